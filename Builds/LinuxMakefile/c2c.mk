@@ -0,0 +1,36 @@
+# False sharing check of loop4r_read, on a board with perf and more than one
+# core:
+#
+#     make -f c2c.mk
+#
+# builds the Release binary and runs the benchmark under "perf c2c record",
+# then prints the cache lines that were hit from more than one core with
+# "perf c2c report". The "pedal queue" benchmark is the one with a second
+# thread, the MIDI input side of the pedal queue, so the lines worth reading
+# are the queue's own and the MIDI input counters next to it. A line with
+# HITM loads from both a store and a load side it doesn't share anything
+# with is what Source/CacheLine.h is for.
+#
+# This file isn't written by the Projucer, so saving the project leaves it be.
+
+BENCH_EVENTS ?= 200000
+
+C2C_DIR := build/c2c
+BINARY := build/loop4r_read
+
+.PHONY: all record report clean
+
+all: report
+
+record:
+	$(MAKE) CONFIG=Release
+	mkdir -p $(C2C_DIR)
+	perf c2c record -o $(C2C_DIR)/perf.data -- $(BINARY) bench $(BENCH_EVENTS) -- < /dev/null > $(C2C_DIR)/bench.log 2>&1
+
+report: record
+	perf c2c report -i $(C2C_DIR)/perf.data --stdio --full-symbols > $(C2C_DIR)/report.txt
+	@grep "ns/event" $(C2C_DIR)/bench.log
+	@sed -n '/Shared Data Cache Line Table/,/^$$/p' $(C2C_DIR)/report.txt
+
+clean:
+	rm -rf $(C2C_DIR)
@@ -0,0 +1,77 @@
+# Profile guided build of loop4r_read, on the board it's going to run on:
+#
+#     make -f pgo.mk
+#
+# builds the Release binary as the baseline, then the PGO configuration
+# instrumented with -fprofile-generate, trains it, and rebuilds it with
+# -fprofile-use and LTO. Training runs the simulator on SIM_PORT, a soak test
+# against it recorded to a trace, a fast replay of that trace (and of TRACE,
+# if given) and the benchmark. At the end the benchmark runs on both binaries
+# and the ns per event are printed side by side, "make -f pgo.mk compare"
+# does only that.
+#
+# This file isn't written by the Projucer, so saving the project leaves it be.
+# The generated "clean" takes all of build/ with it, profile included, so the
+# PGO objects are removed here by hand between the two builds.
+
+BENCH_EVENTS ?= 200000
+SOAK_MINUTES ?= 0.5
+SIM_PORT ?= 9951
+TRACE ?=
+
+PROFILE_DIR := $(abspath build/pgo-profile)
+TRAINING_DIR := build/pgo-training
+BINARY := build/loop4r_read
+BASELINE := build/loop4r_read.release
+OPTIMISED := build/loop4r_read.pgo
+OBJECTS := build/intermediate/PGO
+
+GENERATE_FLAGS := -fprofile-generate=$(PROFILE_DIR) -fprofile-update=prefer-atomic
+USE_FLAGS := -fprofile-use=$(PROFILE_DIR) -fprofile-correction -Wno-missing-profile
+
+.PHONY: all baseline instrumented train optimised compare clean
+
+all: optimised
+	$(MAKE) -f pgo.mk compare
+
+baseline:
+	$(MAKE) CONFIG=Release
+	cp $(BINARY) $(BASELINE)
+
+instrumented: baseline
+	rm -rf $(PROFILE_DIR)
+	rm -rf $(OBJECTS)
+	$(MAKE) CONFIG=PGO CFLAGS="$(GENERATE_FLAGS)" LDFLAGS="$(GENERATE_FLAGS)"
+
+# the exit codes don't matter here, a soak that's too short to judge fails and
+# a replay against the simulator differs from the trace, both still train
+train: instrumented
+	rm -rf $(TRAINING_DIR)
+	mkdir -p $(TRAINING_DIR)
+	$(BINARY) sim $(SIM_PORT) -- < /dev/null > $(TRAINING_DIR)/sim.log 2>&1 & echo $$! > $(TRAINING_DIR)/sim.pid
+	sleep 1
+	-$(BINARY) trace $(TRAINING_DIR)/training.trace soak $(SOAK_MINUTES) -- < /dev/null > $(TRAINING_DIR)/soak.log 2>&1
+	-$(BINARY) replay $(TRAINING_DIR)/training.trace fast -- < /dev/null > $(TRAINING_DIR)/replay.log 2>&1
+	$(if $(TRACE),-$(BINARY) replay $(TRACE) fast -- < /dev/null > $(TRAINING_DIR)/replay-trace.log 2>&1)
+	-$(BINARY) bench $(BENCH_EVENTS) -- < /dev/null > $(TRAINING_DIR)/bench.log 2>&1
+	kill -INT `cat $(TRAINING_DIR)/sim.pid`
+	while kill -0 `cat $(TRAINING_DIR)/sim.pid` 2>/dev/null; do sleep 0.1; done
+
+optimised: train
+	rm -rf $(OBJECTS)
+	$(MAKE) CONFIG=PGO CFLAGS="$(USE_FLAGS)" LDFLAGS="$(USE_FLAGS)"
+	cp $(BINARY) $(OPTIMISED)
+
+compare:
+	@mkdir -p $(TRAINING_DIR)
+	@$(BASELINE) bench $(BENCH_EVENTS) -- < /dev/null 2>&1 | grep "ns/event" > $(TRAINING_DIR)/compare-release.log
+	@$(OPTIMISED) bench $(BENCH_EVENTS) -- < /dev/null 2>&1 | grep "ns/event" > $(TRAINING_DIR)/compare-pgo.log
+	@paste -d '|' $(TRAINING_DIR)/compare-release.log $(TRAINING_DIR)/compare-pgo.log \
+	    | awk -F'|' 'BEGIN { printf "%-18s %13s %12s\n", "", "Release", "PGO" } \
+		{ split($$1, a, "ns/event"); split($$2, b, "ns/event"); \
+		n = split(a[1], before, " "); m = split(b[1], after, " "); \
+		printf "%-18s %10s ns %9s ns  %+.1f%%\n", substr($$1, 1, 18), before[n], after[m], (after[m] / before[n] - 1) * 100 }'
+
+clean:
+	rm -rf $(OBJECTS)
+	rm -rf $(PROFILE_DIR) $(TRAINING_DIR) $(BASELINE) $(OPTIMISED)
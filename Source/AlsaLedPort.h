@@ -0,0 +1,146 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "LedOutput.h"
+
+#if JUCE_LINUX && JUCE_ALSA
+ #include <alsa/asoundlib.h>
+ #include <cerrno>
+#endif
+
+//==============================================================================
+// LED commands as MIDI controllers straight out of our own ALSA sequencer port,
+// skipping the trip through loop4r_leds. The port is opened up front; a batch
+// is queued with snd_seq_event_output and goes to the kernel with a single
+// snd_seq_drain_output, where MidiOutput::sendMessageNow would make a call per
+// message. Only used on the LED writer thread once open.
+class AlsaLedPort : public LedCommandSink
+{
+public:
+    AlsaLedPort() {}
+
+    ~AlsaLedPort()
+    {
+	close();
+    }
+
+    // events our output pool holds, 0 for the default; set before open()
+    void setPoolSize(int output)        { poolOutput_ = output; }
+
+#if JUCE_LINUX && JUCE_ALSA
+    // destination is anything snd_seq_parse_address takes ("20:0", a client
+    // name), or empty to only make the port for others to connect to. channel is 1-16.
+    bool open(const String& destination, int channel)
+    {
+	close();
+	if (snd_seq_open(&seq_, "default", SND_SEQ_OPEN_OUTPUT, 0) < 0)
+	{
+	    seq_ = nullptr;
+	    return false;
+	}
+
+	snd_seq_set_client_name(seq_, "loop4r leds");
+	if (poolOutput_ > 0)
+	{
+	    snd_seq_set_client_pool_output(seq_, (size_t) poolOutput_);
+	}
+	port_ = snd_seq_create_simple_port(seq_, "leds",
+					   SND_SEQ_PORT_CAP_READ | SND_SEQ_PORT_CAP_SUBS_READ,
+					   SND_SEQ_PORT_TYPE_MIDI_GENERIC | SND_SEQ_PORT_TYPE_APPLICATION);
+	if (port_ < 0)
+	{
+	    close();
+	    return false;
+	}
+
+	if (destination.isNotEmpty())
+	{
+	    snd_seq_addr_t address;
+	    if (snd_seq_parse_address(seq_, &address, destination.toRawUTF8()) < 0
+		|| snd_seq_connect_to(seq_, port_, address.client, address.port) < 0)
+	    {
+		close();
+		return false;
+	    }
+	}
+
+	channel_ = jlimit(1, 16, channel) - 1;
+	return true;
+    }
+
+    void close()
+    {
+	if (seq_ != nullptr)
+	{
+	    snd_seq_close(seq_);
+	    seq_ = nullptr;
+	}
+	port_ = -1;
+    }
+
+    bool isOpen() const         { return seq_ != nullptr; }
+
+    void send(int cc, int value) override
+    {
+	if (seq_ == nullptr)
+	{
+	    return;
+	}
+
+	snd_seq_event_t event;
+	snd_seq_ev_clear(&event);
+	snd_seq_ev_set_source(&event, port_);
+	snd_seq_ev_set_subs(&event);
+	snd_seq_ev_set_direct(&event);
+	snd_seq_ev_set_controller(&event, channel_, cc, value);
+	if (snd_seq_event_output(seq_, &event) == -EAGAIN)
+	{
+	    // output buffer full, push out what we have and try once more
+	    snd_seq_drain_output(seq_);
+	    snd_seq_event_output(seq_, &event);
+	}
+    }
+
+    void flush() override
+    {
+	if (seq_ != nullptr)
+	{
+	    snd_seq_drain_output(seq_);
+	}
+    }
+
+private:
+    snd_seq_t* seq_ = nullptr;
+    int port_ = -1;
+    int channel_ = 0;
+#else
+    bool open(const String&, int)       { return false; }
+    void close()                        {}
+    bool isOpen() const                 { return false; }
+    void send(int, int) override        {}
+    void flush() override               {}
+#endif
+
+private:
+    int poolOutput_ = 0;
+
+    JUCE_DECLARE_NON_COPYABLE(AlsaLedPort)
+};
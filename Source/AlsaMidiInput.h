@@ -0,0 +1,583 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include <atomic>
+#include <functional>
+
+#if JUCE_LINUX && JUCE_ALSA
+ #include <alsa/asoundlib.h>
+ #include <cerrno>
+ #include <poll.h>
+ #include <sys/eventfd.h>
+ #include <unistd.h>
+#endif
+
+//==============================================================================
+// MIDI input from our own non-blocking ALSA sequencer port, for callers that
+// poll its descriptors themselves, or read on the thread startReading() gives
+// it, instead of JUCE's input thread. Up to maxSources devices are connected to the one port, each found
+// the way MidiInput names devices ("client" or "client: port", exact match
+// first, then the first that contains the name ignoring case). The sequencer
+// hands us their events merged in the order they arrived, each one is passed
+// on with the index of the source it came from. The port also listens to
+// System:Announce, so when a source goes away and comes back it's connected
+// to again by itself. A source without a name is whoever connects to our
+// port on their own, which is how a virtual input works here.
+//
+// System messages we don't want (MIDI clock, active sensing...) are dropped by
+// the sequencer itself through the client's event filter, so they never wake
+// us up; anything that still gets through is dropped before it's decoded.
+//
+// When events come in faster than we read them the client's input pool
+// fills up and the sequencer throws what doesn't fit away; the next read says
+// so with -ENOSPC. That's counted as an overrun and flagged for takeOverrun(),
+// as whatever pedals were lost went unseen. setPoolSizes() makes the pools
+// bigger than the sequencer's default.
+//
+// Everything but the constructor has to be called from one thread, and while
+// startReading()'s thread runs, only stopReading() and close().
+class AlsaMidiInput
+{
+public:
+    // the three arguments are the source, the message and when poll() came back
+    typedef std::function<void(int, const MidiMessage&, int64)> MessageFunction;
+    // the source and a piece of sysex as the sequencer delivered it
+    typedef std::function<void(int, const uint8*, int)> SysexFunction;
+
+    AlsaMidiInput()
+	: reader_(*this)
+    {
+    }
+
+    ~AlsaMidiInput()
+    {
+	close();
+    }
+
+    static const int maxSources = 8;
+
+#if JUCE_LINUX && JUCE_ALSA
+    static const bool isAvailable = true;
+
+    // the first maxSources of sourceNames, the client named clientName
+    bool open(const StringArray& sourceNames, const String& clientName = "loop4r midi in")
+    {
+	close();
+	if (snd_seq_open(&seq_, "default", SND_SEQ_OPEN_INPUT, SND_SEQ_NONBLOCK) < 0)
+	{
+	    seq_ = nullptr;
+	    return false;
+	}
+
+	snd_seq_set_client_name(seq_, clientName.toRawUTF8());
+	applyPoolSizes();
+	port_ = snd_seq_create_simple_port(seq_, "in",
+					   SND_SEQ_PORT_CAP_WRITE | SND_SEQ_PORT_CAP_SUBS_WRITE,
+					   SND_SEQ_PORT_TYPE_MIDI_GENERIC | SND_SEQ_PORT_TYPE_APPLICATION);
+	if (port_ < 0 || snd_midi_event_new(256, &decoder_) < 0
+	    || snd_seq_connect_from(seq_, port_, SND_SEQ_CLIENT_SYSTEM, SND_SEQ_PORT_SYSTEM_ANNOUNCE) < 0)
+	{
+	    close();
+	    return false;
+	}
+	snd_midi_event_no_status(decoder_, 1);
+	applyEventFilter();
+
+	numSources_ = jmin(sourceNames.size(), (int) maxSources);
+	for (int i = 0; i < numSources_; ++i)
+	{
+	    sources_[i] = Source();
+	    sources_[i].name_ = sourceNames[i];
+	}
+	connectSources();
+	return true;
+    }
+
+    void close()
+    {
+	stopReading();
+	if (decoder_ != nullptr)
+	{
+	    snd_midi_event_free(decoder_);
+	    decoder_ = nullptr;
+	}
+	if (seq_ != nullptr)
+	{
+	    snd_seq_close(seq_);
+	    seq_ = nullptr;
+	}
+	port_ = -1;
+	for (auto&& source : sources_)
+	{
+	    source.connected_ = String();
+	    source.client_ = -1;
+	}
+    }
+
+    // the descriptors to wait on for input
+    Array<int> getFileDescriptors() const
+    {
+	Array<int> fds;
+	if (seq_ != nullptr)
+	{
+	    const int numFds = snd_seq_poll_descriptors_count(seq_, POLLIN);
+	    HeapBlock<pollfd> pfds((size_t) numFds);
+	    snd_seq_poll_descriptors(seq_, pfds, (unsigned int) numFds, POLLIN);
+	    for (int i = 0; i < numFds; ++i)
+	    {
+		fds.add(pfds[i].fd);
+	    }
+	}
+	return fds;
+    }
+
+    // Calls onMessage(int source, const MidiMessage&) for everything that has
+    // arrived. Controllers go to onController(int source, int channel, int
+    // controller, int value) first, straight from the sequencer event; when it
+    // returns false they're decoded and handed to onMessage like the rest.
+    template <typename ControllerFunction, typename Function>
+    void read(ControllerFunction onController, Function onMessage)
+    {
+	if (seq_ == nullptr)
+	{
+	    return;
+	}
+
+	bool sourcesChanged = false;
+	snd_seq_event_t* event = nullptr;
+	for (;;)
+	{
+	    const int result = snd_seq_event_input(seq_, &event);
+	    if (result == -ENOSPC)
+	    {
+		numOverruns_.fetch_add(1, std::memory_order_relaxed);
+		overrun_ = true;
+		continue;
+	    }
+	    if (result < 0 || event == nullptr)
+	    {
+		break;
+	    }
+
+	    if (event->source.client == SND_SEQ_CLIENT_SYSTEM)
+	    {
+		sourcesChanged = sourcesChanged || isPortChange(*event);
+	    }
+	    else if (isDropped(event->type))
+	    {
+		++numDropped_;
+	    }
+	    else
+	    {
+		const int source = findSourceIndex(event->source);
+		if (event->type == SND_SEQ_EVENT_SYSEX && onSysex_ != nullptr)
+		{
+		    onSysex_(source, static_cast<const uint8*>(event->data.ext.ptr), (int) event->data.ext.len);
+		}
+		if (event->type != SND_SEQ_EVENT_CONTROLLER
+		    || !onController(source, event->data.control.channel & 0x0f, (int) (event->data.control.param & 0x7f), event->data.control.value & 0x7f))
+		{
+		    uint8 bytes[256];
+		    const long size = snd_midi_event_decode(decoder_, bytes, sizeof(bytes), event);
+		    if (size > 0)
+		    {
+			onMessage(source, MidiMessage(bytes, (int) size, Time::getMillisecondCounterHiRes() * 0.001));
+		    }
+		}
+	    }
+	    event = nullptr;
+	}
+
+	if (sourcesChanged)
+	{
+	    connectSources();
+	}
+    }
+
+    // Reads on a thread of our own from now on, which sleeps in poll() with no
+    // timeout until there's input, or until stopReading() wakes it through an
+    // eventfd, so it neither wakes up while idle nor keeps a stop waiting.
+    // Controllers are decoded like everything else and handed to onMessage
+    // on that thread. Only stopReading() and close() may be called meanwhile.
+    bool startReading(MessageFunction onMessage)
+    {
+	if (seq_ == nullptr || wakeFd_ >= 0)
+	{
+	    return false;
+	}
+	wakeFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (wakeFd_ < 0)
+	{
+	    return false;
+	}
+	onMessage_ = onMessage;
+	reader_.startThread(9);
+	return true;
+    }
+
+    void stopReading()
+    {
+	if (wakeFd_ >= 0)
+	{
+	    reader_.signalThreadShouldExit();
+	    const uint64 one = 1;
+	    (void) ::write(wakeFd_, &one, sizeof(one));
+	    reader_.stopThread(1000);
+	    ::close(wakeFd_);
+	    wakeFd_ = -1;
+	}
+    }
+
+    // bit n for status 0xf0 + n, see MidiInputFilter; a reading thread is
+    // stopped while the filter changes
+    void setDroppedStatuses(uint32 statuses)
+    {
+	const bool reading = wakeFd_ >= 0;
+	stopReading();
+	droppedStatuses_ = statuses;
+	if (seq_ != nullptr)
+	{
+	    applyEventFilter();
+	}
+	if (reading)
+	{
+	    startReading(onMessage_);
+	}
+    }
+#else
+    static const bool isAvailable = false;
+
+    bool open(const StringArray&, const String& = String())    { return false; }
+    bool startReading(MessageFunction)  { return false; }
+    void stopReading()                  {}
+    void setDroppedStatuses(uint32 statuses)    { droppedStatuses_ = statuses; }
+    void close()                        {}
+    Array<int> getFileDescriptors() const   { return {}; }
+    template <typename ControllerFunction, typename Function>
+    void read(ControllerFunction, Function) {}
+#endif
+
+    bool isOpen() const                 { return port_ >= 0; }
+    int64 getNumDropped() const         { return numDropped_; }
+    int64 getNumOverruns() const        { return numOverruns_.load(std::memory_order_relaxed); }
+
+    // events the client's input and output pools hold, 0 for the default;
+    // for a port already open they change with the next open
+    void setPoolSizes(int input, int output)
+    {
+	poolInput_ = input;
+	poolOutput_ = output;
+    }
+
+    // true once after input was lost to an overrun, from any thread
+    bool takeOverrun()                  { return overrun_.load() && overrun_.exchange(false); }
+
+    // sysex events also go to onSysex as they are, before they're decoded;
+    // not while reading
+    void setSysexFunction(SysexFunction onSysex)    { onSysex_ = onSysex; }
+
+    int getNumSources() const           { return numSources_; }
+    const String& getSourceName(int source) const   { return sources_[source].name_; }
+
+    // the device a source is connected to, empty while there's none
+    const String& getSource(int source) const       { return sources_[source].connected_; }
+
+private:
+    class Reader : public Thread
+    {
+    public:
+	Reader(AlsaMidiInput& owner)
+	    : Thread("loop4r midi in"), owner_(owner)
+	{
+	}
+
+	void run() override
+	{
+	    owner_.runReader();
+	}
+
+    private:
+	AlsaMidiInput& owner_;
+    };
+
+    struct Source
+    {
+	String name_;           // as asked for
+	String connected_;      // the device's own name while connected
+	int client_ = -1;
+	int port_ = -1;
+    };
+
+#if JUCE_LINUX && JUCE_ALSA
+    void runReader()
+    {
+	Array<int> fds = getFileDescriptors();
+	HeapBlock<pollfd> pfds((size_t) fds.size() + 1);
+	for (int i = 0; i < fds.size(); ++i)
+	{
+	    pfds[i] = { fds[i], POLLIN, 0 };
+	}
+	pfds[fds.size()] = { wakeFd_, POLLIN, 0 };
+
+	while (!reader_.threadShouldExit())
+	{
+	    if (poll(pfds, (nfds_t) fds.size() + 1, -1) < 0 && errno != EINTR)
+	    {
+		break;
+	    }
+	    if (reader_.threadShouldExit())
+	    {
+		break;
+	    }
+	    const int64 ticks = Time::getHighResolutionTicks();
+	    read([] (int, int, int, int) { return false; },
+		 [this, ticks] (int source, const MidiMessage& message) { onMessage_(source, message, ticks); });
+	}
+    }
+
+    // sequencer event types for the system statuses, -1 where there's none
+    static int eventTypeForStatus(int nibble)
+    {
+	switch (nibble)
+	{
+	    case 0x0:
+	    case 0x7:   return SND_SEQ_EVENT_SYSEX;
+	    case 0x1:   return SND_SEQ_EVENT_QFRAME;
+	    case 0x2:   return SND_SEQ_EVENT_SONGPOS;
+	    case 0x3:   return SND_SEQ_EVENT_SONGSEL;
+	    case 0x6:   return SND_SEQ_EVENT_TUNE_REQUEST;
+	    case 0x8:   return SND_SEQ_EVENT_CLOCK;
+	    case 0x9:   return SND_SEQ_EVENT_TICK;
+	    case 0xa:   return SND_SEQ_EVENT_START;
+	    case 0xb:   return SND_SEQ_EVENT_CONTINUE;
+	    case 0xc:   return SND_SEQ_EVENT_STOP;
+	    case 0xe:   return SND_SEQ_EVENT_SENSING;
+	    case 0xf:   return SND_SEQ_EVENT_RESET;
+	    default:    return -1;
+	}
+    }
+
+    bool isDropped(int eventType) const
+    {
+	for (int nibble = 0; nibble < 16 && droppedStatuses_ != 0; ++nibble)
+	{
+	    if (((droppedStatuses_ >> nibble) & 1) != 0 && eventTypeForStatus(nibble) == eventType)
+	    {
+		return true;
+	    }
+	}
+	return false;
+    }
+
+    // The filter lists the types that may be delivered, so with nothing to
+    // drop it's left empty (everything), otherwise it's what we decode and
+    // the announcements minus the dropped types.
+    void applyPoolSizes()
+    {
+	if (poolInput_ > 0)
+	{
+	    snd_seq_set_client_pool_input(seq_, (size_t) poolInput_);
+	}
+	if (poolOutput_ > 0)
+	{
+	    snd_seq_set_client_pool_output(seq_, (size_t) poolOutput_);
+	}
+    }
+
+    void applyEventFilter()
+    {
+	snd_seq_client_info_t* info;
+	snd_seq_client_info_alloca(&info);
+	if (snd_seq_get_client_info(seq_, info) < 0)
+	{
+	    return;
+	}
+	snd_seq_client_info_event_filter_clear(info);
+	if (droppedStatuses_ != 0)
+	{
+	    static const int channelTypes[] = {
+		SND_SEQ_EVENT_NOTE, SND_SEQ_EVENT_NOTEON, SND_SEQ_EVENT_NOTEOFF, SND_SEQ_EVENT_KEYPRESS,
+		SND_SEQ_EVENT_CONTROLLER, SND_SEQ_EVENT_PGMCHANGE, SND_SEQ_EVENT_CHANPRESS, SND_SEQ_EVENT_PITCHBEND,
+		SND_SEQ_EVENT_CONTROL14, SND_SEQ_EVENT_NONREGPARAM, SND_SEQ_EVENT_REGPARAM,
+		SND_SEQ_EVENT_CLIENT_START, SND_SEQ_EVENT_CLIENT_EXIT, SND_SEQ_EVENT_CLIENT_CHANGE,
+		SND_SEQ_EVENT_PORT_START, SND_SEQ_EVENT_PORT_EXIT, SND_SEQ_EVENT_PORT_CHANGE,
+		SND_SEQ_EVENT_PORT_SUBSCRIBED, SND_SEQ_EVENT_PORT_UNSUBSCRIBED
+	    };
+	    for (int type : channelTypes)
+	    {
+		snd_seq_client_info_event_filter_add(info, type);
+	    }
+	    for (int nibble = 0; nibble < 16; ++nibble)
+	    {
+		const int type = eventTypeForStatus(nibble);
+		if (type >= 0 && !isDropped(type))
+		{
+		    snd_seq_client_info_event_filter_add(info, type);
+		}
+	    }
+	}
+	snd_seq_set_client_info(seq_, info);
+    }
+
+    bool isPortChange(const snd_seq_event_t& event) const
+    {
+	switch (event.type)
+	{
+	    case SND_SEQ_EVENT_PORT_START:
+	    case SND_SEQ_EVENT_PORT_EXIT:
+	    case SND_SEQ_EVENT_PORT_UNSUBSCRIBED:
+		return event.data.addr.client != snd_seq_client_id(seq_);
+	    default:
+		return false;
+	}
+    }
+
+    // events from anyone we didn't connect count as the unnamed source's, or
+    // the first source's if there's none
+    int findSourceIndex(const snd_seq_addr_t& address) const
+    {
+	int unnamed = 0;
+	for (int i = 0; i < numSources_; ++i)
+	{
+	    if (sources_[i].client_ == address.client && sources_[i].port_ == address.port)
+	    {
+		return i;
+	    }
+	    if (sources_[i].name_.isEmpty())
+	    {
+		unnamed = i;
+	    }
+	}
+	return unnamed;
+    }
+
+    // (re)connects to each source that's there, or notes that it's gone
+    void connectSources()
+    {
+	for (int i = 0; i < numSources_; ++i)
+	{
+	    connectSource(sources_[i]);
+	}
+    }
+
+    void connectSource(Source& source)
+    {
+	if (source.name_.isEmpty())
+	{
+	    return;
+	}
+	snd_seq_addr_t address;
+	String name;
+	if (!findSource(source.name_, address, name))
+	{
+	    if (source.connected_.isNotEmpty())
+	    {
+		std::cerr << "MIDI input port \"" << source.connected_ << "\" got disconnected, waiting." << std::endl;
+	    }
+	    source.connected_ = String();
+	    source.client_ = -1;
+	    return;
+	}
+	if (name == source.connected_)
+	{
+	    return;
+	}
+
+	const int result = snd_seq_connect_from(seq_, port_, address.client, address.port);
+	if (result < 0 && result != -EBUSY)
+	{
+	    return;
+	}
+	source.connected_ = name;
+	source.client_ = address.client;
+	source.port_ = address.port;
+	std::cerr << "Connected to MIDI input port \"" << source.connected_ << "\"." << std::endl;
+    }
+
+    bool findSource(const String& sourceName, snd_seq_addr_t& address, String& name) const
+    {
+	bool found = false;
+	snd_seq_client_info_t* client;
+	snd_seq_port_info_t* port;
+	snd_seq_client_info_alloca(&client);
+	snd_seq_port_info_alloca(&port);
+	snd_seq_client_info_set_client(client, -1);
+	while (snd_seq_query_next_client(seq_, client) >= 0)
+	{
+	    const int clientId = snd_seq_client_info_get_client(client);
+	    if (clientId == snd_seq_client_id(seq_) || clientId == SND_SEQ_CLIENT_SYSTEM)
+	    {
+		continue;
+	    }
+	    snd_seq_port_info_set_client(port, clientId);
+	    snd_seq_port_info_set_port(port, -1);
+	    while (snd_seq_query_next_port(seq_, port) >= 0)
+	    {
+		const unsigned int caps = SND_SEQ_PORT_CAP_READ | SND_SEQ_PORT_CAP_SUBS_READ;
+		if ((snd_seq_port_info_get_capability(port) & caps) != caps)
+		{
+		    continue;
+		}
+
+		const String clientName = snd_seq_client_info_get_name(client);
+		const String portName = snd_seq_port_info_get_name(port);
+		const String deviceName = clientName == portName ? clientName : clientName + ": " + portName;
+		const bool exact = deviceName == sourceName;
+		if (exact || (!found && deviceName.containsIgnoreCase(sourceName)))
+		{
+		    address.client = (unsigned char) clientId;
+		    address.port = (unsigned char) snd_seq_port_info_get_port(port);
+		    name = deviceName;
+		    found = true;
+		    if (exact)
+		    {
+			return true;
+		    }
+		}
+	    }
+	}
+	return found;
+    }
+
+    snd_seq_t* seq_ = nullptr;
+    snd_midi_event_t* decoder_ = nullptr;
+    int wakeFd_ = -1;
+#else
+    void runReader()                    {}
+#endif
+
+    Reader reader_;
+    MessageFunction onMessage_;
+    SysexFunction onSysex_;
+
+    int port_ = -1;
+    uint32 droppedStatuses_ = 0;
+    int64 numDropped_ = 0;
+    int poolInput_ = 0;
+    int poolOutput_ = 0;
+    std::atomic<int64> numOverruns_ { 0 };
+    std::atomic<bool> overrun_ { false };
+    Source sources_[maxSources];
+    int numSources_ = 0;
+
+    JUCE_DECLARE_NON_COPYABLE(AlsaMidiInput)
+};
@@ -0,0 +1,269 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "AlsaMidiInput.h"
+#include <atomic>
+
+#if JUCE_LINUX && JUCE_ALSA
+ #include <alsa/asoundlib.h>
+ #include <cerrno>
+#endif
+
+//==============================================================================
+// "thru": subscriptions made in the ALSA sequencer from each MIDI input
+// device straight to the MIDI output device, the way aconnect makes them, so
+// what the board sends is forwarded by the kernel and never comes up to us to
+// be sent on. Devices are found by name like AlsaMidiInput finds them.
+//
+// A subscription carries everything its sender sends; the sequencer filters
+// events only for the client receiving them, and the output isn't ours. Our
+// own input still gets its copy of every event, for the pedals.
+//
+// The subscriptions outlive our client, so close() takes them down again.
+// refresh() makes them again for ports that went away and came back.
+// isForwarding() may be called from any thread, the rest from one.
+class AlsaMidiThru
+{
+public:
+    static const int maxSources = AlsaMidiInput::maxSources;
+
+    AlsaMidiThru()
+    {
+	for (auto&& forwarding : forwarding_)
+	{
+	    forwarding = false;
+	}
+    }
+
+    ~AlsaMidiThru()
+    {
+	close();
+    }
+
+    // true while the sequencer forwards input source to the output
+    bool isForwarding(int source) const
+    {
+	return source >= 0 && source < maxSources && forwarding_[source].load(std::memory_order_relaxed);
+    }
+
+    // subscriptions made, again after a port came back included
+    int64 getNumConnects() const        { return numConnects_; }
+
+#if JUCE_LINUX && JUCE_ALSA
+    static const bool isAvailable = true;
+
+    // an empty source name is skipped (a virtual input, one we read ourselves)
+    bool open(const StringArray& sourceNames, const String& destinationName)
+    {
+	close();
+	if (snd_seq_open(&seq_, "default", SND_SEQ_OPEN_DUPLEX, 0) < 0)
+	{
+	    seq_ = nullptr;
+	    return false;
+	}
+	snd_seq_set_client_name(seq_, "loop4r thru");
+
+	numSources_ = jmin(sourceNames.size(), (int) maxSources);
+	for (int i = 0; i < numSources_; ++i)
+	{
+	    sources_[i] = Pair();
+	    sources_[i].name_ = sourceNames[i];
+	}
+	destinationName_ = destinationName;
+	refresh();
+	return true;
+    }
+
+    void close()
+    {
+	if (seq_ == nullptr)
+	{
+	    return;
+	}
+	for (int i = 0; i < numSources_; ++i)
+	{
+	    if (forwarding_[i].load())
+	    {
+		unsubscribe(sources_[i]);
+	    }
+	    forwarding_[i] = false;
+	}
+	snd_seq_close(seq_);
+	seq_ = nullptr;
+	numSources_ = 0;
+    }
+
+    bool isOpen() const                 { return seq_ != nullptr; }
+
+    void refresh()
+    {
+	if (seq_ == nullptr)
+	{
+	    return;
+	}
+	snd_seq_addr_t destination;
+	String destinationFullName;
+	const bool hasDestination = findPort(destinationName_, SND_SEQ_PORT_CAP_WRITE | SND_SEQ_PORT_CAP_SUBS_WRITE, destination, destinationFullName);
+	for (int i = 0; i < numSources_; ++i)
+	{
+	    Pair& pair = sources_[i];
+	    snd_seq_addr_t source;
+	    String sourceFullName;
+	    const bool connectable = hasDestination && pair.name_.isNotEmpty()
+		&& findPort(pair.name_, SND_SEQ_PORT_CAP_READ | SND_SEQ_PORT_CAP_SUBS_READ, source, sourceFullName);
+	    if (connectable && forwarding_[i].load() && isSame(pair.source_, source) && isSame(pair.destination_, destination)
+		&& isSubscribed(pair))
+	    {
+		continue;
+	    }
+
+	    // gone, moved, or taken down by the sequencer with a port that went away
+	    if (forwarding_[i].load())
+	    {
+		unsubscribe(pair);
+		forwarding_[i] = false;
+	    }
+	    if (!connectable)
+	    {
+		continue;
+	    }
+	    pair.source_ = source;
+	    pair.destination_ = destination;
+	    if (subscribe(pair))
+	    {
+		forwarding_[i] = true;
+		++numConnects_;
+		std::cerr << "MIDI thru: \"" << sourceFullName << "\" is forwarded to \"" << destinationFullName << "\" by the sequencer." << std::endl;
+	    }
+	}
+    }
+
+private:
+    struct Pair
+    {
+	String name_;
+	snd_seq_addr_t source_ = {};
+	snd_seq_addr_t destination_ = {};
+    };
+
+    static bool isSame(const snd_seq_addr_t& a, const snd_seq_addr_t& b)
+    {
+	return a.client == b.client && a.port == b.port;
+    }
+
+    // a port with caps called name ("client" or "client: port") or else the
+    // first with name in it
+    bool findPort(const String& name, unsigned int caps, snd_seq_addr_t& address, String& fullName) const
+    {
+	bool found = false;
+	snd_seq_client_info_t* client;
+	snd_seq_port_info_t* port;
+	snd_seq_client_info_alloca(&client);
+	snd_seq_port_info_alloca(&port);
+	snd_seq_client_info_set_client(client, -1);
+	while (name.isNotEmpty() && snd_seq_query_next_client(seq_, client) >= 0)
+	{
+	    const int clientId = snd_seq_client_info_get_client(client);
+	    if (clientId == snd_seq_client_id(seq_) || clientId == SND_SEQ_CLIENT_SYSTEM)
+	    {
+		continue;
+	    }
+	    snd_seq_port_info_set_client(port, clientId);
+	    snd_seq_port_info_set_port(port, -1);
+	    while (snd_seq_query_next_port(seq_, port) >= 0)
+	    {
+		if ((snd_seq_port_info_get_capability(port) & caps) != caps)
+		{
+		    continue;
+		}
+
+		const String clientName = snd_seq_client_info_get_name(client);
+		const String portName = snd_seq_port_info_get_name(port);
+		const String deviceName = clientName == portName ? clientName : clientName + ": " + portName;
+		const bool exact = deviceName == name;
+		if (exact || (!found && deviceName.containsIgnoreCase(name)))
+		{
+		    address.client = (unsigned char) clientId;
+		    address.port = (unsigned char) snd_seq_port_info_get_port(port);
+		    fullName = deviceName;
+		    found = true;
+		    if (exact)
+		    {
+			return true;
+		    }
+		}
+	    }
+	}
+	return found;
+    }
+
+    static void describe(const Pair& pair, snd_seq_port_subscribe_t* subscription)
+    {
+	snd_seq_port_subscribe_set_sender(subscription, &pair.source_);
+	snd_seq_port_subscribe_set_dest(subscription, &pair.destination_);
+    }
+
+    bool subscribe(const Pair& pair)
+    {
+	snd_seq_port_subscribe_t* subscription;
+	snd_seq_port_subscribe_alloca(&subscription);
+	describe(pair, subscription);
+	// already there (left by someone else) is as good
+	const int result = snd_seq_subscribe_port(seq_, subscription);
+	return result >= 0 || result == -EBUSY;
+    }
+
+    void unsubscribe(const Pair& pair)
+    {
+	snd_seq_port_subscribe_t* subscription;
+	snd_seq_port_subscribe_alloca(&subscription);
+	describe(pair, subscription);
+	snd_seq_unsubscribe_port(seq_, subscription);
+    }
+
+    bool isSubscribed(const Pair& pair) const
+    {
+	snd_seq_port_subscribe_t* subscription;
+	snd_seq_port_subscribe_alloca(&subscription);
+	describe(pair, subscription);
+	return snd_seq_get_port_subscription(seq_, subscription) >= 0;
+    }
+
+    snd_seq_t* seq_ = nullptr;
+    Pair sources_[maxSources];
+    String destinationName_;
+#else
+    static const bool isAvailable = false;
+
+    bool open(const StringArray&, const String&)    { return false; }
+    void close()                        {}
+    bool isOpen() const                 { return false; }
+    void refresh()                      {}
+
+private:
+#endif
+    int numSources_ = 0;
+    std::atomic<bool> forwarding_[maxSources];
+    int64 numConnects_ = 0;
+
+    JUCE_DECLARE_NON_COPYABLE(AlsaMidiThru)
+};
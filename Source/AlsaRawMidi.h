@@ -0,0 +1,426 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "LockFreeQueue.h"
+#include <atomic>
+#include <functional>
+
+#if JUCE_LINUX
+ #include <cerrno>
+ #include <poll.h>
+ #include <unistd.h>
+#endif
+#if JUCE_LINUX && JUCE_ALSA
+ #include <alsa/asoundlib.h>
+#endif
+
+//==============================================================================
+// Turns a MIDI byte stream into messages: running status, realtime bytes in
+// the middle of a message, and system common messages cancelling the running
+// status. Sysex is skipped, or passed on as it is if there's onSysex, as is
+// data with no status to go with it.
+class RunningStatusDecoder
+{
+public:
+    // onMessage(const uint8* data, int size) for each complete message
+    template <typename Function>
+    void feed(const uint8* bytes, int numBytes, Function&& onMessage)
+    {
+	feed(bytes, numBytes, onMessage, [] (const uint8*, int) {});
+    }
+
+    // and onSysex(const uint8* data, int size) with the sysex bytes in runs as
+    // they are here, F0 to F7 or whichever status byte cuts it short, without
+    // the realtime messages in the middle
+    template <typename Function, typename SysexFunction>
+    void feed(const uint8* bytes, int numBytes, Function&& onMessage, SysexFunction&& onSysex)
+    {
+	int sysexStart = inSysex_ ? 0 : -1;
+	for (int i = 0; i < numBytes; ++i)
+	{
+	    const uint8 byte = bytes[i];
+	    if (byte >= 0xf8)
+	    {
+		if (sysexStart >= 0)
+		{
+		    if (i > sysexStart)
+		    {
+			onSysex(bytes + sysexStart, i - sysexStart);
+		    }
+		    sysexStart = i + 1;
+		}
+		onMessage(&byte, 1);
+		continue;
+	    }
+	    if ((byte & 0x80) != 0)
+	    {
+		// the byte that ends it goes with it, unless it's the next one's F0
+		const int sysexEnd = byte == 0xf0 ? i : i + 1;
+		if (inSysex_ && sysexEnd > sysexStart)
+		{
+		    onSysex(bytes + sysexStart, sysexEnd - sysexStart);
+		}
+		sysexStart = byte == 0xf0 ? i : -1;
+		inSysex_ = byte == 0xf0;
+		status_ = byte == 0xf0 || byte == 0xf7 ? 0 : byte;
+		numData_ = 0;
+		if (status_ >= 0xf0 && getNumDataBytes(status_) == 0)
+		{
+		    onMessage(&status_, 1);
+		    status_ = 0;
+		}
+		continue;
+	    }
+	    if (inSysex_ || status_ == 0)
+	    {
+		++numSkipped_;
+		continue;
+	    }
+
+	    message_[++numData_] = byte;
+	    if (numData_ == getNumDataBytes(status_))
+	    {
+		message_[0] = status_;
+		onMessage(message_, numData_ + 1);
+		numData_ = 0;
+		if (status_ >= 0xf0)
+		{
+		    status_ = 0;
+		}
+	    }
+	}
+	if (sysexStart >= 0 && sysexStart < numBytes)
+	{
+	    onSysex(bytes + sysexStart, numBytes - sysexStart);
+	}
+    }
+
+    void reset()
+    {
+	status_ = 0;
+	numData_ = 0;
+	inSysex_ = false;
+    }
+
+    int64 getNumSkipped() const     { return numSkipped_; }
+
+    static int getNumDataBytes(uint8 status)
+    {
+	switch (status & 0xf0)
+	{
+	    case 0xc0:
+	    case 0xd0:  return 1;
+	    case 0xf0:  return status == 0xf2 ? 2 : (status == 0xf1 || status == 0xf3) ? 1 : 0;
+	    default:    return 2;
+	}
+    }
+
+private:
+    uint8 status_ = 0;
+    uint8 message_[3] = { 0, 0, 0 };
+    int numData_ = 0;
+    bool inSysex_ = false;
+    int64 numSkipped_ = 0;
+};
+
+//==============================================================================
+// A MIDI input that's a byte stream we read ourselves: its bytes go through
+// a RunningStatusDecoder and come out as messages, either from read() on a
+// thread that watches the file descriptors ("epoll"), or from a thread of its
+// own that waits on them without a timeout and queues them for popMessage(),
+// stamped with when poll() came back. Either way a device that goes away
+// leaves the input lost until it's closed. What the device is and how it's
+// read is up to the subclass.
+class ByteStreamMidiInput : private Thread
+{
+public:
+    static const int queueSize = 256;
+
+    struct Event
+    {
+	uint8 data_[3];
+	uint8 size_;
+	int64 ticks_;       // Time::getHighResolutionTicks() when the bytes were there
+    };
+
+    ByteStreamMidiInput(const String& threadName)
+	: Thread(threadName), queue_(queueSize)
+    {
+    }
+
+    virtual ~ByteStreamMidiInput() {}
+
+    virtual bool open(const String& device) = 0;
+    virtual bool isOpen() const = 0;
+    virtual Array<int> getFileDescriptors() const = 0;
+
+    void close()
+    {
+	stopReading();
+	closeDevice();
+    }
+
+    bool isLost() const                 { return lost_.load(); }
+
+    // onSysex(const uint8* data, int size) gets the sysex as it is read, see
+    // RunningStatusDecoder; before open()
+    void setSysexFunction(std::function<void(const uint8*, int)> onSysex)
+    {
+	onSysex_ = onSysex;
+    }
+
+    // everything that's waiting, onMessage(const uint8* data, int size) per
+    // message; false once the device has gone away
+    template <typename Function>
+    bool read(Function&& onMessage)
+    {
+	uint8 bytes[256];
+	for (;;)
+	{
+	    const int count = readBytes(bytes, (int) sizeof(bytes));
+	    if (count == 0)
+	    {
+		return true;
+	    }
+	    if (count < 0)
+	    {
+		lost_ = true;
+		return false;
+	    }
+	    numBytes_.fetch_add(count, std::memory_order_relaxed);
+	    if (onSysex_ != nullptr)
+	    {
+		decoder_.feed(bytes, count, onMessage, onSysex_);
+	    }
+	    else
+	    {
+		decoder_.feed(bytes, count, onMessage);
+	    }
+	}
+    }
+
+#if JUCE_LINUX
+    // starts the thread, which calls onInput whenever it has queued something
+    bool startReading(std::function<void()> onInput)
+    {
+	if (!isOpen() || pipe(wakePipe_) < 0)
+	{
+	    return false;
+	}
+	onInput_ = onInput;
+	startThread(9);
+	return true;
+    }
+
+    void stopReading()
+    {
+	if (wakePipe_[1] >= 0)
+	{
+	    signalThreadShouldExit();
+	    const char byte = 0;
+	    if (::write(wakePipe_[1], &byte, 1) < 0)
+	    {
+		// the thread still sees threadShouldExit within stopThread's wait
+	    }
+	    stopThread(1000);
+	    ::close(wakePipe_[0]);
+	    ::close(wakePipe_[1]);
+	    wakePipe_[0] = wakePipe_[1] = -1;
+	}
+    }
+#else
+    bool startReading(std::function<void()>)    { return false; }
+    void stopReading()                  {}
+#endif
+
+    // whoever startReading's onInput wakes
+    bool popMessage(Event& event)
+    {
+	return queue_.pop(event);
+    }
+
+    int64 getNumBytes() const           { return numBytes_.load(); }
+    int64 getNumDropped() const         { return numDropped_.load(); }
+
+    // when the message read() just handed over was sent, for an input that
+    // knows, 0 for when it was read
+    int64 getStreamTicks() const        { return streamTicks_; }
+
+protected:
+    // whatever's there without waiting: the number of bytes, 0 for none and
+    // less than that once the device has gone away
+    virtual int readBytes(uint8* buffer, int size) = 0;
+    virtual void closeDevice() = 0;
+
+    // for open()
+    void opened()
+    {
+	decoder_.reset();
+	lost_ = false;
+    }
+
+    int64 streamTicks_ = 0;     // set by readBytes() for the bytes it gives, see getStreamTicks()
+
+private:
+#if JUCE_LINUX
+    void run() override
+    {
+	Array<int> fds = getFileDescriptors();
+	struct pollfd pfds[5];
+	const int numFds = jmin(fds.size(), 4);
+	for (int i = 0; i < numFds; ++i)
+	{
+	    pfds[i] = { fds[i], POLLIN, 0 };
+	}
+	pfds[numFds] = { wakePipe_[0], POLLIN, 0 };
+
+	while (!threadShouldExit())
+	{
+	    if (poll(pfds, (nfds_t) numFds + 1, -1) < 0 && errno != EINTR)
+	    {
+		break;
+	    }
+	    if (threadShouldExit())
+	    {
+		break;
+	    }
+
+	    const int64 ticks = Time::getHighResolutionTicks();
+	    bool queued = false;
+	    const bool ok = read([this, &queued, ticks] (const uint8* data, int size)
+	    {
+		Event event = { { 0, 0, 0 }, (uint8) size, streamTicks_ != 0 ? streamTicks_ : ticks };
+		memcpy(event.data_, data, (size_t) size);
+		if (queue_.push(event))
+		{
+		    queued = true;
+		}
+		else
+		{
+		    numDropped_.fetch_add(1, std::memory_order_relaxed);
+		}
+	    });
+	    if (queued)
+	    {
+		onInput_();
+	    }
+	    if (!ok)
+	    {
+		break;
+	    }
+	}
+    }
+
+    int wakePipe_[2] = { -1, -1 };
+#else
+    void run() override {}
+#endif
+
+    RunningStatusDecoder decoder_;
+    std::function<void()> onInput_;
+    std::function<void(const uint8*, int)> onSysex_;
+    SpscQueue<Event> queue_;            // reading thread -> onInput's
+    std::atomic<bool> lost_ { false };
+    std::atomic<int64> numBytes_ { 0 };
+    std::atomic<int64> numDropped_ { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE(ByteStreamMidiInput)
+};
+
+//==============================================================================
+// A MIDI input straight from the hardware with snd_rawmidi, which has the
+// device to itself, rather than a sequencer port.
+class AlsaRawMidiInput : public ByteStreamMidiInput
+{
+public:
+    AlsaRawMidiInput()
+	: ByteStreamMidiInput("loop4r raw midi")
+    {
+    }
+
+    ~AlsaRawMidiInput()
+    {
+	close();
+    }
+
+#if JUCE_LINUX && JUCE_ALSA
+    // device is an ALSA rawmidi name, e.g. "hw:1,0,0"
+    bool open(const String& device) override
+    {
+	close();
+	if (snd_rawmidi_open(&handle_, nullptr, device.toRawUTF8(), SND_RAWMIDI_NONBLOCK) < 0)
+	{
+	    handle_ = nullptr;
+	    return false;
+	}
+	opened();
+	return true;
+    }
+
+    Array<int> getFileDescriptors() const override
+    {
+	Array<int> fds;
+	if (handle_ != nullptr)
+	{
+	    struct pollfd pfds[4];
+	    const int count = snd_rawmidi_poll_descriptors(handle_, pfds, 4);
+	    for (int i = 0; i < count; ++i)
+	    {
+		fds.add(pfds[i].fd);
+	    }
+	}
+	return fds;
+    }
+#else
+    bool open(const String&) override   { return false; }
+    Array<int> getFileDescriptors() const override  { return {}; }
+#endif
+
+    bool isOpen() const override        { return handle_ != nullptr; }
+
+private:
+#if JUCE_LINUX && JUCE_ALSA
+    int readBytes(uint8* buffer, int size) override
+    {
+	const ssize_t count = snd_rawmidi_read(handle_, buffer, (size_t) size);
+	return count == -EAGAIN ? 0 : (int) count;
+    }
+
+    void closeDevice() override
+    {
+	if (handle_ != nullptr)
+	{
+	    snd_rawmidi_close(handle_);
+	    handle_ = nullptr;
+	}
+    }
+
+    snd_rawmidi_t* handle_ = nullptr;
+#else
+    int readBytes(uint8*, int) override { return 0; }
+    void closeDevice() override         {}
+
+    void* handle_ = nullptr;
+#endif
+
+    JUCE_DECLARE_NON_COPYABLE(AlsaRawMidiInput)
+};
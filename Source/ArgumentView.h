@@ -0,0 +1,185 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include <cstring>
+
+//==============================================================================
+// A command option read in place, string_view style: a pointer into the
+// String's UTF-8 and a length, so numbers and note names parse without the
+// upper-cased and trimmed copies String would make for each one. Every
+// number in a script or on the stdin command stream goes through here.
+// The results match what String gave before: decimal reads an optional
+// '-' and the leading digits, hex skips anything that isn't a hex digit,
+// the way getIntValue() and getHexValue32() do.
+class ArgumentView
+{
+public:
+    ArgumentView(const char* data, size_t size) : data_(data), size_(size) {}
+
+    explicit ArgumentView(const String& text)
+	: data_(text.toRawUTF8()), size_(text.getNumBytesAsUTF8())
+    {
+    }
+
+    size_t size() const             { return size_; }
+    bool isEmpty() const            { return size_ == 0; }
+    char operator[](size_t i) const { return data_[i]; }
+    char back() const               { return size_ > 0 ? data_[size_ - 1] : 0; }
+
+    ArgumentView dropBack(size_t n) const
+    {
+	return ArgumentView(data_, n < size_ ? size_ - n : 0);
+    }
+
+    // 12, 12M for decimal and 0CH for hex whatever the default, otherwise
+    // the default decides
+    int asDecOrHex(bool hexByDefault) const
+    {
+	const char suffix = back();
+	if (suffix == 'H' || suffix == 'h')
+	{
+	    return dropBack(1).asHex();
+	}
+	if (suffix == 'M' || suffix == 'm')
+	{
+	    return asDecimal();
+	}
+	return hexByDefault ? asHex() : asDecimal();
+    }
+
+    int asDecimal() const
+    {
+	size_t i = 0;
+	while (i < size_ && isWhitespace(data_[i]))
+	{
+	    ++i;
+	}
+	const bool negative = i < size_ && data_[i] == '-';
+	if (negative)
+	{
+	    ++i;
+	}
+	int value = 0;
+	for (; i < size_ && isDigit(data_[i]); ++i)
+	{
+	    value = 10 * value + (data_[i] - '0');
+	}
+	return negative ? -value : value;
+    }
+
+    int asHex() const
+    {
+	uint32 value = 0;
+	for (size_t i = 0; i < size_; ++i)
+	{
+	    const int digit = getTables().hexDigits_[(uint8) data_[i]];
+	    if (digit >= 0)
+	    {
+		value = (value << 4) | (uint32) digit;
+	    }
+	}
+	return (int) value;
+    }
+
+    // the digits at the end, negative when they follow a '-'
+    int trailingInt() const
+    {
+	int value = 0;
+	int scale = 1;
+	for (size_t i = size_; i-- > 0;)
+	{
+	    if (!isDigit(data_[i]))
+	    {
+		return data_[i] == '-' ? -value : value;
+	    }
+	    value += scale * (data_[i] - '0');
+	    scale *= 10;
+	}
+	return value;
+    }
+
+    // C4, F#2, Bb-1 (H for B, any case) as a MIDI note with middle C in
+    // octave middleC, false when it doesn't look like a note name
+    bool asNoteName(int middleC, int& note) const
+    {
+	if (size_ < 2 || !isDigit(back()))
+	{
+	    return false;
+	}
+	const int semitone = getTables().semitones_[(uint8) data_[0]];
+	if (semitone < 0)
+	{
+	    return false;
+	}
+
+	note = semitone;
+	if (data_[1] == 'B' || data_[1] == 'b')
+	{
+	    note -= 1;
+	}
+	else if (data_[1] == '#')
+	{
+	    note += 1;
+	}
+	note += (trailingInt() + 5 - middleC) * 12;
+	return true;
+    }
+
+private:
+    struct Tables
+    {
+	Tables()
+	{
+	    std::memset(hexDigits_, -1, sizeof(hexDigits_));
+	    std::memset(semitones_, -1, sizeof(semitones_));
+	    for (int i = 0; i < 10; ++i)
+	    {
+		hexDigits_['0' + i] = (int8) i;
+	    }
+	    for (int i = 0; i < 6; ++i)
+	    {
+		hexDigits_['a' + i] = hexDigits_['A' + i] = (int8) (10 + i);
+	    }
+	    static const char names[] = "CDEFGABH";
+	    static const int8 semitones[] = { 0, 2, 4, 5, 7, 9, 11, 11 };
+	    for (int i = 0; i < 8; ++i)
+	    {
+		semitones_[(uint8) names[i]] = semitones_[(uint8) names[i] + 'a' - 'A'] = semitones[i];
+	    }
+	}
+
+	int8 hexDigits_[256];
+	int8 semitones_[256];
+    };
+
+    static const Tables& getTables()
+    {
+	static const Tables tables;
+	return tables;
+    }
+
+    static bool isDigit(char c)         { return c >= '0' && c <= '9'; }
+    static bool isWhitespace(char c)    { return c == ' ' || (c >= '\t' && c <= '\r'); }
+
+    const char* data_;
+    size_t size_;
+};
@@ -0,0 +1,192 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "MidiOutputStage.h"
+#include <limits>
+
+//==============================================================================
+// Holds MIDI messages back until a time of their own, for the pedal presses
+// that are quantised to the beat. They're kept in a min-heap on their due
+// ticks (ties in the order they came, so a release never overtakes its
+// press) and a 1ms HighResolutionTimer hands whatever is due to the output
+// stage. Messages are three bytes at most; when the heap is full a message
+// goes out straight away rather than being lost.
+//
+// schedule() is called from the control thread, the timer runs on its own.
+class BeatScheduler : private HighResolutionTimer
+{
+public:
+    static const int maxPending = 64;
+
+    explicit BeatScheduler(MidiOutputStage& stage) : stage_(stage) {}
+
+    ~BeatScheduler()
+    {
+	stop();
+    }
+
+    void start()
+    {
+	startTimer(1);
+    }
+
+    // whatever is still pending goes out first
+    void stop()
+    {
+	stopTimer();
+	dispatch(std::numeric_limits<int64>::max());
+    }
+
+    bool isRunning() const              { return isTimerRunning(); }
+
+    // due is a Time::getHighResolutionTicks() value
+    void schedule(const MidiMessage& message, int64 due)
+    {
+	{
+	    const SpinLock::ScopedLockType lock(lock_);
+	    if (numPending_ < maxPending && message.getRawDataSize() <= 3)
+	    {
+		Pending& pending = heap_[numPending_];
+		pending.due_ = due;
+		pending.order_ = nextOrder_++;
+		pending.size_ = message.getRawDataSize();
+		std::memcpy(pending.data_, message.getRawData(), (size_t) pending.size_);
+		siftUp(numPending_++);
+		++numScheduled_;
+		return;
+	    }
+	}
+	++numOverflowed_;
+	stage_.add(message);
+	stage_.flush();
+    }
+
+    // the latest due time among the messages for this note still waiting, 0 if none
+    int64 getLatestDue(int channel, int note) const
+    {
+	const SpinLock::ScopedLockType lock(lock_);
+	int64 latest = 0;
+	for (int i = 0; i < numPending_; ++i)
+	{
+	    const Pending& pending = heap_[i];
+	    if (pending.size_ == 3 && (pending.data_[0] & 0xe0) == 0x80
+		&& (pending.data_[0] & 0x0f) == channel - 1 && pending.data_[1] == note)
+	    {
+		latest = jmax(latest, pending.due_);
+	    }
+	}
+	return latest;
+    }
+
+    int getNumPending() const
+    {
+	const SpinLock::ScopedLockType lock(lock_);
+	return numPending_;
+    }
+
+    int64 getNumScheduled() const       { return numScheduled_; }
+    int64 getNumOverflowed() const      { return numOverflowed_; }
+
+    // how late the timer got messages out, at worst
+    double getMaxLateMs() const         { return Time::highResolutionTicksToSeconds(maxLateTicks_.load()) * 1000.0; }
+
+private:
+    struct Pending
+    {
+	int64 due_;
+	int64 order_;
+	int size_;
+	uint8 data_[3];
+    };
+
+    static bool before(const Pending& a, const Pending& b)
+    {
+	return a.due_ != b.due_ ? a.due_ < b.due_ : a.order_ < b.order_;
+    }
+
+    void siftUp(int i)
+    {
+	while (i > 0 && before(heap_[i], heap_[(i - 1) / 2]))
+	{
+	    std::swap(heap_[i], heap_[(i - 1) / 2]);
+	    i = (i - 1) / 2;
+	}
+    }
+
+    void siftDown(int i)
+    {
+	for (;;)
+	{
+	    int smallest = i;
+	    for (int child = 2 * i + 1; child <= 2 * i + 2 && child < numPending_; ++child)
+	    {
+		smallest = before(heap_[child], heap_[smallest]) ? child : smallest;
+	    }
+	    if (smallest == i)
+	    {
+		return;
+	    }
+	    std::swap(heap_[i], heap_[smallest]);
+	    i = smallest;
+	}
+    }
+
+    void dispatch(int64 now)
+    {
+	bool sent = false;
+	{
+	    const SpinLock::ScopedLockType lock(lock_);
+	    while (numPending_ > 0 && heap_[0].due_ <= now)
+	    {
+		const Pending& first = heap_[0];
+		stage_.add(MidiMessage(first.data_, first.size_));
+		if (now != std::numeric_limits<int64>::max() && now - first.due_ > maxLateTicks_.load())
+		{
+		    maxLateTicks_ = now - first.due_;
+		}
+		heap_[0] = heap_[--numPending_];
+		siftDown(0);
+		sent = true;
+	    }
+	}
+	if (sent)
+	{
+	    stage_.flush();
+	}
+    }
+
+    void hiResTimerCallback() override
+    {
+	dispatch(Time::getHighResolutionTicks());
+    }
+
+    MidiOutputStage& stage_;
+    mutable SpinLock lock_;
+    Pending heap_[maxPending];
+    int numPending_ = 0;
+    int64 nextOrder_ = 0;
+    std::atomic<int64> numScheduled_ { 0 };
+    std::atomic<int64> numOverflowed_ { 0 };
+    std::atomic<int64> maxLateTicks_ { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE(BeatScheduler)
+};
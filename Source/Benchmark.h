@@ -0,0 +1,98 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "LedOutput.h"
+#include <atomic>
+#include <functional>
+#include <ostream>
+
+//==============================================================================
+// Takes the LED batches during a benchmark so nothing reaches loop4r_leds,
+// just counts them.
+class CountingLedSink : public LedCommandSink
+{
+public:
+    void send(int, int) override        { ++numCommands_; }
+    void flush() override               { ++numFlushes_; }
+
+    int64 getNumCommands() const        { return numCommands_.load(); }
+    int64 getNumFlushes() const         { return numFlushes_.load(); }
+
+private:
+    std::atomic<int64> numCommands_ { 0 };
+    std::atomic<int64> numFlushes_ { 0 };
+};
+
+//==============================================================================
+// What one replayed stream cost.
+struct BenchmarkResult
+{
+    String name_;
+    int64 events_ = 0;
+    int64 ticks_ = 0;           // Time::getHighResolutionTicks()
+    int64 allocations_ = 0;
+    int64 allocatedBytes_ = 0;
+    int64 ledMessages_ = 0;
+
+    void print(std::ostream& out) const
+    {
+	const double events = (double) jmax((int64) 1, events_);
+	out << name_.paddedRight(' ', 18)
+	    << " " << events_ << " events"
+	    << "  " << String(Time::highResolutionTicksToSeconds(ticks_) * 1.0e9 / events, 1) << " ns/event"
+	    << "  " << String(allocations_ / events, 2) << " allocs/event"
+	    << "  " << String(allocatedBytes_ / events, 1) << " B/event"
+	    << "  " << ledMessages_ << " LED messages" << std::endl;
+    }
+};
+
+//==============================================================================
+// Calls feed(i) for i from 0 to numEvents - 1 on a thread of its own, the way
+// an input thread hands events over, for the benchmarks that measure the
+// handover itself as well as the handling.
+class BenchmarkFeeder : private Thread
+{
+public:
+    BenchmarkFeeder(int64 numEvents, std::function<void(int64)> feed)
+	: Thread("loop4r bench feeder"), numEvents_(numEvents), feed_(std::move(feed))
+    {
+	startThread();
+    }
+
+    ~BenchmarkFeeder()
+    {
+	stopThread(2000);
+    }
+
+private:
+    void run() override
+    {
+	for (int64 i = 0; i < numEvents_ && !threadShouldExit(); ++i)
+	{
+	    feed_(i);
+	}
+    }
+
+    const int64 numEvents_;
+    std::function<void(int64)> feed_;
+
+    JUCE_DECLARE_NON_COPYABLE(BenchmarkFeeder)
+};
@@ -0,0 +1,263 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "LedOutput.h"
+#include "LedPatterns.h"
+#include "LoopStore.h"
+#include <cmath>
+
+//==============================================================================
+// Blinks the LEDs from here instead of leaving it to whoever reads the LED
+// commands. All blinking LEDs run off one beat clock, so they stay in phase,
+// and the toggles of one tick go out as a single LED batch. Blink is lit for
+// the first half of each beat and fast blink for the first half of each half
+// beat; the loop states can be given patterns of their own (LedPatterns.h).
+// Every LED belongs to one pattern, and each pattern keeps the set of its
+// LEDs as a bitmask, so a tick is an OR per pattern that's lit on this step
+// and an XOR with what's shown to find the LEDs that flip. The clock free runs at 120bpm until it's given SooperLooper's tempo,
+// and can be pulled into phase with the loop position or an external clock.
+//
+// set() is called from the control thread, the clock runs on the
+// HighResolutionTimer thread.
+class BlinkEngine : private HighResolutionTimer
+{
+public:
+    static const int tickMs = 2;
+    static const int maxLeds = 128;
+    static constexpr double defaultBpm = 120.0;
+
+    static const int numPatterns = LedPatternSet::numPatterns;
+    static const int numWords = maxLeds / 64;
+
+    explicit BlinkEngine(LedCommandOutput& output) : output_(output)
+    {
+	const LedPatternSet defaults;
+	for (int i = 0; i < numPatterns; ++i)
+	{
+	    patterns_[i] = defaults.get(i);
+	}
+	for (auto&& pattern : patternOf_)
+	{
+	    pattern = Dark;
+	}
+	members_[Dark][0] = members_[Dark][1] = ~(uint64) 0;
+	setTempo(defaultBpm);
+    }
+
+    ~BlinkEngine()
+    {
+	stop();
+    }
+
+    void start()
+    {
+	startTimer(tickMs);
+    }
+
+    void stop()
+    {
+	stopTimer();
+    }
+
+    bool isRunning() const      { return isTimerRunning(); }
+
+    // led is the number sent to loop4r_leds, pattern a LedStates value or an
+    // id from LedPatternSet; blinking LEDs are shown in the current step and
+    // then left to the clock
+    void set(int led, bool on, int pattern)
+    {
+	if (led < 0 || led >= maxLeds)
+	{
+	    return;
+	}
+
+	const SpinLock::ScopedLockType lock(lock_);
+	const int id = on && pattern >= 0 && pattern < numPatterns ? pattern : (int) Dark;
+	const int word = led / 64;
+	const uint64 bit = (uint64) 1 << (led % 64);
+	members_[patternOf_[led]][word] &= ~bit;
+	members_[id][word] |= bit;
+	patternOf_[led] = (uint8) id;
+
+	const bool lit = patterns_[id].isLit(getStep(patterns_[id], beatsAt(Time::getHighResolutionTicks())));
+	lit_[word] = lit ? (lit_[word] | bit) : (lit_[word] & ~bit);
+	output_.add(lit ? 106 : 107, led);
+    }
+
+    // changes what the LEDs on pattern id blink, from their next step
+    void setPattern(int id, const LedPattern& pattern)
+    {
+	if (id > FastBlink && id < numPatterns)
+	{
+	    const SpinLock::ScopedLockType lock(lock_);
+	    patterns_[id] = pattern;
+	}
+    }
+
+    // beats per minute, anything silly falls back to free running at 120
+    void setTempo(double bpm)
+    {
+	if (!(bpm >= 20.0 && bpm <= 400.0))
+	{
+	    bpm = defaultBpm;
+	}
+
+	const SpinLock::ScopedLockType lock(lock_);
+	const double newTicksPerBeat = 60.0 / bpm * (double) Time::getHighResolutionTicksPerSecond();
+	if (ticksPerBeat_ > 0)
+	{
+	    // keep the phase we're in so a tempo change doesn't make the LEDs jump
+	    const int64 now = Time::getHighResolutionTicks();
+	    originTicks_ = now - (int64) (getPhase(now) * newTicksPerBeat);
+	}
+	ticksPerBeat_ = newTicksPerBeat;
+    }
+
+    // loop position in seconds, assumed to start on a beat. Small errors are
+    // eased out over a few updates so network jitter doesn't show on the board.
+    void syncPosition(double seconds)
+    {
+	if (!(seconds >= 0))
+	{
+	    return;
+	}
+
+	const SpinLock::ScopedLockType lock(lock_);
+	const double ticksPerSecond = (double) Time::getHighResolutionTicksPerSecond();
+	pullPhase(std::fmod(seconds * ticksPerSecond / ticksPerBeat_, 1.0));
+    }
+
+    // where in the beat we should be now, 0..1, from an external clock; eased
+    // in like the loop position
+    void syncPhase(double phase)
+    {
+	if (!(phase >= 0 && phase <= 1))
+	{
+	    return;
+	}
+
+	const SpinLock::ScopedLockType lock(lock_);
+	pullPhase(phase);
+    }
+
+    // beats since the clock's origin, which only means anything once it's
+    // been synced
+    double getBeats(int64 now) const
+    {
+	const SpinLock::ScopedLockType lock(lock_);
+	return beatsAt(now);
+    }
+
+    double getTicksPerBeat() const
+    {
+	const SpinLock::ScopedLockType lock(lock_);
+	return ticksPerBeat_;
+    }
+
+    int64 getNumBursts() const          { return numBursts_.load(); }
+
+private:
+    // with the lock held
+    void pullPhase(double wantedPhase)
+    {
+	const int64 now = Time::getHighResolutionTicks();
+	const double ticksPerSecond = (double) Time::getHighResolutionTicksPerSecond();
+	double error = wantedPhase - getPhase(now);
+	if (error > 0.5)
+	{
+	    error -= 1.0;
+	}
+	else if (error < -0.5)
+	{
+	    error += 1.0;
+	}
+
+	const double errorSeconds = std::abs(error) * ticksPerBeat_ / ticksPerSecond;
+	originTicks_ -= (int64) (error * ticksPerBeat_ * (errorSeconds > 0.02 ? 1.0 : 0.125));
+    }
+
+    // with the lock held
+    double beatsAt(int64 now) const
+    {
+	return (double) (now - originTicks_) / ticksPerBeat_;
+    }
+
+    static int getStep(const LedPattern& pattern, double beats)
+    {
+	const double cycles = beats / pattern.beats_;
+	return jlimit(0, LedPattern::numSteps - 1, (int) ((cycles - std::floor(cycles)) * LedPattern::numSteps));
+    }
+
+    // where in the beat we are, 0..1
+    double getPhase(int64 now) const
+    {
+	const double beats = (double) (now - originTicks_) / ticksPerBeat_;
+	return beats - std::floor(beats);
+    }
+
+    void hiResTimerCallback() override
+    {
+	const SpinLock::ScopedLockType lock(lock_);
+	const double beats = beatsAt(Time::getHighResolutionTicks());
+	uint64 lit[numWords] = {};
+	for (int id = 0; id < numPatterns; ++id)
+	{
+	    if ((members_[id][0] | members_[id][1]) != 0 && patterns_[id].isLit(getStep(patterns_[id], beats)))
+	    {
+		lit[0] |= members_[id][0];
+		lit[1] |= members_[id][1];
+	    }
+	}
+
+	const uint64 flipped[numWords] = { lit[0] ^ lit_[0], lit[1] ^ lit_[1] };
+	if ((flipped[0] | flipped[1]) == 0)
+	{
+	    return;
+	}
+
+	for (int word = 0; word < numWords; ++word)
+	{
+	    uint64 bits = flipped[word];
+	    for (int led = word * 64; bits != 0; ++led, bits >>= 1)
+	    {
+		if ((bits & 1) != 0)
+		{
+		    output_.add((lit[word] >> (led % 64)) & 1 ? 106 : 107, led);
+		}
+	    }
+	    lit_[word] = lit[word];
+	}
+	output_.commit();
+	++numBursts_;
+    }
+
+    LedCommandOutput& output_;
+    mutable SpinLock lock_;
+    LedPattern patterns_[numPatterns];
+    uint8 patternOf_[maxLeds];
+    uint64 members_[numPatterns][numWords] = {};
+    uint64 lit_[numWords] = {};
+    int64 originTicks_ = Time::getHighResolutionTicks();
+    double ticksPerBeat_ = 0;
+    std::atomic<int64> numBursts_ { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE(BlinkEngine)
+};
@@ -0,0 +1,39 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+//==============================================================================
+// What's written by one thread for every message it takes is kept off the
+// cache lines other threads write, or a line bounces between their cores on
+// each one. The layouts pad rather than align, so they stay apart whatever
+// alignment the allocator gave the object they're in. 64 bytes is the line
+// on the x86 and ARM cores we run on.
+static const int cacheLineSize = 64;
+
+// value_ with no neighbour of its holder's on either of its cache lines
+template <typename Type>
+struct CacheLinePadded
+{
+    char before_[cacheLineSize];
+    Type value_;
+    char after_[cacheLineSize];
+};
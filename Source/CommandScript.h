@@ -0,0 +1,168 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include <cstring>
+#include <istream>
+
+//==============================================================================
+// A command script compiled to frames, one per command with its options:
+//
+//     u16 length of the rest of the frame (big endian)
+//     u8  command (a CommandIndex value, or includeFile)
+//     u8  number of options
+//     the options, each as NUL terminated UTF-8
+//
+// Program files are compiled to this once and replayed from it, and "--framed"
+// reads the same frames from stdin so a controlling process can stream
+// commands without any text parsing on our side.
+class CommandScript
+{
+public:
+    static const int includeFile = 255;     // the one option is an absolute path
+    static const int maxFrameSize = 0xffff;
+
+    CommandScript() {}
+
+    void clear()
+    {
+	data_.reset();
+	numCommands_ = 0;
+    }
+
+    bool add(int command, const StringArray& opts)
+    {
+	MemoryOutputStream frame;
+	frame.writeByte((char) command);
+	frame.writeByte((char) jmin(opts.size(), 255));
+	for (int i = 0; i < jmin(opts.size(), 255); ++i)
+	{
+	    frame.write(opts[i].toRawUTF8(), opts[i].getNumBytesAsUTF8() + 1);
+	}
+	if (frame.getDataSize() > (size_t) maxFrameSize)
+	{
+	    return false;
+	}
+
+	data_.writeShortBigEndian((short) frame.getDataSize());
+	data_.write(frame.getData(), frame.getDataSize());
+	++numCommands_;
+	return true;
+    }
+
+    int getNumCommands() const      { return numCommands_; }
+
+    // calls function(command, opts) for every frame in order
+    template <typename Function>
+    void forEach(Function&& function) const
+    {
+	const uint8* data = static_cast<const uint8*>(data_.getData());
+	const size_t size = data_.getDataSize();
+	size_t offset = 0;
+	StringArray opts;
+	while (offset + 2 <= size)
+	{
+	    const size_t length = ((size_t) data[offset] << 8) | data[offset + 1];
+	    offset += 2;
+	    if (offset + length > size)
+	    {
+		break;
+	    }
+	    if (decodeFrame(data + offset, length, opts))
+	    {
+		function((int) data[offset], opts);
+	    }
+	    offset += length;
+	}
+    }
+
+    // reads one frame from a stream into command and opts, false at the end or on garbage
+    static bool readFrame(std::istream& in, int& command, StringArray& opts)
+    {
+	uint8 header[2];
+	if (!in.read(reinterpret_cast<char*>(header), 2))
+	{
+	    return false;
+	}
+
+	const size_t length = ((size_t) header[0] << 8) | header[1];
+	HeapBlock<uint8> frame(length);
+	if (length < 2 || !in.read(reinterpret_cast<char*>(frame.getData()), (std::streamsize) length))
+	{
+	    return false;
+	}
+
+	command = frame[0];
+	return decodeFrame(frame, length, opts);
+    }
+
+    enum FrameResult { FrameIncomplete, FrameRead, FrameGarbage };
+
+    // takes one frame off the front of bytes read so far, for readers that
+    // can't block on a stream until the rest of it arrives
+    static FrameResult takeFrame(std::string& pending, int& command, StringArray& opts)
+    {
+	if (pending.size() < 2)
+	{
+	    return FrameIncomplete;
+	}
+	const uint8* data = reinterpret_cast<const uint8*>(pending.data());
+	const size_t length = ((size_t) data[0] << 8) | data[1];
+	if (pending.size() < 2 + length)
+	{
+	    return length < 2 ? FrameGarbage : FrameIncomplete;
+	}
+
+	command = data[2];
+	const bool decoded = decodeFrame(data + 2, length, opts);
+	pending.erase(0, 2 + length);
+	return decoded ? FrameRead : FrameGarbage;
+    }
+
+private:
+    static bool decodeFrame(const uint8* frame, size_t length, StringArray& opts)
+    {
+	opts.clearQuick();
+	if (length < 2)
+	{
+	    return false;
+	}
+
+	const int numOpts = frame[1];
+	const char* text = reinterpret_cast<const char*>(frame + 2);
+	const char* end = reinterpret_cast<const char*>(frame + length);
+	for (int i = 0; i < numOpts; ++i)
+	{
+	    const char* terminator = static_cast<const char*>(std::memchr(text, 0, (size_t) (end - text)));
+	    if (terminator == nullptr)
+	    {
+		return false;
+	    }
+	    opts.add(String::fromUTF8(text, (int) (terminator - text)));
+	    text = terminator + 1;
+	}
+	return true;
+    }
+
+    MemoryOutputStream data_;
+    int numCommands_ = 0;
+
+    JUCE_DECLARE_NON_COPYABLE(CommandScript)
+};
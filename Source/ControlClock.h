@@ -0,0 +1,84 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+//==============================================================================
+// The time the control thread's timing goes by: the heartbeat, reconnects
+// and polls on the timing wheel, debounce, gestures, macros, progress and
+// the ramps. It's the real clock unless it's been made virtual, and then it
+// only moves when it's advanced, so a scenario that takes minutes of
+// heartbeats and backoffs runs as fast as the code does and the same way
+// every time. The components keep taking their "now" as a parameter; this is
+// where the callers get it from.
+//
+// Made virtual before the threads that read it start, advanced by whoever
+// runs the scenario, on that one thread.
+class ControlClock
+{
+public:
+    ControlClock() {}
+
+    // from the real time now on, moved only by advance() and advanceTo()
+    void makeVirtual()
+    {
+	virtualMs_ = Time::getMillisecondCounter();
+	virtualTicks_ = Time::getHighResolutionTicks();
+	virtual_ = true;
+    }
+
+    bool isVirtual() const              { return virtual_; }
+
+    void advance(int ms)
+    {
+	virtualMs_ += (uint32) ms;
+	virtualTicks_ += (int64) ms * Time::getHighResolutionTicksPerSecond() / 1000;
+    }
+
+    // to a Time::getHighResolutionTicks() value, never back
+    void advanceTo(int64 ticks)
+    {
+	if (ticks > virtualTicks_)
+	{
+	    virtualMs_ += (uint32) ((ticks - virtualTicks_) * 1000 / Time::getHighResolutionTicksPerSecond());
+	    virtualTicks_ = ticks;
+	}
+    }
+
+    // Time::getMillisecondCounter() and Time::getHighResolutionTicks() or
+    // their virtual counterparts
+    uint32 getMillisecondCounter() const
+    {
+	return virtual_ ? virtualMs_ : Time::getMillisecondCounter();
+    }
+
+    int64 getHighResolutionTicks() const
+    {
+	return virtual_ ? virtualTicks_ : Time::getHighResolutionTicks();
+    }
+
+private:
+    bool virtual_ = false;
+    uint32 virtualMs_ = 0;
+    int64 virtualTicks_ = 0;
+
+    JUCE_DECLARE_NON_COPYABLE(ControlClock)
+};
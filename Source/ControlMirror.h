@@ -0,0 +1,383 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "LedSubscribers.h"
+#include "LoopStore.h"
+#include "OscPacket.h"
+#include <cstring>
+
+//==============================================================================
+// The SooperLooper controls we can mirror, each with a fixed id: the loops'
+// ones and the global ones (loop -2), in the order SooperLooper documents
+// them. Masks of ids are uint64s.
+//
+// A name off the wire is turned into its id once, where the packet is read,
+// and everything after that goes by id. The names hash to a table slot each
+// with no two the same (the seeds were searched for offline, makeSlots()
+// checks them at compile time), so finding one is a hash of its bytes and a
+// single compare to tell a name we know from one we don't.
+struct SooperLooperControls
+{
+    static const int global = -2;
+    static const int numLoopControls = 49;
+    static const int numGlobalControls = 15;
+
+    // the ones we act on ourselves, checked against the names below
+    enum LoopControl { state = 0, loopLen = 2, loopPos = 3, cycleLen = 4, triggerLatency = 40 };
+    enum GlobalControl { tempo = 0, selectedLoopNum = 3 };
+
+    static constexpr const char* getName(bool isGlobal, int id)
+    {
+	constexpr const char* loopNames[numLoopControls] = {
+	    "state", "next_state", "loop_len", "loop_pos", "cycle_len", "free_time", "total_time", "rate_output",
+	    "in_peak_meter", "out_peak_meter", "is_soloed", "waiting", "channel_count", "true_rate",
+	    "rec_thresh", "feedback", "dry", "wet", "input_gain", "rate", "scratch_pos", "delay_trigger",
+	    "quantize", "round", "redo_is_tap", "sync", "playback_sync", "use_rate", "fade_samples",
+	    "use_feedback_play", "use_common_ins", "use_common_outs", "relative_sync", "use_safety_feedback",
+	    "pan_1", "pan_2", "pan_3", "pan_4", "input_latency", "output_latency", "trigger_latency",
+	    "autoset_latency", "mute_quantized", "overdub_quantized", "replace_quantized", "discrete_prefader",
+	    "stretch_ratio", "pitch_shift", "tempo_stretch" };
+	constexpr const char* globalNames[numGlobalControls] = {
+	    "tempo", "eighth_per_cycle", "sync_source", "selected_loop_num", "dry", "wet", "input_gain",
+	    "tap_tempo", "auto_disable_latency", "output_midi_clock", "smart_eighths", "use_midi_start",
+	    "use_midi_stop", "send_midi_start_on_trigger", "fade_samples" };
+	return isGlobal ? globalNames[id] : loopNames[id];
+    }
+
+    static constexpr int getNumControls(bool isGlobal)  { return isGlobal ? numGlobalControls : numLoopControls; }
+
+    static constexpr bool isName(bool isGlobal, int id, const char* name)
+    {
+	const char* known = getName(isGlobal, id);
+	while (*known != 0 && *known == *name)
+	{
+	    ++known;
+	    ++name;
+	}
+	return *known == *name;
+    }
+
+private:
+    static const int numLoopSlots = 128;
+    static const int numGlobalSlots = 32;
+    static const uint32 loopSeed = 2166241184u;
+    static const uint32 globalSeed = 2166136360u;
+
+    // FNV-1a from seed
+    static constexpr uint32 hash(const char* name, uint32 seed)
+    {
+	uint32 h = seed;
+	for (; *name != 0; ++name)
+	{
+	    h = (h ^ (uint8) *name) * 16777619u;
+	}
+	return h;
+    }
+
+    static constexpr int getSlot(uint32 h, int numSlots)    { return (int) ((h ^ (h >> 16)) & (uint32) (numSlots - 1)); }
+
+    template <int numSlots>
+    struct Slots
+    {
+	int8 ids_[numSlots];
+	bool isPerfect_;
+    };
+
+    template <int numSlots>
+    static constexpr Slots<numSlots> makeSlots(bool isGlobal, uint32 seed)
+    {
+	Slots<numSlots> slots {};
+	for (int i = 0; i < numSlots; ++i)
+	{
+	    slots.ids_[i] = -1;
+	}
+	slots.isPerfect_ = true;
+	for (int id = 0; id < getNumControls(isGlobal); ++id)
+	{
+	    const int slot = getSlot(hash(getName(isGlobal, id), seed), numSlots);
+	    slots.isPerfect_ = slots.isPerfect_ && slots.ids_[slot] < 0;
+	    slots.ids_[slot] = (int8) id;
+	}
+	return slots;
+    }
+
+public:
+    // -1 if it isn't one we know; name is the NUL terminated string as it
+    // is in the packet
+    static int find(bool isGlobal, const char* name)
+    {
+	static constexpr Slots<numLoopSlots> loopSlots = makeSlots<numLoopSlots>(false, loopSeed);
+	static constexpr Slots<numGlobalSlots> globalSlots = makeSlots<numGlobalSlots>(true, globalSeed);
+	static_assert(loopSlots.isPerfect_ && globalSlots.isPerfect_,
+		      "two control names share a slot, search for another seed");
+
+	const int id = isGlobal ? globalSlots.ids_[getSlot(hash(name, globalSeed), numGlobalSlots)]
+				: loopSlots.ids_[getSlot(hash(name, loopSeed), numLoopSlots)];
+	return id >= 0 && std::strcmp(getName(isGlobal, id), name) == 0 ? id : -1;
+    }
+};
+
+static_assert(SooperLooperControls::isName(false, SooperLooperControls::state, "state")
+	      && SooperLooperControls::isName(false, SooperLooperControls::loopLen, "loop_len")
+	      && SooperLooperControls::isName(false, SooperLooperControls::loopPos, "loop_pos")
+	      && SooperLooperControls::isName(false, SooperLooperControls::cycleLen, "cycle_len")
+	      && SooperLooperControls::isName(false, SooperLooperControls::triggerLatency, "trigger_latency")
+	      && SooperLooperControls::isName(true, SooperLooperControls::tempo, "tempo")
+	      && SooperLooperControls::isName(true, SooperLooperControls::selectedLoopNum, "selected_loop_num"),
+	      "a control id that doesn't match its name");
+
+//==============================================================================
+// An engine's controls as SooperLooper last reported them, a float per loop and
+// control id and one per global control, so any number of clients can be
+// answered without asking SooperLooper again. Control thread only.
+class ControlMirror
+{
+public:
+    static const int maxControls = 64;
+    static_assert(SooperLooperControls::numLoopControls <= maxControls, "the masks are uint64s");
+
+    // false if it's the value we already had
+    bool set(int loop, int id, float value)
+    {
+	if (!isPositiveAndBelow(id, maxControls) || (loop != SooperLooperControls::global && !isPositiveAndBelow(loop, (int) LoopStore::maxLoops)))
+	{
+	    return false;
+	}
+
+	const uint64 bit = (uint64) 1 << id;
+	uint64& known = loop == SooperLooperControls::global ? knownGlobals_ : known_[loop];
+	float& stored = loop == SooperLooperControls::global ? globals_[id] : values_[loop][id];
+	if ((known & bit) != 0 && stored == value)
+	{
+	    return false;
+	}
+	known |= bit;
+	stored = value;
+	++numChanges_;
+	return true;
+    }
+
+    // false if SooperLooper hasn't told us yet
+    bool get(int loop, int id, float& value) const
+    {
+	if (!isPositiveAndBelow(id, maxControls) || (loop != SooperLooperControls::global && !isPositiveAndBelow(loop, (int) LoopStore::maxLoops)))
+	{
+	    return false;
+	}
+
+	const uint64 known = loop == SooperLooperControls::global ? knownGlobals_ : known_[loop];
+	if ((known & ((uint64) 1 << id)) == 0)
+	{
+	    return false;
+	}
+	value = loop == SooperLooperControls::global ? globals_[id] : values_[loop][id];
+	return true;
+    }
+
+    // another SooperLooper, or another session
+    void clear()
+    {
+	for (auto&& known : known_)
+	{
+	    known = 0;
+	}
+	knownGlobals_ = 0;
+    }
+
+    int64 getNumChanges() const         { return numChanges_; }
+
+private:
+    float values_[LoopStore::maxLoops][maxControls];
+    float globals_[maxControls];
+    uint64 known_[LoopStore::maxLoops] = {};
+    uint64 knownGlobals_ = 0;
+    int64 numChanges_ = 0;
+};
+
+//==============================================================================
+// Clients following mirrored controls with /loop4r/register_control, each
+// for one control of one loop, every loop (-1) or a global control (-2).
+// A change goes to every client following it as "<path> loop control value",
+// SooperLooper's own /ctrl format. Leases work as for LedSubscribers. Control
+// thread only.
+class ControlSubscribers
+{
+public:
+    static const int maxSubscriptions = 64;
+
+    ControlSubscribers() {}
+
+    // adds or refreshes a subscription, leaseMs 0 never expires
+    bool subscribe(const String& host, int port, const String& path, int loop, int id, int leaseMs)
+    {
+	const uint32 now = Time::getMillisecondCounter();
+	for (auto&& subscription : subscriptions_)
+	{
+	    if (subscription.matches(host, port, path, loop, id))
+	    {
+		subscription.lastSeen_ = now;
+		subscription.leaseMs_ = leaseMs;
+		return true;
+	    }
+	}
+
+	if (subscriptions_.size() >= maxSubscriptions || path.getNumBytesAsUTF8() >= maxPathSize || !openSocket())
+	{
+	    return false;
+	}
+
+	Subscription subscription;
+	if (!LedSubscribers::resolve(host, port, subscription.address_, subscription.addressSize_))
+	{
+	    return false;
+	}
+	subscription.host_ = host;
+	subscription.port_ = port;
+	path.copyToUTF8(subscription.path_, maxPathSize);
+	subscription.loop_ = loop;
+	subscription.id_ = id;
+	subscription.lastSeen_ = now;
+	subscription.leaseMs_ = leaseMs;
+	subscriptions_.add(subscription);
+	updateMasks();
+	return true;
+    }
+
+    void unsubscribe(const String& host, int port, const String& path, int loop, int id)
+    {
+	for (int i = subscriptions_.size(); --i >= 0;)
+	{
+	    if (subscriptions_.getReference(i).matches(host, port, path, loop, id))
+	    {
+		subscriptions_.remove(i);
+	    }
+	}
+	updateMasks();
+    }
+
+    void expire()
+    {
+	const uint32 now = Time::getMillisecondCounter();
+	const int numBefore = subscriptions_.size();
+	for (int i = subscriptions_.size(); --i >= 0;)
+	{
+	    const Subscription& subscription = subscriptions_.getReference(i);
+	    if (subscription.leaseMs_ > 0 && (int) (now - subscription.lastSeen_) > subscription.leaseMs_)
+	    {
+		std::cerr << "Control subscriber " << subscription.host_ << ":" << subscription.port_ << " expired" << std::endl;
+		subscriptions_.remove(i);
+	    }
+	}
+	if (subscriptions_.size() != numBefore)
+	{
+	    updateMasks();
+	}
+    }
+
+    // the controls some client follows, as masks of ids
+    uint64 getLoopControls() const      { return loopMask_; }
+    uint64 getGlobalControls() const    { return globalMask_; }
+
+    // to whoever follows this one
+    void send(int loop, int id, float value)
+    {
+	const bool isGlobal = loop == SooperLooperControls::global;
+	if (((isGlobal ? globalMask_ : loopMask_) & ((uint64) 1 << id)) == 0)
+	{
+	    return;
+	}
+
+	const int fd = socket_ != nullptr ? socket_->getRawSocketHandle() : -1;
+	const char* name = SooperLooperControls::getName(isGlobal, id);
+	for (auto&& subscription : subscriptions_)
+	{
+	    const bool follows = isGlobal ? subscription.loop_ == SooperLooperControls::global
+					  : (subscription.loop_ == -1 || subscription.loop_ == loop);
+	    if (fd >= 0 && follows && subscription.id_ == id)
+	    {
+		OscPacket packet;
+		packet.size_ = OscMessageWriter(packet).begin(subscription.path_, "isf")
+		    .addInt32(loop).addString(name).addFloat32(value).size();
+		if (packet.isValid())
+		{
+		    ::sendto(fd, packet.data_, (size_t) packet.size_, 0,
+			     reinterpret_cast<const sockaddr*>(&subscription.address_), subscription.addressSize_);
+		    ++numSent_;
+		}
+	    }
+	}
+    }
+
+    int size() const                    { return subscriptions_.size(); }
+    int64 getNumSent() const            { return numSent_; }
+
+private:
+    static const int maxPathSize = 64;
+
+    struct Subscription
+    {
+	bool matches(const String& host, int port, const String& path, int loop, int id) const
+	{
+	    return port_ == port && loop_ == loop && id_ == id && host_ == host && path == path_;
+	}
+
+	String host_;
+	int port_ = 0;
+	char path_[maxPathSize];
+	int loop_ = 0;
+	int id_ = 0;
+	uint32 lastSeen_ = 0;
+	int leaseMs_ = 0;
+	sockaddr_storage address_;
+	socklen_t addressSize_ = 0;
+    };
+
+    void updateMasks()
+    {
+	loopMask_ = globalMask_ = 0;
+	for (auto&& subscription : subscriptions_)
+	{
+	    (subscription.loop_ == SooperLooperControls::global ? globalMask_ : loopMask_) |= (uint64) 1 << subscription.id_;
+	}
+    }
+
+    bool openSocket()
+    {
+	if (socket_ == nullptr)
+	{
+	    socket_ = new DatagramSocket(false);
+	    if (!socket_->bindToPort(0))
+	    {
+		socket_ = nullptr;
+		return false;
+	    }
+	}
+	return true;
+    }
+
+    ScopedPointer<DatagramSocket> socket_;     // only used for its descriptor
+    Array<Subscription> subscriptions_;
+    uint64 loopMask_ = 0;
+    uint64 globalMask_ = 0;
+    int64 numSent_ = 0;
+
+    JUCE_DECLARE_NON_COPYABLE(ControlSubscribers)
+};
@@ -0,0 +1,232 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "LoopStore.h"
+#include <cmath>
+
+//==============================================================================
+// Where each loop's cycles start, carried on between SooperLooper's loop_pos
+// reports by the high resolution clock. A report now and then is enough, so
+// loop_pos is asked for every couple of seconds rather than every 100ms, and
+// each new one puts the estimate right. The next boundary of every loop that
+// is running is kept worked out: emitBoundaries() tells the Listeners about
+// the ones that are due, and getNextBoundary() says when to call it again.
+// Control thread only.
+class CycleTracker
+{
+public:
+    struct Listener
+    {
+	virtual ~Listener() {}
+
+	// loop started a cycle at ticks, late is how long ago that was
+	virtual void cycleBoundary(int loop, int64 ticks, int64 lateTicks) = 0;
+    };
+
+    CycleTracker() {}
+
+    void addListener(Listener* listener)        { listeners_.addIfNotAlreadyThere(listener); }
+    void removeListener(Listener* listener)     { listeners_.removeFirstMatchingValue(listener); }
+
+    // another engine, or it went away
+    void reset()
+    {
+	for (auto&& loop : loops_)
+	{
+	    loop = Loop();
+	}
+    }
+
+    void setCycleLength(int loop, double seconds, int64 ticks)
+    {
+	if (!isPositiveAndBelow(loop, LoopStore::maxLoops))
+	{
+	    return;
+	}
+	Loop& tracked = loops_[loop];
+	// carried on until now at the old length, so the phase survives the change
+	if (tracked.synced_)
+	{
+	    tracked.position_ = getPosition(tracked, ticks);
+	    tracked.syncTicks_ = ticks;
+	}
+	tracked.cycleSeconds_ = seconds > 0 ? seconds : 0;
+	plan(tracked, ticks);
+    }
+
+    // loop_pos in seconds, as of ticks
+    void sync(int loop, double position, int64 ticks)
+    {
+	if (!isPositiveAndBelow(loop, LoopStore::maxLoops) || !(position >= 0))
+	{
+	    return;
+	}
+	Loop& tracked = loops_[loop];
+	if (tracked.synced_ && tracked.running_ && tracked.cycleSeconds_ > 0)
+	{
+	    const double error = std::remainder(position - getPosition(tracked, ticks), tracked.cycleSeconds_);
+	    maxErrorMs_ = jmax(maxErrorMs_, std::abs(error) * 1000.0);
+	}
+	const int64 expected = tracked.nextBoundary_;
+	tracked.position_ = position;
+	tracked.syncTicks_ = ticks;
+	tracked.synced_ = true;
+	++numSyncs_;
+	plan(tracked, ticks);
+
+	// the report has the loop already past a boundary we were still waiting
+	// for (or hadn't got round to telling): it's due now, late by position
+	const double ticksPerSecond = (double) Time::getHighResolutionTicksPerSecond();
+	if (expected != 0 && tracked.nextBoundary_ != 0
+	    && (double) (tracked.nextBoundary_ - expected) > tracked.cycleSeconds_ * ticksPerSecond / 2)
+	{
+	    tracked.nextBoundary_ = jmax((int64) 1, ticks - (int64) (position * ticksPerSecond));
+	}
+    }
+
+    // the position only moves on while the loop plays
+    void setRunning(int loop, bool running, int64 ticks)
+    {
+	if (!isPositiveAndBelow(loop, LoopStore::maxLoops) || loops_[loop].running_ == running)
+	{
+	    return;
+	}
+	Loop& tracked = loops_[loop];
+	if (tracked.synced_)
+	{
+	    tracked.position_ = getPosition(tracked, ticks);
+	    tracked.syncTicks_ = ticks;
+	}
+	tracked.running_ = running;
+	plan(tracked, ticks);
+    }
+
+    static bool isRunning(LoopStates state)
+    {
+	switch (state)
+	{
+	    case Playing:
+	    case Overdubbing:
+	    case Multiplying:
+	    case Inserting:
+	    case Replacing:
+	    case Muted:
+	    case OneShot:
+	    case Substitute:
+		return true;
+	    default:
+		return false;
+	}
+    }
+
+    // seconds into the loop, -1 if we don't know
+    double getPosition(int loop, int64 ticks) const
+    {
+	if (!isPositiveAndBelow(loop, LoopStore::maxLoops) || !loops_[loop].synced_)
+	{
+	    return -1;
+	}
+	return getPosition(loops_[loop], ticks);
+    }
+
+    // the earliest boundary coming, 0 if no loop has one
+    int64 getNextBoundary() const
+    {
+	int64 next = 0;
+	for (auto&& loop : loops_)
+	{
+	    if (loop.nextBoundary_ != 0 && (next == 0 || loop.nextBoundary_ < next))
+	    {
+		next = loop.nextBoundary_;
+	    }
+	}
+	return next;
+    }
+
+    // tells the listeners about every boundary up to ticks, each loop's once
+    // however many it missed
+    void emitBoundaries(int64 ticks)
+    {
+	for (int i = 0; i < LoopStore::maxLoops; ++i)
+	{
+	    Loop& loop = loops_[i];
+	    if (loop.nextBoundary_ == 0 || loop.nextBoundary_ > ticks)
+	    {
+		continue;
+	    }
+
+	    const int64 boundary = loop.nextBoundary_;
+	    const int64 late = ticks - boundary;
+	    maxLateMs_ = jmax(maxLateMs_, Time::highResolutionTicksToSeconds(late) * 1000.0);
+	    ++numBoundaries_;
+	    plan(loop, ticks);
+	    for (auto* listener : listeners_)
+	    {
+		listener->cycleBoundary(i, boundary, late);
+	    }
+	}
+    }
+
+    int64 getNumBoundaries() const      { return numBoundaries_; }
+    int64 getNumSyncs() const           { return numSyncs_; }
+    double getMaxLateMs() const         { return maxLateMs_; }
+
+    // how far a loop_pos report was from where we had the loop, the worst so far
+    double getMaxErrorMs() const        { return maxErrorMs_; }
+
+private:
+    struct Loop
+    {
+	double cycleSeconds_ = 0;
+	double position_ = 0;
+	int64 syncTicks_ = 0;
+	int64 nextBoundary_ = 0;        // 0 while there isn't one to expect
+	bool synced_ = false;
+	bool running_ = false;
+    };
+
+    static double getPosition(const Loop& loop, int64 ticks)
+    {
+	return loop.position_ + (loop.running_ ? jmax(0.0, Time::highResolutionTicksToSeconds(ticks - loop.syncTicks_)) : 0.0);
+    }
+
+    // the first boundary after ticks
+    static void plan(Loop& loop, int64 ticks)
+    {
+	if (!loop.synced_ || !loop.running_ || loop.cycleSeconds_ <= 0)
+	{
+	    loop.nextBoundary_ = 0;
+	    return;
+	}
+	const double cycles = getPosition(loop, ticks) / loop.cycleSeconds_;
+	const double secondsLeft = (std::floor(cycles) + 1 - cycles) * loop.cycleSeconds_;
+	loop.nextBoundary_ = ticks + jmax((int64) 1, (int64) (secondsLeft * (double) Time::getHighResolutionTicksPerSecond()));
+    }
+
+    Loop loops_[LoopStore::maxLoops];
+    Array<Listener*> listeners_;
+    int64 numBoundaries_ = 0;
+    int64 numSyncs_ = 0;
+    double maxLateMs_ = 0;
+    double maxErrorMs_ = 0;
+
+    JUCE_DECLARE_NON_COPYABLE(CycleTracker)
+};
@@ -0,0 +1,277 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "LedOutput.h"
+#include "SerialMidiInput.h"
+#include <atomic>
+
+#if JUCE_LINUX
+ #include <cerrno>
+ #include <ctime>
+ #include <fcntl.h>
+ #include <unistd.h>
+#endif
+
+//==============================================================================
+// Channel messages as bytes for a MIDI wire, leaving out the status byte
+// while it's the same as the last one's (running status): a run of LED
+// controllers to one channel goes out at two bytes each instead of three.
+// Real time messages don't interrupt it, everything else restarts it. The
+// status is sent again after a second with nothing sent, for a receiver
+// that has come up meanwhile.
+class RunningStatusEncoder
+{
+public:
+    static const uint32 resendAfterMs = 1000;
+
+    // its bytes at out, which has room for 3; the number written
+    int encode(const uint8* data, int size, uint32 nowMs, uint8* out)
+    {
+	if (size <= 0)
+	{
+	    return 0;
+	}
+	const uint8 status = data[0];
+	int count = 0;
+	if (status >= 0xf8)
+	{
+	    out[count++] = status;
+	    return count;
+	}
+	if (status != status_ || status >= 0xf0 || nowMs - lastMs_ >= resendAfterMs)
+	{
+	    out[count++] = status;
+	}
+	else
+	{
+	    ++numSaved_;
+	}
+	status_ = status < 0xf0 ? status : 0;
+	lastMs_ = nowMs;
+	for (int i = 1; i < jmin(size, 3); ++i)
+	{
+	    out[count++] = data[i];
+	}
+	return count;
+    }
+
+    // the next message sends its status whatever it is
+    void reset()                        { status_ = 0; }
+
+    int64 getNumSaved() const           { return numSaved_; }
+
+private:
+    uint8 status_ = 0;
+    uint32 lastMs_ = 0;
+    int64 numSaved_ = 0;
+};
+
+//==============================================================================
+// A token bucket in bytes, filling at a wire's rate (10 bits a byte, so 3125
+// a second for MIDI) up to burst bytes. Whatever takes its bytes from it
+// never gets more than burst bytes ahead of the wire, so a receiver with a
+// small buffer behind a faster link (a USB to DIN interface) isn't overrun.
+class WireRateLimiter
+{
+public:
+    WireRateLimiter(int bytesPerSecond = SerialMidiInput::midiBaudRate / 10, int burst = 3)
+    {
+	setRate(bytesPerSecond, burst);
+    }
+
+    void setRate(int bytesPerSecond, int burst)
+    {
+	ticksPerByte_ = (double) Time::getHighResolutionTicksPerSecond() / jmax(1, bytesPerSecond);
+	burst_ = jmax(1, burst);
+	tokens_ = burst_;
+	lastTicks_ = 0;
+    }
+
+    // how many of wanted bytes may go now, taken
+    int take(int64 ticks, int wanted)
+    {
+	refill(ticks);
+	const int count = jmin(wanted, (int) tokens_);
+	tokens_ -= count;
+	return count;
+    }
+
+    // until the next byte may go, 0 for now
+    int64 getWaitTicks(int64 ticks)
+    {
+	refill(ticks);
+	return tokens_ >= 1.0 ? 0 : (int64) std::ceil((1.0 - tokens_) * ticksPerByte_);
+    }
+
+private:
+    void refill(int64 ticks)
+    {
+	if (lastTicks_ != 0)
+	{
+	    tokens_ = jmin((double) burst_, tokens_ + (double) (ticks - lastTicks_) / ticksPerByte_);
+	}
+	lastTicks_ = ticks;
+    }
+
+    double ticksPerByte_ = 1;
+    int burst_ = 3;
+    double tokens_ = 3;
+    int64 lastTicks_ = 0;
+};
+
+//==============================================================================
+// LED commands as MIDI controllers written to a DIN link ourselves: a UART
+// wired to the board's MIDI in (set to 31250 baud like SerialMidiInput's) or
+// a rawmidi device node (/dev/snd/midiC1D0) of a USB to DIN interface. The
+// commands of a batch are encoded with running status and flush() writes
+// them paced to the wire by a WireRateLimiter, sleeping for the tokens, so a
+// whole board's frame gets there as fast as 31250 baud allows and none of it
+// is dropped by a receiver that can't keep up with a faster link. The LED
+// writer thread does the waiting; while it does, LedCommandOutput keeps only
+// the LEDs' latest states. Only used on the LED writer thread once open.
+class DinLedPort : public LedCommandSink
+{
+public:
+    static const int maxBytes = 512;    // a batch's, more goes out on the way
+
+    DinLedPort() {}
+
+    ~DinLedPort()
+    {
+	close();
+    }
+
+#if JUCE_LINUX
+    // channel is 1-16; burst is how many bytes may go ahead of the wire
+    bool open(const String& device, int channel, int burst = 3)
+    {
+	close();
+	fd_ = ::open(device.toRawUTF8(), O_WRONLY | O_NOCTTY | O_CLOEXEC);
+	if (fd_ < 0)
+	{
+	    return false;
+	}
+	if (::isatty(fd_) && !SerialMidiInput::setMidiLine(fd_))
+	{
+	    close();
+	    return false;
+	}
+	channel_ = jlimit(1, 16, channel) - 1;
+	limiter_.setRate(SerialMidiInput::midiBaudRate / 10, burst);
+	encoder_.reset();
+	numBuffered_ = 0;
+	return true;
+    }
+
+    void close()
+    {
+	if (fd_ >= 0)
+	{
+	    ::close(fd_);
+	    fd_ = -1;
+	}
+    }
+#else
+    bool open(const String&, int, int = 3)      { return false; }
+    void close()                                {}
+#endif
+
+    bool isOpen() const                 { return fd_ >= 0; }
+
+    void send(int cc, int value) override
+    {
+	if (fd_ < 0)
+	{
+	    return;
+	}
+	if (numBuffered_ + 3 > maxBytes)
+	{
+	    flush();
+	}
+	const uint8 message[3] = { (uint8) (0xb0 | channel_), (uint8) (cc & 0x7f), (uint8) (value & 0x7f) };
+	numBuffered_ += encoder_.encode(message, 3, Time::getMillisecondCounter(), buffer_ + numBuffered_);
+	++numCommands_;
+    }
+
+    void flush() override
+    {
+#if JUCE_LINUX
+	int done = 0;
+	while (fd_ >= 0 && done < numBuffered_)
+	{
+	    const int64 now = Time::getHighResolutionTicks();
+	    const int count = limiter_.take(now, numBuffered_ - done);
+	    if (count == 0)
+	    {
+		wait(limiter_.getWaitTicks(now));
+		continue;
+	    }
+	    const ssize_t written = ::write(fd_, buffer_ + done, (size_t) count);
+	    if (written < 0 && errno != EINTR)
+	    {
+		// the device went away, what's left of the batch with it
+		++numErrors_;
+		break;
+	    }
+	    done += (int) jmax((ssize_t) 0, written);
+	}
+	numBytes_ += done;
+#endif
+	numSaved_ = encoder_.getNumSaved();
+	numBuffered_ = 0;
+    }
+
+    int64 getNumCommands() const        { return numCommands_.load(); }
+    int64 getNumBytes() const           { return numBytes_.load(); }
+    int64 getNumSaved() const           { return numSaved_.load(); }
+    double getWaitedMs() const          { return Time::highResolutionTicksToSeconds(waitedTicks_.load()) * 1000.0; }
+    int64 getNumErrors() const          { return numErrors_.load(); }
+
+private:
+#if JUCE_LINUX
+    void wait(int64 ticks)
+    {
+	const double seconds = Time::highResolutionTicksToSeconds(ticks);
+	struct timespec delay;
+	delay.tv_sec = (time_t) seconds;
+	delay.tv_nsec = (long) ((seconds - (double) delay.tv_sec) * 1.0e9);
+	while (::clock_nanosleep(CLOCK_MONOTONIC, 0, &delay, &delay) == EINTR)
+	{
+	}
+	waitedTicks_ += ticks;
+    }
+#endif
+
+    int fd_ = -1;
+    int channel_ = 0;
+    RunningStatusEncoder encoder_;
+    WireRateLimiter limiter_;
+    uint8 buffer_[maxBytes];
+    int numBuffered_ = 0;
+
+    std::atomic<int64> numCommands_ { 0 };
+    std::atomic<int64> numBytes_ { 0 };
+    std::atomic<int64> numSaved_ { 0 };
+    std::atomic<int64> waitedTicks_ { 0 };
+    std::atomic<int64> numErrors_ { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE(DinLedPort)
+};
@@ -0,0 +1,236 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "LedOutput.h"
+#include <cstring>
+
+#if JUCE_LINUX
+ #include <fcntl.h>
+ #include <sys/ioctl.h>
+ #include <sys/mman.h>
+ #include <unistd.h>
+ #include <linux/spi/spidev.h>
+#endif
+
+//==============================================================================
+// LEDs wired straight to a Raspberry Pi's GPIO pins, one pin per LED number,
+// driven through the registers /dev/gpiomem maps (no root needed). A batch
+// becomes one store to GPSET0 and one to GPCLR0 in flush(), so the LEDs
+// change all at once within microseconds of the state that lit them. Other
+// commands, like the display, have no pins and are ignored. Pins are BCM
+// numbers 0-31 (the header's).
+class GpioLedPort : public LedCommandSink
+{
+public:
+    static const int maxPins = 32;
+
+    GpioLedPort() {}
+
+    ~GpioLedPort()
+    {
+	close();
+    }
+
+#if JUCE_LINUX
+    // pins[i] drives LED number i, -1 for none
+    bool open(const Array<int>& pins)
+    {
+	close();
+	const int fd = ::open("/dev/gpiomem", O_RDWR | O_SYNC | O_CLOEXEC);
+	if (fd < 0)
+	{
+	    return false;
+	}
+	void* map = ::mmap(nullptr, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (map == MAP_FAILED)
+	{
+	    return false;
+	}
+	registers_ = static_cast<volatile uint32*>(map);
+
+	for (int led = 0; led < numElementsInArray(pinForLed_); ++led)
+	{
+	    const int pin = led < pins.size() ? pins[led] : -1;
+	    pinForLed_[led] = isPositiveAndBelow(pin, maxPins) ? pin : -1;
+	    if (pinForLed_[led] >= 0)
+	    {
+		// 3 bits per pin in GPFSEL0-3, 001 is an output
+		volatile uint32& select = registers_[pin / 10];
+		select = (select & ~(7u << ((pin % 10) * 3))) | (1u << ((pin % 10) * 3));
+		registers_[clearOffset] = 1u << pin;
+	    }
+	}
+	return true;
+    }
+
+    void close()
+    {
+	if (registers_ != nullptr)
+	{
+	    ::munmap(const_cast<uint32*>(registers_), mapSize);
+	    registers_ = nullptr;
+	}
+    }
+#else
+    bool open(const Array<int>&)        { return false; }
+    void close()                        {}
+#endif
+
+    bool isOpen() const                 { return registers_ != nullptr; }
+
+    void send(int cc, int value) override
+    {
+	if ((cc == 106 || cc == 107) && isPositiveAndBelow(value, numElementsInArray(pinForLed_)) && pinForLed_[value] >= 0)
+	{
+	    const uint32 bit = 1u << pinForLed_[value];
+	    if (cc == 106)
+	    {
+		set_ |= bit;
+		clear_ &= ~bit;
+	    }
+	    else
+	    {
+		clear_ |= bit;
+		set_ &= ~bit;
+	    }
+	}
+    }
+
+    void flush() override
+    {
+	if (registers_ != nullptr)
+	{
+	    if (set_ != 0)
+	    {
+		registers_[setOffset] = set_;
+	    }
+	    if (clear_ != 0)
+	    {
+		registers_[clearOffset] = clear_;
+	    }
+	}
+	set_ = clear_ = 0;
+    }
+
+private:
+    static const size_t mapSize = 4096;
+    static const int setOffset = 0x1c / 4;      // GPSET0
+    static const int clearOffset = 0x28 / 4;    // GPCLR0
+
+    volatile uint32* registers_ = nullptr;
+    int pinForLed_[128] = {};
+    uint32 set_ = 0;
+    uint32 clear_ = 0;
+
+    JUCE_DECLARE_NON_COPYABLE(GpioLedPort)
+};
+
+//==============================================================================
+// LEDs behind a chain of shift registers (74HC595 and the like) or an LED
+// driver chip that takes its outputs as a bit stream, on an SPI bus. LED
+// number n is bit n of the frame, from the first byte's low bit on, and
+// each batch's flush() writes the whole board's frame with one write() to
+// the spidev device. Other commands are ignored.
+class SpiLedPort : public LedCommandSink
+{
+public:
+    static const int maxBytes = 16;
+
+    SpiLedPort() {}
+
+    ~SpiLedPort()
+    {
+	close();
+    }
+
+#if JUCE_LINUX
+    bool open(const String& device, int numBytes, uint32 speedHz = 1000000)
+    {
+	close();
+	fd_ = ::open(device.toRawUTF8(), O_WRONLY | O_CLOEXEC);
+	if (fd_ < 0)
+	{
+	    return false;
+	}
+	uint8 mode = SPI_MODE_0;
+	if (::ioctl(fd_, SPI_IOC_WR_MODE, &mode) < 0 || ::ioctl(fd_, SPI_IOC_WR_MAX_SPEED_HZ, &speedHz) < 0)
+	{
+	    close();
+	    return false;
+	}
+	numBytes_ = jlimit(1, (int) maxBytes, numBytes);
+	std::memset(frame_, 0, sizeof(frame_));
+	dirty_ = true;
+	flush();
+	return true;
+    }
+
+    void close()
+    {
+	if (fd_ >= 0)
+	{
+	    ::close(fd_);
+	    fd_ = -1;
+	}
+    }
+#else
+    bool open(const String&, int, uint32 = 0)   { return false; }
+    void close()                                {}
+#endif
+
+    bool isOpen() const                 { return fd_ >= 0; }
+
+    void send(int cc, int value) override
+    {
+	if ((cc == 106 || cc == 107) && isPositiveAndBelow(value, numBytes_ * 8))
+	{
+	    const uint8 bit = (uint8) (1u << (value % 8));
+	    frame_[value / 8] = (uint8) (cc == 106 ? (frame_[value / 8] | bit) : (frame_[value / 8] & ~bit));
+	    dirty_ = true;
+	}
+    }
+
+    void flush() override
+    {
+#if JUCE_LINUX
+	if (fd_ >= 0 && dirty_)
+	{
+	    // the far end of the chain goes first, so the last byte is shifted out first
+	    uint8 wire[maxBytes];
+	    for (int i = 0; i < numBytes_; ++i)
+	    {
+		wire[i] = frame_[numBytes_ - 1 - i];
+	    }
+	    ignoreUnused(::write(fd_, wire, (size_t) numBytes_));
+	}
+#endif
+	dirty_ = false;
+    }
+
+private:
+    int fd_ = -1;
+    int numBytes_ = 2;
+    uint8 frame_[maxBytes] = {};
+    bool dirty_ = false;
+
+    JUCE_DECLARE_NON_COPYABLE(SpiLedPort)
+};
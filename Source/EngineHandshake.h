@@ -0,0 +1,183 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+//==============================================================================
+// An engine's connection handshake, /ping, its /pingack, the registrations
+// and every loop's first state, as one small state machine the replies and
+// the engine's timer drive. Each step waits on the answer it asked for, not
+// on a heartbeat interval: a ping that goes unanswered is sent again after a
+// short wait that doubles each time, and so are the state queries of the
+// loops that are still to answer. Those go out all at once and come back on
+// a path of their own ("<prefix>/state"), so an answer is known to be one,
+// whatever the auto updates on "/ctrl" are doing meanwhile.
+//
+// Times are Time::getMillisecondCounter() values; only the control thread
+// uses this.
+class EngineHandshake
+{
+public:
+    enum Step
+    {
+	Idle,           // not connected
+	Pinging,        // waiting on the /pingack
+	Querying,       // registered, waiting on the loops' states
+	Ready
+    };
+
+    static const int initialRetryMs = 50;
+    static const int maxRetryMs = 2000;
+
+    EngineHandshake() {}
+
+    Step getStep() const            { return step_; }
+    bool isReady() const            { return step_ == Ready; }
+    bool isAcknowledged() const     { return step_ == Querying || step_ == Ready; }
+
+    // the ping has gone out
+    void start(uint32 now)
+    {
+	step_ = Pinging;
+	pending_.clear();
+	startedAt_ = now;
+	wait(now, initialRetryMs);
+    }
+
+    void reset()
+    {
+	step_ = Idle;
+	pending_.clear();
+    }
+
+    // the /pingack: on to the loops' states, or done if there are none; true
+    // if the handshake finished here
+    bool acknowledged(int numLoops, uint32 now)
+    {
+	if (step_ != Pinging)
+	{
+	    return false;
+	}
+	step_ = Querying;
+	wait(now, initialRetryMs);
+	return numLoops > 0 ? false : finish(now);
+    }
+
+    // the state of loops first to last - 1 has been asked for
+    void queried(int first, int last, uint32 now)
+    {
+	if (step_ == Querying && last > first)
+	{
+	    pending_.setRange(first, last - first, true);
+	    wait(now, initialRetryMs);
+	}
+    }
+
+    // an answer on the state path; true if it was the last one
+    bool reported(int loop, uint32 now)
+    {
+	if (step_ != Querying || loop < 0 || !pending_[loop])
+	{
+	    return false;
+	}
+	pending_.clearBit(loop);
+	return pending_.isZero() ? finish(now) : false;
+    }
+
+    // the loops there turned out to be fewer than were asked about
+    bool resized(int numLoops, uint32 now)
+    {
+	if (step_ != Querying || pending_.getHighestBit() < numLoops)
+	{
+	    return false;
+	}
+	pending_.setRange(numLoops, pending_.getHighestBit() + 1 - numLoops, false);
+	return pending_.isZero() ? finish(now) : false;
+    }
+
+    // the next time the engine's timer has to look at this, 0 for never
+    uint32 getNextCheckAt() const   { return step_ == Pinging || step_ == Querying ? retryAt_ : 0; }
+
+    // a step waited too long: it's to be taken again, and waits for twice
+    // as long this time
+    bool isOverdue(uint32 now) const
+    {
+	return (step_ == Pinging || step_ == Querying) && (int) (now - retryAt_) >= 0;
+    }
+
+    void retried(uint32 now)
+    {
+	if (step_ == Pinging)
+	{
+	    ++numPingRetries_;
+	}
+	else
+	{
+	    ++numQueryRetries_;
+	}
+	wait(now, jmin(maxRetryMs, retryMs_ * 2));
+    }
+
+    // the loops a retry asks about again
+    template <typename Function>
+    void forEachPending(Function&& function) const
+    {
+	for (int loop = pending_.findNextSetBit(0); loop >= 0; loop = pending_.findNextSetBit(loop + 1))
+	{
+	    function(loop);
+	}
+    }
+
+    int getNumCompleted() const     { return numCompleted_; }
+    int getLastMs() const           { return lastMs_; }
+    int getLongestMs() const        { return longestMs_; }
+    int getNumPingRetries() const   { return numPingRetries_; }
+    int getNumQueryRetries() const  { return numQueryRetries_; }
+
+private:
+    void wait(uint32 now, int ms)
+    {
+	retryMs_ = ms;
+	retryAt_ = now + (uint32) ms;
+    }
+
+    bool finish(uint32 now)
+    {
+	step_ = Ready;
+	lastMs_ = (int) (now - startedAt_);
+	longestMs_ = jmax(longestMs_, lastMs_);
+	++numCompleted_;
+	return true;
+    }
+
+    Step step_ = Idle;
+    BigInteger pending_;
+    uint32 startedAt_ = 0;
+    uint32 retryAt_ = 0;
+    int retryMs_ = initialRetryMs;
+    int numCompleted_ = 0;
+    int lastMs_ = 0;
+    int longestMs_ = 0;
+    int numPingRetries_ = 0;
+    int numQueryRetries_ = 0;
+
+    JUCE_DECLARE_NON_COPYABLE(EngineHandshake)
+};
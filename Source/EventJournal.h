@@ -0,0 +1,270 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+//==============================================================================
+// The flight recorder: the last few thousand high level events (pedals, notes
+// sent, loop states heard, connection changes) as fixed 32 byte records in a
+// memory mapped ring file, meant to stay on all the time. Where TraceCapture
+// keeps the traffic, this keeps what it meant, small enough to read through
+// after a crash or freeze with "journal show". Recording is an atomic
+// increment and a handful of stores, no formatting and no locks, from any
+// thread.
+//
+// The file is a 64 byte header followed by numRecords records:
+//
+//   header: "L4RJRNL " u32 version u32 recordSize u32 numRecords u32 0
+//           i64 ticksPerSecond i64 ticks and i64 ms since 1970 when opened
+//           u64 next (records written so far)
+//   record: i64 highResolutionTicks u32 sequence u16 event u16 engine
+//           i32 a i32 b i32 c u32 0
+//
+// in native byte order, with the same sequence rule as the trace: record n
+// goes in slot n % numRecords with sequence n + 1 stored last, 0 meaning the
+// slot is empty or was being written.
+class EventJournal
+{
+public:
+    enum Event
+    {
+	Started = 1,        // a: pid
+	Stopped,
+	PedalDown,          // a: controller value, b: input
+	PedalUp,            // a: controller value, b: input
+	NoteOn,             // a: channel, b: note, c: velocity
+	NoteOff,            // a: channel, b: note
+	LoopState,          // a: loop, b: new state, c: old state
+	LoopSelected,       // a: loop
+	PingAck,            // a: loops, b: engine id
+	Connected,          // a: send port
+	HeartbeatLost,      // a: send port, b: ms until the reconnect
+	OscQueueFull,
+	Handshake,          // a: ms from the ping to the last loop's state
+	PedalBank,          // a: bank shown
+	numEvents
+    };
+
+    static const int recordSize = 32;
+    static const int defaultNumRecords = 8192;
+    static const uint32 version = 1;
+
+    EventJournal() {}
+
+    ~EventJournal()
+    {
+	close();
+    }
+
+    // the known path: /dev/shm where there is one, so it costs no disk writes
+    static File getDefaultFile()
+    {
+	const File shm("/dev/shm");
+	return (shm.isDirectory() ? shm : File::getSpecialLocation(File::tempDirectory)).getChildFile("loop4r.journal");
+    }
+
+    // (re)creates the file at its full size and maps it
+    bool open(const File& file, int numRecords = defaultNumRecords)
+    {
+	close();
+	numRecords = jmax(16, numRecords);
+	const int64 fileSize = (int64) sizeof(Header) + (int64) numRecords * recordSize;
+	{
+	    file.deleteFile();
+	    FileOutputStream out(file);
+	    if (out.failedToOpen() || !out.setPosition(fileSize - 1) || !out.writeByte(0))
+	    {
+		return false;
+	    }
+	}
+
+	map_ = new MemoryMappedFile(file, MemoryMappedFile::readWrite);
+	if (map_->getData() == nullptr || (int64) map_->getSize() != fileSize)
+	{
+	    map_ = nullptr;
+	    return false;
+	}
+
+	Header* header = static_cast<Header*>(map_->getData());
+	std::memcpy(header->magic_, "L4RJRNL ", 8);
+	header->version_ = version;
+	header->recordSize_ = recordSize;
+	header->numRecords_ = (uint32) numRecords;
+	header->reserved_ = 0;
+	header->ticksPerSecond_ = Time::getHighResolutionTicksPerSecond();
+	header->openedTicks_ = Time::getHighResolutionTicks();
+	header->openedMs_ = Time::currentTimeMillis();
+	header->next_.store(0);
+	numRecords_ = (uint32) numRecords;
+	file_ = file;
+	records_.store(reinterpret_cast<Record*>(header + 1));
+	return true;
+    }
+
+    void close()
+    {
+	records_.store(nullptr);
+	map_ = nullptr;
+    }
+
+    bool isOpen() const                 { return records_.load(std::memory_order_relaxed) != nullptr; }
+    const File& getFile() const         { return file_; }
+
+    void record(Event event, int engine = 0, int32 a = 0, int32 b = 0, int32 c = 0)
+    {
+	Record* records = records_.load(std::memory_order_acquire);
+	if (records == nullptr)
+	{
+	    return;
+	}
+
+	const uint64 n = header()->next_.fetch_add(1, std::memory_order_relaxed);
+	Record& record = records[n % numRecords_];
+	record.sequence_.store(0, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	record.ticks_ = Time::getHighResolutionTicks();
+	record.event_ = (uint16) event;
+	record.engine_ = (uint16) engine;
+	record.a_ = a;
+	record.b_ = b;
+	record.c_ = c;
+	record.sequence_.store((uint32) (n + 1), std::memory_order_release);
+    }
+
+    //==============================================================================
+    // Reading a journal back, which could be one another (crashed) process left.
+    struct Entry
+    {
+	int64 ms_;          // since 1970
+	Event event_;
+	int engine_;
+	int32 a_, b_, c_;
+    };
+
+    // the complete records in the file, oldest first; false if it isn't a journal
+    static bool read(const File& file, Array<Entry>& entries)
+    {
+	MemoryBlock block;
+	if (!file.loadFileAsData(block) || block.getSize() < sizeof(Header))
+	{
+	    return false;
+	}
+
+	const Header* header = static_cast<const Header*>(block.getData());
+	if (std::memcmp(header->magic_, "L4RJRNL ", 8) != 0 || header->version_ != version
+	    || header->recordSize_ != (uint32) recordSize || header->ticksPerSecond_ <= 0
+	    || block.getSize() < sizeof(Header) + (size_t) header->numRecords_ * recordSize)
+	{
+	    return false;
+	}
+
+	Array<const Record*> slots;
+	const Record* records = reinterpret_cast<const Record*>(header + 1);
+	for (uint32 i = 0; i < header->numRecords_; ++i)
+	{
+	    if (records[i].sequence_.load() != 0)
+	    {
+		slots.add(records + i);
+	    }
+	}
+	std::sort(slots.begin(), slots.end(), [] (const Record* a, const Record* b) { return a->sequence_.load() < b->sequence_.load(); });
+
+	entries.clearQuick();
+	entries.ensureStorageAllocated(slots.size());
+	for (auto* record : slots)
+	{
+	    Entry entry;
+	    entry.ms_ = header->openedMs_ + (record->ticks_ - header->openedTicks_) * 1000 / header->ticksPerSecond_;
+	    entry.event_ = (Event) record->event_;
+	    entry.engine_ = record->engine_;
+	    entry.a_ = record->a_;
+	    entry.b_ = record->b_;
+	    entry.c_ = record->c_;
+	    entries.add(entry);
+	}
+	return true;
+    }
+
+    static String describe(const Entry& entry)
+    {
+	const String engine = "engine " + String(entry.engine_) + " ";
+	switch (entry.event_)
+	{
+	    case Started:       return "started, pid " + String(entry.a_);
+	    case Stopped:       return "stopped";
+	    case PedalDown:     return "pedal " + String(entry.a_) + " down on input " + String(entry.b_);
+	    case PedalUp:       return "pedal " + String(entry.a_) + " up on input " + String(entry.b_);
+	    case NoteOn:        return "note on " + String(entry.b_) + " velocity " + String(entry.c_) + " channel " + String(entry.a_);
+	    case NoteOff:       return "note off " + String(entry.b_) + " channel " + String(entry.a_);
+	    case LoopState:     return engine + "loop " + String(entry.a_) + " state " + String(entry.c_) + " -> " + String(entry.b_);
+	    case LoopSelected:  return engine + "selected loop " + String(entry.a_);
+	    case PingAck:       return engine + "pingack, " + String(entry.a_) + " loops, id " + String(entry.b_);
+	    case Connected:     return engine + "connected to port " + String(entry.a_);
+	    case HeartbeatLost: return engine + "lost heartbeat on port " + String(entry.a_) + ", reconnecting in " + String(entry.b_) + "ms";
+	    case OscQueueFull:  return "OSC queue full";
+	    case Handshake:     return engine + "handshake done in " + String(entry.a_) + "ms";
+	    case PedalBank:     return "pedal bank " + String(entry.a_ + 1);
+	    default:            return "unknown event " + String((int) entry.event_);
+	}
+    }
+
+private:
+    struct Header
+    {
+	char magic_[8];
+	uint32 version_;
+	uint32 recordSize_;
+	uint32 numRecords_;
+	uint32 reserved_;
+	int64 ticksPerSecond_;
+	int64 openedTicks_;
+	int64 openedMs_;
+	std::atomic<uint64> next_;
+	char padding_[8];
+    };
+
+    struct Record
+    {
+	int64 ticks_;
+	std::atomic<uint32> sequence_;
+	uint16 event_;
+	uint16 engine_;
+	int32 a_;
+	int32 b_;
+	int32 c_;
+	uint32 reserved_;
+    };
+
+    static_assert(sizeof(Header) == 64, "journal header layout");
+    static_assert(sizeof(Record) == recordSize, "journal record layout");
+
+    Header* header() const              { return static_cast<Header*>(map_->getData()); }
+
+    ScopedPointer<MemoryMappedFile> map_;
+    std::atomic<Record*> records_ { nullptr };
+    uint32 numRecords_ = 0;
+    File file_;
+
+    JUCE_DECLARE_NON_COPYABLE(EventJournal)
+};
@@ -0,0 +1,644 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "HexEncoder.h"
+#include "OscMessageView.h"
+#include <atomic>
+#include <cstring>
+#include <iostream>
+
+enum LogLevel
+{
+    LogQuiet,           // no per-event output
+    LogNormal,          // MIDI events and the OSC messages we care about
+    LogVerbose          // every OSC message, heartbeats and pings included
+};
+
+enum LogCategory
+{
+    LogMidi,
+    LogOsc,
+    numLogCategories
+};
+
+//==============================================================================
+// Bounds how often a kind of line gets written: only every sampleEvery'th
+// one is considered at all, and those are let through by a token bucket
+// refilled at perSecond up to burst. Lines kept out are counted for
+// "suppressed" summaries. A rate of 0 lets everything through. Any thread.
+class LogRateLimiter
+{
+public:
+    LogRateLimiter(double perSecond = 0, double burst = 0, int sampleEvery = 1)
+    {
+	configure(perSecond, burst, sampleEvery);
+    }
+
+    void configure(double perSecond, double burst, int sampleEvery)
+    {
+	const SpinLock::ScopedLockType lock(lock_);
+	perSecond_ = jmax(0.0, perSecond);
+	burst_ = jmax(1.0, burst > 0 ? burst : perSecond_);
+	sampleEvery_ = jmax(1, sampleEvery);
+	tokens_ = burst_;
+	lastTicks_ = Time::getHighResolutionTicks();
+	seen_ = 0;
+    }
+
+    bool allow()
+    {
+	const SpinLock::ScopedLockType lock(lock_);
+	if (sampleEvery_ > 1 && ++seen_ % sampleEvery_ != 0)
+	{
+	    ++suppressed_;
+	    return false;
+	}
+	if (perSecond_ <= 0)
+	{
+	    return true;
+	}
+
+	const int64 now = Time::getHighResolutionTicks();
+	tokens_ = jmin(burst_, tokens_ + Time::highResolutionTicksToSeconds(now - lastTicks_) * perSecond_);
+	lastTicks_ = now;
+	if (tokens_ < 1.0)
+	{
+	    ++suppressed_;
+	    return false;
+	}
+	tokens_ -= 1.0;
+	return true;
+    }
+
+    int64 getNumSuppressed() const
+    {
+	const SpinLock::ScopedLockType lock(lock_);
+	return suppressed_;
+    }
+
+    // lines kept out since the last call
+    int64 takeSuppressed()
+    {
+	const SpinLock::ScopedLockType lock(lock_);
+	const int64 suppressed = suppressed_;
+	suppressed_ = 0;
+	return suppressed;
+    }
+
+    String describe() const
+    {
+	const SpinLock::ScopedLockType lock(lock_);
+	return (perSecond_ > 0 ? String(perSecond_) + "/s, burst " + String(burst_) : String("unlimited"))
+	    + (sampleEvery_ > 1 ? ", 1 in " + String(sampleEvery_) : String());
+    }
+
+private:
+    mutable SpinLock lock_;
+    double perSecond_ = 0;
+    double burst_ = 1;
+    int sampleEvery_ = 1;
+    double tokens_ = 0;
+    int64 lastTicks_ = 0;
+    int64 seen_ = 0;
+    int64 suppressed_ = 0;
+};
+
+//==============================================================================
+// Per-event logging for the MIDI and OSC paths. Producers only copy the raw
+// bytes of an event into a preallocated record, a background thread turns the
+// records into the usual text on stderr. Below the record's level nothing is
+// copied at all. Each category has a rate limit (200 records a second by
+// default) so a flood costs a bounded amount of stderr, and journald, whatever
+// the input rate; what it keeps out is summarised once a second. If the
+// writer can't keep up, records are dropped and counted rather than blocking
+// the caller.
+class EventLog : private Thread
+{
+public:
+    EventLog(int capacity = 512)
+	: Thread("loop4r log"), fifo_(capacity), level_(LogNormal),
+	  useHex_(false), noteNumbers_(false), octaveMiddleC_(3), numDropped_(0)
+    {
+	records_.calloc((size_t) capacity);
+	for (auto&& limit : limits_)
+	{
+	    limit.configure(defaultRecordsPerSecond, 2 * defaultRecordsPerSecond, 1);
+	}
+    }
+
+    static const int defaultRecordsPerSecond = 200;
+
+    ~EventLog()
+    {
+	stop();
+    }
+
+    void setLevel(LogLevel level)               { level_ = level; }
+
+    // the most that's logged whatever the level, for shedding load
+    void setCeiling(LogLevel ceiling)           { ceiling_ = ceiling; }
+
+    // perSecond 0 for no limit, at any time
+    void setRateLimit(LogCategory category, double perSecond, double burst, int sampleEvery)
+    {
+	limits_[category].configure(perSecond, burst, sampleEvery);
+    }
+
+    String describeRateLimit(LogCategory category) const     { return limits_[category].describe(); }
+    bool isEnabled(LogLevel level) const        { return level != LogQuiet && level_.load() >= level && ceiling_.load() >= level; }
+
+    // call before start(), the writer reads these without locking
+    void setMidiFormat(bool useHex, bool noteNumbers, int octaveMiddleC)
+    {
+	useHex_ = useHex;
+	noteNumbers_ = noteNumbers;
+	octaveMiddleC_ = octaveMiddleC;
+    }
+
+    void start()
+    {
+	startThread();
+    }
+
+    // writes out whatever is still queued, then stops the writer
+    void stop()
+    {
+	if (isThreadRunning())
+	{
+	    signalThreadShouldExit();
+	    wakeUp_.signal();
+	    stopThread(1000);
+	}
+    }
+
+    void logMidi(LogLevel level, const MidiMessage& msg)
+    {
+	if (!isEnabled(level))
+	{
+	    return;
+	}
+
+	Record* record = beginRecord(LogMidi);
+	if (record != nullptr)
+	{
+	    record->kind_ = Record::Midi;
+	    record->size_ = msg.getRawDataSize();
+	    std::memcpy(record->midi_, msg.getRawData(), (size_t) jmin(record->size_, (int) sizeof(record->midi_)));
+	    finishRecord();
+	}
+    }
+
+    void logOsc(LogLevel level, const String& address, const OSCMessage& message)
+    {
+	if (!isEnabled(level))
+	{
+	    return;
+	}
+
+	Record* record = beginRecord(LogOsc);
+	if (record != nullptr)
+	{
+	    record->kind_ = Record::Osc;
+	    record->size_ = message.size();
+	    address.copyToUTF8(record->address_, sizeof(record->address_));
+	    const int numArgs = jmin(message.size(), (int) maxOscArgs);
+	    for (int i = 0; i < numArgs; ++i)
+	    {
+		copyArgument(message[i], record->args_[i]);
+	    }
+	    finishRecord();
+	}
+    }
+
+    void logOsc(LogLevel level, const OscMessageView& message)
+    {
+	if (!isEnabled(level))
+	{
+	    return;
+	}
+
+	Record* record = beginRecord(LogOsc);
+	if (record != nullptr)
+	{
+	    record->kind_ = Record::Osc;
+	    record->size_ = message.size();
+	    copyText(message.getAddress(), std::strlen(message.getAddress()), record->address_, sizeof(record->address_));
+	    const int numArgs = jmin(message.size(), (int) maxOscArgs);
+	    for (int i = 0; i < numArgs; ++i)
+	    {
+		copyArgument(message, i, record->args_[i]);
+	    }
+	    finishRecord();
+	}
+    }
+
+    int64 getNumDropped() const     { return numDropped_.load(); }
+
+private:
+    static const int maxOscArgs = 6;
+
+    struct Argument
+    {
+	char type_;
+	int32 int_;
+	float float_;
+	char text_[40];     // string or blob contents, truncated
+    };
+
+    struct Record
+    {
+	enum Kind { Midi, Osc };
+
+	Kind kind_;
+	int size_;          // raw MIDI size, or the number of OSC arguments
+	uint8 midi_[64];
+	char address_[64];
+	Argument args_[maxOscArgs];
+    };
+
+    static void copyArgument(const OSCArgument& arg, Argument& copy)
+    {
+	copy.type_ = arg.getType();
+	copy.text_[0] = 0;
+	if (arg.isInt32())
+	{
+	    copy.int_ = arg.getInt32();
+	}
+	else if (arg.isFloat32())
+	{
+	    copy.float_ = arg.getFloat32();
+	}
+	else if (arg.isString())
+	{
+	    arg.getString().copyToUTF8(copy.text_, sizeof(copy.text_));
+	}
+	else if (arg.isBlob())
+	{
+	    const MemoryBlock& blob = arg.getBlob();
+	    const size_t size = jmin(blob.getSize(), sizeof(copy.text_) - 1);
+	    std::memcpy(copy.text_, blob.getData(), size);
+	    copy.text_[size] = 0;
+	}
+    }
+
+    static void copyArgument(const OscMessageView& message, int index, Argument& copy)
+    {
+	copy.type_ = message.getType(index);
+	copy.text_[0] = 0;
+	if (message.isInt32(index))
+	{
+	    copy.int_ = message.getInt32(index);
+	}
+	else if (message.isFloat32(index))
+	{
+	    copy.float_ = message.getFloat32(index);
+	}
+	else if (message.isString(index))
+	{
+	    copyText(message.getString(index), std::strlen(message.getString(index)), copy.text_, sizeof(copy.text_));
+	}
+	else if (message.isBlob(index))
+	{
+	    copyText(static_cast<const char*>(message.getBlobData(index)), (size_t) message.getBlobSize(index), copy.text_, sizeof(copy.text_));
+	}
+    }
+
+    static void copyText(const char* text, size_t size, char* copy, size_t capacity)
+    {
+	size = jmin(size, capacity - 1);
+	std::memcpy(copy, text, size);
+	copy[size] = 0;
+    }
+
+    // the MIDI input and control threads both log, so producers take turns
+    Record* beginRecord(LogCategory category)
+    {
+	if (!limits_[category].allow())
+	{
+	    if (limits_[category].getNumSuppressed() == 1)
+	    {
+		// the writer sleeps until there's something to summarise
+		wakeUp_.signal();
+	    }
+	    return nullptr;
+	}
+	producerLock_.enter();
+	int start1, size1, start2, size2;
+	fifo_.prepareToWrite(1, start1, size1, start2, size2);
+	if (size1 + size2 < 1)
+	{
+	    producerLock_.exit();
+	    ++numDropped_;
+	    return nullptr;
+	}
+	return &records_[size1 > 0 ? start1 : start2];
+    }
+
+    void finishRecord()
+    {
+	fifo_.finishedWrite(1);
+	producerLock_.exit();
+	wakeUp_.signal();
+    }
+
+    void run() override
+    {
+	while (!threadShouldExit())
+	{
+	    // woken for records, or once a second while there's something
+	    // suppressed to summarise
+	    wakeUp_.wait(hasSuppressed() ? 1000 : -1);
+	    drain();
+	}
+	drain();
+    }
+
+    bool hasSuppressed() const
+    {
+	for (auto&& limit : limits_)
+	{
+	    if (limit.getNumSuppressed() > 0)
+	    {
+		return true;
+	    }
+	}
+	return false;
+    }
+
+    void drain()
+    {
+	int start1, size1, start2, size2;
+	fifo_.prepareToRead(fifo_.getNumReady(), start1, size1, start2, size2);
+	for (int i = 0; i < size1; ++i)
+	{
+	    write(records_[start1 + i]);
+	}
+	for (int i = 0; i < size2; ++i)
+	{
+	    write(records_[start2 + i]);
+	}
+	fifo_.finishedRead(size1 + size2);
+
+	const int64 dropped = numDropped_.exchange(0);
+	if (dropped > 0)
+	{
+	    std::cerr << "(" << dropped << " log records dropped)" << std::endl;
+	}
+	const uint32 now = Time::getMillisecondCounter();
+	if (now - lastSummaryMs_ < 1000 && !threadShouldExit())
+	{
+	    return;
+	}
+	lastSummaryMs_ = now;
+	const char* names[numLogCategories] = { "MIDI", "OSC" };
+	for (int i = 0; i < numLogCategories; ++i)
+	{
+	    const int64 suppressed = limits_[i].takeSuppressed();
+	    if (suppressed > 0)
+	    {
+		std::cerr << "(suppressed " << suppressed << " " << names[i] << " log records)" << std::endl;
+	    }
+	}
+    }
+
+    void write(const Record& record)
+    {
+	if (record.kind_ == Record::Midi)
+	{
+	    writeMidi(MidiMessage(record.midi_, jmin(record.size_, (int) sizeof(record.midi_))), std::cerr);
+	}
+	else
+	{
+	    writeOsc(record, std::cerr);
+	}
+    }
+
+    void writeOsc(const Record& record, std::ostream& out)
+    {
+	out << "-- osc message, address = '" << record.address_ << "', " << record.size_ << " argument(s)" << std::endl;
+
+	const int numArgs = jmin(record.size_, (int) maxOscArgs);
+	for (int i = 0; i < numArgs; ++i)
+	{
+	    const Argument& arg = record.args_[i];
+	    String typeAsString;
+	    String valueAsString;
+
+	    switch (arg.type_)
+	    {
+		case 'f':
+		    typeAsString = "float32";
+		    valueAsString = String (arg.float_);
+		    break;
+		case 'i':
+		    typeAsString = "int32";
+		    valueAsString = String (arg.int_);
+		    break;
+		case 's':
+		    typeAsString = "string";
+		    valueAsString = String::fromUTF8 (arg.text_);
+		    break;
+		case 'b':
+		    typeAsString = "blob";
+		    valueAsString = String::fromUTF8 (arg.text_);
+		    break;
+		default:
+		    typeAsString = "(unknown)";
+		    break;
+	    }
+
+	    out << "==- " + typeAsString.paddedRight(' ', 12) + valueAsString << std::endl;
+	}
+    }
+
+    void writeMidi(const MidiMessage& msg, std::ostream& out)
+    {
+	if (msg.isNoteOn())
+	{
+	    out << "channel "  << outputChannel(msg) << "   " <<
+	    "note-on         " << outputNote(msg) << " " << output7Bit(msg.getVelocity()).paddedLeft(' ', 3) << std::endl;
+	}
+	else if (msg.isNoteOff())
+	{
+	    out << "channel "  << outputChannel(msg) << "   " <<
+	    "note-off        " << outputNote(msg) << " " << output7Bit(msg.getVelocity()).paddedLeft(' ', 3) << std::endl;
+	}
+	else if (msg.isAftertouch())
+	{
+	    out << "channel "  << outputChannel(msg) << "   " <<
+	    "poly-pressure   " << outputNote(msg) << " " << output7Bit(msg.getAfterTouchValue()).paddedLeft(' ', 3) << std::endl;
+	}
+	else if (msg.isController())
+	{
+	    out << "channel "  << outputChannel(msg) << "   " <<
+	    "control-change   " << output7Bit(msg.getControllerNumber()).paddedLeft(' ', 3) << " "
+	    << output7Bit(msg.getControllerValue()).paddedLeft(' ', 3) << std::endl;
+	}
+	else if (msg.isProgramChange())
+	{
+	    out << "channel "  << outputChannel(msg) << "   " <<
+	    "program-change   " << output7Bit(msg.getProgramChangeNumber()).paddedLeft(' ', 7) << std::endl;
+	}
+	else if (msg.isChannelPressure())
+	{
+	    out << "channel "  << outputChannel(msg) << "   " <<
+	    "channel-pressure " << output7Bit(msg.getChannelPressureValue()).paddedLeft(' ', 7) << std::endl;
+	}
+	else if (msg.isPitchWheel())
+	{
+	    out << "channel "  << outputChannel(msg) << "   " <<
+	    "pitch-bend       " << output14Bit(msg.getPitchWheelValue()).paddedLeft(' ', 7) << std::endl;
+	}
+	else if (msg.isMidiClock())
+	{
+	    out << "midi-clock" << std::endl;
+	}
+	else if (msg.isMidiStart())
+	{
+	    out << "start" << std::endl;
+	}
+	else if (msg.isMidiStop())
+	{
+	    out << "stop" << std::endl;
+	}
+	else if (msg.isMidiContinue())
+	{
+	    out << "continue" << std::endl;
+	}
+	else if (msg.isActiveSense())
+	{
+	    out << "active-sensing" << std::endl;
+	}
+	else if (msg.getRawDataSize() == 1 && msg.getRawData()[0] == 0xff)
+	{
+	    out << "reset" << std::endl;
+	}
+	else if (msg.isSysEx())
+	{
+	    out << "system-exclusive";
+
+	    if (!useHex_)
+	    {
+		out << " hex";
+	    }
+
+	    // a chunk at a time through the table, however long the dump
+	    char hex[3 * 64 + 1];
+	    const uint8* data = msg.getSysExData();
+	    for (int left = msg.getSysExDataSize(); left > 0; left -= 64)
+	    {
+		const size_t size = (size_t) jmin(left, 64);
+		out.write(hex, HexEncoder::appendSpaced(hex, data, size) - hex);
+		data += size;
+	    }
+
+	    if (!useHex_)
+	    {
+		out << " dec";
+	    }
+	    out << std::endl;
+	}
+	else if (msg.isQuarterFrame())
+	{
+	    out << "time-code " << output7Bit(msg.getQuarterFrameSequenceNumber()).paddedLeft(' ', 2) << " " << output7Bit(msg.getQuarterFrameValue()) << std::endl;
+	}
+	else if (msg.isSongPositionPointer())
+	{
+	    out << "song-position " << output14Bit(msg.getSongPositionPointerMidiBeat()).paddedLeft(' ', 5) << std::endl;
+	}
+	else if (msg.getRawDataSize() == 2 && msg.getRawData()[0] == 0xf3)
+	{
+	    out << "song-select " << output7Bit(msg.getRawData()[1]).paddedLeft(' ', 3) << std::endl;
+	}
+	else if (msg.getRawDataSize() == 1 && msg.getRawData()[0] == 0xf6)
+	{
+	    out << "tune-request" << std::endl;
+	}
+    }
+
+    String output7BitAsHex(int v)
+    {
+	return String(HexEncoder::digits((uint8) v), 2);
+    }
+
+    String output7Bit(int v)
+    {
+	if (useHex_)
+	{
+	    return output7BitAsHex(v);
+	}
+	else
+	{
+	    return String(v);
+	}
+    }
+
+    String output14BitAsHex(int v)
+    {
+	return String::toHexString(v).paddedLeft('0', 4).toUpperCase();
+    }
+
+    String output14Bit(int v)
+    {
+	if (useHex_)
+	{
+	    return output14BitAsHex(v);
+	}
+	else
+	{
+	    return String(v);
+	}
+    }
+
+    String outputNote(const MidiMessage& msg)
+    {
+	if (noteNumbers_)
+	{
+	    return output7Bit(msg.getNoteNumber()).paddedLeft(' ', 4);
+	}
+	else
+	{
+	    return MidiMessage::getMidiNoteName(msg.getNoteNumber(), true, true, octaveMiddleC_).paddedLeft(' ', 4);
+	}
+    }
+
+    String outputChannel(const MidiMessage& msg)
+    {
+	return output7Bit(msg.getChannel()).paddedLeft(' ', 2);
+    }
+
+    AbstractFifo fifo_;
+    HeapBlock<Record> records_;
+    SpinLock producerLock_;
+    WaitableEvent wakeUp_;
+    std::atomic<int> level_;
+    std::atomic<int> ceiling_ { LogVerbose };
+
+    bool useHex_;
+    bool noteNumbers_;
+    int octaveMiddleC_;
+
+    std::atomic<int64> numDropped_;
+    LogRateLimiter limits_[numLogCategories];
+    uint32 lastSummaryMs_ = 0;      // writer thread only
+
+    JUCE_DECLARE_NON_COPYABLE(EventLog)
+};
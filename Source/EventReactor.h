@@ -0,0 +1,353 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "IoUring.h"
+#include <atomic>
+
+#if JUCE_LINUX
+ #include <cerrno>
+ #include <sys/epoll.h>
+ #include <sys/eventfd.h>
+ #include <sys/timerfd.h>
+ #include <unistd.h>
+#endif
+
+//==============================================================================
+// One epoll set for a thread that does all its waiting in one place: the
+// descriptors it reads from, a timerfd for its next deadline and an eventfd
+// other threads can wake it with. Each watched descriptor carries a tag that
+// wait() hands back when it's readable.
+//
+// The thread calling wait() is the loop's and should be the only one to
+// watch() and unwatch() once it runs. wake() may be called from anywhere, and
+// is free when called by the loop itself.
+//
+// Opened on io_uring instead, each watched descriptor has a one shot poll
+// outstanding (so a handler that leaves something unread is called again, as
+// with epoll), the wake eventfd a read, and the timeout goes in with the
+// wait: the re-arming, the timeout and the sleep are then the one
+// io_uring_enter() per wake, where epoll takes a timerfd_settime(), the
+// epoll_wait() and a read() of whichever of the eventfd and timerfd fired.
+class EventReactor
+{
+public:
+    enum Backend { Epoll, Uring };
+
+    EventReactor() {}
+
+    ~EventReactor()
+    {
+	close();
+    }
+
+#if JUCE_LINUX
+    bool open(Backend backend = Epoll)
+    {
+	close();
+	if (backend == Uring)
+	{
+	    wakeFd_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	    if (wakeFd_ < 0 || !uring_.open(ringEntries))
+	    {
+		close();
+		return false;
+	    }
+	    return true;
+	}
+
+	epoll_ = ::epoll_create1(EPOLL_CLOEXEC);
+	wakeFd_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	timerFd_ = ::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (epoll_ < 0 || wakeFd_ < 0 || timerFd_ < 0 || !watch(wakeFd_, wakeTag) || !watch(timerFd_, timerTag))
+	{
+	    close();
+	    return false;
+	}
+	return true;
+    }
+
+    void close()
+    {
+	owner_ = nullptr;
+	uring_.close();
+	wakeArmed_ = false;
+	numCancels_ = 0;
+	for (auto&& watch : watches_)
+	{
+	    watch.fd_ = -1;
+	    watch.armed_ = false;
+	}
+	for (int* fd : { &epoll_, &wakeFd_, &timerFd_ })
+	{
+	    if (*fd >= 0)
+	    {
+		::close(*fd);
+		*fd = -1;
+	    }
+	}
+    }
+
+    // tag is handed to wait()'s handler when fd is readable, must be >= 0
+    bool watch(int fd, int tag)
+    {
+	if (uring_.isOpen())
+	{
+	    {
+		const SpinLock::ScopedLockType lock(watchLock_);
+		Watch* free = nullptr;
+		for (auto&& watch : watches_)
+		{
+		    if (watch.fd_ == fd)
+		    {
+			return false;
+		    }
+		    if (watch.fd_ < 0 && free == nullptr)
+		    {
+			free = &watch;
+		    }
+		}
+		if (free == nullptr)
+		{
+		    return false;
+		}
+		free->fd_ = fd;
+		free->tag_ = tag;
+		free->armed_ = false;
+	    }
+	    wake();     // its poll goes in with the loop's next wait
+	    return true;
+	}
+
+	epoll_event event = {};
+	event.events = EPOLLIN;
+	event.data.u64 = ((uint64) (uint32) tag << 32) | (uint32) fd;
+	return ::epoll_ctl(epoll_, EPOLL_CTL_ADD, fd, &event) == 0;
+    }
+
+    void unwatch(int fd)
+    {
+	if (uring_.isOpen())
+	{
+	    {
+		const SpinLock::ScopedLockType lock(watchLock_);
+		for (int i = 0; i < maxWatches; ++i)
+		{
+		    Watch& watch = watches_[i];
+		    if (watch.fd_ == fd)
+		    {
+			if (watch.armed_ && numCancels_ < maxWatches)
+			{
+			    cancels_[numCancels_++] = getUserData(i);
+			}
+			watch.fd_ = -1;
+			watch.armed_ = false;
+			++watch.generation_;    // whatever its old poll completes with is ignored
+		    }
+		}
+	    }
+	    wake();
+	    return;
+	}
+
+	::epoll_ctl(epoll_, EPOLL_CTL_DEL, fd, nullptr);
+    }
+
+    void wake()
+    {
+	if (wakeFd_ >= 0 && Thread::getCurrentThreadId() != owner_)
+	{
+	    const uint64 one = 1;
+	    (void) ::write(wakeFd_, &one, sizeof(one));
+	}
+    }
+
+    // Sleeps until something is readable, the timeout (ms, -1 for none) runs
+    // out or wake() is called, then calls handler(tag) once per readable
+    // descriptor. getWakeTicks() is when epoll_wait came back, for the
+    // handlers to stamp what they read with.
+    template <typename Function>
+    void wait(int timeoutMs, Function handler)
+    {
+	owner_.store(Thread::getCurrentThreadId(), std::memory_order_relaxed);
+	if (uring_.isOpen())
+	{
+	    waitOnUring(timeoutMs, handler);
+	    return;
+	}
+
+	itimerspec deadline = {};
+	if (timeoutMs == 0)
+	{
+	    deadline.it_value.tv_nsec = 1; // zero would disarm it
+	}
+	else if (timeoutMs > 0)
+	{
+	    deadline.it_value.tv_sec = timeoutMs / 1000;
+	    deadline.it_value.tv_nsec = (timeoutMs % 1000) * 1000000L;
+	}
+	::timerfd_settime(timerFd_, 0, &deadline, nullptr);
+
+	epoll_event events[maxEvents];
+	const int numEvents = ::epoll_wait(epoll_, events, maxEvents, -1);
+	wakeTicks_ = Time::getHighResolutionTicks();
+	for (int i = 0; i < numEvents; ++i)
+	{
+	    const int tag = (int) (events[i].data.u64 >> 32);
+	    if (tag == wakeTag || tag == timerTag)
+	    {
+		uint64 count;
+		(void) ::read((int) (uint32) events[i].data.u64, &count, sizeof(count));
+	    }
+	    else
+	    {
+		handler(tag);
+	    }
+	}
+    }
+#else
+    bool open(Backend = Epoll)  { return false; }
+    void close()                {}
+    bool watch(int, int)        { return false; }
+    void unwatch(int)           {}
+    void wake()                 {}
+    template <typename Function>
+    void wait(int, Function)    {}
+#endif
+
+    bool isOpen() const         { return epoll_ >= 0 || uring_.isOpen(); }
+    Backend getBackend() const  { return uring_.isOpen() ? Uring : Epoll; }
+    int64 getWakeTicks() const  { return wakeTicks_; }
+    // a signal handler wakes the loop by writing 1 to this, as wake() does
+    int getWakeFd() const       { return wakeFd_; }
+
+private:
+    static const int maxEvents = 16;
+    static const int wakeTag = 0x7ffffffe;
+    static const int timerTag = 0x7fffffff;
+    static const int maxWatches = 32;
+    static const unsigned int ringEntries = 64;
+    static const uint64 wakeData = ~(uint64) 0;
+    static const uint64 cancelData = ~(uint64) 1;
+
+    struct Watch
+    {
+	int fd_ = -1;
+	int tag_ = 0;
+	uint32 generation_ = 0;
+	bool armed_ = false;    // its poll is in the ring
+    };
+
+    uint64 getUserData(int index) const
+    {
+	return ((uint64) watches_[index].generation_ << 32) | (uint32) index;
+    }
+
+#if JUCE_LINUX
+    template <typename Function>
+    void waitOnUring(int timeoutMs, Function& handler)
+    {
+	{
+	    const SpinLock::ScopedLockType lock(watchLock_);
+	    for (int i = 0; i < numCancels_; ++i)
+	    {
+		uring_.removePoll(cancels_[i], cancelData);
+	    }
+	    numCancels_ = 0;
+	    for (int i = 0; i < maxWatches; ++i)
+	    {
+		Watch& watch = watches_[i];
+		if (watch.fd_ >= 0 && !watch.armed_)
+		{
+		    watch.armed_ = uring_.pollIn(watch.fd_, getUserData(i));
+		}
+	    }
+	}
+	if (!wakeArmed_)
+	{
+	    wakeArmed_ = uring_.read(wakeFd_, &wakeCount_, sizeof(wakeCount_), wakeData);
+	}
+
+	uring_.submitAndWait(timeoutMs);
+	wakeTicks_ = Time::getHighResolutionTicks();
+
+	int tags[maxWatches];
+	int numTags = 0;
+	uring_.forEachCompletion([this, &tags, &numTags] (uint64 userData, int result)
+	{
+	    if (userData == wakeData)
+	    {
+		wakeArmed_ = false;
+		return;
+	    }
+	    if (userData == cancelData)
+	    {
+		return;
+	    }
+
+	    const SpinLock::ScopedLockType lock(watchLock_);
+	    const int index = (int) (uint32) userData;
+	    if (!isPositiveAndBelow(index, maxWatches))
+	    {
+		return;
+	    }
+	    Watch& watch = watches_[index];
+	    if (watch.fd_ < 0 || watch.generation_ != (uint32) (userData >> 32))
+	    {
+		return;
+	    }
+	    watch.armed_ = false;
+	    if (result < 0)
+	    {
+		// closed without being unwatched, dropped as epoll would
+		watch.fd_ = -1;
+		++watch.generation_;
+	    }
+	    else if (numTags < maxWatches)
+	    {
+		tags[numTags++] = watch.tag_;
+	    }
+	});
+	for (int i = 0; i < numTags; ++i)
+	{
+	    handler(tags[i]);
+	}
+    }
+#endif
+
+    int epoll_ = -1;
+    int wakeFd_ = -1;
+    int timerFd_ = -1;
+    int64 wakeTicks_ = 0;       // Time::getHighResolutionTicks(), loop thread only
+    std::atomic<Thread::ThreadID> owner_ { nullptr };
+
+    // io_uring: the ring itself only the loop thread touches; the watches
+    // are also changed from whichever thread watches and unwatches
+    IoUring uring_;
+    SpinLock watchLock_;
+    Watch watches_[maxWatches];
+    uint64 cancels_[maxWatches];
+    int numCancels_ = 0;
+    uint64 wakeCount_ = 0;
+    bool wakeArmed_ = false;
+
+    JUCE_DECLARE_NON_COPYABLE(EventReactor)
+};
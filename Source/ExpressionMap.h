@@ -0,0 +1,307 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include <atomic>
+#include <cmath>
+
+//==============================================================================
+// Turns expression pedal controllers into SooperLooper "set" values. Each
+// mapping ramps towards the pedal over rampMs with a LinearSmoothedValue
+// stepped once a millisecond, and a value only goes out when it has moved by
+// at least minChange and no sooner than minIntervalMs after the last one, so a
+// fast sweep costs a few dozen packets rather than one per controller message.
+// The final resting value is always sent.
+//
+// The pedal's travel goes through a 128 entry table per mapping, compiled
+// when the mapping is added or its pedal's calibration changes: the range the
+// pedal really sweeps (given, or learned from what it sends) stretched to
+// 0-1, bent by the mapping's curve and scaled to min-max. Nothing is worked
+// out per controller message but the table lookup.
+//
+// Mappings are added while parsing the command line, the MIDI input thread
+// asks isMapped(), everything else runs on the control thread.
+class ExpressionMap
+{
+public:
+    static const int maxMappings = 8;
+    static const int rampMs = 30;
+    static const int minIntervalMs = 20;
+    static constexpr float minChange = 0.005f;
+
+    enum Curve
+    {
+	Linear,
+	Log,            // quick off the heel, fine near the toe
+	Exp,            // fine near the heel
+	SCurve          // fine at both ends
+    };
+
+    ExpressionMap()
+    {
+	for (auto&& mapped : mapped_)
+	{
+	    mapped = false;
+	}
+	for (auto&& calibration : calibrations_)
+	{
+	    calibration = Calibration();
+	}
+    }
+
+    // "linear", "log", "exp" or "s", -1 for anything else
+    static int parseCurve(const String& name)
+    {
+	static const char* const names[] = { "linear", "log", "exp", "s" };
+	for (int i = 0; i < 4; ++i)
+	{
+	    if (name.equalsIgnoreCase(names[i]))
+	    {
+		return i;
+	    }
+	}
+	return -1;
+    }
+
+    // loop is SooperLooper's loop number, -1 for all or -3 for the selected one
+    bool add(int controller, int loop, const String& control, float minValue, float maxValue, Curve curve = Linear)
+    {
+	if (numMappings_ == maxMappings || controller < 0 || controller > 127 || control.isEmpty())
+	{
+	    return false;
+	}
+
+	Mapping& mapping = mappings_[numMappings_++];
+	mapping.controller_ = controller;
+	mapping.loop_ = loop;
+	mapping.control_ = control;
+	mapping.address_ = "/sl/" + String(loop) + "/set";
+	mapping.min_ = minValue;
+	mapping.max_ = maxValue;
+	mapping.curve_ = curve;
+	mapping.smoothed_.reset(1000.0, rampMs / 1000.0);
+	compile(mapping);
+	mapped_[controller] = true;
+	return true;
+    }
+
+    // the pedal on controller really sweeps low-high, for pedals that don't
+    // reach 0 or 127; learn instead widens the range to what it sends
+    bool calibrate(int controller, int low, int high)
+    {
+	if (controller < 0 || controller > 127 || low < 0 || high > 127 || low >= high)
+	{
+	    return false;
+	}
+	calibrations_[controller] = { low, high, false };
+	compileController(controller);
+	return true;
+    }
+
+    bool learn(int controller)
+    {
+	if (controller < 0 || controller > 127)
+	{
+	    return false;
+	}
+	// full travel until the pedal has been seen to move
+	calibrations_[controller] = { 127, 0, true };
+	compileController(controller);
+	return true;
+    }
+
+    // calls function(controller, low, high) for every pedal being learned
+    // that has moved, to print what to calibrate it to next time
+    template <typename Function>
+    void forEachLearned(Function&& function) const
+    {
+	for (int controller = 0; controller < 128; ++controller)
+	{
+	    const Calibration& calibration = calibrations_[controller];
+	    if (calibration.learning_ && calibration.low_ < calibration.high_)
+	    {
+		function(controller, calibration.low_, calibration.high_);
+	    }
+	}
+    }
+
+    bool isMapped(int controller) const     { return controller >= 0 && controller < 128 && mapped_[controller].load(); }
+    bool isEmpty() const                    { return numMappings_ == 0; }
+
+    void setController(int controller, int value, uint32 now)
+    {
+	value = jlimit(0, 127, value);
+	Calibration& calibration = calibrations_[controller & 127];
+	if (calibration.learning_ && (value < calibration.low_ || value > calibration.high_))
+	{
+	    calibration.low_ = jmin(calibration.low_, value);
+	    calibration.high_ = jmax(calibration.high_, value);
+	    compileController(controller);
+	}
+
+	for (int i = 0; i < numMappings_; ++i)
+	{
+	    Mapping& mapping = mappings_[i];
+	    if (mapping.controller_ == controller)
+	    {
+		if (!mapping.started_)
+		{
+		    // nothing to ramp from yet, jump straight there
+		    mapping.smoothed_.setValue(mapping.table_[value]);
+		    mapping.smoothed_.reset(1000.0, rampMs / 1000.0);
+		    mapping.started_ = true;
+		}
+		if (!mapping.pending_)
+		{
+		    // idle time doesn't count towards the ramp
+		    mapping.lastStepMs_ = now;
+		}
+		mapping.smoothed_.setValue(mapping.table_[value]);
+		mapping.pending_ = true;
+	    }
+	}
+    }
+
+    // true while something still has to be sent, the caller should come back within a few ms
+    bool isBusy() const
+    {
+	for (int i = 0; i < numMappings_; ++i)
+	{
+	    if (mappings_[i].pending_)
+	    {
+		return true;
+	    }
+	}
+	return false;
+    }
+
+    // advances the ramps to now and calls send(address, control, value) for what should go out
+    template <typename SendFunction>
+    void process(uint32 now, SendFunction&& send)
+    {
+	for (int i = 0; i < numMappings_; ++i)
+	{
+	    Mapping& mapping = mappings_[i];
+	    if (!mapping.pending_)
+	    {
+		continue;
+	    }
+
+	    const int steps = jlimit(0, (int) rampMs, (int) (now - mapping.lastStepMs_));
+	    mapping.lastStepMs_ = now;
+	    for (int step = 0; step < steps; ++step)
+	    {
+		mapping.value_ = mapping.smoothed_.getNextValue();
+	    }
+	    if (!mapping.smoothed_.isSmoothing())
+	    {
+		mapping.value_ = mapping.smoothed_.getTargetValue();
+	    }
+
+	    const bool settled = !mapping.smoothed_.isSmoothing();
+	    const bool moved = std::abs(mapping.value_ - mapping.sent_) >= minChange || (settled && mapping.value_ != mapping.sent_);
+	    if (moved && (int) (now - mapping.lastSentMs_) >= minIntervalMs)
+	    {
+		send(mapping.address_, mapping.control_, mapping.value_);
+		mapping.sent_ = mapping.value_;
+		mapping.lastSentMs_ = now;
+		++numSent_;
+	    }
+	    mapping.pending_ = !settled || mapping.value_ != mapping.sent_;
+	}
+    }
+
+    int64 getNumSent() const                { return numSent_; }
+
+private:
+    struct Mapping
+    {
+	int controller_ = -1;
+	int loop_ = -1;
+	String control_;
+	String address_;
+	float min_ = 0;
+	float max_ = 1;
+	Curve curve_ = Linear;
+	float table_[128];
+	LinearSmoothedValue<float> smoothed_;
+	bool started_ = false;
+	bool pending_ = false;
+	float value_ = 0;
+	float sent_ = -1;
+	uint32 lastStepMs_ = 0;
+	uint32 lastSentMs_ = 0;
+    };
+
+    struct Calibration
+    {
+	int low_ = 0;
+	int high_ = 127;
+	bool learning_ = false;
+    };
+
+    static float bend(Curve curve, float x)
+    {
+	switch (curve)
+	{
+	case Log:
+	    return std::log1p(9.0f * x) / std::log1p(9.0f);
+	case Exp:
+	    return std::expm1(4.6f * x) / std::expm1(4.6f);
+	case SCurve:
+	    return x * x * (3.0f - 2.0f * x);
+	default:
+	    return x;
+	}
+    }
+
+    void compile(Mapping& mapping) const
+    {
+	const Calibration& calibration = calibrations_[mapping.controller_];
+	// a range still being learned is no range yet
+	const bool calibrated = calibration.low_ < calibration.high_;
+	const float low = calibrated ? (float) calibration.low_ : 0.0f;
+	const float span = calibrated ? (float) (calibration.high_ - calibration.low_) : 127.0f;
+	for (int value = 0; value < 128; ++value)
+	{
+	    const float x = jlimit(0.0f, 1.0f, ((float) value - low) / span);
+	    mapping.table_[value] = mapping.min_ + (mapping.max_ - mapping.min_) * bend(mapping.curve_, x);
+	}
+    }
+
+    void compileController(int controller)
+    {
+	for (int i = 0; i < numMappings_; ++i)
+	{
+	    if (mappings_[i].controller_ == controller)
+	    {
+		compile(mappings_[i]);
+	    }
+	}
+    }
+
+    Mapping mappings_[maxMappings];
+    int numMappings_ = 0;
+    std::atomic<bool> mapped_[128];
+    Calibration calibrations_[128];
+    int64 numSent_ = 0;
+
+    JUCE_DECLARE_NON_COPYABLE(ExpressionMap)
+};
@@ -0,0 +1,176 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+#if JUCE_LINUX
+ #include <cerrno>
+ #include <cstring>
+ #include <fcntl.h>
+ #include <unistd.h>
+#endif
+
+//==============================================================================
+// The parts of "gig" that are the machine's rather than ours. While
+// /dev/cpu_dma_latency is held open with 0 written to it the kernel keeps
+// every core out of the C-states it takes longer than that to wake from,
+// and closing it (or our exiting, however that happens) lets them back in.
+// The cpufreq governors are files like any other, so each one switched is
+// remembered and put back by restore(), which the destructor calls if
+// nobody did; a crash leaves them at performance, which is only a waste.
+class GigMode
+{
+public:
+    GigMode() {}
+
+    ~GigMode()
+    {
+	restore();
+    }
+
+#if JUCE_LINUX
+    // error is what went wrong, when it didn't work
+    bool holdDmaLatency(String& error)
+    {
+	if (dmaLatencyFd_ >= 0)
+	{
+	    return true;
+	}
+	const int fd = ::open("/dev/cpu_dma_latency", O_WRONLY | O_CLOEXEC);
+	const int32 latencyUs = 0;
+	if (fd < 0 || ::write(fd, &latencyUs, sizeof(latencyUs)) != (ssize_t) sizeof(latencyUs))
+	{
+	    error = std::strerror(errno);
+	    if (fd >= 0)
+	    {
+		::close(fd);
+	    }
+	    return false;
+	}
+	dmaLatencyFd_ = fd;
+	return true;
+    }
+
+    // the performance governor on each of cpus that has cpufreq, returning
+    // how many are on it now; the ones that couldn't be switched are in failed
+    int setPerformanceGovernor(const BigInteger& cpus, String& failed)
+    {
+	int numSet = 0;
+	for (int cpu = cpus.findNextSetBit(0); cpu >= 0; cpu = cpus.findNextSetBit(cpu + 1))
+	{
+	    const File file(getGovernorFile(cpu));
+	    const String was = file.loadFileAsString().trim();
+	    if (was.isEmpty())
+	    {
+		continue;
+	    }
+	    if (was == "performance")
+	    {
+		++numSet;
+	    }
+	    else if (writeGovernor(file, "performance"))
+	    {
+		governors_.add({cpu, was});
+		++numSet;
+	    }
+	    else
+	    {
+		failed << (failed.isEmpty() ? "" : ",") << cpu;
+	    }
+	}
+	return numSet;
+    }
+
+    // the online CPUs, for a governor change with no CPUs of its own
+    static BigInteger getOnlineCpus()
+    {
+	BigInteger cpus;
+	cpus.setRange(0, jmax(1, (int) ::sysconf(_SC_NPROCESSORS_ONLN)), true);
+	return cpus;
+    }
+
+    void restore()
+    {
+	for (auto&& governor : governors_)
+	{
+	    if (!writeGovernor(getGovernorFile(governor.cpu_), governor.was_))
+	    {
+		std::cerr << "Couldn't put CPU " << governor.cpu_ << " back on the " << governor.was_ << " governor" << std::endl;
+	    }
+	}
+	governors_.clear();
+	if (dmaLatencyFd_ >= 0)
+	{
+	    ::close(dmaLatencyFd_);
+	    dmaLatencyFd_ = -1;
+	}
+    }
+#else
+    bool holdDmaLatency(String& error)
+    {
+	error = "only on Linux";
+	return false;
+    }
+
+    int setPerformanceGovernor(const BigInteger&, String& failed)
+    {
+	failed = "all";
+	return 0;
+    }
+
+    static BigInteger getOnlineCpus()           { return BigInteger(); }
+    void restore()                              {}
+#endif
+
+    bool isHoldingDmaLatency() const            { return dmaLatencyFd_ >= 0; }
+    int getNumGovernorsSwitched() const         { return governors_.size(); }
+
+private:
+    struct Governor
+    {
+	int cpu_;
+	String was_;
+    };
+
+    static File getGovernorFile(int cpu)
+    {
+	return File("/sys/devices/system/cpu/cpu" + String(cpu) + "/cpufreq/scaling_governor");
+    }
+
+#if JUCE_LINUX
+    // sysfs takes it in one write or not at all
+    static bool writeGovernor(const File& file, const String& governor)
+    {
+	const int fd = ::open(file.getFullPathName().toRawUTF8(), O_WRONLY | O_CLOEXEC);
+	if (fd < 0)
+	{
+	    return false;
+	}
+	const bool written = ::write(fd, governor.toRawUTF8(), governor.getNumBytesAsUTF8()) == (ssize_t) governor.getNumBytesAsUTF8();
+	::close(fd);
+	return written;
+    }
+#endif
+
+    int dmaLatencyFd_ = -1;
+    Array<Governor> governors_;
+
+    JUCE_DECLARE_NON_COPYABLE(GigMode)
+};
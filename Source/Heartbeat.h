@@ -0,0 +1,181 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include <cmath>
+
+//==============================================================================
+// Decides when to ping a SooperLooper engine, when to give up on it and when
+// to try reconnecting. The ping round trip is smoothed the way TCP does it
+// (srtt/rttvar, RFC 6298) and the retransmit and liveness timeouts follow from
+// that, so a slow but alive engine isn't declared dead. Reconnects back off
+// exponentially until the engine is heard from again. Times are
+// Time::getMillisecondCounter() values; only the control thread uses this.
+class HeartbeatMonitor
+{
+public:
+    static const int defaultPingIntervalMs = 1000;      // quiet time before we ping
+    static const int minTimeoutMs = 200;
+    static const int maxTimeoutMs = 5000;
+    static const int initialBackoffMs = 200;
+    static const int maxBackoffMs = 10000;
+
+    HeartbeatMonitor() {}
+
+    // "idle" pings less often, giving up takes as much longer
+    void setPingInterval(int ms)        { pingIntervalMs_ = jmax(100, ms); }
+    int getPingInterval() const         { return pingIntervalMs_; }
+
+    // the engine has been (re)connected and pinged
+    void connected(uint32 now)
+    {
+	lastHeard_ = now;
+	pingSent(now);
+    }
+
+    // any message from the engine
+    void heard(uint32 now)
+    {
+	lastHeard_ = now;
+	backoffMs_ = initialBackoffMs;
+    }
+
+    // the engine answered a ping
+    void replied(uint32 now)
+    {
+	if (pingSentAt_ != 0)
+	{
+	    addRttSample((int) (now - pingSentAt_));
+	    pingSentAt_ = 0;
+	}
+	++numReplies_;
+	heard(now);
+    }
+
+    // nothing heard for a while, or the last ping is overdue
+    bool shouldPing(uint32 now) const
+    {
+	if (pingSentAt_ != 0)
+	{
+	    return (int) (now - pingSentAt_) >= getTimeoutMs();
+	}
+	return (int) (now - lastHeard_) >= pingIntervalMs_;
+    }
+
+    void pingSent(uint32 now)
+    {
+	pingSentAt_ = now;
+	++numPings_;
+    }
+
+    // a few timeouts without hearing anything
+    bool isLost(uint32 now) const
+    {
+	return (int) (now - lastHeard_) >= pingIntervalMs_ + 3 * getTimeoutMs();
+    }
+
+    // gives up on the engine, returns how long to wait before reconnecting
+    int lost(uint32 now)
+    {
+	++numReconnects_;
+	pingSentAt_ = 0;
+	return scheduleReconnect(now);
+    }
+
+    bool mayReconnect(uint32 now) const
+    {
+	return (int) (now - nextReconnectAt_) >= 0;
+    }
+
+    // a connect attempt failed or went unanswered
+    int scheduleReconnect(uint32 now)
+    {
+	const int wait = backoffMs_;
+	nextReconnectAt_ = now + (uint32) wait;
+	backoffMs_ = jmin(backoffMs_ * 2, (int) maxBackoffMs);
+	return wait;
+    }
+
+    // the earliest time one of the checks above can change its answer: the
+    // reconnect while not connected, the next ping or giving up otherwise
+    uint32 getNextCheckAt(bool connected) const
+    {
+	if (!connected)
+	{
+	    return nextReconnectAt_;
+	}
+	const uint32 ping = pingSentAt_ != 0 ? pingSentAt_ + (uint32) getTimeoutMs() : lastHeard_ + (uint32) pingIntervalMs_;
+	const uint32 lost = lastHeard_ + (uint32) (pingIntervalMs_ + 3 * getTimeoutMs());
+	return (int) (ping - lost) < 0 ? ping : lost;
+    }
+
+    // retransmit timeout, one second until we have a sample
+    int getTimeoutMs() const
+    {
+	if (!hasRtt_)
+	{
+	    return 1000;
+	}
+	return jlimit((int) minTimeoutMs, (int) maxTimeoutMs, roundToInt(srttMs_ + 4.0 * rttVarMs_));
+    }
+
+    // a ping sent and not answered yet, another one now means it was missed
+    bool isPingOutstanding() const      { return pingSentAt_ != 0; }
+
+    bool hasRtt() const                 { return hasRtt_; }
+    double getSmoothedRttMs() const     { return srttMs_; }
+    double getRttVarianceMs() const     { return rttVarMs_; }
+    int getLastRttMs() const            { return lastRttMs_; }
+    int64 getNumPings() const           { return numPings_; }
+    int64 getNumReplies() const         { return numReplies_; }
+    int64 getNumReconnects() const      { return numReconnects_; }
+
+private:
+    void addRttSample(int rttMs)
+    {
+	lastRttMs_ = rttMs;
+	if (!hasRtt_)
+	{
+	    srttMs_ = rttMs;
+	    rttVarMs_ = rttMs / 2.0;
+	    hasRtt_ = true;
+	}
+	else
+	{
+	    rttVarMs_ = 0.75 * rttVarMs_ + 0.25 * std::abs(srttMs_ - rttMs);
+	    srttMs_ = 0.875 * srttMs_ + 0.125 * rttMs;
+	}
+    }
+
+    int pingIntervalMs_ = defaultPingIntervalMs;
+    uint32 lastHeard_ = 0;
+    uint32 pingSentAt_ = 0;
+    uint32 nextReconnectAt_ = 0;
+    int backoffMs_ = initialBackoffMs;
+
+    bool hasRtt_ = false;
+    double srttMs_ = 0;
+    double rttVarMs_ = 0;
+    int lastRttMs_ = 0;
+
+    int64 numPings_ = 0;
+    int64 numReplies_ = 0;
+    int64 numReconnects_ = 0;
+};
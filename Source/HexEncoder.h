@@ -0,0 +1,83 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include <cstring>
+
+//==============================================================================
+// Upper case hex for whole buffers, sysex dumps mostly, out of one 256 entry
+// table: a byte is one four byte copy, never a String. Each entry is the byte
+// as " XX" and a spare byte, so spaced output copies all four and moves on
+// three, leaving the loop free of branches for the compiler to unroll.
+class HexEncoder
+{
+public:
+    // the two digits of v
+    static const char* digits(uint8 v)
+    {
+	return getTable().entries_[v] + 1;
+    }
+
+    // " XX" for every byte; out needs room for 3 * size + 1
+    static char* appendSpaced(char* out, const uint8* data, size_t size)
+    {
+	const Table& table = getTable();
+	for (size_t i = 0; i < size; ++i)
+	{
+	    std::memcpy(out + 3 * i, table.entries_[data[i]], 4);
+	}
+	return out + 3 * size;
+    }
+
+    // "XX" for every byte; out needs room for 2 * size
+    static char* append(char* out, const uint8* data, size_t size)
+    {
+	const Table& table = getTable();
+	for (size_t i = 0; i < size; ++i)
+	{
+	    std::memcpy(out + 2 * i, table.entries_[data[i]] + 1, 2);
+	}
+	return out + 2 * size;
+    }
+
+private:
+    struct Table
+    {
+	Table()
+	{
+	    static const char hexDigits[] = "0123456789ABCDEF";
+	    for (int i = 0; i < 256; ++i)
+	    {
+		entries_[i][0] = ' ';
+		entries_[i][1] = hexDigits[i >> 4];
+		entries_[i][2] = hexDigits[i & 0x0f];
+		entries_[i][3] = 0;
+	    }
+	}
+
+	char entries_[256][4];
+    };
+
+    static const Table& getTable()
+    {
+	static const Table table;
+	return table;
+    }
+};
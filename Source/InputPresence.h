@@ -0,0 +1,93 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include <atomic>
+
+//==============================================================================
+// Whether the controller behind an input is still there ("presence"). A USB
+// interface's port stays when the DIN cable behind it is pulled, so it's told
+// from the traffic: an input that has sent active sensing, which the MIDI spec
+// has at least every 300ms, is gone after sensingTimeoutMs without a message,
+// any other after the silence timeout given (never with 0). heard() is called
+// on the input's thread for every message, check() on the control thread.
+class InputPresence
+{
+public:
+    static const int sensingTimeoutMs = 330;
+
+    enum Change
+    {
+	NoChange,
+	Lost,
+	Returned
+    };
+
+    InputPresence() {}
+
+    void heard(const uint8* data, int size, uint32 now)
+    {
+	lastHeardAt_.store(now, std::memory_order_relaxed);
+	if (size == 1 && data[0] == 0xfe)
+	{
+	    sensing_.store(true, std::memory_order_relaxed);
+	}
+    }
+
+    // starts the silence from now, e.g. when the input is opened
+    void restart(uint32 now)
+    {
+	lastHeardAt_.store(now, std::memory_order_relaxed);
+    }
+
+    Change check(uint32 now, int silenceMs)
+    {
+	const bool sensing = sensing_.load(std::memory_order_relaxed);
+	const int timeoutMs = sensing ? sensingTimeoutMs : silenceMs;
+	const bool quiet = timeoutMs > 0 && (int) (now - lastHeardAt_.load(std::memory_order_relaxed)) > timeoutMs;
+	if (present_ && quiet)
+	{
+	    present_ = false;
+	    ++numLost_;
+	    return Lost;
+	}
+	if (!present_ && !quiet)
+	{
+	    // what comes back may not be sending active sensing any more
+	    present_ = true;
+	    sensing_.store(false, std::memory_order_relaxed);
+	    return Returned;
+	}
+	return NoChange;
+    }
+
+    bool isPresent() const              { return present_; }
+    bool isSensing() const              { return sensing_.load(std::memory_order_relaxed); }
+    int64 getNumLost() const            { return numLost_; }
+
+private:
+    std::atomic<uint32> lastHeardAt_ { 0 };
+    std::atomic<bool> sensing_ { false };
+    bool present_ = true;
+    int64 numLost_ = 0;
+
+    JUCE_DECLARE_NON_COPYABLE(InputPresence)
+};
@@ -0,0 +1,257 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include <atomic>
+
+#if JUCE_LINUX
+ #include <cerrno>
+ #include <csignal>
+ #include <ctime>
+ #include <cstring>
+ #include <linux/io_uring.h>
+ #include <poll.h>
+ #include <sys/mman.h>
+ #include <sys/syscall.h>
+ #include <unistd.h>
+#endif
+
+//==============================================================================
+// The least of io_uring that EventReactor needs, on the raw system calls so
+// there's no liburing to build against: a submission queue to fill, one
+// io_uring_enter() that submits what's queued and waits (with a timeout) for
+// the first completion, and the completions to walk. Needs Linux 5.11 for
+// the timeout to go in with the wait; open() fails on anything older, or
+// where io_uring is turned off, and the caller stays on epoll.
+//
+// One thread uses it.
+class IoUring
+{
+public:
+    IoUring() {}
+
+    ~IoUring()
+    {
+	close();
+    }
+
+#if JUCE_LINUX
+    bool open(unsigned int entries)
+    {
+	close();
+	io_uring_params params = {};
+	ring_ = (int) ::syscall(__NR_io_uring_setup, entries, &params);
+	if (ring_ < 0)
+	{
+	    return false;
+	}
+	if ((params.features & IORING_FEAT_EXT_ARG) == 0 || (params.features & IORING_FEAT_SINGLE_MMAP) == 0)
+	{
+	    close();
+	    return false;
+	}
+
+	// one mapping for both rings, as SINGLE_MMAP allows
+	ringSize_ = jmax((size_t) params.sq_off.array + params.sq_entries * sizeof(uint32),
+			 (size_t) params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe));
+	sqesSize_ = params.sq_entries * sizeof(io_uring_sqe);
+	rings_ = ::mmap(nullptr, ringSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_, IORING_OFF_SQ_RING);
+	sqes_ = ::mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_, IORING_OFF_SQES);
+	if (rings_ == MAP_FAILED || sqes_ == MAP_FAILED)
+	{
+	    close();
+	    return false;
+	}
+
+	char* rings = static_cast<char*>(rings_);
+	sqHead_ = reinterpret_cast<std::atomic<uint32>*>(rings + params.sq_off.head);
+	sqTail_ = reinterpret_cast<std::atomic<uint32>*>(rings + params.sq_off.tail);
+	sqMask_ = *reinterpret_cast<uint32*>(rings + params.sq_off.ring_mask);
+	sqEntries_ = params.sq_entries;
+	sqArray_ = reinterpret_cast<uint32*>(rings + params.sq_off.array);
+	cqHead_ = reinterpret_cast<std::atomic<uint32>*>(rings + params.cq_off.head);
+	cqTail_ = reinterpret_cast<std::atomic<uint32>*>(rings + params.cq_off.tail);
+	cqMask_ = *reinterpret_cast<uint32*>(rings + params.cq_off.ring_mask);
+	cqes_ = reinterpret_cast<io_uring_cqe*>(rings + params.cq_off.cqes);
+	queued_ = 0;
+	return true;
+    }
+
+    void close()
+    {
+	if (sqes_ != nullptr && sqes_ != MAP_FAILED)
+	{
+	    ::munmap(sqes_, sqesSize_);
+	}
+	if (rings_ != nullptr && rings_ != MAP_FAILED)
+	{
+	    ::munmap(rings_, ringSize_);
+	}
+	sqes_ = rings_ = nullptr;
+	if (ring_ >= 0)
+	{
+	    ::close(ring_);
+	    ring_ = -1;
+	}
+    }
+
+    // a zeroed entry to fill in, submitted by the next enter(); when the
+    // queue is full what's in it is submitted first
+    io_uring_sqe* getSqe()
+    {
+	const uint32 tail = sqTail_->load(std::memory_order_relaxed);
+	if (tail - sqHead_->load(std::memory_order_acquire) >= sqEntries_ && enter(0, 0) < 0)
+	{
+	    return nullptr;
+	}
+	const uint32 index = tail & sqMask_;
+	io_uring_sqe* sqe = static_cast<io_uring_sqe*>(sqes_) + index;
+	std::memset(sqe, 0, sizeof(*sqe));
+	sqArray_[index] = index;
+	sqTail_->store(tail + 1, std::memory_order_release);
+	++queued_;
+	return sqe;
+    }
+
+    // a one shot poll for POLLIN on fd
+    bool pollIn(int fd, uint64 userData)
+    {
+	io_uring_sqe* sqe = getSqe();
+	if (sqe == nullptr)
+	{
+	    return false;
+	}
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = fd;
+#if JUCE_BIG_ENDIAN
+	sqe->poll32_events = ((uint32) POLLIN << 16) | ((uint32) POLLIN >> 16);
+#else
+	sqe->poll32_events = POLLIN;
+#endif
+	sqe->user_data = userData;
+	return true;
+    }
+
+    // cancels the poll submitted with userData; the cancel itself completes
+    // with cancelData
+    bool removePoll(uint64 userData, uint64 cancelData)
+    {
+	io_uring_sqe* sqe = getSqe();
+	if (sqe == nullptr)
+	{
+	    return false;
+	}
+	sqe->opcode = IORING_OP_POLL_REMOVE;
+	sqe->fd = -1;
+	sqe->addr = userData;
+	sqe->user_data = cancelData;
+	return true;
+    }
+
+    bool read(int fd, void* buffer, int size, uint64 userData)
+    {
+	io_uring_sqe* sqe = getSqe();
+	if (sqe == nullptr)
+	{
+	    return false;
+	}
+	sqe->opcode = IORING_OP_READ;
+	sqe->fd = fd;
+	sqe->addr = (uint64) (pointer_sized_uint) buffer;
+	sqe->len = (uint32) size;
+	sqe->off = (uint64) -1;         // the file position, which an eventfd doesn't have
+	sqe->user_data = userData;
+	return true;
+    }
+
+    // Submits what's queued and waits up to timeoutMs (-1 for ever, 0 not at
+    // all) for a completion, in the one system call. Returns what the kernel
+    // did: the number submitted, or -errno (-ETIME when the time ran out).
+    int submitAndWait(int timeoutMs)
+    {
+	if (timeoutMs < 0)
+	{
+	    return enter(1, IORING_ENTER_GETEVENTS);
+	}
+	timespec timeout = { timeoutMs / 1000, (timeoutMs % 1000) * 1000000L };
+	io_uring_getevents_arg arg = {};
+	arg.sigmask_sz = _NSIG / 8;
+	arg.ts = (uint64) (pointer_sized_uint) &timeout;
+	return enter(1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+    }
+
+    // calls function(userData, result) for every completion waiting
+    template <typename Function>
+    int forEachCompletion(Function&& function)
+    {
+	uint32 head = cqHead_->load(std::memory_order_relaxed);
+	const uint32 tail = cqTail_->load(std::memory_order_acquire);
+	int numCompleted = 0;
+	for (; head != tail; ++head, ++numCompleted)
+	{
+	    const io_uring_cqe& cqe = cqes_[head & cqMask_];
+	    function((uint64) cqe.user_data, (int) cqe.res);
+	}
+	cqHead_->store(head, std::memory_order_release);
+	return numCompleted;
+    }
+
+    int64 getNumEnters() const      { return numEnters_; }
+#else
+    bool open(unsigned int)         { return false; }
+    void close()                    {}
+#endif
+
+    bool isOpen() const             { return ring_ >= 0; }
+
+private:
+#if JUCE_LINUX
+    int enter(unsigned int minComplete, unsigned int flags, const void* arg = nullptr, size_t argSize = 0)
+    {
+	const unsigned int toSubmit = queued_;
+	++numEnters_;
+	const int result = (int) ::syscall(__NR_io_uring_enter, ring_, toSubmit, minComplete, flags, arg, argSize);
+	if (result < 0)
+	{
+	    return -errno;
+	}
+	queued_ -= jmin(queued_, (unsigned int) result);
+	return result;
+    }
+
+    void* rings_ = nullptr;
+    void* sqes_ = nullptr;
+    size_t ringSize_ = 0, sqesSize_ = 0;
+    std::atomic<uint32>* sqHead_ = nullptr;
+    std::atomic<uint32>* sqTail_ = nullptr;
+    uint32 sqMask_ = 0, sqEntries_ = 0;
+    uint32* sqArray_ = nullptr;
+    std::atomic<uint32>* cqHead_ = nullptr;
+    std::atomic<uint32>* cqTail_ = nullptr;
+    uint32 cqMask_ = 0;
+    io_uring_cqe* cqes_ = nullptr;
+    unsigned int queued_ = 0;
+    int64 numEnters_ = 0;
+#endif
+    int ring_ = -1;
+
+    JUCE_DECLARE_NON_COPYABLE(IoUring)
+};
@@ -0,0 +1,289 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include <atomic>
+#include <cmath>
+#include <cstring>
+
+//==============================================================================
+// A JACK client with one audio input port whose process callback measures
+// the period's peak and RMS and leaves them for the control thread, so the
+// LEDs can show the level going into SooperLooper while recording. libjack is
+// loaded when the client is opened, the way JackMidi does it.
+//
+// The callback does the reductions with JUCE's vectorised kernels, findMinAndMax
+// for the peak and a multiply followed by halving adds for the sum of squares,
+// and then one atomic store. The peak is held until the control thread takes
+// it, so a clip in a period between two looks isn't missed; the RMS is the
+// latest period's.
+//
+// With setFeeding(true) the callback also copies the period's samples into
+// a lock-free ring for one reader thread (the onset detector), dropping what
+// doesn't fit rather than waiting for it.
+class JackMeter
+{
+public:
+    static const int scratchFrames = 1024;     // longer periods are reduced in chunks
+    static const int ringFrames = 16384;
+
+    struct Levels
+    {
+	float peak_;        // largest absolute sample since the last take, 1 is full scale
+	float rms_;         // of the latest period
+    };
+
+    JackMeter()
+	: scratch_(scratchFrames), ringFifo_(ringFrames), ring_(ringFrames)
+    {
+    }
+
+    ~JackMeter()
+    {
+	close();
+    }
+
+#if JUCE_LINUX
+    // connectFrom is a full JACK port name ("system:capture_1"), empty to leave it for later
+    bool open(const String& clientName, const String& connectFrom)
+    {
+	close();
+	if (!library_.open("libjack.so.0") || !loadFunctions())
+	{
+	    library_.close();
+	    return false;
+	}
+
+	int status = 0;
+	client_ = clientOpen_(clientName.toRawUTF8(), jackNoStartServer, &status);
+	if (client_ == nullptr)
+	{
+	    library_.close();
+	    return false;
+	}
+
+	levels_.store(0);
+	inPort_ = portRegister_(client_, "audio_in", jackAudioType, jackPortIsInput, 0);
+	if (inPort_ == nullptr
+	    || setProcessCallback_(client_, processCallback, this) != 0
+	    || activate_(client_) != 0)
+	{
+	    close();
+	    return false;
+	}
+
+	if (connectFrom.isNotEmpty())
+	{
+	    connect_(client_, connectFrom.toRawUTF8(), portName_(inPort_));
+	}
+	return true;
+    }
+
+    void close()
+    {
+	if (client_ != nullptr)
+	{
+	    deactivate_(client_);
+	    clientClose_(client_);
+	    client_ = nullptr;
+	}
+	inPort_ = nullptr;
+	library_.close();
+    }
+
+    int getSampleRate() const       { return client_ != nullptr ? (int) getSampleRate_(client_) : 0; }
+    int getBufferSize() const       { return client_ != nullptr ? (int) getBufferSize_(client_) : 0; }
+#else
+    bool open(const String&, const String&)     { return false; }
+    void close()                    {}
+    int getSampleRate() const       { return 0; }
+    int getBufferSize() const       { return 0; }
+#endif
+
+    bool isOpen() const             { return client_ != nullptr; }
+
+    // control thread: the levels since the last take, zero if no period came in
+    Levels take()
+    {
+	return unpack(levels_.exchange(0, std::memory_order_acquire));
+    }
+
+    void setFeeding(bool feeding)   { feeding_.store(feeding); }
+
+    // the reader thread: up to num samples off the ring, returns how many
+    int readSamples(float* dest, int num)
+    {
+	int start1, size1, start2, size2;
+	ringFifo_.prepareToRead(num, start1, size1, start2, size2);
+	FloatVectorOperations::copy(dest, ring_ + start1, size1);
+	FloatVectorOperations::copy(dest + size1, ring_ + start2, size2);
+	ringFifo_.finishedRead(size1 + size2);
+	return size1 + size2;
+    }
+
+    // the reader thread, so it starts from now rather than what was left from before
+    void skipReady()
+    {
+	ringFifo_.finishedRead(ringFifo_.getNumReady());
+    }
+
+    // frames the callback has put on the ring, dropped ones included
+    int64 getFramesFed() const      { return framesFed_.load(std::memory_order_acquire); }
+
+    // the sum of values, by folding their top half onto their bottom half
+    // with vectorised adds until one is left; values is overwritten
+    static float foldSum(float* values, int num)
+    {
+	while (num > 1)
+	{
+	    const int half = num / 2;
+	    FloatVectorOperations::add(values, values + num - half, half);
+	    num -= half;
+	}
+	return num > 0 ? values[0] : 0.0f;
+    }
+
+    // e.g. -48 for a level of 1/256, with silence at floorDb
+    static float toDecibels(float level, float floorDb)
+    {
+	return level > 0 ? jmax(floorDb, 20.0f * std::log10(level)) : floorDb;
+    }
+
+private:
+    static uint64 pack(Levels levels)
+    {
+	uint32 peak, rms;
+	std::memcpy(&peak, &levels.peak_, sizeof(peak));
+	std::memcpy(&rms, &levels.rms_, sizeof(rms));
+	return ((uint64) peak << 32) | rms;
+    }
+
+    static Levels unpack(uint64 bits)
+    {
+	const uint32 peak = (uint32) (bits >> 32);
+	const uint32 rms = (uint32) bits;
+	Levels levels;
+	std::memcpy(&levels.peak_, &peak, sizeof(peak));
+	std::memcpy(&levels.rms_, &rms, sizeof(rms));
+	return levels;
+    }
+
+    // the bits of jack/jack.h we use
+    typedef uint32 jack_nframes_t;
+    struct jack_client_t;
+    struct jack_port_t;
+
+#if JUCE_LINUX
+    typedef int (*ProcessCallback) (jack_nframes_t, void*);
+
+    static const int jackNoStartServer = 0x01;
+    static const unsigned long jackPortIsInput = 0x1;
+    static constexpr const char* jackAudioType = "32 bit float mono audio";
+
+    bool loadFunctions()
+    {
+	return load(clientOpen_, "jack_client_open") && load(clientClose_, "jack_client_close")
+	    && load(portRegister_, "jack_port_register") && load(portName_, "jack_port_name")
+	    && load(setProcessCallback_, "jack_set_process_callback")
+	    && load(activate_, "jack_activate") && load(deactivate_, "jack_deactivate")
+	    && load(connect_, "jack_connect") && load(portGetBuffer_, "jack_port_get_buffer")
+	    && load(getSampleRate_, "jack_get_sample_rate") && load(getBufferSize_, "jack_get_buffer_size");
+    }
+
+    template <typename Function>
+    bool load(Function& function, const char* name)
+    {
+	function = (Function) library_.getFunction(name);
+	return function != nullptr;
+    }
+
+    static int processCallback(jack_nframes_t numFrames, void* arg)
+    {
+	static_cast<JackMeter*>(arg)->process(numFrames);
+	return 0;
+    }
+
+    // JACK's realtime thread: the reductions and a store, nothing else
+    void process(jack_nframes_t numFrames)
+    {
+	const float* in = static_cast<const float*>(portGetBuffer_(inPort_, numFrames));
+	float peak = 0;
+	double sumOfSquares = 0;
+	for (int done = 0; done < (int) numFrames; done += scratchFrames)
+	{
+	    const int num = jmin(scratchFrames, (int) numFrames - done);
+	    const Range<float> range = FloatVectorOperations::findMinAndMax(in + done, num);
+	    peak = jmax(peak, -range.getStart(), range.getEnd());
+	    sumOfSquares += sumSquares(in + done, num);
+	}
+
+	// the control thread's exchange between the load and store costs no more
+	// than that period's peak
+	Levels levels = unpack(levels_.load(std::memory_order_relaxed));
+	levels.peak_ = jmax(levels.peak_, peak);
+	levels.rms_ = numFrames > 0 ? (float) std::sqrt(sumOfSquares / numFrames) : 0.0f;
+	levels_.store(pack(levels), std::memory_order_release);
+
+	if (feeding_.load(std::memory_order_relaxed))
+	{
+	    int start1, size1, start2, size2;
+	    ringFifo_.prepareToWrite((int) numFrames, start1, size1, start2, size2);
+	    FloatVectorOperations::copy(ring_ + start1, in, size1);
+	    FloatVectorOperations::copy(ring_ + start2, in + size1, size2);
+	    ringFifo_.finishedWrite(size1 + size2);
+	    framesFed_.store(framesFed_.load(std::memory_order_relaxed) + numFrames, std::memory_order_release);
+	}
+    }
+
+    // squares into the scratch buffer and adds them up
+    float sumSquares(const float* samples, int num)
+    {
+	float* scratch = scratch_.getData();
+	FloatVectorOperations::multiply(scratch, samples, samples, num);
+	return foldSum(scratch, num);
+    }
+
+    DynamicLibrary library_;
+    jack_client_t* (*clientOpen_) (const char*, int, int*, ...) = nullptr;
+    int (*clientClose_) (jack_client_t*) = nullptr;
+    jack_port_t* (*portRegister_) (jack_client_t*, const char*, const char*, unsigned long, unsigned long) = nullptr;
+    const char* (*portName_) (const jack_port_t*) = nullptr;
+    int (*setProcessCallback_) (jack_client_t*, ProcessCallback, void*) = nullptr;
+    int (*activate_) (jack_client_t*) = nullptr;
+    int (*deactivate_) (jack_client_t*) = nullptr;
+    int (*connect_) (jack_client_t*, const char*, const char*) = nullptr;
+    void* (*portGetBuffer_) (jack_port_t*, jack_nframes_t) = nullptr;
+    jack_nframes_t (*getSampleRate_) (jack_client_t*) = nullptr;
+    jack_nframes_t (*getBufferSize_) (jack_client_t*) = nullptr;
+
+    jack_port_t* inPort_ = nullptr;
+#endif
+
+    jack_client_t* client_ = nullptr;
+    HeapBlock<float> scratch_;
+    std::atomic<uint64> levels_ { 0 };
+    std::atomic<bool> feeding_ { false };
+    AbstractFifo ringFifo_;
+    HeapBlock<float> ring_;
+    std::atomic<int64> framesFed_ { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE(JackMeter)
+};
@@ -0,0 +1,284 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "LockFreeQueue.h"
+#include "MidiOutputStage.h"
+#include <atomic>
+#include <functional>
+
+//==============================================================================
+// A JACK client with one MIDI input and one MIDI output port, so pedals and
+// notes go the way SooperLooper's audio does instead of through the ALSA
+// sequencer. libjack is loaded when the client is opened, the way JUCE's JACK
+// audio device does it, so there's no build or run time dependency on it.
+//
+// JACK's process callback does no more than copy events: what came in goes on
+// a queue for the control thread (onInput is called to wake it), and the
+// blocks the output stage hands us since the last period go out at its start.
+// A note for a pedal therefore leaves at most a period after the pedal came in.
+// Incoming events keep their frame's time, as high resolution ticks worked
+// back from when the period began.
+class JackMidi : public MidiBlockSink
+{
+public:
+    static const int queueSize = 256;
+
+    // short messages only, anything longer (sysex) is dropped
+    struct Event
+    {
+	uint8 data_[3];
+	uint8 size_;
+	int64 ticks_;       // Time::getHighResolutionTicks() at the event's frame
+    };
+
+    JackMidi()
+	: input_(queueSize), output_(queueSize)
+    {
+    }
+
+    ~JackMidi()
+    {
+	close();
+    }
+
+#if JUCE_LINUX
+    // connectFrom and connectTo are full JACK port names ("system:midi_capture_1")
+    // to connect our input from and our output to, empty to leave that for later
+    bool open(const String& clientName, const String& connectFrom, const String& connectTo, std::function<void()> onInput)
+    {
+	close();
+	if (!library_.open("libjack.so.0") || !loadFunctions())
+	{
+	    library_.close();
+	    return false;
+	}
+
+	int status = 0;
+	client_ = clientOpen_(clientName.toRawUTF8(), jackNoStartServer, &status);
+	if (client_ == nullptr)
+	{
+	    library_.close();
+	    return false;
+	}
+
+	ticksPerFrame_ = Time::getHighResolutionTicksPerSecond() / (double) jmax((jack_nframes_t) 1, getSampleRate_(client_));
+	inPort_ = portRegister_(client_, "midi_in", jackMidiType, jackPortIsInput, 0);
+	outPort_ = portRegister_(client_, "midi_out", jackMidiType, jackPortIsOutput, 0);
+	onInput_ = onInput;
+	if (inPort_ == nullptr || outPort_ == nullptr
+	    || setProcessCallback_(client_, processCallback, this) != 0
+	    || activate_(client_) != 0)
+	{
+	    close();
+	    return false;
+	}
+
+	// a port that isn't there yet can be connected to with jack_connect later
+	if (connectFrom.isNotEmpty())
+	{
+	    connect_(client_, connectFrom.toRawUTF8(), portName_(inPort_));
+	}
+	if (connectTo.isNotEmpty())
+	{
+	    connect_(client_, portName_(outPort_), connectTo.toRawUTF8());
+	}
+	return true;
+    }
+
+    void close()
+    {
+	if (client_ != nullptr)
+	{
+	    deactivate_(client_);
+	    clientClose_(client_);
+	    client_ = nullptr;
+	}
+	inPort_ = outPort_ = nullptr;
+	library_.close();
+    }
+
+    int getSampleRate() const       { return client_ != nullptr ? (int) getSampleRate_(client_) : 0; }
+    int getBufferSize() const       { return client_ != nullptr ? (int) getBufferSize_(client_) : 0; }
+#else
+    bool open(const String&, const String&, const String&, std::function<void()>)     { return false; }
+    void close()                    {}
+    int getSampleRate() const       { return 0; }
+    int getBufferSize() const       { return 0; }
+#endif
+
+    bool isOpen() const             { return client_ != nullptr; }
+
+    // control thread
+    bool popInput(Event& event)
+    {
+	return input_.pop(event);
+    }
+
+    // from the output stage's flush, so one thread at a time
+    void sendBlock(const MidiBuffer& block) override
+    {
+	MidiBuffer::Iterator it(block);
+	const uint8* data;
+	int size, position;
+	while (it.getNextEvent(data, size, position))
+	{
+	    if (size > 3 || !output_.push(makeEvent(data, size, 0)))
+	    {
+		numDropped_.fetch_add(1, std::memory_order_relaxed);
+	    }
+	}
+    }
+
+    int64 getNumIn() const          { return numIn_.load(); }
+    int64 getNumOut() const         { return numOut_.load(); }
+    int64 getNumDropped() const     { return numDropped_.load(); }
+
+private:
+    static Event makeEvent(const uint8* data, int size, int64 ticks)
+    {
+	Event event = { { 0, 0, 0 }, (uint8) size, ticks };
+	memcpy(event.data_, data, (size_t) size);
+	return event;
+    }
+
+    // the bits of jack/jack.h and jack/midiport.h we use
+    typedef uint32 jack_nframes_t;
+    struct jack_client_t;
+    struct jack_port_t;
+
+#if JUCE_LINUX
+    struct jack_midi_event_t
+    {
+	jack_nframes_t time;
+	size_t size;
+	uint8* buffer;
+    };
+    typedef int (*ProcessCallback) (jack_nframes_t, void*);
+
+    static const int jackNoStartServer = 0x01;
+    static const unsigned long jackPortIsInput = 0x1;
+    static const unsigned long jackPortIsOutput = 0x2;
+    static constexpr const char* jackMidiType = "8 bit raw midi";
+
+    bool loadFunctions()
+    {
+	return load(clientOpen_, "jack_client_open") && load(clientClose_, "jack_client_close")
+	    && load(portRegister_, "jack_port_register") && load(portName_, "jack_port_name")
+	    && load(setProcessCallback_, "jack_set_process_callback")
+	    && load(activate_, "jack_activate") && load(deactivate_, "jack_deactivate")
+	    && load(connect_, "jack_connect") && load(portGetBuffer_, "jack_port_get_buffer")
+	    && load(getSampleRate_, "jack_get_sample_rate") && load(getBufferSize_, "jack_get_buffer_size")
+	    && load(midiGetEventCount_, "jack_midi_get_event_count") && load(midiEventGet_, "jack_midi_event_get")
+	    && load(midiClearBuffer_, "jack_midi_clear_buffer") && load(midiEventWrite_, "jack_midi_event_write");
+    }
+
+    template <typename Function>
+    bool load(Function& function, const char* name)
+    {
+	function = (Function) library_.getFunction(name);
+	return function != nullptr;
+    }
+
+    static int processCallback(jack_nframes_t numFrames, void* arg)
+    {
+	static_cast<JackMidi*>(arg)->process(numFrames);
+	return 0;
+    }
+
+    // JACK's realtime thread, no locks or allocation beyond waking the control thread
+    void process(jack_nframes_t numFrames)
+    {
+	void* out = portGetBuffer_(outPort_, numFrames);
+	midiClearBuffer_(out);
+	Event event;
+	while (output_.pop(event))
+	{
+	    if (midiEventWrite_(out, 0, event.data_, event.size_) == 0)
+	    {
+		numOut_.fetch_add(1, std::memory_order_relaxed);
+	    }
+	    else
+	    {
+		numDropped_.fetch_add(1, std::memory_order_relaxed);
+	    }
+	}
+
+	// what's in the input buffer came in over the last period, which ended now
+	const int64 periodStart = Time::getHighResolutionTicks() - (int64) (numFrames * ticksPerFrame_);
+	void* in = portGetBuffer_(inPort_, numFrames);
+	const uint32 numEvents = midiGetEventCount_(in);
+	int queued = 0;
+	for (uint32 i = 0; i < numEvents; ++i)
+	{
+	    jack_midi_event_t midiEvent;
+	    if (midiEventGet_(&midiEvent, in, i) != 0)
+	    {
+		continue;
+	    }
+	    const int64 ticks = periodStart + (int64) (midiEvent.time * ticksPerFrame_);
+	    if (midiEvent.size == 0 || midiEvent.size > 3 || !input_.push(makeEvent(midiEvent.buffer, (int) midiEvent.size, ticks)))
+	    {
+		numDropped_.fetch_add(1, std::memory_order_relaxed);
+		continue;
+	    }
+	    ++queued;
+	}
+	if (queued > 0)
+	{
+	    numIn_.fetch_add(queued, std::memory_order_relaxed);
+	    onInput_();
+	}
+    }
+
+    DynamicLibrary library_;
+    jack_client_t* (*clientOpen_) (const char*, int, int*, ...) = nullptr;
+    int (*clientClose_) (jack_client_t*) = nullptr;
+    jack_port_t* (*portRegister_) (jack_client_t*, const char*, const char*, unsigned long, unsigned long) = nullptr;
+    const char* (*portName_) (const jack_port_t*) = nullptr;
+    int (*setProcessCallback_) (jack_client_t*, ProcessCallback, void*) = nullptr;
+    int (*activate_) (jack_client_t*) = nullptr;
+    int (*deactivate_) (jack_client_t*) = nullptr;
+    int (*connect_) (jack_client_t*, const char*, const char*) = nullptr;
+    void* (*portGetBuffer_) (jack_port_t*, jack_nframes_t) = nullptr;
+    jack_nframes_t (*getSampleRate_) (jack_client_t*) = nullptr;
+    jack_nframes_t (*getBufferSize_) (jack_client_t*) = nullptr;
+    uint32 (*midiGetEventCount_) (void*) = nullptr;
+    int (*midiEventGet_) (jack_midi_event_t*, void*, uint32) = nullptr;
+    void (*midiClearBuffer_) (void*) = nullptr;
+    int (*midiEventWrite_) (void*, jack_nframes_t, const uint8*, size_t) = nullptr;
+
+    jack_port_t* inPort_ = nullptr;
+    jack_port_t* outPort_ = nullptr;
+    double ticksPerFrame_ = 0;
+#endif
+
+    jack_client_t* client_ = nullptr;
+    std::function<void()> onInput_;
+    SpscQueue<Event> input_;        // JACK -> control thread
+    SpscQueue<Event> output_;       // output stage -> JACK
+
+    std::atomic<int64> numIn_ { 0 };
+    std::atomic<int64> numOut_ { 0 };
+    std::atomic<int64> numDropped_ { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE(JackMidi)
+};
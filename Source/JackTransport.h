@@ -0,0 +1,225 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include <cmath>
+
+//==============================================================================
+// JACK transport's bar, beat and tempo, read by a JACK client of its own with
+// jack_transport_query, which only copies the position out of the server's
+// shared memory, so it's cheap enough to do on every control pass. The beat
+// is carried on from the period the position was for by its tempo, the way
+// NetworkClock carries on the leader's, so it can stand in for the MIDI or
+// network clock while the transport rolls. libjack is loaded when the client
+// is opened, the way JackMidi does it. Control thread only.
+class JackTransport
+{
+public:
+    JackTransport() {}
+
+    ~JackTransport()
+    {
+	close();
+    }
+
+#if JUCE_LINUX
+    bool open(const String& clientName)
+    {
+	close();
+	if (!library_.open("libjack.so.0") || !loadFunctions())
+	{
+	    library_.close();
+	    return false;
+	}
+
+	int status = 0;
+	client_ = clientOpen_(clientName.toRawUTF8(), jackNoStartServer, &status);
+	if (client_ == nullptr)
+	{
+	    library_.close();
+	    return false;
+	}
+	if (activate_(client_) != 0)
+	{
+	    close();
+	    return false;
+	}
+	sampleRate_ = (double) getSampleRate_(client_);
+	lastFrame_ = frameTime_(client_);
+	frames_ = 0;
+	return true;
+    }
+
+    void close()
+    {
+	if (client_ != nullptr)
+	{
+	    deactivate_(client_);
+	    clientClose_(client_);
+	    client_ = nullptr;
+	}
+	rolling_ = false;
+	library_.close();
+    }
+
+    // reads the transport as of now, our ticks; a position older than
+    // maxAgeSeconds (the server gone quiet) counts as stopped
+    void poll(int64 now)
+    {
+	jack_position_t position;
+	const int state = transportQuery_(client_, &position);
+	const double ageMicros = (double) (getTime_() - position.usecs);
+	rolling_ = state == jackTransportRolling && (position.valid & jackPositionBBT) != 0
+	    && position.beats_per_minute > 0 && position.ticks_per_beat > 0 && position.beats_per_bar > 0
+	    && ageMicros <= maxAgeSeconds * 1.0e6;
+	if (!rolling_)
+	{
+	    return;
+	}
+	bpm_ = position.beats_per_minute;
+	beatsPerBar_ = position.beats_per_bar;
+	beats_ = (position.bar - 1) * (double) position.beats_per_bar + (position.beat - 1) + position.tick / position.ticks_per_beat;
+	beatTicks_ = now - (int64) (jmax(0.0, ageMicros) * 1.0e-6 * (double) Time::getHighResolutionTicksPerSecond());
+	++numPolls_;
+    }
+
+    // the server's frame clock in high resolution ticks, for what runs at the
+    // audio's rate rather than ours; it's free running, the transport or not
+    int64 getAudioTicks()
+    {
+	const jack_nframes_t frame = frameTime_(client_);
+	frames_ += (jack_nframes_t) (frame - lastFrame_);
+	lastFrame_ = frame;
+	return (int64) ((double) frames_ / sampleRate_ * (double) Time::getHighResolutionTicksPerSecond());
+    }
+#else
+    bool open(const String&)            { return false; }
+    void close()                        {}
+    void poll(int64)                    {}
+    int64 getAudioTicks()               { return 0; }
+#endif
+
+    bool isOpen() const                 { return client_ != nullptr; }
+
+    // rolling with a bar and beat to go by, as of the last poll
+    bool isRolling() const              { return rolling_; }
+
+    // beats since the first bar's first beat at now, our ticks
+    double getBeats(int64 now) const
+    {
+	return beats_ + (double) (now - beatTicks_) * bpm_ / (60.0 * (double) Time::getHighResolutionTicksPerSecond());
+    }
+
+    double getPhase(int64 now) const
+    {
+	const double beats = getBeats(now);
+	return beats - std::floor(beats);
+    }
+
+    double getBpm() const               { return bpm_; }
+    double getBeatsPerBar() const       { return beatsPerBar_; }
+
+    double getTicksPerBeat() const
+    {
+	return bpm_ > 0 ? 60.0 * (double) Time::getHighResolutionTicksPerSecond() / bpm_ : 0;
+    }
+
+    int64 getNumPolls() const           { return numPolls_; }
+
+private:
+    static constexpr double maxAgeSeconds = 1.0;
+
+    // the bits of jack/jack.h and jack/transport.h we use
+    typedef uint32 jack_nframes_t;
+    struct jack_client_t;
+
+#if JUCE_LINUX
+    static const int jackNoStartServer = 0x01;
+    static const int jackTransportRolling = 1;
+    static const uint32 jackPositionBBT = 0x10;
+
+    // packed like JACK's own, only the fields up to the tempo are read
+    struct __attribute__((packed)) jack_position_t
+    {
+	uint64 unique_1;
+	uint64 usecs;
+	jack_nframes_t frame_rate;
+	jack_nframes_t frame;
+	uint32 valid;
+	int32 bar;
+	int32 beat;
+	int32 tick;
+	double bar_start_tick;
+	float beats_per_bar;
+	float beat_type;
+	double ticks_per_beat;
+	double beats_per_minute;
+	double frame_time;
+	double next_time;
+	jack_nframes_t bbt_offset;
+	float audio_frames_per_video_frame;
+	jack_nframes_t video_offset;
+	double tick_double;
+	int32 padding[5];
+	uint64 unique_2;
+    };
+    static_assert(sizeof(jack_position_t) == 136, "jack_position_t isn't JACK's size");
+
+    bool loadFunctions()
+    {
+	return load(clientOpen_, "jack_client_open") && load(clientClose_, "jack_client_close")
+	    && load(activate_, "jack_activate") && load(deactivate_, "jack_deactivate")
+	    && load(transportQuery_, "jack_transport_query") && load(getTime_, "jack_get_time")
+	    && load(frameTime_, "jack_frame_time") && load(getSampleRate_, "jack_get_sample_rate");
+    }
+
+    template <typename Function>
+    bool load(Function& function, const char* name)
+    {
+	function = (Function) library_.getFunction(name);
+	return function != nullptr;
+    }
+
+    DynamicLibrary library_;
+    jack_client_t* (*clientOpen_) (const char*, int, int*, ...) = nullptr;
+    int (*clientClose_) (jack_client_t*) = nullptr;
+    int (*activate_) (jack_client_t*) = nullptr;
+    int (*deactivate_) (jack_client_t*) = nullptr;
+    int (*transportQuery_) (const jack_client_t*, jack_position_t*) = nullptr;
+    uint64 (*getTime_) () = nullptr;
+    jack_nframes_t (*frameTime_) (const jack_client_t*) = nullptr;
+    jack_nframes_t (*getSampleRate_) (jack_client_t*) = nullptr;
+
+    double sampleRate_ = 0;
+    jack_nframes_t lastFrame_ = 0;
+    int64 frames_ = 0;          // lastFrame_ unwrapped
+#endif
+
+    jack_client_t* client_ = nullptr;
+    bool rolling_ = false;
+    double beats_ = 0;          // the transport's beats at beatTicks_
+    int64 beatTicks_ = 0;
+    double bpm_ = 0;
+    double beatsPerBar_ = 0;
+    int64 numPolls_ = 0;
+
+    JUCE_DECLARE_NON_COPYABLE(JackTransport)
+};
@@ -0,0 +1,527 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+#if JUCE_LINUX
+ #include <time.h>
+ #include <unistd.h>
+#endif
+
+//==============================================================================
+// Latency histogram with fixed 100us buckets up to 100ms (anything slower
+// lands in the last one) plus the exact maximum. Recording is a couple of
+// relaxed atomic ops, any thread can read it at any time.
+class LatencyHistogram
+{
+public:
+    static const int numBuckets = 1000;
+    static const int bucketMicros = 100;
+
+    LatencyHistogram()
+    {
+	reset();
+    }
+
+    void record(int64 micros)
+    {
+	const int bucket = (int) jlimit((int64) 0, (int64) numBuckets - 1, micros / bucketMicros);
+	buckets_[bucket].fetch_add(1, std::memory_order_relaxed);
+	count_.fetch_add(1, std::memory_order_relaxed);
+
+	int64 max = max_.load(std::memory_order_relaxed);
+	while (micros > max && !max_.compare_exchange_weak(max, micros, std::memory_order_relaxed))
+	{
+	}
+    }
+
+    int64 getCount() const      { return count_.load(std::memory_order_relaxed); }
+    int64 getMaxMicros() const  { return max_.load(std::memory_order_relaxed); }
+
+    // upper edge of the bucket holding the given percentile (0-100), 0 if empty
+    int64 getPercentileMicros(double percentile) const
+    {
+	const int64 count = getCount();
+	if (count == 0)
+	{
+	    return 0;
+	}
+
+	const int64 wanted = jmax((int64) 1, (int64) std::ceil(count * percentile / 100.0));
+	int64 seen = 0;
+	for (int i = 0; i < numBuckets; ++i)
+	{
+	    seen += buckets_[i].load(std::memory_order_relaxed);
+	    if (seen >= wanted)
+	    {
+		return jmin((int64) (i + 1) * bucketMicros, getMaxMicros());
+	    }
+	}
+	return getMaxMicros();
+    }
+
+    void reset()
+    {
+	for (auto&& bucket : buckets_)
+	{
+	    bucket = 0;
+	}
+	count_ = 0;
+	max_ = 0;
+    }
+
+private:
+    std::atomic<uint32> buckets_[numBuckets];
+    std::atomic<int64> count_;
+    std::atomic<int64> max_;
+
+    JUCE_DECLARE_NON_COPYABLE(LatencyHistogram)
+};
+
+//==============================================================================
+// The stages we time, all but osc-queue measured from when the pedal-down was
+// first seen: the wakeup that read it, or the frame JACK had it at. The
+// kernel's receive time splits pedal-ctrl into pedal-net, until the datagram
+// was in, and osc-queue, from there to the handler.
+class LatencyStats
+{
+public:
+    enum Stage
+    {
+	PedalToNote,        // note on handed to the MIDI output
+	PedalToCtrl,        // SooperLooper's /ctrl state update for that loop
+	PedalToLed,         // LED command for that pedal queued for loop4r_leds
+	PedalToCtrlArrival, // the kernel receiving that /ctrl
+	OscQueue,           // any /ctrl or /pingack, from the kernel receiving it to its handler
+	numStages
+    };
+
+    static const char* getStageName(Stage stage)
+    {
+	switch (stage)
+	{
+	    case PedalToNote:   return "pedal-note";
+	    case PedalToCtrl:   return "pedal-ctrl";
+	    case PedalToLed:    return "pedal-led";
+	    case PedalToCtrlArrival: return "pedal-net";
+	    case OscQueue:      return "osc-queue";
+	    default:            return "unknown";
+	}
+    }
+
+    // startTicks is a Time::getHighResolutionTicks() value
+    void record(Stage stage, int64 startTicks)
+    {
+	record(stage, startTicks, Time::getHighResolutionTicks());
+    }
+
+    void record(Stage stage, int64 startTicks, int64 endTicks)
+    {
+	const double seconds = Time::highResolutionTicksToSeconds(endTicks - startTicks);
+	histograms_[stage].record((int64) (jmax(0.0, seconds) * 1.0e6));
+    }
+
+    const LatencyHistogram& get(Stage stage) const  { return histograms_[stage]; }
+
+    void dump(std::ostream& out) const
+    {
+	for (int i = 0; i < numStages; ++i)
+	{
+	    const LatencyHistogram& histogram = histograms_[i];
+	    out << String(getStageName((Stage) i)).paddedRight(' ', 12)
+		<< " count " << histogram.getCount()
+		<< "  p50 " << String(histogram.getPercentileMicros(50) / 1000.0, 1) << "ms"
+		<< "  p99 " << String(histogram.getPercentileMicros(99) / 1000.0, 1) << "ms"
+		<< "  max " << String(histogram.getMaxMicros() / 1000.0, 1) << "ms" << std::endl;
+	}
+    }
+
+private:
+    LatencyHistogram histograms_[numStages];
+};
+
+//==============================================================================
+// A running estimate of how long a command takes to reach SooperLooper, from
+// the time a loop pedal's note left here to the /ctrl update saying the loop
+// changed, smoothed the way TCP smooths its round trip (RFC 6298). The trip
+// back is as far again as the way there, so half the smoothed time is what
+// gets taken off a scheduled send. It's only trusted once it has a few samples
+// and their spread is small next to it. Only the control thread uses this.
+class LatencyEstimate
+{
+public:
+    static const int minSamples = 4;
+
+    void add(int64 micros)
+    {
+	const double sample = (double) micros;
+	if (numSamples_++ == 0)
+	{
+	    smoothed_ = sample;
+	    variance_ = sample / 2;
+	    return;
+	}
+	variance_ = 0.75 * variance_ + 0.25 * std::abs(smoothed_ - sample);
+	smoothed_ = 0.875 * smoothed_ + 0.125 * sample;
+    }
+
+    // enough samples, and spread no more than half the round trip
+    bool isSteady() const               { return numSamples_ >= minSamples && variance_ <= smoothed_ / 2; }
+
+    double getRoundTripMs() const       { return smoothed_ / 1000.0; }
+    double getVarianceMs() const        { return variance_ / 1000.0; }
+    double getOneWayMs() const          { return smoothed_ / 2000.0; }
+    int64 getNumSamples() const         { return numSamples_; }
+
+    void dump(std::ostream& out) const
+    {
+	out << "Command latency: " << numSamples_ << " samples, round trip " << String(getRoundTripMs(), 1) << "ms, variance "
+	    << String(getVarianceMs(), 1) << "ms, " << (isSteady() ? "compensating " + String(getOneWayMs(), 1) + "ms" : String("not steady")) << std::endl;
+    }
+
+private:
+    double smoothed_ = 0;
+    double variance_ = 0;
+    int64 numSamples_ = 0;
+};
+
+//==============================================================================
+// A histogram of intervals in microseconds with log-linear buckets: values
+// under 2^subBucketBits us each get a bucket, above that every power of two is
+// split into 2^subBucketBits equal ones, so a bucket is never more than 1/8th
+// wider than the values in it. Up to 2^maxBits us (134s); anything longer
+// lands in the last bucket. The maximum is kept exactly. Single threaded.
+class IntervalHistogram
+{
+public:
+    static const int subBucketBits = 3;
+    static const int subBuckets = 1 << subBucketBits;
+    static const int maxBits = 27;
+    static const int numBuckets = (maxBits - subBucketBits + 1) * subBuckets;
+
+    IntervalHistogram()
+    {
+	reset();
+    }
+
+    void record(int64 micros)
+    {
+	++buckets_[getBucket(jmax((int64) 0, micros))];
+	++count_;
+	max_ = jmax(max_, micros);
+    }
+
+    int64 getCount() const      { return count_; }
+    int64 getMaxMicros() const  { return max_; }
+
+    // upper edge of the bucket holding the given percentile (0-100), 0 if empty
+    int64 getPercentileMicros(double percentile) const
+    {
+	if (count_ == 0)
+	{
+	    return 0;
+	}
+
+	const int64 wanted = jmax((int64) 1, (int64) std::ceil(count_ * percentile / 100.0));
+	int64 seen = 0;
+	for (int i = 0; i < numBuckets; ++i)
+	{
+	    seen += buckets_[i];
+	    if (seen >= wanted)
+	    {
+		return jmin(getUpperEdge(i), max_);
+	    }
+	}
+	return max_;
+    }
+
+    void reset()
+    {
+	for (auto&& bucket : buckets_)
+	{
+	    bucket = 0;
+	}
+	count_ = 0;
+	max_ = 0;
+    }
+
+private:
+    static int getBucket(int64 micros)
+    {
+	if (micros < subBuckets)
+	{
+	    return (int) micros;
+	}
+	int bits = 0;
+	while (bits < 63 && (micros >> (bits + 1)) != 0)
+	{
+	    ++bits;
+	}
+	// bits is the top bit's position, the next subBucketBits below it pick the sub-bucket
+	const int bucket = (bits - subBucketBits + 1) * subBuckets + (int) ((micros >> (bits - subBucketBits)) & (subBuckets - 1));
+	return jmin(bucket, numBuckets - 1);
+    }
+
+    static int64 getUpperEdge(int bucket)
+    {
+	if (bucket < subBuckets)
+	{
+	    return bucket + 1;
+	}
+	const int bits = bucket / subBuckets + subBucketBits - 1;
+	return ((int64) (subBuckets + bucket % subBuckets + 1)) << (bits - subBucketBits);
+    }
+
+    uint32 buckets_[numBuckets];
+    int64 count_;
+    int64 max_;
+};
+
+//==============================================================================
+// The gaps between one engine's auto-update /ctrl state messages, per loop.
+// SooperLooper sends them every intervalMs, so wider gaps mean its OSC thread
+// was held up, usually by the audio host being overloaded, and a gap of a few
+// intervals is counted as the updates missing in it. The histograms are sized
+// by resize(), off the /ctrl path. Only the control thread uses this.
+class UpdateArrivals
+{
+public:
+    static const int intervalMs = 100;  // what we register for
+
+    void resize(int numLoops)
+    {
+	while (loops_.size() < numLoops)
+	{
+	    loops_.add(new Loop());
+	}
+	loops_.removeLast(loops_.size() - numLoops);
+    }
+
+    // ticks is a Time::getHighResolutionTicks() value
+    void arrived(int loop, int64 ticks)
+    {
+	Loop* entry = loops_[loop];
+	if (entry == nullptr)
+	{
+	    return;
+	}
+	if (entry->last_ != 0)
+	{
+	    const int64 micros = (int64) (Time::highResolutionTicksToSeconds(ticks - entry->last_) * 1.0e6);
+	    entry->gaps_.record(micros);
+	    const int64 missed = (micros + intervalMs * 500) / (intervalMs * 1000) - 1;
+	    entry->missed_ += jmax((int64) 0, missed);
+	}
+	entry->last_ = ticks;
+    }
+
+    // a gap across a reconnect says nothing about SooperLooper
+    void restart()
+    {
+	for (auto* loop : loops_)
+	{
+	    loop->last_ = 0;
+	}
+    }
+
+    int size() const                                    { return loops_.size(); }
+    const IntervalHistogram& getGaps(int loop) const    { return loops_[loop]->gaps_; }
+    int64 getNumMissed(int loop) const                  { return loops_[loop]->missed_; }
+
+    void dump(std::ostream& out, const String& name) const
+    {
+	for (int i = 0; i < loops_.size(); ++i)
+	{
+	    const IntervalHistogram& gaps = getGaps(i);
+	    if (gaps.getCount() > 0)
+	    {
+		out << name << " loop " << i << " updates " << gaps.getCount()
+		    << "  gap p50 " << String(gaps.getPercentileMicros(50) / 1000.0, 1) << "ms"
+		    << "  p99 " << String(gaps.getPercentileMicros(99) / 1000.0, 1) << "ms"
+		    << "  max " << String(gaps.getMaxMicros() / 1000.0, 1) << "ms"
+		    << "  missed " << getNumMissed(i) << std::endl;
+	    }
+	}
+    }
+
+private:
+    struct Loop
+    {
+	IntervalHistogram gaps_;
+	int64 last_ = 0;
+	int64 missed_ = 0;
+    };
+
+    OwnedArray<Loop> loops_;
+};
+
+//==============================================================================
+// How long after we started each step of the bring-up was first reached. Each
+// is set once, from whichever thread gets there, and read from any. Times are
+// from when this was made, early in the application object's construction;
+// what went before it, from exec through the dynamic linker loading the X11
+// and curl libraries to the static constructors, is the kernel's start time
+// for the process against the boot clock, good to its 10ms ticks.
+class StartupTimes
+{
+public:
+    // in the order they're normally reached
+    enum Milestone
+    {
+	Initialise,         // JUCE's MessageManager is up and initialise() called
+	Parameters,         // the command line parsed
+	LedOutput,          // the LED sink opened
+	Session,            // the journal opened, session and snapshot restored
+	OscBound,           // the OSC receive port bound
+	FirstPing,          // the first /ping handed to an engine's sender
+	MidiClient,         // the ALSA sequencer client made and its ports connected
+	MidiPorts,          // MIDI input and output opened (or given up on)
+	FirstPingAck,       // an engine answered it
+	FirstCtrl,          // the first /ctrl arrived
+	FirstLoopStates,    // and every one of its loops has said what it's doing
+	FirstLedLit,        // the first LED turned on
+	FirstCorrectFrame,  // the first LED frame committed with every loop's state known
+	numMilestones
+    };
+
+    static const char* getMilestoneName(Milestone milestone)
+    {
+	switch (milestone)
+	{
+	    case Initialise:    return "initialise";
+	    case Parameters:    return "parameters";
+	    case LedOutput:     return "LED output";
+	    case Session:       return "session";
+	    case OscBound:      return "OSC bound";
+	    case FirstPing:     return "first /ping";
+	    case MidiClient:    return "ALSA client";
+	    case MidiPorts:     return "MIDI ports";
+	    case FirstPingAck:  return "first /pingack";
+	    case FirstCtrl:     return "first /ctrl";
+	    case FirstLoopStates: return "loop states";
+	    case FirstLedLit:   return "board lit";
+	    case FirstCorrectFrame: return "ready";
+	    default:            return "unknown";
+	}
+    }
+
+    StartupTimes()
+	: startTicks_(Time::getHighResolutionTicks()),
+	  beforeStartMs_(findBeforeStartMs())
+    {
+	for (auto&& ticks : ticks_)
+	{
+	    ticks = 0;
+	}
+    }
+
+    void reached(Milestone milestone)
+    {
+	if (ticks_[milestone].load(std::memory_order_relaxed) == 0)
+	{
+	    int64 expected = 0;
+	    ticks_[milestone].compare_exchange_strong(expected, Time::getHighResolutionTicks() - startTicks_ + 1);
+	}
+    }
+
+    bool hasReached(Milestone milestone) const  { return ticks_[milestone].load(std::memory_order_relaxed) != 0; }
+
+    double getMs(Milestone milestone) const
+    {
+	return Time::highResolutionTicksToSeconds(ticks_[milestone].load(std::memory_order_relaxed)) * 1000.0;
+    }
+
+    // from exec to when this was made, -1 where the kernel doesn't say
+    double getBeforeStartMs() const             { return beforeStartMs_; }
+
+    // the milestones that matter most, on one line
+    void dump(std::ostream& out) const
+    {
+	static const Milestone summary[] = { MidiPorts, FirstPing, FirstPingAck, FirstLoopStates, FirstLedLit, FirstCorrectFrame };
+	out << "Startup:";
+	for (auto milestone : summary)
+	{
+	    out << (milestone == summary[0] ? " " : ", ") << getMilestoneName(milestone) << " "
+		<< (hasReached(milestone) ? String(getMs(milestone), 1) + "ms" : String("-"));
+	}
+	out << std::endl;
+    }
+
+    // every milestone in the order they were reached, each with the time it
+    // took from the one before, which is what that phase cost
+    void dumpProfile(std::ostream& out) const
+    {
+	Milestone order[numMilestones];
+	int numReached = 0;
+	for (int i = 0; i < numMilestones; ++i)
+	{
+	    if (hasReached((Milestone) i))
+	    {
+		order[numReached++] = (Milestone) i;
+	    }
+	}
+	std::stable_sort(order, order + numReached, [this] (Milestone a, Milestone b) { return getMs(a) < getMs(b); });
+
+	const double offset = jmax(0.0, beforeStartMs_);
+	out << "Startup profile, ms since exec and since the step before:" << std::endl;
+	out << "  " << String("started").paddedRight(' ', 16) << String(offset, 1).paddedLeft(' ', 9)
+	    << (beforeStartMs_ < 0 ? String("  (exec not known)") : String("  (dynamic linking, static constructors)")) << std::endl;
+	double last = 0;
+	for (int i = 0; i < numReached; ++i)
+	{
+	    const double ms = getMs(order[i]);
+	    out << "  " << String(getMilestoneName(order[i])).paddedRight(' ', 16) << String(offset + ms, 1).paddedLeft(' ', 9)
+		<< String(ms - last, 1).paddedLeft(' ', 9) << std::endl;
+	    last = ms;
+	}
+	for (int i = 0; i < numMilestones; ++i)
+	{
+	    if (!hasReached((Milestone) i))
+	    {
+		out << "  " << String(getMilestoneName((Milestone) i)).paddedRight(' ', 16) << String("-").paddedLeft(' ', 9) << std::endl;
+	    }
+	}
+    }
+
+private:
+    // the process's start time in /proc/self/stat is in clock ticks since boot
+    static double findBeforeStartMs()
+    {
+#if JUCE_LINUX
+	const StringArray fields(StringArray::fromTokens(File("/proc/self/stat").loadFileAsString().fromLastOccurrenceOf(")", false, false).trim(), " ", ""));
+	struct timespec now;
+	const long ticksPerSecond = sysconf(_SC_CLK_TCK);
+	// starttime is the 22nd field, the 20th after the name
+	if (fields.size() > 19 && ticksPerSecond > 0 && clock_gettime(CLOCK_BOOTTIME, &now) == 0)
+	{
+	    const double started = fields[19].getLargeIntValue() * 1000.0 / ticksPerSecond;
+	    return jmax(0.0, now.tv_sec * 1000.0 + now.tv_nsec / 1.0e6 - started);
+	}
+#endif
+	return -1;
+    }
+
+    const int64 startTicks_;
+    const double beforeStartMs_;
+    std::atomic<int64> ticks_[numMilestones];
+};
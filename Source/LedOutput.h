@@ -0,0 +1,562 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "TraceCapture.h"
+#include "SpanTrace.h"
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <unistd.h>
+
+//==============================================================================
+// Somewhere other than the loop4r_leds pipe to send the LED commands to. The
+// writer thread calls send() for each command of a batch, then flush() once.
+class LedCommandSink
+{
+public:
+    virtual ~LedCommandSink() {}
+
+    virtual void send(int cc, int value) = 0;
+    virtual void flush() = 0;
+};
+
+//==============================================================================
+// Buffered "cc <number> <value>" output for loop4r_leds. Commands added while
+// handling one event are collected and committed together, a writer thread
+// turns each batch into a single write(). The caller never blocks: if the
+// pipe backs up and the ring fills, commands go into a table that only keeps
+// the latest state per LED (or display digit), which the writer emits once it
+// has caught up.
+//
+// Instead of the text, the pipe can carry 4 byte records of opcode, LED
+// index, state and timer, nothing for the reader to tokenise:
+//
+//   0xff '4' 'R' version      once, when the binary framing starts
+//   0x81 led on|off 0         an LED (cc 106 on, cc 107 off)
+//   0x82 cc value 0           any other command, e.g. the display (cc 113)
+//   0x83 count 0 0            end of a batch of count records (mod 256),
+//                             so a whole board's frame can be applied at once
+//
+// The timer byte is 0 for now, blinking being done on our side.
+class LedCommandOutput : private Thread
+{
+public:
+    enum Format
+    {
+	TextFormat,
+	BinaryFormat
+    };
+
+    static const uint8 binaryVersion = 1;
+
+    LedCommandOutput(int fd = STDOUT_FILENO, int capacity = 1024)
+	: Thread("loop4r LED output"), fd_(fd), fifo_(capacity), numPending_(0), overflowed_(false)
+    {
+	ring_.calloc((size_t) capacity);
+	for (auto&& slot : latest_)
+	{
+	    slot = 0;
+	}
+	for (auto&& dirty : dirty_)
+	{
+	    dirty = false;
+	}
+    }
+
+    ~LedCommandOutput()
+    {
+	stop();
+    }
+
+    void start()
+    {
+	startThread();
+    }
+
+    // flushes whatever is queued, then stops the writer
+    void stop()
+    {
+	if (isThreadRunning())
+	{
+	    signalThreadShouldExit();
+	    wakeUp_.signal();
+	    stopThread(1000);
+	}
+    }
+
+    void add(int cc, int value)
+    {
+	const SpinLock::ScopedLockType lock(producerLock_);
+	if (numPending_ == maxPending)
+	{
+	    commitLocked();
+	}
+	pending_[numPending_++] = pack(cc, value);
+    }
+
+    // hands everything added since the last commit to the writer in one go
+    void commit()
+    {
+	const SpinLock::ScopedLockType lock(producerLock_);
+	commitLocked();
+    }
+
+    // sends the batches to sink instead of the pipe, nullptr goes back to the
+    // pipe. The sink has to outlive this.
+    void setSink(LedCommandSink* sink)
+    {
+	sink_ = sink;
+	wakeUp_.signal();
+    }
+
+    bool hasSink() const                { return sink_.load() != nullptr; }
+
+    // what goes down the pipe from the next batch on, text unless told otherwise
+    void setFormat(Format format)
+    {
+	format_ = format;
+	wakeUp_.signal();
+    }
+
+    Format getFormat() const            { return format_.load(); }
+
+    // every command written is recorded there as LedOut
+    void setTrace(TraceCapture* trace)  { trace_ = trace; }
+
+    // each batch the writer emits is a "led write" span there
+    void setSpans(SpanTrace* spans)     { spans_ = spans; }
+
+    int64 getNumWrites() const          { return numWrites_.load(); }
+    int getNumQueued() const            { return fifo_.getNumReady(); }
+    int64 getNumCoalesced() const       { return numCoalesced_.load(); }
+
+private:
+    static const int maxPending = 64;
+    static const int numSlots = 256;
+
+    static uint16 pack(int cc, int value)     { return (uint16) (((cc & 0x7f) << 8) | (value & 0x7f)); }
+    static int ccOf(uint16 command)             { return command >> 8; }
+    static int valueOf(uint16 command)          { return command & 0x7f; }
+
+    // LED on and off share a slot per LED number, so an off supersedes an on
+    static int slotOf(uint16 command)
+    {
+	const int cc = ccOf(command);
+	return (cc == 106 || cc == 107) ? valueOf(command) : 128 + cc;
+    }
+
+    void commitLocked()
+    {
+	if (numPending_ == 0)
+	{
+	    return;
+	}
+
+	// once we've overflowed keep using the table until the writer has emptied
+	// it, otherwise newer ring entries could be overtaken by older table ones
+	int start1, size1, start2, size2;
+	fifo_.prepareToWrite(numPending_, start1, size1, start2, size2);
+	if (!overflowed_.load() && size1 + size2 == numPending_)
+	{
+	    for (int i = 0; i < size1; ++i)
+	    {
+		ring_[start1 + i] = pending_[i];
+	    }
+	    for (int i = 0; i < size2; ++i)
+	    {
+		ring_[start2 + i] = pending_[size1 + i];
+	    }
+	    fifo_.finishedWrite(numPending_);
+	}
+	else
+	{
+	    // the writer is behind, only keep the last state for each LED
+	    for (int i = 0; i < numPending_; ++i)
+	    {
+		const int slot = slotOf(pending_[i]);
+		latest_[slot].store(pending_[i]);
+		if (dirty_[slot].exchange(true))
+		{
+		    ++numCoalesced_;
+		}
+	    }
+	    overflowed_ = true;
+	}
+
+	numPending_ = 0;
+	wakeUp_.signal();
+    }
+
+    void emit(LedCommandSink* sink, uint16 command)
+    {
+	if (TraceCapture* trace = trace_.load())
+	{
+	    const uint8 bytes[] = { (uint8) ccOf(command), (uint8) valueOf(command) };
+	    trace->record(TraceCapture::LedOut, bytes, sizeof(bytes));
+	}
+	if (sink != nullptr)
+	{
+	    sink->send(ccOf(command), valueOf(command));
+	    ++numSinkCommands_;
+	}
+	else
+	{
+	    append(command);
+	}
+    }
+
+    void append(uint16 command)
+    {
+	if (size_ + 16 > (int) sizeof(buffer_))
+	{
+	    writeBuffer();
+	}
+	if (binary_)
+	{
+	    const int cc = ccOf(command);
+	    const bool led = cc == 106 || cc == 107;
+	    appendRecord(led ? 0x81 : 0x82, (uint8) (led ? valueOf(command) : cc), (uint8) (led ? (cc == 106 ? 1 : 0) : valueOf(command)));
+	    ++numInFrame_;
+	}
+	else
+	{
+	    size_ += std::snprintf(buffer_ + size_, sizeof(buffer_) - (size_t) size_, "cc %d %d\n", ccOf(command), valueOf(command));
+	}
+    }
+
+    void appendRecord(uint8 opcode, uint8 index, uint8 state, uint8 timer = 0)
+    {
+	buffer_[size_++] = (char) opcode;
+	buffer_[size_++] = (char) index;
+	buffer_[size_++] = (char) state;
+	buffer_[size_++] = (char) timer;
+    }
+
+    void writeBuffer()
+    {
+	int written = 0;
+	while (written < size_)
+	{
+	    const ssize_t result = ::write(fd_, buffer_ + written, (size_t) (size_ - written));
+	    if (result < 0)
+	    {
+		if (errno == EINTR)
+		{
+		    continue;
+		}
+		break; // consumer went away, nothing sensible to do
+	    }
+	    written += (int) result;
+	}
+	if (size_ > 0)
+	{
+	    ++numWrites_;
+	}
+	size_ = 0;
+    }
+
+    void drain()
+    {
+	const SpanTrace::Scope span(spans_.load(), "led write");
+	LedCommandSink* sink = sink_.load();
+	const bool binary = format_.load() == BinaryFormat;
+	if (binary != binary_)
+	{
+	    binary_ = binary;
+	    if (binary_)
+	    {
+		appendRecord(0xff, '4', 'R', binaryVersion);
+	    }
+	}
+	int start1, size1, start2, size2;
+	fifo_.prepareToRead(fifo_.getNumReady(), start1, size1, start2, size2);
+	for (int i = 0; i < size1; ++i)
+	{
+	    emit(sink, ring_[start1 + i]);
+	}
+	for (int i = 0; i < size2; ++i)
+	{
+	    emit(sink, ring_[start2 + i]);
+	}
+	fifo_.finishedRead(size1 + size2);
+
+	if (overflowed_.exchange(false))
+	{
+	    for (int slot = 0; slot < numSlots; ++slot)
+	    {
+		if (dirty_[slot].exchange(false))
+		{
+		    emit(sink, latest_[slot].load());
+		}
+	    }
+	}
+
+	if (sink != nullptr)
+	{
+	    if (numSinkCommands_ > 0)
+	    {
+		sink->flush();
+		++numWrites_;
+	    }
+	    numSinkCommands_ = 0;
+	}
+	else
+	{
+	    if (numInFrame_ > 0)
+	    {
+		if (size_ + 4 > (int) sizeof(buffer_))
+		{
+		    writeBuffer();
+		}
+		appendRecord(0x83, (uint8) numInFrame_, 0);
+		numInFrame_ = 0;
+	    }
+	    writeBuffer();
+	}
+    }
+
+    void run() override
+    {
+	while (!threadShouldExit())
+	{
+	    wakeUp_.wait(-1);
+	    drain();
+	}
+	drain();
+    }
+
+    int fd_;
+    AbstractFifo fifo_;
+    HeapBlock<uint16> ring_;
+    WaitableEvent wakeUp_;
+
+    // producer side
+    SpinLock producerLock_;
+    uint16 pending_[maxPending];
+    int numPending_;
+
+    // superseded-state table used while the pipe is backed up
+    std::atomic<uint16> latest_[numSlots];
+    std::atomic<bool> dirty_[numSlots];
+    std::atomic<bool> overflowed_;
+    std::atomic<LedCommandSink*> sink_ { nullptr };
+    std::atomic<TraceCapture*> trace_ { nullptr };
+    std::atomic<SpanTrace*> spans_ { nullptr };
+    std::atomic<Format> format_ { TextFormat };
+
+    // writer side
+    char buffer_[4096];
+    int size_ = 0;
+    int numSinkCommands_ = 0;
+    bool binary_ = false;
+    int numInFrame_ = 0;
+
+    std::atomic<int64> numWrites_ { 0 };
+    std::atomic<int64> numCoalesced_ { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE(LedCommandOutput)
+};
+
+//==============================================================================
+// Remembers what was last sent for every LED and the display, so callers only
+// emit real changes. Keeps count of how much that saves. Every change also
+// bumps a version and stamps the LED (or display) with it, so a client that
+// has seen version N can be sent just what changed since.
+class LedChangeFilter
+{
+public:
+    static const int maxLeds = 128;
+
+    LedChangeFilter()
+    {
+	invalidate();
+    }
+
+    // returns true (and records it as sent) if the LED differs from the last send
+    bool update(int index, bool on, int timer, int state, int pattern = 0)
+    {
+	if (index < 0 || index >= maxLeds)
+	{
+	    ++numSent_;
+	    return true;
+	}
+
+	const int packed = validBit | (on ? 1 : 0) | ((timer & 0xff) << 1) | ((state & 0xff) << 9) | ((pattern & 0x1f) << 17);
+	if (sent_[index] == packed)
+	{
+	    ++numSuppressed_;
+	    return false;
+	}
+
+	sent_[index] = packed;
+	changedAt_[index] = ++version_;
+	++numSent_;
+	return true;
+    }
+
+    bool updateDisplay(int value)
+    {
+	if (display_ == (value | validBit))
+	{
+	    ++numSuppressed_;
+	    return false;
+	}
+
+	display_ = value | validBit;
+	displayChangedAt_ = ++version_;
+	++numSent_;
+	return true;
+    }
+
+    // forget what was sent, e.g. when the consumer needs the full state again
+    void invalidate()
+    {
+	for (auto&& sent : sent_)
+	{
+	    sent = 0;
+	}
+	display_ = 0;
+	floor_ = version_;
+    }
+
+    int getVersion() const              { return version_; }
+    int getChangedAt(int index) const   { return changedAt_[index]; }
+
+    // what the display was last sent, -1 for nothing since an invalidate()
+    int getDisplay() const              { return (display_ & validBit) != 0 ? display_ & ~validBit : -1; }
+    int getDisplayChangedAt() const     { return displayChangedAt_; }
+
+    // false if changes since that version can't be told apart from the
+    // redraw that followed an invalidate(), or it's from before a restart
+    bool hasChangesSince(int version) const
+    {
+	return version >= floor_ && version <= version_;
+    }
+
+    int64 getNumSent() const            { return numSent_.load(); }
+    int64 getNumSuppressed() const      { return numSuppressed_.load(); }
+
+private:
+    static const int validBit = 1 << 30;
+
+    int sent_[maxLeds];
+    int display_;
+
+    int version_ = 0;
+    int floor_ = 0;
+    int changedAt_[maxLeds] = {};
+    int displayChangedAt_ = 0;
+
+    std::atomic<int64> numSent_ { 0 };
+    std::atomic<int64> numSuppressed_ { 0 };
+};
+
+//==============================================================================
+// The LEDs and the display as two frames. Handlers only draw into the back
+// one; commit() hands whatever was drawn since the last commit to the
+// consumers in one go and makes it the front frame. So a bank switch that
+// darkens and relights half the board shows up as its end result, and
+// anything reading the front frame sees a whole frame, never half of one.
+// Both sides are the control thread's.
+class LedFrameBuffer
+{
+public:
+    static const int maxLeds = LedChangeFilter::maxLeds;
+
+    struct Led
+    {
+	bool on_ = false;
+	uint8 timer_ = 0;
+	uint8 state_ = 0;
+	uint8 pattern_ = 0;     // what the blink engine shows it with
+    };
+
+    void set(int index, bool on, int timer, int state, int pattern)
+    {
+	Led& led = back_[index];
+	led.on_ = on;
+	led.timer_ = (uint8) timer;
+	led.state_ = (uint8) state;
+	led.pattern_ = (uint8) pattern;
+	if (!dirty_[index])
+	{
+	    dirty_[index] = true;
+	    drawn_[numDrawn_++] = (uint8) index;
+	}
+    }
+
+    void setDisplay(int value)
+    {
+	backDisplay_ = value;
+	displayDirty_ = true;
+    }
+
+    // what the handlers drew last, committed or not
+    bool isOn(int index) const          { return back_[index].on_; }
+
+    // the last committed frame
+    const Led& getLed(int index) const  { return front_[index]; }
+    int getDisplay() const              { return frontDisplay_; }
+
+    // emitLed(index, led) for every LED drawn since the last commit, in the
+    // order they were first drawn, then emitDisplay(value) if that was set;
+    // the caller drops the ones that came back to what was already sent
+    template <typename LedFunction, typename DisplayFunction>
+    void commit(LedFunction&& emitLed, DisplayFunction&& emitDisplay)
+    {
+	if (numDrawn_ == 0 && !displayDirty_)
+	{
+	    return;
+	}
+
+	for (int i = 0; i < numDrawn_; ++i)
+	{
+	    const int index = drawn_[i];
+	    dirty_[index] = false;
+	    front_[index] = back_[index];
+	    emitLed(index, front_[index]);
+	}
+	numDrawn_ = 0;
+
+	if (displayDirty_)
+	{
+	    displayDirty_ = false;
+	    frontDisplay_ = backDisplay_;
+	    emitDisplay(frontDisplay_);
+	}
+	++numFrames_;
+    }
+
+    int64 getNumFrames() const          { return numFrames_; }
+
+private:
+    Led back_[maxLeds];
+    Led front_[maxLeds];
+    bool dirty_[maxLeds] = {};
+    uint8 drawn_[maxLeds];
+    int numDrawn_ = 0;
+
+    int backDisplay_ = -1;
+    int frontDisplay_ = -1;
+    bool displayDirty_ = false;
+
+    int64 numFrames_ = 0;
+};
@@ -0,0 +1,160 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "LoopStore.h"
+
+//==============================================================================
+// A blink pattern compiled to 32 steps spread over a number of beats, bit n
+// set when the LED is lit on step n. The four LedStates are patterns too, so
+// the blink engine treats every LED the same way.
+struct LedPattern
+{
+    static const int numSteps = 32;
+    static const int maxBeats = 8;
+
+    uint32 steps_ = 0;
+    int beats_ = 1;
+
+    bool isSteady() const               { return steps_ == 0 || steps_ == 0xffffffffu; }
+
+    bool isLit(int step) const          { return ((steps_ >> step) & 1) != 0; }
+
+    static LedPattern forLedState(LedStates state)
+    {
+	LedPattern pattern;
+	switch (state)
+	{
+	    case Light:         pattern.steps_ = 0xffffffffu; break;
+	    case Blink:         pattern.steps_ = 0x0000ffffu; break;   // the first half of the beat
+	    case FastBlink:     pattern.steps_ = 0x00ff00ffu; break;   // the first half of each half
+	    default:            break;
+	}
+	return pattern;
+    }
+
+    // dark, light, blink or fast, or the steps as text: x, X, #, * or 1 lit
+    // and anything else dark, stretched to 32 steps, so "x.x....." is a
+    // double blink each beat
+    static bool compile(const String& text, int beats, LedPattern& pattern)
+    {
+	if (beats < 1 || beats > maxBeats || text.isEmpty() || text.length() > numSteps)
+	{
+	    return false;
+	}
+
+	pattern.beats_ = beats;
+	const String name = text.toLowerCase();
+	if (name == "dark" || name == "light" || name == "blink" || name == "fast")
+	{
+	    pattern.steps_ = forLedState(name == "dark" ? Dark : name == "light" ? Light : name == "blink" ? Blink : FastBlink).steps_;
+	    return true;
+	}
+
+	pattern.steps_ = 0;
+	const int length = text.length();
+	for (int step = 0; step < numSteps; ++step)
+	{
+	    const juce_wchar c = text[step * length / numSteps];
+	    if (c == 'x' || c == 'X' || c == '#' || c == '*' || c == '1')
+	    {
+		pattern.steps_ |= (uint32) 1 << step;
+	    }
+	}
+	return true;
+    }
+};
+
+//==============================================================================
+// Which pattern each loop state's LED blinks with. Ids 0-3 are the LedStates'
+// own, a loop state given its own pattern gets one of the ids after them.
+// Loop states without one keep what the LED table says.
+class LedPatternSet
+{
+public:
+    static const int numStates = Paused - Unknown + 1;
+    static const int numPatterns = FastBlink + 1 + numStates;
+
+    LedPatternSet()
+    {
+	for (int i = 0; i < numPatterns; ++i)
+	{
+	    patterns_[i] = LedPattern::forLedState(i <= FastBlink ? (LedStates) i : Dark);
+	}
+    }
+
+    // the pattern id for an LED in state, showing a loop in loopState
+    int choose(LedStates state, LoopStates loopState) const
+    {
+	const int id = idForState(loopState);
+	return id >= 0 && custom_[id] ? id : (int) state;
+    }
+
+    void set(LoopStates loopState, const LedPattern& pattern)
+    {
+	const int id = idForState(loopState);
+	patterns_[id] = pattern;
+	custom_[id] = true;
+    }
+
+    void clear(LoopStates loopState)
+    {
+	custom_[idForState(loopState)] = false;
+    }
+
+    const LedPattern& get(int id) const         { return patterns_[id]; }
+
+    static int idForState(LoopStates loopState)
+    {
+	return loopState >= Unknown && loopState <= Paused ? FastBlink + 1 + (loopState - Unknown) : -1;
+    }
+
+    // SooperLooper's name for it, lower case
+    static const char* getStateName(LoopStates loopState)
+    {
+	static const char* const names[] = { "unknown", "off", "waitstart", "recording", "waitstop", "playing",
+					     "overdubbing", "multiplying", "inserting", "replacing", "delay",
+					     "muted", "scratching", "oneshot", "substitute", "paused" };
+	return loopState >= Unknown && loopState <= Paused ? names[loopState - Unknown] : names[0];
+    }
+
+    // SooperLooper's state names, lower case, or a state number
+    static bool parseState(const String& text, LoopStates& loopState)
+    {
+	for (int i = 0; i < numStates; ++i)
+	{
+	    if (text.equalsIgnoreCase(getStateName((LoopStates) (i + Unknown))))
+	    {
+		loopState = (LoopStates) (i + Unknown);
+		return true;
+	    }
+	}
+	if (text.containsOnly("-0123456789") && text.getIntValue() >= Unknown && text.getIntValue() <= Paused)
+	{
+	    loopState = (LoopStates) text.getIntValue();
+	    return true;
+	}
+	return false;
+    }
+
+private:
+    LedPattern patterns_[numPatterns];
+    bool custom_[numPatterns] = {};
+};
@@ -0,0 +1,121 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "LedOutput.h"
+#include "LedPluginApi.h"
+
+//==============================================================================
+// An LED driver loaded into the process (see LedPluginApi.h) in place of the
+// loop4r_leds pipe: each batch the writer thread emits goes to the plugin's
+// frame() as one call, no process hop, pipe or parse. Loaded before it's set
+// as the LED output's sink and unloaded after the output has stopped.
+class LedPluginSink : public LedCommandSink
+{
+public:
+    static const int maxFrame = 512;
+
+    LedPluginSink() {}
+
+    ~LedPluginSink()
+    {
+	unload();
+    }
+
+    bool load(const String& path, const String& args)
+    {
+	unload();
+	if (!library_.open(path))
+	{
+	    std::cerr << "Couldn't load LED plugin " << path << std::endl;
+	    return false;
+	}
+	const auto entry = (loop4r_led_plugin_entry_function) library_.getFunction("loop4r_led_plugin_entry");
+	const loop4r_led_plugin* plugin = entry != nullptr ? entry() : nullptr;
+	if (plugin == nullptr || plugin->api_version != LOOP4R_LED_PLUGIN_API_VERSION
+	    || plugin->open == nullptr || plugin->frame == nullptr)
+	{
+	    std::cerr << "LED plugin " << path << " has no loop4r_led_plugin_entry for API version "
+		      << LOOP4R_LED_PLUGIN_API_VERSION << std::endl;
+	    library_.close();
+	    return false;
+	}
+	handle_ = plugin->open(args.toRawUTF8());
+	if (handle_ == nullptr)
+	{
+	    std::cerr << "LED plugin " << path << " couldn't open \"" << args << "\"" << std::endl;
+	    library_.close();
+	    return false;
+	}
+	plugin_ = plugin;
+	return true;
+    }
+
+    void unload()
+    {
+	if (plugin_ != nullptr)
+	{
+	    if (plugin_->close != nullptr)
+	    {
+		plugin_->close(handle_);
+	    }
+	    plugin_ = nullptr;
+	    handle_ = nullptr;
+	    library_.close();
+	}
+    }
+
+    bool isLoaded() const               { return plugin_ != nullptr; }
+    int64 getNumFrames() const          { return numFrames_; }
+
+    void send(int cc, int value) override
+    {
+	if (numCommands_ == maxFrame)
+	{
+	    flush();
+	}
+	loop4r_led_command& command = frame_[numCommands_++];
+	const bool led = cc == 106 || cc == 107;
+	command.opcode = led ? 0x81 : 0x82;
+	command.index = (unsigned char) (led ? value : cc);
+	command.state = (unsigned char) (led ? (cc == 106 ? 1 : 0) : value);
+	command.timer = 0;
+    }
+
+    void flush() override
+    {
+	if (plugin_ != nullptr && numCommands_ > 0)
+	{
+	    plugin_->frame(handle_, frame_, numCommands_);
+	    ++numFrames_;
+	}
+	numCommands_ = 0;
+    }
+
+private:
+    DynamicLibrary library_;
+    const loop4r_led_plugin* plugin_ = nullptr;
+    void* handle_ = nullptr;
+    loop4r_led_command frame_[maxFrame];
+    int numCommands_ = 0;
+    int64 numFrames_ = 0;      // writer thread
+
+    JUCE_DECLARE_NON_COPYABLE(LedPluginSink)
+};
@@ -0,0 +1,63 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+/*
+    The ABI for in-process LED drivers, loaded with "lplug". A plugin is a
+    shared object built against this header alone (plain C, no JUCE),
+    exporting
+
+        extern "C" const struct loop4r_led_plugin* loop4r_led_plugin_entry(void);
+
+    open() gets the arguments given after the path and returns the driver's
+    handle, or null if it can't drive its LEDs. frame() is then called on the
+    LED writer thread with each batch, the changes from one event or a whole
+    board after a backlog, as the same records the binary pipe framing uses:
+    opcode 0x81 LED index on/off, 0x82 controller number value (the display).
+    It should not block for long, the next batch waits for it. close() comes
+    last, on shutdown.
+*/
+
+#define LOOP4R_LED_PLUGIN_API_VERSION 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct loop4r_led_command
+{
+    unsigned char opcode;
+    unsigned char index;
+    unsigned char state;
+    unsigned char timer;
+};
+
+struct loop4r_led_plugin
+{
+    int api_version;    /* LOOP4R_LED_PLUGIN_API_VERSION */
+    void* (*open)(const char* args);
+    void (*frame)(void* handle, const struct loop4r_led_command* commands, int count);
+    void (*close)(void* handle);
+};
+
+typedef const struct loop4r_led_plugin* (*loop4r_led_plugin_entry_function)(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,205 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include <atomic>
+#include <climits>
+#include <cstring>
+
+#if JUCE_LINUX
+ #include <fcntl.h>
+ #include <linux/futex.h>
+ #include <sys/mman.h>
+ #include <sys/syscall.h>
+ #include <unistd.h>
+#endif
+
+//==============================================================================
+// The LED, display and loop state published in a POSIX shared memory segment
+// (shm_open name, "/loop4r_leds" by default) for processes on the same box,
+// which can then read it at any time without a syscall or a pipe to parse.
+//
+// The segment is a Segment below, in native byte order. Writes are guarded by
+// a seqlock: sequence_ is odd while the control thread is writing, so a reader
+// copies what it needs between two even, equal reads of it and retries
+// otherwise. changes_ goes up once per batch of changes; a reader that wants
+// to sleep until the next one increments waiters_, does FUTEX_WAIT on changes_
+// with the value it last saw and decrements waiters_ again. The writer only
+// makes the FUTEX_WAKE syscall when someone is waiting.
+//
+// Only the control thread writes; open() and close() before it runs or after
+// it has stopped.
+class LedSharedState
+{
+public:
+    static const int maxEntries = 128;
+    static const uint32 version = 1;
+
+    struct Segment
+    {
+	char magic_[8];                             // "L4RLEDS"
+	uint32 version_;
+	std::atomic<uint32> sequence_;              // seqlock, odd while writing
+	std::atomic<uint32> changes_;               // futex word, bumped per batch
+	std::atomic<uint32> waiters_;
+	int32 numLeds_;
+	int32 numLoops_;
+	int32 selectedLoop_;
+	int32 reserved_;
+	uint8 ledOn_[maxEntries];
+	uint8 ledTimer_[maxEntries];
+	uint8 ledMode_[maxEntries];                 // LedStates
+	int8 loopState_[maxEntries];                // LoopStates
+    };
+
+    LedSharedState() {}
+
+    ~LedSharedState()
+    {
+	close();
+    }
+
+#if JUCE_LINUX
+    bool open(const String& name)
+    {
+	close();
+	const int fd = ::shm_open(name.toRawUTF8(), O_CREAT | O_RDWR, 0644);
+	if (fd < 0)
+	{
+	    return false;
+	}
+	void* segment = MAP_FAILED;
+	if (::ftruncate(fd, sizeof(Segment)) == 0)
+	{
+	    segment = ::mmap(nullptr, sizeof(Segment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	}
+	::close(fd);
+	if (segment == MAP_FAILED)
+	{
+	    ::shm_unlink(name.toRawUTF8());
+	    return false;
+	}
+
+	segment_ = static_cast<Segment*>(segment);
+	name_ = name;
+	beginWrite();
+	std::memcpy(segment_->magic_, "L4RLEDS", 8);
+	segment_->version_ = version;
+	segment_->numLeds_ = 0;
+	segment_->numLoops_ = 0;
+	segment_->selectedLoop_ = -1;
+	segment_->reserved_ = 0;
+	std::memset(segment_->ledOn_, 0, sizeof(segment_->ledOn_));
+	std::memset(segment_->ledTimer_, 0, sizeof(segment_->ledTimer_));
+	std::memset(segment_->ledMode_, 0, sizeof(segment_->ledMode_));
+	std::memset(segment_->loopState_, -1, sizeof(segment_->loopState_));
+	endWrite();
+	return true;
+    }
+
+    void close()
+    {
+	if (segment_ != nullptr)
+	{
+	    ::munmap(segment_, sizeof(Segment));
+	    ::shm_unlink(name_.toRawUTF8());
+	    segment_ = nullptr;
+	}
+    }
+
+    // wakes the readers if anything changed since the last call
+    void publish()
+    {
+	if (segment_ == nullptr || !changed_)
+	{
+	    return;
+	}
+	changed_ = false;
+	segment_->changes_.fetch_add(1, std::memory_order_release);
+	if (segment_->waiters_.load(std::memory_order_acquire) > 0)
+	{
+	    ::syscall(SYS_futex, reinterpret_cast<uint32*>(&segment_->changes_), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+	}
+    }
+#else
+    bool open(const String&)        { return false; }
+    void close()                    {}
+    void publish()                  {}
+#endif
+
+    bool isOpen() const             { return segment_ != nullptr; }
+
+    void setLed(int index, bool on, int timer, int mode, int numLeds)
+    {
+	if (segment_ == nullptr || index < 0 || index >= maxEntries)
+	{
+	    return;
+	}
+	beginWrite();
+	segment_->ledOn_[index] = on ? 1 : 0;
+	segment_->ledTimer_[index] = (uint8) timer;
+	segment_->ledMode_[index] = (uint8) mode;
+	segment_->numLeds_ = numLeds;
+	endWrite();
+    }
+
+    void setSelectedLoop(int loop)
+    {
+	if (segment_ == nullptr)
+	{
+	    return;
+	}
+	beginWrite();
+	segment_->selectedLoop_ = loop;
+	endWrite();
+    }
+
+    void setLoopState(int loop, int state, int numLoops)
+    {
+	if (segment_ == nullptr || loop < 0 || loop >= maxEntries)
+	{
+	    return;
+	}
+	beginWrite();
+	segment_->loopState_[loop] = (int8) state;
+	segment_->numLoops_ = numLoops;
+	endWrite();
+    }
+
+private:
+    void beginWrite()
+    {
+	segment_->sequence_.store(segment_->sequence_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    void endWrite()
+    {
+	segment_->sequence_.store(segment_->sequence_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	changed_ = true;
+    }
+
+    Segment* segment_ = nullptr;
+    String name_;
+    bool changed_ = false;
+
+    JUCE_DECLARE_NON_COPYABLE(LedSharedState)
+};
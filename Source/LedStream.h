@@ -0,0 +1,380 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "OscPacket.h"
+#include <atomic>
+#include <string>
+
+#if JUCE_LINUX
+ #include <cerrno>
+ #include <fcntl.h>
+ #include <netinet/in.h>
+ #include <poll.h>
+ #include <sys/socket.h>
+ #include <unistd.h>
+#endif
+
+//==============================================================================
+// OSC 1.1 over a stream: each packet between END bytes, with END and ESC in
+// the packet escaped.
+struct SlipEncoder
+{
+    static const uint8 end = 0xc0;
+    static const uint8 esc = 0xdb;
+    static const uint8 escEnd = 0xdc;
+    static const uint8 escEsc = 0xdd;
+
+    static void append(std::string& out, const char* data, int size)
+    {
+	out += (char) end;
+	for (int i = 0; i < size; ++i)
+	{
+	    const uint8 byte = (uint8) data[i];
+	    if (byte == end || byte == esc)
+	    {
+		out += (char) esc;
+		out += (char) (byte == end ? escEnd : escEsc);
+	    }
+	    else
+	    {
+		out += (char) byte;
+	    }
+	}
+	out += (char) end;
+    }
+};
+
+//==============================================================================
+// The LEDs and display as SLIP framed /led and /display messages (the same
+// ones the UDP subscribers get) to TCP clients, for stage WiFi where a lost
+// datagram would leave a tablet showing the wrong state until the next
+// change. A client gets every LED when it connects, then the changes.
+//
+// The control thread only stores the latest state and marks it dirty for
+// every client; our thread turns what's dirty into messages whenever a
+// client has taken everything it was sent. A slow client so gets the latest
+// state of each LED that changed meanwhile rather than every step, each
+// client holds at most one snapshot's worth, and none of it ever waits on a
+// socket.
+class LedStreamServer : private Thread
+{
+public:
+    static const int maxLeds = 128;
+    static const int maxClients = 8;
+
+    LedStreamServer() : Thread("loop4r led stream") {}
+
+    ~LedStreamServer()
+    {
+	stop();
+    }
+
+#if JUCE_LINUX
+    bool start(int port)
+    {
+	stop();
+	listen_ = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	const int reuse = 1;
+	sockaddr_in address = {};
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_ANY);
+	address.sin_port = htons((uint16) port);
+	if (listen_ < 0 || ::setsockopt(listen_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) != 0
+	    || ::bind(listen_, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0
+	    || ::listen(listen_, maxClients) != 0 || ::pipe2(wakePipe_, O_NONBLOCK | O_CLOEXEC) != 0)
+	{
+	    stop();
+	    return false;
+	}
+	port_ = port;
+	startThread();
+	return true;
+    }
+
+    void stop()
+    {
+	if (isThreadRunning())
+	{
+	    signalThreadShouldExit();
+	    wake();
+	    stopThread(1000);
+	}
+	for (auto&& client : clients_)
+	{
+	    closeClient(client);
+	}
+	for (auto* fd : { &listen_, &wakePipe_[0], &wakePipe_[1] })
+	{
+	    if (*fd >= 0)
+	    {
+		::close(*fd);
+		*fd = -1;
+	    }
+	}
+	port_ = -1;
+    }
+#else
+    bool start(int)                     { return false; }
+    void stop()                         {}
+#endif
+
+    bool isRunning() const              { return port_ >= 0; }
+    int getPort() const                 { return port_; }
+    int getNumClients() const           { return numClients_.load(); }
+    int64 getNumSent() const            { return numSent_.load(); }
+
+    // control thread: the latest state, sent with the next commit()
+    void setLed(int index, bool on, int timer, int state, int version)
+    {
+	if (index < 0 || index >= maxLeds)
+	{
+	    return;
+	}
+	leds_[index].store(ledSet | (on ? 1u : 0u) | ((uint64) (uint8) timer << 1) | ((uint64) (uint8) state << 9)
+			   | ((uint64) (uint32) version << 32), std::memory_order_relaxed);
+	for (auto&& client : clients_)
+	{
+	    if (client.active_.load(std::memory_order_relaxed))
+	    {
+		client.dirty_[index >> 6].fetch_or((uint64) 1 << (index & 63), std::memory_order_release);
+	    }
+	}
+	marked_ = true;
+    }
+
+    void setDisplay(int value, int version)
+    {
+	display_.store(ledSet | (uint32) value | ((uint64) (uint32) version << 32), std::memory_order_relaxed);
+	for (auto&& client : clients_)
+	{
+	    if (client.active_.load(std::memory_order_relaxed))
+	    {
+		client.displayDirty_.store(true, std::memory_order_release);
+	    }
+	}
+	marked_ = true;
+    }
+
+    // control thread, after a commit: one wake up for everything it changed
+    void commit()
+    {
+	if (marked_)
+	{
+	    marked_ = false;
+	    if (!wakePending_.exchange(true))
+	    {
+		wake();
+	    }
+	}
+    }
+
+private:
+    static const uint64 ledSet = (uint64) 1 << 31;
+
+    struct Client
+    {
+	int fd_ = -1;
+	std::atomic<bool> active_ { false };
+	std::atomic<uint64> dirty_[maxLeds / 64] {};
+	std::atomic<bool> displayDirty_ { false };
+	std::string out_;                   // our thread only: what the socket hasn't taken yet
+    };
+
+    void wake()
+    {
+#if JUCE_LINUX
+	const char byte = 0;
+	(void) ::write(wakePipe_[1], &byte, 1);
+#endif
+    }
+
+#if JUCE_LINUX
+    void closeClient(Client& client)
+    {
+	if (client.fd_ >= 0)
+	{
+	    client.active_ = false;
+	    ::close(client.fd_);
+	    client.fd_ = -1;
+	    client.out_.clear();
+	    --numClients_;
+	}
+    }
+
+    void accept()
+    {
+	const int fd = ::accept4(listen_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+	if (fd < 0)
+	{
+	    return;
+	}
+	for (auto&& client : clients_)
+	{
+	    if (client.fd_ < 0)
+	    {
+		// everything, for a start
+		client.fd_ = fd;
+		client.active_ = true;
+		for (auto&& word : client.dirty_)
+		{
+		    word = ~(uint64) 0;
+		}
+		client.displayDirty_ = true;
+		++numClients_;
+		return;
+	    }
+	}
+	::close(fd);
+    }
+
+    // what's dirty for the client, as SLIP frames to send
+    void collect(Client& client)
+    {
+	static constexpr auto ledMessage = makeOscMessage<OscInt32, OscInt32, OscInt32, OscInt32, OscInt32>("/led");
+	static constexpr auto displayMessage = makeOscMessage<OscInt32, OscInt32>("/display");
+	OscPacket packet;
+	for (int word = 0; word < maxLeds / 64; ++word)
+	{
+	    uint64 dirty = client.dirty_[word].exchange(0, std::memory_order_acquire);
+	    for (int bit = 0; dirty != 0; ++bit, dirty >>= 1)
+	    {
+		const uint64 led = leds_[word * 64 + bit].load(std::memory_order_relaxed);
+		if ((dirty & 1) == 0 || (led & ledSet) == 0)
+		{
+		    continue;
+		}
+		packet.size_ = ledMessage.write(packet.data_, word * 64 + bit, (int) (led & 1), (int) ((led >> 1) & 0xff),
+						(int) ((led >> 9) & 0xff), (int) (uint32) (led >> 32));
+		SlipEncoder::append(client.out_, packet.data_, packet.size_);
+		++numSent_;
+	    }
+	}
+	const bool displayDirty = client.displayDirty_.exchange(false, std::memory_order_acquire);
+	const uint64 display = display_.load(std::memory_order_relaxed);
+	if (displayDirty && (display & ledSet) != 0)
+	{
+	    packet.size_ = displayMessage.write(packet.data_, (int) (display & 0x7fffffff), (int) (uint32) (display >> 32));
+	    SlipEncoder::append(client.out_, packet.data_, packet.size_);
+	    ++numSent_;
+	}
+    }
+
+    void write(Client& client)
+    {
+	const ssize_t written = ::send(client.fd_, client.out_.data(), client.out_.size(), MSG_NOSIGNAL);
+	if (written > 0)
+	{
+	    client.out_.erase(0, (size_t) written);
+	}
+	else if (written < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+	{
+	    closeClient(client);
+	}
+    }
+
+    void run() override
+    {
+	while (!threadShouldExit())
+	{
+	    pollfd fds[2 + maxClients];
+	    fds[0] = { wakePipe_[0], POLLIN, 0 };
+	    fds[1] = { listen_, POLLIN, 0 };
+	    for (int i = 0; i < maxClients; ++i)
+	    {
+		const Client& client = clients_[i];
+		fds[2 + i] = { client.fd_, (short) (POLLIN | (client.out_.empty() ? 0 : POLLOUT)), 0 };
+	    }
+	    if (::poll(fds, 2 + maxClients, -1) < 0 && errno != EINTR)
+	    {
+		break;
+	    }
+
+	    if (fds[0].revents != 0)
+	    {
+		char bytes[64];
+		while (::read(wakePipe_[0], bytes, sizeof(bytes)) > 0)
+		{
+		}
+		// cleared before looking, so a change made while we do wakes us again
+		wakePending_ = false;
+	    }
+	    if (fds[1].revents != 0)
+	    {
+		accept();
+	    }
+	    for (int i = 0; i < maxClients; ++i)
+	    {
+		Client& client = clients_[i];
+		if (client.fd_ < 0 || fds[2 + i].fd != client.fd_)
+		{
+		    continue;
+		}
+		if ((fds[2 + i].revents & POLLIN) != 0)
+		{
+		    // nothing's expected from them, it's only read to see them go
+		    char bytes[256];
+		    const ssize_t size = ::recv(client.fd_, bytes, sizeof(bytes), 0);
+		    if (size == 0 || (size < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+		    {
+			closeClient(client);
+			continue;
+		    }
+		}
+		if ((fds[2 + i].revents & (POLLERR | POLLHUP)) != 0)
+		{
+		    closeClient(client);
+		    continue;
+		}
+	    }
+	    for (auto&& client : clients_)
+	    {
+		if (client.fd_ < 0)
+		{
+		    continue;
+		}
+		if (client.out_.empty())
+		{
+		    collect(client);
+		}
+		if (!client.out_.empty())
+		{
+		    write(client);
+		}
+	    }
+	}
+    }
+
+    int listen_ = -1;
+    int wakePipe_[2] = { -1, -1 };
+#endif
+
+    int port_ = -1;
+    Client clients_[maxClients];
+    std::atomic<uint64> leds_[maxLeds] {};
+    std::atomic<uint64> display_ { 0 };
+    std::atomic<bool> wakePending_ { false };
+    std::atomic<int> numClients_ { 0 };
+    std::atomic<int64> numSent_ { 0 };
+    bool marked_ = false;               // control thread only
+
+    JUCE_DECLARE_NON_COPYABLE(LedStreamServer)
+};
@@ -0,0 +1,470 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "LocalOscSocket.h"
+#include "OscPacket.h"
+#include <cerrno>
+#include <cstring>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+//==============================================================================
+// The clients that asked for LED and display updates with
+// /loop4r/register_auto_update. Each change is encoded once by the caller and
+// the same buffer goes to every subscriber from one socket, with the
+// addresses resolved when they subscribe rather than on every send.
+// Subscribers that gave a lease drop out unless they register again within it,
+// the others stay until they unregister. Clients on the local socket are
+// sent to from it and dropped as soon as their own socket goes away.
+//
+// A subscriber can ask for less than everything: the kinds of update it
+// wants and the LEDs it shows, loop n's being LED n. Each send says what it
+// carries and goes only to those whose filter shares a bit with it.
+// Control thread only.
+class LedSubscribers
+{
+public:
+    static const int maxSubscribers = 16;
+
+    enum Updates
+    {
+	LedUpdates = 1,         // /led, and /leds frames
+	DisplayUpdates = 2,     // /display, and /leds frames that change it
+	TunerUpdates = 4,       // /tuner
+	AllUpdates = LedUpdates | DisplayUpdates | TunerUpdates
+    };
+
+    // the last bit stands for LED 31 and every LED past it
+    static uint32 ledBit(int index)     { return 1u << jlimit(0, 31, index); }
+
+    struct Filter
+    {
+	int updates_ = AllUpdates;
+	uint32 leds_ = 0xffffffff;      // for LedUpdates
+    };
+
+    LedSubscribers() {}
+
+    // adds or refreshes a subscriber, leaseMs 0 never expires
+    bool subscribe(const String& host, int port, int leaseMs, const Filter& filter)
+    {
+	const uint32 now = Time::getMillisecondCounter();
+	for (auto&& subscriber : subscribers_)
+	{
+	    if (!subscriber.local_ && subscriber.port_ == port && subscriber.host_ == host)
+	    {
+		subscriber.lastSeen_ = now;
+		subscriber.leaseMs_ = leaseMs;
+		subscriber.filter_ = filter;
+		return true;
+	    }
+	}
+
+	if (subscribers_.size() >= maxSubscribers || !openSocket())
+	{
+	    return false;
+	}
+
+	Subscriber subscriber;
+	if (!resolve(host, port, subscriber.address_, subscriber.addressSize_))
+	{
+	    return false;
+	}
+	subscriber.host_ = host;
+	subscriber.port_ = port;
+	subscriber.lastSeen_ = now;
+	subscriber.leaseMs_ = leaseMs;
+	subscriber.filter_ = filter;
+	subscribers_.add(subscriber);
+	return true;
+    }
+
+    // a client of the local socket, known by its address
+    bool subscribeLocal(const LocalPeer& peer, int leaseMs, const Filter& filter)
+    {
+	const String name = peer.getName();
+	for (auto&& subscriber : subscribers_)
+	{
+	    if (subscriber.local_ && subscriber.host_ == name)
+	    {
+		subscriber.lastSeen_ = Time::getMillisecondCounter();
+		subscriber.leaseMs_ = leaseMs;
+		subscriber.filter_ = filter;
+		return true;
+	    }
+	}
+	if (subscribers_.size() >= maxSubscribers || localFd_ < 0 || !peer.canReply())
+	{
+	    return false;
+	}
+
+	Subscriber subscriber;
+	std::memcpy(&subscriber.address_, &peer.address_, (size_t) peer.addressSize_);
+	subscriber.addressSize_ = peer.addressSize_;
+	subscriber.host_ = name;
+	subscriber.local_ = true;
+	subscriber.lastSeen_ = Time::getMillisecondCounter();
+	subscriber.leaseMs_ = leaseMs;
+	subscriber.filter_ = filter;
+	subscribers_.add(subscriber);
+	std::cerr << "LED updates to local client " << name << " (pid " << peer.pid_ << ")" << std::endl;
+	return true;
+    }
+
+    void unsubscribeLocal(const LocalPeer& peer)
+    {
+	const String name = peer.getName();
+	for (int i = subscribers_.size(); --i >= 0;)
+	{
+	    if (subscribers_.getReference(i).local_ && subscribers_.getReference(i).host_ == name)
+	    {
+		subscribers_.remove(i);
+	    }
+	}
+    }
+
+    // the local socket's descriptor, -1 when it's closed drops its clients
+    void setLocalSocket(int fd)
+    {
+	localFd_ = fd;
+	if (fd < 0)
+	{
+	    for (int i = subscribers_.size(); --i >= 0;)
+	    {
+		if (subscribers_.getReference(i).local_)
+		{
+		    subscribers_.remove(i);
+		}
+	    }
+	}
+    }
+
+    void unsubscribe(const String& host, int port)
+    {
+	for (int i = subscribers_.size(); --i >= 0;)
+	{
+	    const Subscriber& subscriber = subscribers_.getReference(i);
+	    if (!subscriber.local_ && subscriber.port_ == port && subscriber.host_ == host)
+	    {
+		subscribers_.remove(i);
+	    }
+	}
+    }
+
+    void expire()
+    {
+	const uint32 now = Time::getMillisecondCounter();
+	for (int i = subscribers_.size(); --i >= 0;)
+	{
+	    const Subscriber& subscriber = subscribers_.getReference(i);
+	    if (subscriber.leaseMs_ > 0 && (int) (now - subscriber.lastSeen_) > subscriber.leaseMs_)
+	    {
+		std::cerr << "LED subscriber " << subscriber.host_;
+		if (!subscriber.local_)
+		{
+		    std::cerr << ":" << subscriber.port_;
+		}
+		std::cerr << " expired" << std::endl;
+		subscribers_.remove(i);
+	    }
+	}
+    }
+
+    bool isEmpty() const        { return subscribers_.isEmpty(); }
+    int size() const            { return subscribers_.size(); }
+
+    // what's sent is counted there per address as OscOut
+    void setMetrics(Metrics* metrics)   { metrics_ = metrics; }
+
+    // updates is what the packet carries, leds the LEDs of its LedUpdates
+    void send(const OscPacket& packet, int updates, uint32 leds = 0xffffffff)
+    {
+	send(packet.data_, packet.size_, updates, leds);
+    }
+
+    void send(const char* data, int size, int updates, uint32 leds = 0xffffffff)
+    {
+	const int fd = socket_ != nullptr ? socket_->getRawSocketHandle() : -1;
+	if ((fd < 0 && localFd_ < 0) || size <= 0)
+	{
+	    return;
+	}
+	int numSent = 0;
+	for (int i = subscribers_.size(); --i >= 0;)
+	{
+	    const Subscriber& subscriber = subscribers_.getReference(i);
+	    const int wanted = subscriber.filter_.updates_ & updates;
+	    if ((wanted & ~LedUpdates) == 0 && ((wanted & LedUpdates) == 0 || (subscriber.filter_.leds_ & leds) == 0))
+	    {
+		++numFiltered_;
+		continue;
+	    }
+	    ++numSent;
+	    if (subscriber.local_)
+	    {
+		if (::sendto(localFd_, data, (size_t) size, MSG_DONTWAIT | MSG_NOSIGNAL,
+			     reinterpret_cast<const sockaddr*>(&subscriber.address_), subscriber.addressSize_) < 0
+		    && (errno == ECONNREFUSED || errno == ENOENT))
+		{
+		    std::cerr << "LED subscriber " << subscriber.host_ << " went away" << std::endl;
+		    subscribers_.remove(i);
+		}
+	    }
+	    else if (fd >= 0)
+	    {
+		::sendto(fd, data, (size_t) size, 0,
+			 reinterpret_cast<const sockaddr*>(&subscriber.address_), subscriber.addressSize_);
+	    }
+	}
+	++numPackets_;
+	numDatagrams_ += numSent;
+	if (metrics_ != nullptr)
+	{
+	    metrics_->countOscPacket(Metrics::OscOut, data, size);
+	}
+    }
+
+    int64 getNumPackets() const     { return numPackets_; }
+    int64 getNumDatagrams() const   { return numDatagrams_; }
+    int64 getNumFiltered() const    { return numFiltered_; }    // datagrams a filter saved
+
+    // the IPv4 address to sendto() host:port at
+    static bool resolve(const String& host, int port, sockaddr_storage& address, socklen_t& addressSize)
+    {
+	addrinfo hints;
+	std::memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_DGRAM;
+
+	addrinfo* info = nullptr;
+	if (::getaddrinfo(host.toRawUTF8(), String(port).toRawUTF8(), &hints, &info) != 0 || info == nullptr)
+	{
+	    return false;
+	}
+	std::memcpy(&address, info->ai_addr, info->ai_addrlen);
+	addressSize = (socklen_t) info->ai_addrlen;
+	::freeaddrinfo(info);
+	return true;
+    }
+
+private:
+    struct Subscriber
+    {
+	String host_;
+	int port_ = 0;
+	uint32 lastSeen_ = 0;
+	int leaseMs_ = 0;
+	bool local_ = false;            // host_ is then the local socket address's name
+	Filter filter_;
+	sockaddr_storage address_;
+	socklen_t addressSize_ = 0;
+    };
+
+    bool openSocket()
+    {
+	if (socket_ == nullptr)
+	{
+	    socket_ = new DatagramSocket(false);
+	    if (!socket_->bindToPort(0))
+	    {
+		socket_ = nullptr;
+		return false;
+	    }
+	}
+	return true;
+    }
+
+    ScopedPointer<DatagramSocket> socket_;     // only used for its descriptor
+    Array<Subscriber> subscribers_;
+    int localFd_ = -1;
+    int64 numPackets_ = 0;
+    int64 numDatagrams_ = 0;
+    int64 numFiltered_ = 0;
+    Metrics* metrics_ = nullptr;
+
+    JUCE_DECLARE_NON_COPYABLE(LedSubscribers)
+};
+
+//==============================================================================
+// The same /led and /display packets sent once to a multicast group, for
+// rooms full of displays where a send per subscriber would grow with the
+// class. Every change bumps the version they carry by one, so a receiver
+// that sees one skipped asks /loop4r/changes on our OSC port for what it
+// missed; /loop4r/version goes out every second so the last change of a
+// burst can't be lost unnoticed. Control thread only.
+class LedMulticast
+{
+public:
+    LedMulticast() {}
+
+    ~LedMulticast()
+    {
+	close();
+    }
+
+    // group has to be a multicast address, ttl 1 keeps it on the local network
+    bool open(const String& group, int port, int ttl)
+    {
+	close();
+	sockaddr_storage address;
+	socklen_t addressSize = 0;
+	if (!LedSubscribers::resolve(group, port, address, addressSize)
+	    || !IN_MULTICAST(ntohl(reinterpret_cast<const sockaddr_in&>(address).sin_addr.s_addr)))
+	{
+	    return false;
+	}
+
+	fd_ = ::socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+	const unsigned char hops = (unsigned char) jlimit(1, 255, ttl);
+	const unsigned char loop = 1;       // displays on this host see it too
+	if (fd_ < 0 || ::setsockopt(fd_, IPPROTO_IP, IP_MULTICAST_TTL, &hops, sizeof(hops)) != 0
+	    || ::setsockopt(fd_, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop)) != 0
+	    || ::connect(fd_, reinterpret_cast<const sockaddr*>(&address), addressSize) != 0)
+	{
+	    close();
+	    return false;
+	}
+	group_ = group;
+	port_ = port;
+	return true;
+    }
+
+    void close()
+    {
+	if (fd_ >= 0)
+	{
+	    ::close(fd_);
+	    fd_ = -1;
+	}
+	port_ = -1;
+    }
+
+    bool isOpen() const                 { return fd_ >= 0; }
+    const String& getGroup() const      { return group_; }
+    int getPort() const                 { return port_; }
+    int64 getNumPackets() const         { return numPackets_; }
+
+    void send(const OscPacket& packet)
+    {
+	send(packet.data_, packet.size_);
+    }
+
+    void send(const char* data, int size)
+    {
+	if (fd_ >= 0 && size > 0 && ::send(fd_, data, (size_t) size, MSG_DONTWAIT) == size)
+	{
+	    ++numPackets_;
+	}
+    }
+
+    void sendVersion(int version)
+    {
+	static constexpr auto versionMessage = makeOscMessage<OscInt32>("/loop4r/version");
+	OscPacket packet;
+	packet.size_ = versionMessage.write(packet.data_, version);
+	send(packet);
+    }
+
+private:
+    int fd_ = -1;
+    String group_;
+    int port_ = -1;
+    int64 numPackets_ = 0;
+
+    JUCE_DECLARE_NON_COPYABLE(LedMulticast)
+};
+
+//==============================================================================
+// With "ledframes" everything one commit changed goes to the subscribers
+// and the multicast group as a single message rather than a /led per LED
+// and a /display:
+//
+//     /leds ,iii(iiii)...  frame version display  (index on timer state)...
+//
+// frame counts the frames sent, so a gap is a lost datagram; version is the
+// one the last change in it took, the frame covering one per LED plus one
+// for the display; display is the selected loop, -1 if it didn't change.
+// A frame is applied whole or not at all. A board's worth of LEDs doesn't
+// fit an OscPacket, so it's written into a buffer of its own.
+class LedFrameWriter
+{
+public:
+    static const int maxLeds = 128;
+
+    LedFrameWriter() {}
+
+    void clear()
+    {
+	numLeds_ = 0;
+	display_ = -1;
+	ledMask_ = 0;
+    }
+
+    bool isEmpty() const        { return numLeds_ == 0 && display_ < 0; }
+
+    void addLed(int index, bool on, int timer, int state)
+    {
+	if (numLeds_ < maxLeds)
+	{
+	    leds_[numLeds_++] = { index, on ? 1 : 0, timer, state };
+	    ledMask_ |= LedSubscribers::ledBit(index);
+	}
+    }
+
+    // what a subscriber's filter has to share with the frame, see LedSubscribers
+    int getUpdates() const      { return (numLeds_ > 0 ? LedSubscribers::LedUpdates : 0) | (display_ >= 0 ? LedSubscribers::DisplayUpdates : 0); }
+    uint32 getLedMask() const   { return ledMask_; }
+
+    void setDisplay(int value)  { display_ = value; }
+
+    // the message, in getData() until the next write
+    int write(int frame, int version)
+    {
+	char typeTags[3 + 4 * maxLeds + 1];
+	std::memset(typeTags, 'i', (size_t) (3 + 4 * numLeds_));
+	typeTags[3 + 4 * numLeds_] = 0;
+	OscMessageWriter message(data_, (int) sizeof(data_));
+	message.begin("/leds", typeTags).addInt32(frame).addInt32(version).addInt32(display_);
+	for (int i = 0; i < numLeds_; ++i)
+	{
+	    message.addInt32(leds_[i].index_).addInt32(leds_[i].on_).addInt32(leds_[i].timer_).addInt32(leds_[i].state_);
+	}
+	return message.size();
+    }
+
+    const char* getData() const { return data_; }
+
+private:
+    struct Led
+    {
+	int index_, on_, timer_, state_;
+    };
+
+    Led leds_[maxLeds];
+    int numLeds_ = 0;
+    int display_ = -1;
+    uint32 ledMask_ = 0;
+    char data_[8 + 4 * maxLeds + 8 + 4 * (3 + 4 * maxLeds)];
+
+    JUCE_DECLARE_NON_COPYABLE(LedFrameWriter)
+};
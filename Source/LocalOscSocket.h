@@ -0,0 +1,327 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "LockFreeQueue.h"
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <functional>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#if JUCE_LINUX
+ #include <cerrno>
+ #include <fcntl.h>
+ #include <poll.h>
+ #include <unistd.h>
+#endif
+
+//==============================================================================
+// Who sent a datagram to the local socket: the address to answer at, and the
+// process the kernel says it came from.
+struct LocalPeer
+{
+    sockaddr_un address_;
+    socklen_t addressSize_ = 0;
+    int pid_ = 0;
+    int uid_ = -1;
+
+    // a client that never bound its socket can send to us but not be answered
+    bool canReply() const
+    {
+	return addressSize_ > (socklen_t) offsetof(sockaddr_un, sun_path);
+    }
+
+    // the path, or "@name" for an abstract address
+    String getName() const
+    {
+	if (!canReply())
+	{
+	    return "(unbound)";
+	}
+	const char* path = address_.sun_path;
+	const size_t length = (size_t) addressSize_ - offsetof(sockaddr_un, sun_path);
+	if (path[0] == 0)
+	{
+	    return "@" + String::fromUTF8(path + 1, (int) length - 1);
+	}
+	return String::fromUTF8(path, (int) strnlen(path, length));
+    }
+};
+
+//==============================================================================
+// The /loop4r protocol on a Unix datagram socket, for the clients on this
+// host (loop4r_leds, a display) that would otherwise go through the UDP stack
+// over loopback. A client binds a socket of its own, to a path or an abstract
+// name the kernel picks, and sends the same OSC packets here; its auto
+// updates come back to that address, so it needs no port. The kernel passes
+// the sender's credentials with every datagram, and only our own user and
+// root are listened to.
+//
+// With the reactor its descriptor is watched and read() called as it's
+// ready. Otherwise startReading() has a thread of ours wait on it and queue
+// what arrives, for the control thread to drain().
+class LocalOscSocket : private Thread
+{
+public:
+    static const int maxDatagramSize = 1024;
+    static const int queueSize = 64;
+
+    struct Datagram
+    {
+	char data_[maxDatagramSize];
+	int size_ = 0;
+	LocalPeer from_;
+    };
+
+    LocalOscSocket() : Thread("loop4r local osc"), queue_(queueSize) {}
+
+    ~LocalOscSocket()
+    {
+	close();
+    }
+
+#if JUCE_LINUX
+    // replaces whatever socket is left at path from an earlier run
+    bool open(const String& path)
+    {
+	close();
+	sockaddr_un address = {};
+	address.sun_family = AF_UNIX;
+	if (path.getNumBytesAsUTF8() >= sizeof(address.sun_path))
+	{
+	    return false;
+	}
+	std::strcpy(address.sun_path, path.toRawUTF8());
+
+	fd_ = ::socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	::unlink(address.sun_path);
+	const int on = 1;
+	if (fd_ < 0 || ::bind(fd_, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0
+	    || ::setsockopt(fd_, SOL_SOCKET, SO_PASSCRED, &on, sizeof(on)) != 0)
+	{
+	    close();
+	    return false;
+	}
+	path_ = path;
+	return true;
+    }
+
+    void close()
+    {
+	stopReading();
+	if (fd_ >= 0)
+	{
+	    ::close(fd_);
+	    fd_ = -1;
+	}
+	if (path_.isNotEmpty())
+	{
+	    ::unlink(path_.toRawUTF8());
+	    path_ = String();
+	}
+    }
+
+    // onQueued is called on our thread after each batch it queues
+    bool startReading(std::function<void()> onQueued)
+    {
+	if (fd_ < 0 || isThreadRunning() || ::pipe2(wakePipe_, O_NONBLOCK | O_CLOEXEC) != 0)
+	{
+	    return false;
+	}
+	onQueued_ = std::move(onQueued);
+	startThread();
+	return true;
+    }
+
+    void stopReading()
+    {
+	if (isThreadRunning())
+	{
+	    signalThreadShouldExit();
+	    const char byte = 0;
+	    (void) ::write(wakePipe_[1], &byte, 1);
+	    stopThread(1000);
+	}
+	for (auto* fd : { &wakePipe_[0], &wakePipe_[1] })
+	{
+	    if (*fd >= 0)
+	    {
+		::close(*fd);
+		*fd = -1;
+	    }
+	}
+    }
+
+    // calls onDatagram(const char* data, int size, const LocalPeer& from) for
+    // everything waiting, on the caller's thread
+    template <typename Function>
+    void read(Function onDatagram)
+    {
+	while (receive(datagram_))
+	{
+	    onDatagram(datagram_.data_, datagram_.size_, datagram_.from_);
+	}
+    }
+
+    // false once the client's socket is gone, a full one just loses the packet
+    bool send(const LocalPeer& to, const char* data, int size)
+    {
+	if (fd_ < 0 || !to.canReply())
+	{
+	    return false;
+	}
+	if (::sendto(fd_, data, (size_t) size, MSG_DONTWAIT | MSG_NOSIGNAL,
+		     reinterpret_cast<const sockaddr*>(&to.address_), to.addressSize_) < 0)
+	{
+	    return errno != ECONNREFUSED && errno != ENOENT && errno != ENOTCONN;
+	}
+	return true;
+    }
+#else
+    bool open(const String&)                    { return false; }
+    void close()                                {}
+    bool startReading(std::function<void()>)    { return false; }
+    void stopReading()                          {}
+    template <typename Function> void read(Function) {}
+    bool send(const LocalPeer&, const char*, int)   { return false; }
+#endif
+
+    // what the thread queued, on the control thread
+    template <typename Function>
+    void drain(Function onDatagram)
+    {
+	while (queue_.pop(datagram_))
+	{
+	    onDatagram(datagram_.data_, datagram_.size_, datagram_.from_);
+	}
+    }
+
+    bool isOpen() const                 { return fd_ >= 0; }
+    const String& getPath() const       { return path_; }
+    int getFileDescriptor() const       { return fd_; }
+    int64 getNumReceived() const        { return numReceived_.load(); }
+    int64 getNumRejected() const        { return numRejected_.load(); }
+    int64 getNumDropped() const         { return numDropped_.load(); }
+
+private:
+#if JUCE_LINUX
+    // the next datagram from a sender we accept, false when there's none
+    bool receive(Datagram& datagram)
+    {
+	for (;;)
+	{
+	    iovec iov = { datagram.data_, sizeof(datagram.data_) };
+	    union
+	    {
+		char buffer[CMSG_SPACE(sizeof(ucred))];
+		cmsghdr align;
+	    } control;
+	    msghdr header = {};
+	    header.msg_name = &datagram.from_.address_;
+	    header.msg_namelen = sizeof(datagram.from_.address_);
+	    header.msg_iov = &iov;
+	    header.msg_iovlen = 1;
+	    header.msg_control = control.buffer;
+	    header.msg_controllen = sizeof(control.buffer);
+
+	    const ssize_t size = fd_ < 0 ? -1 : ::recvmsg(fd_, &header, MSG_DONTWAIT);
+	    if (size < 0)
+	    {
+		return false;
+	    }
+
+	    datagram.size_ = (int) size;
+	    datagram.from_.addressSize_ = header.msg_namelen;
+	    datagram.from_.uid_ = -1;
+	    for (cmsghdr* message = CMSG_FIRSTHDR(&header); message != nullptr; message = CMSG_NXTHDR(&header, message))
+	    {
+		if (message->cmsg_level == SOL_SOCKET && message->cmsg_type == SCM_CREDENTIALS)
+		{
+		    ucred credentials;
+		    std::memcpy(&credentials, CMSG_DATA(message), sizeof(credentials));
+		    datagram.from_.pid_ = (int) credentials.pid;
+		    datagram.from_.uid_ = (int) credentials.uid;
+		}
+	    }
+
+	    if ((header.msg_flags & MSG_TRUNC) != 0
+		|| (datagram.from_.uid_ != (int) ::geteuid() && datagram.from_.uid_ != 0))
+	    {
+		++numRejected_;
+		continue;
+	    }
+	    ++numReceived_;
+	    return true;
+	}
+    }
+
+    void run() override
+    {
+	Datagram datagram;
+	while (!threadShouldExit())
+	{
+	    pollfd fds[2] = { { wakePipe_[0], POLLIN, 0 }, { fd_, POLLIN, 0 } };
+	    if (::poll(fds, 2, -1) < 0 && errno != EINTR)
+	    {
+		break;
+	    }
+	    if (fds[1].revents == 0)
+	    {
+		continue;
+	    }
+
+	    bool queued = false;
+	    while (receive(datagram))
+	    {
+		if (queue_.push(datagram))
+		{
+		    queued = true;
+		}
+		else
+		{
+		    ++numDropped_;
+		}
+	    }
+	    if (queued && onQueued_)
+	    {
+		onQueued_();
+	    }
+	}
+    }
+
+    int wakePipe_[2] = { -1, -1 };
+#else
+    bool receive(Datagram&)             { return false; }
+#endif
+
+    int fd_ = -1;
+    String path_;
+    SpscQueue<Datagram> queue_;
+    Datagram datagram_;                 // the reader's, read() or drain()
+    std::function<void()> onQueued_;
+    std::atomic<int64> numReceived_ { 0 };
+    std::atomic<int64> numRejected_ { 0 };
+    std::atomic<int64> numDropped_ { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE(LocalOscSocket)
+};
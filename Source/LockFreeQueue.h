@@ -0,0 +1,102 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "CacheLine.h"
+#include <atomic>
+
+//==============================================================================
+// Fixed capacity single-producer/single-consumer queue. All slots are
+// allocated up front, push and pop never lock or allocate (beyond whatever
+// the element's own assignment operator does). pop() moves the element out,
+// so a queued OSCMessage is copied once, going in, and not again coming out.
+//
+// Each side's index is on a cache line of its own, with the copy it keeps of
+// the other side's: the producer only looks at the consumer's index again
+// when its copy says the queue is full, the consumer at the producer's when
+// its copy says it's empty. A busy queue then costs a shared line once per
+// catch up rather than on every push and pop.
+template <typename ElementType>
+class SpscQueue
+{
+public:
+    SpscQueue(int capacity, const ElementType& prototype = ElementType())
+	: numSlots_(capacity + 1)
+    {
+	slots_.insertMultiple(0, prototype, numSlots_);
+    }
+
+    bool push(const ElementType& element)
+    {
+	const int write = write_.load(std::memory_order_relaxed);
+	const int next = write + 1 == numSlots_ ? 0 : write + 1;
+	if (next == readSeen_)
+	{
+	    readSeen_ = read_.load(std::memory_order_acquire);
+	    if (next == readSeen_)
+	    {
+		return false;
+	    }
+	}
+
+	slots_.getReference(write) = element;
+	write_.store(next, std::memory_order_release);
+	return true;
+    }
+
+    bool pop(ElementType& element)
+    {
+	const int read = read_.load(std::memory_order_relaxed);
+	if (read == writeSeen_)
+	{
+	    writeSeen_ = write_.load(std::memory_order_acquire);
+	    if (read == writeSeen_)
+	    {
+		return false;
+	    }
+	}
+
+	element = std::move(slots_.getReference(read));
+	read_.store(read + 1 == numSlots_ ? 0 : read + 1, std::memory_order_release);
+	return true;
+    }
+
+    int size() const
+    {
+	const int used = write_.load(std::memory_order_acquire) - read_.load(std::memory_order_acquire);
+	return used < 0 ? used + numSlots_ : used;
+    }
+
+    bool isEmpty() const    { return size() == 0; }
+    int capacity() const    { return numSlots_ - 1; }
+
+private:
+    const int numSlots_;
+    Array<ElementType> slots_;
+    char padding0_[cacheLineSize];
+    std::atomic<int> write_ { 0 };      // the producer's
+    int readSeen_ = 0;
+    char padding1_[cacheLineSize];
+    std::atomic<int> read_ { 0 };       // the consumer's
+    int writeSeen_ = 0;
+    char padding2_[cacheLineSize];
+
+    JUCE_DECLARE_NON_COPYABLE(SpscQueue)
+};
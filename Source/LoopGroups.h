@@ -0,0 +1,160 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "LoopStore.h"
+#include "MidiInputFilter.h"
+#include "OscPacket.h"
+#include "PedalGestures.h"
+#include <cstdio>
+
+//==============================================================================
+// Named sets of loops ("group" in a program file) and the pedals that send a
+// SooperLooper command to every loop of one at once ("gpedal"). A pedal's
+// messages, one /sl/L/hit per loop, are encoded when it's given its group
+// and again when the group changes, so a press only copies them into the one
+// bundle that takes them to the engine together. A group of "all" is
+// SooperLooper's own every loop, loop -1, in a single message. Only the
+// control thread uses this.
+class LoopGroups
+{
+public:
+    static const int maxGroups = 16;
+    static const int allLoops = -1;
+
+    LoopGroups() {}
+
+    // loops is a comma separated list of loops from 0 with ranges like 0-2,
+    // or "all"; replaces a group of the same name, and what its pedals send
+    bool define(const String& name, const String& loops, String& error)
+    {
+	Group group;
+	group.name_ = name;
+	if (loops.equalsIgnoreCase("all"))
+	{
+	    group.loops_.add(allLoops);
+	}
+	else if (!MidiInputFilter::parseNumbers(loops, 0, LoopStore::maxLoops - 1, [&] (int loop) { group.loops_.addIfNotAlreadyThere(loop); })
+		 || group.loops_.isEmpty())
+	{
+	    error = "expected loops like 0,2 or 0-3, or all";
+	    return false;
+	}
+
+	const int existing = find(name);
+	if (existing < 0 && groups_.size() == maxGroups)
+	{
+	    error = "more than " + String(maxGroups) + " groups";
+	    return false;
+	}
+	if (existing >= 0)
+	{
+	    groups_.getReference(existing) = group;
+	}
+	else
+	{
+	    groups_.add(group);
+	}
+
+	const int index = existing >= 0 ? existing : groups_.size() - 1;
+	for (auto&& pedal : pedals_)
+	{
+	    if (pedal.group_ == index)
+	    {
+		encode(pedal);
+	    }
+	}
+	return true;
+    }
+
+    int find(const String& name) const
+    {
+	for (int i = 0; i < groups_.size(); ++i)
+	{
+	    if (groups_.getReference(i).name_.equalsIgnoreCase(name))
+	    {
+		return i;
+	    }
+	}
+	return -1;
+    }
+
+    // pedal key (see PedalGestures::getKey) sends command to the group's
+    // loops, group -1 frees the pedal again
+    void bind(int key, int group, const String& command)
+    {
+	Pedal& pedal = pedals_[key];
+	numPedals_ += (group >= 0) - (pedal.group_ >= 0);
+	pedal.group_ = group;
+	pedal.command_ = command;
+	encode(pedal);
+    }
+
+    bool hasPedals() const              { return numPedals_ > 0; }
+
+    // nullptr for a pedal without a group
+    const Array<OscPacket>* getMessages(int key) const
+    {
+	const Pedal& pedal = pedals_[key];
+	return pedal.group_ >= 0 ? &pedal.messages_ : nullptr;
+    }
+
+    int getNumGroups() const            { return groups_.size(); }
+
+private:
+    struct Group
+    {
+	String name_;
+	Array<int> loops_;
+    };
+
+    struct Pedal
+    {
+	int group_ = -1;
+	String command_;
+	Array<OscPacket> messages_;
+    };
+
+    void encode(Pedal& pedal)
+    {
+	pedal.messages_.clearQuick();
+	if (pedal.group_ < 0)
+	{
+	    return;
+	}
+	for (int loop : groups_.getReference(pedal.group_).loops_)
+	{
+	    char address[32];
+	    std::snprintf(address, sizeof(address), "/sl/%d/hit", loop);
+	    OscPacket packet;
+	    packet.size_ = OscMessageWriter(packet).begin(address, "s").addString(pedal.command_.toRawUTF8()).size();
+	    if (packet.isValid())
+	    {
+		pedal.messages_.add(packet);
+	    }
+	}
+    }
+
+    Array<Group> groups_;
+    Pedal pedals_[PedalGestures::maxPedals];
+    int numPedals_ = 0;
+
+    JUCE_DECLARE_NON_COPYABLE(LoopGroups)
+};
@@ -0,0 +1,143 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "LoopStore.h"
+
+// timers
+static const int TIMER_OFF = 0;
+static const int TIMER_FASTBLINK = 1;
+static const int TIMER_BLINK = 3;
+
+// the pedal LEDs that show the multiply, insert, replace and substitute states
+enum AuxLed
+{
+    NoAux = -1,
+    AuxMultiply,
+    AuxInsert,
+    AuxReplace,
+    AuxSubstitute
+};
+
+struct LoopLedAction
+{
+    LedStates mode_;
+    uint8 timer_;
+    bool loopOn_;
+    int8 auxOn_;        // AuxLed to light, NoAux for none
+    int8 auxOff_;       // AuxLed to put out, the old state's if it had one
+};
+
+//==============================================================================
+// What the LEDs do when a loop goes from one state to another, in play mode
+// (0) or record mode (1). Only these constexpr functions know SooperLooper's
+// states, LoopLedTable turns them into a flat table at compile time so a
+// transition is a single indexed load. States we don't know about share one
+// slot and get a dark LED, whatever their number.
+namespace LoopLeds
+{
+    static const int numStates = Paused - Unknown + 2;     // the last one is for anything else
+    static const int numModes = 2;
+
+    constexpr int slotForState(int state)
+    {
+	return (state >= Unknown && state <= Paused) ? state - Unknown : numStates - 1;
+    }
+
+    constexpr LoopStates stateForSlot(int slot)
+    {
+	return slot < numStates - 1 ? (LoopStates) (slot + Unknown) : (LoopStates) (Paused + 1);
+    }
+
+    constexpr LoopLedAction ledForState(LoopStates state, int mode)
+    {
+	switch (state)
+	{
+	    case Unknown:
+	    case Off:
+		return { Dark, TIMER_OFF, false, NoAux, NoAux };
+	    case WaitStart:
+	    case WaitStop:
+		return { FastBlink, TIMER_FASTBLINK, true, NoAux, NoAux };
+	    case Recording:
+	    case Overdubbing:
+	    case Delay:
+	    case Scratching:
+	    case OneShot:
+		return { Light, TIMER_OFF, true, NoAux, NoAux };
+	    case Inserting:
+		return { FastBlink, TIMER_FASTBLINK, true, AuxInsert, NoAux };
+	    case Replacing:
+		return { FastBlink, TIMER_FASTBLINK, true, AuxReplace, NoAux };
+	    case Substitute:
+		return { FastBlink, TIMER_FASTBLINK, true, AuxSubstitute, NoAux };
+	    case Multiplying:
+		return { FastBlink, TIMER_FASTBLINK, true, AuxMultiply, NoAux };
+	    case Playing:
+		return mode == 0 ? LoopLedAction { Light, TIMER_OFF, true, NoAux, NoAux }
+				 : LoopLedAction { Blink, TIMER_BLINK, true, NoAux, NoAux };
+	    case Muted:
+	    case Paused:
+		return { Blink, TIMER_BLINK, true, NoAux, NoAux };
+	    default:
+		return { Dark, TIMER_OFF, false, NoAux, NoAux };
+	}
+    }
+
+    constexpr LoopLedAction transition(LoopStates from, LoopStates to, int mode)
+    {
+	return { ledForState(to, mode).mode_, ledForState(to, mode).timer_, ledForState(to, mode).loopOn_,
+		 ledForState(to, mode).auxOn_,
+		 slotForState(from) == slotForState(to) ? (int8) NoAux : ledForState(from, mode).auxOn_ };
+    }
+}
+
+struct LoopLedTable
+{
+    constexpr LoopLedTable() : actions_()
+    {
+	for (int from = 0; from < LoopLeds::numStates; ++from)
+	{
+	    for (int to = 0; to < LoopLeds::numStates; ++to)
+	    {
+		for (int mode = 0; mode < LoopLeds::numModes; ++mode)
+		{
+		    actions_[from][to][mode] = LoopLeds::transition(LoopLeds::stateForSlot(from), LoopLeds::stateForSlot(to), mode);
+		}
+	    }
+	}
+    }
+
+    // mode is 0 in play mode, anything else is record mode
+    constexpr const LoopLedAction& get(int from, int to, int mode) const
+    {
+	return actions_[LoopLeds::slotForState(from)][LoopLeds::slotForState(to)][mode != 0 ? 1 : 0];
+    }
+
+    LoopLedAction actions_[LoopLeds::numStates][LoopLeds::numStates][LoopLeds::numModes];
+};
+
+// built at compile time
+inline const LoopLedTable& loopLedTable()
+{
+    static constexpr LoopLedTable table {};
+    return table;
+}
@@ -0,0 +1,105 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include <cmath>
+
+//==============================================================================
+// How far through the selected loop we are, for showing on the display or a
+// ring of LEDs. SooperLooper's loop_pos only comes every so often, so the
+// position is carried on from the last one by the clock and put right by
+// each new one. It's rendered as a step out of however many the display
+// has; a step back by one is taken for network jitter and not shown, so the
+// display only ever moves forward until the loop comes round. Control thread
+// only.
+class LoopProgress
+{
+public:
+    // a new loop (or none): nothing to show until SooperLooper says
+    void reset()
+    {
+	length_ = 0;
+	synced_ = false;
+	shown_ = -1;
+    }
+
+    void setLength(double seconds)
+    {
+	length_ = seconds > 0 ? seconds : 0;
+    }
+
+    // the loop position in seconds as of ticks
+    void sync(double position, int64 ticks)
+    {
+	position_ = position;
+	syncTicks_ = ticks;
+	synced_ = true;
+    }
+
+    // 0..1 through the loop, or -1 if we don't know; it only moves on while
+    // the loop runs
+    double getFraction(int64 ticks, bool running) const
+    {
+	if (!synced_ || length_ <= 0)
+	{
+	    return -1;
+	}
+	const double elapsed = running ? Time::highResolutionTicksToSeconds(ticks - syncTicks_) : 0;
+	const double cycles = (position_ + jmax(0.0, elapsed)) / length_;
+	return cycles - std::floor(cycles);
+    }
+
+    // the step, 0..steps-1, to show, -1 if we don't know
+    int render(int64 ticks, bool running, int steps)
+    {
+	const double fraction = getFraction(ticks, running);
+	if (fraction < 0 || steps <= 0)
+	{
+	    shown_ = -1;
+	    return -1;
+	}
+
+	const int step = jlimit(0, steps - 1, (int) (fraction * steps));
+	if (!(shown_ >= 0 && step == shown_ - 1))
+	{
+	    shown_ = step;
+	}
+	return shown_;
+    }
+
+    // until the next step is due; -1 if it won't move by itself
+    int getMsUntilNextStep(int64 ticks, bool running, int steps) const
+    {
+	const double fraction = getFraction(ticks, running);
+	if (fraction < 0 || !running || steps <= 0)
+	{
+	    return -1;
+	}
+	const double next = (std::floor(fraction * steps) + 1) / steps;
+	return (int) std::ceil((next - fraction) * length_ * 1000.0);
+    }
+
+private:
+    double length_ = 0;
+    double position_ = 0;
+    int64 syncTicks_ = 0;
+    bool synced_ = false;
+    int shown_ = -1;
+};
@@ -0,0 +1,86 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "LoopStore.h"
+#include <atomic>
+
+//==============================================================================
+// How long each loop has shown each state and how often one state went to
+// another, as the board drew them: a loop that sits in WaitStart or WaitStop
+// is waiting on sync, Overdubbing back to Playing soon after is likely an
+// undo. Fed by the control thread on every state it draws, which costs a
+// compare when nothing changed and a couple of relaxed adds when it did;
+// read from anywhere while it's being fed. The arrays are fixed, nothing is
+// allocated. Switching engines draws the other engine's loops, which counts
+// as transitions like any other.
+class LoopStateStats
+{
+public:
+    static const int numStates = Paused - Unknown + 1;
+
+    LoopStateStats()
+    {
+	for (auto&& state : lastState_)
+	{
+	    state = Unknown;
+	}
+    }
+
+    // control thread only, now in milliseconds
+    void record(int loop, LoopStates newState, uint32 now)
+    {
+	if (!isPositiveAndBelow(loop, LoopStore::maxLoops) || newState == lastState_[loop])
+	{
+	    return;
+	}
+	const int from = lastState_[loop] - Unknown;
+	const int to = newState - Unknown;
+	if (entered_[loop] != 0)
+	{
+	    dwellMs_[loop][from].fetch_add(now - entered_[loop], std::memory_order_relaxed);
+	}
+	transitions_[from][to].fetch_add(1, std::memory_order_relaxed);
+	lastState_[loop] = newState;
+	entered_[loop] = jmax(now, 1u);    // 0 is never entered
+    }
+
+    // what's over so far, the time in the state a loop is in now is added
+    // when it leaves it
+    int64 getDwellMs(int loop, LoopStates state) const
+    {
+	return (int64) dwellMs_[loop][state - Unknown].load(std::memory_order_relaxed);
+    }
+
+    int64 getNumTransitions(LoopStates from, LoopStates to) const
+    {
+	return (int64) transitions_[from - Unknown][to - Unknown].load(std::memory_order_relaxed);
+    }
+
+private:
+    // the control thread's own
+    LoopStates lastState_[LoopStore::maxLoops];
+    uint32 entered_[LoopStore::maxLoops] = {};
+
+    std::atomic<uint64> dwellMs_[LoopStore::maxLoops][numStates] = {};
+    std::atomic<uint64> transitions_[numStates][numStates] = {};
+
+    JUCE_DECLARE_NON_COPYABLE(LoopStateStats)
+};
@@ -0,0 +1,768 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+enum LoopStates
+{
+    Unknown = -1,
+    Off = 0,
+    WaitStart,
+    Recording,
+    WaitStop,
+    Playing,
+    Overdubbing,
+    Multiplying,
+    Inserting,
+    Replacing,
+    Delay,
+    Muted,
+    Scratching,
+    OneShot,
+    Substitute,
+    Paused
+};
+
+enum LedStates
+{
+    Dark,
+    Light,
+    Blink,
+    FastBlink
+};
+
+//==============================================================================
+// State of one SooperLooper engine's loops: the loop state and the LED mode and
+// timer that goes with it, as parallel fixed arrays indexed by SooperLooper's
+// loop number. It never reallocates, so nothing handed out can go stale, and
+// every accessor checks the index against the size the engine last reported:
+// reads outside it give Unknown/Dark, writes are ignored.
+class LoopStore
+{
+public:
+    static const int maxLoops = 128;
+
+    LoopStore()
+    {
+	reset(0);
+    }
+
+    // forget everything and start over with numLoops loops, all Off; returns the
+    // number kept, which is less than asked for past maxLoops
+    int reset(int numLoops)
+    {
+	size_ = 0;
+	return resize(numLoops);
+    }
+
+    // grows or shrinks to numLoops, loops that are new come in Off
+    int resize(int numLoops)
+    {
+	const int newSize = jlimit(0, (int) maxLoops, numLoops);
+	for (int i = size_; i < newSize; ++i)
+	{
+	    state_[i] = Off;
+	    ledMode_[i] = Dark;
+	    ledTimer_[i] = 0;
+	}
+	size_ = newSize;
+	return size_;
+    }
+
+    int size() const                            { return size_; }
+    bool contains(int loop) const               { return loop >= 0 && loop < size_; }
+
+    LoopStates getState(int loop) const         { return contains(loop) ? state_[loop] : Unknown; }
+    LedStates getLedMode(int loop) const        { return contains(loop) ? ledMode_[loop] : Dark; }
+    int getLedTimer(int loop) const             { return contains(loop) ? ledTimer_[loop] : 0; }
+
+    bool setState(int loop, LoopStates state)
+    {
+	if (!contains(loop))
+	{
+	    return false;
+	}
+	state_[loop] = state;
+	return true;
+    }
+
+    void setLed(int loop, LedStates mode, int timer)
+    {
+	if (contains(loop))
+	{
+	    ledMode_[loop] = mode;
+	    ledTimer_[loop] = (uint8) timer;
+	}
+    }
+
+private:
+    int size_;
+    LoopStates state_[maxLoops];
+    LedStates ledMode_[maxLoops];
+    uint8 ledTimer_[maxLoops];
+
+    JUCE_DECLARE_NON_COPYABLE(LoopStore)
+};
+
+//==============================================================================
+// When to re-read each loop's state while SooperLooper only tells us about
+// changes. Every loop has its own interval (0 means never) and is due that
+// long after we last heard about it, so loops that report on their own are
+// left alone and a lost update costs at most one interval.
+class LoopPollSchedule
+{
+public:
+    LoopPollSchedule()
+    {
+	for (int i = 0; i < LoopStore::maxLoops; ++i)
+	{
+	    intervalMs_[i] = 0;
+	    dueAt_[i] = 0;
+	}
+    }
+
+    void setInterval(int loop, int intervalMs, uint32 now)
+    {
+	if (loop >= 0 && loop < LoopStore::maxLoops && intervalMs_[loop] != intervalMs)
+	{
+	    intervalMs_[loop] = intervalMs;
+	    dueAt_[loop] = now + (uint32) intervalMs;
+	}
+    }
+
+    void heard(int loop, uint32 now)
+    {
+	if (loop >= 0 && loop < LoopStore::maxLoops)
+	{
+	    dueAt_[loop] = now + (uint32) intervalMs_[loop];
+	}
+    }
+
+    // calls poll(loop) for the first numLoops loops that are due and reschedules them
+    template <typename Function>
+    void forEachDue(int numLoops, uint32 now, Function poll)
+    {
+	for (int i = 0; i < jmin(numLoops, (int) LoopStore::maxLoops); ++i)
+	{
+	    if (intervalMs_[i] > 0 && (int) (now - dueAt_[i]) >= 0)
+	    {
+		dueAt_[i] = now + (uint32) intervalMs_[i];
+		poll(i);
+	    }
+	}
+    }
+
+    // ms until forEachDue() would poll one of the first numLoops, -1 for never
+    int getMsUntilNext(int numLoops, uint32 now) const
+    {
+	int soonest = -1;
+	for (int i = 0; i < jmin(numLoops, (int) LoopStore::maxLoops); ++i)
+	{
+	    if (intervalMs_[i] > 0)
+	    {
+		const int wait = jmax(0, (int) (dueAt_[i] - now));
+		soonest = soonest < 0 ? wait : jmin(soonest, wait);
+	    }
+	}
+	return soonest;
+    }
+
+private:
+    int intervalMs_[LoopStore::maxLoops];
+    uint32 dueAt_[LoopStore::maxLoops];
+
+    JUCE_DECLARE_NON_COPYABLE(LoopPollSchedule)
+};
+
+//==============================================================================
+// Which loops SooperLooper should report on fast ("adaptive"): the ones in a
+// state that's on its way to another, and for holdMs the ones a pedal just
+// sent a command to, which is when the LED is being waited for. The rest keep
+// the usual registration. A switch costs a message or two, so going fast
+// happens at once but a loop only goes back to slow minSwitchMs after it went
+// fast, and forEachSwitch() makes at most maxSwitches a call; the others wait
+// for the next.
+class AdaptiveUpdates
+{
+public:
+    static const int minSwitchMs = 250;
+    static const int maxSwitches = 8;
+
+    AdaptiveUpdates()
+    {
+	reset();
+    }
+
+    // holdMs 0 turns it off
+    void configure(int holdMs)
+    {
+	holdMs_ = jmax(0, holdMs);
+	reset();
+    }
+
+    bool isEnabled() const      { return holdMs_ > 0; }
+
+    // every loop slow and nothing wanted, as after registering them all again
+    void reset()
+    {
+	for (int i = 0; i < LoopStore::maxLoops; ++i)
+	{
+	    transitional_[i] = false;
+	    fast_[i] = false;
+	    heldUntil_[i] = 0;
+	    switchedAt_[i] = 0;
+	}
+	pending_ = false;
+	hasNext_ = false;
+    }
+
+    // the states that end by themselves, usually at the end of a cycle
+    static bool isTransitional(LoopStates state)
+    {
+	return state == WaitStart || state == Recording || state == WaitStop
+	    || state == Multiplying || state == Inserting;
+    }
+
+    void reported(int loop, LoopStates state)
+    {
+	if (isEnabled() && isPositiveAndBelow(loop, (int) LoopStore::maxLoops) && transitional_[loop] != isTransitional(state))
+	{
+	    transitional_[loop] = !transitional_[loop];
+	    pending_ = true;
+	}
+    }
+
+    void targeted(int loop, uint32 now)
+    {
+	if (isEnabled() && isPositiveAndBelow(loop, (int) LoopStore::maxLoops))
+	{
+	    heldUntil_[loop] = now + (uint32) holdMs_;
+	    pending_ = true;
+	}
+    }
+
+    bool isFast(int loop) const
+    {
+	return isPositiveAndBelow(loop, (int) LoopStore::maxLoops) && fast_[loop];
+    }
+
+    // calls switchTo(loop, fast) for the first numLoops loops whose rate is to
+    // change now
+    template <typename Function>
+    void forEachSwitch(int numLoops, uint32 now, Function switchTo)
+    {
+	if (!pending_ && (!hasNext_ || (int) (now - nextAt_) < 0))
+	{
+	    return;
+	}
+	pending_ = false;
+	hasNext_ = false;
+	int numSwitched = 0;
+	for (int i = 0; i < jmin(numLoops, (int) LoopStore::maxLoops); ++i)
+	{
+	    const bool wanted = wants(i, now);
+	    if (wanted != fast_[i] && (wanted || (int) (now - switchedAt_[i]) >= minSwitchMs))
+	    {
+		if (numSwitched == maxSwitches)
+		{
+		    pending_ = true;
+		    continue;
+		}
+		fast_[i] = wanted;
+		switchedAt_[i] = now;
+		++numSwitches_;
+		++numSwitched;
+		switchTo(i, wanted);
+	    }
+	    // the next time this loop could want switching back
+	    if (fast_[i] && !transitional_[i])
+	    {
+		const uint32 due = (int) (heldUntil_[i] - (switchedAt_[i] + (uint32) minSwitchMs)) > 0
+		    ? heldUntil_[i] : switchedAt_[i] + (uint32) minSwitchMs;
+		if (!hasNext_ || (int) (due - nextAt_) < 0)
+		{
+		    nextAt_ = due;
+		    hasNext_ = true;
+		}
+	    }
+	}
+    }
+
+    // ms until forEachSwitch() has something to do, -1 for nothing
+    int getMsUntilNext(uint32 now) const
+    {
+	if (!isEnabled())
+	{
+	    return -1;
+	}
+	if (pending_)
+	{
+	    return 0;
+	}
+	return hasNext_ ? jmax(0, (int) (nextAt_ - now)) : -1;
+    }
+
+    int64 getNumSwitches() const        { return numSwitches_; }
+
+private:
+    bool wants(int loop, uint32 now) const
+    {
+	return transitional_[loop] || (int) (heldUntil_[loop] - now) > 0;
+    }
+
+    int holdMs_ = 0;
+    bool transitional_[LoopStore::maxLoops];
+    bool fast_[LoopStore::maxLoops];
+    uint32 heldUntil_[LoopStore::maxLoops];
+    uint32 switchedAt_[LoopStore::maxLoops];
+    bool pending_ = false;
+    bool hasNext_ = false;  // nextAt_ is when a fast loop's hold ends
+    uint32 nextAt_ = 0;
+    int64 numSwitches_ = 0;
+
+    JUCE_DECLARE_NON_COPYABLE(AdaptiveUpdates)
+};
+
+//==============================================================================
+// When to ask SooperLooper for every loop's state at once ("reconcile") and
+// hold the answers up against the store, to catch an update lost on the way.
+// Right after a sign of loss (a missed heartbeat, a reconnect, a loop found
+// wrong) that's every minMs; each round that finds nothing wrong doubles the
+// interval, up to maxMs.
+class StateReconciler
+{
+public:
+    StateReconciler() {}
+
+    // minMs 0 turns it off
+    void configure(int minMs, int maxMs)
+    {
+	minMs_ = jmax(0, minMs);
+	maxMs_ = jmax(minMs_, maxMs);
+	intervalMs_ = minMs_;
+	scheduled_ = false;
+    }
+
+    bool isEnabled() const      { return minMs_ > 0; }
+
+    // the next round within minMs, and the ones after it as often
+    void lost(uint32 now)
+    {
+	if (!isEnabled())
+	{
+	    return;
+	}
+	intervalMs_ = minMs_;
+	if (!scheduled_ || (int) (dueAt_ - (now + (uint32) minMs_)) > 0)
+	{
+	    dueAt_ = now + (uint32) minMs_;
+	    scheduled_ = true;
+	}
+    }
+
+    bool isDue(uint32 now) const
+    {
+	return isEnabled() && (!scheduled_ || (int) (now - dueAt_) >= 0);
+    }
+
+    // a round went out: how the last one went sets when the next goes
+    void sent(uint32 now)
+    {
+	if (numSent_ > 0)
+	{
+	    intervalMs_ = divergedInRound_ ? minMs_ : jmin(maxMs_, intervalMs_ * 2);
+	}
+	divergedInRound_ = false;
+	dueAt_ = now + (uint32) intervalMs_;
+	scheduled_ = true;
+	++numSent_;
+    }
+
+    // one loop's answer disagreed with the store
+    void diverged(uint32 now)
+    {
+	divergedInRound_ = true;
+	++numDiverged_;
+	lost(now);
+    }
+
+    // ms until isDue(), -1 for never
+    int getMsUntilNext(uint32 now) const
+    {
+	if (!isEnabled())
+	{
+	    return -1;
+	}
+	return scheduled_ ? jmax(0, (int) (dueAt_ - now)) : 0;
+    }
+
+    int getIntervalMs() const           { return intervalMs_; }
+    int64 getNumSent() const            { return numSent_; }
+    int64 getNumDiverged() const        { return numDiverged_; }
+
+private:
+    int minMs_ = 0;
+    int maxMs_ = 0;
+    int intervalMs_ = 0;
+    bool scheduled_ = false;
+    uint32 dueAt_ = 0;
+    bool divergedInRound_ = false;
+    int64 numSent_ = 0;
+    int64 numDiverged_ = 0;
+
+    JUCE_DECLARE_NON_COPYABLE(StateReconciler)
+};
+
+//==============================================================================
+// Guesses what SooperLooper will make of a loop pedal, so the LED can change
+// on the press rather than a /ctrl round trip later, then holds the guess up
+// against what SooperLooper reports. While a guess is pending, reports of the
+// state the loop was in before the press are taken to predate the note and
+// don't undo it; the guess ends when it's confirmed, contradicted or times
+// out, and then the reported (or the old) state wins.
+class LoopPredictor
+{
+public:
+    // what the loop pedals are bound to in play and record mode (see loop4r_read.slb)
+    enum Command
+    {
+	MuteTrigger,
+	RecordOrOverdub
+    };
+
+    static const int timeoutMs = 500;
+
+    LoopPredictor()
+    {
+	clear();
+    }
+
+    // SooperLooper's transition, Unknown where it depends on more than we know
+    static LoopStates next(LoopStates state, Command command)
+    {
+	switch (command)
+	{
+	    case MuteTrigger:
+		return state == Playing ? Muted : state == Muted ? Playing : Unknown;
+	    case RecordOrOverdub:
+		switch (state)
+		{
+		    case Off:           return Recording;
+		    case Recording:     return Playing;
+		    case Playing:       return Overdubbing;
+		    case Overdubbing:   return Playing;
+		    default:            return Unknown;
+		}
+	}
+	return Unknown;
+    }
+
+    // the state to show for the press, Unknown if we'd rather not guess
+    LoopStates pressed(int loop, LoopStates current, Command command, uint32 now)
+    {
+	const LoopStates predicted = next(current, command);
+	if (predicted == Unknown || loop < 0 || loop >= LoopStore::maxLoops)
+	{
+	    return Unknown;
+	}
+	if (predicted_[loop] == Unknown)
+	{
+	    previous_[loop] = current;
+	}
+	predicted_[loop] = predicted;
+	madeAt_[loop] = now;
+	++numPredictions_;
+	return predicted;
+    }
+
+    // SooperLooper reported state for loop, false if it's a stale report to ignore
+    bool reported(int loop, LoopStates state)
+    {
+	if (loop < 0 || loop >= LoopStore::maxLoops || predicted_[loop] == Unknown)
+	{
+	    return true;
+	}
+	if (state == previous_[loop] && state != predicted_[loop])
+	{
+	    return false;
+	}
+	if (state == predicted_[loop])
+	{
+	    ++numConfirmed_;
+	}
+	else
+	{
+	    ++numMispredicted_;
+	}
+	predicted_[loop] = Unknown;
+	return true;
+    }
+
+    // calls rollBack(loop, previousState) for the guesses nothing confirmed in time
+    template <typename Function>
+    void expire(uint32 now, Function rollBack)
+    {
+	for (int i = 0; i < LoopStore::maxLoops; ++i)
+	{
+	    if (predicted_[i] != Unknown && (int) (now - madeAt_[i]) >= timeoutMs)
+	    {
+		predicted_[i] = Unknown;
+		++numExpired_;
+		rollBack(i, previous_[i]);
+	    }
+	}
+    }
+
+    // ms until expire() has a guess to roll back, -1 for none pending
+    int getMsUntilNextExpiry(uint32 now) const
+    {
+	int soonest = -1;
+	for (int i = 0; i < LoopStore::maxLoops; ++i)
+	{
+	    if (predicted_[i] != Unknown)
+	    {
+		const int wait = jmax(0, timeoutMs - (int) (now - madeAt_[i]));
+		soonest = soonest < 0 ? wait : jmin(soonest, wait);
+	    }
+	}
+	return soonest;
+    }
+
+    void clear()
+    {
+	for (int i = 0; i < LoopStore::maxLoops; ++i)
+	{
+	    predicted_[i] = Unknown;
+	    previous_[i] = Unknown;
+	    madeAt_[i] = 0;
+	}
+    }
+
+    int64 getNumPredictions() const     { return numPredictions_; }
+    int64 getNumConfirmed() const       { return numConfirmed_; }
+    int64 getNumMispredicted() const    { return numMispredicted_; }
+    int64 getNumExpired() const         { return numExpired_; }
+
+private:
+    LoopStates predicted_[LoopStore::maxLoops];
+    LoopStates previous_[LoopStore::maxLoops];
+    uint32 madeAt_[LoopStore::maxLoops];
+
+    int64 numPredictions_ = 0;
+    int64 numConfirmed_ = 0;
+    int64 numMispredicted_ = 0;
+    int64 numExpired_ = 0;
+
+    JUCE_DECLARE_NON_COPYABLE(LoopPredictor)
+};
+
+//==============================================================================
+// Whether a loop pedal's command got through to SooperLooper ("deliver").
+// Once the note's gone the loop's state should move off the one the press
+// found it in within a window the caller works out from the round trip and
+// how often the loop is reported on. If it doesn't the state is asked for
+// straight away. If the answer has the loop moved on, the command took and
+// only its update was lost. If the loop is still where it was, the command
+// was lost and goes again. These commands toggle, so a resend is only safe
+// once we know the first one didn't take; a blind one could undo it. An
+// unanswered question is asked again rather than guessed at. Only presses
+// whose transition LoopPredictor knows are tracked, since a command that
+// wouldn't change the state can't be told from a lost one. Each loop has
+// one entry, a new press replaces what was pending, and after the given
+// number of questions and resends together the loop is given up on.
+class CommandDelivery
+{
+public:
+    enum Action
+    {
+	Query,          // ask for the loop's state
+	Resend          // the note again, and its release if it was released
+    };
+
+    CommandDelivery()
+    {
+	clear();
+    }
+
+    // maxAttempts 0 turns it off
+    void configure(int maxAttempts)
+    {
+	maxAttempts_ = jmax(0, maxAttempts);
+	clear();
+    }
+
+    bool isEnabled() const      { return maxAttempts_ > 0; }
+
+    void sent(int loop, int note, LoopStates before, uint32 now, int windowMs)
+    {
+	if (!isEnabled() || !isPositiveAndBelow(loop, (int) LoopStore::maxLoops))
+	{
+	    return;
+	}
+	Entry& entry = entries_[loop];
+	entry.phase_ = Awaiting;
+	entry.note_ = note;
+	entry.before_ = before;
+	entry.released_ = false;
+	entry.attempts_ = 0;
+	entry.resent_ = false;
+	entry.windowMs_ = windowMs;
+	entry.dueAt_ = now + (uint32) windowMs;
+	++numTracked_;
+    }
+
+    void released(int loop)
+    {
+	if (isPositiveAndBelow(loop, (int) LoopStore::maxLoops))
+	{
+	    entries_[loop].released_ = true;
+	}
+    }
+
+    // an update of loop's state, answer says it's the answer to our question;
+    // true if something is due now
+    bool reported(int loop, LoopStates state, bool answer, uint32 now)
+    {
+	if (!isPositiveAndBelow(loop, (int) LoopStore::maxLoops) || entries_[loop].phase_ == Idle)
+	{
+	    return false;
+	}
+	Entry& entry = entries_[loop];
+	if (state != entry.before_)
+	{
+	    if (entry.resent_)
+	    {
+		++numRecovered_;
+	    }
+	    else if (entry.phase_ == Querying)
+	    {
+		++numUpdatesLost_;
+	    }
+	    entry.phase_ = Idle;
+	    return false;
+	}
+	if (!answer || entry.phase_ != Querying)
+	{
+	    return false;
+	}
+	// still where the press found it, so the command never arrived
+	entry.phase_ = Lost;
+	entry.dueAt_ = now;
+	return true;
+    }
+
+    // calls act(loop, note, released, action) for what's due now
+    template <typename Function>
+    void process(uint32 now, Function act)
+    {
+	for (int i = 0; i < LoopStore::maxLoops; ++i)
+	{
+	    Entry& entry = entries_[i];
+	    if (entry.phase_ == Idle || (int) (now - entry.dueAt_) < 0)
+	    {
+		continue;
+	    }
+	    if (entry.attempts_ >= maxAttempts_)
+	    {
+		entry.phase_ = Idle;
+		++numGivenUp_;
+		continue;
+	    }
+	    ++entry.attempts_;
+	    entry.dueAt_ = now + (uint32) entry.windowMs_;
+	    if (entry.phase_ == Lost)
+	    {
+		entry.phase_ = Awaiting;
+		entry.resent_ = true;
+		++numRetransmits_;
+		act(i, entry.note_, entry.released_, Resend);
+	    }
+	    else
+	    {
+		entry.phase_ = Querying;
+		++numQueries_;
+		act(i, entry.note_, entry.released_, Query);
+	    }
+	}
+    }
+
+    // ms until process() has something to do, -1 for nothing pending
+    int getMsUntilNext(uint32 now) const
+    {
+	int soonest = -1;
+	for (auto& entry : entries_)
+	{
+	    if (entry.phase_ != Idle)
+	    {
+		const int wait = jmax(0, (int) (entry.dueAt_ - now));
+		soonest = soonest < 0 ? wait : jmin(soonest, wait);
+	    }
+	}
+	return soonest;
+    }
+
+    void clear()
+    {
+	for (auto& entry : entries_)
+	{
+	    entry.phase_ = Idle;
+	}
+    }
+
+    int64 getNumTracked() const         { return numTracked_; }
+    int64 getNumQueries() const         { return numQueries_; }
+    int64 getNumRetransmits() const     { return numRetransmits_; }
+    int64 getNumRecovered() const       { return numRecovered_; }
+    int64 getNumUpdatesLost() const     { return numUpdatesLost_; }
+    int64 getNumGivenUp() const         { return numGivenUp_; }
+
+private:
+    enum Phase
+    {
+	Idle,
+	Awaiting,       // the state change, until dueAt_
+	Querying,       // the answer to our question, until dueAt_
+	Lost            // the answer said it didn't take, resend at dueAt_
+    };
+
+    struct Entry
+    {
+	Phase phase_;
+	int note_;
+	LoopStates before_;
+	bool released_;
+	bool resent_;
+	int attempts_;
+	int windowMs_;
+	uint32 dueAt_;
+    };
+
+    int maxAttempts_ = 0;
+    Entry entries_[LoopStore::maxLoops];
+
+    int64 numTracked_ = 0;
+    int64 numQueries_ = 0;
+    int64 numRetransmits_ = 0;
+    int64 numRecovered_ = 0;
+    int64 numUpdatesLost_ = 0;
+    int64 numGivenUp_ = 0;
+
+    JUCE_DECLARE_NON_COPYABLE(CommandDelivery)
+};
@@ -0,0 +1,275 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "LatencyStats.h"
+#include "OscPacket.h"
+#include <functional>
+#include <ostream>
+
+#if JUCE_LINUX && JUCE_ALSA
+ #include <alsa/asoundlib.h>
+ #include <poll.h>
+#endif
+
+//==============================================================================
+// End to end latency from outside the process: a sequencer client of its
+// own plays the FCB1010 into our virtual input ("vin") and listens on our
+// virtual output ("vout"), and a UDP socket subscribes to the LED updates
+// with /loop4r/register_auto_update like any display would. Each loop pedal
+// press is timed until its note on comes back and until the first /led
+// datagram after it does, which takes in the ALSA hops, the input thread,
+// the control thread and the output stack. One press is outstanding at a
+// time, at the given rate, so the presses don't queue behind each other.
+class LoopbackLatency : private Thread
+{
+public:
+    static const int timeoutMs = 250;
+
+    LoopbackLatency() : Thread("loop4r loopback") {}
+
+    ~LoopbackLatency()
+    {
+	stop();
+    }
+
+    // called on the loopback thread once every press has been timed
+    std::function<void()> onFinished_;
+
+#if JUCE_LINUX && JUCE_ALSA
+    // inputName and outputName are our own virtual ports, oscPort the one
+    // we take OSC on. channel is 1-16.
+    bool start(const String& inputName, const String& outputName, int oscPort, int channel, int events, int rate)
+    {
+	stop();
+	if (snd_seq_open(&seq_, "default", SND_SEQ_OPEN_DUPLEX, SND_SEQ_NONBLOCK) < 0)
+	{
+	    seq_ = nullptr;
+	    return false;
+	}
+	snd_seq_set_client_name(seq_, "loop4r loopback");
+	port_ = snd_seq_create_simple_port(seq_, "loopback",
+					   SND_SEQ_PORT_CAP_READ | SND_SEQ_PORT_CAP_SUBS_READ | SND_SEQ_PORT_CAP_WRITE | SND_SEQ_PORT_CAP_SUBS_WRITE,
+					   SND_SEQ_PORT_TYPE_MIDI_GENERIC | SND_SEQ_PORT_TYPE_APPLICATION);
+	snd_seq_addr_t input, output;
+	if (port_ < 0
+	    || !findPort(inputName, SND_SEQ_PORT_CAP_WRITE | SND_SEQ_PORT_CAP_SUBS_WRITE, input)
+	    || !findPort(outputName, SND_SEQ_PORT_CAP_READ | SND_SEQ_PORT_CAP_SUBS_READ, output)
+	    || snd_seq_connect_to(seq_, port_, input.client, input.port) < 0
+	    || snd_seq_connect_from(seq_, port_, output.client, output.port) < 0)
+	{
+	    close();
+	    return false;
+	}
+
+	leds_ = new DatagramSocket(false);
+	if (!leds_->bindToPort(0))
+	{
+	    close();
+	    return false;
+	}
+	oscPort_ = oscPort;
+	channel_ = jlimit(1, 16, channel) - 1;
+	events_ = jmax(1, events);
+	rate_ = jmax(1, rate);
+	notes_.reset();
+	ledLatency_.reset();
+	missedNotes_ = 0;
+	missedLeds_ = 0;
+	startThread();
+	return true;
+    }
+#else
+    bool start(const String&, const String&, int, int, int, int)    { return false; }
+#endif
+
+    void stop()
+    {
+	stopThread(2 * timeoutMs + 1000);
+	close();
+    }
+
+    void dump(std::ostream& out) const
+    {
+	dumpHistogram(out, "note on", notes_, missedNotes_);
+	dumpHistogram(out, "/led", ledLatency_, missedLeds_);
+    }
+
+private:
+    static void dumpHistogram(std::ostream& out, const char* name, const LatencyHistogram& histogram, int64 missed)
+    {
+	out << "loopback " << String(name).paddedRight(' ', 8) << " count " << histogram.getCount()
+	    << "  p50 " << String(histogram.getPercentileMicros(50) / 1000.0, 2) << "ms"
+	    << "  p99 " << String(histogram.getPercentileMicros(99) / 1000.0, 2) << "ms"
+	    << "  max " << String(histogram.getMaxMicros() / 1000.0, 2) << "ms"
+	    << "  missed " << missed << std::endl;
+    }
+
+#if JUCE_LINUX && JUCE_ALSA
+    bool findPort(const String& name, unsigned int capabilities, snd_seq_addr_t& address)
+    {
+	snd_seq_client_info_t* client;
+	snd_seq_port_info_t* port;
+	snd_seq_client_info_alloca(&client);
+	snd_seq_port_info_alloca(&port);
+	snd_seq_client_info_set_client(client, -1);
+	while (snd_seq_query_next_client(seq_, client) >= 0)
+	{
+	    snd_seq_port_info_set_client(port, snd_seq_client_info_get_client(client));
+	    snd_seq_port_info_set_port(port, -1);
+	    while (snd_seq_query_next_port(seq_, port) >= 0)
+	    {
+		if (name == snd_seq_port_info_get_name(port)
+		    && (snd_seq_port_info_get_capability(port) & capabilities) == capabilities)
+		{
+		    address = *snd_seq_port_info_get_addr(port);
+		    return true;
+		}
+	    }
+	}
+	return false;
+    }
+
+    void sendController(int cc, int value)
+    {
+	snd_seq_event_t event;
+	snd_seq_ev_clear(&event);
+	snd_seq_ev_set_source(&event, port_);
+	snd_seq_ev_set_subs(&event);
+	snd_seq_ev_set_direct(&event);
+	snd_seq_ev_set_controller(&event, channel_, cc, value);
+	snd_seq_event_output_direct(seq_, &event);
+    }
+
+    void subscribe(bool unsubscribe)
+    {
+	OscPacket packet;
+	packet.size_ = OscMessageWriter(packet).begin(unsubscribe ? "/loop4r/unregister_auto_update" : "/loop4r/register_auto_update", "si")
+	    .addString("localhost").addInt32(leds_->getBoundPort()).size();
+	leds_->write("127.0.0.1", oscPort_, packet.data_, packet.size_);
+    }
+
+    // waits up to ms for the note on or LED update, or just drains until then
+    // with start 0; returns once both have been seen
+    void wait(int ms, int64 start, bool& noteSeen, bool& ledSeen)
+    {
+	const int64 end = Time::getHighResolutionTicks() + Time::secondsToHighResolutionTicks(ms / 1000.0);
+	for (;;)
+	{
+	    const int64 now = Time::getHighResolutionTicks();
+	    if (now >= end || threadShouldExit() || (noteSeen && ledSeen))
+	    {
+		return;
+	    }
+	    struct pollfd fds[8];
+	    const int numSeq = jmin(7, snd_seq_poll_descriptors_count(seq_, POLLIN));
+	    snd_seq_poll_descriptors(seq_, fds, (unsigned int) numSeq, POLLIN);
+	    fds[numSeq].fd = leds_->getRawSocketHandle();
+	    fds[numSeq].events = POLLIN;
+	    fds[numSeq].revents = 0;
+	    ::poll(fds, (nfds_t) numSeq + 1, jmax(1, (int) (Time::highResolutionTicksToSeconds(end - now) * 1000.0)));
+	    const int64 arrived = Time::getHighResolutionTicks();
+
+	    snd_seq_event_t* event = nullptr;
+	    while (snd_seq_event_input(seq_, &event) >= 0 && event != nullptr)
+	    {
+		if (start != 0 && !noteSeen && event->type == SND_SEQ_EVENT_NOTEON && event->data.note.velocity > 0)
+		{
+		    notes_.record((int64) (Time::highResolutionTicksToSeconds(arrived - start) * 1.0e6));
+		    noteSeen = true;
+		}
+	    }
+	    char buffer[512];
+	    String host;
+	    int port = 0;
+	    while (leds_->waitUntilReady(true, 0) == 1 && leds_->read(buffer, sizeof(buffer), false, host, port) > 0)
+	    {
+		if (start != 0 && !ledSeen)
+		{
+		    ledLatency_.record((int64) (Time::highResolutionTicksToSeconds(arrived - start) * 1.0e6));
+		    ledSeen = true;
+		}
+	    }
+	}
+    }
+
+    void run() override
+    {
+	subscribe(false);
+	bool noteSeen = false, ledSeen = false;
+	wait(500, 0, noteSeen, ledSeen);
+
+	const int periodMs = 1000 / rate_;
+	for (int i = 0; i < events_ && !threadShouldExit(); ++i)
+	{
+	    // the loop pedals, 1-4, in turn
+	    const int pedal = 1 + i % 4;
+	    const int64 start = Time::getHighResolutionTicks();
+	    noteSeen = ledSeen = false;
+	    sendController(104, pedal);
+	    wait(timeoutMs, start, noteSeen, ledSeen);
+	    missedNotes_ += noteSeen ? 0 : 1;
+	    missedLeds_ += ledSeen ? 0 : 1;
+
+	    sendController(105, pedal);
+	    // whatever the release brings is drained along with the wait
+	    bool drained = false;
+	    const int elapsed = (int) (Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - start) * 1000.0);
+	    wait(jmax(1, periodMs - elapsed), 0, drained, drained);
+	}
+
+	subscribe(true);
+	if (!threadShouldExit() && onFinished_)
+	{
+	    onFinished_();
+	}
+    }
+
+    snd_seq_t* seq_ = nullptr;
+    int port_ = -1;
+#else
+    void run() override {}
+#endif
+
+    void close()
+    {
+#if JUCE_LINUX && JUCE_ALSA
+	if (seq_ != nullptr)
+	{
+	    snd_seq_close(seq_);
+	    seq_ = nullptr;
+	}
+	port_ = -1;
+#endif
+	leds_ = nullptr;
+    }
+
+    ScopedPointer<DatagramSocket> leds_;
+    int oscPort_ = 0;
+    int channel_ = 0;
+    int events_ = 0;
+    int rate_ = 20;
+    LatencyHistogram notes_;
+    LatencyHistogram ledLatency_;
+    int64 missedNotes_ = 0;
+    int64 missedLeds_ = 0;
+
+    JUCE_DECLARE_NON_COPYABLE(LoopbackLatency)
+};
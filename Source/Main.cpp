@@ -28,9 +28,184 @@
  */
 
 #include "../JuceLibraryCode/JuceHeader.h"
+#include "LockFreeQueue.h"
+#include "OscDispatch.h"
+#include "OscPacket.h"
+#include "LedOutput.h"
+#include "MidiHotplug.h"
+#include "MidiDeviceCatalogue.h"
+#include "MidiInputFilter.h"
+#include "PedalLayout.h"
+#include "LatencyStats.h"
+#include "EventLog.h"
+#include "Heartbeat.h"
+#include "EngineHandshake.h"
+#include "LoopStore.h"
+#include "LoopLedTable.h"
+#include "BlinkEngine.h"
+#include "LedPatterns.h"
+#include "AlsaLedPort.h"
+#include "MidiOutputStage.h"
+#include "ExpressionMap.h"
+#include "CommandScript.h"
+#include "RuntimeCommands.h"
+#include "ProgramFileWatcher.h"
+#include "Benchmark.h"
+#include "ReplySenders.h"
+#include "ScratchArena.h"
+#include "SlbBindings.h"
+#include "PedalBanks.h"
+#include "LoopGroups.h"
+#include "CycleTracker.h"
+#include "NetworkClock.h"
+#include "SlSession.h"
+#include "LedSubscribers.h"
+#include "LedStream.h"
+#include "LocalOscSocket.h"
+#include "ControlMirror.h"
+#include "LoopProgress.h"
+#include "TraceCapture.h"
+#include "TraceArchive.h"
+#include "TraceAnalyser.h"
+#include "LedSharedState.h"
+#include "ThreadTuning.h"
+#include "WorkerPool.h"
+#include "AlsaMidiInput.h"
+#include "AlsaMidiThru.h"
+#include "EventReactor.h"
+#include "UdpBatchReader.h"
+#include "OscCoalescer.h"
+#include "OscGate.h"
+#include "StateSnapshot.h"
+#include "RcuSnapshot.h"
+#include "JackMidi.h"
+#include "JackMeter.h"
+#include "JackTransport.h"
+#include "OnsetDetector.h"
+#include "PitchDetector.h"
+#include "MidiRecorder.h"
+#include "MidiFilePlayer.h"
+#include "MidiMonitor.h"
+#include "SysexCapture.h"
+#include "SysexUploader.h"
+#include "PedalScripts.h"
+#include "StagePipeline.h"
+#include "ArgumentView.h"
+#include "OverloadGuard.h"
+#include "ControlClock.h"
+#include "InputPresence.h"
+#include "PedalChords.h"
+#include "AlsaRawMidi.h"
+#include "SerialMidiInput.h"
+#include "RtpMidiInput.h"
+#include "PedalGestures.h"
+#include "PedalDebounce.h"
+#include "MidiClock.h"
+#include "BeatScheduler.h"
+#include "TapTempo.h"
+#include "PedalMacros.h"
+#include "TimingWheel.h"
+#include "Metrics.h"
+#include "SpanTrace.h"
+#include "ThreadAccounting.h"
+#include "Soak.h"
+#include "SooperLooperSim.h"
+#include "LoopbackLatency.h"
+#include "EventJournal.h"
+#include "LedPlugin.h"
+#include "DirectLeds.h"
+#include "DinMidiOutput.h"
+#include "LoopStateStats.h"
+#include "GigMode.h"
+#include "SelfTest.h"
+#include "ScaleBenchmark.h"
+#include "OscCodecBenchmark.h"
+#include <atomic>
+#include <csignal>
+#include <cstdlib>
+#include <new>
 #include <sstream>
 #include <unistd.h>
 
+//==============================================================================
+// every allocation is counted so "bench" can report allocations and bytes
+// per event, and per thread for "acct" to charge MIDI events and OSC
+// messages with them
+static std::atomic<int64> allocationCount { 0 };
+static std::atomic<int64> allocationBytes { 0 };
+
+void* operator new(std::size_t size)
+{
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    allocationBytes.fetch_add((int64) size, std::memory_order_relaxed);
+    ++ThreadAllocations::get();
+    if (void* p = std::malloc(size == 0 ? 1 : size))
+    {
+	return p;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+//==============================================================================
+// With "epoll" the signal handlers also write to the loop's eventfd, so it
+// finds out straight away rather than at its next tick
+static volatile std::sig_atomic_t signalWakeFd = -1;
+
+static void wakeForSignal()
+{
+    const int fd = signalWakeFd;
+    if (fd >= 0)
+    {
+	const int savedErrno = errno;
+	const uint64_t one = 1;
+	(void) ::write(fd, &one, sizeof(one));
+	errno = savedErrno;
+    }
+}
+
+// set by SIGINT/SIGTERM, the timer then quits so shutdown() gets to run
+static volatile std::sig_atomic_t quitSignalled = 0;
+
+static void signalQuit(int)
+{
+    quitSignalled = 1;
+    wakeForSignal();
+}
+
+// set by SIGUSR1, the timer then writes out the "spans" trace
+static volatile std::sig_atomic_t spansSignalled = 0;
+
+static void signalSpans(int)
+{
+    spansSignalled = 1;
+    wakeForSignal();
+}
+
 //==============================================================================
 enum CommandIndex
 {
@@ -42,46 +217,142 @@ enum CommandIndex
     CHANNEL,
     BASE_NOTE,
     OSC_IN,
-    OSC_OUT
-};
-
-enum LoopStates
-{
-    Unknown = -1,
-    Off = 0,
-    WaitStart,
-    Recording,
-    WaitStop,
-    Playing,
-    Overdubbing,
-    Multiplying,
-    Inserting,
-    Replacing,
-    Delay,
-    Muted,
-    Scratching,
-    OneShot,
-    Substitute,
-    Paused
-};
-
-enum LedStates
-{
-    Dark,
-    Light,
-    Blink,
-    FastBlink
+    OSC_OUT,
+    OSC_REALTIME,
+    LATENCY_STATS,
+    LOG_LEVEL,
+    ENGINE,
+    BLINK,
+    LED_PORT,
+    THIN_CC,
+    EXPRESSION,
+    BENCHMARK,
+    UPDATES,
+    TRACE,
+    TRACE_ARCHIVE,
+    REPLAY,
+    ANALYSE,
+    SHARED_STATE,
+    THREAD_PRIORITY,
+    LOCK_MEMORY,
+    GIG_MODE,
+    REACTOR,
+    PREDICT,
+    STATE_SNAPSHOT,
+    MIDI_FILTER,
+    MIDI_DROP,
+    ADD_INPUT,
+    MIRROR_OUT,
+    MIDI_ROUTE,
+    VIRTUAL_IN,
+    JACK_MIDI,
+    RAW_IN,
+    SERIAL_IN,
+    RTP_IN,
+    GESTURE,
+    GESTURE_TIMES,
+    DEBOUNCE,
+    CLOCK_FOLLOW,
+    QUANTISE,
+    TAP_TEMPO,
+    MACRO,
+    MACRO_PEDAL,
+    OSC_TIMED,
+    METRICS,
+    SPANS,
+    ACCOUNTING,
+    SOAK,
+    SIMULATE,
+    LOOPBACK,
+    JOURNAL,
+    LOG_RATE,
+    LED_FORMAT,
+    LED_PLUGIN,
+    LED_GPIO,
+    LED_SPI,
+    LED_DIN,
+    LED_PATTERN,
+    BANK_UPDATES,
+    MIRROR,
+    PROGRESS,
+    RELOAD,
+    LED_STREAM,
+    LOCAL_SOCKET,
+    LED_MULTICAST,
+    OSC_BUFFERS,
+    OSC_SEND_THREAD,
+    IO_URING,
+    SLB_BINDINGS,
+    SESSION_FILE,
+    DISCOVER,
+    INPUT_METER,
+    ONSET_RECORD,
+    TUNER,
+    MIDI_RECORD,
+    MIDI_PLAY,
+    MIDI_MONITOR,
+    SYSEX_CAPTURE,
+    SYSEX_UPLOAD,
+    SCRIPT_PEDAL,
+    IDLE_POWER,
+    LOAD_SHEDDING,
+    HEARTBEAT_LOSS,
+    SELF_TEST,
+    SCALE_BENCHMARK,
+    MULTIPLE_INSTANCES,
+    SL_COMMANDS,
+    LED_FRAMES,
+    ADAPTIVE_UPDATES,
+    RECONCILE,
+    DELIVERY,
+    PRESENCE,
+    LED_REPLAY,
+    STANDBY_IN,
+    CHORD,
+    EXPR_CALIBRATE,
+    MIDI_THRU,
+    SEQ_POOL,
+    WORKERS,
+    OSC_GATE,
+    PEDAL_BANKS,
+    LOOP_GROUP,
+    GROUP_PEDAL,
+    CYCLE_TRACKING,
+    NET_CLOCK,
+    HOST_CLOCK,
+    JACK_TRANSPORT
 };
 
 static const String& DEFAULT_VIRTUAL_OUT_NAME = "loop4r_control_out";
+static const String& DEFAULT_VIRTUAL_IN_NAME = "loop4r_control_in";
+static const String& DEFAULT_JACK_CLIENT_NAME = "loop4r_control";
 static const int DEFAULT_BASE_NOTE = 64;
 static const int UP = 10;
 static const int DOWN = 11;
 
-// timers
-static const int TIMER_OFF = 0;
-static const int TIMER_FASTBLINK = 1;
-static const int TIMER_BLINK = 3;
+// device rescans while ALSA announces hotplugs (in 200ms ticks)
+static const int MIDI_FALLBACK_POLL_TICKS = 25;
+static const int periodicIntervalMs = 200;       // the control thread's jobs that poll
+static const int receivePortRetryMs = 200;
+static const int receivePortDrainMs = 1000;     // the old port's read after a move, for what's on its way
+static const int expiryIntervalMs = 1000;       // reply senders and LED subscribers
+static const int idleExpiryIntervalMs = 10000;  // the same with "idle"
+static const int gigPriority = 65;              // "gig"'s SCHED_FIFO priority for the MIDI thread, one less for each after it
+static const int idleTickIntervalMs = 5000;     // "idle"'s device rescans without hotplug announcements
+static const int presenceCheckMs = 100;         // "presence"
+static const int deliveryRttMs = 50;            // "deliver"'s round trip until the heartbeat has measured one
+static const int minDeliveryWindowMs = 20;
+static const int maxDeliveryWindowMs = 1000;
+static const int standbyCheckMs = 10;           // the same with a "standby" waiting to take over
+static const int ledReplayChunkMs = 2;          // a reconnected board's LEDs, a chunk this often
+static const int maxHeldPasses = 4;             // control passes the queries and LEDs may wait for pedals
+static const int oscResyncDelayMs = 50;         // after the OSC socket drops, for the burst to end before we ask again
+static const int oscGatePacketsPerSecond = 2000; // from one source, far more than SooperLooper's busiest burst
+static const int oscGateBlockMs = 2000;         // a source sending more is dropped unread for this long
+static const int THREAD_TUNING_TICKS = 5;       // that many timer ticks between looks for new threads
+
+// LEDs on the board, loops past these only show on loop4r_leds
+static const int NUM_PEDAL_LEDS = 10;
 
 // pedals (0-3 are assigned to loops 1..4)
 static const int RECORD = 4;
@@ -91,6 +362,16 @@ static const int REPLACE = 7;
 static const int SUBSTITUTE = 8;
 static const int UNDO = 9;
 
+// the pedal for each AuxLed
+static const int AUX_LED_PEDALS[] = { MULTIPLY, INSERT, REPLACE, SUBSTITUTE };
+static_assert(sizeof(AUX_LED_PEDALS) / sizeof(AUX_LED_PEDALS[0]) == AuxSubstitute + 1, "a pedal for every AuxLed");
+
+typedef Pedals<EurekaPromIoLayout> BoardPedals;
+static_assert(BoardPedals::table.forValue(5).action_ == PedalModeToggle && BoardPedals::table.forValue(5).pedal_ == RECORD,
+	      "record pedal moved in the layout");
+static_assert(BoardPedals::table.forValue(0).action_ == PedalMomentary && BoardPedals::table.forValue(0).pedal_ == UNDO,
+	      "undo pedal moved in the layout");
+
 struct ApplicationCommand
 {
     static ApplicationCommand Dummy()
@@ -117,31 +398,161 @@ struct ApplicationCommand
     StringArray opts_;
 };
 
-struct LED {
-    int index_;
-    bool on_;
-    int timer_;
-    LedStates state_;
+// a pedal press or release as handed from the MIDI input thread to the control thread
+struct PedalEvent {
+    int controller_;
+    int value_;
+    int64 ticks_;       // Time::getHighResolutionTicks() when it arrived
+    int input_ = 0;     // index into the MIDI inputs
+};
 
-    void clear()
+// What the MIDI input stages pass along, the message where it was read
+struct MidiInputEvent {
+    const uint8* data_;
+    int size_;
+    int input_;
+    int64 ticks_;
+};
+
+// What the pedal stages pass along, which pedal it is worked out once
+struct PedalStageEvent {
+    PedalEvent event_;
+    bool isPedal_;      // a press or release rather than an expression pedal
+    int pedal_;         // its BoardPedals index
+    int key_;           // its PedalGestures key, -1 if it has none
+};
+
+// One MIDI input: the port we look for, the loop its first loop pedal drives
+// and, without "epoll", the JUCE input while it's open. They live in a fixed
+// array so the MIDI thread can look its input up while another is added.
+struct MidiInputSource {
+    String name_;
+    String fullName_;       // the device's own name while it's open
+    int firstLoop_ = 0;
+    bool virtual_ = false;  // "vin": a port of our own others connect to
+    bool raw_ = false;      // "raw": a rawmidi device, read by rawInput_
+    bool serial_ = false;   // "serial": a UART, read by serialInput_
+    bool rtp_ = false;      // "rtp": an AppleMIDI session, read by rtpInput_
+    ScopedPointer<MidiInput> input_;
+    AlsaRawMidiInput rawInput_;
+    SerialMidiInput serialInput_;
+    RtpMidiInput rtpInput_;
+    int standbyFor_ = -1;     // "standby": the input this one takes over from
+
+    // what the MIDI thread writes or reads for every message, apart from the rest
+    char hotBegin_[cacheLineSize];
+    std::atomic<int64> numEvents_ { 0 };
+    InputPresence presence_;  // "presence"
+    std::atomic<bool> standingBy_ { false };    // its pedals are dropped meanwhile
+    char hotEnd_[cacheLineSize];
+
+    // the one that reads a "raw", "serial" or "rtp" input ourselves, nullptr for the rest
+    ByteStreamMidiInput* getByteInput()
     {
-	on_ = false;
-	timer_ = TIMER_OFF;
-	state_ = Dark;
+	return raw_ ? static_cast<ByteStreamMidiInput*>(&rawInput_) : serial_ ? static_cast<ByteStreamMidiInput*>(&serialInput_)
+	    : rtp_ ? &rtpInput_ : nullptr;
     }
 };
 
-struct Loop {
-    int index_;
-    LoopStates state_;
-    LED& led_;
+// What a pedal gesture ("gest") does: a note for SooperLooper, a command hit
+// on the pedal's loop (or the selected one), or the pedal's own press again.
+struct GestureAction {
+    enum Kind
+    {
+	None,
+	Note,
+	Hit,
+	SamePedal,
+	Tuner
+    };
+
+    Kind kind_ = None;
+    int note_ = 0;
+    String command_;
+};
 
-    void clear()
+// Where MIDI goes: dout's port, vout's virtual one and mout's mirror, each
+// taking the kinds of message "route" gave it (all by default).
+enum MidiOutputRole
+{
+    HardwareOut,
+    VirtualOut,
+    MirrorOut,
+    numMidiOutputRoles
+};
+
+struct MidiOutputPort {
+    String name_;
+    ScopedPointer<MidiOutput> output_;
+    int routes_ = MidiOutputStage::RouteAll;
+};
+
+// One SooperLooper instance. All engines share our receive port, each one is
+// told to answer on its own path prefix ("/e1/ctrl" etc, none for the first)
+// so we can tell them apart. Only the active engine is shown on the LEDs.
+struct Engine {
+    Engine(int index, int sendPort, TraceCapture& trace, Metrics& metrics, SpanTrace& spans)
+	: index_(index), sendPort_(sendPort), pathPrefix_(index == 0 ? String() : "/e" + String(index))
     {
-	// we don't clear index_
-	state_ = Off;
-	led_.clear();
+	sender_.setTrace(&trace);
+	sender_.setMetrics(&metrics);
+	sender_.setSpans(&spans);
     }
+
+    int index_;
+    int sendPort_;
+    String sendHost_ { "127.0.0.1" };
+    String localAddress_;               // ours as the looper's host sees it, for the return url
+    String pathPrefix_;
+    OscPacketSender sender_;
+    SooperLooperPackets packets_;
+
+    static const int registrationLeaseMs = 60000;
+
+    bool connected_ = false;
+    HeartbeatMonitor heartbeat_;
+    EngineHandshake handshake_;
+    uint32 registeredAt_ = 0;
+    int loopCount_ = 0;
+    int engineId_ = 0;
+    int selectedLoop_ = -1;
+    int checkTimer_ = -1;               // the control thread's wheel: heartbeat, reconnect and polls
+    int predictionTimer_ = -1;          // and guesses that time out
+    int deliveryTimer_ = -1;            // and pedal commands not heard back about
+    double clockTempoSent_ = 0;         // what "follow" last set its tempo to, 0 for not since connecting
+    ClockOffset clockOffset_;           // "hostclock": its host's wall clock less ours
+    uint32 clockAskedAt_ = 0;
+    String hostUrl_;
+    String version_;
+    LoopStore loops_;
+    LoopPollSchedule polls_;
+    LoopPredictor predictions_;
+    AdaptiveUpdates adaptive_;  // "adaptive": which loops are reported on fast
+    StateReconciler reconciler_;    // "reconcile"
+    CommandDelivery deliveries_;    // "deliver"
+    UpdateArrivals arrivals_;   // gaps between the auto-updates' /ctrl states
+    BigInteger visibleLoops_;   // the ones on the board, registered as if there were no others
+    ControlMirror controls_;
+    uint64 mirroredLoopControls_ = 0;   // registered with SooperLooper, as ids
+    uint64 mirroredGlobalControls_ = 0;
+    bool restored_ = false;     // loops_ came from the snapshot, SooperLooper hasn't confirmed them
+    int sessionLoops_ = 0;      // what "slsess" said it has, 0 if we weren't told
+    uint32 discoveringUntil_ = 0;   // "discover" takes an answer from another port until then, 0 for not
+
+    JUCE_DECLARE_NON_COPYABLE(Engine)
+};
+
+// What the board shows, as of the last LED commit, for threads other than
+// the control thread to read through an RcuSnapshot
+struct PublishedState
+{
+    int engine_ = 0;                    // the active one
+    int selectedLoop_ = -1;
+    int numLoops_ = 0;
+    int display_ = -1;
+    int numLit_ = 0;
+    uint8 loopStates_[LoopStore::maxLoops] = {};
+    bool leds_[LedChangeFilter::maxLeds] = {};
 };
 
 inline float sign(float value)
@@ -150,24 +561,132 @@ inline float sign(float value)
 }
 
 class loop4r_readApplication  : public JUCEApplicationBase, public MidiInputCallback,
-public Timer, private OSCReceiver::Listener<OSCReceiver::MessageLoopCallback>
+public Timer, private AsyncUpdater, private OSCReceiver::Listener<OSCReceiver::MessageLoopCallback>,
+private PedalScriptHost, private CycleTracker::Listener
 {
 public:
     //==============================================================================
-    loop4r_readApplication()
+    loop4r_readApplication() : realtimeOscListener_(*this), pedalEvents_(256), oscEvents_(256, OSCMessage("/")), controlThread_(*this)
     {
 	commands_.add({"din",   "device in",        DEVICE_IN,          1, "name",           "Set the name of the MIDI input port"});
+	commands_.add({"presence", "presence",    PRESENCE,          -1, "(silence s)|off", "Tell when a controller goes away behind a port that stays, as a USB interface's does: from its active sensing stopping or, for one that doesn't send it, silence s (0, never) without a message. The board's LEDs are all sent again when it comes back"});
+	commands_.add({"ledreplay", "led replay", LED_REPLAY,        -1, "(baud)|off",     "When a MIDI input (re)connects, send the board every LED and the display again, paced for a link of baud (31250, a DIN cable; 0 for all at once)"});
+	commands_.add({"ain",   "add input",        ADD_INPUT,         -1, "name (first loop)", "Also take pedals from MIDI input port name, its loop pedals driving loops from first loop (0) on; din sets the first input"});
+	commands_.add({"standby", "standby input", STANDBY_IN,      -1, "name (primary)", "Keep MIDI input port name open as a hot standby for input primary (0, din's) and drive the same loops: its pedals are ignored until the primary goes quiet or away (implies \"presence\"), then it takes over at once and the LEDs are sent again. The primary takes back over when it's heard again. For the board to show them, connect the LED output to both"});
 	commands_.add({"dout",  "device out",       DEVICE_OUT,         1, "name",           "Set the name of the MIDI output port"});
 	commands_.add({"vout",  "virtual",          VIRTUAL_OUT,       -1, "(name)",         "Use virtual MIDI output port with optional name (Linux/macOS)"});
+	commands_.add({"filt",  "midi filter",      MIDI_FILTER,       -1, "(channels) (types) (ccs)", "Only act on MIDI input on these channels (1-16), of these types (note, polyat, cc, pc, chanat, bend, sys) and controller numbers, e.g. 1 cc 104-105; lists take commas, ranges and all, no lists lets everything through"});
+	commands_.add({"drop",  "drop midi",        MIDI_DROP,          1, "kinds",          "Drop these system messages from the MIDI input first thing: clock, tick, transport, sensing, realtime (all of those), sysex, timecode, song or none. With epoll the sequencer doesn't even deliver them"});
+	commands_.add({"mout",  "mirror out",       MIRROR_OUT,        -1, "(name)",         "Also send the MIDI output to port name, e.g. a recorder; no name stops it"});
+	commands_.add({"thru",  "midi thru",        MIDI_THRU,          1, "on|off", "Have the ALSA sequencer forward each MIDI input device to the dout port itself, pedals included, instead of passing the other controllers on through us; inputs read some other way are still passed on (Linux)"});
+	commands_.add({"seqpool", "sequencer pools", SEQ_POOL,         -1, "input (output)", "Give our ALSA sequencer clients pools of input events (for the MIDI inputs) and output events (for the LED port) instead of the sequencer's default; when input is lost to an overrun anyway, the loops' state is asked for again and the LEDs go to the board again (Linux)"});
+	commands_.add({"route", "midi route",       MIDI_ROUTE,         2, "hw|virt|mirror kinds", "Send only these kinds (notes, cc, other, all or none, comma separated) to the dout, vout or mout port"});
+	commands_.add({"vin",   "virtual in",       VIRTUAL_IN,        -1, "(name) (first loop)", "Create a virtual MIDI input port (loop4r_control_in) for software controllers to connect to, its loop pedals driving loops from first loop (0) on (Linux/macOS)"});
+	commands_.add({"raw",   "raw in",           RAW_IN,            -1, "device (first loop)", "Take pedals straight from an ALSA rawmidi device (hw:1,0,0), opened for us alone rather than through the sequencer, driving loops from first loop (0) on (Linux)"});
+	commands_.add({"serial", "serial in",       SERIAL_IN,         -1, "device (first loop)", "Take pedals straight from a UART at MIDI's 31250 baud (/dev/ttyAMA0), for a board wired to the GPIO pins, driving loops from first loop (0) on (Linux)"});
+	commands_.add({"rtp",   "rtp in",           RTP_IN,            -1, "port (first loop) (max ms)", "Take pedals from the network over RTP-MIDI, as the AppleMIDI session a Mac, iPad or rtpMIDI invites on port (5004) and the one after, driving loops from first loop (0) on; its packets are held up to max ms (10) to put them in order and smooth their jitter, and what a lost one carried comes back from the next one's recovery journal (Linux)"});
+	commands_.add({"jack",  "",                 JACK_MIDI,         -1, "(client) (from port) (to port)", "Also take pedals from and send MIDI to JACK, as a client (loop4r_control) with midi_in and midi_out ports connected from and to the given JACK ports; its pedals drive the first input's loops (Linux)"});
+	commands_.add({"gest",  "gesture",          GESTURE,           -1, "pedal long|double|repeat note N|hit command|pedal|tuner|off (input)", "Make a long press, double tap or held repeat of that pedal (1-10) on the input (0) send note N, hit its loop (or the selected one) with a SooperLooper command, repeat the pedal itself, turn the tuner on or off, or do nothing special again; the pedal's own press then waits until it's known not to be one"});
+	commands_.add({"chord", "chord",           CHORD,             -1, "pedal pedal note N|hit command|tuner|off (input)|window ms", "Make two pedals (1-10) of the input (0) pressed within the window (40ms) of each other send note N, hit the lower one's loop (or the selected one) with a SooperLooper command or turn the tuner on or off, instead of what each does; their presses then wait out the window, other pedals don't"});
+	commands_.add({"gestms", "gesture times",   GESTURE_TIMES,      4, "long double delay repeat", "Gesture thresholds in ms: long press (600), double tap window (300), repeat delay (500) and repeat interval (150)"});
+	commands_.add({"debounce", "",              DEBOUNCE,           1, "ms", "Swallow a pedal's switch bouncing for ms after each press or release, the first edge still going out at once (0, off)"});
+	commands_.add({"hostclock", "host clock",   HOST_CLOCK,        -1, "(port)|off",     "With every heartbeat ask the loop4r_read on port (9000) of each engine's host for its wall clock, NTP style, and time tag the bundles for the engine on that clock; /loop4r/stats \"clocks\" has the offsets and how far out they could be. Engines on this host aren't asked"});
+	commands_.add({"follow", "clock follow",    CLOCK_FOLLOW,       1, "on|off|bpm",     "Lock to the MIDI clock coming in: set SooperLooper's tempo when it moves by bpm (0.5) or more, and run the blink clock from its beat"});
+	commands_.add({"netclock", "network clock", NET_CLOCK,         -1, "host:port (ms)|off", "Follow the beat of the loop4r_read listening on host:port like \"follow\" does the MIDI clock's, asking for its clock every ms (250) and working out how far apart and drifting our clocks are; every loop4r_read answers with its followed or blink clock's beat"});
+	commands_.add({"jtransport", "jack transport", JACK_TRANSPORT, 1, "on|off", "While JACK transport rolls, read its bar, beat and tempo as a JACK client (loop4r_control_transport) on every control pass and go by them ahead of the MIDI or network clock: the blink clock, \"quant\", macro waits and the \"netclock\" answers; the loop progress runs on JACK's frame clock between SooperLooper's positions. Stopped, the other clocks and tap tempo count again (Linux)"});
+	commands_.add({"quant", "quantise",         QUANTISE,          -1, "off|beat|bar (beats per bar) (ahead ms|auto (ms))", "In record mode send loop pedal presses on the next beat or bar (4 beats) of the followed MIDI clock, or of the synced blink clock, ahead by ms (0) or by the measured command latency, falling back to ms (0) while that's unsteady"});
+	commands_.add({"tap",   "tap tempo",        TAP_TEMPO,         -1, "pedal|off (input)", "Make that pedal (1-10) on the input (0) a tap tempo pedal instead: SooperLooper's tempo and the blink clock follow the taps"});
+	commands_.add({"macro", "",                 MACRO,             -1, "name steps",     "Define a macro from steps: mute L, unmute L, hit L command, select L, note N, wait ms or wait N beats"});
+	commands_.add({"group", "loop group",       LOOP_GROUP,         2, "name loops",     "Define a group of loops, comma separated from 0 with ranges like 0-2, or all of them"});
+	commands_.add({"gpedal", "group pedal",     GROUP_PEDAL,       -1, "pedal group command|off (input)", "Make that pedal (1-10) on the input (0) hit every loop of the group with a SooperLooper command (mute_on, trigger, ...) in one bundle, time tagged for the beat like a loop pedal's press with \"quant\""});
+	commands_.add({"mpedal", "macro pedal",     MACRO_PEDAL,       -1, "pedal name|off (input)", "Make that pedal (1-10) on the input (0) run the macro instead, a press while it runs cancelling it"});
+	commands_.add({"jpedal", "script pedal",    SCRIPT_PEDAL,      -1, "pedal file|off (input) (ms)", "Give that pedal (1-10) on the input (0) to the JavaScript file's onPedal(event) first, parsed once and run within ms (5) a press or release; the usual mapping gets it unless that returns true"});
+	commands_.add({"osct",  "osc timetags",     OSC_TIMED,          1, "off|on|lead ms", "Send macro steps lead ms (20) before they're due, the OSC ones in bundles time tagged for then so SooperLooper runs them on time, the notes from the beat scheduler"});
+	commands_.add({"metrics", "metrics socket", METRICS,           -1, "(path)",         "Serve MIDI, OSC, LED and connection counters and the queue depths in Prometheus text on Unix socket path (/tmp/loop4r.metrics)"});
+	commands_.add({"spans", "span trace",       SPANS,             -1, "(file) (spans)|dump|off", "Record what each thread does, MIDI and OSC handling and every send, as spans, the last spans (16384) per thread, and write them to file (/tmp/loop4r_spans.json) as Chrome trace JSON on exit, on SIGUSR1 or with dump"});
+	commands_.add({"acct",  "accounting",       ACCOUNTING,        -1, "(seconds)",      "Every seconds (10) print each thread's CPU time and how often it ran, from /proc (Linux), and the allocations per MIDI event and per OSC message handled; the totals on exit"});
 	commands_.add({"list",  "",                 LIST,               0, "",               "Lists the MIDI ports"});
 	commands_.add({"ch",    "channel",          CHANNEL,            1, "number",         "Set MIDI channel for the commands (0-16), defaults to 0"});
 	commands_.add({"base",  "base note",        BASE_NOTE,          1, "number",         "Starting note"});
 	commands_.add({"oin",   "osc in",           OSC_IN,             1, "number",         "OSC receive port"});
-	commands_.add({"oout",  "osc out",          OSC_OUT,            1, "number",         "OSC send port"});
-
-	for (auto i=0; i<10; i++)
+	commands_.add({"oout",  "osc out",          OSC_OUT,            1, "(host:)number",  "OSC send port, of SooperLooper on another host if it's given"});
+	commands_.add({"ort",   "osc realtime",     OSC_REALTIME,       0, "",               "Hand OSC messages to the control thread straight from the receiver thread"});
+	commands_.add({"eng",   "engine",           ENGINE,             1, "(host:)number",  "Also drive the SooperLooper engine on this OSC port, on another host if it's given"});
+	commands_.add({"blink", "blink clock",      BLINK,              1, "free|sync",      "Blink the LEDs from here, free running or synced to the loop tempo"});
+	commands_.add({"lfmt",  "led format",       LED_FORMAT,         1, "text|binary",    "What goes to loop4r_leds on stdout: \"cc number value\" lines (default) or 4 byte records, each batch ending in a frame marker"});
+	commands_.add({"lplug", "led plugin",       LED_PLUGIN,        -1, "path (args)",    "Drive the LEDs from a driver loaded into the process (see LedPluginApi.h), handed each batch in one call, instead of loop4r_leds"});
+	commands_.add({"gpio",  "led gpio",         LED_GPIO,           1, "pins",           "Drive LED number i from the i'th of the comma separated BCM GPIO pins (-1 for none) through /dev/gpiomem, instead of loop4r_leds (Raspberry Pi)"});
+	commands_.add({"ledpat", "led pattern",     LED_PATTERN,       -1, "state pattern|default (beats)", "Blink the LEDs of loops in state (e.g. waitstart, paused) with pattern over beats (1), where the pattern is dark, light, blink, fast or up to 32 steps like x.x..... (x lit). Needs \"blink\""});
+	commands_.add({"lstream", "led stream",     LED_STREAM,        -1, "(port)|off",     "Serve the LEDs and display as SLIP framed OSC over TCP on port (9002): all of them when a client connects, then the changes, only the latest of each for a client that's behind"});
+	commands_.add({"lsock", "local socket",     LOCAL_SOCKET,      -1, "(path)|off",     "Also take /loop4r messages on Unix datagram socket path (/tmp/loop4r.sock) from our own user's processes, auto updating a client there at its own socket's address"});
+	commands_.add({"obuf",  "osc buffers",      OSC_BUFFERS,       -1, "receive (send)", "Kernel buffer bytes for the OSC sockets, 0 for the default; with epoll the datagrams the kernel drops are counted and the loops' state asked for again"});
+	commands_.add({"ogate", "osc gate",         OSC_GATE,          -1, "packets (block ms)|off", "Let each source send the OSC socket up to packets datagrams a second (" + String(oscGatePacketsPerSecond) + "), dropping everything from one that sends more unread for block ms (" + String(oscGateBlockMs) + "); malformed datagrams and addresses nothing handles are only counted (with epoll)"});
+	commands_.add({"osend", "osc send thread",  OSC_SEND_THREAD,    0, "",               "Send to the engines from a thread of our own, in batches, so a full socket buffer never holds up the pedals"});
+	commands_.add({"slb",   "bindings",         SLB_BINDINGS,      -1, "(file)|off",     "Send the loop pedals the notes SooperLooper's MIDI bindings file (loop4r_read.slb) has mute_trigger and record_or_overdub_excl on, reporting where it and the base note layout differ"});
+	commands_.add({"slcmd", "osc commands",     SL_COMMANDS,       -1, "(on|off)",       "Send the pedals' SooperLooper commands as /sl/N/down and /sl/N/up straight to the engine rather than notes through its MIDI bindings: slb's bindings, or the loop pedals' mute_trigger and record_or_overdub_excl without them. Notes bound to nothing or to global commands, and everything while disconnected or quantised, stay MIDI"});
+	commands_.add({"slsess", "session",         SESSION_FILE,      -1, "(file)",         "Size the loops and build their registrations from SooperLooper session file (loop4r_read.slsess) and take its tempo, before the engine first answers"});
+	commands_.add({"discover", "discover",      DISCOVER,          -1, "(first-last) (ms)|off", "Whenever an engine is (re)connected, also ping ports first to last (9951-9960) on its host at once and move it to the first other one that answers within ms (50), unless its own port answers"});
+	commands_.add({"meter", "input meter",      INPUT_METER,       -1, "(from port) (leds) (ms)|off", "Light the comma separated LEDs (- for none) as a bar of the audio level coming from JACK port from port into a client (loop4r_control_meter), RMS as the bar, the peak as a dot and the last LED for a second after a clip, at most every ms (30) (Linux)"});
+	commands_.add({"onset", "onset record",     ONSET_RECORD,      -1, "(threshold) (sensitivity)|off", "Hit record on the selected loop while it's empty when an attack comes in on the meter's JACK input, its spectral flux over threshold (0.05) and sensitivity (1.5) times the recent average; trigger_latency is raised for that hit by how late we noticed (Linux)"});
+	commands_.add({"tuner", "",                 TUNER,             -1, "on|off|toggle (leds) (sharp led) (ms)", "Tune to the meter's JACK input: the display shows the note as letter (C 1 to B 7) and octave, 64 for A4, the comma separated LEDs (the board's 1-5) are a needle centred when within 5 cents, the sharp LED (none) lights for sharps, redrawn at most every ms (100); onsets wait meanwhile"});
+	commands_.add({"mrec",  "midi record",      MIDI_RECORD,       -1, "(file)|off",     "Record the pedals coming in and the MIDI going out to Standard MIDI File (loop4r_read.mid), written as it goes from a thread of its own every second"});
+	commands_.add({"play",  "",                 MIDI_PLAY,         -1, "file (in|out) (times)|stop", "Play MIDI file's events at their times, to within a fraction of a millisecond and without drifting, as if they came in from the first input or straight out to the MIDI output (in), times times over (1, 0 until stopped)"});
+	commands_.add({"monitor", "",               MIDI_MONITOR,      -1, "(ts)|off",       "Print all MIDI coming in to stdout as it comes, without the log's rate limit, formatted from tables a batch at a time so dense clock or sysex streams keep up, with the seconds since starting in front of each line (ts)"});
+	commands_.add({"sysex", "",                 SYSEX_CAPTURE,     -1, "(dir) (crc)|off", "Write sysex bulk dumps coming in to files in directory (sysex) as they arrive, a file each, reporting each one's size and CRC-32, and whether it matches crc in hex if given"});
+	commands_.add({"upload", "",                SYSEX_UPLOAD,      -1, "file (gap ms)|stop", "Send file's sysex messages to the MIDI output one at a time from a low priority thread, waiting as long as each takes on the wire and gap ms (100) more for the device between them, while everything else keeps going out"});
+	commands_.add({"idle",  "idle power",       IDLE_POWER,        -1, "(ping s)",       "Sleep until something happens: implies \"epoll\" and updates on change without rereading loops, watches ALSA announcements rather than rescanning devices, pings SooperLooper after ping s (10) of quiet and expires subscriptions every 10s. How often we woke is in the metrics and at exit"});
+	commands_.add({"shed",  "load shedding",    LOAD_SHEDDING,     -1, "(off|depth) (lag ms)", "When events queue up past depth (32) or take past lag ms (5) from coming in to being handled, leave out the verbose log, then the OSC display pushes, then the controllers passed through to the outputs, never the pedals; MIDI feedback loops cut passthrough for 2s. On by default"});
+	commands_.add({"uring", "io uring",         IO_URING,           0, "",               "Run the epoll loop on io_uring instead, re-arming, timing out and sleeping in one system call per wake (Linux 5.11); implies \"epoll\""});
+	commands_.add({"lmcast", "led multicast",   LED_MULTICAST,     -1, "(group:port) (ttl)|off", "Also send the LED and display updates once to multicast group:port (239.255.4.4:9003, ttl 1), with /loop4r/version every second; receivers start from /loop4r/snapshot and ask /loop4r/changes when they see a version skipped"});
+	commands_.add({"ledframes", "led frames",  LED_FRAMES,        -1, "(on|off)",       "Send the subscribers and the multicast group each input event's LED and display changes as one /leds message: frame number, version, display (-1 unchanged) and index, on, timer and state per LED changed"});
+	commands_.add({"spi",   "led spi",          LED_SPI,           -1, "(device) (bytes)", "Shift the LEDs out as a bit frame of bytes (2) to a shift register chain or LED driver on device (/dev/spidev0.0), instead of loop4r_leds"});
+	commands_.add({"din",   "led din",          LED_DIN,           -1, "(device) (burst)", "Send the LEDs as MIDI controllers on the channel straight down a DIN link, a UART at 31250 baud or a USB interface's rawmidi node like /dev/snd/midiC1D0 (/dev/ttyAMA0), with running status and paced to the wire so at most burst bytes (3) go ahead of it, instead of loop4r_leds (Linux)"});
+	commands_.add({"lport", "led port",         LED_PORT,          -1, "(dest)",         "Send the LED controllers from our own ALSA port, connected to dest (client:port) if given"});
+	commands_.add({"expr",  "expression",       EXPRESSION,        -1, "cc loop ctrl (min max) (curve)", "Send controller cc to SooperLooper as /sl/loop/set ctrl, scaled to min-max (0-1) along curve linear, log, exp or s (linear)"});
+	commands_.add({"exprcal", "expression calibration", EXPR_CALIBRATE, -1, "cc low high|learn", "Stretch what the pedal on controller cc really sweeps, low-high or learned from it (printed on exit), to the whole of its expr mappings"});
+	commands_.add({"thin",  "thin cc",          THIN_CC,            0, "",               "Pass each controller through at most once per millisecond, keeping the latest value"});
+	commands_.add({"upd",   "updates",          UPDATES,           -1, "auto|change (ms) (selected ms)", "Have SooperLooper send loop states every 100ms (auto, default) or only on change, then reread them every ms (2000) and the selected loop's every selected ms (200)"});
+	commands_.add({"adaptive", "adaptive updates", ADAPTIVE_UPDATES, -1, "(ms) (hold ms)|off", "Have SooperLooper send a loop's state every ms (10) while it's waiting to start or stop, recording, multiplying or inserting, and for hold ms (1500) after a pedal sent it a command; the other loops keep their usual updates"});
+	commands_.add({"reconcile", "reconcile",  RECONCILE,         -1, "(min s) (max s)|off", "Every so often ask SooperLooper for all the loops' states in one message and correct the ones we have wrong: every min s (2) after a missed heartbeat, a reconnect or a wrong loop, twice as long after each round that finds none, up to max s (60)"});
+	commands_.add({"deliver", "delivery",     DELIVERY,          -1, "(attempts)|off", "Expect a loop pedal's /ctrl state change within the round trip and the loop's update interval; if it doesn't come ask for the loop's state, and if the command didn't take send it again, up to attempts (4) questions and resends per press. Only presses whose outcome is known are tracked, so a toggle is never sent twice blind"});
+	commands_.add({"mir",   "mirror",           MIRROR,            -1, "(ms) control ...", "Keep these SooperLooper controls (loop_pos, wet, ...; global:name for a global one) for /loop4r/get_control and /loop4r/register_control, the loop ones auto updated every ms (100)"});
+	commands_.add({"prog",  "progress",         PROGRESS,          -1, "off|display|ring (ms) (leds)", "Show how far through the selected loop we are as a percentage on the display or lit along the comma separated LEDs, at most every ms (50)"});
+	commands_.add({"reload", "config reload",   RELOAD,             1, "on|off",         "When a program file named on the command line is saved, run the commands in it that changed, between events and without reconnecting (on)"});
+	commands_.add({"cycles", "cycle tracking",  CYCLE_TRACKING,    -1, "(sample ms)|off", "Work out where the loops' cycles start from loop_pos and cycle_len asked for every sample ms (2000) and the clock in between, and sync \"blink sync\" on the selected loop's, instead of having SooperLooper send its position every 100ms; takes effect when an engine next registers"});
+	commands_.add({"banks", "pedal banks",      PEDAL_BANKS,       -1, "count (loops per bank)", "Page the loop pedals through count banks of loops (at most " + String(PedalBanks::maxBanks) + ") with the up and down pedals, each bank loops per bank (one per loop pedal) on from the one before"});
+	commands_.add({"bank",  "bank updates",     BANK_UPDATES,      -1, "on|off (ms)",    "Only the loops under the inputs' loop pedals and the selected one get the updates chosen with \"upd\", the rest are sent on change and reread every ms (10000)"});
+	commands_.add({"trace", "trace",            TRACE,             -1, "(file) (records)", "Record MIDI and OSC in and out to a memory mapped ring file, /dev/shm/loop4r.trace and 65536 records by default"});
+	commands_.add({"archive", "trace archive",  TRACE_ARCHIVE,     -1, "file (segment seconds)|off", "Keep the whole of the trace in file, appended to by a low priority thread as compressed segments of segment seconds (30) with an index next to it (file.idx), for replay to start anywhere in; after \"trace\""});
+	commands_.add({"analyse", "analyse",        ANALYSE,           -1, "file count|echo|reconnects|states (threshold) (from s) (for s)", "Query a trace or trace archive on every core, from s seconds in and for s, then quit: records per source, pedal presses whose LED echo took more than threshold ms (20), stretches of threshold s (2) with nothing coming in while we sent, or each loop's time per state"});
+	commands_.add({"replay", "replay",          REPLAY,            -1, "file (fast|realtime) (from s) (for s)", "Feed a trace's (or a trace archive's, from s seconds in and for s) MIDI and OSC input back in, as fast as possible or with the recorded spacing, compare the output with the trace, then quit"});
+	commands_.add({"shm",   "shared state",     SHARED_STATE,      -1, "(name)",         "Publish the LED, display and loop state in POSIX shared memory, /loop4r_leds by default"});
+	commands_.add({"rt",    "realtime",         THREAD_PRIORITY,   -1, "thread priority (fifo|rr|other) (cpus)", "Schedule a thread (midi, osc, control, leds, workers or its name) at priority, SCHED_FIFO by default, on CPUs like 2 or 0,2-3"});
+	commands_.add({"workers", "worker pool",    WORKERS,           -1, "(count)|off", "Run the jobs nothing should wait on (device lists after a hotplug, span dumps on SIGUSR1) on count worker threads (one per CPU no realtime thread is pinned to, at most " + String(WorkerPool::maxWorkers) + "), kept off the realtime threads' CPUs"});
+	commands_.add({"mlock", "lock memory",      LOCK_MEMORY,        0, "",               "Lock all current and future memory, stacks included, so nothing is paged out"});
+	commands_.add({"gig",   "gig mode",         GIG_MODE,          -1, "(cpus) (performance)", "Play live: hold /dev/cpu_dma_latency at 0 so the cores stay out of deep C-states, lock memory, run the midi, control, osc and leds threads SCHED_FIFO (" + String(gigPriority) + " down) on CPUs like 2-3 where \"rt\" doesn't say otherwise, keep the log from going verbose and, with performance, put those CPUs (all of them without cpus) on the performance governor. What worked is printed and it's all put back on exit (Linux)"});
+	commands_.add({"epoll", "reactor",          REACTOR,            0, "",               "Read MIDI, OSC and -- commands and run the timers from one epoll loop on the control thread (Linux)"});
+	commands_.add({"pred",  "predict",          PREDICT,            0, "",               "Light a loop's LED for the state its pedal should lead to straight away, then check it against SooperLooper"});
+	commands_.add({"snap",  "snapshot",         STATE_SNAPSHOT,    -1, "(file)",         "Keep the mode, LEDs and loop states in file (~/.loop4r_state) and light the board from it on start, until SooperLooper answers"});
+	commands_.add({"log",   "log level",        LOG_LEVEL,          1, "level",          "Event logging: quiet, normal (default) or verbose"});
+	commands_.add({"lrate", "log rate",         LOG_RATE,          -1, "midi|osc|all (per second) (burst) (1 in n)", "Limit the MIDI or OSC event log to per second records (200, 0 for no limit) with bursts of burst (twice that), logging only every n'th (1); what's left out is counted once a second"});
+	commands_.add({"stats", "latency stats",    LATENCY_STATS,      0, "",               "Print pedal to note/ctrl/LED latency percentiles, pedal-ctrl split at the kernel receiving the /ctrl into network and queueing, and the gaps between each loop's auto-updates on exit"});
+	commands_.add({"jrnl",  "journal",          JOURNAL,           -1, "(file) (records)|off|show (file)", "The flight recorder of pedals, notes, loop states and connection changes, always on in /dev/shm/loop4r.journal (8192 records): move or resize it, turn it off, or print a journal (a crashed one) and quit"});
+	commands_.add({"e2e",   "loopback",         LOOPBACK,          -1, "(presses) (per second)", "Time loop pedal presses (1000, 20 a second) played into the virtual input (vin) by a sequencer client of our own until their note on comes out of the virtual output (vout) and their /led reaches a local subscriber, with predictions on, then quit (Linux)"});
+	commands_.add({"sim",   "simulate",         SIMULATE,          -1, "port (loops) (ms) (loss %) (delay ms) (jitter ms)", "Run as a simulated SooperLooper on port with loops (8), auto updates every ms (100), dropping loss % of the replies and delaying them by delay plus up to jitter ms, printing its traffic every second until interrupted"});
+	commands_.add({"soak",  "soak test",        SOAK,              -1, "(minutes) (events/s) (KB/hour)", "Feed pedal, expression, /ctrl, heartbeat, pingack and stats traffic at events/s (20000) for minutes (60), sampling RSS, heap and fragmentation; fail with exit code 1 if either grew faster than KB/hour (1024), then quit"});
+	commands_.add({"hbloss", "heartbeat loss",  HEARTBEAT_LOSS,    -1, "(minutes) (alive s)", "Run minutes (10) of SooperLooper answering pings for alive s (60) and then going quiet on a virtual clock, as fast as it goes; fail with exit code 1 if the silence wasn't noticed in time or the reconnects stopped, then quit"});
+	commands_.add({"selftest", "self test",     SELF_TEST,         -1, "(sequencer ms) (udp ms) (timer ms) (ping ms)", "Measure this box for a couple of seconds, then quit: an ALSA sequencer hop between ports of our own, a UDP echo through the OSC receive port, 1ms timer wakeups scheduled as the control thread (\"rt control\" or \"gig\") and SooperLooper's /ping round trip. Each fails with exit code 1 if its 99th percentile is over its limit (1, 0.5, 0.5 and 5ms) or anything's lost"});
+	commands_.add({"scale", "scaling benchmark", SCALE_BENCHMARK,  -1, "(seconds) (file)", "Run the simulator and a copy of us as processes for every point of 4, 16, 64 and 256 loops x 0, 1, 8 and 32 LED subscribers x updates every 100, 10 and 1ms, playing 20 pedal presses a second into a pty for seconds (3) each; write CPU, pedal to LED percentiles, OSC rates and the time in handleCtrlMessage, updateLoopLedState and the sends per second as CSV to file (standard output), then quit (Linux)"});
+	commands_.add({"multi", "multiple instances", MULTIPLE_INSTANCES, 0, "",              "Run even with another copy of us running, on OSC ports and devices of its own"});
+	commands_.add({"bench", "benchmark",        BENCHMARK,         -1, "(events) (file)", "Replay pedal, expression and /ctrl streams, then the /ctrl, /heartbeat, /led and registration messages through the JUCE OSC objects and our writers, typed messages, cached packets, views and schemas; report ns, allocations, bytes allocated and LEDs per event, then quit. The file holds recorded \"loop control value\" /ctrl lines"});
+
+	for (int i = 0; i < commands_.size(); ++i)
 	{
-	    leds_.add({i, false, TIMER_OFF, Dark});
+	    commandLookup_.set(commands_[i].param_.toLowerCase(), i);
+	    if (commands_[i].altParam_.isNotEmpty())
+	    {
+		commandLookup_.set(commands_[i].altParam_.toLowerCase(), i);
+	    }
 	}
 
 	channel_ = 1;
@@ -175,27 +694,58 @@ public:
 	selected_ = 0;
 	noteNumbersOutput_ = false;
 	useHexadecimalsByDefault_ = false;
-	oscSendPort_ = 9951;
+	octaveMiddleC_ = 3;
 	oscReceivePort_ = 9000;
 	oscLedSendPort_ = 9001;
-	loopCount_ = 0;
-	hostUrl_ = "";
-	version_ = "";
-	selectedLoop_ = -1;
-	pinged_ = false;
 	mode_ = 0;
-	heartbeat_ = 5;
-	engineId_ = 0;
-	currentCommand_ = ApplicationCommand::Dummy();
+	engines_.add(new Engine(0, 9951, trace_, metrics_, spans_));
+	ledOutput_.setTrace(&trace_);
+	midiStage_.setTrace(&trace_);
+	midiStage_.setMetrics(&metrics_);
+	midiStage_.setSpans(&spans_);
+	midiStage_.setJournal(&journal_);
+	ledOutput_.setSpans(&spans_);
+	ledSubscribers_.setMetrics(&metrics_);
+	activeEngine_ = 0;
+	realtimeOsc_ = false;
+	dumpLatencyStats_ = false;
+	for (int i = 0; i < LedChangeFilter::maxLeds; ++i)
+	{
+	    pendingCtrlTicks_[i] = 0;
+	    pendingLedTicks_[i] = 0;
+	    pendingSendTicks_[i] = 0;
+	}
+	for (auto&& macro : macroForKey_)
+	{
+	    macro = -1;
+	}
+	for (auto&& script : scriptForKey_)
+	{
+	    script = -1;
+	}
+	registerOscHandlers();
+	registerMetrics();
     }
 
     const String getApplicationName() override       { return ProjectInfo::projectName; }
     const String getApplicationVersion() override    { return ProjectInfo::versionString; }
-    bool moreThanOneInstanceAllowed() override       { return false; }
+    // except for the simulator, which is there for another one to talk to,
+    // "scale", which runs copies of us, and those given "multi"
+    bool moreThanOneInstanceAllowed() override
+    {
+	const StringArray params = getCommandLineParameterArray();
+	return params.contains("sim") || params.contains("simulate") || params.contains("scale") || params.contains("scaling benchmark")
+	    || params.contains("multi") || params.contains("multiple instances");
+    }
 
     //==============================================================================
     void initialise (const String& commandLine) override
     {
+	startup_.reached(StartupTimes::Initialise);
+	ledOutput_.start();
+	eventLog_.setMidiFormat(useHexadecimalsByDefault_, noteNumbersOutput_, octaveMiddleC_);
+	eventLog_.start();
+
 	StringArray cmdLineParams(getCommandLineParameterArray());
 	if (cmdLineParams.contains("--help") || cmdLineParams.contains("-h"))
 	{
@@ -210,1457 +760,8957 @@ public:
 	    return;
 	}
 
+	// opened once OSC is on its way, see openMidiPorts()
+	deferMidiPorts_ = true;
+	startupProfile_ = cmdLineParams.contains("--startup-profile");
 	parseParameters(cmdLineParams);
+	startup_.reached(StartupTimes::Parameters);
+	rebuildPedalNotes();
+	if (useReactor_ && reactorBackend_ == EventReactor::Uring && !reactor_.open(EventReactor::Uring))
+	{
+	    std::cerr << "Couldn't set up io_uring, using epoll" << std::endl;
+	}
+	if (useReactor_ && !reactor_.isOpen() && !reactor_.open())
+	{
+	    std::cerr << "Couldn't set up the epoll loop, using the MIDI and OSC threads" << (idlePower_ ? " and waking every 200ms" : "") << std::endl;
+	    useReactor_ = false;
+	    reconnectOscInput();
+	}
 
-	if (cmdLineParams.contains("--"))
+	const bool framed = cmdLineParams.contains("--framed");
+	if ((framed || cmdLineParams.contains("--")) && StdinCommandReader::isFile())
 	{
-	    while (std::cin)
-	    {
-		std::string line;
-		getline(std::cin, line);
-		StringArray params = parseLineAsParameters(line);
-		parseParameters(params);
-	    }
+	    // a file ends, so it's read here and can set up the bench, replay and the rest
+	    readStdinFile(framed);
+	}
+	else if (framed || cmdLineParams.contains("--"))
+	{
+	    // read as they come, the reactor's own way or by the stdin reader,
+	    // and run between events once everything is running
+	    readStdinCommands_ = !framed && useReactor_;
+	    readStdinInBackground_ = !readStdinCommands_;
+	    stdinFramed_ = framed;
 	}
 
-	if (cmdLineParams.isEmpty())
+	if (benchmarkEvents_ > 0)
 	{
-	    printUsage();
+	    openMidiPorts();
+	    runBenchmarks();
 	    systemRequestedQuit();
 	}
-	else
+	else if (replayFile_.isNotEmpty())
 	{
-	    startTimer(200);
+	    openMidiPorts();
+	    runReplay();
+	    systemRequestedQuit();
 	}
-    }
-
-    void timerCallback() override
-    {
-	if (fullMidiInName_.isNotEmpty() && !MidiInput::getDevices().contains(fullMidiInName_))
+	else if (analyseFile_.isNotEmpty())
 	{
-	    std::cerr << "MIDI input port \"" << fullMidiInName_ << "\" got disconnected, waiting." << std::endl;
-
-	    fullMidiInName_ = String();
-	    midiIn_ = nullptr;
+	    runAnalysis();
+	    systemRequestedQuit();
 	}
-	else if ((midiInName_.isNotEmpty() && midiIn_ == nullptr))
+	else if (soakMinutes_ > 0)
 	{
-	    if (tryToConnectMidiInput())
-	    {
-		std::cerr << "Connected to MIDI input port \"" << fullMidiInName_ << "\"." << std::endl;
-	    }
+	    openMidiPorts();
+	    runSoak();
+	    systemRequestedQuit();
 	}
-
-#if (JUCE_LINUX || JUCE_MAC)
-	if (virtMidiOutName_.isNotEmpty() && midiOutName_.isEmpty() && midiOut_ == nullptr)
+	else if (heartbeatLossMinutes_ > 0)
 	{
-
-	    midiOut_ = MidiOutput::createNewDevice(virtMidiOutName_);
-	    if (midiOut_ == nullptr)
-	    {
-		std::cerr << "Couldn't create virtual MIDI output port \"" << virtMidiOutName_ << "\"" << std::endl;
-	    }
-#else
-	    std::cerr << "Virtual MIDI output ports are not supported on Windows" << std::endl;
-	    exit;
-#endif
+	    runHeartbeatLoss();
+	    systemRequestedQuit();
 	}
-
-	if (midiOutName_.isNotEmpty() && virtMidiOutName_.isEmpty() && midiOut_ == nullptr)
+	else if (selfTesting_)
 	{
-	    int index = MidiOutput::getDevices().indexOf(midiOutName_);
-	    if (index >= 0)
+	    runSelfTest();
+	    systemRequestedQuit();
+	}
+	else if (scaleSeconds_ > 0)
+	{
+	    runScaleBenchmark();
+	    systemRequestedQuit();
+	}
+	else if (simulating_)
+	{
+	    runSimulator();
+	    systemRequestedQuit();
+	}
+	else if (journalShowFile_ != File())
+	{
+	    showJournal();
+	    systemRequestedQuit();
+	}
+	else if (cmdLineParams.isEmpty())
+	{
+	    openMidiPorts();
+	    printUsage();
+	    systemRequestedQuit();
+	}
+	else
+	{
+	    if (ledPluginPath_.isNotEmpty() && ledPlugin_.load(ledPluginPath_, ledPluginArgs_))
 	    {
-		midiOut_ = MidiOutput::openDevice(index);
+		std::cerr << "Sending LEDs to plugin " << ledPluginPath_ << std::endl;
+		ledOutput_.setSink(&ledPlugin_);
 	    }
-	    else
+	    else if (gpioPins_.size() > 0 && openGpioLeds())
+	    {
+		ledOutput_.setSink(&gpioLeds_);
+	    }
+	    else if (spiDevice_.isNotEmpty() && openSpiLeds())
+	    {
+		ledOutput_.setSink(&spiLeds_);
+	    }
+	    else if (dinDevice_.isNotEmpty() && openDinLeds())
+	    {
+		ledOutput_.setSink(&dinLeds_);
+	    }
+	    else if (useLedPort_ && openLedPort())
+	    {
+		ledOutput_.setSink(&ledPort_);
+	    }
+	    startup_.reached(StartupTimes::LedOutput);
+	    if (useReactor_)
+	    {
+		signalWakeFd = reactor_.getWakeFd();
+	    }
+	    if (gigMode_)
+	    {
+		startGigMode();
+	    }
+	    std::signal(SIGINT, signalQuit);
+	    std::signal(SIGTERM, signalQuit);
+	    std::signal(SIGUSR1, signalSpans);
+	    if (!journalOff_ && !journal_.isOpen() && !journal_.open(EventJournal::getDefaultFile()))
+	    {
+		std::cerr << "Couldn't create journal file " << EventJournal::getDefaultFile().getFullPathName() << std::endl;
+	    }
+	    journal_.record(EventJournal::Started, 0, (int32) getpid());
+	    for (auto* engine : engines_)
 	    {
-		StringArray devices = MidiOutput::getDevices();
-		for (int i = 0; i < devices.size(); ++i)
+		// the command line connects them before there's a journal
+		if (engine->connected_)
 		{
-		    if (devices[i].containsIgnoreCase(midiOutName_))
-		    {
-			midiOut_ = MidiOutput::openDevice(i);
-			midiOutName_ = devices[i];
-			break;
-		    }
+		    journal_.record(EventJournal::Connected, engine->index_, engine->sendPort_);
 		}
 	    }
-	    if (midiOut_ == nullptr)
+	    preloadSession();
+	    restoreSnapshot();
+	    startup_.reached(StartupTimes::Session);
+	    startWorkers();
+	    snapshot_.start();
+	    if (useReactor_)
 	    {
-		std::cerr << "Couldn't find MIDI output port \"" << midiOutName_ << "\"" << std::endl;
+		// its tick checks the MIDI output too, so it's opened before that runs
+		openMidiPorts();
 	    }
-	}
-
-	if (currentReceivePort_ < 0 || currentSendPort_ < 0) {
-	    if (tryToConnectOsc())
+	    if (useOscSendThread_)
+	    {
+		startOscSendThread();
+	    }
+	    // the first pass binds the OSC port and pings straight away, while we
+	    // open the MIDI ports here
+	    controlThread_.startThread();
+	    if (readStdinInBackground_)
+	    {
+		stdinReader_.start(stdinFramed_, [this] { wakeControlThread(); });
+	    }
+	    if (reloadPrograms_)
 	    {
-		std::cerr << "Connected to OSC ports " << (int)currentReceivePort_ << " (in), " << (int) currentSendPort_ << " (out) and " << (int) currentLedSendPort_ << " (led)" << std::endl;
-		heartbeat_ = 5;
+		startProgramWatcher();
 	    }
+	    if (!useReactor_)
+	    {
+		openMidiPorts();
+		threadTuning_.apply();
+		startTimer(200);
+		startMidiHotplug();
+	    }
+	    if (loopbackEvents_ > 0)
+	    {
+		startLoopback();
+	    }
+	}
+    }
+
+    // "gig", before any of the threads it schedules start: what worked and
+    // what didn't is said once, the scheduling as each thread starts
+    void startGigMode()
+    {
+	StringArray done, failed;
+	String error;
+	if (gig_.holdDmaLatency(error))
+	{
+	    done.add("CPU DMA latency held at 0");
 	}
 	else
 	{
-	    // heartbeat
-	    if (heartbeat_ == 0)
+	    failed.add("/dev/cpu_dma_latency (" + error + ")");
+	}
+	if (gigGovernor_)
+	{
+	    String notSwitched;
+	    const int numSet = gig_.setPerformanceGovernor(gigCpus_.isZero() ? GigMode::getOnlineCpus() : gigCpus_, notSwitched);
+	    if (numSet > 0)
 	    {
-		oscSender.send("/ping", (String) "osc.udp://localhost:" + std::to_string(currentReceivePort_) + "/", (String) "/heartbeat");
+		done.add("performance governor on " + String(numSet) + " CPUs");
 	    }
-	    else if (heartbeat_ < -5) // give a second before we try reconnecting
+	    if (notSwitched.isNotEmpty())
 	    {
-		// we've lost heartbeat, try reconnecting
-		currentReceivePort_ = -1;
-		currentSendPort_ = -1;
-		if (tryToConnectOsc())
-		{
-		    std::cerr << "Reconnected to OSC ports " << (int)currentReceivePort_ << " (in) and " << (int) currentSendPort_ << " (out)" << std::endl;
-		    heartbeat_ = 5;
-		}
+		failed.add("the governor of CPUs " + notSwitched);
 	    }
-	    else
+	    else if (numSet == 0)
+	    {
+		failed.add("a governor (no cpufreq)");
+	    }
+	}
+	if (!memoryLocked_)
+	{
+	    memoryLocked_ = ThreadTuning::lockMemory();
+	}
+	if (memoryLocked_)
+	{
+	    done.add("memory locked");
+	}
+	else
+	{
+	    failed.add("memory locked");
+	}
+	static const char* const threads[] = { "midi", "control", "osc", "leds" };
+	StringArray scheduled;
+	for (int i = 0; i < numElementsInArray(threads); ++i)
+	{
+	    if (!threadTuning_.has(threads[i]) && threadTuning_.add(threads[i], ThreadTuning::PolicyFifo, gigPriority - i, gigCpuList_))
 	    {
-		--heartbeat_;
+		scheduled.add(threads[i]);
 	    }
 	}
+	if (scheduled.size() > 0)
+	{
+	    done.add(scheduled.joinIntoString(", ") + " SCHED_FIFO" + (gigCpuList_.isEmpty() ? String() : " on CPUs " + gigCpuList_));
+	}
+	logCeiling_ = LogNormal;
+	eventLog_.setCeiling(logCeiling_);
+	done.add("no verbose log");
+
+	std::cerr << "Gig mode: " << done.joinIntoString(", ");
+	if (failed.size() > 0)
+	{
+	    std::cerr << "; couldn't get " << failed.joinIntoString(", ");
+	}
+	std::cerr << std::endl;
     }
 
-    void updateLoops()
+    void stopGigMode()
     {
-	for (auto&& loop : loops_)
+	const int numGovernors = gig_.getNumGovernorsSwitched();
+	const bool dmaLatency = gig_.isHoldingDmaLatency();
+	gig_.restore();
+	if (numGovernors > 0 || dmaLatency)
 	{
-	    updateLoopLedState(loop, loop.state_);
+	    std::cerr << "Gig mode: " << (dmaLatency ? "CPU DMA latency let go" : "")
+		      << (dmaLatency && numGovernors > 0 ? ", " : "")
+		      << (numGovernors > 0 ? String(numGovernors) + " CPUs back on their governors" : String()) << std::endl;
 	}
     }
 
-    void updateLoopLedState(Loop& loop, LoopStates newState)
+    void timerCallback() override
     {
-	switch (newState)
+	if (quitSignalled)
 	{
-	    case Unknown:
-	    case Off:
-		loop.led_.state_ = Dark;
-		loop.led_.timer_ = TIMER_OFF;
-		ledOff(loop.index_);
-		break;
-	    case WaitStart:
-	    case WaitStop:
-		loop.led_.state_ = FastBlink;
-		loop.led_.timer_ = TIMER_FASTBLINK;
-		ledOn(loop.index_);
-		break;
-	    case Recording:
-		loop.led_.state_ = Light;
-		loop.led_.timer_ = TIMER_OFF;
-		ledOn(loop.index_);
-		break;
-	    case Overdubbing:
-		loop.led_.state_ = Light;
-		loop.led_.timer_ = TIMER_OFF;
-		ledOn(loop.index_);
-		break;
-	    case Inserting:
-		loop.led_.state_ = FastBlink;
-		loop.led_.timer_ = TIMER_FASTBLINK;
-		ledOn(loop.index_);
-		ledOn(INSERT);
-		break;
-	    case Replacing:
-		loop.led_.state_ = FastBlink;
-		loop.led_.timer_ = TIMER_FASTBLINK;
-		ledOn(loop.index_);
-		ledOn(REPLACE);
-		break;
-	    case Substitute:
-		loop.led_.state_ = FastBlink;
-		loop.led_.timer_ = TIMER_FASTBLINK;
-		ledOn(loop.index_);
-		ledOn(SUBSTITUTE);
-		break;
-	    case Multiplying:
-		loop.led_.state_ = FastBlink;
-		loop.led_.timer_ = TIMER_FASTBLINK;
-		ledOn(loop.index_);
-		ledOn(MULTIPLY);
-		break;
-	    case Delay:
-		loop.led_.state_ = Light;
-		loop.led_.timer_ = TIMER_OFF;
-		ledOn(loop.index_);
-		break;
-	    case Scratching:
-		loop.led_.state_ = Light;
-		loop.led_.timer_ = TIMER_OFF;
-		ledOn(loop.index_);
-		break;
-	    case OneShot:
-		loop.led_.state_ = Light;
-		loop.led_.timer_ = TIMER_OFF;
-		ledOn(loop.index_);
-		break;
-	    case Playing:
-		if (mode_ == 0)
-		{
-		    loop.led_.state_ = Light;
-		    loop.led_.timer_ = TIMER_OFF;
-		    ledOn(loop.index_);
-		}
-		else
-		{
-		    loop.led_.state_ = Blink;
-		    loop.led_.timer_ = TIMER_BLINK;
-		    ledOn(loop.index_);
-		}
-		break;
-	    case Muted:
-	    case Paused:
-		loop.led_.state_ = Blink;
-		loop.led_.timer_ = TIMER_BLINK;
-		ledOn(loop.index_);
-		break;
-	    default:
-		loop.led_.state_ = Dark;
-		loop.led_.timer_ = TIMER_OFF;
-		ledOff(loop.index_);
-		break;
+	    stopTimer();
+	    systemRequestedQuit();
+	    return;
 	}
-
-	if (newState != loop.state_)
+	if (spansSignalled)
 	{
-	    // turn off any leds that are no longer active
-	    switch(loop.state_)
+	    spansSignalled = 0;
+	    if (!workers_.submit(&writeSpansJob, this))
 	    {
-		case Inserting:
-		    ledOff(INSERT);
-		    break;
-		case Replacing:
-		    ledOff(REPLACE);
-		    break;
-		case Substitute:
-		    ledOff(SUBSTITUTE);
-		    break;
-		case Multiplying:
-		    ledOff(MULTIPLY);
-		    break;
-		default:
-		    break;
+		writeSpans();
 	    }
 	}
-	loop.state_ = newState;
-    }
-
-    void shutdown() override
-    {
-	// Add your application's shutdown code here..
 
+	// the MIDI and OSC threads come and go with their devices and ports
+	if (!threadTuning_.isEmpty() && ++threadTuningTicks_ >= THREAD_TUNING_TICKS)
+	{
+	    threadTuningTicks_ = 0;
+	    threadTuning_.apply();
+	}
 
+	// with the announce port watched, the device scan is only a safety net
+	if (!midiHotplug_.isRunning() || ++midiPollTicks_ >= MIDI_FALLBACK_POLL_TICKS)
+	{
+	    midiPollTicks_ = 0;
+	    midiDevices_.invalidate();
+	    const ScopedLock lock(midiPortsLock_);
+	    checkMidiDevices();
+	}
     }
 
-    //==============================================================================
-    void systemRequestedQuit() override
+    // the JUCE inputs are only used where the ALSA sequencer isn't there
+    bool readsSequencer() const
     {
-	// This is called when the app is being asked to quit: you can ignore this
-	// request and let the app carry on running, or call quit() to allow the app to close.
-	quit();
+	return useReactor_ || AlsaMidiInput::isAvailable;
     }
 
-    void anotherInstanceStarted (const String& commandLine) override
+    void checkMidiDevices()
     {
-	// When another instance of the app is launched while this one is running,
-	// this method is invoked, and the commandLine parameter tells you what
-	// the other instance's command-line arguments were.
+	checkMidiInput();
+	checkMidiOutput();
+	midiThru_.refresh();
     }
-    void suspended() override {}
-    void resumed() override {}
-    void unhandledException(const std::exception*, const String&, int) override { jassertfalse; }
 
-private:
-    ApplicationCommand* findApplicationCommand(const String& param)
+    // "thru": the sequencer forwards the inputs it can see to dout
+    void openMidiThru()
     {
-	for (auto&& cmd : commands_)
+	StringArray names;
+	for (int i = 0; i < numMidiInputs_; ++i)
 	{
-	    if (cmd.param_.equalsIgnoreCase(param) || cmd.altParam_.equalsIgnoreCase(param))
-	    {
-		return &cmd;
-	    }
+	    const MidiInputSource& in = midiInputs_[i];
+	    names.add(in.virtual_ || in.raw_ || in.serial_ || in.rtp_ ? String() : in.name_);
 	}
-	return nullptr;
-    }
-
-    StringArray parseLineAsParameters(const String& line)
-    {
-	StringArray parameters;
-	if (!line.startsWith("#"))
+	const ScopedLock lock(midiPortsLock_);
+	if (!midiThru_.open(names, midiOutputs_[HardwareOut].name_))
 	{
-	    StringArray tokens;
-	    tokens.addTokens(line, true);
-	    tokens.removeEmptyStrings(true);
-	    for (String token : tokens)
-	    {
-		parameters.add(token.trimCharactersAtStart("\"").trimCharactersAtEnd("\""));
-	    }
+	    std::cerr << "Couldn't open the ALSA sequencer for MIDI thru, passing controllers on ourselves" << std::endl;
 	}
-	return parameters;
     }
 
-    void handleVarArgCommand()
+    // the ports named on the command line, opened once the control thread is
+    // binding the OSC port and pinging, rather than one after another before it
+    void openMidiPorts()
     {
-	if (currentCommand_.expectedOptions_ < 0)
+	if (!deferMidiPorts_)
 	{
-	    executeCommand(currentCommand_);
+	    return;
 	}
-    }
-
-    void parseParameters(StringArray& parameters)
-    {
-	for (String param : parameters)
+	deferMidiPorts_ = false;
+	if (readsSequencer() && !useReactor_)
 	{
-	    if (param == "--") continue;
-
-	    ApplicationCommand* cmd = findApplicationCommand(param);
-	    if (cmd)
-	    {
-		handleVarArgCommand();
-
-		currentCommand_ = *cmd;
-	    }
-	    else if (currentCommand_.command_ == NONE)
-	    {
-		File file = File::getCurrentWorkingDirectory().getChildFile(param);
-		if (file.existsAsFile())
-		{
-		    parseFile(file);
-		}
-	    }
-	    else if (currentCommand_.expectedOptions_ != 0)
-	    {
-		currentCommand_.opts_.add(param);
-		currentCommand_.expectedOptions_ -= 1;
-	    }
-
-	    // handle fixed arg commands
-	    if (currentCommand_.expectedOptions_ == 0)
+	    openSequencerInput();
+	}
+	for (int i = 0; i < numMidiInputs_ && !readsSequencer(); ++i)
+	{
+	    if (midiInputs_[i].name_.isNotEmpty() && !tryToConnectMidiInput(midiInputs_[i]))
 	    {
-		executeCommand(currentCommand_);
+		reportMissingMidiInput(midiInputs_[i]);
 	    }
 	}
-
-	handleVarArgCommand();
+	checkMidiOutput();
+	if (midiThruEnabled_)
+	{
+	    openMidiThru();
+	}
+	if (jackClientName_.isNotEmpty())
+	{
+	    openJackMidi();
+	}
+	if (meterEnabled_)
+	{
+	    openJackMeter();
+	}
+	if (jackTransportEnabled_)
+	{
+	    openJackTransport();
+	}
+	startup_.reached(StartupTimes::MidiPorts);
     }
 
-    void parseFile(File file)
+    void checkByteMidiInput(MidiInputSource& in)
     {
-	StringArray parameters;
-
-	StringArray lines;
-	file.readLines(lines);
-	for (String line : lines)
+	if (in.getByteInput()->isLost())
 	{
-	    parameters.addArray(parseLineAsParameters(line));
+	    std::cerr << "MIDI input device \"" << in.name_ << "\" got disconnected, waiting." << std::endl;
+	    closeByteMidiInput(in);
+	    inputLost((int) (&in - midiInputs_));
+	}
+	if (!in.getByteInput()->isOpen() && tryToConnectMidiInput(in))
+	{
+	    std::cerr << "Connected to MIDI input device \"" << in.name_ << "\"." << std::endl;
+	    requestLedReplay();
 	}
-
-	parseParameters(parameters);
     }
 
-    void sendMidiMessage(MidiOutput *midiOut, const MidiMessage&& msg)
+    void closeByteMidiInput(MidiInputSource& in)
     {
-	if (midiOut)
+	ByteStreamMidiInput* bytes = in.getByteInput();
+	if (bytes == nullptr)
 	{
-	    midiOut->sendMessageNow(msg);
+	    return;
 	}
-	else
+	if (useReactor_)
 	{
-	    static bool missingOutputPortWarningPrinted = false;
-	    if (!missingOutputPortWarningPrinted)
+	    for (int fd : bytes->getFileDescriptors())
 	    {
-		std::cerr << "No valid MIDI output port was specified for some of the messages" << std::endl;
-		missingOutputPortWarningPrinted = true;
+		reactor_.unwatch(fd);
 	    }
 	}
+	bytes->close();
+	in.fullName_ = String();
     }
 
-    bool checkChannel(const MidiMessage& msg, int channel)
-    {
-	return channel == 0 || msg.getChannel() == channel;
-    }
-
-    void handleIncomingMidiMessage(MidiInput*, const MidiMessage& msg) override
+    // a "raw" or "serial" input's messages, read inline with "epoll"
+    void readByteMidi(int input)
     {
-	if (!filterCommands_.isEmpty())
+	const SpanTrace::Scope span(&spans_, "midi decode");
+	ByteStreamMidiInput* bytes = midiInputs_[input].getByteInput();
+	const int64 ticks = reactor_.getWakeTicks();
+	if (bytes != nullptr && !bytes->read([this, input, ticks, bytes] (const uint8* data, int size)
+					     {
+						 handleShortMidiMessage(input, data, size, bytes->getStreamTicks() != 0 ? bytes->getStreamTicks() : ticks);
+					     }))
 	{
-	    bool filtered = false;
-	    for (ApplicationCommand& cmd : filterCommands_)
+	    // the descriptors go before the next tick's check closes them
+	    for (int fd : bytes->getFileDescriptors())
 	    {
-		switch (cmd.command_)
-		{
-		    case CHANNEL:
-			channel_ = asDecOrHex7BitValue(cmd.opts_[0]);
-			break;
-		    default:
-			// no-op
-			break;
-		}
+		reactor_.unwatch(fd);
 	    }
+	}
+    }
 
-	    if (!filtered)
+    // what the "raw" and "serial" inputs' threads queued, without "epoll"
+    void drainByteMidi()
+    {
+	ByteStreamMidiInput::Event event;
+	for (int i = 0; i < numMidiInputs_; ++i)
+	{
+	    ByteStreamMidiInput* bytes = midiInputs_[i].getByteInput();
+	    while (bytes != nullptr && bytes->popMessage(event))
 	    {
-		return;
+		handleShortMidiMessage(i, event.data_, event.size_, event.ticks_);
 	    }
 	}
+    }
 
-	if (msg.isController()) {
-	    int pedalIdx = pedalIndex(msg.getControllerValue());
-	    switch (msg.getControllerNumber()) {
-		case 104: // 1-10 pedal down
-		    lastTime_ = (Time::getCurrentTime());
-		    if (pedalIdx >= 0 && pedalIdx <= 3)
-		    {
-			sendMidiMessage(midiOut_, MidiMessage::noteOn(channel_, baseNote_+mode_+pedalIdx, (uint8)127));
-		    }
-		    else if (pedalIdx == RECORD)
-		    {
-			mode_ = mode_ > 0 ? 0 : 20;
-			if (mode_ == 0) {
-			    ledOff(pedalIdx);
-			}
-			else {
-			    ledOn(pedalIdx);
-			}
-			updateLoops();
-		    }
-		    else if (pedalIdx == UNDO)
-		    {
-			ledOn(pedalIdx);
-			sendMidiMessage(midiOut_, MidiMessage::noteOn(channel_, baseNote_+pedalIdx, (uint8)127));
-		    }
-		    else
-		    {
-			sendMidiMessage(midiOut_, MidiMessage::noteOn(channel_, baseNote_+pedalIdx, (uint8)127));
-		    }
-		    break;
-		case 105:
-		    if (pedalIdx >= 0 && pedalIdx <= 3)
-		    {
-			sendMidiMessage(midiOut_, MidiMessage::noteOff(channel_, baseNote_+mode_+pedalIdx, (uint8)0));
-		    }
-		    else if (pedalIdx == RECORD)
-		    {
-		    }
-		    else if (pedalIdx == UNDO)
-		    {
-			ledOff(pedalIdx);
-			sendMidiMessage(midiOut_, MidiMessage::noteOff(channel_, baseNote_+pedalIdx, (uint8)0));
-			updateLoops();
-		    }
-		    else
-		    {
-			sendMidiMessage(midiOut_, MidiMessage::noteOff(channel_, baseNote_+pedalIdx, (uint8)0));
-		    }
-		    break;
-		default:
-		    if (midiOut_) {
-			midiOut_->sendMessageNow(msg);
-		    }
-		break;
-	    }
+    void openJackMidi()
+    {
+	if (!jackMidi_.open(jackClientName_, jackFrom_, jackTo_, [this] () { wakeControlThread(); }))
+	{
+	    std::cerr << "Couldn't open JACK client \"" << jackClientName_ << "\", is JACK running?" << std::endl;
+	    return;
 	}
+	midiStage_.setSink(&jackMidi_, MidiOutputStage::RouteAll);
+	std::cerr << "Connected to JACK as \"" << jackClientName_ << "\", " << jackMidi_.getBufferSize() << " frames at "
+		  << jackMidi_.getSampleRate() << "Hz" << std::endl;
+    }
 
-	if (msg.isNoteOn())
+    void openJackMeter()
+    {
+	const String clientName = (jackClientName_.isNotEmpty() ? jackClientName_ : DEFAULT_JACK_CLIENT_NAME) + "_meter";
+	if (!jackMeter_.open(clientName, meterFrom_))
 	{
-	    std::cerr << "channel "  << outputChannel(msg) << "   " <<
-	    "note-on         " << outputNote(msg) << " " << output7Bit(msg.getVelocity()).paddedLeft(' ', 3) << std::endl;
+	    std::cerr << "Couldn't open JACK client \"" << clientName << "\", is JACK running?" << std::endl;
+	    return;
 	}
-	else if (msg.isNoteOff())
+	std::cerr << "Metering JACK input into \"" << clientName << "\" on " << meterLeds_.size() << " LEDs" << std::endl;
+	if (onsetEnabled_)
 	{
-	    std::cerr << "channel "  << outputChannel(msg) << "   " <<
-	    "note-off        " << outputNote(msg) << " " << output7Bit(msg.getVelocity()).paddedLeft(' ', 3) << std::endl;
+	    startOnsetDetector();
 	}
-	else if (msg.isAftertouch())
+    }
+
+    void startOnsetDetector()
+    {
+	onsetDetector_.start(jackMeter_, onsetThreshold_, onsetSensitivity_, [this] () { wakeControlThread(); });
+    }
+
+    void drainOnsets()
+    {
+	OnsetDetector::Onset onset;
+	while (onsetDetector_.popOnset(onset))
 	{
-	    std::cerr << "channel "  << outputChannel(msg) << "   " <<
-	    "poly-pressure   " << outputNote(msg) << " " << output7Bit(msg.getAfterTouchValue()).paddedLeft(' ', 3) << std::endl;
+	    handleOnset(onset);
 	}
-	else if (msg.isController())
+    }
+
+    // an attack on the meter's input: record on the selected loop if it's
+    // empty, with SooperLooper's trigger latency raised for that one hit by
+    // how long ago the attack came in, so the loop starts on it rather than
+    // after it. Its own trigger latency is only known if it's mirrored.
+    void handleOnset(const OnsetDetector::Onset& onset)
+    {
+	Engine& engine = activeEngine();
+	const int loop = engine.selectedLoop_;
+	const uint32 now = time_.getMillisecondCounter();
+	if (!engine.connected_ || loop < 0 || engine.loops_.getState(loop) != Off || (int32) (onsetHoldUntil_ - now) > 0)
 	{
-	    std::cerr << "channel "  << outputChannel(msg) << "   " <<
-	    "control-change   " << output7Bit(msg.getControllerNumber()).paddedLeft(' ', 3) << " "
-	    << output7Bit(msg.getControllerValue()).paddedLeft(' ', 3) << std::endl;
+	    ++numOnsetsIgnored_;
+	    return;
 	}
-	else if (msg.isProgramChange())
+	onsetHoldUntil_ = now + onsetHoldMs;
+
+	const int64 lateFrames = onset.framesAgo_ + jackMeter_.getBufferSize()
+	    + (int64) (Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - onset.ticks_) * jackMeter_.getSampleRate());
+	float latency = 0;
+	engine.controls_.get(loop, SooperLooperControls::triggerLatency, latency);
+
+	char set[32], hit[32];
+	std::snprintf(set, sizeof(set), "/sl/%d/set", loop);
+	std::snprintf(hit, sizeof(hit), "/sl/%d/hit", loop);
+	OscBundleSender bundle(engine.sender_);
+	OscPacket packet;
+	packet.size_ = OscMessageWriter(packet).begin(set, "sf").addString("trigger_latency").addFloat32(latency + (float) lateFrames).size();
+	bundle.add(packet);
+	packet.size_ = OscMessageWriter(packet).begin(hit, "s").addString("record").size();
+	bundle.add(packet);
+	packet.size_ = OscMessageWriter(packet).begin(set, "sf").addString("trigger_latency").addFloat32(latency).size();
+	bundle.add(packet);
+	++numOnsetRecords_;
+	std::cerr << "Onset (flux " << String(onset.flux_, 3) << ") recording loop " << loop << " from "
+		  << String(lateFrames * 1000.0 / jmax(1, jackMeter_.getSampleRate()), 1) << "ms back" << std::endl;
+    }
+
+    // control thread, with "meter off"
+    void closeJackMeter()
+    {
+	onsetDetector_.stop();
+	onsetEnabled_ = meterEnabled_ = false;
+	jackMeter_.close();
+	if (meterTimer_ >= 0)
 	{
-	    std::cerr << "channel "  << outputChannel(msg) << "   " <<
-	    "program-change   " << output7Bit(msg.getProgramChangeNumber()).paddedLeft(' ', 7) << std::endl;
+	    wheel_.cancel(meterTimer_);
 	}
-	else if (msg.isChannelPressure())
+	if (meterDrawn_)
 	{
-	    std::cerr << "channel "  << outputChannel(msg) << "   " <<
-	    "channel-pressure " << output7Bit(msg.getChannelPressureValue()).paddedLeft(' ', 7) << std::endl;
+	    for (int led : meterLeds_)
+	    {
+		setLed(led, false);
+	    }
+	    commitLeds();
+	    meterDrawn_ = false;
 	}
-	else if (msg.isPitchWheel())
+	meterRmsStep_ = meterPeakStep_ = -1;
+	meterClipped_ = false;
+	meterLeds_.clear();
+    }
+
+    void openJackTransport()
+    {
+	const String clientName = (jackClientName_.isNotEmpty() ? jackClientName_ : DEFAULT_JACK_CLIENT_NAME) + "_transport";
+	if (!jackTransport_.open(clientName))
 	{
-	    std::cerr << "channel "  << outputChannel(msg) << "   " <<
-	    "pitch-bend       " << output14Bit(msg.getPitchWheelValue()).paddedLeft(' ', 7) << std::endl;
+	    std::cerr << "Couldn't open JACK client \"" << clientName << "\", is JACK running?" << std::endl;
+	    return;
 	}
-	else if (msg.isMidiClock())
+	std::cerr << "Following JACK transport as \"" << clientName << "\"" << std::endl;
+	jackTransport_.poll(time_.getHighResolutionTicks());
+	// the progress is carried on by another clock from here
+	restartProgress();
+	if (periodicTimer_ >= 0)
 	{
-	    std::cerr << "midi-clock" << std::endl;
+	    wheel_.schedule(periodicTimer_, time_.getMillisecondCounter());
 	}
-	else if (msg.isMidiStart())
+    }
+
+    // control thread, with "jtransport off"
+    void closeJackTransport()
+    {
+	jackTransportEnabled_ = false;
+	if (jackTransport_.isOpen())
 	{
-	    std::cerr << "start" << std::endl;
+	    jackTransport_.close();
+	    restartProgress();
 	}
-	else if (msg.isMidiStop())
+    }
+
+    // the clock the loop progress is carried on by: JACK's frames if it's
+    // there, they're what SooperLooper's position runs on
+    int64 getProgressTicks()
+    {
+	return jackTransport_.isOpen() ? jackTransport_.getAudioTicks() : time_.getHighResolutionTicks();
+    }
+
+    // the level as the number of meterLeds_ it reaches, 0 below meterFloorDb
+    int toMeterStep(float level) const
+    {
+	const float db = JackMeter::toDecibels(level, meterFloorDb);
+	return jlimit(0, meterLeds_.size(), roundToInt((db - meterFloorDb) / -meterFloorDb * meterLeds_.size()));
+    }
+
+    // draws the bar when a step, the peak or clip changed, and comes back in meterMs_
+    void renderMeter(uint32 now)
+    {
+	const JackMeter::Levels levels = jackMeter_.take();
+	if (levels.peak_ >= 1.0f)
 	{
-	    std::cerr << "stop" << std::endl;
+	    numMeterClips_ += (int32) (meterClipUntil_ - now) > 0 ? 0 : 1;
+	    meterClipUntil_ = now + meterClipHoldMs;
 	}
-	else if (msg.isMidiContinue())
+	const int rmsStep = toMeterStep(levels.rms_);
+	const int peakStep = toMeterStep(levels.peak_);
+	const bool clipped = (int32) (meterClipUntil_ - now) > 0;
+	if (rmsStep != meterRmsStep_ || peakStep != meterPeakStep_ || clipped != meterClipped_)
 	{
-	    std::cerr << "continue" << std::endl;
+	    meterRmsStep_ = rmsStep;
+	    meterPeakStep_ = peakStep;
+	    meterClipped_ = clipped;
+	    const int last = meterLeds_.size() - 1;
+	    for (int i = 0; i <= last; ++i)
+	    {
+		setLed(meterLeds_[i], i < rmsStep || i == peakStep - 1 || (i == last && clipped));
+	    }
+	    commitLeds();
+	    meterDrawn_ = true;
 	}
-	else if (msg.isActiveSense())
+	wheel_.scheduleIn(meterTimer_, meterMs_, now);
+    }
+
+    // control thread: the tuner takes its LEDs and the display over, keeping
+    // what they'd have shown meanwhile for when it's turned off
+    void setTuning(bool on)
+    {
+	if (on == tuning_)
 	{
-	    std::cerr << "active-sensing" << std::endl;
+	    return;
 	}
-	else if (msg.getRawDataSize() == 1 && msg.getRawData()[0] == 0xff)
+	if (on && !jackMeter_.isOpen())
 	{
-	    std::cerr << "reset" << std::endl;
+	    std::cerr << "The tuner listens to the \"meter\" input, give that first" << std::endl;
+	    return;
 	}
-	else if (msg.isSysEx())
-	{
-	    std::cerr << "system-exclusive";
 
-	    if (!useHexadecimalsByDefault_)
-	    {
-		std::cerr << " hex";
-	    }
-
-	    int size = msg.getSysExDataSize();
-	    const uint8* data = msg.getSysExData();
-	    while (size--)
+	if (on)
+	{
+	    onsetDetector_.stop();      // it reads the same ring
+	    tuner_.start(jackMeter_);
+	    for (int i = 0; i < LedChangeFilter::maxLeds; ++i)
 	    {
-		uint8 b = *data++;
-		std::cerr << " " << output7BitAsHex(b);
+		tunerOwns_[i] = tunerLeds_.contains(i) || i == tunerSharpLed_;
+		tunerSaved_[i] = ledFrame_.isOn(i);
 	    }
+	    tuning_ = true;
+	    tunerNote_ = tunerNeedle_ = -2;
+	    wheel_.schedule(tunerTimer_, time_.getMillisecondCounter());
+	    return;
+	}
 
-	    if (!useHexadecimalsByDefault_)
+	tuner_.stop();
+	wheel_.cancel(tunerTimer_);
+	tuning_ = false;
+	for (int i = 0; i < LedChangeFilter::maxLeds; ++i)
+	{
+	    if (tunerOwns_[i])
 	    {
-		std::cerr << " dec" << std::endl;
+		setLed(i, tunerSaved_[i]);
 	    }
 	}
-	else if (msg.isQuarterFrame())
-	{
-	    std::cerr << "time-code " << output7Bit(msg.getQuarterFrameSequenceNumber()).paddedLeft(' ', 2) << " " << output7Bit(msg.getQuarterFrameValue()) << std::endl;
-	}
-	else if (msg.isSongPositionPointer())
-	{
-	    std::cerr << "song-position " << output14Bit(msg.getSongPositionPointerMidiBeat()).paddedLeft(' ', 5) << std::endl;
-	}
-	else if (msg.getRawDataSize() == 2 && msg.getRawData()[0] == 0xf3)
-	{
-	    std::cerr << "song-select " << output7Bit(msg.getRawData()[1]).paddedLeft(' ', 3) << std::endl;
-	}
-	else if (msg.getRawDataSize() == 1 && msg.getRawData()[0] == 0xf6)
+	selectLoop();
+	commitLeds();
+	sendTunerNote("", 0);
+	if (onsetEnabled_)
 	{
-	    std::cerr << "tune-request" << std::endl;
+	    startOnsetDetector();
 	}
     }
 
-    String output7BitAsHex(int v)
+    void drawTunerLed(int index, bool on)
     {
-	return String::toHexString(v).paddedLeft('0', 2).toUpperCase();
+	ledFrame_.set(index, on, TIMER_OFF, on ? Light : Dark, on ? Light : Dark);
     }
 
-    String output7Bit(int v)
+    // the note's name and cents off it, for displays that can show them
+    void sendTunerNote(const char* name, float cents)
     {
-	if (useHexadecimalsByDefault_)
-	{
-	    return output7BitAsHex(v);
-	}
-	else
+	if (pushesToDisplays())
 	{
-	    return String(v);
+	    OscPacket packet;
+	    packet.size_ = OscMessageWriter(packet).begin("/tuner", "sf").addString(name).addFloat32(cents).size();
+	    ledSubscribers_.send(packet, LedSubscribers::TunerUpdates);
+	    ledMulticast_.send(packet);
 	}
     }
 
-    String output14BitAsHex(int v)
+    // draws the latest pitch when its note or needle moved; without one the
+    // needle goes out and the display keeps the last note
+    void renderTuner(uint32 now)
     {
-	return String::toHexString(v).paddedLeft('0', 4).toUpperCase();
+	static const char* const names[] = { "C", "C#", "D", "D#", "E", "F", "F#", "G", "G#", "A", "A#", "B" };
+	static const int letters[] = { 1, 1, 2, 2, 3, 4, 4, 5, 5, 6, 6, 7 };
+
+	const float frequency = tuner_.getFrequency();
+	float cents = 0;
+	const int note = frequency > 0 ? YinPitch::toNote(frequency, cents) : -1;
+	const int centre = (tunerLeds_.size() - 1) / 2;
+	const int needle = note < 0 ? -1
+	    : std::abs(cents) <= tunerInTuneCents ? centre
+	    : jlimit(0, tunerLeds_.size() - 1, centre + (cents < 0 ? -1 : 1) * jmax(1, roundToInt(std::abs(cents) / 50.0f * centre)));
+	if (note != tunerNote_ || needle != tunerNeedle_)
+	{
+	    for (int i = 0; i < tunerLeds_.size(); ++i)
+	    {
+		drawTunerLed(tunerLeds_[i], i == needle);
+	    }
+	    if (note >= 0)
+	    {
+		const int pitchClass = note % 12;
+		ledFrame_.setDisplay(letters[pitchClass] * 10 + jlimit(0, 9, note / 12 - 1));
+		if (tunerSharpLed_ >= 0)
+		{
+		    drawTunerLed(tunerSharpLed_, names[pitchClass][1] == '#');
+		}
+		const String name = String(names[pitchClass]) + String(note / 12 - 1);
+		sendTunerNote(name.toRawUTF8(), cents);
+	    }
+	    commitLeds();
+	    tunerNote_ = note < 0 && tunerNote_ >= 0 ? tunerNote_ : note;
+	    tunerNeedle_ = needle;
+	}
+	wheel_.scheduleIn(tunerTimer_, tunerMs_, now);
     }
 
-    String output14Bit(int v)
+    // what "play ... in" had come in, at the times it was due
+    void drainPlayedMidi()
     {
-	if (useHexadecimalsByDefault_)
+	MidiFilePlayer::Event event;
+	while (midiPlayer_.popInput(event))
 	{
-	    return output14BitAsHex(v);
-	}
-	else
-	{
-	    return String(v);
+	    handleShortMidiMessage(0, event.data_, event.size_, event.ticks_);
 	}
     }
 
-    String outputNote(const MidiMessage& msg)
+    void drainJackMidi()
     {
-	if (noteNumbersOutput_)
-	{
-	    return output7Bit(msg.getNoteNumber()).paddedLeft(' ', 4);
-	}
-	else
+	JackMidi::Event event;
+	while (jackMidi_.popInput(event))
 	{
-	    return MidiMessage::getMidiNoteName(msg.getNoteNumber(), true, true, octaveMiddleC_).paddedLeft(' ', 4);
+	    handleShortMidiMessage(0, event.data_, event.size_, event.ticks_);
 	}
     }
 
-    String outputChannel(const MidiMessage& msg)
+    // a message from JACK, a rawmidi device or a UART, handled right here on the
+    // control thread like the epoll shortcut: pedals and mapped expression
+    // controllers straight away, the rest the usual way
+    void handleShortMidiMessage(int input, const uint8* data, int size, int64 ticks)
     {
-	return output7Bit(msg.getChannel()).paddedLeft(' ', 2);
+	// already on the control thread, pedals are handled there and then
+	runMidiInputStages({data, size, input, ticks}, [this] (const PedalEvent& event) { handlePedalEvent(event); return true; });
     }
 
-    bool tryToConnectMidiInput()
+    void checkMidiOutput()
     {
-	MidiInput* midi_input = nullptr;
-	String midi_input_name;
-
-	int index = MidiInput::getDevices().indexOf(midiInName_);
-	if (index >= 0)
-	{
-	    midi_input = MidiInput::openDevice(index, this);
-	    midi_input_name = midiInName_;
-	}
-	else
+	bool opened = false;
+	for (int role = 0; role < numMidiOutputRoles; ++role)
 	{
-	    StringArray devices = MidiInput::getDevices();
-	    for (int i = 0; i < devices.size(); ++i)
+	    if (midiOutputs_[role].name_.isNotEmpty() && midiOutputs_[role].output_ == nullptr)
 	    {
-		if (devices[i].containsIgnoreCase(midiInName_))
-		{
-		    midi_input = MidiInput::openDevice(i, this);
-		    midi_input_name = devices[i];
-		    break;
-		}
+		opened = openMidiOutput((MidiOutputRole) role) || opened;
 	    }
 	}
-
-	if (midi_input)
+	if (opened)
 	{
-	    midi_input->start();
-	    midiIn_ = midi_input;
-	    fullMidiInName_ = midi_input_name;
-	    return true;
+	    updateMidiRoutes();
 	}
-
-	return false;
     }
 
-    bool tryToConnectOsc() {
-	if (currentSendPort_ < 0) {
-	    if (oscSender.connect ("127.0.0.1", oscSendPort_)) {
-		std::cerr << "Successfully connected to OSC Send port " << (int)oscSendPort_ << std::endl;
-		currentSendPort_ = oscSendPort_;
-	    }
-	}
-
-	if (currentReceivePort_ < 0) {
-	    connect();
-	}
-
-	if (currentSendPort_ > 0 && currentReceivePort_ > 0) {
-	    if (!pinged_)
+    bool isMidiOutputMissing() const
+    {
+	for (auto&& port : midiOutputs_)
+	{
+	    if (port.name_.isNotEmpty() && port.output_ == nullptr)
 	    {
-		oscSender.send("/ping", (String) "osc.udp://localhost:" + std::to_string(currentReceivePort_) + "/", (String) "/pingack");
+		return true;
 	    }
-	    return true;
 	}
-
 	return false;
     }
 
-    bool tryToConnectLedOsc() {
-	if (currentLedSendPort_ < 0) {
-	    if (oscLedSender.connect ("127.0.0.1", oscLedSendPort_)) {
-		std::cerr << "Successfully connected to OSC LED Send port " << (int)oscLedSendPort_ << std::endl;
-		currentLedSendPort_ = oscLedSendPort_;
+    bool openMidiOutput(MidiOutputRole role)
+    {
+	MidiOutputPort& port = midiOutputs_[role];
+	if (role == VirtualOut)
+	{
+#if (JUCE_LINUX || JUCE_MAC)
+	    port.output_ = MidiOutput::createNewDevice(port.name_);
+	    if (port.output_ == nullptr)
+	    {
+		std::cerr << "Couldn't create virtual MIDI output port \"" << port.name_ << "\"" << std::endl;
+	    }
+#else
+	    std::cerr << "Virtual MIDI output ports are not supported on Windows" << std::endl;
+	    port.name_ = String();
+#endif
+	}
+	else
+	{
+	    String fullName;
+	    const int index = midiDevices_.findOutput(port.name_, fullName);
+	    if (index >= 0)
+	    {
+		port.output_ = MidiOutput::openDevice(index);
+		port.name_ = fullName;
+	    }
+	    if (port.output_ == nullptr)
+	    {
+		std::cerr << "Couldn't find MIDI output port \"" << port.name_ << "\"" << std::endl;
 	    }
 	}
+	return port.output_ != nullptr;
+    }
 
-	if (currentLedSendPort_ > 0) {
-	    return true;
+    // hands the open ports and their routes to midiStage_
+    void updateMidiRoutes()
+    {
+	MidiOutput* outputs[numMidiOutputRoles];
+	int routes[numMidiOutputRoles];
+	for (int role = 0; role < numMidiOutputRoles; ++role)
+	{
+	    outputs[role] = midiOutputs_[role].output_;
+	    routes[role] = midiOutputs_[role].routes_;
 	}
-	return false;
+	midiStage_.setOutputs(outputs, routes, numMidiOutputRoles);
     }
 
-    void executeCommand(ApplicationCommand& cmd)
+    void checkMidiInput()
     {
-	switch (cmd.command_) {
-	case NONE:
-	    break;
-	case LIST:
-	    std::cerr << "MIDI Input devices:" << std::endl;
-	    for (auto&& device : MidiInput::getDevices())
+	for (int i = 0; i < numMidiInputs_; ++i)
+	{
+	    MidiInputSource& in = midiInputs_[i];
+	    if (in.getByteInput() != nullptr)
 	    {
-		std::cerr << device << std::endl;
+		checkByteMidiInput(in);
+		continue;
 	    }
-	    std::cerr << "MIDI Output devices:" << std::endl;
-	    for (auto&& device : MidiOutput::getDevices())
+	    // our own sequencer port follows its source by itself
+	    if (readsSequencer())
 	    {
-		std::cerr << device << std::endl;
+		continue;
 	    }
-	    systemRequestedQuit();
-	    break;
-	case CHANNEL:
-	    channel_ = asDecOrHex7BitValue(cmd.opts_[0]);
-	    break;
-	case DEVICE_IN:
+	    if (!in.virtual_ && in.fullName_.isNotEmpty() && !midiDevices_.hasInput(in.fullName_))
 	    {
-		midiIn_ = nullptr;
-		midiInName_ = cmd.opts_[0];
+		std::cerr << "MIDI input port \"" << in.fullName_ << "\" got disconnected, waiting." << std::endl;
 
-		if (!tryToConnectMidiInput())
-		{
-		    std::cerr << "Couldn't find MIDI input port \"" << midiInName_ << "\", waiting." << std::endl;
-		}
-		break;
+		in.fullName_ = String();
+		in.input_ = nullptr;
+		inputLost(i);
 	    }
-	case DEVICE_OUT:
+	    else if ((in.name_.isNotEmpty() && in.input_ == nullptr))
 	    {
-		midiOut_ = nullptr;
-		midiOutName_ = cmd.opts_[0];
-
-		if (virtMidiOutName_.isNotEmpty())
+		if (tryToConnectMidiInput(in))
 		{
-		    std::cerr << "Cannot use both a dout and a vout argument" << std::endl;
-		    break;
+		    std::cerr << "Connected to MIDI input port \"" << in.fullName_ << "\"." << std::endl;
+		    requestLedReplay();
 		}
+	    }
+	}
+    }
 
-		int index = MidiOutput::getDevices().indexOf(midiOutName_);
-		if (index >= 0)
+    //==============================================================================
+    // The control thread's deferred work is on one timing wheel, created as it
+    // starts: each engine's connection check when its heartbeat, reconnect,
+    // poll or lease is next due, its predictions when the first one times out,
+    // its pedal commands when one's due to be asked about or sent again,
+    // and the few periodic jobs only while they have anything to do. Between
+    // deadlines the control thread sleeps.
+    void createTimers()
+    {
+	const uint32 now = time_.getMillisecondCounter();
+	for (auto* engine : engines_)
+	{
+	    if (idlePower_)
+	    {
+		engine->heartbeat_.setPingInterval(idlePingMs_);
+	    }
+	    engine->checkTimer_ = wheel_.create([this, engine] (uint32 now)
+	    {
+		checkEngineConnection(*engine);
+		scheduleEngineCheck(*engine, now);
+	    });
+	    engine->predictionTimer_ = wheel_.create([this, engine] (uint32 now)
+	    {
+		// SooperLooper said nothing, so it didn't change the loop
+		engine->predictions_.expire(now, [this, engine] (int loop, LoopStates previous)
+		{
+		    setLoopState(*engine, loop, previous);
+		});
+		const int wait = engine->predictions_.getMsUntilNextExpiry(now);
+		if (wait >= 0)
 		{
-		    midiOut_ = MidiOutput::openDevice(index);
+		    wheel_.scheduleIn(engine->predictionTimer_, wait, now);
 		}
-		else
+	    });
+	    engine->deliveryTimer_ = wheel_.create([this, engine] (uint32 now)
+	    {
+		processDeliveries(*engine, now);
+		const int wait = engine->deliveries_.getMsUntilNext(now);
+		if (wait >= 0)
 		{
-		    StringArray devices = MidiOutput::getDevices();
-		    for (int i = 0; i < devices.size(); ++i)
-		    {
-			if (devices[i].containsIgnoreCase(midiOutName_))
-			{
-			    midiOut_ = MidiOutput::openDevice(i);
-			    midiOutName_ = devices[i];
-			    break;
-			}
-		    }
+		    wheel_.scheduleIn(engine->deliveryTimer_, wait, now);
 		}
+	    });
+	}
+	// the receive port is shared by all engines, they're checked once it's bound
+	receivePortTimer_ = wheel_.create([this] (uint32 now)
+	{
+	    connect();
+	    if (currentReceivePort_ < 0)
+	    {
+		wheel_.scheduleIn(receivePortTimer_, receivePortRetryMs, now);
+		return;
+	    }
+	    for (auto* engine : engines_)
+	    {
+		wheel_.schedule(engine->checkTimer_, now);
+	    }
+	});
+	expiryTimer_ = wheel_.create([this] (uint32 now)
+	{
+	    replySenders_.expire();
+	    ledSubscribers_.expire();
+	    controlSubscribers_.expire();
+	    if (ledMulticast_.isOpen())
+	    {
+		ledMulticast_.sendVersion(ledChanges_.getVersion());
+	    }
+	    wheel_.scheduleIn(expiryTimer_, idlePower_ ? idleExpiryIntervalMs : expiryIntervalMs, now);
+	});
+	periodicTimer_ = wheel_.create([this] (uint32 now) { runPeriodicJobs(now); });
+	progressTimer_ = wheel_.create([this] (uint32 now) { renderProgress(now); });
+	cycleTimer_ = wheel_.create([this] (uint32 now) { emitCycles(now); });
+	netClockTimer_ = wheel_.create([this] (uint32 now) { sendNetClockRequest(now); });
+	if (netClockHost_.isNotEmpty())
+	{
+	    wheel_.scheduleIn(netClockTimer_, 0, time_.getMillisecondCounter());
+	}
+	cycles_.addListener(this);
+	meterTimer_ = wheel_.create([this] (uint32 now) { renderMeter(now); });
+	tunerTimer_ = wheel_.create([this] (uint32 now) { renderTuner(now); });
+	receivePortDrainTimer_ = wheel_.create([this] (uint32) { closeOldOscInput(); });
+	oscResyncTimer_ = wheel_.create([this] (uint32) { resyncLoops(); });
+	ledReplayTimer_ = wheel_.create([this] (uint32 now) { sendLedReplayChunk(now); });
+	presenceTimer_ = wheel_.create([this] (uint32 now)
+	{
+	    checkPresence();
+	    if (presenceEnabled_)
+	    {
+		wheel_.scheduleIn(presenceTimer_, hasStandby() ? standbyCheckMs : presenceCheckMs, now);
+	    }
+	});
 
-		if (midiOut_ == nullptr)
-		{
-		    std::cerr << "Couldn't find MIDI output port \"" << midiOutName_ << "\"" << std::endl;
-		}
-		break;
+	if (currentReceivePort_ < 0)
+	{
+	    wheel_.schedule(receivePortTimer_, now);
+	}
+	else
+	{
+	    for (auto* engine : engines_)
+	    {
+		wheel_.schedule(engine->checkTimer_, now);
 	    }
+	}
+	wheel_.scheduleIn(expiryTimer_, idlePower_ ? idleExpiryIntervalMs : expiryIntervalMs, now);
+	wheel_.schedule(periodicTimer_, now);
+	if (progressMode_ != ProgressOff)
+	{
+	    restartProgress();
+	}
+	if (meterLeds_.size() > 0)
+	{
+	    wheel_.schedule(meterTimer_, now);
+	}
+	if (presenceEnabled_)
+	{
+	    wheel_.schedule(presenceTimer_, now);
+	}
+    }
 
-	case VIRTUAL_OUT:
+    // "presence": an input gone quiet is only reported, when it's heard
+    // again the board may have lost what its LEDs showed, so all of them go
+    // out again in the next frame
+    void enablePresence(int silenceMs)
+    {
+	presenceEnabled_ = true;
+	presenceSilenceMs_ = silenceMs;
+	for (int i = 0; i < numMidiInputs_; ++i)
+	{
+	    midiInputs_[i].presence_.restart(Time::getMillisecondCounter());
+	}
+	if (presenceTimer_ >= 0 && !wheel_.isScheduled(presenceTimer_))
+	{
+	    wheel_.schedule(presenceTimer_, time_.getMillisecondCounter());
+	}
+    }
+
+    void checkPresence()
+    {
+	const uint32 now = Time::getMillisecondCounter();
+	bool replay = false;
+	for (int i = 0; i < numMidiInputs_; ++i)
+	{
+	    MidiInputSource& in = midiInputs_[i];
+	    if (in.name_.isEmpty())
 	    {
-#if (JUCE_LINUX || JUCE_MAC)
-		virtMidiOutName_ = cmd.opts_[0];
-		if (midiOutName_.isNotEmpty())
-		{
-		    std::cerr << "Cannot use both a dout and a vout argument" << std::endl;
+		continue;
+	    }
+	    switch (in.presence_.check(now, presenceSilenceMs_))
+	    {
+		case InputPresence::Lost:
+		    std::cerr << "MIDI input \"" << in.name_ << "\" went quiet"
+			      << (in.presence_.isSensing() ? " (no active sensing)" : "") << ", is the controller still connected?" << std::endl;
+		    inputLost(i);
 		    break;
-		}
+		case InputPresence::Returned:
+		    std::cerr << "MIDI input \"" << in.name_ << "\" is back" << std::endl;
+		    inputReturned(i);
+		    replay = true;
+		    break;
+		case InputPresence::NoChange:
+		    break;
+	    }
+	}
+	if (replay)
+	{
+	    requestLedReplay();
+	}
+    }
+
+    // "standby": the input in charge of a failover group (a primary and the one
+    // standing by for it) went away, so the other takes over if it's there.
+    // Either thread; it only flips which of them the input stage drops.
+    void inputLost(int input)
+    {
+	const MidiInputSource& in = midiInputs_[input];
+	if (in.standingBy_.load())
+	{
+	    return;
+	}
+	for (int i = 0; i < numMidiInputs_; ++i)
+	{
+	    const MidiInputSource& other = midiInputs_[i];
+	    if (i != input && other.standingBy_.load() && (other.standbyFor_ == input || in.standbyFor_ == i)
+		&& other.presence_.isPresent())
+	    {
+		switchInputs(input, i);
+		return;
+	    }
+	}
+    }
+
+    bool hasStandby() const
+    {
+	for (int i = 0; i < numMidiInputs_; ++i)
+	{
+	    if (midiInputs_[i].standbyFor_ >= 0)
+	    {
+		return true;
+	    }
+	}
+	return false;
+    }
+
+    // a primary heard again takes back over from its standby
+    void inputReturned(int input)
+    {
+	for (int i = 0; i < numMidiInputs_; ++i)
+	{
+	    if (midiInputs_[i].standbyFor_ == input && midiInputs_[input].standingBy_.load())
+	    {
+		switchInputs(i, input);
+		return;
+	    }
+	}
+    }
+
+    void switchInputs(int from, int to)
+    {
+	const SpinLock::ScopedLockType lock(failoverLock_);
+	if (!midiInputs_[to].standingBy_.load())
+	{
+	    return;
+	}
+	midiInputs_[to].standingBy_ = false;
+	midiInputs_[from].standingBy_ = true;
+	++numFailovers_;
+	std::cerr << "Failing over from MIDI input \"" << midiInputs_[from].name_ << "\" to \"" << midiInputs_[to].name_ << "\"" << std::endl;
+	requestLedReplay();
+    }
+
+    // from any thread, the control thread starts it on its next pass
+    void requestLedReplay()
+    {
+	ledReplayRequested_ = true;
+	wakeControlThread();
+    }
+
+    // A board that was unplugged shows nothing until each LED changes, so on a
+    // (re)connect what's committed goes to it again: a chunk of it every
+    // ledReplayChunkMs, as much as the link carries meanwhile at 3 bytes a
+    // controller. Each chunk sends what the LEDs show by then, so a change
+    // made while it's under way is never undone by an older one.
+    void startLedReplay()
+    {
+	if (ledReplayBaud_ < 0 || ledReplayTimer_ < 0)
+	{
+	    return;
+	}
+	ledReplayNext_ = 0;
+	++numLedReplays_;
+	sendLedReplayChunk(time_.getMillisecondCounter());
+    }
+
+    void sendLedReplayChunk(uint32 now)
+    {
+	if (ledReplayNext_ < 0)
+	{
+	    return;
+	}
+	const int numLeds = getNumLeds();
+	const int display = ledFrame_.getDisplay();
+	const int numCommands = numLeds + 2;
+	const int chunk = ledReplayBaud_ == 0 ? numCommands : jmax(1, ledReplayBaud_ / 10 * ledReplayChunkMs / 1000 / 3);
+	for (const int end = jmin(numCommands, ledReplayNext_ + chunk); ledReplayNext_ < end; ++ledReplayNext_)
+	{
+	    if (ledReplayNext_ < numLeds)
+	    {
+		const LedFrameBuffer::Led& led = ledFrame_.getLed(ledReplayNext_);
+		sendBoardLed(ledReplayNext_, led.on_, led.pattern_);
+	    }
+	    else if (display >= 0)
+	    {
+		ledOutput_.add(ledReplayNext_ == numLeds ? 113 : 114, ledReplayNext_ == numLeds ? display / 10 : display % 10);
+	    }
+	}
+	ledOutput_.commit();
+	if (ledReplayNext_ < numCommands)
+	{
+	    wheel_.scheduleIn(ledReplayTimer_, ledReplayChunkMs, now);
+	}
+	else
+	{
+	    ledReplayNext_ = -1;
+	}
+    }
+
+    // what still needs looking at every 200ms: the reactor's device scan, the
+    // snapshot, the followed clock and the startup report until it's out
+    void runPeriodicJobs(uint32 now)
+    {
+	if (useReactor_)
+	{
+	    runReactorTick();
+	}
+	if (snapshot_.isEnabled())
+	{
+	    saveSnapshot();
+	}
+	if (clockFollow_)
+	{
+	    followMidiClock();
+	}
+	if (jackTransport_.isOpen())
+	{
+	    followJackTransport();
+	}
+	reportStartup();
+	if (startTuning_ && jackMeter_.isOpen())
+	{
+	    startTuning_ = false;
+	    setTuning(true);
+	}
+	// with "idle" the control passes report the startup instead
+	if ((useReactor_ && !idlePower_) || snapshot_.isEnabled() || clockFollow_ || jackTransport_.isOpen() || (isStartupPending() && !idlePower_)
+	    || startTuning_)
+	{
+	    wheel_.scheduleIn(periodicTimer_, periodicIntervalMs, now);
+	}
+	else if (useReactor_ && needsIdleTick())
+	{
+	    wheel_.scheduleIn(periodicTimer_, idleTickIntervalMs, now);
+	}
+    }
+
+    bool isStartupPending() const
+    {
+	return !startupReported_ || (startupProfile_ && !startupProfiled_);
+    }
+
+    void reportStartup()
+    {
+	if (!startupReported_ && startup_.hasReached(StartupTimes::FirstPingAck) && startup_.hasReached(StartupTimes::FirstLedLit))
+	{
+	    startupReported_ = true;
+	    startup_.dump(std::cerr);
+	}
+	if (startupProfile_ && !startupProfiled_ && startup_.hasReached(StartupTimes::FirstCorrectFrame))
+	{
+	    startupProfiled_ = true;
+	    startup_.dumpProfile(std::cerr);
+	}
+    }
+
+    // "idle" leaves device changes to the hotplug monitor and the signals
+    // wake the loop themselves, so the tick is only for rescanning where
+    // there are no announcements and for new threads to tune
+    bool needsIdleTick() const
+    {
+	return !midiHotplug_.isRunning() || !threadTuning_.isEmpty();
+    }
+
+    // the engine's check goes on the wheel for the soonest of its deadlines
+    void scheduleEngineCheck(Engine& engine, uint32 now)
+    {
+	if (engine.checkTimer_ < 0)
+	{
+	    return;
+	}
+	uint32 due = engine.heartbeat_.getNextCheckAt(engine.connected_);
+	if (engine.connected_)
+	{
+	    const uint32 handshakeAt = engine.handshake_.getNextCheckAt();
+	    if (handshakeAt != 0 && (int) (handshakeAt - due) < 0)
+	    {
+		due = handshakeAt;
+	    }
+	    const int pollWait = changeUpdates_ ? engine.polls_.getMsUntilNext(engine.loops_.size(), now) : -1;
+	    if (pollWait >= 0 && (int) (now + (uint32) pollWait - due) < 0)
+	    {
+		due = now + (uint32) pollWait;
+	    }
+	    const int reconcileWait = engine.loopCount_ > 0 ? engine.reconciler_.getMsUntilNext(now) : -1;
+	    if (reconcileWait >= 0 && (int) (now + (uint32) reconcileWait - due) < 0)
+	    {
+		due = now + (uint32) reconcileWait;
+	    }
+	    const uint32 lease = engine.registeredAt_ + (uint32) Engine::registrationLeaseMs;
+	    if (engine.loopCount_ > 0 && (int) (lease - due) < 0)
+	    {
+		due = lease;
+	    }
+	}
+	wheel_.schedule(engine.checkTimer_, (int) (due - now) > 0 ? due : now);
+    }
 
-		midiOut_ = MidiOutput::createNewDevice(virtMidiOutName_);
-		if (midiOut_ == nullptr)
+    void checkEngineConnection(Engine& engine)
+    {
+	const uint32 now = time_.getMillisecondCounter();
+	if (!engine.connected_)
+	{
+	    if (engine.heartbeat_.mayReconnect(now))
+	    {
+		if (tryToConnectEngine(engine))
 		{
-		    std::cerr << "Couldn't create virtual MIDI output port \"" << virtMidiOutName_ << "\"" << std::endl;
+		    std::cerr << (engine.heartbeat_.getNumReconnects() > 0 ? "Reconnected" : "Connected") << " to OSC ports " << (int)currentReceivePort_ << " (in), " << (int) engine.sendPort_ << " (out) and " << (int) currentLedSendPort_ << " (led)" << std::endl;
+		}
+		else
+		{
+		    engine.heartbeat_.scheduleReconnect(now);
 		}
-#else
-		std::cerr << "Virtual MIDI output ports are not supported on Windows" << std::endl;
-#endif
-		break;
 	    }
-	case BASE_NOTE:
-	    baseNote_ = asNoteNumber(cmd.opts_[0]);
-	    break;
-	case OSC_OUT:
-	    oscSendPort_ = asPortNumber(cmd.opts_[0]);
-	    // specify here where to send OSC messages to: host URL and UDP port number
-	    if (! oscSender.connect ("127.0.0.1", oscSendPort_))
-		std::cerr << "Error: could not connect to UDP port " << cmd.opts_[0] << std::endl;
+	}
+	else if (engine.heartbeat_.isLost(now))
+	{
+	    // we've lost heartbeat, back off so a busy looper isn't flooded with re-registrations
+	    const int wait = engine.heartbeat_.lost(now);
+	    metrics_.add(Metrics::Reconnects);
+	    journal_.record(EventJournal::HeartbeatLost, engine.index_, engine.sendPort_, wait);
+	    engine.arrivals_.restart();
+	    engine.handshake_.reset();
+	    engine.sender_.disconnect();
+	    engine.connected_ = false;
+	    if (isActive(engine))
+	    {
+		resetCycles();
+	    }
+	    std::cerr << "Lost heartbeat from OSC port " << (int) engine.sendPort_ << ", reconnecting in " << wait << "ms" << std::endl;
+	}
+	else
+	{
+	    if (engine.handshake_.isOverdue(now))
+	    {
+		retryHandshake(engine, now);
+	    }
+	    if (engine.heartbeat_.shouldPing(now))
+	    {
+		if (engine.heartbeat_.isPingOutstanding())
+		{
+		    metrics_.add(Metrics::HeartbeatMisses);
+		    engine.reconciler_.lost(now);
+		}
+		engine.sender_.send(engine.packets_.heartbeatPing());
+		engine.heartbeat_.pingSent(now);
+	    }
+	    if (hostClockPort_ > 0 && !engine.sender_.isLoopback() && (int) (now - engine.clockAskedAt_) >= engine.heartbeat_.getPingInterval())
+	    {
+		sendTimeRequest(engine, now);
+	    }
+	    if (changeUpdates_)
+	    {
+		pollLoops(engine, now);
+	    }
+	    if (engine.loopCount_ > 0 && engine.reconciler_.isDue(now))
+	    {
+		const OscPacketSender::QueryScope query(engine.sender_);
+		engine.sender_.send(engine.packets_.allLoopsReconcile());
+		engine.reconciler_.sent(now);
+	    }
+	    if (engine.loopCount_ > 0 && (int) (now - engine.registeredAt_) >= Engine::registrationLeaseMs)
+	    {
+		registerLoops(engine, 0, engine.loops_.size(), true);
+	    }
 	    else
-		currentSendPort_ = oscSendPort_;
-	    break;
-	case OSC_IN:
-	    oscReceivePort_ = asPortNumber(cmd.opts_[0]);
-	    if (!tryToConnectOsc())
-		std::cerr << "Error: could not connect to UDP port " << cmd.opts_[0] << std::endl;
-	    break;
-	default:
-	    filterCommands_.add(cmd);
-	    break;
+	    {
+		// an input moved to other loops, "bank", "mirror" or "progress" changed since
+		updateVisibleLoops(engine);
+		updateMirroredControls(engine);
+		if (progressMode_ != ProgressOff && !wheel_.isScheduled(progressTimer_))
+		{
+		    restartProgress();
+		}
+	    }
+	}
+    }
+
+    // with "idle" the announcements wake the epoll loop, which rescans
+    void startIdleHotplug()
+    {
+	hotplugWakesControl_ = true;
+	if (midiHotplug_.start([this] { midiDevicesAnnounced(); }))
+	{
+	    std::cerr << "Watching ALSA announcements for MIDI device changes" << std::endl;
+	}
+    }
+
+    void startMidiHotplug()
+    {
+	hotplugWakesControl_ = false;
+	if (midiHotplug_.start([this] { midiDevicesAnnounced(); }))
+	{
+	    std::cerr << "Watching ALSA announcements for MIDI device changes" << std::endl;
+	}
+    }
+
+    // on the hotplug thread: a worker lists the devices, so the rescan that
+    // follows finds them in the catalogue instead of listing them itself
+    void midiDevicesAnnounced()
+    {
+	midiDevices_.invalidate();
+	midiDevicesChanged_ = true;
+	if (!workers_.submit(&listMidiDevicesJob, this))
+	{
+	    rescanMidiDevices();
+	}
+    }
+
+    static void listMidiDevicesJob(void* context)
+    {
+	auto* app = static_cast<loop4r_readApplication*>(context);
+	app->midiDevices_.getInputs();
+	app->midiDevices_.getOutputs();
+	app->rescanMidiDevices();
+    }
+
+    static void writeSpansJob(void* context)
+    {
+	static_cast<loop4r_readApplication*>(context)->writeSpans();
+    }
+
+    void rescanMidiDevices()
+    {
+	if (hotplugWakesControl_)
+	{
+	    wakeControlThread();
+	}
+	else
+	{
+	    triggerAsyncUpdate();
+	}
+    }
+
+    // as many workers as there are CPUs left to them, unless "workers" said
+    void startWorkers()
+    {
+	if (numWorkers_ < 0)
+	{
+	    return;
+	}
+	const BigInteger reserved = threadTuning_.getRealtimeCpus();
+	const int numCpus = SystemStats::getNumCpus();
+	BigInteger cpus;
+	if (!reserved.isZero())
+	{
+	    cpus.setRange(0, numCpus, true);
+	    for (int cpu = reserved.findNextSetBit(0); cpu >= 0; cpu = reserved.findNextSetBit(cpu + 1))
+	    {
+		cpus.clearBit(cpu);
+	    }
+	    if (cpus.isZero())
+	    {
+		std::cerr << "Every CPU is reserved for a realtime thread, the workers run wherever they're put" << std::endl;
+	    }
+	}
+	const int numFree = cpus.isZero() ? numCpus : cpus.countNumberOfSetBits();
+	if (!workers_.start(numWorkers_ > 0 ? numWorkers_ : numFree, cpus))
+	{
+	    std::cerr << "Couldn't start the worker threads, their jobs run where they come up" << std::endl;
+	}
+    }
+
+    Engine& activeEngine()
+    {
+	return *engines_.getUnchecked(activeEngine_);
+    }
+
+    bool isActive(const Engine& engine) const
+    {
+	return engine.index_ == activeEngine_;
+    }
+
+    // inactive engines only remember the state, it's drawn when they're selected
+    void setLoopState(Engine& engine, int loop, LoopStates newState)
+    {
+	if (!engine.loops_.contains(loop))
+	{
+	    return;
+	}
+
+	const LoopStates oldState = engine.loops_.getState(loop);
+	if (oldState != newState)
+	{
+	    journal_.record(EventJournal::LoopState, engine.index_, loop, newState, oldState);
+	}
+	if (isActive(engine))
+	{
+	    updateLoopLedState(engine.loops_, loop, newState);
+	    if (cycleSampleMs_ > 0 && CycleTracker::isRunning(newState) != CycleTracker::isRunning(oldState))
+	    {
+		cycles_.setRunning(loop, CycleTracker::isRunning(newState), Time::getHighResolutionTicks());
+		scheduleCycles(time_.getMillisecondCounter(), Time::getHighResolutionTicks());
+	    }
+	}
+	else
+	{
+	    engine.loops_.setState(loop, newState);
+	}
+    }
+
+    void selectEngine(int index)
+    {
+	if (index < 0 || index >= engines_.size() || index == activeEngine_)
+	{
+	    return;
+	}
+
+	// darken what the old engine lit before its loops stop backing the LEDs
+	const int numLeds = getNumLeds();
+	for (int i = 0; i < numLeds; ++i)
+	{
+	    activeEngine().loops_.setLed(i, Dark, TIMER_OFF);
+	    ledOff(i);
+	}
+	Engine& previous = activeEngine();
+	activeEngine_ = index;
+	updateVisibleLoops(previous);
+	updateVisibleLoops(activeEngine());
+	if (mode_ > 0)
+	{
+	    ledOn(RECORD);
+	}
+	updateLoops();
+	if (blinkSync_ && activeEngine().connected_)
+	{
+	    const OscPacketSender::QueryScope query(activeEngine().sender_);
+	    activeEngine().sender_.send(activeEngine().packets_.tempoState());
+	}
+	// the new engine's cycles are known again from its next reports
+	resetCycles();
+	if (cycleSampleMs_ > 0 && activeEngine().connected_)
+	{
+	    const LoopStore& loops = activeEngine().loops_;
+	    for (int i = 0; i < loops.size(); ++i)
+	    {
+		cycles_.setRunning(i, CycleTracker::isRunning(loops.getState(i)), Time::getHighResolutionTicks());
+	    }
+	    OscBundleSender bundle(activeEngine().sender_);
+	    OscPacket packet;
+	    for (const int id : { (int) SooperLooperControls::loopPos, (int) SooperLooperControls::cycleLen })
+	    {
+		activeEngine().packets_.buildCycleGet(packet, SooperLooperControls::getName(false, id));
+		bundle.add(packet);
+	    }
+	}
+	if (activeEngine().selectedLoop_ >= 0)
+	{
+	    selectLoop();
+	}
+	if (progressMode_ != ProgressOff)
+	{
+	    restartProgress();
+	}
+	std::cerr << "Showing SooperLooper engine " << index << " on port " << activeEngine().sendPort_ << std::endl;
+    }
+
+    void updateLoops()
+    {
+	LoopStore& loops = activeEngine().loops_;
+	for (int i = 0; i < loops.size(); ++i)
+	{
+	    updateLoopLedState(loops, i, loops.getState(i));
+	}
+    }
+
+    // the board's LEDs plus any loops of the active engine past them
+    int getNumLeds()
+    {
+	return jmin(jmax(NUM_PEDAL_LEDS, activeEngine().loops_.size()), (int) LedChangeFilter::maxLeds);
+    }
+
+    void updateLoopLedState(LoopStore& loops, int loop, LoopStates newState)
+    {
+	const SpanTrace::Scope span(&spans_, "updateLoopLedState");
+	const LoopLedAction& action = loopLedTable().get(loops.getState(loop), newState, mode_);
+	loops.setLed(loop, action.mode_, action.timer_);
+	loops.setState(loop, newState);     // before setLed(), which picks the state's pattern
+	loopStates_.record(loop, newState, time_.getMillisecondCounter());
+	setLed(loop, action.loopOn_);
+	if (action.auxOn_ != NoAux)
+	{
+	    ledOn(AUX_LED_PEDALS[action.auxOn_]);
+	}
+	if (action.auxOff_ != NoAux)
+	{
+	    ledOff(AUX_LED_PEDALS[action.auxOff_]);
+	}
+	sharedLeds_.setLoopState(loop, newState, loops.size());
+    }
+
+    void shutdown() override
+    {
+	// Add your application's shutdown code here..
+
+	metricsServer_.stop();
+	ledStream_.stop();
+	midiHotplug_.stop();
+	workers_.stop();
+	stopControlThread();
+	closeLocalSocket();
+	sequencerInput_.close();
+	for (auto&& in : midiInputs_)
+	{
+	    in.rawInput_.close();
+	    in.serialInput_.close();
+	    in.rtpInput_.close();
+	}
+	snapshot_.stop();
+	unregisterEngines();
+	stopOscSendThread();
+	sharedLeds_.close();
+	midiPlayer_.stop();         // before the stage they may be flushing loses its output
+	sysexUploader_.stop();
+	beatScheduler_.stop();
+	midiStage_.setThinning(false);
+	midiStage_.setOutput(nullptr);
+	midiStage_.setSink(nullptr, 0);
+	jackMidi_.close();
+	onsetDetector_.stop();
+	tuner_.stop();
+	midiRecorder_.stop();
+	midiMonitor_.stop();
+	sysexCapture_.stop();
+	jackMeter_.close();
+	jackTransport_.close();
+	blink_.stop();
+	ledOutput_.stop();
+	ledPort_.close();
+	if (ledPlugin_.isLoaded())
+	{
+	    std::cerr << "LED plugin: " << ledPlugin_.getNumFrames() << " frames" << std::endl;
+	    ledPlugin_.unload();
+	}
+	gpioLeds_.close();
+	spiLeds_.close();
+	if (dinLeds_.getNumCommands() > 0)
+	{
+	    std::cerr << "DIN LEDs: " << dinLeds_.getNumCommands() << " commands in " << dinLeds_.getNumBytes() << " bytes, "
+		      << dinLeds_.getNumSaved() << " status bytes saved, " << String(dinLeds_.getWaitedMs(), 1) << "ms waited for the wire, "
+		      << dinLeds_.getNumErrors() << " write errors" << std::endl;
+	}
+	dinLeds_.close();
+	stopGigMode();
+	eventLog_.stop();
+	std::cerr << "MIDI out: " << midiStage_.getNumMessages() << " messages in " << midiStage_.getNumBlocks() << " blocks, " << midiStage_.getNumThinned() << " thinned" << std::endl;
+	if (midiThru_.isOpen())
+	{
+	    std::cerr << "MIDI thru: " << midiThru_.getNumConnects() << " sequencer connections made" << std::endl;
+	}
+	std::cerr << "LED updates: " << ledChanges_.getNumSent() << " sent, " << ledChanges_.getNumSuppressed() << " suppressed" << std::endl;
+	if (numFailovers_ > 0)
+	{
+	    std::cerr << "Failovers: " << numFailovers_ << " between a MIDI input and its standby" << std::endl;
+	}
+	if (numLedReplays_ > 0)
+	{
+	    std::cerr << "LED replays: " << numLedReplays_ << " to a (re)connected board" << std::endl;
+	}
+	std::cerr << "SooperLooper updates: " << ctrlUpdates_.getNumCoalesced() << " superseded while queued" << std::endl;
+	if (reconcileMinMs_ > 0)
+	{
+	    int64 numRounds = 0;
+	    for (auto* engine : engines_)
+	    {
+		numRounds += engine->reconciler_.getNumSent();
+	    }
+	    std::cerr << "Reconcile: " << numRounds << " rounds, " << numDivergences_ << " loops found wrong and corrected" << std::endl;
+	}
+	if (deliveryAttempts_ > 0)
+	{
+	    std::cerr << "Delivery: " << sumDeliveries(&CommandDelivery::getNumTracked) << " loop pedal commands tracked, "
+		      << sumDeliveries(&CommandDelivery::getNumQueries) << " asked about, "
+		      << sumDeliveries(&CommandDelivery::getNumRetransmits) << " resent, "
+		      << sumDeliveries(&CommandDelivery::getNumRecovered) << " recovered, "
+		      << sumDeliveries(&CommandDelivery::getNumUpdatesLost) << " with only the update lost, "
+		      << sumDeliveries(&CommandDelivery::getNumGivenUp) << " given up on" << std::endl;
+	}
+	if (adaptiveHoldMs_ > 0)
+	{
+	    int64 numSwitches = 0;
+	    for (auto* engine : engines_)
+	    {
+		numSwitches += engine->adaptive_.getNumSwitches();
+	    }
+	    std::cerr << "Adaptive updates: " << numSwitches << " switches between " << adaptiveMs_ << "ms and the usual rate" << std::endl;
+	}
+	if (useReactor_)
+	{
+	    std::cerr << "OSC in: " << oscBatches_.getNumDatagrams() << " datagrams in " << oscBatches_.getNumBatches() << " batches, "
+		      << String(oscBatches_.getMeanBatch(), 1) << " on average and " << oscBatches_.getMaxBatch() << " at most, "
+		      << oscBatches_.getNumTruncated() << " too long, " << oscBatches_.getNumDropped() << " dropped by the kernel, "
+		      << oscBatches_.getNumStamped() << " with its receive time" << std::endl;
+	}
+	for (auto* engine : engines_)
+	{
+	    const EngineHandshake& handshake = engine->handshake_;
+	    if (handshake.getNumCompleted() > 0 || handshake.getNumPingRetries() > 0)
+	    {
+		std::cerr << "Handshake" << (engines_.size() > 1 ? " with engine " + String(engine->index_) : String()) << ": "
+			  << handshake.getNumCompleted() << " done, the last in " << handshake.getLastMs() << "ms (at most "
+			  << handshake.getLongestMs() << "ms), " << handshake.getNumPingRetries() << " pings and "
+			  << handshake.getNumQueryRetries() << " state queries sent again" << std::endl;
+	    }
+	}
+	if (oscGate_.getNumRejected() > 0)
+	{
+	    std::cerr << "OSC rejected: " << oscGate_.getNumRejected(OscGate::Malformed) << " malformed, "
+		      << oscGate_.getNumRejected(OscGate::UnknownAddress) << " for unknown addresses, "
+		      << oscGate_.getNumRejected(OscGate::RateLimited) + oscGate_.getNumRejected(OscGate::Blocked)
+		      << " from sources over their rate (" << oscGate_.getNumBlocks() << " times blocked)" << std::endl;
+	}
+	if (pedalBanks_.getNumSwitches() > 0)
+	{
+	    std::cerr << "Pedal banks: " << pedalBanks_.getNumSwitches() << " switches, on bank " << pedalBanks_.getIndex() + 1
+		      << " of " << pedalBanks_.getNumBanks() << std::endl;
+	}
+	if (numGroupHits_ > 0)
+	{
+	    std::cerr << "Loop groups: " << numGroupHits_ << " pedal presses, " << numTimedGroupHits_ << " time tagged for the beat" << std::endl;
+	}
+	if (cycles_.getNumSyncs() > 0)
+	{
+	    std::cerr << "Cycles: " << cycles_.getNumBoundaries() << " boundaries, at most " << String(cycles_.getMaxLateMs(), 2)
+		      << "ms late, from " << cycles_.getNumSyncs() << " loop_pos reports at most " << String(cycles_.getMaxErrorMs(), 2)
+		      << "ms from where we had them" << std::endl;
+	}
+	if (macros_.getNumStarted() > 0)
+	{
+	    std::cerr << "Macros: " << macros_.getNumStarted() << " started, " << macros_.getNumCancelled() << " cancelled, "
+		      << numTimedBundles_ << " steps sent time tagged" << std::endl;
+	}
+	if (tapTempo_.getNumTaps() > 0)
+	{
+	    std::cerr << "Tap tempo: " << tapTempo_.getNumTaps() << " taps, " << tapTempo_.getNumRejected() << " rejected, "
+		      << String(tapTempo_.getBpm(), 2) << "bpm" << std::endl;
+	}
+	if (quantiseBeats_ > 0)
+	{
+	    std::cerr << "Quantised: " << beatScheduler_.getNumScheduled() << " notes held for the beat, at most "
+		      << String(beatScheduler_.getMaxLateMs(), 1) << "ms late, " << beatScheduler_.getNumOverflowed() << " sent at once with the queue full, "
+		      << numUncompensated_ << " without latency compensation" << std::endl;
+	}
+	for (int i = 0; i < numMidiInputs_; ++i)
+	{
+	    const RtpMidiInput& rtp = midiInputs_[i].rtpInput_;
+	    if (midiInputs_[i].rtp_)
+	    {
+		std::cerr << "RTP-MIDI input " << i << ": " << rtp.getNumSessions() << " sessions, " << rtp.getNumPackets() << " packets, "
+			  << rtp.getNumLost() << " lost, " << rtp.getNumRecovered() << " messages recovered, " << rtp.getNumLate() << " too late, "
+			  << rtp.getNumReordered() << " reordered, jitter " << String(rtp.getJitterMs(), 2) << "ms" << std::endl;
+	    }
+	}
+	if (clockFollow_)
+	{
+	    std::cerr << "MIDI clock: " << clock_.getNumClocks() << " clocks, " << String(clock_.getBpm(), 2) << "bpm, jitter "
+		      << String(clock_.getJitterMicros(), 0) << "us, " << clock_.getNumRelocks() << " relocks, "
+		      << numClockTempoSent_ << " tempo changes sent" << std::endl;
+	}
+	if (netClockHost_.isNotEmpty())
+	{
+	    const ClockOffset& offset = netClock_.getOffset();
+	    std::cerr << "Network clock: " << offset.getNumExchanges() << " answers to " << numNetClockRequests_ << " requests, "
+		      << offset.getNumRejected() << " too slow, " << String(netClock_.getBpm(), 2) << "bpm, "
+		      << (int64) offset.getOffsetMicros(NetworkClock::toMicros(Time::getHighResolutionTicks())) << "us offset drifting "
+		      << String(offset.getDriftPpm(), 2) << "ppm, jitter " << (int64) offset.getJitterMicros() << "us, quickest round trip "
+		      << (int64) offset.getMinDelayMicros() << "us" << std::endl;
+	}
+	for (auto* engine : engines_)
+	{
+	    const ClockOffset& offset = engine->clockOffset_;
+	    if (offset.getNumExchanges() > 0)
+	    {
+		std::cerr << "Engine " << engine->index_ << " host clock: " << (int64) offset.getOffsetMicros(ClockOffset::getWallMicros())
+			  << "us ahead of ours, to within " << (int64) offset.getErrorBoundMicros() << "us, drifting "
+			  << String(offset.getDriftPpm(), 2) << "ppm, from " << offset.getNumExchanges() << " exchanges, "
+			  << offset.getNumRejected() << " too slow" << std::endl;
+	    }
+	}
+	if (jackTransport_.getNumPolls() > 0)
+	{
+	    std::cerr << "JACK transport: " << jackTransport_.getNumPolls() << " rolling positions read, "
+		      << String(jackTransport_.getBpm(), 2) << "bpm, " << jackTransport_.getBeatsPerBar() << " beats to the bar" << std::endl;
+	}
+	if (numNetClockAnswers_ > 0)
+	{
+	    std::cerr << "Network clock: answered " << numNetClockAnswers_ << " requests" << std::endl;
+	}
+	expression_.forEachLearned([] (int controller, int low, int high)
+	{
+	    std::cerr << "Expression " << controller << ": swept " << low << "-" << high << ", \"exprcal " << controller << " " << low << " " << high << "\" to keep it" << std::endl;
+	});
+	if (!chords_.isEmpty())
+	{
+	    std::cerr << "Chords: " << chords_.getNumFired() << " made, " << chords_.getNumLate() << " presses handed on late" << std::endl;
+	}
+	if (debounce_.isEnabled())
+	{
+	    std::cerr << "Pedal debounce: " << debounce_.getNumSuppressed() << " bounces suppressed, " << debounce_.getNumLate() << " edges passed on late" << std::endl;
+	}
+	if (!gestures_.isEmpty())
+	{
+	    std::cerr << "Pedal gestures: " << gestures_.getNumRecognised() << " recognised" << std::endl;
+	}
+	if (jackClientName_.isNotEmpty())
+	{
+	    std::cerr << "JACK MIDI: " << jackMidi_.getNumIn() << " in, " << jackMidi_.getNumOut() << " out, " << jackMidi_.getNumDropped() << " dropped" << std::endl;
+	}
+	if (meterLeds_.size() > 0)
+	{
+	    std::cerr << "Input meter: " << numMeterClips_ << " clips" << std::endl;
+	}
+	if (midiPlayer_.getNumPlayed() > 0)
+	{
+	    std::cerr << "MIDI playback: " << midiPlayer_.getNumPlayed() << " events, " << String(midiPlayer_.getAverageLateMs(), 3) << "ms late on average and "
+		      << String(midiPlayer_.getMaxLateMs(), 3) << "ms at most, " << midiPlayer_.getNumDropped() << " dropped" << std::endl;
+	}
+	if (midiMonitor_.getNumWrites() > 0 || midiMonitor_.getNumDropped() > 0)
+	{
+	    std::cerr << "MIDI monitor: " << midiMonitor_.getNumPrinted() << " messages in " << midiMonitor_.getNumWrites() << " writes, "
+		      << midiMonitor_.getNumDropped() << " dropped" << std::endl;
+	}
+	if (pedalScripts_.getNumRuns() > 0)
+	{
+	    std::cerr << "Pedal scripts: " << pedalScripts_.getNumRuns() << " runs, " << pedalScripts_.getNumErrors() << " errors, "
+		      << pedalScripts_.getMaxMicros() << "us at most" << std::endl;
+	}
+	if (sysexCapture_.getNumDumps() > 0 || sysexCapture_.getNumDropped() > 0)
+	{
+	    std::cerr << "Sysex capture: " << sysexCapture_.getNumDumps() << " dumps of " << sysexCapture_.getNumBytes() << " bytes, "
+		      << sysexCapture_.getNumBad() << " bad, " << sysexCapture_.getNumDropped() << " bytes dropped" << std::endl;
+	}
+	if (idlePower_ && controlEndTicks_ != 0)
+	{
+	    const double seconds = jmax(0.001, Time::highResolutionTicksToSeconds(controlEndTicks_ - controlStartTicks_));
+	    const int64 control = metrics_.get(Metrics::ControlWakeups);
+	    const int64 all = idleWakeups_;
+	    std::cerr << "Wakeups: " << control << " on the control thread (" << String(control / seconds, 2) << "/s), "
+		      << all << " in all the threads (" << String(all / seconds, 2) << "/s) over " << String(seconds, 1) << "s" << std::endl;
+	}
+	if (overload_.getNumRaised() > 0 || feedback_.getNumCuts() > 0)
+	{
+	    std::cerr << "Load shedding: " << overload_.getNumRaised() << " times for "
+		      << String(overload_.getSecondsShed(Time::getHighResolutionTicks()), 1) << "s, "
+		      << overload_.getNumShed(OverloadGuard::ShedDisplays) << " display pushes and "
+		      << overload_.getNumShed(OverloadGuard::ShedPassthrough) << " passthrough controllers left out, "
+		      << feedback_.getNumCuts() << " MIDI feedback loops cut (" << feedback_.getNumDropped() << " controllers dropped)" << std::endl;
+	}
+	if (slCommands_)
+	{
+	    std::cerr << "Pedal commands: " << numPedalCommandsSent_ << " sent as OSC for the " << pedalCommands_.getNumCommands() << " notes bound" << std::endl;
+	}
+	if (ledFrames_)
+	{
+	    std::cerr << "LED frames: " << numLedFramesPushed_ << " pushed as /leds" << std::endl;
+	}
+	if (workers_.getNumSubmitted() > 0 || workers_.getNumRejected() > 0)
+	{
+	    std::cerr << "Workers: " << workers_.getNumWorkers() << " threads ran " << workers_.getNumSubmitted() << " jobs, "
+		      << workers_.getNumStolen() << " stolen, " << workers_.getNumRejected() << " turned away while full" << std::endl;
+	}
+	if (ledSubscribers_.getNumFiltered() > 0)
+	{
+	    std::cerr << "LED subscribers: " << ledSubscribers_.getNumDatagrams() << " datagrams sent, " << ledSubscribers_.getNumFiltered() << " left out by their filters" << std::endl;
+	}
+	if (midiRecorder_.getNumFlushes() > 0 || midiRecorder_.getNumDropped() > 0)
+	{
+	    std::cerr << "MIDI recording: " << midiRecorder_.getNumRecorded() << " events in " << midiRecorder_.getNumFlushes() << " flushes, "
+		      << midiRecorder_.getNumDropped() << " dropped" << std::endl;
+	}
+	if (tuner_.getNumHops() > 0)
+	{
+	    std::cerr << "Tuner: " << tuner_.getNumHops() << " hops, " << String(tuner_.getAverageMicros(), 1) << "us on average and "
+		      << tuner_.getMaxMicros() << "us at most" << std::endl;
+	}
+	if (onsetEnabled_)
+	{
+	    std::cerr << "Onsets: " << onsetDetector_.getNumOnsets() << " in " << onsetDetector_.getNumHops() << " hops, "
+		      << numOnsetRecords_ << " started recording, " << numOnsetsIgnored_ << " ignored" << std::endl;
+	}
+	for (int i = 0; i < numMidiInputs_ && (numMidiInputs_ > 1 || presenceEnabled_); ++i)
+	{
+	    std::cerr << "MIDI in from \"" << midiInputs_[i].name_ << "\": " << (int64) midiInputs_[i].numEvents_ << " events";
+	    if (presenceEnabled_)
+	    {
+		std::cerr << ", went quiet " << midiInputs_[i].presence_.getNumLost() << " times";
+	    }
+	    std::cerr << std::endl;
+	}
+	if (sequencerInput_.getNumOverruns() > 0)
+	{
+	    std::cerr << "MIDI in: " << sequencerInput_.getNumOverruns() << " sequencer overruns" << std::endl;
+	}
+	if (midiFilter_.isActive())
+	{
+	    std::cerr << "MIDI in: " << numMidiFiltered_.value_.load() << " messages filtered out";
+	    if (readsSequencer())
+	    {
+		std::cerr << ", " << sequencerInput_.getNumDropped() << " more dropped before decoding";
+	    }
+	    std::cerr << std::endl;
+	}
+	if (midiDevices_.getNumLookups() > 0)
+	{
+	    std::cerr << "MIDI devices: " << midiDevices_.getNumLookups() << " lookups, " << midiDevices_.getNumHits() << " from the cache ("
+		      << roundToInt(midiDevices_.getHitRate() * 100.0) << "%)" << std::endl;
+	}
+	if (!startupReported_ && startup_.hasReached(StartupTimes::FirstPing))
+	{
+	    startup_.dump(std::cerr);
+	}
+	if (startupProfile_ && !startupProfiled_)
+	{
+	    startup_.dumpProfile(std::cerr);
+	}
+	if (spans_.isEnabled())
+	{
+	    writeSpans();
+	}
+	journal_.record(EventJournal::Stopped);
+	if (loopbackEvents_ > 0)
+	{
+	    loopback_.stop();
+	    loopback_.dump(std::cout);
+	}
+	if (threadAccounting_.isRunning())
+	{
+	    threadAccounting_.stop();
+	    threadAccounting_.dump(std::cerr);
+	    allocations_.dump(std::cerr);
+	}
+	if (trace_.isOpen())
+	{
+	    std::cerr << "Trace: " << (int64) trace_.getNumRecorded() << " records in " << trace_.getFile().getFullPathName() << std::endl;
+	}
+	if (archive_.isRunning())
+	{
+	    archive_.stop();
+	    std::cerr << "Trace archive: " << archive_.getNumArchived() << " records in " << archive_.getNumSegments() << " segments, "
+		      << archive_.getNumCompressedBytes() / 1024 << "KB (from " << archive_.getNumArchived() * TraceCapture::recordSize / 1024
+		      << "KB), " << archive_.getNumLost() << " lost to the ring, in " << archive_.getFile().getFullPathName() << std::endl;
+	}
+	if (dumpLatencyStats_)
+	{
+	    latency_.dump(std::cerr);
+	    commandLatency_.dump(std::cerr);
+	    dumpEngineStats(std::cerr);
+	}
+    }
+
+    //==============================================================================
+    void systemRequestedQuit() override
+    {
+	// This is called when the app is being asked to quit: you can ignore this
+	// request and let the app carry on running, or call quit() to allow the app to close.
+	quit();
+    }
+
+    void anotherInstanceStarted (const String& commandLine) override
+    {
+	// When another instance of the app is launched while this one is running,
+	// this method is invoked, and the commandLine parameter tells you what
+	// the other instance's command-line arguments were.
+    }
+    void suspended() override {}
+    void resumed() override {}
+    void unhandledException(const std::exception*, const String&, int) override { jassertfalse; }
+
+private:
+    const ApplicationCommand* findApplicationCommand(const String& param) const
+    {
+	const String key = param.toLowerCase();
+	if (commandLookup_.contains(key))
+	{
+	    return &commands_.getReference(commandLookup_[key]);
+	}
+	return nullptr;
+    }
+
+    StringArray parseLineAsParameters(const String& line)
+    {
+	StringArray parameters;
+	if (!line.startsWith("#"))
+	{
+	    StringArray tokens;
+	    tokens.addTokens(line, true);
+	    tokens.removeEmptyStrings(true);
+	    for (const String& token : tokens)
+	    {
+		parameters.add(token.trimCharactersAtStart("\"").trimCharactersAtEnd("\""));
+	    }
+	}
+	return parameters;
+    }
+
+    void handleVarArgCommand()
+    {
+	if (currentCommand_ != nullptr && currentRemaining_ < 0)
+	{
+	    // done with, or the next line read would run it again
+	    const ApplicationCommand* cmd = currentCommand_;
+	    currentCommand_ = nullptr;
+	    executeCommand(*cmd, currentOpts_);
+	}
+    }
+
+    // the options are gathered in currentOpts_, which keeps its storage from
+    // one command to the next; the commands themselves are never copied
+    void parseParameters(const StringArray& parameters)
+    {
+	for (const String& param : parameters)
+	{
+	    if (param == "--" || param == "--framed" || param == "--startup-profile") continue;
+
+	    const ApplicationCommand* cmd = findApplicationCommand(param);
+	    if (cmd)
+	    {
+		handleVarArgCommand();
+
+		currentCommand_ = cmd;
+		currentRemaining_ = cmd->expectedOptions_;
+		currentOpts_.clearQuick();
+	    }
+	    else if (currentCommand_ == nullptr)
+	    {
+		File file = File::getCurrentWorkingDirectory().getChildFile(param);
+		if (file.existsAsFile())
+		{
+		    if (!controlThread_.isThreadRunning())
+		    {
+			programWatcher_.watch(file);
+		    }
+		    parseFile(file);
+		}
+		continue;
+	    }
+	    else if (currentRemaining_ != 0)
+	    {
+		currentOpts_.add(param);
+		currentRemaining_ -= 1;
+	    }
+	    else
+	    {
+		continue;
+	    }
+
+	    // handle fixed arg commands
+	    if (currentRemaining_ == 0)
+	    {
+		executeCommand(*currentCommand_, currentOpts_);
+	    }
+	}
+
+	handleVarArgCommand();
+    }
+
+    // program files are compiled once and rerun from the compiled form until they change
+    void parseFile(File file)
+    {
+	runScript(compileFile(file));
+    }
+
+    const CommandScript& compileFile(const File& file)
+    {
+	const Time modified = file.getLastModificationTime();
+	CompiledFile* compiled = nullptr;
+	for (auto* candidate : compiledFiles_)
+	{
+	    if (candidate->file_ == file)
+	    {
+		if (candidate->modified_ == modified)
+		{
+		    return candidate->script_;
+		}
+		compiled = candidate;
+		break;
+	    }
+	}
+	if (compiled == nullptr)
+	{
+	    compiled = compiledFiles_.add(new CompiledFile());
+	    compiled->file_ = file;
+	}
+
+	compiled->modified_ = modified;
+	compiled->script_.clear();
+	compileLines(file, compiled->script_);
+	return compiled->script_;
+    }
+
+    // touches nothing but the command table, so program files can be
+    // compiled off the control thread too
+    void compileLines(const File& file, CommandScript& script)
+    {
+	StringArray parameters;
+	StringArray lines;
+	file.readLines(lines);
+	for (String line : lines)
+	{
+	    parameters.addArray(parseLineAsParameters(line));
+	}
+	compileParameters(parameters, script);
+    }
+
+    // The same grammar as parseParameters: a command takes its fixed number
+    // of options, or for var arg ones everything up to the next command, and
+    // files named before any command are included.
+    void compileParameters(const StringArray& parameters, CommandScript& script)
+    {
+	const ApplicationCommand* current = nullptr;
+	int remaining = 0;
+	StringArray opts;
+	for (const String& param : parameters)
+	{
+	    if (param == "--" || param == "--framed" || param == "--startup-profile") continue;
+
+	    const ApplicationCommand* cmd = findApplicationCommand(param);
+	    if (cmd)
+	    {
+		if (current != nullptr && remaining < 0)
+		{
+		    script.add(current->command_, opts);
+		}
+		current = cmd;
+		remaining = cmd->expectedOptions_;
+		opts.clearQuick();
+	    }
+	    else if (current == nullptr)
+	    {
+		const File file = File::getCurrentWorkingDirectory().getChildFile(param);
+		if (file.existsAsFile())
+		{
+		    script.add(CommandScript::includeFile, StringArray(file.getFullPathName()));
+		}
+		continue;
+	    }
+	    else if (remaining != 0)
+	    {
+		opts.add(param);
+		remaining -= 1;
+	    }
+	    else
+	    {
+		continue;
+	    }
+
+	    if (remaining == 0)
+	    {
+		script.add(current->command_, opts);
+	    }
+	}
+
+	if (current != nullptr && remaining < 0)
+	{
+	    script.add(current->command_, opts);
+	}
+    }
+
+    void runScript(const CommandScript& script)
+    {
+	script.forEach([this] (int command, const StringArray& opts)
+	{
+	    runCompiledCommand(command, opts);
+	});
+    }
+
+    void runCompiledCommand(int command, const StringArray& opts)
+    {
+	if (command == CommandScript::includeFile)
+	{
+	    parseFile(File(opts[0]));
+	    return;
+	}
+
+	for (auto&& cmd : commands_)
+	{
+	    if (cmd.command_ == command)
+	    {
+		executeCommand(cmd, opts);
+		return;
+	    }
+	}
+	std::cerr << "Unknown command " << command << " in compiled script" << std::endl;
+    }
+
+    // queued on midiStage_, goes out with the next flush
+    void sendMidiMessage(const MidiMessage& msg)
+    {
+	if (midiRecorder_.isRecording())
+	{
+	    midiRecorder_.record(msg, Time::getHighResolutionTicks());
+	}
+	if (midiStage_.hasOutput() || replaying_)
+	{
+	    midiStage_.add(msg);
+	}
+	else
+	{
+	    static bool missingOutputPortWarningPrinted = false;
+	    if (!missingOutputPortWarningPrinted)
+	    {
+		std::cerr << "No valid MIDI output port was specified for some of the messages" << std::endl;
+		missingOutputPortWarningPrinted = true;
+	    }
+	}
+    }
+
+    bool checkChannel(const MidiMessage& msg, int channel)
+    {
+	return channel == 0 || msg.getChannel() == channel;
+    }
+
+    void handleIncomingMidiMessage(MidiInput* source, const MidiMessage& msg) override
+    {
+	const SpanTrace::Scope span(&spans_, "handleIncomingMidiMessage");
+	const int input = findMidiInput(source);
+	if (sysexCapture_.isCapturing())
+	{
+	    captureSysexEnd(input, msg.getRawData(), msg.getRawDataSize());
+	}
+	// JUCE's own time stamp is only to the millisecond
+	handleMidiInput(input, msg, time_.getHighResolutionTicks());
+    }
+
+    // JUCE keeps the dump so far and hands it all over every time, the
+    // capture only gets what's new
+    void handlePartialSysexMessage(MidiInput* source, const uint8* data, int numBytesSoFar, double) override
+    {
+	if (!sysexCapture_.isCapturing())
+	{
+	    return;
+	}
+	int& seen = partialSysex_[findMidiInput(source)];
+	if (numBytesSoFar < seen)
+	{
+	    seen = 0;       // a new dump
+	}
+	sysexCapture_.feed(findMidiInput(source), data + seen, numBytesSoFar - seen);
+	seen = numBytesSoFar;
+    }
+
+    // the rest of a whole sysex message, or what cut one short
+    void captureSysexEnd(int input, const uint8* data, int size)
+    {
+	int& seen = partialSysex_[input];
+	if (data[0] == 0xf0)
+	{
+	    const int from = seen <= size ? seen : 0;
+	    sysexCapture_.feed(input, data + from, size - from);
+	    seen = 0;
+	}
+	else if (data[0] < 0xf8 && seen > 0)
+	{
+	    sysexCapture_.feed(input, data, 1);
+	    seen = 0;
+	}
+    }
+
+    // the benchmark and replay feed their events in without an input, as the first
+    int findMidiInput(const MidiInput* source) const
+    {
+	for (int i = 0; i < AlsaMidiInput::maxSources; ++i)
+	{
+	    if (source != nullptr && midiInputs_[i].input_.get() == source)
+	    {
+		return i;
+	    }
+	}
+	return 0;
+    }
+
+    // ticks is a Time::getHighResolutionTicks() value for when the message
+    // was first seen, as early as its input can tell; pedal latency counts
+    // from there
+    void handleMidiInput(int input, const MidiMessage& msg, int64 ticks)
+    {
+	// mode_ and the LEDs belong to the control thread, just hand the pedal over
+	runMidiInputStages({msg.getRawData(), msg.getRawDataSize(), input, ticks}, [this] (const PedalEvent& event)
+	{
+	    if (!pedalEvents_.push(event))
+	    {
+		return false;
+	    }
+	    wakeControlThread();
+	    return true;
+	});
+    }
+
+    // every message in from every input: counted, filtered, routed, followed
+    // for "follow" and logged. Pedals and the expression pedals that are
+    // mapped go to deliver(const PedalEvent&), false if it couldn't take one,
+    // other controllers straight out.
+    template <typename Deliver>
+    void runMidiInputStages(const MidiInputEvent& event, Deliver&& deliver)
+    {
+	const AllocationAccounting::Scope counted(allocations_, AllocationAccounting::MidiEvent);
+	makeStagePipeline(
+	    [this] (const MidiInputEvent& e)
+	    {
+		midiInputs_[e.input_].numEvents_.fetch_add(1, std::memory_order_relaxed);
+		if (presenceEnabled_)
+		{
+		    midiInputs_[e.input_].presence_.heard(e.data_, e.size_, Time::getMillisecondCounter());
+		}
+		if (midiInputs_[e.input_].standingBy_.load(std::memory_order_relaxed))
+		{
+		    return false;
+		}
+		trace_.record(TraceCapture::MidiIn, e.data_, e.size_);
+		metrics_.countMidiIn(e.data_, e.size_);
+		return true;
+	    },
+	    [this] (const MidiInputEvent& e)
+	    {
+		if (!midiFilter_.passes(e.data_, e.size_))
+		{
+		    numMidiFiltered_.value_.fetch_add(1, std::memory_order_relaxed);
+		    return false;
+		}
+		return true;
+	    },
+	    [this, &deliver] (const MidiInputEvent& e)
+	    {
+		if (e.size_ != 3 || (e.data_[0] & 0xf0) != 0xb0)
+		{
+		    return true;
+		}
+		const int controller = e.data_[1];
+		if (controller == 104 || controller == 105)
+		{
+		    if (!deliver(PedalEvent { controller, e.data_[2], e.ticks_, e.input_ }))
+		    {
+			std::cerr << "Pedal queue is full, dropping controller " << controller << " " << (int) e.data_[2] << std::endl;
+		    }
+		}
+		else if (expression_.isMapped(controller))
+		{
+		    // becomes SooperLooper "set" messages on the control thread
+		    deliver(PedalEvent { controller, e.data_[2], e.ticks_, e.input_ });
+		}
+		else if (midiThru_.isForwarding(e.input_) && !replaying_)
+		{
+		    // the sequencer has already sent it on
+		}
+		else if (overload_.sheds(OverloadGuard::ShedPassthrough))
+		{
+		    overload_.countShed(OverloadGuard::ShedPassthrough);
+		}
+		else if (replaying_ || feedback_.pass(e.data_, e.ticks_))
+		{
+		    // expression pedals and the like, one block per callback
+		    midiStage_.add(MidiMessage(e.data_, 3));
+		    midiStage_.flush();
+		}
+		return true;
+	    },
+	    whenEnabled(clockFollow_, [this] (const MidiInputEvent& e)
+	    {
+		followClockMessage(e.data_, e.size_, e.ticks_);
+		return true;
+	    }),
+	    [this] (const MidiInputEvent& e)
+	    {
+		logMidiIn(e.data_, e.size_, e.ticks_);
+		return true;
+	    })(event);
+    }
+
+    // "monitor" takes the MIDI coming in over from the event log
+    void logMidiIn(const uint8* data, int size, int64 ticks)
+    {
+	if (midiMonitor_.isMonitoring())
+	{
+	    midiMonitor_.add(data, size, ticks);
+	}
+	else if (eventLog_.isEnabled(LogNormal))
+	{
+	    eventLog_.logMidi(LogNormal, MidiMessage(data, size));
+	}
+    }
+
+    // the MIDI thread's side of "follow"
+    void followClockMessage(const uint8* data, int size, int64 ticks)
+    {
+	switch (data[0])
+	{
+	    case 0xf8:
+		clock_.clock(ticks);
+		break;
+	    case 0xfa:
+		clock_.start();
+		break;
+	    case 0xfb:
+		clock_.resume();
+		break;
+	    case 0xfc:
+		clock_.stop();
+		break;
+	    case 0xf2:
+		if (size >= 3)
+		{
+		    clock_.songPosition(data[1] | (data[2] << 7));
+		}
+		break;
+	    default:
+		break;
+	}
+    }
+
+    // "jtransport", while the transport rolls; it goes before the other clocks
+    bool isFollowingJack() const
+    {
+	return jackTransport_.isOpen() && jackTransport_.isRolling();
+    }
+
+    bool isFollowingClock() const
+    {
+	return clockFollow_ && !isFollowingJack() && clock_.isLocked(Time::getHighResolutionTicks());
+    }
+
+    // "netclock", while neither of those is followed instead
+    bool isFollowingNetClock() const
+    {
+	return netClockHost_.isNotEmpty() && !isFollowingJack() && !isFollowingClock()
+	    && netClock_.isLocked(Time::getHighResolutionTicks());
+    }
+
+    // the blink clock's tempo and phase come from outside, not SooperLooper
+    bool isFollowingBeat() const
+    {
+	return isFollowingJack() || isFollowingClock() || isFollowingNetClock();
+    }
+
+    // control thread, every tick: a tempo that's moved enough goes to the
+    // active engine, and the blink clock runs off the followed beat
+    void followMidiClock()
+    {
+	const int64 now = Time::getHighResolutionTicks();
+	if (!clock_.isLocked(now) || isFollowingJack())
+	{
+	    return;
+	}
+
+	const double bpm = clock_.getBpm();
+	if (blink_.isRunning())
+	{
+	    blink_.setTempo(bpm);
+	    blink_.syncPhase(clock_.getPhase(now));
+	}
+
+	Engine& engine = activeEngine();
+	if (engine.connected_ && std::abs(bpm - engine.clockTempoSent_) >= clockMinChange_)
+	{
+	    sendTempo(engine, bpm);
+	    engine.clockTempoSent_ = bpm;
+	    ++numClockTempoSent_;
+	}
+    }
+
+    // every tick while the transport rolls: the blink clock runs off its
+    // beat. SooperLooper's tempo isn't set, under JACK it syncs to the
+    // transport itself.
+    void followJackTransport()
+    {
+	if (!isFollowingJack() || !blink_.isRunning())
+	{
+	    return;
+	}
+	blink_.setTempo(jackTransport_.getBpm());
+	blink_.syncPhase(jackTransport_.getPhase(Time::getHighResolutionTicks()));
+    }
+
+    // each answer from the leader: the blink clock runs off its beat, and
+    // SooperLooper gets its tempo as with "follow"
+    void followNetClock()
+    {
+	if (!isFollowingNetClock())
+	{
+	    return;
+	}
+
+	const int64 now = Time::getHighResolutionTicks();
+	const double bpm = netClock_.getBpm();
+	if (blink_.isRunning())
+	{
+	    blink_.setTempo(bpm);
+	    blink_.syncPhase(netClock_.getPhase(now));
+	}
+
+	Engine& engine = activeEngine();
+	if (engine.connected_ && std::abs(bpm - engine.clockTempoSent_) >= clockMinChange_)
+	{
+	    sendTempo(engine, bpm);
+	    engine.clockTempoSent_ = bpm;
+	    ++numClockTempoSent_;
+	}
+    }
+
+    // asks the leader for its clock, t0 in the request; it answers on
+    // /loop4r/clock_answer
+    void sendNetClockRequest(uint32 now)
+    {
+	if (netClockHost_.isEmpty())
+	{
+	    return;
+	}
+	wheel_.scheduleIn(netClockTimer_, netClockMs_, now);
+	OscPacketSender* sender = replySenders_.get(netClockHost_.toRawUTF8(), netClockPort_);
+	if (sender == nullptr)
+	{
+	    return;
+	}
+	const String self = sender->isLoopback() ? String("localhost") : sender->getLocalAddress();
+	const int64 t0 = NetworkClock::toMicros(Time::getHighResolutionTicks());
+	OscPacket packet;
+	packet.size_ = OscMessageWriter(packet).begin("/loop4r/clock", "sisii").addString(self.toRawUTF8()).addInt32(currentReceivePort_)
+	    .addString("/loop4r/clock_answer").addInt32(NetworkClock::getHigh(t0)).addInt32(NetworkClock::getLow(t0)).size();
+	if (sender->send(packet))
+	{
+	    ++numNetClockRequests_;
+	}
+    }
+
+    // "hostclock": t0 to the loop4r_read on the engine's host, answered on
+    // "<prefix>/time"
+    void sendTimeRequest(Engine& engine, uint32 now)
+    {
+	engine.clockAskedAt_ = now;
+	OscPacketSender* sender = replySenders_.get(engine.sendHost_.toRawUTF8(), hostClockPort_);
+	if (sender == nullptr)
+	{
+	    return;
+	}
+	const String path = engine.pathPrefix_ + "/time";
+	const int64 t0 = ClockOffset::getWallMicros();
+	OscPacket packet;
+	packet.size_ = OscMessageWriter(packet).begin("/loop4r/time", "sisii").addString(engine.localAddress_.toRawUTF8())
+	    .addInt32(currentReceivePort_).addString(path.toRawUTF8()).addInt32(ClockOffset::getHigh(t0)).addInt32(ClockOffset::getLow(t0)).size();
+	sender->send(packet);
+    }
+
+    // a time tag for when ticks is on the engine's host, whose clock may not
+    // agree with ours
+    uint64 getTimeTag(const Engine& engine, int64 ticks) const
+    {
+	const int64 now = ClockOffset::getWallMicros();
+	const double maxAgeMicros = 10.0 * engine.heartbeat_.getPingInterval() * 1000.0;
+	const double offset = hostClockPort_ > 0 && engine.clockOffset_.isLocked(now, maxAgeMicros) ? engine.clockOffset_.getOffsetMicros(now) : 0;
+	return OscTimedBundle::getTimeTag(ticks, offset);
+    }
+
+    void sendTempo(Engine& engine, double bpm)
+    {
+	OscPacket packet;
+	packet.size_ = OscMessageWriter(packet).begin("/set", "sf").addString("tempo").addFloat32((float) bpm).size();
+	engine.sender_.send(packet);
+    }
+
+    // The epoll loop's shortcut for a pedal: the three bytes come straight from
+    // the sequencer event and the pedal is handled right here, on the control
+    // thread, without a MidiMessage. Anything else says no and takes the way
+    // above.
+    bool handleIncomingController(int input, int channel, int controller, int value, int64 ticks)
+    {
+	if (controller != 104 && controller != 105)
+	{
+	    return false;
+	}
+	const uint8 bytes[3] = { (uint8) (0xb0 | channel), (uint8) controller, (uint8) value };
+	runMidiInputStages({bytes, 3, input, ticks}, [this] (const PedalEvent& event) { handlePedalEvent(event); return true; });
+	return true;
+    }
+
+    //==============================================================================
+    // "bench": the hot paths run synchronously on the message thread before the
+    // control thread exists, each event is fed in and fully handled, LEDs
+    // included, before the next one
+    template <typename Function>
+    BenchmarkResult runBenchmark(const String& name, int64 events, Function&& replay)
+    {
+	BenchmarkResult result;
+	result.name_ = name;
+	result.events_ = events;
+	const int64 ledsBefore = ledChanges_.getNumSent();
+	const int64 allocationsBefore = allocationCount.load();
+	const int64 bytesBefore = allocationBytes.load();
+	const int64 start = Time::getHighResolutionTicks();
+	for (int64 i = 0; i < events; ++i)
+	{
+	    replay(i);
+	}
+	result.ticks_ = Time::getHighResolutionTicks() - start;
+	result.allocations_ = allocationCount.load() - allocationsBefore;
+	result.allocatedBytes_ = allocationBytes.load() - bytesBefore;
+	result.ledMessages_ = ledChanges_.getNumSent() - ledsBefore;
+	return result;
+    }
+
+    // message is scratch space, so the benchmark doesn't count its own allocations
+    void drainControlEvents(OSCMessage& message)
+    {
+	PedalEvent pedal;
+	while (pedalEvents_.pop(pedal))
+	{
+	    handlePedalEvent(pedal);
+	}
+	midiStage_.flush();
+	drainOscEvents(message);
+	commitLeds();
+    }
+
+    // The pedals again, from a thread of their own as the MIDI thread sends
+    // them, handled here as they come off the queue. The one benchmark where
+    // two threads share the hot state, and so the one "perf c2c" has anything
+    // to say about (Builds/LinuxMakefile/c2c.mk).
+    BenchmarkResult runPedalQueueBenchmark(int64 events)
+    {
+	PedalEvent pedal;
+	WaitableEvent room;
+	ScopedPointer<BenchmarkFeeder> feeder;
+	return runBenchmark("pedal queue", events, [this, events, &pedal, &room, &feeder] (int64 i)
+	{
+	    if (i == 0)
+	    {
+		feeder = new BenchmarkFeeder(events, [this, &room] (int64 fed)
+		{
+		    // never so far ahead that the queue fills. Both sides wait
+		    // rather than spin, a spinning side on a single core only
+		    // keeps the other one from running.
+		    while (pedalEvents_.size() >= pedalEvents_.capacity() / 2)
+		    {
+			room.wait(1);
+		    }
+		    handleIncomingMidiMessage(nullptr, MidiMessage::controllerEvent(channel_, (fed & 1) ? 105 : 104, (int) ((fed / 2) % 10)));
+		});
+	    }
+	    while (!pedalEvents_.pop(pedal))
+	    {
+		controlWakeUp_.wait(1);
+	    }
+	    room.signal();
+	    handlePedalEvent(pedal);
+	    midiStage_.flush();
+	    commitLeds();
+	    if (i == events - 1)
+	    {
+		feeder = nullptr;
+	    }
+	});
+    }
+
+    // a recorded /ctrl stream, one "loop control value" per line
+    Array<OSCMessage> loadCtrlStream(const File& file)
+    {
+	Array<OSCMessage> messages;
+	StringArray lines;
+	file.readLines(lines);
+	for (const String& line : lines)
+	{
+	    StringArray tokens;
+	    tokens.addTokens(line, true);
+	    tokens.removeEmptyStrings(true);
+	    if (tokens.size() == 3 && !line.startsWith("#"))
+	    {
+		OSCMessage message("/ctrl");
+		message.addInt32(tokens[0].getIntValue());
+		message.addString(tokens[1]);
+		message.addFloat32(tokens[2].getFloatValue());
+		messages.add(message);
+	    }
+	}
+	return messages;
+    }
+
+    void runBenchmarks()
+    {
+	CountingLedSink sink;
+	ledOutput_.setSink(&sink);
+	eventLog_.setLevel(LogQuiet);
+
+	Engine& engine = activeEngine();
+	engine.loopCount_ = 8;
+	engine.loops_.reset(engine.loopCount_);
+
+	Array<OSCMessage> ctrl;
+	if (benchmarkCtrlFile_.isNotEmpty())
+	{
+	    ctrl = loadCtrlStream(File::getCurrentWorkingDirectory().getChildFile(benchmarkCtrlFile_));
+	    if (ctrl.isEmpty())
+	    {
+		std::cerr << "No /ctrl lines in \"" << benchmarkCtrlFile_ << "\", using a synthetic stream" << std::endl;
+	    }
+	}
+	if (ctrl.isEmpty())
+	{
+	    const LoopStates states[] = { Recording, Playing, Overdubbing, Multiplying, Muted, Playing };
+	    for (int i = 0; i < 48; ++i)
+	    {
+		OSCMessage message("/ctrl");
+		message.addInt32(i % engine.loopCount_);
+		message.addString("state");
+		message.addFloat32((float) states[(i / engine.loopCount_) % 6]);
+		ctrl.add(message);
+	    }
+	}
+
+	const int64 events = benchmarkEvents_;
+	OSCMessage scratch("/");
+	Array<BenchmarkResult> results;
+	results.add(runBenchmark("pedals", events, [this, &scratch] (int64 i)
+	{
+	    // presses and releases walking over all ten pedals
+	    handleIncomingMidiMessage(nullptr, MidiMessage::controllerEvent(channel_, (i & 1) ? 105 : 104, (int) ((i / 2) % 10)));
+	    drainControlEvents(scratch);
+	}));
+	RunningStatusDecoder decoder;
+	results.add(runBenchmark("raw pedals", events, [this, &decoder, &scratch] (int64 i)
+	{
+	    // the same, as a rawmidi device's bytes with running status after the first
+	    const uint8 bytes[3] = { (uint8) (0xb0 | (channel_ - 1)), (uint8) ((i & 1) ? 105 : 104), (uint8) ((i / 2) % 10) };
+	    decoder.feed(i == 0 ? bytes : bytes + 1, i == 0 ? 3 : 2, [this] (const uint8* data, int size) { handleShortMidiMessage(0, data, size, Time::getHighResolutionTicks()); });
+	    drainControlEvents(scratch);
+	}));
+	results.add(runBenchmark("expression", events, [this, &scratch] (int64 i)
+	{
+	    // expression pedal going up and down
+	    const int position = (int) (i % 254);
+	    handleIncomingMidiMessage(nullptr, MidiMessage::controllerEvent(channel_, 7, position < 127 ? position : 253 - position));
+	    drainControlEvents(scratch);
+	}));
+	results.add(runBenchmark("ctrl", events, [this, &ctrl, &scratch] (int64 i)
+	{
+	    oscMessageReceived(ctrl.getReference((int) (i % ctrl.size())));
+	    drainControlEvents(scratch);
+	}));
+	results.add(runPedalQueueBenchmark(events));
+
+	// the OSC codecs on their own, every shape through every path it has
+	OscCodecBenchmark codec;
+	for (int shape = 0; shape < OscCodecBenchmark::numShapes; ++shape)
+	{
+	    for (int path = 0; path < OscCodecBenchmark::numPaths; ++path)
+	    {
+		const OscCodecBenchmark::Shape s = (OscCodecBenchmark::Shape) shape;
+		const OscCodecBenchmark::Path p = (OscCodecBenchmark::Path) path;
+		if (OscCodecBenchmark::applies(s, p))
+		{
+		    results.add(runBenchmark(String(OscCodecBenchmark::getShapeName(s)) + " " + OscCodecBenchmark::getPathName(p), events,
+					     [&codec, s, p] (int64 i) { codec.run(s, p, i); }));
+		}
+	    }
+	}
+
+	ledOutput_.stop();
+	for (auto&& result : results)
+	{
+	    result.print(std::cout);
+	}
+	std::cout << "LED writer: " << sink.getNumCommands() << " commands in " << sink.getNumFlushes() << " flushes" << std::endl;
+	ledOutput_.setSink(nullptr);
+    }
+
+    //==============================================================================
+    // "soak": the pedal, expression and SooperLooper traffic "bench" feeds in,
+    // mixed with heartbeats, pingacks that change the loop count and stats
+    // queries, kept up at a fixed rate for minutes or hours while the memory
+    // is sampled. It fails (exit code 1) if the RSS or the heap in use grew
+    // faster than the limit, going by the slope after the first tenth.
+    void runSoak()
+    {
+	CountingLedSink sink;
+	ledOutput_.setSink(&sink);
+	eventLog_.setLevel(LogQuiet);
+	std::signal(SIGINT, signalQuit);
+	std::signal(SIGTERM, signalQuit);
+
+	Engine& engine = activeEngine();
+	engine.loopCount_ = 8;
+	engine.loops_.reset(engine.loopCount_);
+
+	const LoopStates states[] = { Recording, Playing, Overdubbing, Multiplying, Muted, Playing };
+	const double seconds = soakMinutes_ * 60.0;
+	const double sampleInterval = jlimit(1.0, 60.0, seconds / 100.0);
+	const int64 ticksPerSecond = Time::getHighResolutionTicksPerSecond();
+	const int64 start = Time::getHighResolutionTicks();
+	OSCMessage scratch("/");
+	MemoryGrowth growth;
+	int64 events = 0;
+	double nextSample = 0;
+
+	std::cout << "Soak: " << roundToInt(seconds) << "s at " << soakRate_ << " events/s, failing above "
+		  << soakLimitKB_ << "KB/hour" << std::endl;
+	for (;;)
+	{
+	    const double elapsed = (double) (Time::getHighResolutionTicks() - start) / (double) ticksPerSecond;
+	    if (elapsed >= nextSample || elapsed >= seconds || quitSignalled)
+	    {
+		growth.add(MemorySample::take(elapsed));
+		growth.getLast().print(std::cout);
+		nextSample += sampleInterval;
+	    }
+	    if (elapsed >= seconds || quitSignalled)
+	    {
+		break;
+	    }
+	    // a batch of events, then sleep until they're due
+	    const int64 due = (int64) (elapsed * soakRate_) + jmax(1, soakRate_ / 100);
+	    for (; events < due; ++events)
+	    {
+		const int64 i = events;
+		switch (i % 32)
+		{
+		    case 31:
+			if ((i / 32) % 500 == 0)
+			{
+			    // SooperLooper coming back with a different number of loops
+			    OSCMessage message("/pingack");
+			    message.addString("osc.udp://localhost:9951/");
+			    message.addString("1.7");
+			    message.addInt32(((i / 32) % 1000) == 0 ? 8 : 6);
+			    message.addInt32(9951);
+			    oscMessageReceived(message);
+			}
+			else if ((i / 32) % 50 == 0)
+			{
+			    OSCMessage message("/loop4r/stats");
+			    message.addString("localhost");
+			    message.addInt32(9);
+			    message.addString("/soak");
+			    message.addString("all");
+			    oscMessageReceived(message);
+			}
+			else
+			{
+			    OSCMessage message("/heartbeat");
+			    message.addString("osc.udp://localhost:9951/");
+			    message.addString("1.7");
+			    message.addInt32(engine.loopCount_);
+			    message.addInt32(9951);
+			    oscMessageReceived(message);
+			}
+			break;
+		    default:
+			if (i % 32 < 12)
+			{
+			    // presses and releases walking over all ten pedals
+			    handleIncomingMidiMessage(nullptr, MidiMessage::controllerEvent(channel_, (i & 1) ? 105 : 104, (int) ((i / 2) % 10)));
+			}
+			else if (i % 32 < 20)
+			{
+			    const int position = (int) (i % 254);
+			    handleIncomingMidiMessage(nullptr, MidiMessage::controllerEvent(channel_, 7, position < 127 ? position : 253 - position));
+			}
+			else
+			{
+			    OSCMessage message("/ctrl");
+			    message.addInt32((int) (i % jmax(1, engine.loopCount_)));
+			    message.addString("state");
+			    message.addFloat32((float) states[(i / 7) % 6]);
+			    oscMessageReceived(message);
+			}
+		}
+		drainControlEvents(scratch);
+	    }
+	    const double behind = (double) events / soakRate_ - (double) (Time::getHighResolutionTicks() - start) / (double) ticksPerSecond;
+	    if (behind > 0.001)
+	    {
+		Thread::sleep((int) (behind * 1000.0));
+	    }
+	}
+
+	ledOutput_.stop();
+	ledOutput_.setSink(nullptr);
+
+	const double rssSlope = growth.getRssSlopeKBPerHour();
+	const double heapSlope = growth.getHeapSlopeKBPerHour();
+	const bool failed = rssSlope > soakLimitKB_ || heapSlope > soakLimitKB_;
+	std::cout << events << " events, " << sink.getNumCommands() << " LED commands" << std::endl
+		  << "Growth: rss " << String(rssSlope, 1) << "KB/hour, heap " << String(heapSlope, 1) << "KB/hour over "
+		  << growth.size() << " samples" << std::endl
+		  << (failed ? "FAIL" : "PASS") << std::endl;
+	setApplicationReturnValue(failed ? 1 : 0);
+    }
+
+    // "scale", the CSV to scaleFile_ if it's given
+    void runScaleBenchmark()
+    {
+	ScaleBenchmark::Options options;
+	options.executable_ = File::getSpecialLocation(File::currentExecutableFile);
+	options.seconds_ = scaleSeconds_;
+	std::ostringstream csv;
+	ScaleBenchmark benchmark;
+	const bool ran = benchmark.run(options, scaleFile_.isEmpty() ? std::cout : csv, std::cerr);
+	if (scaleFile_.isNotEmpty())
+	{
+	    const File out(File::getCurrentWorkingDirectory().getChildFile(scaleFile_));
+	    if (!out.replaceWithText(csv.str()))
+	    {
+		std::cerr << "Couldn't write " << out.getFullPathName() << std::endl;
+	    }
+	}
+	setApplicationReturnValue(ran ? 0 : 1);
+    }
+
+    // "selftest", with "gig" as we'd play if it's given
+    void runSelfTest()
+    {
+	if (gigMode_)
+	{
+	    startGigMode();
+	}
+	const int timeoutMs = 100;
+	selfTest_.probeSequencer(200, timeoutMs);
+	selfTest_.probeUdp(oscReceivePort_, 200, timeoutMs);
+	selfTest_.probeTimer(800, [this] { return threadTuning_.applyToCurrentThread("control"); });
+	const Engine& engine = activeEngine();
+	selfTest_.probePing(engine.sendHost_, engine.sendPort_, 20, timeoutMs);
+	setApplicationReturnValue(selfTest_.dump(std::cout) ? 0 : 1);
+    }
+
+    //==============================================================================
+    // "hbloss": SooperLooper answering every ping for aliveSeconds and then
+    // going quiet, for minutes, on the virtual clock. The control passes run
+    // back to back with the clock moved on to whatever they wait for, so
+    // minutes of heartbeats and backoff take milliseconds. It fails (exit
+    // code 1) if the silence isn't noticed in time or the reconnects stop or
+    // back off further than they should.
+    void runHeartbeatLoss()
+    {
+	CountingLedSink sink;
+	ledOutput_.setSink(&sink);
+	eventLog_.setLevel(LogQuiet);
+	time_.makeVirtual();
+
+	Engine& engine = activeEngine();
+	const int64 realStart = Time::getHighResolutionTicks();
+	const uint32 start = time_.getMillisecondCounter();
+	const uint32 end = start + (uint32) roundToInt(heartbeatLossMinutes_ * 60000.0);
+	const uint32 quietAt = start + (uint32) heartbeatLossAliveMs_;
+	const int rttMs = 2;
+
+	createTimers();
+	OSCMessage message("/");
+	OSCMessage scratch("/");
+	int64 numPasses = 0;
+	int64 numAnswered = 0;
+	int64 numConnects = 0;
+	bool wasConnected = false;
+	uint32 lastHeard = start;
+	uint32 lostAt = 0;
+	uint32 lastConnectAt = 0;
+	int longestGapMs = 0;
+	while ((int) (time_.getMillisecondCounter() - end) < 0)
+	{
+	    const int wait = runControlPass(message);
+	    ++numPasses;
+	    const uint32 now = time_.getMillisecondCounter();
+	    if (engine.connected_ && !wasConnected)
+	    {
+		++numConnects;
+		if (lastConnectAt != 0 && (int) (lastConnectAt - quietAt) >= 0)
+		{
+		    // from one reconnect to the next, both into the silence
+		    longestGapMs = jmax(longestGapMs, (int) (now - lastConnectAt));
+		}
+		lastConnectAt = now;
+	    }
+	    else if (!engine.connected_ && wasConnected && lostAt == 0 && (int) (now - quietAt) >= 0)
+	    {
+		lostAt = now;
+	    }
+	    wasConnected = engine.connected_;
+
+	    if (engine.connected_ && (int) (now - quietAt) < 0 && (engine.loopCount_ == 0 || engine.heartbeat_.isPingOutstanding()))
+	    {
+		// the answer comes back a round trip later
+		time_.advance(rttMs);
+		if (engine.loopCount_ == 0)
+		{
+		    OSCMessage pingAck("/pingack");
+		    pingAck.addString("osc.udp://localhost:" + String(engine.sendPort_) + "/");
+		    pingAck.addString("1.7");
+		    pingAck.addInt32(8);
+		    pingAck.addInt32(engine.sendPort_);
+		    oscMessageReceived(pingAck);
+		}
+		else
+		{
+		    OSCMessage heartbeat("/heartbeat");
+		    heartbeat.addString("osc.udp://localhost:" + String(engine.sendPort_) + "/");
+		    heartbeat.addString("1.7");
+		    heartbeat.addInt32(engine.loopCount_);
+		    heartbeat.addInt32(engine.sendPort_);
+		    oscMessageReceived(heartbeat);
+		}
+		drainControlEvents(scratch);
+		lastHeard = time_.getMillisecondCounter();
+		++numAnswered;
+		continue;
+	    }
+	    time_.advance(wait < 0 ? (int) (end - now) : jmax(1, jmin(wait, (int) (end - now))));
+	}
+	ledOutput_.stop();
+	ledOutput_.setSink(nullptr);
+
+	const double realMs = Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - realStart) * 1000.0;
+	const int noticedMs = lostAt != 0 ? (int) (lostAt - lastHeard) : -1;
+	const int lateMs = 200;     // a periodic tick's worth
+	const int noticeLimitMs = engine.heartbeat_.getPingInterval() + 3 * HeartbeatMonitor::maxTimeoutMs + lateMs;
+	const int gapLimitMs = HeartbeatMonitor::maxBackoffMs + noticeLimitMs;
+	const bool failed = noticedMs < 0 || noticedMs > noticeLimitMs || longestGapMs > gapLimitMs
+	    || (int) (end - lastConnectAt) > gapLimitMs;
+	std::cout << "Heartbeat loss: " << String(heartbeatLossMinutes_, 1) << " minutes on the virtual clock in "
+		  << String(realMs, 1) << "ms, " << numPasses << " control passes" << std::endl
+		  << "Answered " << numAnswered << " pings for " << heartbeatLossAliveMs_ / 1000 << "s, silence noticed after "
+		  << noticedMs << "ms (at most " << noticeLimitMs << "ms)" << std::endl
+		  << numConnects << " connects, " << engine.heartbeat_.getNumReconnects() << " losses, at most "
+		  << longestGapMs << "ms apart (at most " << gapLimitMs << "ms), " << engine.heartbeat_.getNumPings() << " pings" << std::endl
+		  << (failed ? "FAIL" : "PASS") << std::endl;
+	setApplicationReturnValue(failed ? 1 : 0);
+    }
+
+    //==============================================================================
+    // "journal show": what a journal holds, e.g. the one a crashed or frozen
+    // loop4r_read left in /dev/shm
+    void showJournal()
+    {
+	Array<EventJournal::Entry> entries;
+	if (!EventJournal::read(journalShowFile_, entries))
+	{
+	    std::cerr << "No journal in \"" << journalShowFile_.getFullPathName() << "\"" << std::endl;
+	    setApplicationReturnValue(1);
+	    return;
+	}
+	for (auto& entry : entries)
+	{
+	    std::cout << Time(entry.ms_).formatted("%Y-%m-%d %H:%M:%S") << "." << String(entry.ms_ % 1000).paddedLeft('0', 3)
+		      << "  " << EventJournal::describe(entry) << std::endl;
+	}
+	std::cout << entries.size() << " events" << std::endl;
+    }
+
+    //==============================================================================
+    // "e2e": the loopback client plays into our virtual input and quits us
+    // once it has timed every press, shutdown() printing what it measured
+    void startLoopback()
+    {
+	String input;
+	for (int i = 0; i < numMidiInputs_ && input.isEmpty(); ++i)
+	{
+	    if (midiInputs_[i].virtual_)
+	    {
+		input = midiInputs_[i].name_;
+	    }
+	}
+	const String output = midiOutputs_[VirtualOut].output_ != nullptr ? midiOutputs_[VirtualOut].name_ : String();
+	loopback_.onFinished_ = [this] { MessageManager::callAsync([this] { systemRequestedQuit(); }); };
+	if (input.isEmpty() || output.isEmpty()
+	    || !loopback_.start(input, output, oscReceivePort_, channel_, loopbackEvents_, loopbackRate_))
+	{
+	    std::cerr << "Couldn't start the loopback benchmark, it needs \"vin\" and \"vout\" ports on ALSA" << std::endl;
+	    loopbackEvents_ = 0;
+	    systemRequestedQuit();
+	}
+    }
+
+    //==============================================================================
+    // "sim": no loop4r at all, just the simulated SooperLooper on its own
+    // thread, for another loop4r_read (or several) to be pointed at
+    void runSimulator()
+    {
+	std::signal(SIGINT, signalQuit);
+	std::signal(SIGTERM, signalQuit);
+	SooperLooperSimulator simulator;
+	if (!simulator.start(simulatorOptions_))
+	{
+	    std::cerr << "Couldn't bind the simulator to port " << simulatorOptions_.port_ << std::endl;
+	    setApplicationReturnValue(1);
+	    return;
+	}
+	std::cout << "Simulating SooperLooper on port " << simulatorOptions_.port_ << " with " << simulatorOptions_.loops_
+		  << " loops, updates every " << simulatorOptions_.updateIntervalMs_ << "ms" << std::endl;
+	double last = Time::getMillisecondCounterHiRes();
+	while (!quitSignalled)
+	{
+	    Thread::sleep(100);
+	    const double now = Time::getMillisecondCounterHiRes();
+	    if (now - last >= 1000.0)
+	    {
+		simulator.printStats(std::cout, (now - last) / 1000.0);
+		last = now;
+	    }
+	}
+	simulator.stop();
+    }
+
+    //==============================================================================
+    // "replay": a trace's MIDI and OSC input is fed back through the handlers on
+    // the message thread, the same way "bench" does it, with the output going
+    // to a trace of its own, ending with the unregistrations shutdown() sends.
+    // That is then compared, stream by stream, with the MIDI, LED and OSC
+    // output in the original. Pings are left out of the
+    // comparison since they follow the clock rather than the input; so do
+    // registration renewals, thinning and expression ramps, which can make a
+    // difference in long or fast replays. From an archive only the segments
+    // around the part asked for are read; started part way in, the loops'
+    // state from before isn't there, so the output may differ from the start.
+    void runReplay()
+    {
+	const File file(File::getCurrentWorkingDirectory().getChildFile(replayFile_));
+	Array<TraceCapture::Entry> recorded;
+	int64 ticksPerSecond = 0;
+	int numSegments = 0;
+	const bool archived = TraceArchive::isArchive(file);
+	if (!(archived ? TraceArchive::read(file, replayFrom_, replayFor_, recorded, ticksPerSecond, &numSegments)
+	      : TraceCapture::read(file, recorded, ticksPerSecond)) || recorded.isEmpty())
+	{
+	    std::cerr << "No trace records in \"" << replayFile_ << "\"" << std::endl;
+	    return;
+	}
+
+	const File output(File::getSpecialLocation(File::tempDirectory).getNonexistentChildFile("loop4r-replay", ".trace"));
+	if (!trace_.open(output, jmax((int) TraceCapture::defaultNumRecords, 4 * recorded.size())))
+	{
+	    std::cerr << "Couldn't create trace file " << output.getFullPathName() << std::endl;
+	    return;
+	}
+
+	CountingLedSink sink;
+	ledOutput_.setSink(&sink);
+	eventLog_.setLevel(LogQuiet);
+	// the engines take what's sent as if connected, with the return url the recording had
+	replaying_ = true;
+	for (auto* engine : engines_)
+	{
+	    engine->packets_.setReturnUrl((String) "osc.udp://localhost:" + String(oscReceivePort_) + "/", engine->pathPrefix_);
+	    engine->connected_ = true;
+	}
+
+	OSCMessage message("/");
+	OSCMessage scratch("/");
+	int64 numEvents = 0;
+	int64 numSkipped = 0;
+	const int64 firstTicks = recorded.getReference(0).ticks_;
+	const int64 start = Time::getHighResolutionTicks();
+	if (!replayRealtime_)
+	{
+	    // pedal timing goes by the recorded times however fast it's fed
+	    time_.makeVirtual();
+	}
+	const double virtualTicksPerRecorded = (double) Time::getHighResolutionTicksPerSecond() / (double) ticksPerSecond;
+	for (auto& entry : recorded)
+	{
+	    if (entry.source_ != TraceCapture::MidiIn && entry.source_ != TraceCapture::OscIn)
+	    {
+		continue;
+	    }
+	    if (entry.cutShort_)
+	    {
+		++numSkipped;
+		continue;
+	    }
+
+	    if (replayRealtime_)
+	    {
+		const double due = (entry.ticks_ - firstTicks) / (double) ticksPerSecond;
+		const double wait = due - Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - start);
+		if (wait > 0)
+		{
+		    Thread::sleep(roundToInt(wait * 1000.0));
+		}
+	    }
+	    else
+	    {
+		time_.advanceTo(start + (int64) ((entry.ticks_ - firstTicks) * virtualTicksPerRecorded));
+		advancePedalTiming();
+	    }
+
+	    if (entry.source_ == TraceCapture::MidiIn)
+	    {
+		handleIncomingMidiMessage(nullptr, MidiMessage(entry.data_, entry.size_));
+	    }
+	    else if (OscMessageReader::read(entry.data_, entry.size_, message))
+	    {
+		oscMessageReceived(message);
+	    }
+	    else
+	    {
+		++numSkipped;
+		continue;
+	    }
+	    drainControlEvents(scratch);
+	    ++numEvents;
+	}
+	const double seconds = Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - start);
+
+	// the recording ends with shutdown()'s unregistrations too; the LED
+	// writer emits (and traces) whatever commands are still queued
+	unregisterEngines();
+	ledOutput_.stop();
+	ledOutput_.setSink(nullptr);
+	midiStage_.flush();
+	trace_.close();
+
+	replaying_ = false;
+	for (auto* engine : engines_)
+	{
+	    engine->connected_ = false;
+	}
+
+	Array<TraceCapture::Entry> replayed;
+	TraceCapture::read(output, replayed, ticksPerSecond);
+	output.deleteFile();
+
+	std::cout << "Replayed " << numEvents << " events in " << String(seconds, 3) << "s";
+	if (archived)
+	{
+	    std::cout << " from " << numSegments << " archive segments";
+	}
+	if (numSkipped > 0)
+	{
+	    std::cout << ", skipped " << numSkipped << " cut short or unreadable";
+	}
+	std::cout << std::endl;
+
+	bool identical = true;
+	identical = compareReplay("MIDI out", TraceCapture::MidiOut, recorded, replayed) && identical;
+	identical = compareReplay("LED out", TraceCapture::LedOut, recorded, replayed) && identical;
+	identical = compareReplay("OSC out", TraceCapture::OscOut, recorded, replayed) && identical;
+	setApplicationReturnValue(identical ? 0 : 1);
+    }
+
+    // "analyse": the query on the trace or archive, to stdout
+    void runAnalysis()
+    {
+	const File file(File::getCurrentWorkingDirectory().getChildFile(analyseFile_));
+	TraceAnalyser analyser;
+	if (!analyser.open(file, analysis_))
+	{
+	    std::cerr << "No trace or trace archive in \"" << analyseFile_ << "\"" << std::endl;
+	    setApplicationReturnValue(1);
+	    return;
+	}
+	analyser.run(std::cout, std::cerr);
+    }
+
+    static bool isReplayOutput(const TraceCapture::Entry& entry, TraceCapture::Source source)
+    {
+	return entry.source_ == source
+	    && !(source == TraceCapture::OscOut && entry.size_ >= 6 && std::memcmp(entry.data_, "/ping", 6) == 0);
+    }
+
+    // prints how one output stream compares, true if it's the same
+    bool compareReplay(const char* name, TraceCapture::Source source,
+		       const Array<TraceCapture::Entry>& recorded, const Array<TraceCapture::Entry>& replayed)
+    {
+	int numRecorded = 0;
+	int numReplayed = 0;
+	int firstDifference = -1;
+	int r = 0;
+	int p = 0;
+	for (;;)
+	{
+	    while (r < recorded.size() && !isReplayOutput(recorded.getReference(r), source))
+	    {
+		++r;
+	    }
+	    while (p < replayed.size() && !isReplayOutput(replayed.getReference(p), source))
+	    {
+		++p;
+	    }
+	    if (r == recorded.size() && p == replayed.size())
+	    {
+		break;
+	    }
+
+	    if (firstDifference < 0)
+	    {
+		const bool same = r < recorded.size() && p < replayed.size()
+		    && recorded.getReference(r).size_ == replayed.getReference(p).size_
+		    && std::memcmp(recorded.getReference(r).data_, replayed.getReference(p).data_, (size_t) recorded.getReference(r).size_) == 0;
+		if (!same)
+		{
+		    firstDifference = jmax(numRecorded, numReplayed);
+		}
+	    }
+	    if (r < recorded.size())
+	    {
+		++numRecorded;
+		++r;
+	    }
+	    if (p < replayed.size())
+	    {
+		++numReplayed;
+		++p;
+	    }
+	}
+
+	std::cout << String(name).paddedRight(' ', 10) << " recorded " << numRecorded << ", replayed " << numReplayed;
+	if (firstDifference >= 0)
+	{
+	    std::cout << ", first difference at #" << firstDifference << std::endl;
+	    return false;
+	}
+	std::cout << ", identical" << std::endl;
+	return true;
+    }
+
+    // control thread: what a pedal press or release does, debounced and then
+    // through the gesture recogniser for the pedals that have gestures
+    void handlePedalEvent(const PedalEvent& event)
+    {
+	const SpanTrace::Scope span(&spans_, "pedal");
+	if (event.ticks_ != 0)
+	{
+	    overload_.noteLag(time_.getHighResolutionTicks() - event.ticks_);
+	}
+	PedalStageEvent pedal = decodePedalEvent(event);
+	makeStagePipeline(
+	    [this] (const PedalStageEvent& p)
+	    {
+		if (p.isPedal_)
+		{
+		    journal_.record(p.event_.controller_ == 104 ? EventJournal::PedalDown : EventJournal::PedalUp, 0, p.event_.value_, p.event_.input_);
+		}
+		return true;
+	    },
+	    whenEnabled(midiRecorder_.isRecording(), [this] (const PedalStageEvent& p)
+	    {
+		const uint8 data[] = { (uint8) (0xb0 | ((jlimit(1, 16, channel_) - 1) & 0x0f)), (uint8) (p.event_.controller_ & 0x7f), (uint8) (p.event_.value_ & 0x7f) };
+		midiRecorder_.record(data, 3, p.event_.ticks_);
+		return true;
+	    }),
+	    whenEnabled(debounce_.isEnabled(), [this] (const PedalStageEvent& p)
+	    {
+		if (!p.isPedal_ || p.key_ < 0)
+		{
+		    return true;
+		}
+		const int input = p.event_.input_;
+		debounce_.edge(p.key_, p.event_.controller_ == 104, p.event_.value_, p.event_.ticks_, [this, input] (bool down, int value, int64 ticks) {
+		    recognisePedalEvent({down ? 104 : 105, value, ticks, input});
+		});
+		return false;
+	    }),
+	    [this] (const PedalStageEvent& p)
+	    {
+		recogniseDecodedPedal(p);
+		return true;
+	    })(pedal);
+    }
+
+    static PedalStageEvent decodePedalEvent(const PedalEvent& event)
+    {
+	const bool isPedal = event.controller_ == 104 || event.controller_ == 105;
+	const int pedal = BoardPedals::table.forValue(event.value_).pedal_;
+	return { event, isPedal, pedal, PedalGestures::getKey(event.input_, pedal) };
+    }
+
+    void recognisePedalEvent(const PedalEvent& event)
+    {
+	recogniseDecodedPedal(decodePedalEvent(event));
+    }
+
+    // chords first: a pedal in one is held back for its partner, the
+    // others are only marked held
+    void recogniseDecodedPedal(const PedalStageEvent& pedal)
+    {
+	if (pedal.isPedal_ && pedal.key_ >= 0
+	    && chords_.edge(pedal.key_, pedal.event_.controller_ == 104, pedal.event_.value_, pedal.event_.ticks_,
+			    [this] (int key, int value, int64 ticks) { recogniseSinglePedal(decodePedalEvent({104, value, ticks, PedalChords::inputOf(key)})); },
+			    [this, &pedal] (int chord, int value, int64 ticks) { runGestureAction(chordActions_[chord], pedal.event_.input_, value, ticks); }))
+	{
+	    return;
+	}
+	recogniseSinglePedal(pedal);
+    }
+
+    // tap, script, macro and gesture pedals each take theirs, the rest is the
+    // board's own mapping
+    void recogniseSinglePedal(const PedalStageEvent& pedal)
+    {
+	makeStagePipeline(
+	    whenEnabled(tapKey_ >= 0, [this] (const PedalStageEvent& p)
+	    {
+		if (!p.isPedal_ || p.key_ != tapKey_)
+		{
+		    return true;
+		}
+		handleTapPedal(p.event_);
+		return false;
+	    }),
+	    whenEnabled(numScriptPedals_ > 0, [this] (const PedalStageEvent& p)
+	    {
+		return !p.isPedal_ || p.key_ < 0 || scriptForKey_[p.key_] < 0
+		    || !pedalScripts_.run(scriptForKey_[p.key_], p.pedal_, p.event_.controller_ == 104, p.event_.value_, p.event_.input_, p.event_.ticks_);
+	    }),
+	    whenEnabled(numMacroPedals_ > 0, [this] (const PedalStageEvent& p)
+	    {
+		if (!p.isPedal_ || p.key_ < 0 || macroForKey_[p.key_] < 0)
+		{
+		    return true;
+		}
+		handleMacroPedal(p.key_, p.event_);
+		return false;
+	    }),
+	    whenEnabled(loopGroups_.hasPedals(), [this] (const PedalStageEvent& p)
+	    {
+		if (!p.isPedal_ || p.key_ < 0 || loopGroups_.getMessages(p.key_) == nullptr)
+		{
+		    return true;
+		}
+		handleGroupPedal(p.key_, p.event_);
+		return false;
+	    }),
+	    whenEnabled(!gestures_.isEmpty(), [this] (const PedalStageEvent& p)
+	    {
+		if (!p.isPedal_ || gestures_.getGestures(p.key_) == 0)
+		{
+		    return true;
+		}
+		auto onOutcome = [this] (int key, PedalGestures::Outcome outcome, int value, int64 ticks) { handlePedalGesture(key, outcome, value, ticks); };
+		if (p.event_.controller_ == 104)
+		{
+		    gestures_.pressed(p.key_, p.event_.value_, p.event_.ticks_, onOutcome);
+		}
+		else
+		{
+		    gestures_.released(p.key_, p.event_.ticks_, onOutcome);
+		}
+		return false;
+	    }),
+	    [this] (const PedalStageEvent& p)
+	    {
+		actOnPedalEvent(p.event_);
+		return true;
+	    })(pedal);
+    }
+
+    // "tap": the pedal's LED shows the tap, the tempo goes to the active
+    // engine and the blink clock is put on the beat of the last tap
+    void handleTapPedal(const PedalEvent& event)
+    {
+	const int pedal = BoardPedals::table.forValue(event.value_).pedal_;
+	if (event.controller_ == 105)
+	{
+	    ledOff(pedal);
+	    return;
+	}
+
+	ledOn(pedal);
+	if (!tapTempo_.tap(event.ticks_))
+	{
+	    return;
+	}
+	if (blink_.isRunning())
+	{
+	    const double beats = (double) (time_.getHighResolutionTicks() - tapTempo_.getLastTap()) / tapTempo_.getTicksPerBeat();
+	    blink_.setTempo(tapTempo_.getBpm());
+	    blink_.syncPhase(beats - std::floor(beats));
+	}
+	Engine& engine = activeEngine();
+	if (engine.connected_)
+	{
+	    sendTempo(engine, tapTempo_.getBpm());
+	}
+    }
+
+    // "mpedal": the pedal's LED is lit while its macro runs
+    void handleMacroPedal(int key, const PedalEvent& event)
+    {
+	if (event.controller_ != 104)
+	{
+	    return;
+	}
+
+	const int pedal = key % PedalGestures::pedalsPerInput;
+	if (macros_.cancel(key))
+	{
+	    ledOff(pedal);
+	    return;
+	}
+	ledOn(pedal);
+	if (!macros_.start(macroForKey_[key], key, event.ticks_, time_.getHighResolutionTicks() + getMacroLeadTicks(), getTicksPerBeat(),
+			   [this] (const PedalMacros::Step& step, int, int64 due) { runMacroStep(step, due); },
+			   [this] (int key) { ledOff(key % PedalGestures::pedalsPerInput); }))
+	{
+	    std::cerr << "Too many macros running, not starting another" << std::endl;
+	    ledOff(pedal);
+	}
+    }
+
+    // "gpedal": every loop of the group gets the command from the one bundle,
+    // so they all change in the same engine cycle. With "quant" in record
+    // mode the bundle goes now, time tagged for the beat, rather than being
+    // held back for it. The LED is lit while the pedal's down.
+    void handleGroupPedal(int key, const PedalEvent& event)
+    {
+	const int pedal = key % PedalGestures::pedalsPerInput;
+	if (event.controller_ != 104)
+	{
+	    ledOff(pedal);
+	    return;
+	}
+	ledOn(pedal);
+	Engine& engine = activeEngine();
+	if (!engine.connected_)
+	{
+	    return;
+	}
+
+	const int64 now = time_.getHighResolutionTicks();
+	int64 beat = 0;
+	if (quantiseBeats_ > 0 && mode_ > 0)
+	{
+	    getQuantisedTicks(now, &beat);
+	}
+	OscBundleSender bundle(engine.sender_);
+	if (beat > now)
+	{
+	    bundle.setTimeTag(getTimeTag(engine, beat));
+	    ++numTimedGroupHits_;
+	}
+	for (const OscPacket& packet : *loopGroups_.getMessages(key))
+	{
+	    bundle.add(packet);
+	}
+	++numGroupHits_;
+    }
+
+    // with "osct" steps come here early, due says when they should happen
+    void runMacroStep(const PedalMacros::Step& step, int64 due)
+    {
+	const bool early = due > time_.getHighResolutionTicks();
+	if (step.kind_ == PedalMacros::Step::Note)
+	{
+	    if (early && beatScheduler_.isRunning())
+	    {
+		const int64 noteDue = due - getCompensationTicks();
+		beatScheduler_.schedule(MidiMessage::noteOn(channel_, step.value_, (uint8) 127), noteDue);
+		beatScheduler_.schedule(MidiMessage::noteOff(channel_, step.value_, (uint8) 0), noteDue);
+		return;
+	    }
+	    sendMidiMessage(MidiMessage::noteOn(channel_, step.value_, (uint8) 127));
+	    sendMidiMessage(MidiMessage::noteOff(channel_, step.value_, (uint8) 0));
+	    return;
+	}
+
+	Engine& engine = activeEngine();
+	if (!engine.connected_)
+	{
+	    return;
+	}
+	OscPacket packet;
+	if (step.kind_ == PedalMacros::Step::Select)
+	{
+	    packet.size_ = OscMessageWriter(packet).begin("/set", "sf").addString("selected_loop_num").addFloat32((float) step.loop_).size();
+	}
+	else
+	{
+	    char address[32];
+	    std::snprintf(address, sizeof(address), "/sl/%d/hit", step.loop_);
+	    packet.size_ = OscMessageWriter(packet).begin(address, "s").addString(step.command_.toRawUTF8()).size();
+	}
+	OscPacket bundle;
+	if (early && OscTimedBundle::wrap(packet, getTimeTag(engine, due), bundle))
+	{
+	    engine.sender_.send(bundle);
+	    ++numTimedBundles_;
+	    return;
+	}
+	engine.sender_.send(packet);
+    }
+
+    int64 getMacroLeadTicks() const
+    {
+	return (int64) (macroLeadMs_ * (double) Time::getHighResolutionTicksPerSecond() / 1000.0);
+    }
+
+    // the beat for macro waits and the like: the followed clock, the tapped
+    // tempo or the blink clock's
+    double getTicksPerBeat() const
+    {
+	if (isFollowingJack())
+	{
+	    return jackTransport_.getTicksPerBeat();
+	}
+	if (isFollowingClock())
+	{
+	    return clock_.getTicksPerBeat();
+	}
+	if (isFollowingNetClock())
+	{
+	    return netClock_.getTicksPerBeat();
+	}
+	return tapTempo_.hasTempo() ? tapTempo_.getTicksPerBeat() : blink_.getTicksPerBeat();
+    }
+
+    void handlePedalGesture(int key, PedalGestures::Outcome outcome, int value, int64 ticks)
+    {
+	const int input = key / PedalGestures::pedalsPerInput;
+	switch (outcome)
+	{
+	    case PedalGestures::Press:
+		actOnPedalEvent({104, value, ticks, input});
+		break;
+	    case PedalGestures::Release:
+		actOnPedalEvent({105, value, ticks, input});
+		break;
+	    default:
+		{
+		    const int gesture = outcome == PedalGestures::LongPressed ? 0 : outcome == PedalGestures::DoubleTapped ? 1 : 2;
+		    runGestureAction(gestureActions_[key][gesture], input, value, ticks);
+		    break;
+		}
+	}
+    }
+
+    void runGestureAction(const GestureAction& action, int input, int value, int64 ticks)
+    {
+	switch (action.kind_)
+	{
+	    case GestureAction::Note:
+		sendMidiMessage(MidiMessage::noteOn(channel_, action.note_, (uint8) 127));
+		sendMidiMessage(MidiMessage::noteOff(channel_, action.note_, (uint8) 0));
+		break;
+	    case GestureAction::Hit:
+		{
+		    Engine& engine = activeEngine();
+		    const PedalInfo& pedal = BoardPedals::table.forValue(value);
+		    const int loop = pedal.action_ == PedalLoop ? pedalBanks_.getCurrent().getLoop(input, pedal.pedal_) : -3;
+		    if (engine.connected_)
+		    {
+			char address[32];
+			std::snprintf(address, sizeof(address), "/sl/%d/hit", loop);
+			OscPacket packet;
+			packet.size_ = OscMessageWriter(packet).begin(address, "s").addString(action.command_.toRawUTF8()).size();
+			engine.sender_.send(packet);
+		    }
+		    break;
+		}
+	    case GestureAction::Tuner:
+		setTuning(!tuning_);
+		break;
+	    case GestureAction::SamePedal:
+		actOnPedalEvent({104, value, ticks, input});
+		actOnPedalEvent({105, value, ticks, input});
+		break;
+	    default:
+		break;
+	}
+    }
+
+    // the notes the pedals send, checked against "slb"'s bindings when there are some
+    void rebuildPedalNotes()
+    {
+	pedalNotes_.setBase(baseNote_);
+	const int bankLoops = (numPedalBanks_ - 1) * (loopsPerBank_ > 0 ? loopsPerBank_ : BoardPedals::table.getNumLoopPedals());
+	int numLoops = BoardPedals::table.getNumLoopPedals() + bankLoops;
+	for (int i = 0; i < numMidiInputs_; ++i)
+	{
+	    numLoops = jmax(numLoops, midiInputs_[i].firstLoop_ + bankLoops + BoardPedals::table.getNumLoopPedals());
+	}
+	if (!slbBindings_.isLoaded())
+	{
+	    rebuildPedalBanks();
+	    rebuildPedalCommands(numLoops);
+	    return;
+	}
+
+	Array<int> otherOffsets;
+	for (int value = 0; value < NUM_PEDAL_LEDS + 2; ++value)    // the up/down pedals too
+	{
+	    const PedalInfo& pedal = BoardPedals::table.forValue(value);
+	    if (pedal.action_ == PedalNote || pedal.action_ == PedalMomentary)
+	    {
+		otherOffsets.add(pedal.noteOffset_);
+	    }
+	}
+
+	StringArray problems;
+	pedalNotes_.applyBindings(slbBindings_, numLoops, otherOffsets, channel_, problems);
+	for (const String& problem : problems)
+	{
+	    std::cerr << slbBindings_.getFile().getFileName() << ": " << problem << std::endl;
+	}
+	rebuildPedalBanks();
+	rebuildPedalCommands(numLoops);
+    }
+
+    // every bank's notes, LEDs and loops for "bank" updates, from the notes
+    // just worked out; the bank shown stays if it's still there
+    void rebuildPedalBanks()
+    {
+	int firstLoops[PedalBanks::maxInputs] = {};
+	const int numInputs = jlimit(1, (int) PedalBanks::maxInputs, numMidiInputs_);
+	for (int i = 0; i < jmin(numMidiInputs_, (int) PedalBanks::maxInputs); ++i)
+	{
+	    firstLoops[i] = midiInputs_[i].firstLoop_;
+	}
+	const int previous = pedalBanks_.getIndex();
+	pedalBanks_.build(numPedalBanks_, loopsPerBank_, BoardPedals::table.getNumLoopPedals(), firstLoops, numInputs, pedalNotes_);
+	if (controlThread_.isThreadRunning() && pedalBanks_.getIndex() != previous)
+	{
+	    showPedalBank(pedalBanks_.get(jmin(previous, PedalBanks::maxBanks - 1)));
+	}
+    }
+
+    // UP and DOWN with more than one bank
+    void switchPedalBank(int step)
+    {
+	const PedalBanks::Bank& previous = pedalBanks_.getCurrent();
+	if (!pedalBanks_.page(step))
+	{
+	    return;
+	}
+	journal_.record(EventJournal::PedalBank, 0, pedalBanks_.getIndex());
+	showPedalBank(previous);
+	commitLeds();
+    }
+
+    // the board's loop pedals showing the current bank's loops, drawn again
+    // only where they show something other than previous did
+    void showPedalBank(const PedalBanks::Bank& previous)
+    {
+	const PedalBanks::Bank& bank = pedalBanks_.getCurrent();
+	for (int pedal = 0; pedal < BoardPedals::table.getNumLoopPedals(); ++pedal)
+	{
+	    const LedFrameBuffer::Led& was = ledFrame_.getLed(previous.getLoop(0, pedal));
+	    const LedFrameBuffer::Led& led = ledFrame_.getLed(bank.getLoop(0, pedal));
+	    if (led.on_ != was.on_ || led.pattern_ != was.pattern_)
+	    {
+		sendBoardPedalLed(pedal, led.on_, led.pattern_);
+	    }
+	}
+	updateVisibleLoops(activeEngine());
+    }
+
+    // "slcmd": what the notes become, from the same bindings as the notes
+    void rebuildPedalCommands(int numLoops)
+    {
+	if (!slCommands_)
+	{
+	    pedalCommands_.clear();
+	}
+	else if (slbBindings_.isLoaded())
+	{
+	    pedalCommands_.build(slbBindings_);
+	}
+	else
+	{
+	    pedalCommands_.build(pedalNotes_, numLoops);
+	}
+    }
+
+    // a pedal's note, or with "slcmd" the command it's bound to straight to
+    // the active engine
+    void sendPedalNote(const MidiMessage& msg)
+    {
+	if (slCommands_)
+	{
+	    Engine& engine = activeEngine();
+	    const OscPacket* packet = pedalCommands_.get(msg.getNoteNumber(), msg.isNoteOn());
+	    if (packet != nullptr && engine.connected_)
+	    {
+		engine.sender_.send(*packet);
+		++numPedalCommandsSent_;
+		return;
+	    }
+	}
+	sendMidiMessage(msg);
+    }
+
+    void actOnPedalEvent(const PedalEvent& event)
+    {
+	const PedalInfo& pedal = BoardPedals::table.forValue(event.value_);
+	// every input's loop pedals start at its own first loop, in the bank shown
+	const PedalBanks::Bank& bank = pedalBanks_.getCurrent();
+	const int loop = bank.getLoop(event.input_, pedal.pedal_);
+	if ((pedal.pedal_ == UP || pedal.pedal_ == DOWN) && pedalBanks_.getNumBanks() > 1 && (event.controller_ == 104 || event.controller_ == 105))
+	{
+	    if (event.controller_ == 104)
+	    {
+		switchPedalBank(pedal.pedal_ == UP ? 1 : -1);
+	    }
+	    return;
+	}
+	switch (event.controller_) {
+	    case 104: // 1-10 pedal down
+		// a loop's LED only follows once SooperLooper reports the new state
+		if (pedal.action_ != PedalLoop)
+		{
+		    pendingLedTicks_[pedal.pedal_] = event.ticks_;
+		}
+		switch (pedal.action_)
+		{
+		    case PedalLoop:
+			if (loop < LedChangeFilter::maxLeds)
+			{
+			    pendingLedTicks_[loop] = event.ticks_;
+			    pendingCtrlTicks_[loop] = event.ticks_;
+			}
+			sendLoopNote(MidiMessage::noteOn(channel_, bank.getNote(mode_ > 0, event.input_, pedal.noteOffset_), (uint8)127), loop);
+			latency_.record(LatencyStats::PedalToNote, event.ticks_);
+			if (predictLoops_)
+			{
+			    predictLoopState(activeEngine(), loop);
+			}
+			break;
+		    case PedalModeToggle:
+			mode_ = mode_ > 0 ? 0 : 20;
+			if (mode_ == 0) {
+			    ledOff(pedal.pedal_);
+			}
+			else {
+			    ledOn(pedal.pedal_);
+			}
+			updateLoops();
+			break;
+		    case PedalMomentary:
+			ledOn(pedal.pedal_);
+			sendPedalNote(MidiMessage::noteOn(channel_, pedalNotes_.getNote(pedal.noteOffset_), (uint8)127));
+			latency_.record(LatencyStats::PedalToNote, event.ticks_);
+			break;
+		    case PedalNote:
+			sendPedalNote(MidiMessage::noteOn(channel_, pedalNotes_.getNote(pedal.noteOffset_), (uint8)127));
+			latency_.record(LatencyStats::PedalToNote, event.ticks_);
+			break;
+		}
+		break;
+	    case 105:
+		switch (pedal.action_)
+		{
+		    case PedalLoop:
+			sendLoopNote(MidiMessage::noteOff(channel_, bank.getNote(mode_ > 0, event.input_, pedal.noteOffset_), (uint8)0), loop);
+			break;
+		    case PedalModeToggle:
+			break;
+		    case PedalMomentary:
+			ledOff(pedal.pedal_);
+			sendPedalNote(MidiMessage::noteOff(channel_, pedalNotes_.getNote(pedal.noteOffset_), (uint8)0));
+			updateLoops();
+			break;
+		    case PedalNote:
+			sendPedalNote(MidiMessage::noteOff(channel_, pedalNotes_.getNote(pedal.noteOffset_), (uint8)0));
+			break;
+		}
+		break;
+	    default: // a mapped expression pedal
+		expression_.setController(event.controller_, event.value_, time_.getMillisecondCounter());
+		break;
+	}
+    }
+
+    // a loop pedal's note: with "quant" in record mode a press waits for the
+    // beat and its release for the press; everything else goes now
+    // the note-on's send time is kept for the loop, to time the command by
+    // when the loop's /ctrl update comes back
+    void sendLoopNote(const MidiMessage& msg, int loop)
+    {
+	const int64 now = Time::getHighResolutionTicks();
+	if (msg.isNoteOn())
+	{
+	    activeEngine().adaptive_.targeted(loop, time_.getMillisecondCounter());
+	}
+	if (quantiseBeats_ > 0 && beatScheduler_.isRunning() && midiStage_.hasOutput())
+	{
+	    const int64 due = msg.isNoteOn() ? (mode_ > 0 ? getQuantisedTicks(now) : 0)
+		: beatScheduler_.getLatestDue(msg.getChannel(), msg.getNoteNumber());
+	    if (due > now)
+	    {
+		beatScheduler_.schedule(msg, due);
+		setPendingSend(msg, loop, due);
+		return;
+	    }
+	}
+	sendPedalNote(msg);
+	setPendingSend(msg, loop, now);
+	if (msg.isNoteOn())
+	{
+	    trackDelivery(activeEngine(), loop, msg.getNoteNumber());
+	}
+	else
+	{
+	    activeEngine().deliveries_.released(loop);
+	}
+    }
+
+    // "deliver": a loop pedal's press just went out, its loop should move on
+    // from the state it's in now. Quantised presses aren't tracked, they take
+    // effect on the beat
+    void trackDelivery(Engine& engine, int loop, int note)
+    {
+	if (!engine.deliveries_.isEnabled() || !engine.connected_ || !engine.loops_.contains(loop))
+	{
+	    return;
+	}
+	const LoopStates before = engine.loops_.getState(loop);
+	const LoopPredictor::Command command = mode_ == 0 ? LoopPredictor::MuteTrigger : LoopPredictor::RecordOrOverdub;
+	if (LoopPredictor::next(before, command) == Unknown)
+	{
+	    return;
+	}
+	const uint32 now = time_.getMillisecondCounter();
+	engine.deliveries_.sent(loop, note, before, now, getDeliveryWindowMs(engine, loop));
+	scheduleDeliveries(engine, now);
+    }
+
+    // how long a command has to show in its loop's state: the round trip
+    // with four times its variance, like the heartbeat's timeout, and how
+    // long the loop's next update can take to come round
+    int getDeliveryWindowMs(const Engine& engine, int loop) const
+    {
+	const HeartbeatMonitor& heartbeat = engine.heartbeat_;
+	const double rttMs = heartbeat.hasRtt() ? heartbeat.getSmoothedRttMs() + 4.0 * heartbeat.getRttVarianceMs() : deliveryRttMs;
+	const int updateMs = changeUpdates_ ? 0 : engine.adaptive_.isFast(loop) ? adaptiveMs_ : UpdateArrivals::intervalMs;
+	return jlimit(minDeliveryWindowMs, maxDeliveryWindowMs, roundToInt(rttMs) + updateMs);
+    }
+
+    void scheduleDeliveries(Engine& engine, uint32 now)
+    {
+	const int wait = engine.deliveries_.getMsUntilNext(now);
+	if (wait >= 0 && engine.deliveryTimer_ >= 0)
+	{
+	    wheel_.scheduleBy(engine.deliveryTimer_, now + (uint32) wait);
+	}
+    }
+
+    // the questions and resends due; they're only for the engine the pedals
+    // play, a switch away leaves the rest unanswered
+    void processDeliveries(Engine& engine, uint32 now)
+    {
+	if (!engine.connected_ || !isActive(engine))
+	{
+	    engine.deliveries_.clear();
+	    return;
+	}
+	engine.deliveries_.process(now, [this, &engine] (int loop, int note, bool released, CommandDelivery::Action action)
+	{
+	    if (action == CommandDelivery::Query)
+	    {
+		engine.sender_.send(engine.packets_.loopDeliveryState(loop));
+		return;
+	    }
+	    sendPedalNote(MidiMessage::noteOn(channel_, note, (uint8) 127));
+	    if (released)
+	    {
+		sendPedalNote(MidiMessage::noteOff(channel_, note, (uint8) 0));
+	    }
+	});
+    }
+
+    void setPendingSend(const MidiMessage& msg, int loop, int64 ticks)
+    {
+	if (msg.isNoteOn() && loop < LedChangeFilter::maxLeds)
+	{
+	    pendingSendTicks_[loop] = ticks;
+	}
+    }
+
+    // what "quant ... auto" takes off scheduled sends, 0 while the estimate
+    // isn't to be trusted
+    int64 getCompensationTicks() const
+    {
+	if (!quantiseAutoAhead_ || !commandLatency_.isSteady())
+	{
+	    return 0;
+	}
+	return (int64) (commandLatency_.getOneWayMs() * (double) Time::getHighResolutionTicksPerSecond() / 1000.0);
+    }
+
+    // when a quantised press should be sent, 0 without a beat to go by; beat
+    // if given is when it falls due, before the latency's taken off
+    int64 getQuantisedTicks(int64 now, int64* beat = nullptr)
+    {
+	double beats = 0;
+	double ticksPerBeat = 0;
+	if (isFollowingJack())
+	{
+	    beats = jackTransport_.getBeats(now);
+	    ticksPerBeat = jackTransport_.getTicksPerBeat();
+	}
+	else if (isFollowingClock())
+	{
+	    beats = clock_.getBeats(now);
+	    ticksPerBeat = clock_.getTicksPerBeat();
+	}
+	else if (isFollowingNetClock())
+	{
+	    beats = netClock_.getBeats(now);
+	    ticksPerBeat = netClock_.getTicksPerBeat();
+	}
+	else if (blinkSync_ && blink_.isRunning())
+	{
+	    beats = blink_.getBeats(now);
+	    ticksPerBeat = blink_.getTicksPerBeat();
+	}
+	if (ticksPerBeat <= 0)
+	{
+	    return 0;
+	}
+
+	// sent ahead by the offset, so the boundary we go for is the first
+	// whose send time is still to come; a press a hair late still makes it
+	double aheadTicks = quantiseAheadMs_ * (double) Time::getHighResolutionTicksPerSecond() / 1000.0;
+	if (quantiseAutoAhead_)
+	{
+	    if (commandLatency_.isSteady())
+	    {
+		aheadTicks = (double) getCompensationTicks();
+	    }
+	    else
+	    {
+		++numUncompensated_;
+	    }
+	}
+	const double graceTicks = 0.02 * (double) Time::getHighResolutionTicksPerSecond();
+	const double boundary = std::ceil((beats + (aheadTicks - graceTicks) / ticksPerBeat) / quantiseBeats_) * quantiseBeats_;
+	if (beat != nullptr)
+	{
+	    *beat = now + (int64) ((boundary - beats) * ticksPerBeat);
+	}
+	return jmax(now, now + (int64) ((boundary - beats) * ticksPerBeat - aheadTicks));
+    }
+
+    // shows the state SooperLooper should be switching the loop to, /ctrl then has the last word
+    void predictLoopState(Engine& engine, int loop)
+    {
+	if (!engine.connected_ || !engine.loops_.contains(loop))
+	{
+	    return;
+	}
+	const LoopPredictor::Command command = mode_ == 0 ? LoopPredictor::MuteTrigger : LoopPredictor::RecordOrOverdub;
+	const uint32 now = time_.getMillisecondCounter();
+	const LoopStates predicted = engine.predictions_.pressed(loop, engine.loops_.getState(loop), command, now);
+	if (predicted != Unknown)
+	{
+	    updateLoopLedState(engine.loops_, loop, predicted);
+	    if (engine.predictionTimer_ >= 0)
+	    {
+		wheel_.scheduleBy(engine.predictionTimer_, now + (uint32) LoopPredictor::timeoutMs);
+	    }
+	}
+    }
+
+    // sends whatever the expression ramps have due to the active engine
+    void sendExpression()
+    {
+	Engine& engine = activeEngine();
+	expression_.process(time_.getMillisecondCounter(), [&engine] (const String& address, const String& control, float value)
+	{
+	    if (engine.connected_)
+	    {
+		OscPacket packet;
+		packet.size_ = OscMessageWriter(packet).begin(address.toRawUTF8(), "sf")
+		    .addString(control.toRawUTF8()).addFloat32(value).size();
+		engine.sender_.send(packet);
+	    }
+	});
+    }
+
+    void reportMissingMidiInput(const MidiInputSource& in)
+    {
+	if (in.raw_ || in.serial_ || in.rtp_)
+	{
+	    std::cerr << "Couldn't open MIDI input device \"" << in.name_ << "\", waiting." << std::endl;
+	}
+	else if (in.virtual_)
+	{
+#if (JUCE_LINUX || JUCE_MAC)
+	    std::cerr << "Couldn't create virtual MIDI input port \"" << in.name_ << "\"" << std::endl;
+#else
+	    std::cerr << "Virtual MIDI input ports are not supported on Windows" << std::endl;
+#endif
+	}
+	else
+	{
+	    std::cerr << "Couldn't find MIDI input port \"" << in.name_ << "\", waiting." << std::endl;
+	}
+    }
+
+    bool tryToConnectMidiInput(MidiInputSource& in)
+    {
+	if (ByteStreamMidiInput* bytes = in.getByteInput())
+	{
+	    const int input = (int) (&in - midiInputs_);
+	    bytes->setSysexFunction([this, input] (const uint8* data, int size) { sysexCapture_.feed(input, data, size); });
+	    if (!bytes->open(in.name_))
+	    {
+		return false;
+	    }
+	    if (useReactor_)
+	    {
+		for (int fd : bytes->getFileDescriptors())
+		{
+		    reactor_.watch(fd, ReactorByteMidi + (int) (&in - midiInputs_));
+		}
+	    }
+	    else
+	    {
+		bytes->startReading([this] () { wakeControlThread(); });
+	    }
+	    in.fullName_ = in.name_;
+	    return true;
+	}
+
+	MidiInput* midi_input = nullptr;
+	String midi_input_name;
+
+	if (in.virtual_)
+	{
+#if (JUCE_LINUX || JUCE_MAC)
+	    // served by the same ALSA client and thread as the other inputs
+	    midi_input = MidiInput::createNewDevice(in.name_, this);
+	    midi_input_name = in.name_;
+#endif
+	}
+	else
+	{
+	    const int index = midiDevices_.findInput(in.name_, midi_input_name);
+	    if (index >= 0)
+	    {
+		midi_input = MidiInput::openDevice(index, this);
+	    }
+	}
+
+	if (midi_input)
+	{
+	    midi_input->start();
+	    in.input_ = midi_input;
+	    in.fullName_ = midi_input_name;
+	    return true;
+	}
+
+	return false;
+    }
+
+    bool tryToConnectOsc() {
+	if (currentReceivePort_ < 0) {
+	    connect();
+	}
+
+	bool connected = currentReceivePort_ > 0;
+	for (auto* engine : engines_)
+	{
+	    connected = tryToConnectEngine(*engine) && connected;
+	}
+	return connected;
+    }
+
+    // "host:port", or just the port of a looper on this host
+    void parseEngineAddress(const String& value, String& host, int& port)
+    {
+	const int colon = value.lastIndexOfChar(':');
+	host = colon > 0 ? value.substring(0, colon) : String("127.0.0.1");
+	port = asPortNumber(colon > 0 ? value.substring(colon + 1) : value);
+    }
+
+    // a looper on another host is answered to the address it reaches us on,
+    // and what's sent to it in a pass goes together, see OscPacketSender
+    bool connectEngineSender(Engine& engine)
+    {
+	if (!engine.sender_.connect(engine.sendHost_, engine.sendPort_))
+	{
+	    return false;
+	}
+	engine.sender_.setCoalescing(!engine.sender_.isLoopback());
+	if (oscSendBufferBytes_ > 0)
+	{
+	    UdpBatchReader::configure(engine.sender_.getSocketHandle(), 0, oscSendBufferBytes_);
+	}
+	engine.localAddress_ = String();
+	if (!engine.sender_.isLoopback())
+	{
+	    engine.localAddress_ = engine.sender_.getLocalAddress();
+	    if (engine.localAddress_.isEmpty())
+	    {
+		// no route to it yet, the first address that isn't loopback
+		Array<IPAddress> addresses;
+		IPAddress::findAllAddresses(addresses);
+		for (auto&& address : addresses)
+		{
+		    if (engine.localAddress_.isEmpty() && address != IPAddress::local())
+		    {
+			engine.localAddress_ = address.toString();
+		    }
+		}
+	    }
+	    std::cerr << "SooperLooper on " << engine.sendHost_ << " answers to " << engine.localAddress_ << std::endl;
+	}
+	return true;
+    }
+
+    static String getReturnUrl(const Engine& engine, int port)
+    {
+	return "osc.udp://" + (engine.localAddress_.isEmpty() ? String("localhost") : engine.localAddress_) + ":" + String(port) + "/";
+    }
+
+    // the step the handshake is waiting on has gone unanswered: the ping,
+    // or the queries of the loops still to report, go again
+    void retryHandshake(Engine& engine, uint32 now)
+    {
+	if (engine.handshake_.getStep() == EngineHandshake::Pinging)
+	{
+	    engine.sender_.send(engine.packets_.pingAckPing());
+	}
+	else
+	{
+	    const OscPacketSender::QueryScope query(engine.sender_);
+	    OscBundleSender bundle(engine.sender_);
+	    engine.handshake_.forEachPending([&engine, &bundle] (int loop) { bundle.add(engine.packets_.loopInitialState(loop)); });
+	}
+	engine.handshake_.retried(now);
+    }
+
+    // every loop has told us its state since the engine was connected
+    void handshakeFinished(Engine& engine)
+    {
+	startup_.reached(StartupTimes::FirstLoopStates);
+	journal_.record(EventJournal::Handshake, engine.index_, engine.handshake_.getLastMs());
+    }
+
+    bool tryToConnectEngine(Engine& engine) {
+	if (!engine.sender_.isConnected()) {
+	    if (connectEngineSender(engine)) {
+		std::cerr << "Successfully connected to OSC Send port " << (int)engine.sendPort_ << std::endl;
+	    }
+	}
+
+	if (engine.sender_.isConnected() && currentReceivePort_ > 0) {
+	    engine.packets_.setReturnUrl(getReturnUrl(engine, currentReceivePort_), engine.pathPrefix_);
+	    engine.sender_.send(engine.packets_.pingAckPing());
+	    engine.handshake_.start(time_.getMillisecondCounter());
+	    startup_.reached(StartupTimes::FirstPing);
+	    engine.connected_ = true;
+	    engine.clockTempoSent_ = 0;
+	    engine.heartbeat_.connected(time_.getMillisecondCounter());
+	    // whatever was lost while we were away is looked for soon
+	    if (engine.reconciler_.isEnabled() != (reconcileMinMs_ > 0))
+	    {
+		engine.reconciler_.configure(reconcileMinMs_, reconcileMaxMs_);
+	    }
+	    engine.reconciler_.lost(time_.getMillisecondCounter());
+	    if (engine.deliveries_.isEnabled() != (deliveryAttempts_ > 0))
+	    {
+		engine.deliveries_.configure(deliveryAttempts_);
+	    }
+	    journal_.record(EventJournal::Connected, engine.index_, engine.sendPort_);
+	    startDiscovery(engine);
+	    return true;
+	}
+
+	return false;
+    }
+
+    // "discover": one /ping from one socket to every candidate port at once,
+    // answered on "/loop4r/discover/<engine>/<port>", so the port it came
+    // from is in the path. The engine's own ping went first, so while its
+    // own port is alive that one answers first.
+    void startDiscovery(Engine& engine)
+    {
+	if (discoverFirstPort_ <= 0)
+	{
+	    return;
+	}
+	if (discoverySocket_ == nullptr)
+	{
+	    discoverySocket_ = new DatagramSocket(false);
+	    if (!discoverySocket_->bindToPort(0))
+	    {
+		discoverySocket_ = nullptr;
+		return;
+	    }
+	}
+
+	const String returnUrl = getReturnUrl(engine, currentReceivePort_);
+	for (int port = discoverFirstPort_; port <= discoverLastPort_; ++port)
+	{
+	    if (port == engine.sendPort_ || isEnginePort(engine.sendHost_, port))
+	    {
+		continue;
+	    }
+	    char path[48];
+	    std::snprintf(path, sizeof(path), "/loop4r/discover/%d/%d", engine.index_, port);
+	    OscPacket packet;
+	    packet.size_ = OscMessageWriter(packet).begin("/ping", "ss").addString(returnUrl.toRawUTF8()).addString(path).size();
+	    discoverySocket_->write(engine.sendHost_, port, packet.data_, packet.size_);
+	}
+	engine.discoveringUntil_ = jmax((uint32) 1, time_.getMillisecondCounter() + (uint32) discoverWindowMs_);
+    }
+
+    // another engine already sends there
+    bool isEnginePort(const String& host, int port) const
+    {
+	for (auto* engine : engines_)
+	{
+	    if (engine->sendPort_ == port && engine->sendHost_ == host)
+	    {
+		return true;
+	    }
+	}
+	return false;
+    }
+
+    // a /pingack to "discover"'s /ping: the first from another port, while the
+    // engine's own hasn't answered, moves the engine there
+    void handleDiscoverMessage(const OSCMessage& message)
+    {
+	const StringArray parts = StringArray::fromTokens(message.getAddressPattern().toString(), "/", "");
+	const int index = parts[3].getIntValue();
+	const int port = parts[4].getIntValue();
+	if (parts.size() != 5 || !isPositiveAndBelow(index, engines_.size()) || message.size() < 3 || !message[2].isInt32())
+	{
+	    return;
+	}
+
+	Engine& engine = *engines_.getUnchecked(index);
+	const uint32 until = engine.discoveringUntil_;
+	if (until == 0 || (int) (time_.getMillisecondCounter() - until) > 0 || engine.heartbeat_.getNumReplies() > 0)
+	{
+	    engine.discoveringUntil_ = 0;
+	    return;
+	}
+	engine.discoveringUntil_ = 0;
+	if (port == engine.sendPort_ || isEnginePort(engine.sendHost_, port))
+	{
+	    return;
+	}
+
+	std::cerr << "Found SooperLooper on port " << port << " of " << engine.sendHost_ << ", not " << engine.sendPort_ << std::endl;
+	engine.sendPort_ = port;
+	engine.sender_.disconnect();
+	engine.connected_ = false;
+	if (!tryToConnectEngine(engine))
+	{
+	    std::cerr << "Error: could not connect to UDP port " << port << std::endl;
+	}
+    }
+
+    bool tryToConnectLedOsc() {
+	if (currentLedSendPort_ < 0) {
+	    if (oscLedSender.connect ("127.0.0.1", oscLedSendPort_)) {
+		std::cerr << "Successfully connected to OSC LED Send port " << (int)oscLedSendPort_ << std::endl;
+		currentLedSendPort_ = oscLedSendPort_;
+	    }
+	}
+
+	if (currentLedSendPort_ > 0) {
+	    return true;
+	}
+	return false;
+    }
+
+    // commands that pick how we run, or set up what other threads record
+    // into or the LEDs go to, and mean nothing once we're running
+    static bool isStartupOnly(int command)
+    {
+	switch (command)
+	{
+	    case ENGINE:
+	    case OSC_REALTIME:
+	    case REACTOR:
+	    case IDLE_POWER:
+	    case GIG_MODE:
+	    case LED_PLUGIN:
+	    case LED_GPIO:
+	    case LED_SPI:
+	    case LED_DIN:
+	    case LED_PORT:
+	    case TRACE:
+	    case JOURNAL:
+	    case REPLAY:
+	    case ANALYSE:
+	    case LOOPBACK:
+	    case SIMULATE:
+	    case SOAK:
+	    case HEARTBEAT_LOSS:
+	    case SELF_TEST:
+	    case SCALE_BENCHMARK:
+	    case MULTIPLE_INSTANCES:
+	    case BENCHMARK:
+	    case OSC_SEND_THREAD:
+	    case IO_URING:
+	    case SESSION_FILE:
+		return true;
+	    default:
+		return false;
+	}
+    }
+
+    void executeCommand(const ApplicationCommand& cmd, const StringArray& opts)
+    {
+	if (controlThread_.isThreadRunning() && isStartupOnly(cmd.command_))
+	{
+	    std::cerr << "\"" << cmd.param_ << "\" can only be given when starting" << std::endl;
+	    return;
+	}
+
+	switch (cmd.command_) {
+	case NONE:
+	    break;
+	case LIST:
+	    std::cerr << "MIDI Input devices:" << std::endl;
+	    for (auto&& device : midiDevices_.getInputs())
+	    {
+		std::cerr << device << std::endl;
+	    }
+	    std::cerr << "MIDI Output devices:" << std::endl;
+	    for (auto&& device : midiDevices_.getOutputs())
+	    {
+		std::cerr << device << std::endl;
+	    }
+	    systemRequestedQuit();
+	    break;
+	case CHANNEL:
+	    channel_ = asDecOrHex7BitValue(opts[0]);
+	    break;
+	case DEVICE_IN:
+	case ADD_INPUT:
+	case STANDBY_IN:
+	case VIRTUAL_IN:
+	case RAW_IN:
+	case SERIAL_IN:
+	case RTP_IN:
+	    {
+		if ((opts.isEmpty() && cmd.command_ != VIRTUAL_IN) || (cmd.command_ != DEVICE_IN && numMidiInputs_ >= AlsaMidiInput::maxSources))
+		{
+		    std::cerr << "Couldn't add MIDI input \"" << opts.joinIntoString(" ") << "\", expected name (first loop) and at most "
+			      << (int) AlsaMidiInput::maxSources << " inputs" << std::endl;
+		    break;
+		}
+		MidiInputSource& in = midiInputs_[cmd.command_ == DEVICE_IN ? 0 : numMidiInputs_];
+		in.input_ = nullptr;
+		closeByteMidiInput(in);
+		in.virtual_ = cmd.command_ == VIRTUAL_IN;
+		in.raw_ = cmd.command_ == RAW_IN;
+		in.serial_ = cmd.command_ == SERIAL_IN;
+		in.rtp_ = cmd.command_ == RTP_IN;
+		if (in.rtp_)
+		{
+		    in.rtpInput_.setMaxDelayMs(opts[2].isEmpty() ? 10 : jlimit(0, 1000, opts[2].getIntValue()));
+		}
+		in.name_ = in.virtual_ && opts[0].isEmpty() ? DEFAULT_VIRTUAL_IN_NAME : opts[0];
+		in.fullName_ = String();
+		in.firstLoop_ = jlimit(0, LoopStore::maxLoops - 1, opts[1].getIntValue());
+		in.standbyFor_ = -1;
+		in.standingBy_ = false;
+		in.presence_.restart(Time::getMillisecondCounter());
+		if (cmd.command_ == STANDBY_IN)
+		{
+		    const int primary = jlimit(0, jmax(0, numMidiInputs_ - 1), opts[1].getIntValue());
+		    in.firstLoop_ = midiInputs_[primary].firstLoop_;
+		    in.standbyFor_ = primary;
+		    in.standingBy_ = true;
+		    enablePresence(presenceSilenceMs_);
+		}
+		numMidiInputs_ = jmax(numMidiInputs_, (int) (&in - midiInputs_) + 1);
+		if (controlThread_.isThreadRunning())
+		{
+		    rebuildPedalNotes();
+		}
+		if (readsSequencer() && in.getByteInput() == nullptr)
+		{
+		    // the reactor opens its own port when it starts
+		    if (sequencerInput_.isOpen() || (!useReactor_ && !deferMidiPorts_))
+		    {
+			openSequencerInput();
+		    }
+		    break;
+		}
+
+		if (deferMidiPorts_)
+		{
+		    break;
+		}
+		if (!tryToConnectMidiInput(in))
+		{
+		    reportMissingMidiInput(in);
+		}
+		break;
+	    }
+	case DEVICE_OUT:
+	case VIRTUAL_OUT:
+	case MIRROR_OUT:
+	    {
+		const MidiOutputRole role = cmd.command_ == DEVICE_OUT ? HardwareOut : cmd.command_ == VIRTUAL_OUT ? VirtualOut : MirrorOut;
+		MidiOutputPort& port = midiOutputs_[role];
+		{
+		    // out of midiStage_ before it goes
+		    ScopedPointer<MidiOutput> old(port.output_.release());
+		    updateMidiRoutes();
+		}
+		port.name_ = role == VirtualOut && opts[0].isEmpty() ? DEFAULT_VIRTUAL_OUT_NAME : opts[0];
+		if (deferMidiPorts_ || port.name_.isEmpty())
+		{
+		    break;
+		}
+		if (openMidiOutput(role))
+		{
+		    updateMidiRoutes();
+		}
+		break;
+	    }
+	case MIDI_ROUTE:
+	    {
+		const String target = opts[0].toLowerCase();
+		const int role = target == "hw" ? HardwareOut : target == "virt" ? VirtualOut : target == "mirror" ? MirrorOut : -1;
+		int routes = 0;
+		for (auto&& kind : StringArray::fromTokens(opts[1].toLowerCase(), ",", ""))
+		{
+		    routes |= kind == "notes" ? MidiOutputStage::RouteNotes
+			: kind == "cc" ? MidiOutputStage::RouteControllers
+			: kind == "other" ? MidiOutputStage::RouteOther
+			: kind == "all" ? MidiOutputStage::RouteAll
+			: kind == "none" ? 0
+			: -1;
+		}
+		if (role < 0 || routes < 0)
+		{
+		    std::cerr << "Couldn't route \"" << opts.joinIntoString(" ") << "\", expected hw|virt|mirror and notes, cc, other, all or none" << std::endl;
+		    break;
+		}
+		midiOutputs_[role].routes_ = routes;
+		updateMidiRoutes();
+		break;
+	    }
+	case JACK_MIDI:
+	    {
+		if (jackMidi_.isOpen())
+		{
+		    std::cerr << "Already connected to JACK as \"" << jackClientName_ << "\"" << std::endl;
+		    break;
+		}
+		jackClientName_ = opts[0].isNotEmpty() ? opts[0] : DEFAULT_JACK_CLIENT_NAME;
+		jackFrom_ = opts[1];
+		jackTo_ = opts[2];
+		if (!deferMidiPorts_)
+		{
+		    openJackMidi();
+		}
+		break;
+	    }
+	case INPUT_METER:
+	    if (opts.size() == 1 && opts[0].equalsIgnoreCase("off"))
+	    {
+		closeJackMeter();
+		break;
+	    }
+	    if (opts.size() < 2)
+	    {
+		std::cerr << "Unknown input meter \"" << opts.joinIntoString(" ") << "\", expected (from port) (leds) (ms) or off" << std::endl;
+		break;
+	    }
+	    {
+		// the LEDs it had are put out first, it's drawn again on the next look
+		const bool reopen = !jackMeter_.isOpen() || opts[0] != meterFrom_;
+		if (reopen)
+		{
+		    const bool onset = onsetEnabled_;
+		    closeJackMeter();
+		    onsetEnabled_ = onset;       // started again with the meter
+		}
+		else if (meterDrawn_)
+		{
+		    for (int led : meterLeds_)
+		    {
+			setLed(led, false);
+		    }
+		    meterRmsStep_ = meterPeakStep_ = -1;
+		}
+		meterFrom_ = opts[0];
+		meterLeds_.clear();
+		for (auto&& led : StringArray::fromTokens(opts[1], ",", ""))
+		{
+		    if (led.containsOnly("0123456789"))     // "-" for none, for "onset" alone
+		    {
+			meterLeds_.add(jlimit(0, LedChangeFilter::maxLeds - 1, led.getIntValue()));
+		    }
+		}
+		meterEnabled_ = true;
+		meterMs_ = opts.size() > 2 ? jmax(10, opts[2].getIntValue()) : meterMs_;
+		if (reopen && !deferMidiPorts_)
+		{
+		    openJackMeter();
+		}
+		if (meterTimer_ >= 0 && meterLeds_.size() > 0)
+		{
+		    wheel_.schedule(meterTimer_, time_.getMillisecondCounter());
+		}
+	    }
+	    break;
+	case ONSET_RECORD:
+	    if (opts.size() == 1 && opts[0].equalsIgnoreCase("off"))
+	    {
+		onsetDetector_.stop();
+		onsetEnabled_ = false;
+		break;
+	    }
+	    if (!meterEnabled_)
+	    {
+		std::cerr << "Onsets are found in the \"meter\" input, give that first" << std::endl;
+		break;
+	    }
+	    onsetThreshold_ = opts.size() > 0 ? jmax(0.0f, opts[0].getFloatValue()) : onsetThreshold_;
+	    onsetSensitivity_ = opts.size() > 1 ? jmax(1.0f, opts[1].getFloatValue()) : onsetSensitivity_;
+	    onsetEnabled_ = true;
+	    if (jackMeter_.isOpen())
+	    {
+		startOnsetDetector();
+	    }
+	    break;
+	case TUNER:
+	    {
+		if (opts.size() > 1)
+		{
+		    const bool wasTuning = tuning_;
+		    setTuning(false);       // gives back the old LEDs
+		    tunerLeds_.clear();
+		    for (auto&& led : StringArray::fromTokens(opts[1], ",", ""))
+		    {
+			tunerLeds_.add(jlimit(0, LedChangeFilter::maxLeds - 1, led.getIntValue()));
+		    }
+		    tunerSharpLed_ = opts.size() > 2 && opts[2].containsOnly("0123456789") ? jmin(LedChangeFilter::maxLeds - 1, opts[2].getIntValue()) : -1;
+		    tunerMs_ = opts.size() > 3 ? jmax(20, opts[3].getIntValue()) : tunerMs_;
+		    if (wasTuning)
+		    {
+			setTuning(true);
+		    }
+		}
+		const String what = opts[0].toLowerCase();
+		if (what != "on" && what != "off" && what != "toggle")
+		{
+		    std::cerr << "Unknown tuner \"" << opts.joinIntoString(" ") << "\", expected on, off or toggle (leds) (sharp led) (ms)" << std::endl;
+		}
+		else if (!controlThread_.isThreadRunning())
+		{
+		    startTuning_ = what == "on";
+		}
+		else
+		{
+		    setTuning(what == "toggle" ? !tuning_ : what == "on");
+		}
+		break;
+	    }
+	case BASE_NOTE:
+	    baseNote_ = asNoteNumber(opts[0]);
+	    if (controlThread_.isThreadRunning())
+	    {
+		rebuildPedalNotes();
+	    }
+	    break;
+	case DISCOVER:
+	    if (opts.size() == 1 && opts[0].equalsIgnoreCase("off"))
+	    {
+		discoverFirstPort_ = 0;
+		break;
+	    }
+	    {
+		const String range = opts.isEmpty() ? String("9951-9960") : opts[0];
+		discoverFirstPort_ = asPortNumber(range.upToFirstOccurrenceOf("-", false, false));
+		discoverLastPort_ = range.containsChar('-') ? asPortNumber(range.fromFirstOccurrenceOf("-", false, false)) : discoverFirstPort_;
+		discoverWindowMs_ = opts.size() > 1 ? jlimit(1, 1000, opts[1].getIntValue()) : 50;
+		if (discoverFirstPort_ <= 0 || discoverLastPort_ < discoverFirstPort_ || discoverLastPort_ - discoverFirstPort_ >= 256)
+		{
+		    std::cerr << "Expected a port range like 9951-9960, not \"" << range << "\"" << std::endl;
+		    discoverFirstPort_ = 0;
+		}
+	    }
+	    break;
+	case MIDI_PLAY:
+	    if (opts.size() == 1 && opts[0].equalsIgnoreCase("stop"))
+	    {
+		midiPlayer_.stop();
+		break;
+	    }
+	    {
+		const File file = File::getCurrentWorkingDirectory().getChildFile(opts[0]);
+		const bool toInput = opts.size() < 2 || !opts[1].equalsIgnoreCase("out");
+		String error;
+		if (!midiPlayer_.load(file, error))
+		{
+		    std::cerr << "Couldn't play " << file.getFullPathName() << ", it " << error << std::endl;
+		    break;
+		}
+		midiPlayer_.start(opts.size() > 2 ? jmax(0, opts[2].getIntValue()) : 1, midiStage_,
+				  toInput ? std::function<void()>([this] () { wakeControlThread(); }) : std::function<void()>());
+		std::cerr << "Playing " << midiPlayer_.getNumEvents() << " events over " << String(midiPlayer_.getLengthSeconds(), 1)
+			  << "s from " << file.getFullPathName() << (toInput ? " as input" : " out") << std::endl;
+	    }
+	    break;
+	case MIDI_MONITOR:
+	    if (opts.size() == 1 && opts[0].equalsIgnoreCase("off"))
+	    {
+		midiMonitor_.stop();
+		break;
+	    }
+	    midiMonitor_.start(useHexadecimalsByDefault_, noteNumbersOutput_, octaveMiddleC_, opts.size() == 1 && opts[0].equalsIgnoreCase("ts"));
+	    break;
+	case SYSEX_UPLOAD:
+	    if (opts.size() == 1 && opts[0].equalsIgnoreCase("stop"))
+	    {
+		sysexUploader_.stop();
+		break;
+	    }
+	    {
+		const File file = File::getCurrentWorkingDirectory().getChildFile(opts[0]);
+		String error;
+		if (!sysexUploader_.load(file, error))
+		{
+		    std::cerr << "Couldn't upload " << file.getFullPathName() << ", it " << error << std::endl;
+		    break;
+		}
+		if (!midiStage_.hasOutput())
+		{
+		    std::cerr << "No MIDI output to upload " << file.getFullPathName() << " to" << std::endl;
+		    break;
+		}
+		sysexUploader_.start(midiStage_, opts.size() > 1 ? opts[1].getIntValue() : SysexUploader::defaultGapMs);
+		std::cerr << "Uploading " << sysexUploader_.getNumMessages() << " sysex messages from " << file.getFullPathName() << std::endl;
+	    }
+	    break;
+	case SYSEX_CAPTURE:
+	    if (opts.size() == 1 && opts[0].equalsIgnoreCase("off"))
+	    {
+		sysexCapture_.stop();
+		break;
+	    }
+	    {
+		const File directory = File::getCurrentWorkingDirectory().getChildFile(opts.isEmpty() ? "sysex" : opts[0]);
+		if (sysexCapture_.start(directory, opts.size() > 1, (uint32) opts[1].getHexValue64()))
+		{
+		    std::cerr << "Writing sysex dumps to " << directory.getFullPathName() << std::endl;
+		}
+		else
+		{
+		    std::cerr << "Couldn't write sysex dumps to " << directory.getFullPathName() << std::endl;
+		}
+	    }
+	    break;
+	case MIDI_RECORD:
+	    if (opts.size() == 1 && opts[0].equalsIgnoreCase("off"))
+	    {
+		midiRecorder_.stop();
+		break;
+	    }
+	    {
+		const File file = File::getCurrentWorkingDirectory().getChildFile(opts.isEmpty() ? "loop4r_read.mid" : opts[0]);
+		if (midiRecorder_.start(file))
+		{
+		    std::cerr << "Recording MIDI to " << file.getFullPathName() << std::endl;
+		}
+		else
+		{
+		    std::cerr << "Couldn't record MIDI to " << file.getFullPathName() << std::endl;
+		}
+	    }
+	    break;
+	case SESSION_FILE:
+	    {
+		const File file = File::getCurrentWorkingDirectory().getChildFile(opts.isEmpty() ? "loop4r_read.slsess" : opts[0]);
+		if (!session_.load(file))
+		{
+		    std::cerr << "No loopers in SooperLooper session " << file.getFullPathName() << std::endl;
+		}
+	    }
+	    break;
+	case SLB_BINDINGS:
+	    if (opts.size() == 1 && opts[0].equalsIgnoreCase("off"))
+	    {
+		slbBindings_.clear();
+	    }
+	    else
+	    {
+		const File file = File::getCurrentWorkingDirectory().getChildFile(opts.isEmpty() ? "loop4r_read.slb" : opts[0]);
+		if (!slbBindings_.load(file))
+		{
+		    std::cerr << "Couldn't read SooperLooper bindings from " << file.getFullPathName() << std::endl;
+		    break;
+		}
+	    }
+	    if (controlThread_.isThreadRunning())
+	    {
+		rebuildPedalNotes();
+	    }
+	    break;
+	case LED_FRAMES:
+	    ledFrames_ = !opts[0].equalsIgnoreCase("off");
+	    break;
+	case SL_COMMANDS:
+	    slCommands_ = !opts[0].equalsIgnoreCase("off");
+	    if (controlThread_.isThreadRunning())
+	    {
+		rebuildPedalNotes();
+	    }
+	    break;
+	case OSC_OUT:
+	    {
+		Engine& engine = *engines_.getUnchecked(0);
+		String host;
+		int port;
+		parseEngineAddress(opts[0], host, port);
+		if (engine.connected_ && (port != engine.sendPort_ || host != engine.sendHost_))
+		{
+		    // another looper now, the old one is left nothing to send us
+		    OscBundleSender bundle(engine.sender_);
+		    addUnregistrations(engine, bundle);
+		}
+		engine.sendPort_ = port;
+		engine.sendHost_ = host;
+		engine.connected_ = false;
+		// specify here where to send OSC messages to: host URL and UDP port number
+		if (! connectEngineSender(engine))
+		    std::cerr << "Error: could not connect to UDP port " << opts[0] << std::endl;
+		break;
+	    }
+	case ENGINE:
+	    {
+		String host;
+		int port;
+		parseEngineAddress(opts[0], host, port);
+		engines_.add(new Engine(engines_.size(), port, trace_, metrics_, spans_))->sendHost_ = host;
+	    }
+	    break;
+	case OSC_IN:
+	    oscReceivePort_ = asPortNumber(opts[0]);
+	    if (currentReceivePort_ > 0 && currentReceivePort_ != oscReceivePort_)
+	    {
+		rebindOscInput();
+		break;
+	    }
+	    if (!tryToConnectOsc())
+		std::cerr << "Error: could not connect to UDP port " << opts[0] << std::endl;
+	    break;
+	case LOG_RATE:
+	    {
+		const String category = opts[0].toLowerCase();
+		if (category != "midi" && category != "osc" && category != "all")
+		{
+		    std::cerr << "Unknown log category \"" << opts[0] << "\", expected midi, osc or all" << std::endl;
+		    break;
+		}
+		const double perSecond = opts.size() > 1 ? opts[1].getDoubleValue() : (double) EventLog::defaultRecordsPerSecond;
+		const double burst = opts.size() > 2 ? opts[2].getDoubleValue() : 2 * perSecond;
+		const int sampleEvery = opts.size() > 3 ? opts[3].getIntValue() : 1;
+		for (int i = 0; i < numLogCategories; ++i)
+		{
+		    if (category == "all" || category == (i == LogMidi ? "midi" : "osc"))
+		    {
+			eventLog_.setRateLimit((LogCategory) i, perSecond, burst, sampleEvery);
+		    }
+		}
+		std::cerr << "Log rate: MIDI " << eventLog_.describeRateLimit(LogMidi) << ", OSC " << eventLog_.describeRateLimit(LogOsc) << std::endl;
+	    }
+	    break;
+	case LOG_LEVEL:
+	    if (opts[0].equalsIgnoreCase("quiet"))
+	    {
+		eventLog_.setLevel(LogQuiet);
+	    }
+	    else if (opts[0].equalsIgnoreCase("normal"))
+	    {
+		eventLog_.setLevel(LogNormal);
+	    }
+	    else if (opts[0].equalsIgnoreCase("verbose"))
+	    {
+		eventLog_.setLevel(LogVerbose);
+	    }
+	    else
+	    {
+		std::cerr << "Unknown log level \"" << opts[0] << "\", expected quiet, normal or verbose" << std::endl;
+	    }
+	    break;
+	case LATENCY_STATS:
+	    dumpLatencyStats_ = true;
+	    break;
+	case LOAD_SHEDDING:
+	    if (opts[0].equalsIgnoreCase("off"))
+	    {
+		overload_.configure(0, 0);
+		feedback_.setEnabled(false);
+	    }
+	    else
+	    {
+		overload_.configure(opts.isEmpty() ? OverloadGuard::defaultQueueDepth : jmax(1, opts[0].getIntValue()),
+				    opts.size() > 1 ? opts[1].getIntValue() : OverloadGuard::defaultLagMs);
+		feedback_.setEnabled(true);
+	    }
+	    applyShedLevel(OverloadGuard::Normal);
+	    break;
+	case BENCHMARK:
+	    benchmarkEvents_ = opts.isEmpty() ? 100000 : jmax(1, opts[0].getIntValue());
+	    benchmarkCtrlFile_ = opts[1];
+	    break;
+	case EXPRESSION:
+	    {
+		const int curve = opts.size() > 5 ? ExpressionMap::parseCurve(opts[5]) : ExpressionMap::Linear;
+		if (opts.size() < 3 || curve < 0
+		    || !expression_.add(asDecOrHex7BitValue(opts[0]), opts[1].getIntValue(), opts[2],
+					opts.size() > 3 ? opts[3].getFloatValue() : 0.0f,
+					opts.size() > 4 ? opts[4].getFloatValue() : 1.0f,
+					(ExpressionMap::Curve) curve))
+		{
+		    std::cerr << "Couldn't map expression \"" << opts.joinIntoString(" ") << "\", expected cc loop ctrl (min max) (linear|log|exp|s)" << std::endl;
+		}
+		break;
+	    }
+	case WORKERS:
+	    numWorkers_ = opts[0].equalsIgnoreCase("off") ? -1 : jmax(0, opts[0].getIntValue());
+	    break;
+	case SEQ_POOL:
+	    if (opts[0].getIntValue() <= 0 || (opts.size() > 1 && opts[1].getIntValue() <= 0))
+	    {
+		std::cerr << "Couldn't size the sequencer pools \"" << opts.joinIntoString(" ") << "\", expected input (output) events" << std::endl;
+		break;
+	    }
+	    sequencerInput_.setPoolSizes(opts[0].getIntValue(), opts[1].getIntValue());
+	    ledPort_.setPoolSize(opts[1].getIntValue());
+	    break;
+	case MIDI_THRU:
+	    if (!AlsaMidiThru::isAvailable)
+	    {
+		std::cerr << "MIDI thru needs the ALSA sequencer" << std::endl;
+		break;
+	    }
+	    midiThruEnabled_ = opts[0].equalsIgnoreCase("on");
+	    if (!midiThruEnabled_)
+	    {
+		const ScopedLock lock(midiPortsLock_);
+		midiThru_.close();
+	    }
+	    else if (!deferMidiPorts_)
+	    {
+		openMidiThru();
+	    }
+	    break;
+	case EXPR_CALIBRATE:
+	    if (opts[1].equalsIgnoreCase("learn")
+		? !expression_.learn(asDecOrHex7BitValue(opts[0]))
+		: !expression_.calibrate(asDecOrHex7BitValue(opts[0]), opts[1].getIntValue(), opts[2].getIntValue()))
+	    {
+		std::cerr << "Couldn't calibrate expression \"" << opts.joinIntoString(" ") << "\", expected cc low high (0-127, low below high) or cc learn" << std::endl;
+	    }
+	    break;
+	case THIN_CC:
+	    midiStage_.setThinning(true);
+	    break;
+	case ANALYSE:
+	    if (opts.size() < 2 || !TraceAnalyser::parseQuery(opts[1], analysis_.query_))
+	    {
+		std::cerr << "Usage: analyse file count|echo|reconnects|states (threshold) (from s) (for s)" << std::endl;
+		break;
+	    }
+	    analyseFile_ = opts[0];
+	    analysis_.threshold_ = opts[2].isEmpty() ? -1.0 : opts[2].getDoubleValue();
+	    analysis_.fromSeconds_ = opts[3].getDoubleValue();
+	    analysis_.seconds_ = opts[4].getDoubleValue();
+	    break;
+	case REPLAY:
+	    replayFile_ = opts[0];
+	    replayRealtime_ = opts[1].equalsIgnoreCase("realtime");
+	    if (opts.size() > 1 && !replayRealtime_ && !opts[1].equalsIgnoreCase("fast"))
+	    {
+		std::cerr << "Unknown replay speed \"" << opts[1] << "\", expected fast or realtime" << std::endl;
+	    }
+	    replayFrom_ = opts[2].getDoubleValue();
+	    replayFor_ = opts[3].getDoubleValue();
+	    break;
+	case THREAD_PRIORITY:
+	    {
+		const String policy = opts[2];
+		const ThreadTuning::Policy schedule = policy.equalsIgnoreCase("rr") ? ThreadTuning::PolicyRoundRobin
+		    : policy.equalsIgnoreCase("other") ? ThreadTuning::PolicyOther : ThreadTuning::PolicyFifo;
+		if (opts.size() < 2 || (policy.isNotEmpty() && !policy.equalsIgnoreCase("fifo") && schedule == ThreadTuning::PolicyFifo)
+		    || !threadTuning_.add(opts[0], schedule, opts[1].getIntValue(), opts[3]))
+		{
+		    std::cerr << "Couldn't use realtime settings \"" << opts.joinIntoString(" ") << "\", expected thread priority (fifo|rr|other) (cpus)" << std::endl;
+		}
+	    }
+	    break;
+	case LOCK_MEMORY:
+	    memoryLocked_ = ThreadTuning::lockMemory();
+	    break;
+	case GIG_MODE:
+	    gigMode_ = true;
+	    for (const String& opt : opts)
+	    {
+		BigInteger cpus;
+		if (opt.equalsIgnoreCase("performance"))
+		{
+		    gigGovernor_ = true;
+		}
+		else if (ThreadTuning::parseCpus(opt, cpus) && !cpus.isZero())
+		{
+		    gigCpus_ = cpus;
+		    gigCpuList_ = opt;
+		}
+		else
+		{
+		    std::cerr << "Unknown gig setting \"" << opt << "\", expected CPUs like 2-3 or performance" << std::endl;
+		}
+	    }
+	    break;
+	case PREDICT:
+	    predictLoops_ = true;
+	    break;
+	case STATE_SNAPSHOT:
+	    snapshot_.setFile(opts.isEmpty() ? File("~/.loop4r_state") : File::getCurrentWorkingDirectory().getChildFile(opts[0]));
+	    break;
+	case IO_URING:
+	    reactorBackend_ = EventReactor::Uring;
+	    enableReactor();
+	    break;
+	case REACTOR:
+	    enableReactor();
+	    break;
+	case IDLE_POWER:
+	    idlePower_ = true;
+	    idlePingMs_ = (opts.isEmpty() ? 10 : jmax(1, opts[0].getIntValue())) * 1000;
+	    // what changes is sent to us, nothing is reread on a timer
+	    changeUpdates_ = true;
+	    pollMs_ = 0;
+	    selectedPollMs_ = 0;
+	    enableReactor();
+	    break;
+	case SHARED_STATE:
+	    {
+		const String name = opts.isEmpty() ? String("/loop4r_leds") : opts[0];
+		if (sharedLeds_.open(name))
+		{
+		    std::cerr << "Publishing LED state in shared memory " << name << std::endl;
+		}
+		else
+		{
+		    std::cerr << "Couldn't create shared memory " << name << std::endl;
+		}
+	    }
+	    break;
+	case TRACE_ARCHIVE:
+	    if (opts.isEmpty() || opts[0].equalsIgnoreCase("off"))
+	    {
+		archive_.stop();
+	    }
+	    else
+	    {
+		const File file(File::getCurrentWorkingDirectory().getChildFile(opts[0]));
+		if (!trace_.isOpen())
+		{
+		    std::cerr << "No trace to archive, \"trace\" has to come first" << std::endl;
+		}
+		else if (!archive_.start(trace_, file, opts.size() > 1 ? opts[1].getIntValue() : (int) TraceArchive::defaultSegmentSeconds))
+		{
+		    std::cerr << "Couldn't create trace archive " << file.getFullPathName() << std::endl;
+		}
+	    }
+	    break;
+	case TRACE:
+	    {
+		const File file(opts.isEmpty() ? String("/dev/shm/loop4r.trace") : File::getCurrentWorkingDirectory().getChildFile(opts[0]).getFullPathName());
+		const int numRecords = opts.size() > 1 ? opts[1].getIntValue() : (int) TraceCapture::defaultNumRecords;
+		if (!trace_.open(file, numRecords))
+		{
+		    std::cerr << "Couldn't create trace file " << file.getFullPathName() << std::endl;
+		}
+	    }
+	    break;
+	case RELOAD:
+	    reloadPrograms_ = !opts[0].equalsIgnoreCase("off");
+	    if (!controlThread_.isThreadRunning())
+	    {
+		break;
+	    }
+	    if (reloadPrograms_)
+	    {
+		startProgramWatcher();
+	    }
+	    else
+	    {
+		programWatcher_.stop();
+	    }
+	    break;
+	case PROGRESS:
+	    if (opts.size() > 0 && (opts[0].equalsIgnoreCase("off") || opts[0].equalsIgnoreCase("display")
+					 || opts[0].equalsIgnoreCase("ring")))
+	    {
+		progressMode_ = opts[0].equalsIgnoreCase("display") ? ProgressDisplay
+		    : opts[0].equalsIgnoreCase("ring") ? ProgressRing : ProgressOff;
+		progressMs_ = opts.size() > 1 ? jmax(10, opts[1].getIntValue()) : progressMs_;
+		if (opts.size() > 2)
+		{
+		    progressLeds_.clear();
+		    for (auto&& led : StringArray::fromTokens(opts[2], ",", ""))
+		    {
+			progressLeds_.add(jlimit(0, LedChangeFilter::maxLeds - 1, led.getIntValue()));
+		    }
+		}
+	    }
+	    else
+	    {
+		std::cerr << "Unknown progress \"" << opts.joinIntoString(" ") << "\", expected off, display or ring (ms) (leds)" << std::endl;
+	    }
+	    break;
+	case MIRROR:
+	    for (int i = 0; i < opts.size(); ++i)
+	    {
+		const String& name = opts[i];
+		const bool isGlobal = name.startsWithIgnoreCase("global:");
+		const int loopId = isGlobal ? -1 : SooperLooperControls::find(false, name.toRawUTF8());
+		const int globalId = loopId >= 0 ? -1 : SooperLooperControls::find(true, name.fromFirstOccurrenceOf("global:", false, true).toRawUTF8());
+		if (i == 0 && name.containsOnly("0123456789"))
+		{
+		    const int ms = jmax(10, name.getIntValue());
+		    if (ms != mirrorIntervalMs_)
+		    {
+			// a reload changing it: registered again at the new interval
+			for (auto* engine : engines_)
+			{
+			    engine->mirroredLoopControls_ = 0;
+			    engine->mirroredGlobalControls_ = 0;
+			}
+		    }
+		    mirrorIntervalMs_ = ms;
+		}
+		else if (loopId >= 0)
+		{
+		    mirrorLoopControls_ |= (uint64) 1 << loopId;
+		}
+		else if (globalId >= 0)
+		{
+		    mirrorGlobalControls_ |= (uint64) 1 << globalId;
+		}
+		else
+		{
+		    std::cerr << "Unknown SooperLooper control \"" << name << "\"" << std::endl;
+		}
+	    }
+	    break;
+	case CYCLE_TRACKING:
+	    if (opts.size() > 0 && opts[0].equalsIgnoreCase("off"))
+	    {
+		cycleSampleMs_ = 0;
+	    }
+	    else if (opts.size() == 0 || opts[0].getIntValue() > 0)
+	    {
+		cycleSampleMs_ = opts.size() > 0 ? jmax(100, opts[0].getIntValue()) : 2000;
+	    }
+	    else
+	    {
+		std::cerr << "Unknown cycle tracking \"" << opts.joinIntoString(" ") << "\", expected (sample ms) or off" << std::endl;
+	    }
+	    break;
+	case PEDAL_BANKS:
+	    if (opts[0].getIntValue() > 0)
+	    {
+		numPedalBanks_ = jmin(opts[0].getIntValue(), (int) PedalBanks::maxBanks);
+		loopsPerBank_ = opts.size() > 1 ? jmax(0, opts[1].getIntValue()) : 0;
+		if (controlThread_.isThreadRunning())
+		{
+		    rebuildPedalNotes();
+		}
+	    }
+	    else
+	    {
+		std::cerr << "Couldn't set up pedal banks with \"" << opts.joinIntoString(" ") << "\", expected count (loops per bank)" << std::endl;
+	    }
+	    break;
+	case BANK_UPDATES:
+	    if (opts.size() > 0 && (opts[0].equalsIgnoreCase("on") || opts[0].equalsIgnoreCase("off")))
+	    {
+		bankUpdates_ = opts[0].equalsIgnoreCase("on");
+		hiddenPollMs_ = opts.size() > 1 ? jmax(0, opts[1].getIntValue()) : hiddenPollMs_;
+	    }
+	    else
+	    {
+		std::cerr << "Unknown bank updates \"" << opts.joinIntoString(" ") << "\", expected on or off (ms)" << std::endl;
+	    }
+	    break;
+	case LED_REPLAY:
+	    ledReplayBaud_ = opts.size() > 0 && opts[0].equalsIgnoreCase("off") ? -1
+		: opts.size() > 0 ? jmax(0, opts[0].getIntValue()) : 31250;
+	    break;
+	case PRESENCE:
+	    if (opts.size() > 0 && opts[0].equalsIgnoreCase("off"))
+	    {
+		presenceEnabled_ = false;
+	    }
+	    else
+	    {
+		enablePresence(opts.size() > 0 ? roundToInt(jmax(0.0, opts[0].getDoubleValue()) * 1000) : 0);
+	    }
+	    break;
+	case DELIVERY:
+	    deliveryAttempts_ = opts.size() > 0 && opts[0].equalsIgnoreCase("off") ? 0 : opts.size() > 0 ? jmax(1, opts[0].getIntValue()) : 4;
+	    for (auto* engine : engines_)
+	    {
+		engine->deliveries_.configure(deliveryAttempts_);
+	    }
+	    break;
+	case RECONCILE:
+	    if (opts.size() > 0 && opts[0].equalsIgnoreCase("off"))
+	    {
+		reconcileMinMs_ = 0;
+	    }
+	    else
+	    {
+		reconcileMinMs_ = roundToInt((opts.size() > 0 ? jmax(0.01, opts[0].getDoubleValue()) : 2.0) * 1000);
+		reconcileMaxMs_ = roundToInt((opts.size() > 1 ? jmax(0.01, opts[1].getDoubleValue()) : 60.0) * 1000);
+	    }
+	    for (auto* engine : engines_)
+	    {
+		engine->reconciler_.configure(reconcileMinMs_, reconcileMaxMs_);
+	    }
+	    break;
+	case ADAPTIVE_UPDATES:
+	    if (opts.size() > 0 && opts[0].equalsIgnoreCase("off"))
+	    {
+		adaptiveHoldMs_ = 0;
+	    }
+	    else
+	    {
+		adaptiveMs_ = opts.size() > 0 ? jmax(1, opts[0].getIntValue()) : 10;
+		adaptiveHoldMs_ = opts.size() > 1 ? jmax(1, opts[1].getIntValue()) : 1500;
+	    }
+	    break;
+	case UPDATES:
+	    if (opts.size() > 0 && opts[0].equalsIgnoreCase("auto"))
+	    {
+		changeUpdates_ = false;
+	    }
+	    else if (opts.size() > 0 && opts[0].equalsIgnoreCase("change"))
+	    {
+		changeUpdates_ = true;
+		if (opts.size() > 1)
+		{
+		    pollMs_ = jmax(0, opts[1].getIntValue());
+		}
+		if (opts.size() > 2)
+		{
+		    selectedPollMs_ = jmax(0, opts[2].getIntValue());
+		}
+	    }
+	    else
+	    {
+		std::cerr << "Unknown updates \"" << opts.joinIntoString(" ") << "\", expected auto or change (ms) (selected ms)" << std::endl;
+	    }
+	    break;
+	case LED_FORMAT:
+	    if (opts[0].equalsIgnoreCase("text") || opts[0].equalsIgnoreCase("binary"))
+	    {
+		ledOutput_.setFormat(opts[0].equalsIgnoreCase("binary") ? LedCommandOutput::BinaryFormat : LedCommandOutput::TextFormat);
+	    }
+	    else
+	    {
+		std::cerr << "Unknown LED format \"" << opts[0] << "\", expected text or binary" << std::endl;
+	    }
+	    break;
+	case LED_PLUGIN:
+	    ledPluginPath_ = opts[0];
+	    ledPluginArgs_ = opts.joinIntoString(" ", 1);
+	    break;
+	case LED_GPIO:
+	    gpioPins_.clear();
+	    for (auto&& pin : StringArray::fromTokens(opts[0], ",", ""))
+	    {
+		gpioPins_.add(pin.trim().isEmpty() ? -1 : pin.getIntValue());
+	    }
+	    break;
+	case LED_PATTERN:
+	    setLedPattern(opts);
+	    break;
+	case LED_SPI:
+	    spiDevice_ = opts[0].isEmpty() ? "/dev/spidev0.0" : opts[0];
+	    spiBytes_ = opts.size() > 1 ? opts[1].getIntValue() : 2;
+	    break;
+	case LED_DIN:
+	    dinDevice_ = opts[0].isEmpty() ? "/dev/ttyAMA0" : opts[0];
+	    dinBurst_ = opts.size() > 1 ? jmax(1, opts[1].getIntValue()) : 3;
+	    break;
+	case LED_PORT:
+	    useLedPort_ = true;
+	    ledPortDestination_ = opts[0];
+	    break;
+	case BLINK:
+	    if (opts[0].equalsIgnoreCase("free"))
+	    {
+		blinkSync_ = false;
+		blink_.start();
+	    }
+	    else if (opts[0].equalsIgnoreCase("sync"))
+	    {
+		blinkSync_ = true;
+		blink_.start();
+	    }
+	    else
+	    {
+		std::cerr << "Unknown blink clock \"" << opts[0] << "\", expected free or sync" << std::endl;
+	    }
+	    break;
+	case OSC_REALTIME:
+	    if (!realtimeOsc_)
+	    {
+		// swap the listener over if we're already receiving
+		if (isConnected())
+		{
+		    removeOscListener(*oscReceiver_);
+		}
+		realtimeOsc_ = true;
+		if (isConnected())
+		{
+		    addOscListener(*oscReceiver_);
+		}
+	    }
+	    break;
+	case MIDI_FILTER:
+	    if (opts.isEmpty())
+	    {
+		midiFilter_.clear();
+	    }
+	    else if (!midiFilter_.set(opts[0], opts[1], opts[2]))
+	    {
+		std::cerr << "Couldn't use MIDI filter \"" << opts.joinIntoString(" ") << "\", expected (channels) (types) (ccs)" << std::endl;
+	    }
+	    break;
+	case GESTURE:
+	    {
+		static const char* const names[] = { "long", "double", "repeat" };
+		static const int masks[] = { PedalGestures::LongPress, PedalGestures::DoubleTap, PedalGestures::HoldRepeat };
+		const String what = opts[2].toLowerCase();
+		int gesture = -1;
+		for (int i = 0; i < 3; ++i)
+		{
+		    gesture = opts[1].equalsIgnoreCase(names[i]) ? i : gesture;
+		}
+		const int pedalNumber = opts[0].getIntValue();
+		const int input = what == "note" || what == "hit" ? opts[4].getIntValue() : opts[3].getIntValue();
+		// pedal 10 is the board's pedal index 9, like the rest one down
+		const int key = PedalGestures::getKey(input, pedalNumber - 1);
+		GestureAction action;
+		action.kind_ = what == "note" ? GestureAction::Note
+		    : what == "hit" ? GestureAction::Hit
+		    : what == "pedal" ? GestureAction::SamePedal
+		    : what == "tuner" ? GestureAction::Tuner
+		    : GestureAction::None;
+		action.note_ = action.kind_ == GestureAction::Note ? asNoteNumber(opts[3]) : 0;
+		action.command_ = action.kind_ == GestureAction::Hit ? opts[3] : String();
+		if (gesture < 0 || key < 0 || pedalNumber < 1 || input < 0 || input >= AlsaMidiInput::maxSources
+		    || (action.kind_ == GestureAction::None && what != "off")
+		    || (action.kind_ == GestureAction::Hit && action.command_.isEmpty())
+		    || (action.kind_ == GestureAction::Note && opts[3].isEmpty()))
+		{
+		    std::cerr << "Couldn't use gesture \"" << opts.joinIntoString(" ") << "\", expected pedal long|double|repeat note N|hit command|pedal|tuner|off (input)" << std::endl;
+		    break;
+		}
+		gestureActions_[key][gesture] = action;
+		const int mask = action.kind_ != GestureAction::None ? gestures_.getGestures(key) | masks[gesture] : gestures_.getGestures(key) & ~masks[gesture];
+		gestures_.setGestures(key, mask);
+		break;
+	    }
+	case CHORD:
+	    {
+		if (opts[0].equalsIgnoreCase("window"))
+		{
+		    chords_.setWindowMs(opts[1].getIntValue());
+		    break;
+		}
+		const String what = opts[2].toLowerCase();
+		const int input = what == "note" || what == "hit" ? opts[4].getIntValue() : opts[3].getIntValue();
+		GestureAction action;
+		action.kind_ = what == "note" ? GestureAction::Note
+		    : what == "hit" ? GestureAction::Hit
+		    : what == "tuner" ? GestureAction::Tuner
+		    : GestureAction::None;
+		action.note_ = action.kind_ == GestureAction::Note ? asNoteNumber(opts[3]) : 0;
+		action.command_ = action.kind_ == GestureAction::Hit ? opts[3] : String();
+		if ((action.kind_ == GestureAction::None && what != "off")
+		    || (action.kind_ == GestureAction::Hit && action.command_.isEmpty())
+		    || (action.kind_ == GestureAction::Note && opts[3].isEmpty()))
+		{
+		    std::cerr << "Couldn't use chord \"" << opts.joinIntoString(" ") << "\", expected pedal pedal note N|hit command|tuner|off (input) or window ms" << std::endl;
+		    break;
+		}
+		// pedal 10 is the board's pedal index 9, like the rest one down
+		const int chord = action.kind_ == GestureAction::None
+		    ? chords_.remove(input, opts[0].getIntValue() - 1, opts[1].getIntValue() - 1)
+		    : chords_.add(input, opts[0].getIntValue() - 1, opts[1].getIntValue() - 1);
+		if (chord < 0 && action.kind_ != GestureAction::None)
+		{
+		    std::cerr << "Couldn't add chord \"" << opts.joinIntoString(" ") << "\", expected two pedals 1-" << PedalGestures::pedalsPerInput
+			      << " of an input below " << PedalChords::maxChords << " and at most " << PedalChords::maxChords << " chords" << std::endl;
+		    break;
+		}
+		if (chord >= 0)
+		{
+		    chordActions_[chord] = action;
+		}
+		break;
+	    }
+	case DEBOUNCE:
+	    debounce_.setWindowMs(opts[0].getIntValue());
+	    break;
+	case GESTURE_TIMES:
+	    gestures_.setTimes(opts[0].getIntValue(), opts[1].getIntValue(), opts[2].getIntValue(), opts[3].getIntValue());
+	    break;
+	case LED_STREAM:
+	    if (opts.size() == 1 && opts[0].equalsIgnoreCase("off"))
+	    {
+		ledStream_.stop();
+		break;
+	    }
+	    {
+		const int port = opts.isEmpty() ? 9002 : asPortNumber(opts[0]);
+		if (ledStream_.start(port))
+		{
+		    std::cerr << "Serving the LEDs over TCP on port " << port << std::endl;
+		}
+		else
+		{
+		    std::cerr << "Couldn't serve the LEDs over TCP on port " << port << std::endl;
+		}
+	    }
+	    break;
+	case OSC_BUFFERS:
+	    oscReceiveBufferBytes_ = jmax(0, opts[0].getIntValue());
+	    oscSendBufferBytes_ = opts.size() > 1 ? jmax(0, opts[1].getIntValue()) : oscSendBufferBytes_;
+	    if (oscSocket_ != nullptr)
+	    {
+		configureOscSocket(*oscSocket_);
+	    }
+	    if (oscSendThread_.isRunning())
+	    {
+		UdpBatchReader::configure(oscSendThread_.getSocketHandle(), 0, oscSendBufferBytes_);
+	    }
+	    for (auto* engine : engines_)
+	    {
+		if (engine->sender_.isConnected())
+		{
+		    UdpBatchReader::configure(engine->sender_.getSocketHandle(), 0, oscSendBufferBytes_);
+		}
+	    }
+	    break;
+	case OSC_GATE:
+	    if (opts[0].equalsIgnoreCase("off"))
+	    {
+		oscGate_.setLimit(0, 0);
+	    }
+	    else if (opts[0].getIntValue() > 0)
+	    {
+		oscGate_.setLimit(opts[0].getIntValue(), opts.size() > 1 ? opts[1].getIntValue() : oscGateBlockMs);
+	    }
+	    else
+	    {
+		std::cerr << "Couldn't gate the OSC socket with \"" << opts.joinIntoString(" ") << "\", expected packets a second (block ms) or off" << std::endl;
+	    }
+	    break;
+	case OSC_SEND_THREAD:
+	    useOscSendThread_ = true;
+	    break;
+	case LED_MULTICAST:
+	    if (opts.size() == 1 && opts[0].equalsIgnoreCase("off"))
+	    {
+		ledMulticast_.close();
+		break;
+	    }
+	    {
+		String group("239.255.4.4");
+		int port = 9003;
+		if (!opts.isEmpty())
+		{
+		    parseEngineAddress(opts[0], group, port);
+		}
+		const int ttl = opts.size() > 1 ? opts[1].getIntValue() : 1;
+		if (ledMulticast_.open(group, port, ttl))
+		{
+		    std::cerr << "Sending the LEDs to multicast group " << group << ":" << port << std::endl;
+		}
+		else
+		{
+		    std::cerr << "Couldn't send the LEDs to multicast group " << group << ":" << port << std::endl;
+		}
+	    }
+	    break;
+	case LOCAL_SOCKET:
+	    if (opts.size() == 1 && opts[0].equalsIgnoreCase("off"))
+	    {
+		closeLocalSocket();
+		break;
+	    }
+	    openLocalSocket(opts.isEmpty() ? String("/tmp/loop4r.sock") : File::getCurrentWorkingDirectory().getChildFile(opts[0]).getFullPathName());
+	    break;
+	case METRICS:
+	    {
+		const String path = opts.isEmpty() ? String("/tmp/loop4r.metrics") : File::getCurrentWorkingDirectory().getChildFile(opts[0]).getFullPathName();
+		if (metricsServer_.start(path))
+		{
+		    std::cerr << "Serving metrics on Unix socket " << path << std::endl;
+		}
+		else
+		{
+		    std::cerr << "Couldn't serve metrics on Unix socket " << path << std::endl;
+		}
+	    }
+	    break;
+	case HEARTBEAT_LOSS:
+	    heartbeatLossMinutes_ = opts.isEmpty() ? 10.0 : jmax(0.01, opts[0].getDoubleValue());
+	    heartbeatLossAliveMs_ = (opts.size() > 1 ? jmax(0, opts[1].getIntValue()) : 60) * 1000;
+	    break;
+	case MULTIPLE_INSTANCES:
+	    // seen by moreThanOneInstanceAllowed(), before we get this far
+	    break;
+	case SCALE_BENCHMARK:
+	    scaleSeconds_ = opts.isEmpty() ? 3.0 : jmax(0.5, opts[0].getDoubleValue());
+	    scaleFile_ = opts[1];
+	    break;
+	case SELF_TEST:
+	    selfTesting_ = true;
+	    for (int i = 0; i < jmin(opts.size(), (int) SelfTest::numProbes); ++i)
+	    {
+		if (opts[i].getDoubleValue() > 0)
+		{
+		    selfTest_.setLimitMs((SelfTest::Probe) i, opts[i].getDoubleValue());
+		}
+	    }
+	    break;
+	case SOAK:
+	    soakMinutes_ = opts.isEmpty() ? 60.0 : jmax(0.01, opts[0].getDoubleValue());
+	    soakRate_ = opts.size() > 1 ? jmax(1, opts[1].getIntValue()) : 20000;
+	    soakLimitKB_ = opts.size() > 2 ? opts[2].getDoubleValue() : 1024.0;
+	    break;
+	case JOURNAL:
+	    if (opts[0].equalsIgnoreCase("off"))
+	    {
+		journal_.close();
+		journalOff_ = true;
+	    }
+	    else if (opts[0].equalsIgnoreCase("show"))
+	    {
+		journalShowFile_ = opts[1].isEmpty() ? EventJournal::getDefaultFile()
+		    : File::getCurrentWorkingDirectory().getChildFile(opts[1]);
+	    }
+	    else
+	    {
+		const File file = opts[0].isEmpty() ? EventJournal::getDefaultFile() : File::getCurrentWorkingDirectory().getChildFile(opts[0]);
+		journalOff_ = false;
+		if (!journal_.open(file, opts.size() > 1 ? opts[1].getIntValue() : (int) EventJournal::defaultNumRecords))
+		{
+		    std::cerr << "Couldn't create journal file " << file.getFullPathName() << std::endl;
+		}
+	    }
+	    break;
+	case LOOPBACK:
+	    loopbackEvents_ = opts.isEmpty() ? 1000 : jmax(1, opts[0].getIntValue());
+	    loopbackRate_ = opts.size() > 1 ? jmax(1, opts[1].getIntValue()) : 20;
+	    // a loop's LED only changes without SooperLooper when it's predicted
+	    predictLoops_ = true;
+	    break;
+	case SIMULATE:
+	    simulating_ = true;
+	    simulatorOptions_.port_ = opts[0].getIntValue();
+	    simulatorOptions_.loops_ = opts.size() > 1 ? opts[1].getIntValue() : 8;
+	    simulatorOptions_.updateIntervalMs_ = opts.size() > 2 ? opts[2].getIntValue() : 100;
+	    simulatorOptions_.lossPercent_ = opts[3].getDoubleValue();
+	    simulatorOptions_.delayMs_ = opts[4].getIntValue();
+	    simulatorOptions_.jitterMs_ = opts[5].getIntValue();
+	    break;
+	case ACCOUNTING:
+	    allocations_.setEnabled(true);
+	    threadAccounting_.start(roundToInt((opts.isEmpty() ? 10.0 : jmax(0.1, opts[0].getDoubleValue())) * 1000.0));
+	    break;
+	case SPANS:
+	    if (opts.size() == 1 && opts[0].equalsIgnoreCase("dump"))
+	    {
+		writeSpans();
+	    }
+	    else if (opts.size() == 1 && opts[0].equalsIgnoreCase("off"))
+	    {
+		spans_.setEnabled(false);
+	    }
+	    else
+	    {
+		spansFile_ = opts.isEmpty() ? File("/tmp/loop4r_spans.json") : File::getCurrentWorkingDirectory().getChildFile(opts[0]);
+		spans_.allocate(opts.size() > 1 ? opts[1].getIntValue() : (int) SpanTrace::defaultNumSpans);
+		spans_.setEnabled(true);
+		std::cerr << "Recording spans, " << spans_.getNumSpans() << " per thread, for " << spansFile_.getFullPathName() << std::endl;
+	    }
+	    break;
+	case OSC_TIMED:
+	    if (opts[0].equalsIgnoreCase("off"))
+	    {
+		macroLeadMs_ = 0;
+	    }
+	    else if (opts[0].equalsIgnoreCase("on") || opts[0].getIntValue() > 0)
+	    {
+		macroLeadMs_ = opts[0].getIntValue() > 0 ? jmin(opts[0].getIntValue(), 1000) : 20;
+		beatScheduler_.start();
+	    }
+	    else
+	    {
+		std::cerr << "Couldn't time tag with \"" << opts[0] << "\", expected off, on or a lead in ms" << std::endl;
+	    }
+	    break;
+	case MACRO:
+	    {
+		StringArray steps(opts);
+		steps.remove(0);
+		String error;
+		if (opts[0].isEmpty() || !macros_.define(opts[0], steps, error))
+		{
+		    std::cerr << "Couldn't define macro \"" << opts[0] << "\": " << (error.isNotEmpty() ? error : String("it needs a name")) << std::endl;
+		}
+		break;
+	    }
+	case LOOP_GROUP:
+	    {
+		String error;
+		if (!loopGroups_.define(opts[0], opts[1], error))
+		{
+		    std::cerr << "Couldn't define loop group \"" << opts[0] << "\": " << error << std::endl;
+		}
+		break;
+	    }
+	case GROUP_PEDAL:
+	    {
+		const bool off = opts[1].equalsIgnoreCase("off");
+		const int input = (off ? opts[2] : opts[3]).getIntValue();
+		const int key = PedalGestures::getKey(input, opts[0].getIntValue() - 1);
+		const int group = off ? -1 : loopGroups_.find(opts[1]);
+		if (key < 0 || opts[0].getIntValue() < 1 || input >= AlsaMidiInput::maxSources
+		    || (!off && (group < 0 || opts[2].isEmpty())))
+		{
+		    std::cerr << "Couldn't give \"" << opts.joinIntoString(" ") << "\" a loop group, expected pedal group command|off (input) after the group's defined" << std::endl;
+		    break;
+		}
+		loopGroups_.bind(key, group, opts[2]);
+		break;
+	    }
+	case MACRO_PEDAL:
+	    {
+		const int key = PedalGestures::getKey(opts[2].getIntValue(), opts[0].getIntValue() - 1);
+		const int macro = macros_.find(opts[1]);
+		if (key < 0 || opts[0].getIntValue() < 1 || opts[2].getIntValue() >= AlsaMidiInput::maxSources
+		    || (macro < 0 && !opts[1].equalsIgnoreCase("off")))
+		{
+		    std::cerr << "Couldn't give \"" << opts.joinIntoString(" ") << "\" a macro, expected pedal name|off (input) after the macro's defined" << std::endl;
+		    break;
+		}
+		macros_.cancel(key);
+		numMacroPedals_ += (macro >= 0) - (macroForKey_[key] >= 0);
+		macroForKey_[key] = macro;
+		break;
+	    }
+	case SCRIPT_PEDAL:
+	    {
+		const int key = PedalGestures::getKey(opts[2].getIntValue(), opts[0].getIntValue() - 1);
+		if (key < 0 || opts[0].getIntValue() < 1 || opts[1].isEmpty() || opts[2].getIntValue() >= AlsaMidiInput::maxSources)
+		{
+		    std::cerr << "Couldn't give \"" << opts.joinIntoString(" ") << "\" a script, expected pedal file|off (input) (ms)" << std::endl;
+		    break;
+		}
+		int script = -1;
+		if (!opts[1].equalsIgnoreCase("off"))
+		{
+		    const File file = File::getCurrentWorkingDirectory().getChildFile(opts[1]);
+		    String error;
+		    script = pedalScripts_.load(file, opts.size() > 3 ? opts[3].getIntValue() : PedalScripts::defaultBudgetMs, error);
+		    if (script < 0)
+		    {
+			std::cerr << "Couldn't use " << file.getFileName() << " for pedal " << opts[0] << ": " << error << std::endl;
+			break;
+		    }
+		}
+		numScriptPedals_ += (script >= 0) - (scriptForKey_[key] >= 0);
+		scriptForKey_[key] = script;
+		break;
+	    }
+	case TAP_TEMPO:
+	    if (opts[0].equalsIgnoreCase("off"))
+	    {
+		tapKey_ = -1;
+	    }
+	    else if (opts[0].getIntValue() >= 1 && opts[1].getIntValue() >= 0 && opts[1].getIntValue() < AlsaMidiInput::maxSources)
+	    {
+		tapKey_ = PedalGestures::getKey(opts[1].getIntValue(), opts[0].getIntValue() - 1);
+	    }
+	    else
+	    {
+		std::cerr << "Couldn't make \"" << opts.joinIntoString(" ") << "\" a tap tempo pedal, expected pedal|off (input)" << std::endl;
+	    }
+	    break;
+	case QUANTISE:
+	    {
+		const String unit = opts[0].toLowerCase();
+		if (unit == "off")
+		{
+		    quantiseBeats_ = 0;
+		    break;
+		}
+		if (unit != "beat" && unit != "bar")
+		{
+		    std::cerr << "Couldn't quantise to \"" << opts[0] << "\", expected off, beat or bar" << std::endl;
+		    break;
+		}
+		int next = 1;
+		const int beatsPerBar = unit == "bar" && opts[1].containsOnly("0123456789") && opts[1].isNotEmpty() ? opts[next++].getIntValue() : 4;
+		quantiseBeats_ = unit == "bar" ? jlimit(1, 32, beatsPerBar) : 1;
+		quantiseAutoAhead_ = opts[next].equalsIgnoreCase("auto");
+		quantiseAheadMs_ = jmax(0, opts[quantiseAutoAhead_ ? next + 1 : next].getIntValue());
+		beatScheduler_.start();
+		break;
+	    }
+	case HOST_CLOCK:
+	    if (opts.size() > 0 && opts[0].equalsIgnoreCase("off"))
+	    {
+		hostClockPort_ = 0;
+	    }
+	    else if (opts.size() == 0 || asPortNumber(opts[0]) > 0)
+	    {
+		hostClockPort_ = opts.size() > 0 ? asPortNumber(opts[0]) : 9000;
+	    }
+	    else
+	    {
+		std::cerr << "Couldn't ask the hosts' clocks with \"" << opts.joinIntoString(" ") << "\", expected (port) or off" << std::endl;
+	    }
+	    for (auto* engine : engines_)
+	    {
+		engine->clockOffset_.reset();
+	    }
+	    break;
+	case NET_CLOCK:
+	    if (opts.size() > 0 && opts[0].equalsIgnoreCase("off"))
+	    {
+		netClockHost_ = String();
+		netClock_.reset();
+		if (controlThread_.isThreadRunning())
+		{
+		    wheel_.cancel(netClockTimer_);
+		}
+	    }
+	    else if (opts.size() > 0 && opts[0].fromLastOccurrenceOf(":", false, false).getIntValue() > 0)
+	    {
+		netClockHost_ = opts[0].upToLastOccurrenceOf(":", false, false);
+		netClockPort_ = opts[0].fromLastOccurrenceOf(":", false, false).getIntValue();
+		netClockMs_ = opts.size() > 1 ? jmax(20, opts[1].getIntValue()) : 250;
+		netClock_.reset();
+		if (controlThread_.isThreadRunning())
+		{
+		    wheel_.scheduleIn(netClockTimer_, 0, time_.getMillisecondCounter());
+		}
+	    }
+	    else
+	    {
+		std::cerr << "Couldn't follow a network clock with \"" << opts.joinIntoString(" ") << "\", expected host:port (ms) or off" << std::endl;
+	    }
+	    break;
+	case JACK_TRANSPORT:
+	    if (opts[0].equalsIgnoreCase("off"))
+	    {
+		closeJackTransport();
+	    }
+	    else if (opts[0].equalsIgnoreCase("on"))
+	    {
+		const bool reopen = !jackTransport_.isOpen();
+		jackTransportEnabled_ = true;
+		if (reopen && !deferMidiPorts_)
+		{
+		    openJackTransport();
+		}
+	    }
+	    else
+	    {
+		std::cerr << "Couldn't follow JACK transport with \"" << opts[0] << "\", expected on or off" << std::endl;
+	    }
+	    break;
+	case CLOCK_FOLLOW:
+	    if (opts[0].equalsIgnoreCase("off"))
+	    {
+		clockFollow_ = false;
+	    }
+	    else if (opts[0].equalsIgnoreCase("on") || opts[0].getDoubleValue() > 0)
+	    {
+		clockFollow_ = true;
+		clockMinChange_ = opts[0].getDoubleValue() > 0 ? opts[0].getDoubleValue() : 0.5;
+	    }
+	    else
+	    {
+		std::cerr << "Couldn't follow the clock with \"" << opts[0] << "\", expected on, off or a tempo change in bpm" << std::endl;
+	    }
+	    break;
+	case MIDI_DROP:
+	    if (midiFilter_.setDropped(opts[0]))
+	    {
+		sequencerInput_.setDroppedStatuses(midiFilter_.getDroppedStatuses());
+	    }
+	    else
+	    {
+		std::cerr << "Couldn't drop \"" << opts[0] << "\", expected clock, tick, transport, sensing, realtime, sysex, timecode, song or none" << std::endl;
+	    }
+	    break;
+	default:
+	    break;
+	}
+    }
+
+    uint16 asPortNumber(const String& value)
+    {
+	return (uint16)limit16Bit(asDecOrHexIntValue(value));
+    }
+
+    uint8 asNoteNumber(const String& value)
+    {
+	int note;
+	if (ArgumentView(value).asNoteName(octaveMiddleC_, note))
+	{
+	    return (uint8)limit7Bit(note);
+	}
+
+	return (uint8)limit7Bit(asDecOrHexIntValue(value));
+    }
+
+    uint8 asDecOrHex7BitValue(const String& value)
+    {
+	return (uint8)limit7Bit(asDecOrHexIntValue(value));
+    }
+
+    uint16 asDecOrHex14BitValue(const String& value)
+    {
+	return (uint16)limit14Bit(asDecOrHexIntValue(value));
+    }
+
+    int asDecOrHexIntValue(const String& value)
+    {
+	return ArgumentView(value).asDecOrHex(useHexadecimalsByDefault_);
+    }
+
+    static uint8 limit7Bit(int value)
+    {
+	return (uint8)jlimit(0, 0x7f, value);
+    }
+
+    static uint16 limit14Bit(int value)
+    {
+	return (uint16)jlimit(0, 0x3fff, value);
+    }
+
+    static uint16 limit16Bit(int value)
+    {
+	return (uint16)jlimit(0, 0xffff, value);
+    }
+
+    // PedalScriptHost, for "jpedal" scripts on the control thread
+    void runScriptCommand(const String& line) override
+    {
+	const ScopedLock lock(midiPortsLock_);
+	parseParameters(parseLineAsParameters(line));
+    }
+
+    void setScriptLed(int led, bool on) override
+    {
+	if (led >= 0 && led < LedChangeFilter::maxLeds)
+	{
+	    on ? ledOn(led) : ledOff(led);
+	}
+    }
+
+    void sendScriptMidi(const MidiMessage& message) override
+    {
+	sendMidiMessage(message);
+    }
+
+    int getScriptMode() const override
+    {
+	return mode_;
+    }
+
+    void setScriptMode(int mode) override
+    {
+	mode_ = mode > 0 ? 20 : 0;
+	updateLoops();
+    }
+
+    void ledOn(int pedalIdx) {
+	setLed(pedalIdx, true);
+    }
+
+    void ledOff(int pedalIdx) {
+	setLed(pedalIdx, false);
+    }
+
+    void setLed(int pedalIdx, bool on) {
+	if (pedalIdx < 0 || pedalIdx >= LedChangeFilter::maxLeds)
+	{
+	    return;
+	}
+	// the tuner has it for now, this is what it gets back
+	if (tuning_ && tunerOwns_[pedalIdx])
+	{
+	    tunerSaved_[pedalIdx] = on;
+	    return;
+	}
+
+	// a loop's LED blinks the way the active engine's loop says
+	const LoopStore& loops = activeEngine().loops_;
+	const LedStates state = loops.getLedMode(pedalIdx);
+	const int pattern = loops.contains(pedalIdx) ? ledPatterns_.choose(state, loops.getState(pedalIdx)) : (int) state;
+	ledFrame_.set(pedalIdx, on, loops.getLedTimer(pedalIdx), state, pattern);
+    }
+
+    // from commitLeds(), once per LED drawn in the frame
+    void emitLed(int pedalIdx, const LedFrameBuffer::Led& led)
+    {
+	const bool on = led.on_;
+	const int timer = led.timer_;
+	const LedStates state = (LedStates) led.state_;
+
+	// nothing to do if the consumers already have this state
+	if (!ledChanges_.update(pedalIdx, on, timer, state, led.pattern_))
+	{
+	    return;
+	}
+
+	sharedLeds_.setLed(pedalIdx, on, timer, state, getNumLeds());
+	if (on)
+	{
+	    startup_.reached(StartupTimes::FirstLedLit);
+	}
+
+	if (pendingLedTicks_[pedalIdx] != 0)
+	{
+	    latency_.record(LatencyStats::PedalToLed, pendingLedTicks_[pedalIdx]);
+	    pendingLedTicks_[pedalIdx] = 0;
+	}
+
+	sendBoardLed(pedalIdx, on, led.pattern_);
+
+	if (ledFrames_)
+	{
+	    ledFramePush_.addLed(pedalIdx, on, timer, (int) state);
+	}
+	else if (pushesToDisplays())
+	{
+	    static constexpr auto ledMessage = makeOscMessage<OscInt32, OscInt32, OscInt32, OscInt32, OscInt32>("/led");
+	    OscPacket packet;
+	    packet.size_ = ledMessage.write(packet.data_, pedalIdx, on ? 1 : 0, timer, (int) state, ledChanges_.getVersion());
+	    ledSubscribers_.send(packet, LedSubscribers::LedUpdates, LedSubscribers::ledBit(pedalIdx));
+	    ledMulticast_.send(packet);
+	}
+	if (ledStream_.isRunning())
+	{
+	    ledStream_.setLed(pedalIdx, on, timer, (int) state, ledChanges_.getVersion());
+	}
+    }
+
+    // A loop's LED goes to the loop pedal the bank shows it on, and every
+    // other LED to its own pedal as always. Past the loop pedals the two can
+    // be the same LED, a loop's and an aux pedal's share the index.
+    void sendBoardLed(int pedalIdx, bool on, int pattern)
+    {
+	const int loopPedal = pedalBanks_.getCurrent().getPedal(pedalIdx);
+	if (loopPedal != PedalBanks::noPedal)
+	{
+	    sendBoardPedalLed(loopPedal, on, pattern);
+	}
+	if (pedalIdx >= BoardPedals::table.getNumLoopPedals())
+	{
+	    sendBoardPedalLed(pedalIdx, on, pattern);
+	}
+    }
+
+    void sendBoardPedalLed(int pedal, bool on, int pattern)
+    {
+	//sendMidiMessage(midiOut_, MidiMessage::controllerEvent(channel_, on ? 106 : 107, BoardPedals::table.ledNumber(pedal)));
+	if (blink_.isRunning())
+	{
+	    blink_.set(BoardPedals::table.ledNumber(pedal), on, pattern);
+	}
+	else
+	{
+	    ledOutput_.add(on ? 106 : 107, BoardPedals::table.ledNumber(pedal));
+	}
+    }
+
+    void selectLoop() {
+	// the progress shows there while it knows where the loop is, the tuner while it's on
+	if ((progressMode_ == ProgressDisplay && progressStep_ >= 0) || tuning_)
+	{
+	    return;
+	}
+	ledFrame_.setDisplay(activeEngine().selectedLoop_);
+    }
+
+    // the selected loop, or the progress through it
+    void emitDisplay(int selectedLoop)
+    {
+	const int previous = ledChanges_.getDisplay();
+	if (!ledChanges_.updateDisplay(selectedLoop))
+	{
+	    return;
+	}
+	sharedLeds_.setSelectedLoop(activeEngine().selectedLoop_);
+
+	// only the digits that changed, one cc per step of the progress
+	if (previous < 0 || previous / 10 != selectedLoop / 10)
+	{
+	    //sendMidiMessage(midiOut_, MidiMessage::controllerEvent(channel_, 113, (uint8)(selectedLoop / 10)));
+	    ledOutput_.add(113, selectedLoop / 10);
+	}
+	if (previous < 0 || previous % 10 != selectedLoop % 10)
+	{
+	    //sendMidiMessage(midiOut_, MidiMessage::controllerEvent(channel_, 114, (uint8)(selectedLoop % 10)));
+	    ledOutput_.add(114, selectedLoop % 10);
+	}
+
+	if (ledFrames_)
+	{
+	    ledFramePush_.setDisplay(selectedLoop);
+	}
+	else if (pushesToDisplays())
+	{
+	    static constexpr auto displayMessage = makeOscMessage<OscInt32, OscInt32>("/display");
+	    OscPacket packet;
+	    packet.size_ = displayMessage.write(packet.data_, selectedLoop, ledChanges_.getVersion());
+	    ledSubscribers_.send(packet, LedSubscribers::DisplayUpdates);
+	    ledMulticast_.send(packet);
+	}
+	if (ledStream_.isRunning())
+	{
+	    ledStream_.setDisplay(selectedLoop, ledChanges_.getVersion());
+	}
+    }
+
+    // the end of an input event (or a batch of them): everything drawn since
+    // the last one goes out together and becomes what readers see
+    void commitLeds()
+    {
+	ledFrame_.commit([this] (int index, const LedFrameBuffer::Led& led) { emitLed(index, led); },
+			 [this] (int value) { emitDisplay(value); });
+	if (!startup_.hasReached(StartupTimes::FirstCorrectFrame) && startup_.hasReached(StartupTimes::FirstLoopStates))
+	{
+	    startup_.reached(StartupTimes::FirstCorrectFrame);
+	}
+	if (!ledFramePush_.isEmpty())
+	{
+	    pushLedFrame();
+	}
+	ledOutput_.commit();
+	sharedLeds_.publish();
+	ledStream_.commit();
+	publishState();
+    }
+
+    // the committed LEDs and the active engine's loops for the other threads,
+    // when any of it changed
+    void publishState()
+    {
+	PublishedState* state = publishedState_.edit();
+	if (state == nullptr)
+	{
+	    return;
+	}
+	const Engine& engine = activeEngine();
+	const PublishedState& current = publishedState_.getCurrent();
+	state->engine_ = engine.index_;
+	state->selectedLoop_ = engine.selectedLoop_;
+	state->numLoops_ = engine.loops_.size();
+	state->display_ = ledFrame_.getDisplay();
+	state->numLit_ = 0;
+	for (int i = 0; i < state->numLoops_; ++i)
+	{
+	    state->loopStates_[i] = (uint8) engine.loops_.getState(i);
+	}
+	for (int i = 0; i < LedChangeFilter::maxLeds; ++i)
+	{
+	    state->leds_[i] = ledFrame_.getLed(i).on_;
+	    state->numLit_ += state->leds_[i] ? 1 : 0;
+	}
+	if (std::memcmp(state, &current, sizeof(PublishedState)) == 0)
+	{
+	    publishedState_.abandon();
+	    return;
+	}
+	publishedState_.publish();
+    }
+
+    // a gauge's look at the published state, 0 if every reader slot is taken
+    template <typename Function>
+    int64 readPublishedState(Function&& function) const
+    {
+	const RcuSnapshot<PublishedState>::ReadScope state(publishedState_);
+	return state.isValid() ? function(*state) : 0;
+    }
+
+    // "ledframes": what the commit changed as one /leds message
+    void pushLedFrame()
+    {
+	if (pushesToDisplays())
+	{
+	    const int size = ledFramePush_.write((int) ++numLedFramesPushed_, ledChanges_.getVersion());
+	    // a frame is applied whole, so it isn't cut down to what each one shows
+	    ledSubscribers_.send(ledFramePush_.getData(), size, ledFramePush_.getUpdates(), ledFramePush_.getLedMask());
+	    ledMulticast_.send(ledFramePush_.getData(), size);
+	}
+	ledFramePush_.clear();
+    }
+
+    // Registers loops first..last-1 for state updates, as a few bundles rather
+    // than a datagram per message. On (re)initialisation it also asks for their
+    // current state and registers for the selected loop. When that covers every
+    // loop the engine has it goes to loop -1, two messages whatever the session
+    // size; the states then come back one /ctrl per loop as usual.
+    //
+    // (Re)initialisation first drops whatever the engine still has for our url,
+    // e.g. from a run that crashed, so subscriptions never pile up there. It's
+    // repeated every registrationLeaseMs in case the engine lost ours.
+    void registerLoops(Engine& engine, int first, int last, bool initial)
+    {
+	engine.arrivals_.resize(engine.loops_.size());
+	const OscPacketSender::QueryScope query(engine.sender_);
+	OscBundleSender bundle(engine.sender_);
+	if (initial)
+	{
+	    addUnregistrations(engine, bundle);
+	    engine.registeredAt_ = time_.getMillisecondCounter();
+	    engine.packets_.setFastInterval(adaptiveMs_);
+	    engine.adaptive_.configure(adaptiveHoldMs_);
+	}
+	engine.visibleLoops_ = getVisibleLoops(engine);
+	const bool allVisible = !bankUpdates_ || changeUpdates_;
+	if (initial && first == 0 && last == engine.loopCount_)
+	{
+	    bundle.add(changeUpdates_ || !allVisible ? engine.packets_.allLoopsChangeUpdates(false) : engine.packets_.allLoopsAutoUpdates(false));
+	    for (int i = allVisible ? last : first; i < last; ++i)
+	    {
+		if (engine.visibleLoops_[i])
+		{
+		    bundle.add(engine.packets_.loopAutoUpdates(i, false));
+		}
+	    }
+	    bundle.add(engine.packets_.allLoopsInitialState());
+	}
+	else
+	{
+	    for (int i = first; i < last; ++i)
+	    {
+		bundle.add(changeUpdates_ || !allVisible ? engine.packets_.loopChangeUpdates(i, false) : engine.packets_.loopAutoUpdates(i, false));
+		if (!allVisible && engine.visibleLoops_[i])
+		{
+		    bundle.add(engine.packets_.loopAutoUpdates(i, false));
+		}
+		if (initial)
+		{
+		    bundle.add(engine.packets_.loopInitialState(i));
+		}
+	    }
+	}
+	if (initial)
+	{
+	    engine.handshake_.queried(first, last, time_.getMillisecondCounter());
+	    engine.mirroredLoopControls_ = engine.mirroredGlobalControls_ = 0;
+	    addMirrorRegistrations(engine, bundle);
+	    bundle.add(engine.packets_.globalUpdates(false));
+	    if (blinkSync_)
+	    {
+		bundle.add(engine.packets_.tempoUpdates(false));
+		bundle.add(engine.packets_.tempoState());
+		if (cycleSampleMs_ == 0)
+		{
+		    bundle.add(engine.packets_.positionUpdates(false));
+		}
+	    }
+	    if (cycleSampleMs_ > 0)
+	    {
+		addCycleRegistrations(engine, bundle, false);
+	    }
+	}
+	setPollIntervals(engine);
+    }
+
+    // loop_pos and cycle_len of every loop for the cycle tracker, with their
+    // values now when registering
+    void addCycleRegistrations(Engine& engine, OscBundleSender& bundle, bool unreg)
+    {
+	OscPacket packet;
+	for (const int id : { (int) SooperLooperControls::loopPos, (int) SooperLooperControls::cycleLen })
+	{
+	    const char* control = SooperLooperControls::getName(false, id);
+	    engine.packets_.buildCycleUpdates(packet, control, cycleSampleMs_ > 0 ? cycleSampleMs_ : 2000, unreg);
+	    bundle.add(packet);
+	    if (!unreg)
+	    {
+		engine.packets_.buildCycleGet(packet, control);
+		bundle.add(packet);
+	    }
+	}
+    }
+
+    // the mirrored controls not yet registered with the engine, then their values
+    void addMirrorRegistrations(Engine& engine, OscBundleSender& bundle)
+    {
+	const uint64 loopControls = getMirroredControls(false) & ~engine.mirroredLoopControls_;
+	const uint64 globalControls = getMirroredControls(true) & ~engine.mirroredGlobalControls_;
+	OscPacket packet;
+	for (int id = 0; id < ControlMirror::maxControls; ++id)
+	{
+	    for (const bool isGlobal : { false, true })
+	    {
+		if ((((isGlobal ? globalControls : loopControls) >> id) & 1) != 0)
+		{
+		    const int index = isGlobal ? SooperLooperControls::global : -1;
+		    engine.packets_.buildControlUpdates(packet, index, SooperLooperControls::getName(isGlobal, id), mirrorIntervalMs_, false);
+		    bundle.add(packet);
+		    engine.packets_.buildControlGet(packet, index, SooperLooperControls::getName(isGlobal, id));
+		    bundle.add(packet);
+		}
+	    }
+	}
+	engine.mirroredLoopControls_ |= loopControls;
+	engine.mirroredGlobalControls_ |= globalControls;
+    }
+
+    // what "mirror" asked for and what clients follow, less what we follow anyway
+    uint64 getMirroredControls(bool isGlobal) const
+    {
+	if (isGlobal)
+	{
+	    return (mirrorGlobalControls_ | controlSubscribers_.getGlobalControls())
+		& ~((uint64) 1 << SooperLooperControls::selectedLoopNum);
+	}
+	const uint64 progress = progressMode_ == ProgressOff ? 0
+	    : ((uint64) 1 << SooperLooperControls::loopPos) | ((uint64) 1 << SooperLooperControls::loopLen);
+	return (mirrorLoopControls_ | controlSubscribers_.getLoopControls() | progress) & ~((uint64) 1 << SooperLooperControls::state);
+    }
+
+    void updateMirroredControls(Engine& engine)
+    {
+	if (engine.connected_ && engine.loopCount_ > 0
+	    && ((getMirroredControls(false) & ~engine.mirroredLoopControls_) != 0
+		|| (getMirroredControls(true) & ~engine.mirroredGlobalControls_) != 0))
+	{
+	    const OscPacketSender::QueryScope query(engine.sender_);
+	    OscBundleSender bundle(engine.sender_);
+	    addMirrorRegistrations(engine, bundle);
+	}
+    }
+
+    // a /ctrl value for the mirror, passed on to the clients following it
+    // and the progress display
+    void mirrorControl(Engine& engine, int loop, int id, float value)
+    {
+	if (id < 0 || !engine.controls_.set(loop, id, value) || !isActive(engine))
+	{
+	    return;
+	}
+	controlSubscribers_.send(loop, id, value);
+
+	if (progressTimer_ >= 0 && progressMode_ != ProgressOff && loop == engine.selectedLoop_
+	    && (id == SooperLooperControls::loopPos || id == SooperLooperControls::loopLen))
+	{
+	    if (id == SooperLooperControls::loopPos)
+	    {
+		progress_.sync(value, getProgressTicks());
+	    }
+	    else
+	    {
+		progress_.setLength(value);
+	    }
+	    wheel_.schedule(progressTimer_, time_.getMillisecondCounter());
+	}
+    }
+
+    // another loop or engine selected: start from what the mirror has for it
+    void restartProgress()
+    {
+	const Engine& engine = activeEngine();
+	progress_.reset();
+	float value;
+	if (engine.controls_.get(engine.selectedLoop_, SooperLooperControls::loopLen, value))
+	{
+	    progress_.setLength(value);
+	}
+	if (engine.controls_.get(engine.selectedLoop_, SooperLooperControls::loopPos, value))
+	{
+	    progress_.sync(value, getProgressTicks());
+	}
+	if (progressTimer_ >= 0)
+	{
+	    wheel_.schedule(progressTimer_, time_.getMillisecondCounter());
+	}
+    }
+
+    static bool isLoopRunning(LoopStates state)
+    {
+	return state == Playing || state == Overdubbing || state == Multiplying || state == Inserting
+	    || state == Replacing || state == Substitute || state == Muted || state == OneShot;
+    }
+
+    // draws the progress when it's moved a step, and comes back when it's
+    // due to move the next one, not sooner than every progressMs_. Without a
+    // position the display goes back to the selected loop.
+    void renderProgress(uint32 now)
+    {
+	const Engine& engine = activeEngine();
+	const int steps = progressMode_ == ProgressDisplay ? 100 : progressLeds_.size();
+	const bool running = isLoopRunning(engine.loops_.getState(engine.selectedLoop_));
+	const int64 ticks = getProgressTicks();
+	const int step = progressMode_ == ProgressOff ? -1 : progress_.render(ticks, running, steps);
+	if (step != progressStep_)
+	{
+	    const bool wasShowing = progressStep_ >= 0;
+	    progressStep_ = step;
+	    for (int i = 0; i < progressLeds_.size(); ++i)
+	    {
+		if (progressMode_ == ProgressRing || wasShowing)
+		{
+		    setLed(progressLeds_[i], progressMode_ == ProgressRing && i <= step);
+		}
+	    }
+	    if (step >= 0 && progressMode_ == ProgressDisplay && !tuning_)
+	    {
+		ledFrame_.setDisplay(step);
+	    }
+	    else if (engine.selectedLoop_ >= 0)
+	    {
+		selectLoop();
+	    }
+	    commitLeds();
+	}
+
+	if (progressMode_ != ProgressOff)
+	{
+	    const int wait = progress_.getMsUntilNextStep(ticks, running, steps);
+	    wheel_.scheduleIn(progressTimer_, wait < 0 ? 1000 : jmax(progressMs_, wait), now);
+	}
+    }
+
+    // everything registerLoops may have registered, in either update mode
+    void addUnregistrations(Engine& engine, OscBundleSender& bundle)
+    {
+	bundle.add(engine.packets_.allLoopsAutoUpdates(true));
+	bundle.add(engine.packets_.allLoopsChangeUpdates(true));
+	for (int i = 0; engine.adaptive_.isEnabled() && i < engine.loops_.size(); ++i)
+	{
+	    if (engine.adaptive_.isFast(i))
+	    {
+		bundle.add(engine.packets_.loopFastUpdates(i, true));
+	    }
+	}
+	bundle.add(engine.packets_.globalUpdates(true));
+	bundle.add(engine.packets_.tempoUpdates(true));
+	bundle.add(engine.packets_.positionUpdates(true));
+	addCycleRegistrations(engine, bundle, true);
+	OscPacket packet;
+	for (int id = 0; id < ControlMirror::maxControls; ++id)
+	{
+	    for (const bool isGlobal : { false, true })
+	    {
+		if ((((isGlobal ? engine.mirroredGlobalControls_ : engine.mirroredLoopControls_) >> id) & 1) != 0)
+		{
+		    engine.packets_.buildControlUpdates(packet, isGlobal ? SooperLooperControls::global : -1,
+							SooperLooperControls::getName(isGlobal, id), mirrorIntervalMs_, true);
+		    bundle.add(packet);
+		}
+	    }
+	}
+    }
+
+    // leave no subscriptions behind sending to a port nobody reads any more
+    void unregisterEngines()
+    {
+	for (auto* engine : engines_)
+	{
+	    if (engine->connected_)
+	    {
+		OscBundleSender bundle(engine->sender_);
+		addUnregistrations(*engine, bundle);
+	    }
+	    engine->sender_.flush();
+	}
+    }
+
+    // with change-only updates, the selected loop is reread more often than the
+    // rest and, with "bank", the loops off the board less often
+    void setPollIntervals(Engine& engine)
+    {
+	if (!changeUpdates_)
+	{
+	    return;
+	}
+	const uint32 now = time_.getMillisecondCounter();
+	for (int i = 0; i < engine.loops_.size(); ++i)
+	{
+	    engine.polls_.setInterval(i, i == engine.selectedLoop_ ? selectedPollMs_
+					 : engine.visibleLoops_[i] ? pollMs_ : hiddenPollMs_, now);
+	}
+	scheduleEngineCheck(engine, now);
+    }
+
+    // with "bank", the loops the inputs' loop pedals play on the active engine
+    // and every engine's selected loop; without it all of them
+    BigInteger getVisibleLoops(const Engine& engine) const
+    {
+	BigInteger visible;
+	const int numLoops = engine.loops_.size();
+	if (!bankUpdates_)
+	{
+	    visible.setRange(0, numLoops, true);
+	    return visible;
+	}
+
+	if (&engine == engines_[activeEngine_])
+	{
+	    visible = pedalBanks_.getCurrent().visible_;
+	    visible.setRange(numLoops, jmax(0, LoopStore::maxLoops - numLoops), false);
+	}
+	if (engine.loops_.contains(engine.selectedLoop_))
+	{
+	    visible.setBit(engine.selectedLoop_);
+	}
+	return visible;
+    }
+
+    // after a bank switch, the engine check or a new selected loop: with auto
+    // updates, loops coming onto the board get them (and are asked for their
+    // state) and the ones leaving go back to change updates only
+    void updateVisibleLoops(Engine& engine)
+    {
+	const BigInteger visible = getVisibleLoops(engine);
+	if (visible == engine.visibleLoops_)
+	{
+	    return;
+	}
+
+	if (engine.connected_ && engine.loopCount_ > 0 && !changeUpdates_)
+	{
+	    const OscPacketSender::QueryScope query(engine.sender_);
+	    OscBundleSender bundle(engine.sender_);
+	    for (int i = 0; i < engine.loops_.size(); ++i)
+	    {
+		if (visible[i] != engine.visibleLoops_[i])
+		{
+		    bundle.add(engine.packets_.loopAutoUpdates(i, !visible[i]));
+		    bundle.add(visible[i] ? engine.packets_.loopState(i) : engine.packets_.loopChangeUpdates(i, false));
+		}
+	    }
+	}
+	engine.visibleLoops_ = visible;
+	setPollIntervals(engine);
+    }
+
+    // "adaptive": loops going fast, or back to the updates registerLoops() gave them
+    void switchUpdateRates(Engine& engine, uint32 now)
+    {
+	const OscPacketSender::QueryScope query(engine.sender_);
+	OscBundleSender bundle(engine.sender_);
+	engine.adaptive_.forEachSwitch(engine.loops_.size(), now, [&] (int loop, bool fast) {
+	    bundle.add(engine.packets_.loopFastUpdates(loop, !fast));
+	    if (!fast && !changeUpdates_ && engine.visibleLoops_[loop])
+	    {
+		bundle.add(engine.packets_.loopAutoUpdates(loop, false));
+	    }
+	});
+    }
+
+    // rereads the states SooperLooper should have told us about, in case an update got lost
+    void pollLoops(Engine& engine, uint32 now)
+    {
+	const OscPacketSender::QueryScope query(engine.sender_);
+	OscBundleSender bundle(engine.sender_);
+	engine.polls_.forEachDue(engine.loops_.size(), now, [&] (int loop) {
+	    bundle.add(engine.packets_.loopState(loop));
+	});
+    }
+
+    void resetLoops(Engine& engine)
+    {
+	if (engine.loops_.reset(engine.loopCount_) < engine.loopCount_)
+	{
+	    std::cerr << "Only following the first " << LoopStore::maxLoops << " of " << engine.loopCount_ << " loops" << std::endl;
+	}
+	engine.predictions_.clear();
+	engine.deliveries_.clear();
+	engine.controls_.clear();
+    }
+
+    // (Re)initialisation without starting over: the loops that are still there
+    // keep their state and LEDs until their /ctrl says otherwise, the ones gone
+    // go dark and only the new ones are drawn, Off. The caller registers what's
+    // needed and the changes go out as one LED frame when the message is done.
+    void resyncLoops(Engine& engine, int numLoops)
+    {
+	LoopStore& loops = engine.loops_;
+	const int oldSize = loops.size();
+	const bool active = isActive(engine);
+	for (int i = jmax(0, numLoops); active && i < oldSize; ++i)
+	{
+	    updateLoopLedState(loops, i, Off);
+	}
+	if (loops.resize(numLoops) < numLoops)
+	{
+	    std::cerr << "Only following the first " << LoopStore::maxLoops << " of " << numLoops << " loops" << std::endl;
+	}
+	for (int i = oldSize; active && i < loops.size(); ++i)
+	{
+	    updateLoopLedState(loops, i, Off);
+	}
+	if (engine.handshake_.resized(loops.size(), time_.getMillisecondCounter()))
+	{
+	    handshakeFinished(engine);
+	}
+    }
+
+    // a snapshot from some other SooperLooper: its loops go dark before we start over
+    void discardSnapshot(Engine& engine)
+    {
+	if (!engine.restored_)
+	{
+	    return;
+	}
+	engine.restored_ = false;
+	if (isActive(engine))
+	{
+	    LoopStore& loops = engine.loops_;
+	    for (int i = 0; i < loops.size(); ++i)
+	    {
+		updateLoopLedState(loops, i, Off);
+	    }
+	}
+    }
+
+    // control thread, on its tick; only written out when something changed
+    void saveSnapshot()
+    {
+	SnapshotWriter& out = snapshot_.getWriter();
+	out.reset();
+	out.addInt(mode_);
+	out.addInt(activeEngine_);
+	out.addInt(LedChangeFilter::maxLeds);
+	for (int i = 0; i < LedChangeFilter::maxLeds; ++i)
+	{
+	    out.addByte(ledFrame_.getLed(i).on_ ? 1 : 0);
+	}
+	out.addInt(engines_.size());
+	for (auto* engine : engines_)
+	{
+	    out.addInt(engine->engineId_);
+	    out.addInt(engine->loopCount_);
+	    out.addInt(engine->selectedLoop_);
+	    out.addInt(engine->loops_.size());
+	    for (int i = 0; i < engine->loops_.size(); ++i)
+	    {
+		out.addByte(engine->loops_.getState(i));
+	    }
+	}
+	snapshot_.publish();
+    }
+
+    // Before the control thread starts, and before the snapshot (which knows
+    // better): every engine gets the session's loops, their packets built
+    // for when the /pingack comes, and the blink clock its tempo.
+    void preloadSession()
+    {
+	if (!session_.isLoaded())
+	{
+	    return;
+	}
+	const int numLoops = session_.getNumLoopers();
+	for (auto* engine : engines_)
+	{
+	    engine->sessionLoops_ = numLoops;
+	    engine->loopCount_ = numLoops;
+	    resetLoops(*engine);
+	    engine->arrivals_.resize(engine->loops_.size());
+	    engine->packets_.prepareLoops(engine->loops_.size());
+	}
+	if (session_.getTempo() > 0 && !isFollowingClock())
+	{
+	    blink_.setTempo(session_.getTempo());
+	}
+	std::cerr << "Preloaded " << numLoops << " loops at " << String(session_.getTempo(), 1) << " bpm from "
+		  << session_.getFile().getFullPathName() << std::endl;
+    }
+
+    // before the control thread starts: the LEDs come back as they were, the
+    // loops are checked again once their engine answers the ping
+    void restoreSnapshot()
+    {
+	MemoryBlock payload;
+	if (!snapshot_.load(payload))
+	{
+	    return;
+	}
+	SnapshotReader in(payload.getData(), payload.getSize());
+	mode_ = in.readInt() != 0 ? 20 : 0;
+	const int savedActive = in.readInt();
+	activeEngine_ = isPositiveAndBelow(savedActive, engines_.size()) ? savedActive : 0;
+	const int numLeds = in.readInt();
+	bool savedLeds[LedChangeFilter::maxLeds] = {};
+	for (int i = 0; i < numLeds; ++i)
+	{
+	    const bool on = in.readByte() != 0;
+	    if (i < LedChangeFilter::maxLeds)
+	    {
+		savedLeds[i] = on;
+	    }
+	}
+
+	const int numEngines = in.readInt();
+	for (int e = 0; e < numEngines; ++e)
+	{
+	    const int engineId = in.readInt();
+	    const int loopCount = in.readInt();
+	    const int selectedLoop = in.readInt();
+	    const int numLoops = in.readInt();
+	    if (e >= engines_.size() || numLoops < 0)
+	    {
+		for (int i = 0; i < numLoops; ++i)
+		{
+		    in.readByte();
+		}
+		continue;
+	    }
+
+	    Engine& engine = *engines_[e];
+	    engine.engineId_ = engineId;
+	    engine.loopCount_ = loopCount;
+	    engine.loops_.reset(numLoops);
+	    engine.selectedLoop_ = jmin(selectedLoop, engine.loops_.size() - 1);
+	    engine.restored_ = true;
+	    for (int i = 0; i < numLoops; ++i)
+	    {
+		const int state = (int8) in.readByte();
+		const LoopStates loopState = (state >= Unknown && state <= Paused) ? (LoopStates) state : Unknown;
+		if (e == activeEngine_)
+		{
+		    updateLoopLedState(engine.loops_, i, loopState);
+		}
+		else
+		{
+		    engine.loops_.setState(i, loopState);
+		}
+	    }
+	}
+
+	// the mode and aux LEDs as they were, the loops' ones are already set
+	const int numLoopLeds = activeEngine().loops_.size();
+	for (int i = numLoopLeds; i < LedChangeFilter::maxLeds; ++i)
+	{
+	    if (savedLeds[i] != ledFrame_.isOn(i))
+	    {
+		setLed(i, savedLeds[i]);
+	    }
+	}
+	if (activeEngine().selectedLoop_ >= 0)
+	{
+	    selectLoop();
+	}
+	commitLeds();
+	std::cerr << "Restored " << numLoopLeds << " loops from " << snapshot_.getFile().getFullPathName() << std::endl;
+    }
+
+    void handlePingAckMessage(const OSCMessage& message)
+    {
+	Engine& engine = *oscEngine_;
+	if (oscArrivalTicks_ != 0)
+	{
+	    latency_.record(LatencyStats::OscQueue, oscArrivalTicks_);
+	}
+	if (! message.isEmpty())
+	{
+	    const int previousId = engine.engineId_;
+	    const int previousLoops = engine.loopCount_;
+	    int i = 0;
+	    for (OSCArgument* arg = message.begin(); arg != message.end(); ++arg)
+	    {
+		switch (i)
+		{
+		    case 0:
+			if (arg->isString())
+			    engine.hostUrl_ = arg->getString();
+			break;
+		    case 1:
+			if (arg->isString())
+			    engine.version_ = arg->getString();
+			break;
+		    case 2:
+			if (arg->isInt32())
+			    engine.loopCount_ = arg->getInt32();
+			break;
+		    case 3:
+			if (arg->isInt32())
+			    engine.engineId_ = arg->getInt32();
+			break;
+		    default:
+			std::cerr << "Unexpected number of arguments for /pingack" << std::endl;
+		}
+		i++;
+	    }
+
+	    const uint32 now = time_.getMillisecondCounter();
+	    if (engine.handshake_.isAcknowledged() && engine.engineId_ == previousId && engine.loopCount_ == previousLoops)
+	    {
+		// a late answer to a ping that was sent again
+		engine.heartbeat_.heard(now);
+		return;
+	    }
+	    if (engine.handshake_.acknowledged(engine.loopCount_, now))
+	    {
+		handshakeFinished(engine);
+	    }
+	    if (engine.loopCount_ > 0 && engine.sessionLoops_ > 0 && engine.loopCount_ != engine.sessionLoops_)
+	    {
+		std::cerr << "SooperLooper has " << engine.loopCount_ << " loops, the session said " << engine.sessionLoops_ << std::endl;
+		engine.sessionLoops_ = 0;
+	    }
+	    if (engine.loopCount_ > 0)
+	    {
+		if (engine.restored_ && engine.engineId_ == previousId)
+		{
+		    // the same SooperLooper we saved, keep showing its loops until they answer
+		    engine.restored_ = false;
+		    if (engine.loops_.resize(engine.loopCount_) < engine.loopCount_)
+		    {
+			std::cerr << "Only following the first " << LoopStore::maxLoops << " of " << engine.loopCount_ << " loops" << std::endl;
+		    }
+		}
+		else
+		{
+		    discardSnapshot(engine);
+		    resyncLoops(engine, engine.loopCount_);
+		    engine.predictions_.clear();
+		    engine.controls_.clear();
+		}
+		registerLoops(engine, 0, engine.loops_.size(), true);
+	    }
+	    engine.heartbeat_.replied(now);
+	    journal_.record(EventJournal::PingAck, engine.index_, engine.loopCount_, engine.engineId_);
+	    startup_.reached(StartupTimes::FirstPingAck);
+	}
+    }
+
+    void handleHeartbeatMessage(const OSCMessage& message)
+    {
+	handleAsView(message, &loop4r_readApplication::handleHeartbeatView);
+    }
+
+    void handleHeartbeatView(const OscMessageView& message)
+    {
+	Engine& engine = *oscEngine_;
+	SooperLooperHeartbeat heartbeat;
+	if (!heartbeat.read(message))
+	{
+	    if (!message.isEmpty())
+	    {
+		std::cerr << "unrecognized format for heartbeat message." << std::endl;
+	    }
+	    return;
+	}
+	// both rarely change, so they're only copied when they do
+	if (engine.hostUrl_ != heartbeat.hostUrl_)
+	{
+	    engine.hostUrl_ = heartbeat.hostUrl_;
+	}
+	if (engine.version_ != heartbeat.version_)
+	{
+	    engine.version_ = heartbeat.version_;
+	}
+	const int numloops = heartbeat.numLoops_;
+	const int uid = heartbeat.engineId_;
+
+	if (uid != engine.engineId_) {
+	    // looper changed on us, reinitialize
+	    if (numloops > 0)
+	    {
+		// the new one has none of our registrations, so all of them go again
+		engine.loopCount_ = numloops;
+		discardSnapshot(engine);
+		resyncLoops(engine, numloops);
+		engine.predictions_.clear();
+		engine.controls_.clear();
+		registerLoops(engine, 0, engine.loops_.size(), true);
+	    }
+	}
+	else
+	{
+	    // check loopcount
+	    if (engine.loopCount_ != numloops)
+	    {
+		const int oldSize = engine.loops_.size();
+		engine.loopCount_ = numloops;
+		resyncLoops(engine, numloops);
+		if (engine.loops_.size() > oldSize)
+		{
+		    registerLoops(engine, oldSize, engine.loops_.size(), false);
+		}
+	    }
+	}
+	engine.heartbeat_.replied(time_.getMillisecondCounter());
+    }
+
+    void handleCtrlMessage(const OSCMessage& message)
+    {
+	handleAsView(message, &loop4r_readApplication::handleCtrlView);
+    }
+
+    // <prefix>/ctrl loop control value, loop -2 for the global controls
+    void handleCtrlView(const OscMessageView& message)
+    {
+	const SpanTrace::Scope span(&spans_, "handleCtrlMessage");
+	Engine& engine = *oscEngine_;
+	SooperLooperCtrl ctrl;
+	if (!ctrl.read(message))
+	{
+	    if (!message.isEmpty())
+	    {
+		std::cerr << "unrecognized format for ctrl message." << std::endl;
+	    }
+	    return;
+	}
+
+	startup_.reached(StartupTimes::FirstCtrl);
+	const int loopIndex = ctrl.loop_;
+	if (oscArrivalTicks_ != 0)
+	{
+	    latency_.record(LatencyStats::OscQueue, oscArrivalTicks_);
+	}
+	// the name's only looked at here, from here on it's the control's id
+	const int id = SooperLooperControls::find(loopIndex == SooperLooperControls::global, ctrl.control_);
+	mirrorControl(engine, loopIndex, id, ctrl.value_);
+	if (loopIndex == -2)
+	{
+	    // global control update
+	    if (id == SooperLooperControls::tempo)
+	    {
+		// with "follow" the blink clock has the MIDI clock's tempo already
+		if (isActive(engine) && !isFollowingBeat())
+		{
+		    blink_.setTempo(ctrl.value_);
+		}
+	    }
+	    else if (id == SooperLooperControls::selectedLoopNum)
+	    {
+		engine.selectedLoop_ = ctrl.value_;
+		journal_.record(EventJournal::LoopSelected, engine.index_, (int32) engine.selectedLoop_);
+		updateVisibleLoops(engine);
+		setPollIntervals(engine);
+		if (isActive(engine))
+		{
+		    selectLoop();
+		    if (progressMode_ != ProgressOff)
+		    {
+			restartProgress();
+		    }
+		}
+	    }
+	}
+	else if (loopIndex >= 0)
+	{
+	    if (id == SooperLooperControls::state)
+	    {
+		const LoopStates loopState = static_cast<LoopStates>((int) ctrl.value_);
+		if (isActive(engine) && loopIndex < LedChangeFilter::maxLeds && pendingCtrlTicks_[loopIndex] != 0)
+		{
+		    latency_.record(LatencyStats::PedalToCtrl, pendingCtrlTicks_[loopIndex]);
+		    if (oscArrivalTicks_ != 0)
+		    {
+			latency_.record(LatencyStats::PedalToCtrlArrival, pendingCtrlTicks_[loopIndex], oscArrivalTicks_);
+		    }
+		    pendingCtrlTicks_[loopIndex] = 0;
+		}
+		// a quantised note still waiting to go out has nothing to time yet;
+		// the round trip ends when the kernel had the answer, if it says
+		const int64 now = Time::getHighResolutionTicks();
+		const int64 arrived = oscArrivalTicks_ != 0 ? oscArrivalTicks_ : now;
+		if (isActive(engine) && loopIndex < LedChangeFilter::maxLeds && pendingSendTicks_[loopIndex] != 0 && arrived >= pendingSendTicks_[loopIndex])
+		{
+		    commandLatency_.add((int64) (Time::highResolutionTicksToSeconds(arrived - pendingSendTicks_[loopIndex]) * 1.0e6));
+		    pendingSendTicks_[loopIndex] = 0;
+		}
+		// a report from before SooperLooper saw the press mustn't undo the prediction
+		if (engine.predictions_.reported(loopIndex, loopState))
+		{
+		    setLoopState(engine, loopIndex, loopState);
+		}
+		engine.polls_.heard(loopIndex, time_.getMillisecondCounter());
+		engine.adaptive_.reported(loopIndex, loopState);
+		engine.deliveries_.reported(loopIndex, loopState, false, time_.getMillisecondCounter());
+		if (!changeUpdates_ && engine.visibleLoops_[loopIndex])
+		{
+		    engine.arrivals_.arrived(loopIndex, now);
+		}
+	    }
+	    engine.heartbeat_.heard(time_.getMillisecondCounter());
+	}
+    }
+
+    // <prefix>/pos loop "loop_pos" seconds, the selected loop's position for the blink clock
+    void handleReconcileMessage(const OSCMessage& message)
+    {
+	handleAsView(message, &loop4r_readApplication::handleReconcileView);
+    }
+
+    // <prefix>/reconcile loop "state" value, a "reconcile" round's answers:
+    // only a loop we have wrong is drawn again
+    void handleReconcileView(const OscMessageView& message)
+    {
+	Engine& engine = *oscEngine_;
+	engine.heartbeat_.heard(time_.getMillisecondCounter());
+	SooperLooperCtrl ctrl;
+	if (!ctrl.read(message) || SooperLooperControls::find(false, ctrl.control_) != SooperLooperControls::state)
+	{
+	    return;
+	}
+	const int loop = ctrl.loop_;
+	const LoopStates loopState = static_cast<LoopStates>((int) ctrl.value_);
+	if (engine.loops_.contains(loop) && engine.predictions_.reported(loop, loopState)
+	    && engine.loops_.getState(loop) != loopState)
+	{
+	    engine.reconciler_.diverged(time_.getMillisecondCounter());
+	    ++numDivergences_;
+	    setLoopState(engine, loop, loopState);
+	}
+    }
+
+    void handleDeliveryMessage(const OSCMessage& message)
+    {
+	handleAsView(message, &loop4r_readApplication::handleDeliveryView);
+    }
+
+    // <prefix>/delivery loop "state" value, the answer to "deliver"'s question
+    // about a loop a pedal's command seems not to have reached. It's as good
+    // as an update too
+    void handleDeliveryView(const OscMessageView& message)
+    {
+	Engine& engine = *oscEngine_;
+	const uint32 now = time_.getMillisecondCounter();
+	engine.heartbeat_.heard(now);
+	SooperLooperCtrl ctrl;
+	if (!ctrl.read(message) || SooperLooperControls::find(false, ctrl.control_) != SooperLooperControls::state)
+	{
+	    return;
+	}
+	const int loop = ctrl.loop_;
+	const LoopStates loopState = static_cast<LoopStates>((int) ctrl.value_);
+	if (engine.deliveries_.reported(loop, loopState, true, now))
+	{
+	    scheduleDeliveries(engine, now);
+	}
+	if (engine.loops_.contains(loop) && engine.predictions_.reported(loop, loopState)
+	    && engine.loops_.getState(loop) != loopState)
+	{
+	    setLoopState(engine, loop, loopState);
+	}
+    }
+
+    void handleStateMessage(const OSCMessage& message)
+    {
+	handleAsView(message, &loop4r_readApplication::handleStateView);
+    }
+
+    // <prefix>/state loop "state" value, the answers to the handshake's state
+    // queries: ticked off, then taken like any update
+    void handleStateView(const OscMessageView& message)
+    {
+	SooperLooperCtrl ctrl;
+	if (ctrl.read(message) && oscEngine_->handshake_.reported(ctrl.loop_, time_.getMillisecondCounter()))
+	{
+	    handshakeFinished(*oscEngine_);
+	}
+	handleCtrlView(message);
+    }
+
+    void handlePositionMessage(const OSCMessage& message)
+    {
+	handleAsView(message, &loop4r_readApplication::handlePositionView);
+    }
+
+    void handlePositionView(const OscMessageView& message)
+    {
+	SooperLooperCtrl position;
+	if (position.read(message) && isActive(*oscEngine_) && !isFollowingBeat())
+	{
+	    blink_.syncPosition(position.value_);
+	}
+	oscEngine_->heartbeat_.heard(time_.getMillisecondCounter());
+    }
+
+    void handleCycleMessage(const OSCMessage& message)
+    {
+	handleAsView(message, &loop4r_readApplication::handleCycleView);
+    }
+
+    // <prefix>/cycle loop loop_pos|cycle_len value, for the cycle tracker;
+    // only the active engine's loops are tracked
+    void handleCycleView(const OscMessageView& message)
+    {
+	SooperLooperCtrl ctrl;
+	if (ctrl.read(message) && isActive(*oscEngine_))
+	{
+	    const int64 ticks = Time::getHighResolutionTicks();
+	    const int id = SooperLooperControls::find(false, ctrl.control_);
+	    if (id == SooperLooperControls::loopPos)
+	    {
+		cycles_.sync(ctrl.loop_, ctrl.value_, ticks);
+	    }
+	    else if (id == SooperLooperControls::cycleLen)
+	    {
+		cycles_.setCycleLength(ctrl.loop_, ctrl.value_, ticks);
+	    }
+	    scheduleCycles(time_.getMillisecondCounter(), ticks);
+	}
+	oscEngine_->heartbeat_.heard(time_.getMillisecondCounter());
+    }
+
+    // the timer set for the next boundary any loop has coming
+    void scheduleCycles(uint32 now, int64 ticks)
+    {
+	const int64 next = cycles_.getNextBoundary();
+	if (next == 0)
+	{
+	    wheel_.cancel(cycleTimer_);
+	    return;
+	}
+	const double ms = Time::highResolutionTicksToSeconds(next - ticks) * 1000.0;
+	wheel_.scheduleIn(cycleTimer_, jmax(0, (int) std::ceil(ms)), now);
+    }
+
+    void emitCycles(uint32 now)
+    {
+	const int64 ticks = Time::getHighResolutionTicks();
+	cycles_.emitBoundaries(ticks);
+	scheduleCycles(now, ticks);
+    }
+
+    void resetCycles()
+    {
+	cycles_.reset();
+	wheel_.cancel(cycleTimer_);
+    }
+
+    // the selected loop's cycle starting is where the blink clock's beat is
+    void cycleBoundary(int loop, int64 ticks, int64 lateTicks) override
+    {
+	ignoreUnused(ticks);
+	if (blinkSync_ && !isFollowingBeat() && loop == activeEngine().selectedLoop_)
+	{
+	    blink_.syncPosition(Time::highResolutionTicksToSeconds(lateTicks));
+	}
+    }
+
+    // For the handlers written against views: a queued or replayed OSCMessage
+    // is encoded again, which for these short messages is cheap.
+    void handleAsView(const OSCMessage& message, void (loop4r_readApplication::*handler)(const OscMessageView&))
+    {
+	char buffer[OscPacket::maxSize];
+	OscMessageWriter writer(buffer, sizeof(buffer));
+	const bool complete = writer.write(message);
+	const OscMessageView view(buffer, complete && writer.ok() ? writer.size() : 0);
+	if (view.isValid())
+	{
+	    (this->*handler)(view);
+	}
+	else
+	{
+	    std::cerr << "unrecognized format for " << message.getAddressPattern().toString() << " message." << std::endl;
+	}
+    }
+
+    // scratch space for encoding one reply, given back once the event it
+    // answers has been handled
+    static OscMessageWriter makeReplyWriter(int capacity = OscSendThread::maxDatagramSize)
+    {
+	char* buffer = ScratchArena::get().allocateChars(capacity);
+	return OscMessageWriter(buffer, buffer != nullptr ? capacity : 0);
+    }
+
+    // the sender for a reply to "host port url ...", nullptr (and why on
+    // stderr) if the message isn't one or we can't connect
+    OscPacketSender* findReplySender(const OscMessageView& message, const char* what)
+    {
+	if (message.size() < 3 || !message.isString(0) || !message.isInt32(1) || !message.isString(2))
+	{
+	    std::cerr << "unrecognized format for " << what << " message." << std::endl;
+	    return nullptr;
+	}
+	OscPacketSender* sender = replySenders_.get(message.getString(0), message.getInt32(1));
+	if (sender == nullptr)
+	{
+	    std::cerr << "Error: could not connect to UDP " << message.getString(0) << ":" << message.getInt32(1) << std::endl;
+	}
+	return sender;
+    }
+
+    void handlePingMessage(const OSCMessage& message)
+    {
+	handleAsView(message, &loop4r_readApplication::handlePingView);
+    }
+
+    void handlePingView(const OscMessageView& message)
+    {
+	OscPacketSender* sender = findReplySender(message, "ping");
+	if (sender == nullptr)
+	{
+	    return;
+	}
+
+	char self[48];
+	std::snprintf(self, sizeof(self), "osc.udp://localhost:%d", oscReceivePort_);
+	OscMessageWriter reply(makeReplyWriter());
+	reply.begin(message.getString(2), "ssii").addString(self).addString(ProjectInfo::versionString)
+	    .addInt32(NUM_PEDAL_LEDS).addInt32((int) getuid());
+	if (! sender->send(reply.getData(), reply.size()))
+	{
+	    std::cerr << "Error: could not send to UDP " << message.getString(0) << ":" << message.getInt32(1) << std::endl;
+	}
+    }
+
+    void handleClockMessage(const OSCMessage& message)
+    {
+	handleAsView(message, &loop4r_readApplication::handleClockView);
+    }
+
+    // /loop4r/clock host port path t0 (two int32s): our time and beat for
+    // another loop4r_read's "netclock", 0bpm without a beat to give
+    void handleClockView(const OscMessageView& message)
+    {
+	OscPacketSender* sender = findReplySender(message, "clock");
+	if (sender == nullptr || message.size() < 5 || !message.isInt32(3) || !message.isInt32(4))
+	{
+	    return;
+	}
+
+	double beats = 0;
+	double bpm = 0;
+	const int64 now = Time::getHighResolutionTicks();
+	if (isFollowingBeat() || blink_.isRunning())
+	{
+	    const double ticksPerBeat = isFollowingJack() ? jackTransport_.getTicksPerBeat() : isFollowingClock() ? clock_.getTicksPerBeat()
+		: isFollowingNetClock() ? netClock_.getTicksPerBeat() : blink_.getTicksPerBeat();
+	    beats = isFollowingJack() ? jackTransport_.getBeats(now) : isFollowingClock() ? clock_.getBeats(now)
+		: isFollowingNetClock() ? netClock_.getBeats(now) : blink_.getBeats(now);
+	    bpm = ticksPerBeat > 0 ? 60.0 * (double) Time::getHighResolutionTicksPerSecond() / ticksPerBeat : 0;
+	}
+	const double whole = std::floor(beats);
+	const int64 t1 = NetworkClock::toMicros(now);
+	OscMessageWriter reply(makeReplyWriter());
+	reply.begin(message.getString(2), "iiiiiff").addInt32(message.getInt32(3)).addInt32(message.getInt32(4))
+	    .addInt32(NetworkClock::getHigh(t1)).addInt32(NetworkClock::getLow(t1))
+	    .addInt32((int32) whole).addFloat32((float) (beats - whole)).addFloat32((float) bpm);
+	if (sender->send(reply.getData(), reply.size()))
+	{
+	    ++numNetClockAnswers_;
+	}
+    }
+
+    void handleClockAnswerMessage(const OSCMessage& message)
+    {
+	handleAsView(message, &loop4r_readApplication::handleClockAnswerView);
+    }
+
+    // /loop4r/clock_answer t0 t1 beat fraction bpm, the leader's answer
+    void handleClockAnswerView(const OscMessageView& message)
+    {
+	const int64 t3 = NetworkClock::toMicros(Time::getHighResolutionTicks());
+	if (message.size() < 7 || !message.isInt32(0) || !message.isInt32(1) || !message.isInt32(2) || !message.isInt32(3)
+	    || !message.isInt32(4) || !message.isFloat32(5) || !message.isFloat32(6))
+	{
+	    std::cerr << "unrecognized format for clock answer message." << std::endl;
+	    return;
+	}
+	if (netClockHost_.isEmpty())
+	{
+	    return;
+	}
+	netClock_.answered(NetworkClock::join(message.getInt32(0), message.getInt32(1)),
+			   NetworkClock::join(message.getInt32(2), message.getInt32(3)), t3,
+			   message.getInt32(4) + (double) message.getFloat32(5), message.getFloat32(6));
+	followNetClock();
+    }
+
+    void handleTimeRequestMessage(const OSCMessage& message)
+    {
+	handleAsView(message, &loop4r_readApplication::handleTimeRequestView);
+    }
+
+    // /loop4r/time host port path t0 (two int32s): t0 back with when it came
+    // in and went out on our wall clock, for another host's "hostclock"
+    void handleTimeRequestView(const OscMessageView& message)
+    {
+	const int64 t1 = ClockOffset::getWallMicros();
+	OscPacketSender* sender = findReplySender(message, "time");
+	if (sender == nullptr || message.size() < 5 || !message.isInt32(3) || !message.isInt32(4))
+	{
+	    return;
+	}
+	OscMessageWriter reply(makeReplyWriter());
+	reply.begin(message.getString(2), "iiiiii").addInt32(message.getInt32(3)).addInt32(message.getInt32(4))
+	    .addInt32(ClockOffset::getHigh(t1)).addInt32(ClockOffset::getLow(t1));
+	const int64 t2 = ClockOffset::getWallMicros();
+	reply.addInt32(ClockOffset::getHigh(t2)).addInt32(ClockOffset::getLow(t2));
+	sender->send(reply.getData(), reply.size());
+    }
+
+    void handleTimeMessage(const OSCMessage& message)
+    {
+	handleAsView(message, &loop4r_readApplication::handleTimeView);
+    }
+
+    // <prefix>/time t0 t1 t2, the engine host's answer
+    void handleTimeView(const OscMessageView& message)
+    {
+	const int64 t3 = ClockOffset::getWallMicros();
+	for (int i = 0; i < 6; ++i)
+	{
+	    if (!message.isInt32(i))
+	    {
+		std::cerr << "unrecognized format for time message." << std::endl;
+		return;
+	    }
+	}
+	oscEngine_->clockOffset_.exchanged(ClockOffset::join(message.getInt32(0), message.getInt32(1)),
+					   ClockOffset::join(message.getInt32(2), message.getInt32(3)),
+					   ClockOffset::join(message.getInt32(4), message.getInt32(5)), t3);
+    }
+
+    // /loop4r/engine n shows engine n on the board
+    bool openGpioLeds()
+    {
+	if (gpioLeds_.isOpen())
+	{
+	    return true;
+	}
+	if (!gpioLeds_.open(gpioPins_))
+	{
+	    std::cerr << "Couldn't map /dev/gpiomem for the LED pins, using loop4r_leds" << std::endl;
+	    return false;
+	}
+	std::cerr << "Driving " << gpioPins_.size() << " LEDs from GPIO pins" << std::endl;
+	return true;
+    }
+
+    bool openSpiLeds()
+    {
+	if (spiLeds_.isOpen())
+	{
+	    return true;
+	}
+	if (!spiLeds_.open(spiDevice_, spiBytes_))
+	{
+	    std::cerr << "Couldn't open SPI device " << spiDevice_ << " for the LEDs, using loop4r_leds" << std::endl;
+	    return false;
+	}
+	std::cerr << "Shifting LEDs out on " << spiDevice_ << std::endl;
+	return true;
+    }
+
+    bool openDinLeds()
+    {
+	if (dinLeds_.isOpen())
+	{
+	    return true;
+	}
+	if (!dinLeds_.open(dinDevice_, channel_, dinBurst_))
+	{
+	    std::cerr << "Couldn't open MIDI device " << dinDevice_ << " for the LEDs, using loop4r_leds" << std::endl;
+	    return false;
+	}
+	std::cerr << "Sending LEDs down the DIN link on " << dinDevice_ << std::endl;
+	return true;
+    }
+
+    bool openLedPort()
+    {
+	if (ledPort_.isOpen())
+	{
+	    return true;
+	}
+	if (!ledPort_.open(ledPortDestination_, channel_))
+	{
+	    std::cerr << "Couldn't open the ALSA LED port" << (ledPortDestination_.isEmpty() ? String() : " to \"" + ledPortDestination_ + "\"") << ", using loop4r_leds" << std::endl;
+	    return false;
+	}
+	std::cerr << "Sending LEDs from ALSA port \"loop4r leds\"" << (ledPortDestination_.isEmpty() ? String() : " to \"" + ledPortDestination_ + "\"") << std::endl;
+	return true;
+    }
+
+    // "ledpat state pattern|default (beats)"; the loops in that state pick it
+    // up straight away
+    void setLedPattern(const StringArray& opts)
+    {
+	LoopStates loopState;
+	if (opts.size() < 2 || !LedPatternSet::parseState(opts[0], loopState))
+	{
+	    std::cerr << "Usage: ledpat state pattern|default (beats), state as SooperLooper names it" << std::endl;
+	    return;
+	}
+
+	if (opts[1].equalsIgnoreCase("default"))
+	{
+	    ledPatterns_.clear(loopState);
+	}
+	else
+	{
+	    LedPattern pattern;
+	    if (!LedPattern::compile(opts[1], opts.size() > 2 ? opts[2].getIntValue() : 1, pattern))
+	    {
+		std::cerr << "Bad LED pattern \"" << opts[1] << "\", expected dark, light, blink, fast or up to "
+			  << LedPattern::numSteps << " steps over 1-" << LedPattern::maxBeats << " beats" << std::endl;
+		return;
+	    }
+	    ledPatterns_.set(loopState, pattern);
+	    blink_.setPattern(LedPatternSet::idForState(loopState), pattern);
+	}
+	updateLoops();
+    }
+
+    // resend every LED and the display, e.g. after switching where they go
+    void redrawLeds()
+    {
+	ledChanges_.invalidate();
+	const int numLeds = getNumLeds();
+	for (int i = 0; i < numLeds; ++i)
+	{
+	    setLed(i, ledFrame_.isOn(i));
+	}
+	if (activeEngine().selectedLoop_ >= 0)
+	{
+	    selectLoop();
+	}
+    }
+
+    // /loop4r/led_output pipe|alsa|plugin|gpio|spi|din switches between
+    // loop4r_leds, our own ALSA port, the plugin "lplug" loaded and the pins,
+    // bus or MIDI link given with "gpio", "spi" or "din"
+    void handleLedOutputMessage(const OSCMessage& message)
+    {
+	if (message.size() < 1 || !message[0].isString())
+	{
+	    std::cerr << "unrecognized format for led_output message." << std::endl;
+	    return;
+	}
+
+	const String output = message[0].getString();
+	if (output == "alsa")
+	{
+	    if (!openLedPort())
+	    {
+		return;
+	    }
+	    ledOutput_.setSink(&ledPort_);
+	}
+	else if (output == "gpio" || output == "spi")
+	{
+	    if (!(output == "gpio" ? openGpioLeds() : openSpiLeds()))
+	    {
+		return;
+	    }
+	    ledOutput_.setSink(output == "gpio" ? static_cast<LedCommandSink*>(&gpioLeds_) : &spiLeds_);
+	}
+	else if (output == "din")
+	{
+	    if (!openDinLeds())
+	    {
+		return;
+	    }
+	    ledOutput_.setSink(&dinLeds_);
+	}
+	else if (output == "plugin")
+	{
+	    if (!ledPlugin_.isLoaded())
+	    {
+		std::cerr << "No LED plugin loaded" << std::endl;
+		return;
+	    }
+	    ledOutput_.setSink(&ledPlugin_);
+	}
+	else if (output == "pipe")
+	{
+	    ledOutput_.setSink(nullptr);
+	}
+	else
+	{
+	    std::cerr << "Unknown LED output \"" << output << "\", expected pipe, alsa, plugin, gpio, spi or din" << std::endl;
+	    return;
+	}
+	redrawLeds();
+    }
+
+    void handleEngineMessage(const OSCMessage& message)
+    {
+	if (message.size() < 1 || !message[0].isInt32())
+	{
+	    std::cerr << "unrecognized format for engine message." << std::endl;
+	    return;
+	}
+	selectEngine(message[0].getInt32());
+    }
+
+    // /loop4r/engines host port url, answered with one
+    // "url index port connected srtt rttvar timeout pings replies reconnects" per engine (times in ms)
+    void handleEnginesMessage(const OSCMessage& message)
+    {
+	if (message.size() < 3 || !message[0].isString() || !message[1].isInt32() || !message[2].isString())
+	{
+	    std::cerr << "unrecognized format for engines message." << std::endl;
+	    return;
+	}
+
+	const String host = message[0].getString();
+	const int port = message[1].getInt32();
+	const String url = message[2].getString();
+
+	OscPacketSender* sender = replySenders_.get(host.toRawUTF8(), port);
+	if (sender == nullptr)
+	{
+	    std::cerr << "Error: could not connect to UDP " << host << ":" << port << std::endl;
+	    return;
+	}
+
+	OscMessageWriter reply(makeReplyWriter());
+	for (auto* engine : engines_)
+	{
+	    const HeartbeatMonitor& heartbeat = engine->heartbeat_;
+	    reply.begin(url.toRawUTF8(), "iiiffiiii")
+		.addInt32(engine->index_)
+		.addInt32(engine->sendPort_)
+		.addInt32(engine->connected_ ? 1 : 0)
+		.addFloat32((float) heartbeat.getSmoothedRttMs())
+		.addFloat32((float) heartbeat.getRttVarianceMs())
+		.addInt32(heartbeat.getTimeoutMs())
+		.addInt32((int) heartbeat.getNumPings())
+		.addInt32((int) heartbeat.getNumReplies())
+		.addInt32((int) heartbeat.getNumReconnects());
+	    sender->send(reply.getData(), reply.size());
+	}
+    }
+
+    // one of "deliver"'s counts over all the engines
+    int64 sumDeliveries(int64 (CommandDelivery::*count)() const) const
+    {
+	int64 sum = 0;
+	for (auto* engine : engines_)
+	{
+	    sum += (engine->deliveries_.*count)();
+	}
+	return sum;
+    }
+
+    void dumpEngineStats(std::ostream& out)
+    {
+	for (auto* engine : engines_)
+	{
+	    const HeartbeatMonitor& heartbeat = engine->heartbeat_;
+	    out << "engine " << engine->index_ << " (port " << engine->sendPort_ << ")"
+		<< "  rtt " << String(heartbeat.getSmoothedRttMs(), 1) << "ms +/- " << String(heartbeat.getRttVarianceMs(), 1) << "ms"
+		<< "  timeout " << heartbeat.getTimeoutMs() << "ms"
+		<< "  pings " << heartbeat.getNumPings() << "  replies " << heartbeat.getNumReplies()
+		<< "  reconnects " << heartbeat.getNumReconnects() << std::endl;
+	    if (predictLoops_)
+	    {
+		const LoopPredictor& predictions = engine->predictions_;
+		out << "engine " << engine->index_ << " predictions " << predictions.getNumPredictions()
+		    << "  confirmed " << predictions.getNumConfirmed() << "  mispredicted " << predictions.getNumMispredicted()
+		    << "  expired " << predictions.getNumExpired() << std::endl;
+	    }
+	    engine->arrivals_.dump(out, "engine " + String(engine->index_));
+	}
+    }
+
+    // /loop4r/stats host port url (latency|metrics|arrivals|all), answered
+    // with one "url stage count p50 p99 max" per stage (times in ms) for the
+    // latency, the default, one "url name value" per sample for the metrics,
+    // the name being the Prometheus one with its labels, and one
+    // "url engine loop count p50 p99 max missed" per loop for the gaps between
+    // its auto-updates
+    void handleStatsMessage(const OSCMessage& message)
+    {
+	if (message.size() < 3 || !message[0].isString() || !message[1].isInt32() || !message[2].isString())
+	{
+	    std::cerr << "unrecognized format for stats message." << std::endl;
+	    return;
+	}
+
+	const String host = message[0].getString();
+	const int port = message[1].getInt32();
+	const String url = message[2].getString();
+
+	OscPacketSender* sender = replySenders_.get(host.toRawUTF8(), port);
+	if (sender == nullptr)
+	{
+	    std::cerr << "Error: could not connect to UDP " << host << ":" << port << std::endl;
+	    return;
+	}
+
+	OscMessageWriter reply(makeReplyWriter());
+	const String what = message.size() > 3 && message[3].isString() ? message[3].getString() : String("latency");
+	if (what == "latency" || what == "all")
+	{
+	    for (int i = 0; i < LatencyStats::numStages; ++i)
+	    {
+		const LatencyStats::Stage stage = (LatencyStats::Stage) i;
+		const LatencyHistogram& histogram = latency_.get(stage);
+		reply.begin(url.toRawUTF8(), "sifff")
+		    .addString(LatencyStats::getStageName(stage))
+		    .addInt32((int) histogram.getCount())
+		    .addFloat32((float) (histogram.getPercentileMicros(50) / 1000.0))
+		    .addFloat32((float) (histogram.getPercentileMicros(99) / 1000.0))
+		    .addFloat32((float) (histogram.getMaxMicros() / 1000.0));
+		sender->send(reply.getData(), reply.size());
+	    }
+	}
+	if (what == "metrics" || what == "all")
+	{
+	    metrics_.forEachSample([&] (const String& name, const String& labels, const String&, bool, int64 value)
+				   {
+				       const String sample = labels.isEmpty() ? name : name + "{" + labels + "}";
+				       reply.begin(url.toRawUTF8(), "si").addString(sample.toRawUTF8()).addInt32((int) value);
+				       sender->send(reply.getData(), reply.size());
+				   });
+	}
+	if (what == "clocks" || what == "all")
+	{
+	    const int64 now = ClockOffset::getWallMicros();
+	    for (auto* engine : engines_)
+	    {
+		const ClockOffset& offset = engine->clockOffset_;
+		const bool locked = hostClockPort_ > 0 && offset.isLocked(now, 10.0 * engine->heartbeat_.getPingInterval() * 1000.0);
+		reply.begin(url.toRawUTF8(), "iifff")
+		    .addInt32(engine->index_)
+		    .addInt32(locked ? 1 : 0)
+		    .addFloat32((float) (offset.getOffsetMicros(now) / 1000.0))
+		    .addFloat32((float) (offset.getErrorBoundMicros() / 1000.0))
+		    .addFloat32((float) offset.getDriftPpm());
+		sender->send(reply.getData(), reply.size());
+	    }
+	}
+	if (what == "arrivals" || what == "all")
+	{
+	    for (auto* engine : engines_)
+	    {
+		const UpdateArrivals& arrivals = engine->arrivals_;
+		for (int i = 0; i < arrivals.size(); ++i)
+		{
+		    const IntervalHistogram& gaps = arrivals.getGaps(i);
+		    reply.begin(url.toRawUTF8(), "iiifffi")
+			.addInt32(engine->index_)
+			.addInt32(i)
+			.addInt32((int) gaps.getCount())
+			.addFloat32((float) (gaps.getPercentileMicros(50) / 1000.0))
+			.addFloat32((float) (gaps.getPercentileMicros(99) / 1000.0))
+			.addFloat32((float) (gaps.getMaxMicros() / 1000.0))
+			.addInt32((int) arrivals.getNumMissed(i));
+		    sender->send(reply.getData(), reply.size());
+		}
+	    }
+	}
+    }
+
+    // Replies with the LEDs in one message so the client never sees half a
+    // frame: "url i:selected_loop i:number_of_leds b:leds i:version i:full",
+    // the blob holding index, on, timer and state as a byte each per LED. With
+    // since >= 0 only the LEDs changed after that version are in the blob,
+    // unless the filter can't tell (full is 1 then).
+    void sendLedFrame(OscPacketSender& sender, const OscMessageView& message, int since)
+    {
+	const bool full = since < 0 || !ledChanges_.hasChangesSince(since);
+	const int numLeds = getNumLeds();
+	uint8* const leds = static_cast<uint8*>(ScratchArena::get().allocate((size_t) numLeds * 4, 4));
+	if (leds == nullptr)
+	{
+	    return;
+	}
+	uint8* led = leds;
+	for (int i = 0; i < numLeds; ++i)
+	{
+	    if (full || ledChanges_.getChangedAt(i) > since)
+	    {
+		const LedFrameBuffer::Led& shown = ledFrame_.getLed(i);
+		led[0] = (uint8) i;
+		led[1] = shown.on_ ? 1 : 0;
+		led[2] = shown.timer_;
+		led[3] = shown.state_;
+		led += 4;
+	    }
+	}
+
+	OscMessageWriter reply(makeReplyWriter(OscSendThread::maxDatagramSize + numLeds * 4));
+	reply.begin(message.getString(2), "iibii")
+	    .addInt32(ledFrame_.getDisplay())
+	    .addInt32(numLeds)
+	    .addBlob(leds, (int) (led - leds))
+	    .addInt32(ledChanges_.getVersion())
+	    .addInt32(full ? 1 : 0);
+	if (! sender.send(reply.getData(), reply.size()))
+	{
+	    std::cerr << "Error: could not send to UDP " << message.getString(0) << ":" << message.getInt32(1) << std::endl;
+	}
+    }
+
+    void handleSnapshotMessage(const OSCMessage& message)
+    {
+	handleAsView(message, &loop4r_readApplication::handleSnapshotView);
+    }
+
+    // /loop4r/snapshot host port url
+    void handleSnapshotView(const OscMessageView& message)
+    {
+	if (OscPacketSender* sender = findReplySender(message, "snapshot"))
+	{
+	    sendLedFrame(*sender, message, -1);
+	}
+    }
+
+    void handleChangesMessage(const OSCMessage& message)
+    {
+	handleAsView(message, &loop4r_readApplication::handleChangesView);
+    }
+
+    // /loop4r/changes host port url version, what changed since the client's
+    // version. The pushed /led and /display carry the version too, so a
+    // client that sees a gap can ask for the changes since its last one.
+    void handleChangesView(const OscMessageView& message)
+    {
+	if (message.size() >= 3 && !message.isInt32(3))
+	{
+	    std::cerr << "unrecognized format for changes message." << std::endl;
+	    return;
+	}
+	if (OscPacketSender* sender = findReplySender(message, "changes"))
+	{
+	    sendLedFrame(*sender, message, message.getInt32(3));
+	}
+    }
+
+    void handleLedsMessage(const OSCMessage& message)
+    {
+	handleAsView(message, &loop4r_readApplication::handleLedsView);
+    }
+
+    void handleLedsView(const OscMessageView& message)
+    {
+	OscPacketSender* sender = findReplySender(message, "leds");
+	if (sender == nullptr)
+	{
+	    return;
+	}
+
+	OscMessageWriter reply(makeReplyWriter());
+	const int numLeds = getNumLeds();
+	for (int i = 0; i < numLeds; ++i)
+	{
+	    const LedFrameBuffer::Led& led = ledFrame_.getLed(i);
+	    reply.begin(message.getString(2), "iiii").addInt32(i).addInt32(led.on_ ? 1 : 0)
+		.addInt32((int) led.timer_).addInt32((int) led.state_);
+	    sender->send(reply.getData(), reply.size());
+	}
+    }
+
+    void handleDisplayMessage(const OSCMessage& message)
+    {
+	handleAsView(message, &loop4r_readApplication::handleDisplayView);
+    }
+
+    void handleDisplayView(const OscMessageView& message)
+    {
+	OscPacketSender* sender = findReplySender(message, "display");
+	if (sender == nullptr)
+	{
+	    return;
+	}
+
+	OscMessageWriter reply(makeReplyWriter());
+	reply.begin("/display", "i").addInt32(ledFrame_.getDisplay());
+	sender->send(reply.getData(), reply.size());
+    }
+
+    // /loop4r/register_auto_update host port (lease seconds) (leds) (updates),
+    // without a lease the subscription lasts until
+    // /loop4r/unregister_auto_update host port. leds is a mask of the LEDs
+    // shown, bit n for loop n's (bit 31 for 31 and up), updates one of
+    // 1 /led, 2 /display and 4 /tuner; both are everything when left out,
+    // 0 for no lease if only they are wanted. On the local socket it's the
+    // sender that's subscribed, host and port can be left out:
+    // /loop4r/register_auto_update (lease seconds) (leds) (updates).
+    void handleRegisterAutoUpdateMessage(const OSCMessage& message, bool unreg)
+    {
+	if (localPeer_ != nullptr)
+	{
+	    if (unreg)
+	    {
+		ledSubscribers_.unsubscribeLocal(*localPeer_);
+		return;
+	    }
+	    const int lease = message.size() > 0 && message[0].isString() ? 2 : 0;
+	    const int leaseMs = message.size() > lease && message[lease].isInt32() ? jmax(0, message[lease].getInt32()) * 1000 : 0;
+	    if (!ledSubscribers_.subscribeLocal(*localPeer_, leaseMs, parseUpdateFilter(message, lease + 1)))
+	    {
+		std::cerr << "Error: could not subscribe local client " << localPeer_->getName() << " to LED updates" << std::endl;
+	    }
+	    return;
+	}
+	if (message.size() < 2 || !message[0].isString() || !message[1].isInt32())
+	{
+	    return;
+	}
+
+	const String host = message[0].getString();
+	const int port = message[1].getInt32();
+	if (unreg)
+	{
+	    ledSubscribers_.unsubscribe(host, port);
+	    return;
+	}
+
+	const int leaseMs = message.size() > 2 && message[2].isInt32() ? jmax(0, message[2].getInt32()) * 1000 : 0;
+	if (!ledSubscribers_.subscribe(host, port, leaseMs, parseUpdateFilter(message, 3)))
+	{
+	    std::cerr << "Error: could not subscribe UDP " << host << ":" << port << " to LED updates" << std::endl;
+	}
+    }
+
+    // the leds and updates masks from first on, anything missing is everything
+    static LedSubscribers::Filter parseUpdateFilter(const OSCMessage& message, int first)
+    {
+	LedSubscribers::Filter filter;
+	if (message.size() > first && message[first].isInt32())
+	{
+	    filter.leds_ = (uint32) message[first].getInt32();
+	}
+	if (message.size() > first + 1 && message[first + 1].isInt32())
+	{
+	    filter.updates_ = message[first + 1].getInt32() & LedSubscribers::AllUpdates;
+	}
+	return filter;
+    }
+
+    void writeSpans()
+    {
+	if (spansFile_ == File())
+	{
+	    std::cerr << "No spans recorded, start them with spans" << std::endl;
+	    return;
+	}
+	const int numWritten = spans_.write(spansFile_);
+	if (numWritten < 0)
+	{
+	    std::cerr << "Couldn't write spans to " << spansFile_.getFullPathName() << std::endl;
+	}
+	else
+	{
+	    std::cerr << "Spans: " << numWritten << " written to " << spansFile_.getFullPathName() << std::endl;
+	}
+    }
+
+    // All of these are read on the metrics server's thread, so only atomics
+    // and the queues' own counts
+    void registerMetrics()
+    {
+	metrics_.addGauge("loop4r_led_updates_total", "result=\"sent\"", "LED updates sent or suppressed as unchanged",
+			  [this] { return ledChanges_.getNumSent(); }, true);
+	metrics_.addGauge("loop4r_led_updates_total", "result=\"suppressed\"", "LED updates sent or suppressed as unchanged",
+			  [this] { return ledChanges_.getNumSuppressed(); }, true);
+	metrics_.addGauge("loop4r_midi_out_total", "", "MIDI messages handed to the outputs",
+			  [this] { return midiStage_.getNumMessages(); }, true);
+	metrics_.addGauge("loop4r_led_stream_clients", "", "TCP clients of the LED stream",
+			  [this] { return (int64) ledStream_.getNumClients(); });
+	metrics_.addGauge("loop4r_led_stream_messages_total", "", "LED and display messages sent to the LED stream's clients",
+			  [this] { return ledStream_.getNumSent(); }, true);
+	metrics_.addGauge("loop4r_queue_depth", "queue=\"osc_send\"", "Entries waiting in a queue",
+			  [this] { return (int64) oscSendThread_.getNumQueued(); });
+	metrics_.addGauge("loop4r_osc_dropped_total", "", "Datagrams the kernel dropped on the OSC receive socket for want of buffer space",
+			  [this] { return numOscDropped_.load(); }, true);
+	metrics_.addGauge("loop4r_selected_loop", "", "The active engine's selected loop, -1 for none",
+			  [this] { return readPublishedState([] (const PublishedState& state) { return (int64) state.selectedLoop_; }); });
+	metrics_.addGauge("loop4r_loops", "", "Loops the active engine has",
+			  [this] { return readPublishedState([] (const PublishedState& state) { return (int64) state.numLoops_; }); });
+	metrics_.addGauge("loop4r_leds_lit", "", "LEDs on as of the last commit",
+			  [this] { return readPublishedState([] (const PublishedState& state) { return (int64) state.numLit_; }); });
+	metrics_.addGauge("loop4r_osc_rejected_total", "reason=\"malformed\"", "OSC datagrams and messages turned away unhandled: malformed, for an address nothing handles, from a source over its rate or blocked",
+			  [this] { return oscGate_.getNumRejected(OscGate::Malformed); }, true);
+	metrics_.addGauge("loop4r_osc_rejected_total", "reason=\"unknown\"", "OSC datagrams and messages turned away unhandled: malformed, for an address nothing handles, from a source over its rate or blocked",
+			  [this] { return oscGate_.getNumRejected(OscGate::UnknownAddress); }, true);
+	metrics_.addGauge("loop4r_osc_rejected_total", "reason=\"rate\"", "OSC datagrams and messages turned away unhandled: malformed, for an address nothing handles, from a source over its rate or blocked",
+			  [this] { return oscGate_.getNumRejected(OscGate::RateLimited); }, true);
+	metrics_.addGauge("loop4r_osc_rejected_total", "reason=\"blocked\"", "OSC datagrams and messages turned away unhandled: malformed, for an address nothing handles, from a source over its rate or blocked",
+			  [this] { return oscGate_.getNumRejected(OscGate::Blocked); }, true);
+	metrics_.addGauge("loop4r_local_datagrams_total", "result=\"received\"", "Datagrams on the local socket received, refused as from another user, or received and dropped with the queue full",
+			  [this] { return localSocket_.getNumReceived(); }, true);
+	metrics_.addGauge("loop4r_local_datagrams_total", "result=\"refused\"", "Datagrams on the local socket received, refused as from another user, or received and dropped with the queue full",
+			  [this] { return localSocket_.getNumRejected(); }, true);
+	metrics_.addGauge("loop4r_local_datagrams_total", "result=\"dropped\"", "Datagrams on the local socket received, refused as from another user, or received and dropped with the queue full",
+			  [this] { return localSocket_.getNumDropped(); }, true);
+	metrics_.addGauge("loop4r_wakeups_total", "", "Times the threads running now have slept and been woken",
+			  [] { return ThreadAccounting::countWakeups(ThreadAccounting::sampleWakeups()); }, true);
+	metrics_.addGauge("loop4r_shed_level", "", "What's being left out to catch up: 0 nothing, 1 the verbose log, 2 and OSC display pushes, 3 and passthrough controllers",
+			  [this] { return (int64) overload_.getLevel(); });
+	metrics_.addGauge("loop4r_shed_total", "what=\"display\"", "Display pushes and passthrough controllers left out to catch up",
+			  [this] { return overload_.getNumShed(OverloadGuard::ShedDisplays); }, true);
+	metrics_.addGauge("loop4r_shed_total", "what=\"passthrough\"", "Display pushes and passthrough controllers left out to catch up",
+			  [this] { return overload_.getNumShed(OverloadGuard::ShedPassthrough); }, true);
+	metrics_.addGauge("loop4r_midi_overruns_total", "", "Times the sequencer threw MIDI input away because we didn't read it in time",
+			  [this] { return sequencerInput_.getNumOverruns(); }, true);
+	metrics_.addGauge("loop4r_midi_feedback_cuts_total", "", "Times passthrough was cut for a MIDI feedback loop",
+			  [this] { return feedback_.getNumCuts(); }, true);
+	metrics_.addGauge("loop4r_pedal_commands_total", "result=\"tracked\"", "Loop pedal commands \"deliver\" followed, by what became of them",
+			  [this] { return sumDeliveries(&CommandDelivery::getNumTracked); }, true);
+	metrics_.addGauge("loop4r_pedal_commands_total", "result=\"queried\"", "Loop pedal commands \"deliver\" followed, by what became of them",
+			  [this] { return sumDeliveries(&CommandDelivery::getNumQueries); }, true);
+	metrics_.addGauge("loop4r_pedal_commands_total", "result=\"retransmitted\"", "Loop pedal commands \"deliver\" followed, by what became of them",
+			  [this] { return sumDeliveries(&CommandDelivery::getNumRetransmits); }, true);
+	metrics_.addGauge("loop4r_pedal_commands_total", "result=\"recovered\"", "Loop pedal commands \"deliver\" followed, by what became of them",
+			  [this] { return sumDeliveries(&CommandDelivery::getNumRecovered); }, true);
+	metrics_.addGauge("loop4r_pedal_commands_total", "result=\"update_lost\"", "Loop pedal commands \"deliver\" followed, by what became of them",
+			  [this] { return sumDeliveries(&CommandDelivery::getNumUpdatesLost); }, true);
+	metrics_.addGauge("loop4r_pedal_commands_total", "result=\"given_up\"", "Loop pedal commands \"deliver\" followed, by what became of them",
+			  [this] { return sumDeliveries(&CommandDelivery::getNumGivenUp); }, true);
+	metrics_.addGauge("loop4r_reconcile_divergences_total", "", "Loops a reconcile round found in a different state than we had",
+			  [this] { return numDivergences_; }, true);
+	metrics_.addGauge("loop4r_queue_depth", "queue=\"pedal\"", "Entries waiting in a queue",
+			  [this] { return (int64) pedalEvents_.size(); });
+	metrics_.addGauge("loop4r_queue_depth", "queue=\"osc\"", "Entries waiting in a queue",
+			  [this] { return (int64) oscEvents_.size(); });
+	metrics_.addGauge("loop4r_queue_depth", "queue=\"led\"", "Entries waiting in a queue",
+			  [this] { return (int64) ledOutput_.getNumQueued(); });
+	metrics_.addGauge("loop4r_queue_depth", "queue=\"beat\"", "Entries waiting in a queue",
+			  [this] { return (int64) beatScheduler_.getNumPending(); });
+	metrics_.addGauge("loop4r_startup_ready_milliseconds", "", "Time from exec to the first LED frame drawn with every loop's state known, 0 until then",
+			  [this] { return startup_.hasReached(StartupTimes::FirstCorrectFrame)
+				   ? (int64) (jmax(0.0, startup_.getBeforeStartMs()) + startup_.getMs(StartupTimes::FirstCorrectFrame)) : 0; });
+	metrics_.addSamples("loop4r_startup_milliseconds", "Time from exec to each step of the startup reached so far",
+			    [this] (const Metrics::Emit& emit)
+			    {
+				for (int i = 0; i < StartupTimes::numMilestones; ++i)
+				{
+				    const StartupTimes::Milestone milestone = (StartupTimes::Milestone) i;
+				    if (startup_.hasReached(milestone))
+				    {
+					emit("step=\"" + String(StartupTimes::getMilestoneName(milestone)) + "\"",
+					     (int64) (jmax(0.0, startup_.getBeforeStartMs()) + startup_.getMs(milestone)));
+				    }
+				}
+			    });
+	metrics_.addSamples("loop4r_latency_microseconds", "Pedal to note, ctrl and LED latency and the OSC queueing, by percentile, to 100us",
+			    [this] (const Metrics::Emit& emit)
+			    {
+				for (int i = 0; i < LatencyStats::numStages; ++i)
+				{
+				    const LatencyHistogram& histogram = latency_.get((LatencyStats::Stage) i);
+				    if (histogram.getCount() > 0)
+				    {
+					const String stage = "stage=\"" + String(LatencyStats::getStageName((LatencyStats::Stage) i)) + "\",quantile=";
+					emit(stage + "\"0.5\"", histogram.getPercentileMicros(50));
+					emit(stage + "\"0.99\"", histogram.getPercentileMicros(99));
+				    }
+				}
+			    });
+	metrics_.addSamples("loop4r_span_microseconds_total", "Time in each kind of span while \"spans\" records",
+			    [this] (const Metrics::Emit& emit)
+			    {
+				spans_.forEachTotal([&emit] (const char* name, int64, double seconds)
+						    { emit("span=\"" + String(name) + "\"", (int64) (seconds * 1.0e6)); });
+			    }, true);
+	metrics_.addSamples("loop4r_spans_total", "Spans of each kind while \"spans\" records",
+			    [this] (const Metrics::Emit& emit)
+			    {
+				spans_.forEachTotal([&emit] (const char* name, int64 count, double)
+						    { emit("span=\"" + String(name) + "\"", count); });
+			    }, true);
+	// only the cells that have seen something, most never will
+	metrics_.addSamples("loop4r_loop_state_milliseconds_total", "Time loops have spent in each state, counted when they leave it",
+			    [this] (const Metrics::Emit& emit)
+			    {
+				for (int loop = 0; loop < LoopStore::maxLoops; ++loop)
+				{
+				    for (int i = 0; i < LoopStateStats::numStates; ++i)
+				    {
+					const LoopStates state = (LoopStates) (i + Unknown);
+					const int64 ms = loopStates_.getDwellMs(loop, state);
+					if (ms > 0)
+					{
+					    emit("loop=\"" + String(loop) + "\",state=\"" + LedPatternSet::getStateName(state) + "\"", ms);
+					}
+				    }
+				}
+			    }, true);
+	metrics_.addSamples("loop4r_loop_transitions_total", "Times a loop went from one state to another, all loops together",
+			    [this] (const Metrics::Emit& emit)
+			    {
+				for (int i = 0; i < LoopStateStats::numStates; ++i)
+				{
+				    for (int j = 0; j < LoopStateStats::numStates; ++j)
+				    {
+					const LoopStates from = (LoopStates) (i + Unknown);
+					const LoopStates to = (LoopStates) (j + Unknown);
+					const int64 count = loopStates_.getNumTransitions(from, to);
+					if (count > 0)
+					{
+					    emit("from=\"" + String(LedPatternSet::getStateName(from)) + "\",to=\""
+						 + LedPatternSet::getStateName(to) + "\"", count);
+					}
+				    }
+				}
+			    }, true);
+    }
+
+    void registerOscHandlers()
+    {
+	// address, handler, logged at the normal level (verbose otherwise)
+	oscDispatcher_.add("/ctrl",                           &loop4r_readApplication::handleCtrlMessage,              true);
+	oscDispatcher_.add("/cycle",                          &loop4r_readApplication::handleCycleMessage,             false);
+	oscDispatcher_.add("/delivery",                       &loop4r_readApplication::handleDeliveryMessage,          false);
+	oscDispatcher_.add("/heartbeat",                      &loop4r_readApplication::handleHeartbeatMessage,         false);
+	oscDispatcher_.add("/time",                           &loop4r_readApplication::handleTimeMessage,              false);
+	oscDispatcher_.add("/pingack",                        &loop4r_readApplication::handlePingAckMessage,           true);
+	oscDispatcher_.add("/pos",                            &loop4r_readApplication::handlePositionMessage,          false);
+	oscDispatcher_.add("/reconcile",                      &loop4r_readApplication::handleReconcileMessage,         false);
+	oscDispatcher_.add("/state",                          &loop4r_readApplication::handleStateMessage,             true);
+	oscDispatcher_.addView("/ctrl",                       &loop4r_readApplication::handleCtrlView,                 true);
+	oscDispatcher_.addView("/cycle",                      &loop4r_readApplication::handleCycleView,                false);
+	oscDispatcher_.addView("/delivery",                   &loop4r_readApplication::handleDeliveryView,             false);
+	oscDispatcher_.addView("/heartbeat",                  &loop4r_readApplication::handleHeartbeatView,            false);
+	oscDispatcher_.addView("/time",                       &loop4r_readApplication::handleTimeView,                 false);
+	oscDispatcher_.addView("/pos",                        &loop4r_readApplication::handlePositionView,             false);
+	oscDispatcher_.addView("/reconcile",                  &loop4r_readApplication::handleReconcileView,            false);
+	oscDispatcher_.addView("/state",                      &loop4r_readApplication::handleStateView,                true);
+	oscDispatcher_.add("/loop4r/ping",                    &loop4r_readApplication::handlePingMessage,              false);
+	oscDispatcher_.addView("/loop4r/ping",                &loop4r_readApplication::handlePingView,                 false);
+	oscDispatcher_.add("/loop4r/clock",                   &loop4r_readApplication::handleClockMessage,             false);
+	oscDispatcher_.addView("/loop4r/clock",               &loop4r_readApplication::handleClockView,                false);
+	oscDispatcher_.add("/loop4r/clock_answer",            &loop4r_readApplication::handleClockAnswerMessage,       false);
+	oscDispatcher_.addView("/loop4r/clock_answer",        &loop4r_readApplication::handleClockAnswerView,          false);
+	oscDispatcher_.add("/loop4r/time",                    &loop4r_readApplication::handleTimeRequestMessage,       false);
+	oscDispatcher_.addView("/loop4r/time",                &loop4r_readApplication::handleTimeRequestView,          false);
+	oscDispatcher_.add("/loop4r/engine",                  &loop4r_readApplication::handleEngineMessage,            true);
+	oscDispatcher_.add("/loop4r/engines",                 &loop4r_readApplication::handleEnginesMessage,           false);
+	oscDispatcher_.add("/loop4r/stats",                   &loop4r_readApplication::handleStatsMessage,             false);
+	oscDispatcher_.add("/loop4r/led_output",              &loop4r_readApplication::handleLedOutputMessage,         true);
+	oscDispatcher_.add("/loop4r/snapshot",                &loop4r_readApplication::handleSnapshotMessage,          false);
+	oscDispatcher_.addView("/loop4r/snapshot",            &loop4r_readApplication::handleSnapshotView,             false);
+	oscDispatcher_.add("/loop4r/changes",                 &loop4r_readApplication::handleChangesMessage,           false);
+	oscDispatcher_.addView("/loop4r/changes",             &loop4r_readApplication::handleChangesView,              false);
+	oscDispatcher_.add("/loop4r/leds",                    &loop4r_readApplication::handleLedsMessage,              true);
+	oscDispatcher_.addView("/loop4r/leds",                &loop4r_readApplication::handleLedsView,                 true);
+	oscDispatcher_.add("/loop4r/display",                 &loop4r_readApplication::handleDisplayMessage,           true);
+	oscDispatcher_.addView("/loop4r/display",             &loop4r_readApplication::handleDisplayView,              true);
+	oscDispatcher_.add("/loop4r/register_auto_update",    &loop4r_readApplication::handleRegisterMessage,          true);
+	oscDispatcher_.add("/loop4r/unregister_auto_update",  &loop4r_readApplication::handleUnregisterMessage,        true);
+	oscDispatcher_.add("/loop4r/get_control",             &loop4r_readApplication::handleGetControlMessage,        false);
+	oscDispatcher_.add("/loop4r/register_control",        &loop4r_readApplication::handleRegisterControlMessage,   true);
+	oscDispatcher_.add("/loop4r/unregister_control",      &loop4r_readApplication::handleUnregisterControlMessage, true);
+	oscDispatcher_.add("/loop4r/discover",                &loop4r_readApplication::handleDiscoverMessage,          false);
+	oscDispatcher_.add("/loop4r/cmd",                     &loop4r_readApplication::handleCmdMessage,               true);
+    }
+
+    void handleRegisterMessage(const OSCMessage& message)
+    {
+	handleRegisterAutoUpdateMessage(message, false);
+    }
+
+    void handleUnregisterMessage(const OSCMessage& message)
+    {
+	handleRegisterAutoUpdateMessage(message, true);
+    }
+
+    // host port url loop control, the loop -1 for every loop and -2 for a
+    // global control; false (and why on stderr) if it isn't one
+    bool parseControlMessage(const OSCMessage& message, const char* what, int& loop, int& id)
+    {
+	if (message.size() < 5 || !message[0].isString() || !message[1].isInt32() || !message[2].isString()
+	    || !message[3].isInt32() || !message[4].isString())
+	{
+	    std::cerr << "unrecognized format for " << what << " message." << std::endl;
+	    return false;
+	}
+	loop = message[3].getInt32();
+	id = SooperLooperControls::find(loop == SooperLooperControls::global, message[4].getString().toRawUTF8());
+	if (id < 0 || loop < SooperLooperControls::global)
+	{
+	    std::cerr << "Unknown SooperLooper control " << loop << " " << message[4].getString() << std::endl;
+	    return false;
+	}
+	return true;
+    }
+
+    // /loop4r/get_control host port url loop control, answered from the
+    // active engine's mirror as "url loop control value" for each loop that
+    // has one; controls nobody mirrors have nothing to answer with
+    void handleGetControlMessage(const OSCMessage& message)
+    {
+	int loop, id;
+	if (!parseControlMessage(message, "get_control", loop, id))
+	{
+	    return;
+	}
+
+	const String host = message[0].getString();
+	const int port = message[1].getInt32();
+	OscPacketSender* sender = replySenders_.get(host.toRawUTF8(), port);
+	if (sender == nullptr)
+	{
+	    std::cerr << "Error: could not connect to UDP " << host << ":" << port << std::endl;
+	    return;
+	}
+
+	OscMessageWriter reply(makeReplyWriter());
+	const ControlMirror& controls = activeEngine().controls_;
+	const int first = loop == -1 ? 0 : loop;
+	const int last = loop == -1 ? activeEngine().loops_.size() : loop + 1;
+	for (int i = first; i < last; ++i)
+	{
+	    float value;
+	    if (controls.get(i, id, value))
+	    {
+		reply.begin(message[2].getString().toRawUTF8(), "isf").addInt32(i)
+		    .addString(message[4].getString().toRawUTF8()).addFloat32(value);
+		sender->send(reply.getData(), reply.size());
+	    }
+	}
+    }
+
+    // /loop4r/register_control host port url loop control (lease seconds):
+    // changes on the active engine are sent as "url loop control value", and
+    // the first client to follow a control has it mirrored from then on
+    void handleRegisterControlMessage(const OSCMessage& message)
+    {
+	int loop, id;
+	if (!parseControlMessage(message, "register_control", loop, id))
+	{
+	    return;
+	}
+
+	const int leaseMs = message.size() > 5 && message[5].isInt32() ? jmax(0, message[5].getInt32()) * 1000 : 0;
+	if (!controlSubscribers_.subscribe(message[0].getString(), message[1].getInt32(), message[2].getString(), loop, id, leaseMs))
+	{
+	    std::cerr << "Error: could not subscribe UDP " << message[0].getString() << ":" << message[1].getInt32() << " to control updates" << std::endl;
+	    return;
+	}
+	for (auto* engine : engines_)
+	{
+	    updateMirroredControls(*engine);
+	}
+    }
+
+    // what's mirrored stays so until the next registration, in case they're back
+    void handleUnregisterControlMessage(const OSCMessage& message)
+    {
+	int loop, id;
+	if (parseControlMessage(message, "unregister_control", loop, id))
+	{
+	    controlSubscribers_.unsubscribe(message[0].getString(), message[1].getInt32(), message[2].getString(), loop, id);
+	}
+    }
+
+    // /loop4r/cmd "line" runs the line as stdin would, /loop4r/cmd with more
+    // arguments takes each as one of the command's words; either way it's
+    // queued for the start of the next pass rather than run in the middle of
+    // handling this datagram
+    void handleCmdMessage(const OSCMessage& message)
+    {
+	StringArray params;
+	for (auto&& arg : message)
+	{
+	    params.add(arg.isString() ? arg.getString() : arg.isInt32() ? String(arg.getInt32())
+		       : arg.isFloat32() ? String(arg.getFloat32()) : String());
+	}
+	if (params.isEmpty())
+	{
+	    std::cerr << "unrecognized format for cmd message." << std::endl;
+	    return;
+	}
+
+	if (params.size() == 1)
+	{
+	    runtimeCommands_.addLine(params[0]);
+	}
+	else
+	{
+	    runtimeCommands_.add(RuntimeCommands::parameters, params);
+	}
+	wakeControlThread();
+    }
+
+    // "/e<n>/..." is engine n's reply path, anything else belongs to the first engine
+    Engine* engineForAddress(const String& address, String& path)
+    {
+	if (address.startsWith("/e"))
+	{
+	    const int slash = address.indexOfChar(2, '/');
+	    const String number = address.substring(2, slash);
+	    if (slash > 2 && number.containsOnly("0123456789") && number.getIntValue() < engines_.size())
+	    {
+		path = address.substring(slash);
+		return engines_.getUnchecked(number.getIntValue());
+	    }
+	}
+	path = address;
+	return engines_.getUnchecked(0);
+    }
+
+    // the engine a raw address is for, path is moved past its "/e<n>" prefix
+    Engine* engineForAddress(const char*& path)
+    {
+	if (path[0] == '/' && path[1] == 'e' && CharacterFunctions::isDigit(path[2]))
+	{
+	    int number = 0;
+	    const char* end = path + 2;
+	    while (CharacterFunctions::isDigit(*end) && number < engines_.size())
+	    {
+		number = number * 10 + (*end++ - '0');
+	    }
+	    if (*end == '/' && number < engines_.size())
+	    {
+		path = end;
+		return engines_.getUnchecked(number);
+	    }
 	}
+	return engines_.getUnchecked(0);
     }
 
-    uint16 asPortNumber(String value)
+    // Read in place off the socket: the hot addresses are handled straight
+    // from the view, everything else goes the OSCMessage way.
+    void dispatchOscView(const OscMessageView& view)
     {
-	return (uint16)limit16Bit(asDecOrHexIntValue(value));
+	const AllocationAccounting::Scope counted(allocations_, AllocationAccounting::OscMessage);
+	const ScratchArena::Scope scratch;
+	const char* path = view.getAddress();
+	Engine* engine = engineForAddress(path);
+	const auto* entry = oscDispatcher_.findView(path);
+	if (entry == nullptr)
+	{
+	    OSCMessage message("/");
+	    if (!oscDispatcher_.knows(path))
+	    {
+		oscGate_.reject(OscGate::UnknownAddress);
+	    }
+	    else if (view.toMessage(message))
+	    {
+		dispatchOscMessage(message);
+	    }
+	    return;
+	}
+
+	oscEngine_ = engine;
+	eventLog_.logOsc(entry->verbose_ ? LogNormal : LogVerbose, view);
+	(this->*(entry->handler_))(view);
     }
 
-    uint8 asNoteNumber(String value)
+    // Everything queued by the OSC listener. A backlog of /ctrl updates is
+    // cut down to the latest per loop and control before any is applied, so
+    // catching up doesn't light the LEDs for states that are already gone.
+    void drainOscEvents(OSCMessage& message)
     {
-	if (value.length() >= 2)
+	const SpanTrace::Scope span(&spans_, "osc drain");
+	while (oscEvents_.pop(message))
 	{
-	    value = value.toUpperCase();
-	    String first = value.substring(0, 1);
-	    if (first.containsOnly("CDEFGABH") && value.substring(value.length()-1).containsOnly("1234567890"))
+	    char buffer[OscPacket::maxSize];
+	    OscMessageWriter writer(buffer, sizeof(buffer));
+	    const bool complete = writer.write(message);
+	    const OscMessageView view(buffer, complete && writer.ok() ? writer.size() : 0);
+	    if (!view.isValid() || !coalesceCtrlUpdate(view))
 	    {
-		int note = 0;
-		switch (first[0])
-		{
-		    case 'C': note = 0; break;
-		    case 'D': note = 2; break;
-		    case 'E': note = 4; break;
-		    case 'F': note = 5; break;
-		    case 'G': note = 7; break;
-		    case 'A': note = 9; break;
-		    case 'B': note = 11; break;
-		    case 'H': note = 11; break;
-		}
-
-		if (value[1] == 'B')
-		{
-		    note -= 1;
-		}
-		else if (value[1] == '#')
-		{
-		    note += 1;
-		}
-
-		note += (value.getTrailingIntValue() + 5 - octaveMiddleC_) * 12;
-
-		return (uint8)limit7Bit(note);
+		flushCtrlUpdates();
+		dispatchOscMessage(message);
 	    }
 	}
-
-	return (uint8)limit7Bit(asDecOrHexIntValue(value));
+	flushCtrlUpdates();
     }
 
-    uint8 asDecOrHex7BitValue(String value)
+    // holds back a "/ctrl loop control value" update, false for anything else
+    bool coalesceCtrlUpdate(const OscMessageView& view)
     {
-	return (uint8)limit7Bit(asDecOrHexIntValue(value));
+	const char* path = view.getAddress();
+	engineForAddress(path);
+	return std::strcmp(path, "/ctrl") == 0 && SooperLooperCtrl::Schema::matches(view)
+	    && ctrlUpdates_.add(view, oscArrivalTicks_);
     }
 
-    uint16 asDecOrHex14BitValue(String value)
+    void flushCtrlUpdates()
     {
-	return (uint16)limit14Bit(asDecOrHexIntValue(value));
+	if (!ctrlUpdates_.isEmpty())
+	{
+	    ctrlUpdates_.flush([this] (const OscMessageView& view, int64 arrivalTicks)
+			       {
+				   oscArrivalTicks_ = arrivalTicks;
+				   dispatchOscView(view);
+			       });
+	}
     }
 
-    int asDecOrHexIntValue(String value)
+    void dispatchOscMessage(const OSCMessage& message)
     {
-	if (value.endsWithIgnoreCase("H"))
+	const AllocationAccounting::Scope counted(allocations_, AllocationAccounting::OscMessage);
+	const ScratchArena::Scope scratch;
+	const String address = message.getAddressPattern().toString();
+	String path;
+	oscEngine_ = engineForAddress(address, path);
+	const auto* entry = oscDispatcher_.find(path);
+	if (entry == nullptr)
 	{
-	    return value.dropLastCharacters(1).getHexValue32();
+	    oscGate_.reject(OscGate::UnknownAddress);
 	}
-	else if (value.endsWithIgnoreCase("M"))
+	eventLog_.logOsc(entry != nullptr && entry->verbose_ ? LogNormal : LogVerbose, address, message);
+	oscDispatcher_.dispatch(*this, entry, message);
+    }
+
+    // Called on the message thread, or on the "Juce OSC server" thread when
+    // running with "ort". Either way the message is only queued, the control
+    // thread handles it.
+    void queueOscMessage(const OSCMessage& message)
+    {
+	const SpanTrace::Scope span(&spans_, "osc queue");
+	const AllocationAccounting::Scope counted(allocations_, AllocationAccounting::OscMessage, false);
+	traceOscMessage(message);
+	bool queued;
 	{
-	    return value.getIntValue();
+	    const SpinLock::ScopedLockType lock(oscQueueLock_.value_);
+	    queued = oscEvents_.push(message);
 	}
-	else if (useHexadecimalsByDefault_)
+	if (queued)
 	{
-	    return value.getHexValue32();
+	    wakeControlThread();
 	}
 	else
 	{
-	    return value.getIntValue();
+	    journal_.record(EventJournal::OscQueueFull);
+	    if (queueFullLog_.allow())
+	    {
+		const int64 suppressed = queueFullLog_.takeSuppressed();
+		std::cerr << "OSC queue is full, dropping " << message.getAddressPattern().toString();
+		if (suppressed > 0)
+		{
+		    std::cerr << " (" << suppressed << " more dropped since the last report)";
+		}
+		std::cerr << std::endl;
+	    }
 	}
     }
 
-    static uint8 limit7Bit(int value)
+    void traceOscMessage(const OSCMessage& message)
     {
-	return (uint8)jlimit(0, 0x7f, value);
+	metrics_.countOscAddress(Metrics::OscIn, message.getAddressPattern().toString().toRawUTF8());
+	if (trace_.isOpen())
+	{
+	    char buffer[TraceCapture::maxData];
+	    OscMessageWriter writer(buffer, sizeof(buffer));
+	    const bool complete = writer.write(message);
+	    trace_.record(TraceCapture::OscIn, buffer, writer.size(), !complete || !writer.ok());
+	}
     }
 
-    static uint16 limit14Bit(int value)
+    void oscMessageReceived (const OSCMessage& message) override
     {
-	return (uint16)jlimit(0, 0x3fff, value);
+	queueOscMessage(message);
     }
 
-    static uint16 limit16Bit(int value)
+    void oscBundleReceived (const OSCBundle& bundle) override
     {
-	return (uint16)jlimit(0, 0xffff, value);
+	queueOscBundle(bundle);
     }
 
-    int pedalIndex(int controllerValue) {
-	switch (controllerValue) {
-	    case 1:
-	    case 2:
-	    case 3:
-	    case 4:
-	    case 5:
-	    case 6:
-	    case 7:
-	    case 8:
-	    case 9:
-		return controllerValue-1;
-	    case 0:
-		return 9;
-	    case 10:
-		return UP;
-	    case 11:
-		return DOWN;
-	    default:
-		return controllerValue;
-	}
-    }
-
-    uint8 ledNumber(int pedalIdx) {
-	switch (pedalIdx) {
-	    case 0:
-	    case 1:
-	    case 2:
-	    case 3:
-	    case 4:
-	    case 5:
-	    case 6:
-	    case 7:
-	    case 8:
-		return pedalIdx+1;
-	    case 9:
-		return 0;
-	    default:
-		return pedalIdx;
+    // timetags are ignored, everything is handled as soon as it arrives
+    void queueOscBundle(const OSCBundle& bundle)
+    {
+	for (auto& element : bundle)
+	{
+	    if (element.isMessage())
+	    {
+		queueOscMessage(element.getMessage());
+	    }
+	    else if (element.isBundle())
+	    {
+		queueOscBundle(element.getBundle());
+	    }
 	}
     }
 
-    void ledOn(int pedalIdx) {
-	//sendMidiMessage(midiOut_, MidiMessage::controllerEvent(channel_, 106, ledNumber(pedalIdx)));
-	std::cout << "cc " << 106 << " " << (int)ledNumber(pedalIdx) << std::endl;
-
-	LED& led = leds_.getReference(pedalIdx);
-	led.on_ = true;
-
-	if (oscLedSenderInitialized_)
+    void handleAsyncUpdate() override
+    {
+	if (midiDevicesChanged_.exchange(false))
 	{
-	    oscLedSender.send("/led", (int)led.index_, (int)(led.on_ ? 1 : 0), (int)led.timer_, (int)led.state_);
+	    const ScopedLock lock(midiPortsLock_);
+	    checkMidiDevices();
 	}
     }
 
-    void ledOff(int pedalIdx) {
-	//sendMidiMessage(midiOut_, MidiMessage::controllerEvent(channel_, 107, ledNumber(pedalIdx)));
-	std::cout << "cc " << 107 << " " << (int)ledNumber(pedalIdx) << std::endl;
+    // The control thread owns the loop and LED state. Pedals are handled first
+    // since somebody is standing on them, then SooperLooper's updates, and
+    // every 200ms the OSC connection and heartbeat are looked after.
+    void runControlLoop()
+    {
+	if (memoryLocked_)
+	{
+	    ThreadTuning::prefaultStack();
+	}
+	if (useReactor_)
+	{
+	    runReactorLoop();
+	    return;
+	}
 
-	LED& led = leds_.getReference(pedalIdx);
-	led.on_ = false;
-	if (oscLedSenderInitialized_)
+	createTimers();
+	OSCMessage message("/");
+	while (!controlThread_.threadShouldExit())
 	{
-	    oscLedSender.send("/led", (int)led.index_, (int)(led.on_ ? 1 : 0), (int)led.timer_, (int)led.state_);
+	    controlWakeUp_.wait(runControlPass(message));
+	    metrics_.add(Metrics::ControlWakeups);
 	}
     }
 
-    void selectLoop() {
-	if (selectedLoop_ / 10 > 0)
+    // handles everything that's queued up, returns how long we may sleep
+    int runControlPass(OSCMessage& message)
+    {
+	const SpanTrace::Scope span(&spans_, "control pass");
+	if (overload_.isEnabled() || feedback_.getNumCuts() != numFeedbackCutsReported_)
 	{
-	    //sendMidiMessage(midiOut_, MidiMessage::controllerEvent(channel_, 113, (uint8)(selectedLoop_ / 10)));
-	    std::cout << "cc " << 113 << " " << (int)(selectedLoop_ / 10) << std::endl;
+	    checkOverload();
 	}
-	else
+	if (runtimeCommands_.hasPending())
+	{
+	    runRuntimeCommands();
+	}
+	if (sequencerInput_.takeOverrun())
+	{
+	    handleSequencerOverrun();
+	}
+	if (ledReplayRequested_.load() && ledReplayRequested_.exchange(false))
+	{
+	    startLedReplay();
+	}
+	if (jackMidi_.isOpen())
+	{
+	    drainJackMidi();
+	}
+	if (onsetDetector_.isRunning())
+	{
+	    drainOnsets();
+	}
+	// before the pedals, so a quantised press goes by this period's beat
+	if (jackTransport_.isOpen())
+	{
+	    jackTransport_.poll(time_.getHighResolutionTicks());
+	}
+	if (midiPlayer_.getNumEvents() > 0)
+	{
+	    drainPlayedMidi();
+	}
+	if (!useReactor_)
+	{
+	    drainByteMidi();
+	}
+	PedalEvent pedal;
+	while (pedalEvents_.pop(pedal))
+	{
+	    handlePedalEvent(pedal);
+	}
+	advancePedalTiming();
+	midiStage_.flush();
+	if (!expression_.isEmpty())
+	{
+	    sendExpression();
+	}
+	drainOscEvents(message);
+	if (!useReactor_ && localSocket_.isOpen())
 	{
-	    //sendMidiMessage(midiOut_, MidiMessage::controllerEvent(channel_, 113, (uint8)0));
-	    std::cout << "cc " << 113 << " 0" << std::endl;
+	    localSocket_.drain([this] (const char* data, int size, const LocalPeer& from) { dispatchLocalPacket(data, size, from); });
 	}
 
-	//sendMidiMessage(midiOut_, MidiMessage::controllerEvent(channel_, 114, (uint8)(selectedLoop_ % 10)));
-	std::cout << "cc " << 114 << " " << (int)(selectedLoop_ % 10) << std::endl;
+	wheel_.advance(time_.getMillisecondCounter());
+	for (auto* engine : engines_)
+	{
+	    if (isUpdatingRates(*engine) && engine->adaptive_.getMsUntilNext(time_.getMillisecondCounter()) == 0)
+	    {
+		switchUpdateRates(*engine, time_.getMillisecondCounter());
+	    }
+	}
+	// the pass's output by what it's for: loop commands and MIDI first, then
+	// the engines' queries, then the LEDs (the log has a thread of its own).
+	// While there are pedals waiting the last two wait for them, for a few
+	// passes at most; what's held meanwhile only gets more up to date.
+	for (auto* engine : engines_)
+	{
+	    engine->sender_.flushCommands();
+	}
+	midiStage_.flush();
+	if (pedalEvents_.isEmpty() || ++numHeldPasses_ > maxHeldPasses)
+	{
+	    numHeldPasses_ = 0;
+	    for (auto* engine : engines_)
+	    {
+		engine->sender_.flushQueries();
+	    }
+	    commitLeds();
+	}
+	if (idlePower_ && isStartupPending())
+	{
+	    reportStartup();
+	}
 
-	if (oscLedSenderInitialized_)
+	// until the wheel's next deadline (forever with nothing on it), a ramp
+	// in progress needs us back within a couple of milliseconds, the pedal
+	// timing at its own deadlines
+	int wait = wheel_.getMsUntilNext(time_.getMillisecondCounter());
+	if (debounce_.hasPending())
+	{
+	    wait = soonest(wait, debounce_.getMsUntilNext(time_.getHighResolutionTicks()));
+	}
+	if (macros_.isBusy())
+	{
+	    wait = soonest(wait, macros_.getMsUntilNext(time_.getHighResolutionTicks() + getMacroLeadTicks()));
+	}
+	if (!gestures_.isEmpty())
+	{
+	    wait = soonest(wait, gestures_.getMsUntilNext(time_.getHighResolutionTicks()));
+	}
+	if (chords_.hasPending())
+	{
+	    wait = soonest(wait, chords_.getMsUntilNext(time_.getHighResolutionTicks()));
+	}
+	if (overload_.getLevel() != OverloadGuard::Normal)
+	{
+	    // back to give a level up once it's calm
+	    wait = soonest(wait, OverloadGuard::calmMs);
+	}
+	for (auto* engine : engines_)
 	{
-	    oscLedSender.send("/display", (int)selectedLoop_);
+	    if (isUpdatingRates(*engine))
+	    {
+		wait = soonest(wait, engine->adaptive_.getMsUntilNext(time_.getMillisecondCounter()));
+	    }
 	}
+	return expression_.isBusy() ? soonest(wait, 2) : wait;
     }
 
-    void getCurrentState(int index)
+    bool isUpdatingRates(const Engine& engine) const
     {
-	String buf = "/sl";
-	buf = buf + "/" + std::to_string(index) + "/get";
-	oscSender.send(buf,
-		       (String) "state",
-		       (String) "osc.udp://localhost:" + std::to_string(currentReceivePort_) + "/",
-		       (String) "/ctrl");
+	return engine.adaptive_.isEnabled() && engine.connected_ && engine.loopCount_ > 0;
     }
 
-    void registerAutoUpdates(int index, bool unreg)
+    // debounced edges, macro steps and gestures that have come due
+    void advancePedalTiming()
     {
-	String buf = "/sl";
-	if (unreg)
+	if (debounce_.hasPending())
 	{
-	    buf = buf + "/" + std::to_string(index) + "/unregister_auto_update";
-	    oscSender.send(buf,
-			   (String) "state",
-			   (int)100,
-			   (String) "osc.udp://localhost:" + std::to_string(currentReceivePort_) + "/",
-			   (String) "/ctrl");
+	    debounce_.advance(time_.getHighResolutionTicks(), [this] (int key, bool down, int value, int64 ticks) {
+		recognisePedalEvent({down ? 104 : 105, value, ticks, key / PedalGestures::pedalsPerInput});
+	    });
 	}
-	else{
-	    buf = buf + "/" + std::to_string(index) + "/register_auto_update";
-	    oscSender.send(buf,
-			   (String) "state",
-			   (int)100,
-			   (String) "osc.udp://localhost:" + std::to_string(currentReceivePort_) + "/",
-			   (String) "/ctrl");
+	if (macros_.isBusy())
+	{
+	    macros_.advance(time_.getHighResolutionTicks() + getMacroLeadTicks(), getTicksPerBeat(),
+			    [this] (const PedalMacros::Step& step, int, int64 due) { runMacroStep(step, due); },
+			    [this] (int key) { ledOff(key % PedalGestures::pedalsPerInput); });
+	}
+	if (!gestures_.isEmpty())
+	{
+	    gestures_.advance(time_.getHighResolutionTicks(), [this] (int key, PedalGestures::Outcome outcome, int value, int64 ticks) { handlePedalGesture(key, outcome, value, ticks); });
+	}
+	if (chords_.hasPending())
+	{
+	    chords_.advance(time_.getHighResolutionTicks(), [this] (int key, int value, int64 ticks) {
+		recogniseSinglePedal(decodePedalEvent({104, value, ticks, PedalChords::inputOf(key)}));
+	    });
 	}
     }
 
-    void registerGlobalUpdates(bool unreg)
+    // how far behind we are decides what's shed, once a pass
+    void checkOverload()
     {
-	String buf = "";
-	if (unreg)
+	const int64 now = Time::getHighResolutionTicks();
+	const OverloadGuard::Level before = overload_.getLevel();
+	if (overload_.update(jmax(pedalEvents_.size(), oscEvents_.size()), now))
 	{
-	    buf = buf + "/unregister_update";
-	    oscSender.send(buf,
-			   (String) "selected_loop_num",
-			   (String) "osc.udp://localhost:" + std::to_string(currentReceivePort_) + "/",
-			   (String) "/ctrl");
+	    const OverloadGuard::Level level = overload_.getLevel();
+	    std::cerr << (level > before ? "Falling behind, load shed to: " : "Catching up, load shed to: ")
+		      << OverloadGuard::getLevelName(level) << std::endl;
+	    applyShedLevel(before);
 	}
-	else{
-	    buf = buf + "/register_update";
-	    oscSender.send(buf,
-			   (String) "selected_loop_num",
-			   (String) "osc.udp://localhost:" + std::to_string(currentReceivePort_) + "/",
-			   (String) "/ctrl");
+	if (feedback_.getNumCuts() != numFeedbackCutsReported_)
+	{
+	    numFeedbackCutsReported_ = feedback_.getNumCuts();
+	    std::cerr << "MIDI feedback loop, controllers come straight back from the outputs: passthrough cut for "
+		      << MidiFeedbackGuard::cutMs / 1000 << "s" << std::endl;
 	}
+    }
 
+    // the log's ceiling follows the level (under "gig"'s), and OSC displays that missed
+    // updates are sent everything once they get them again
+    void applyShedLevel(OverloadGuard::Level before)
+    {
+	eventLog_.setCeiling(overload_.sheds(OverloadGuard::ShedLogging) ? LogNormal : logCeiling_);
+	if (before >= OverloadGuard::ShedDisplays && !overload_.sheds(OverloadGuard::ShedDisplays))
+	{
+	    redrawLeds();
+	}
     }
 
-    void handlePingAckMessage(const OSCMessage& message)
+    // the OSC displays get what changed, unless they're being shed
+    bool pushesToDisplays()
     {
-	if (! message.isEmpty())
+	if (ledSubscribers_.isEmpty() && !ledMulticast_.isOpen())
 	{
-	    int i = 0;
-	    for (OSCArgument* arg = message.begin(); arg != message.end(); ++arg)
+	    return false;
+	}
+	if (overload_.sheds(OverloadGuard::ShedDisplays))
+	{
+	    overload_.countShed(OverloadGuard::ShedDisplays);
+	    return false;
+	}
+	return true;
+    }
+
+    // the sooner of two waits where -1 is never
+    static int soonest(int a, int b)
+    {
+	return a < 0 ? b : b < 0 ? a : jmin(a, b);
+    }
+
+    // With "epoll" the control thread does the MIDI and OSC threads' reading
+    // and the message thread's timer work itself, all from one epoll_wait():
+    // the ALSA sequencer, the OSC socket and standard input are read as they
+    // become ready and their handlers run inline, and the reactor's timerfd
+    // brings us back for the 200ms tick and expression ramps.
+    void runReactorLoop()
+    {
+	if (oscSocket_ != nullptr)
+	{
+	    reactor_.watch(oscSocket_->getRawSocketHandle(), ReactorOsc);
+	}
+	if (localSocket_.isOpen())
+	{
+	    reactor_.watch(localSocket_.getFileDescriptor(), ReactorLocalOsc);
+	}
+	openSequencerInput();
+	if (readStdinCommands_ && !reactor_.watch(STDIN_FILENO, ReactorStdin))
+	{
+	    // regular files can't be watched, but they don't block either
+	    while (readStdinCommands())
 	    {
-		switch (i)
-		{
-		    case 0:
-			if (arg->isString())
-			    hostUrl_ = arg->getString();
-			break;
-		    case 1:
-			if (arg->isString())
-			    version_ = arg->getString();
-			break;
-		    case 2:
-			if (arg->isInt32())
-			    loopCount_ = arg->getInt32();
-			break;
-		    case 3:
-			if (arg->isInt32())
-			    engineId_ = arg->getInt32();
-			break;
-		    default:
-			std::cerr << "Unexpected number of arguments for /pingack" << std::endl;
-		}
-		i++;
 	    }
+	}
+	threadTuning_.apply();
+	if (idlePower_)
+	{
+	    startIdleHotplug();
+	}
 
-	    if (loopCount_ > 0)
+	createTimers();
+	controlStartTicks_ = Time::getHighResolutionTicks();
+	controlStartWakeups_ = ThreadAccounting::sampleWakeups();
+	OSCMessage message("/");
+	while (!controlThread_.threadShouldExit())
+	{
+	    reactor_.wait(runControlPass(message), [this] (int tag)
+			  {
+			      switch (tag)
+			      {
+				  case ReactorMidi:
+				  {
+				      const SpanTrace::Scope span(&spans_, "midi decode");
+				      sequencerInput_.read([this] (int source, int channel, int controller, int value) { return handleIncomingController(sequencerInputs_[source], channel, controller, value, reactor_.getWakeTicks()); },
+							[this] (int source, const MidiMessage& msg) { handleMidiInput(sequencerInputs_[source], msg, reactor_.getWakeTicks()); });
+				      break;
+				  }
+				  case ReactorOsc:
+				      readOscSocket(*oscSocket_, oscDrops_);
+				      break;
+				  case ReactorOscDraining:
+				      readOscSocket(*oldOscSocket_, oldOscDrops_);
+				      break;
+				  case ReactorLocalOsc:
+				      localSocket_.read([this] (const char* data, int size, const LocalPeer& from) { dispatchLocalPacket(data, size, from); });
+				      break;
+				  case ReactorStdin:
+				      if (!readStdinCommands())
+				      {
+					  reactor_.unwatch(STDIN_FILENO);
+				      }
+				      break;
+				  default:
+				      if (tag >= ReactorByteMidi)
+				      {
+					  readByteMidi(tag - ReactorByteMidi);
+				      }
+				      break;
+			      }
+			  });
+	    metrics_.add(Metrics::ControlWakeups);
+	    overload_.noteLag(Time::getHighResolutionTicks() - reactor_.getWakeTicks());
+	    handleSignals();
+	    if (midiDevicesChanged_.exchange(false))
 	    {
-		loops_.clear();
-		for (i = 0; i < loopCount_; i++)
-		{
-		    loops_.add({i, Off, leds_.getReference(i)});
-		    registerAutoUpdates(i, false);
-		    getCurrentState(i);
-		}
-		registerGlobalUpdates(false);
+		checkMidiDevices();
 	    }
-	    heartbeat_ = 5; // we just heard from the looper
 	}
+
+	signalWakeFd = -1;
+	if (idlePower_)
+	{
+	    // before the threads go, the control thread among them
+	    controlEndTicks_ = Time::getHighResolutionTicks();
+	    idleWakeups_ = ThreadAccounting::countWakeups(ThreadAccounting::sampleWakeups(), controlStartWakeups_);
+	}
+	sequencerInput_.close();
+	reactor_.close();
     }
 
-    void handleHeartbeatMessage(const OSCMessage& message)
+    // the signals are looked at after every wake, one of them may have been it
+    void handleSignals()
     {
-	if (! message.isEmpty())
+	if (quitSignalled && !quitRequested_)
 	{
-	    int i = 0;
-	    int numloops = 0;
-	    int uid = engineId_;
-	    for (OSCArgument* arg = message.begin(); arg != message.end(); ++arg)
+	    quitRequested_ = true;
+	    MessageManager::callAsync([this] { systemRequestedQuit(); });
+	}
+	if (spansSignalled)
+	{
+	    spansSignalled = 0;
+	    if (!workers_.submit(&writeSpansJob, this))
 	    {
-		switch (i)
-		{
-		    case 0:
-			if (arg->isString())
-			    hostUrl_ = arg->getString();
-			break;
-		    case 1:
-			if (arg->isString())
-			    version_ = arg->getString();
-			break;
-		    case 2:
-			if (arg->isInt32())
-			    numloops = arg->getInt32();
-			break;
-		    case 3:
-			if (arg->isInt32())
-			    uid = arg->getInt32();
-			break;
-		    default:
-			std::cerr << "Unexpected number of arguments for /heartbeat" << std::endl;
-		}
-		i++;
+		MessageManager::callAsync([this] { writeSpans(); });
 	    }
+	}
+    }
 
-	    if (uid != engineId_) {
-		// looper changed on us, reinitialize
-		if (numloops > 0)
-		{
-		    loopCount_ = numloops;
-		    loops_.clear();
-		    for (i = 0; i < loopCount_; i++)
-		    {
-			loops_.add({i, Off, leds_.getReference(i)});
-			registerAutoUpdates(i, false);
-			getCurrentState(i);
-			updateLoops();
-		    }
-		    registerGlobalUpdates(false);
-		}
-	    }
-	    else
-	    {
-		// check loopcount
-		if (loopCount_ != numloops)
-		{
-		    for (auto i=loopCount_; i<numloops; i++)
-		    {
-			registerAutoUpdates(i, false);
-			loops_.add({i, Off, leds_.getReference(i)});
-			updateLoops();
-		    }
-		    loopCount_ = numloops;
-		}
-	    }
-	    heartbeat_ = 5; // we just heard from the looper
+    // what the message thread's timer does otherwise
+    void runReactorTick()
+    {
+	handleSignals();
+	if (!threadTuning_.isEmpty() && (idlePower_ || ++threadTuningTicks_ >= THREAD_TUNING_TICKS))
+	{
+	    threadTuningTicks_ = 0;
+	    threadTuning_.apply();
+	}
+	// nothing tells us about new devices here, so this lists them again
+	if (isMidiOutputMissing())
+	{
+	    midiDevices_.invalidate();
 	}
+	checkMidiDevices();
     }
-    void handleCtrlMessage(const OSCMessage& message)
+
+    // Our own sequencer port for the inputs that aren't read some other way:
+    // with "epoll" the reactor watches it, otherwise it has a thread of its
+    // own taking the JUCE input thread's place, one that sleeps until there's
+    // input or it's stopped rather than waking ten times a second.
+    void openSequencerInput()
     {
-	if (! message.isEmpty())
+	if (useReactor_)
 	{
-	    OSCArgument* arg = message.begin();
-	    int loopIndex = -1;
-	    int loopState = 0;
-	    if (arg->isInt32())
+	    for (int fd : sequencerInput_.getFileDescriptors())
 	    {
-		loopIndex = arg->getInt32();
-		++arg;
-	    }
-	    else {
-		std::cerr << "unrecognized format for ctrl message." << std::endl;
-		return;
+		reactor_.unwatch(fd);
 	    }
-
-	    if (loopIndex == -2)
+	}
+	sequencerInput_.close();
+	// a virtual input is our port itself, named after it, for anyone to connect
+	// to; rawmidi devices and UARTs are read by themselves
+	StringArray names;
+	String clientName("loop4r midi in");
+	for (int i = 0; i < numMidiInputs_; ++i)
+	{
+	    if (ByteStreamMidiInput* bytes = midiInputs_[i].getByteInput())
 	    {
-		// global control update
-		if (arg->isString() && arg->getString() == "selected_loop_num")
+		if (!bytes->isOpen() && !tryToConnectMidiInput(midiInputs_[i]))
 		{
-		    ++arg;
-		    if (arg->isFloat32())
-		    {
-			selectedLoop_ = arg->getFloat32();
-			selectLoop();
-		    }
+		    reportMissingMidiInput(midiInputs_[i]);
 		}
+		continue;
 	    }
-	    else if (loopIndex < 0) {
-		return;
+	    sequencerInputs_[names.size()] = i;
+	    names.add(midiInputs_[i].virtual_ ? String() : midiInputs_[i].name_);
+	    if (midiInputs_[i].virtual_)
+	    {
+		clientName = midiInputs_[i].name_;
 	    }
-	    else
+	}
+	if (names.isEmpty())
+	{
+	    return;
+	}
+
+	sequencerInput_.setSysexFunction([this] (int source, const uint8* data, int size) { sysexCapture_.feed(sequencerInputs_[source], data, size); });
+	if (!sequencerInput_.open(names, clientName))
+	{
+	    std::cerr << "Couldn't open an ALSA sequencer port for MIDI input" << std::endl;
+	    return;
+	}
+	if (useReactor_)
+	{
+	    for (int fd : sequencerInput_.getFileDescriptors())
 	    {
-		if (arg->isString() && arg->getString() == "state")
-		{
-		    ++arg;
-		    if (arg->isFloat32())
-		    {
-			loopState = arg->getFloat32();
-			Loop &loop = loops_.getReference(loopIndex);
-			updateLoopLedState(loop, static_cast<LoopStates>(loopState));
-		    }
-		}
-		heartbeat_ = 5; // we just heard from the looper
+		reactor_.watch(fd, ReactorMidi);
+	    }
+	}
+	else
+	{
+	    sequencerInput_.startReading([this] (int source, const MidiMessage& msg, int64 ticks) { handleMidiInput(sequencerInputs_[source], msg, ticks); });
+	}
+	startup_.reached(StartupTimes::MidiClient);
+	for (int i = 0; i < sequencerInput_.getNumSources(); ++i)
+	{
+	    if (sequencerInput_.getSourceName(i).isNotEmpty() && sequencerInput_.getSource(i).isEmpty())
+	    {
+		std::cerr << "Couldn't find MIDI input port \"" << sequencerInput_.getSourceName(i) << "\", waiting." << std::endl;
+	    }
+	}
+    }
+
+    // everything waiting on the OSC socket, one datagram per message or bundle,
+    // with the batch's /ctrl updates coalesced like the queued ones. If the
+    // kernel dropped any meanwhile some state may be gone, so once the burst
+    // is over the loops are asked for it again.
+    void readOscSocket(DatagramSocket& socket, uint32& drops)
+    {
+	const uint32 before = drops;
+	const uint32 now = time_.getMillisecondCounter();
+	oscBatches_.read(socket.getRawSocketHandle(), [this, now] (const char* data, int size)
+			 {
+			     if (oscGate_.admit(oscBatches_.getSource(), now))
+			     {
+				 oscArrivalTicks_ = oscBatches_.getArrivalTicks();
+				 dispatchOscPacket(data, size);
+			     }
+			 }, &drops);
+	flushCtrlUpdates();
+	oscArrivalTicks_ = 0;
+	if (drops != before)
+	{
+	    numOscDropped_ += (int64) (uint32) (drops - before);
+	    if (oscResyncTimer_ >= 0 && !wheel_.isScheduled(oscResyncTimer_))
+	    {
+		wheel_.scheduleIn(oscResyncTimer_, oscResyncDelayMs, time_.getMillisecondCounter());
 	    }
 	}
     }
 
-    void handlePingMessage(const OSCMessage& message)
+    void startOscSendThread()
+    {
+	if (!oscSendThread_.start())
+	{
+	    std::cerr << "Couldn't start the OSC send thread, sending from the control thread" << std::endl;
+	    return;
+	}
+	if (oscSendBufferBytes_ > 0)
+	{
+	    UdpBatchReader::configure(oscSendThread_.getSocketHandle(), 0, oscSendBufferBytes_);
+	}
+	for (auto* engine : engines_)
+	{
+	    engine->sender_.setSendThread(&oscSendThread_);
+	}
+    }
+
+    void stopOscSendThread()
     {
-	if (! message.isEmpty())
+	if (!oscSendThread_.isRunning())
 	{
-	    String host;
-	    int port;
-	    String url;
-	    OSCArgument* arg = message.begin();
-	    if (arg->isString())
-	    {
-		host = arg->getString();
-		++arg;
-
-		if (arg->isInt32())
-		{
-		    port = arg->getInt32();
-		    ++arg;
-
-		    if (arg->isString())
-		    {
-			url = arg->getString();
-
-			OSCSender sender;
-
-			if (! sender.connect(host, port))
-			{
-			    std::cerr << "Error: could not connect to UDP " << host << ":" << port << std::endl;
-			    return;
-			}
-
-			if (! sender.send(url, (String)"osc.udp://localhost:" + std::to_string(oscReceivePort_),
-				    (String)getApplicationVersion(), (int)leds_.size(), (int)getuid()))
-			{
-			    std::cerr << "Error: could not send to UDP " << host << ":" << port << std::endl;
-			}
-
-			sender.disconnect();
-		    }
-		}
-
-	    }
+	    return;
+	}
+	for (auto* engine : engines_)
+	{
+	    engine->sender_.setSendThread(nullptr);
 	}
+	oscSendThread_.stop();
+	std::cerr << "OSC send thread: " << oscSendThread_.getNumSent() << " datagrams in " << oscSendThread_.getNumBatches() << " batches, "
+		  << oscSendThread_.getNumOverflowed() << " commands sent around it and " << oscSendThread_.getNumDropped() << " queries dropped while it was full" << std::endl;
     }
 
-    void handleLedsMessage(const OSCMessage& message)
+    void resyncLoops()
     {
-	if (! message.isEmpty())
+	std::cerr << "The OSC socket has dropped " << numOscDropped_.load() << " datagrams, asking for the loops' state again" << std::endl;
+	for (auto* engine : engines_)
 	{
-	    String host;
-	    int port;
-	    String url;
-	    OSCArgument* arg = message.begin();
-	    if (arg->isString())
+	    if (engine->sender_.isConnected() && engine->connected_ && engine->loopCount_ > 0)
 	    {
-		host = arg->getString();
-		++arg;
-
-		if (arg->isInt32())
-		{
-		    port = arg->getInt32();
-		    ++arg;
-
-		    if (arg->isString())
-		    {
-			url = arg->getString();
-
-			OSCSender sender;
-
-			if (! sender.connect(host, port))
-			{
-			    std::cerr << "Error: could not connect to UDP " << host << ":" << port << std::endl;
-			    return;
-			}
-			for (auto&& led : leds_)
-			{
-			    sender.send(url, (int)led.index_, (int)(led.on_ ? 1 : 0), (int)led.timer_, (int)led.state_);
-			}
-
-			sender.disconnect();
-		    }
-		}
-
+		const OscPacketSender::QueryScope query(engine->sender_);
+		engine->sender_.send(engine->packets_.allLoopsState());
 	    }
 	}
     }
 
-    void handleDisplayMessage(const OSCMessage& message)
+    // pedals went missing in the sequencer, so what they did, or what we think
+    // they did, may not be what the loops are doing
+    void handleSequencerOverrun()
     {
-	if (! message.isEmpty())
+	std::cerr << "The MIDI input overran " << sequencerInput_.getNumOverruns() << " times so far, asking for the loops' state again" << std::endl;
+	for (auto* engine : engines_)
 	{
-	    String host;
-	    int port;
-	    String url;
-	    OSCArgument* arg = message.begin();
-	    if (arg->isString())
+	    if (engine->sender_.isConnected() && engine->connected_ && engine->loopCount_ > 0)
 	    {
-		host = arg->getString();
-		++arg;
-
-		if (arg->isInt32())
-		{
-		    port = arg->getInt32();
-		    ++arg;
+		const OscPacketSender::QueryScope query(engine->sender_);
+		engine->sender_.send(engine->packets_.allLoopsState());
+	    }
+	}
+	requestLedReplay();
+    }
 
-		    if (arg->isString())
-		    {
-			url = arg->getString();
+    // a new socket's drop count starts again from 0
+    void configureOscSocket(DatagramSocket& socket)
+    {
+	if (!UdpBatchReader::configure(socket.getRawSocketHandle(), oscReceiveBufferBytes_, 0))
+	{
+	    std::cerr << "Couldn't size the OSC socket's buffers, count its drops or time its datagrams" << std::endl;
+	}
+	else if (oscReceiveBufferBytes_ > 0)
+	{
+	    std::cerr << "OSC receive buffer is " << UdpBatchReader::getReceiveBufferSize(socket.getRawSocketHandle()) << " bytes" << std::endl;
+	}
+    }
 
-			OSCSender sender;
+    void dispatchOscPacket(const char* data, int size)
+    {
+	const SpanTrace::Scope span(&spans_, "osc parse");
+	if (!isKnownOscPacket(data, size))
+	{
+	    return;
+	}
+	if (!OscMessageReader::readPacket(data, size, [this] (const OscMessageView& message)
+					  {
+					      trace_.record(TraceCapture::OscIn, message.getData(), message.getSize());
+					      metrics_.countOscAddress(Metrics::OscIn, message.getAddress());
+					      if (!coalesceCtrlUpdate(message))
+					      {
+						  flushCtrlUpdates();
+						  dispatchOscView(message);
+					      }
+					  }))
+	{
+	    oscGate_.reject(OscGate::Malformed);
+	}
+    }
 
-			if (! sender.connect(host, port))
-			{
-			    std::cerr << "Error: could not connect to UDP " << host << ":" << port << std::endl;
-			    return;
-			}
+    // A look at a datagram's address before it's parsed: false, and counted,
+    // if it isn't one we handle. A bundle's messages are looked at one by one
+    // as they're dispatched.
+    bool isKnownOscPacket(const char* data, int size)
+    {
+	if (size >= 8 && std::memcmp(data, "#bundle", 8) == 0)
+	{
+	    return true;
+	}
+	if (size < 4 || data[0] != '/' || std::memchr(data, 0, (size_t) size) == nullptr)
+	{
+	    oscGate_.reject(OscGate::Malformed);
+	    return false;
+	}
+	const char* path = data;
+	engineForAddress(path);
+	if (!oscDispatcher_.knows(path))
+	{
+	    oscGate_.reject(OscGate::UnknownAddress);
+	    return false;
+	}
+	return true;
+    }
 
-			sender.send("/display", (int)selectedLoop_);
-			sender.disconnect();
-		    }
-		}
+    // a packet from the local socket, its handlers seeing who sent it
+    void dispatchLocalPacket(const char* data, int size, const LocalPeer& from)
+    {
+	localPeer_ = &from;
+	dispatchOscPacket(data, size);
+	flushCtrlUpdates();
+	localPeer_ = nullptr;
+    }
 
-	    }
+    void openLocalSocket(const String& path)
+    {
+	closeLocalSocket();
+	if (!localSocket_.open(path))
+	{
+	    std::cerr << "Couldn't take /loop4r messages on Unix socket " << path << std::endl;
+	    return;
+	}
+	// the reactor only watches it once it's running, it picks it up itself otherwise
+	if (!useReactor_)
+	{
+	    localSocket_.startReading([this] { wakeControlThread(); });
+	}
+	else if (controlThread_.isThreadRunning())
+	{
+	    reactor_.watch(localSocket_.getFileDescriptor(), ReactorLocalOsc);
 	}
+	ledSubscribers_.setLocalSocket(localSocket_.getFileDescriptor());
+	std::cerr << "Taking /loop4r messages on Unix socket " << path << std::endl;
     }
 
-    void handleRegisterAutoUpdateMessage(const OSCMessage& message, bool unreg)
+    void closeLocalSocket()
     {
-	if (! message.isEmpty())
+	if (!localSocket_.isOpen())
 	{
-	    OSCArgument* arg = message.begin();
-	    String host;
-	    int port;
-	    if (arg->isString())
-	    {
-		host = arg->getString();
-		++arg;
-
-		if (arg->isInt32())
-		{
-		    port = arg->getInt32();
-		    ++arg;
-		    if (unreg)
-		    {
-			if (oscLedSenderInitialized_)
-			{
-			    if (! oscLedSender.disconnect())
-			    {
-				std::cerr << "Error: could not disconnect from UDP " << oscRemoteHost_ << ":" <<  oscRemotePort_ << std::endl;
-				return;
-			    }
-			    oscLedSenderInitialized_ = false;
-			    oscRemoteHost_ = "";
-			    oscRemotePort_ = -1;
-			}
-		    }
-		    else if (host != oscRemoteHost_ || port != oscRemotePort_)
-		    {
-			if (oscLedSenderInitialized_)
-			{
-			    if (! oscLedSender.disconnect())
-			    {
-				std::cerr << "Error: could not disconnect from UDP port " <<  oscRemotePort_ << std::endl;
-			    }
-			    else
-			    {
-				oscLedSenderInitialized_ = false;
-				oscRemoteHost_ = "";
-				oscRemotePort_ = -1;
-			    }
-			}
-
-			if (! oscLedSender.connect(host, port))
-			{
-			    std::cerr << "Error: could not connect to UDP port " <<  oscRemotePort_ << std::endl;
-			    return;
-			}
-			oscRemoteHost_ = host;
-			oscRemotePort_ = port;
-			oscLedSenderInitialized_ = true;
-		    }
-		}
-	    }
-	    else
-		return;
-	    }
+	    return;
+	}
+	if (useReactor_ && controlThread_.isThreadRunning())
+	{
+	    reactor_.unwatch(localSocket_.getFileDescriptor());
+	}
+	ledSubscribers_.setLocalSocket(-1);
+	localSocket_.close();
     }
 
-    void oscMessageReceived (const OSCMessage& message) override
+    void startProgramWatcher()
     {
-	if (!message.getAddressPattern().toString().startsWith("/heartbeat") && !message.getAddressPattern().toString().startsWith("/loop4r/ping") )
+	if (programWatcher_.isEmpty())
+	{
+	    return;
+	}
+	if (programWatcher_.start([this] (const File& file, CommandScript& script) { compileLines(file, script); },
+				  [this] (const File& file, int numCommands)
+				  {
+				      std::cerr << "Reloading " << file.getFullPathName() << ", " << numCommands << " command(s) changed" << std::endl;
+				      wakeControlThread();
+				  }))
 	{
-	    std::cerr << "-" <<
-	    + "- osc message, address = '"
-	    + message.getAddressPattern().toString()
-	    + "', "
-	    + String (message.size())
-	    + " argument(s)" << std::endl;
+	    std::cerr << "Watching the program files for changes" << std::endl;
+	}
+	else
+	{
+	    std::cerr << "Couldn't watch the program files for changes" << std::endl;
+	}
+    }
 
-	    for (OSCArgument* arg = message.begin(); arg != message.end(); ++arg)
+    // lines or frames from standard input redirected from a file, read to the
+    // end while we're starting like the command line itself
+    void readStdinFile(bool framed)
+    {
+	if (framed)
+	{
+	    int command;
+	    StringArray opts;
+	    while (CommandScript::readFrame(std::cin, command, opts))
 	    {
-		String typeAsString;
-		String valueAsString;
-
-		if (arg->isFloat32())
-		{
-		    typeAsString = "float32";
-		    valueAsString = String (arg->getFloat32());
-		}
-		else if (arg->isInt32())
-		{
-		    typeAsString = "int32";
-		    valueAsString = String (arg->getInt32());
-		}
-		else if (arg->isString())
-		{
-		    typeAsString = "string";
-		    valueAsString = arg->getString();
-		}
-		else if (arg->isBlob())
-		{
-		    typeAsString = "blob";
-		    auto& blob = arg->getBlob();
-		    valueAsString = String::fromUTF8 ((const char*) blob.getData(), (int) blob.getSize());
-		}
-		else
-		{
-		    typeAsString = "(unknown)";
-		}
-
-		std::cerr << "==- " + typeAsString.paddedRight(' ', 12) + valueAsString << std::endl;
-
+		runCompiledCommand(command, opts);
 	    }
+	    return;
 	}
-	if (message.getAddressPattern().toString().startsWith("/pingack"))
+	std::string line;
+	while (getline(std::cin, line))
 	{
-	    handlePingAckMessage(message);
+	    StringArray params = parseLineAsParameters(line);
+	    parseParameters(params);
 	}
-	else if (message.getAddressPattern().toString().startsWith("/ctrl"))
+    }
+
+    // what the stdin reader and /loop4r/cmd have queued, run at the start of a
+    // control pass; without the reactor the message thread's MIDI device
+    // checks are kept out while a command opens or closes ports
+    void runRuntimeCommands()
+    {
+	const ScopedLock lock(midiPortsLock_);
+	runtimeCommands_.run([this] (int command, const StringArray& opts)
+			     {
+				 if (command == RuntimeCommands::line)
+				 {
+				     parseParameters(parseLineAsParameters(opts[0]));
+				 }
+				 else if (command == RuntimeCommands::parameters)
+				 {
+				     parseParameters(opts);
+				 }
+				 else
+				 {
+				     runCompiledCommand(command, opts);
+				 }
+			     });
+    }
+
+    // queues the complete lines that have arrived, false once standard input is closed
+    bool readStdinCommands()
+    {
+	char buffer[1024];
+	const ssize_t size = ::read(STDIN_FILENO, buffer, sizeof(buffer));
+	if (size > 0)
 	{
-	    handleCtrlMessage(message);
+	    stdinPending_.append(buffer, (size_t) size);
 	}
-	else if (message.getAddressPattern().toString().startsWith("/heartbeat"))
+	else
 	{
-	    handleHeartbeatMessage(message);
+	    stdinPending_ += '\n';
 	}
-	else if (message.getAddressPattern().toString().startsWith("/loop4r/ping"))
+
+	size_t end;
+	while ((end = stdinPending_.find('\n')) != std::string::npos)
 	{
-	    handlePingMessage(message);
+	    runtimeCommands_.addLine(String(stdinPending_.c_str(), end));
+	    stdinPending_.erase(0, end + 1);
 	}
-	else if (message.getAddressPattern().toString().startsWith("/loop4r/leds"))
+	return size > 0;
+    }
+
+    void wakeControlThread()
+    {
+	controlWakeUp_.signal();
+	reactor_.wake();
+    }
+
+    void stopControlThread()
+    {
+	controlThread_.signalThreadShouldExit();
+	wakeControlThread();
+	controlThread_.stopThread(1000);
+    }
+
+    void addOscListener(OSCReceiver& receiver)
+    {
+	if (realtimeOsc_)
 	{
-	    handleLedsMessage(message);
+	    receiver.addListener(&realtimeOscListener_);
 	}
-	else if (message.getAddressPattern().toString().startsWith("/loop4r/display"))
+	else
 	{
-	    handleDisplayMessage(message);
+	    receiver.addListener(this);
 	}
-	else if (message.getAddressPattern().toString().startsWith("/loop4r/register_auto_update"))
+    }
+
+    void removeOscListener(OSCReceiver& receiver)
+    {
+	if (realtimeOsc_)
 	{
-	    handleRegisterAutoUpdateMessage(message, false);
+	    receiver.removeListener(&realtimeOscListener_);
 	}
-	else if (message.getAddressPattern().toString().startsWith("/loop4r/unregister_auto_update"))
+	else
 	{
-	    handleRegisterAutoUpdateMessage(message, true);
+	    receiver.removeListener(this);
 	}
     }
 
-    void oscBundleReceived (const OSCBundle& bundle) override
+    void startOscReceiver(OSCReceiver& receiver)
     {
-
+	addOscListener(receiver);
+	receiver.registerFormatErrorHandler ([this] (const char*, int)
+					     {
+						 oscGate_.reject(OscGate::Malformed);
+					     });
     }
 
     void connect()
@@ -1673,14 +9723,30 @@ private:
 	    return;
 	}
 
-	if (oscReceiver.connect (portToConnect))
+	if (useReactor_)
+	{
+	    // our own socket, watched by the reactor (straight away if it's running)
+	    oscSocket_ = new DatagramSocket(false);
+	    if (!oscSocket_->bindToPort(portToConnect))
+	    {
+		oscSocket_ = nullptr;
+		handleConnectError (portToConnect);
+		return;
+	    }
+	    configureOscSocket(*oscSocket_);
+	    oscDrops_ = 0;
+	    currentReceivePort_ = portToConnect;
+	    startup_.reached(StartupTimes::OscBound);
+	    if (controlThread_.isThreadRunning())
+	    {
+		reactor_.watch(oscSocket_->getRawSocketHandle(), ReactorOsc);
+	    }
+	}
+	else if (oscReceiver_->connect (portToConnect))
 	{
 	    currentReceivePort_ = portToConnect;
-	    oscReceiver.addListener (this);
-	    oscReceiver.registerFormatErrorHandler ([this] (const char* data, int dataSize)
-						    {
-							std::cerr << "- (" + String(dataSize) + "bytes with invalid format)" << std::endl;
-						    });
+	    startup_.reached(StartupTimes::OscBound);
+	    startOscReceiver(*oscReceiver_);
 	    //connectButton.setButtonText ("Disconnect");
 	}
 	else
@@ -1689,12 +9755,149 @@ private:
 	}
     }
 
+    // "epoll" (or "uring"): the MIDI and OSC reading moves to the control thread
+    void enableReactor()
+    {
+	if (!useReactor_)
+	{
+	    // "oin" and "dev" may have come first
+	    useReactor_ = true;
+	    reconnectOscInput();
+	    for (auto&& in : midiInputs_)
+	    {
+		in.input_ = nullptr;
+		in.fullName_ = String();
+	    }
+	}
+    }
+
+    // Moves the receive port to OSCReceiver or our own socket, whichever
+    // useReactor_ now asks for. A /pingack may have gone to the old one, so the
+    // engines are pinged again.
+    void reconnectOscInput()
+    {
+	if (currentReceivePort_ < 0)
+	{
+	    return;
+	}
+	disconnect();
+	connect();
+	if (currentReceivePort_ < 0 && receivePortTimer_ >= 0)
+	{
+	    wheel_.schedule(receivePortTimer_, time_.getMillisecondCounter() + (uint32) receivePortRetryMs);
+	}
+	for (auto* engine : engines_)
+	{
+	    if (engine->sender_.isConnected())
+	    {
+		engine->sender_.send(engine->packets_.pingAckPing());
+		engine->handshake_.start(time_.getMillisecondCounter());
+	    }
+	}
+    }
+
+    // Moves the receive port while we're running, make before break: the new
+    // port is bound while the old one still receives, the engines register
+    // their updates to the new one and then drop the old ones, and the old
+    // port is read for a while longer for what was already on its way. No
+    // ping, so the loops and LEDs carry on as they are.
+    void rebindOscInput()
+    {
+	const int oldPort = currentReceivePort_;
+	const int port = oscReceivePort_;
+	if (!isValidOscPort(port))
+	{
+	    handleInvalidPortNumberEntered();
+	    oscReceivePort_ = oldPort;
+	    return;
+	}
+
+	// a move that's still draining is done with now
+	closeOldOscInput();
+	if (useReactor_)
+	{
+	    ScopedPointer<DatagramSocket> socket(new DatagramSocket(false));
+	    if (!socket->bindToPort(port))
+	    {
+		handleConnectError(port);
+		oscReceivePort_ = oldPort;
+		return;
+	    }
+	    configureOscSocket(*socket);
+	    reactor_.unwatch(oscSocket_->getRawSocketHandle());
+	    oldOscSocket_ = oscSocket_.release();
+	    oldOscDrops_ = oscDrops_;
+	    oscSocket_ = socket.release();
+	    oscDrops_ = 0;
+	    reactor_.watch(oldOscSocket_->getRawSocketHandle(), ReactorOscDraining);
+	    reactor_.watch(oscSocket_->getRawSocketHandle(), ReactorOsc);
+	}
+	else
+	{
+	    ScopedPointer<OSCReceiver> receiver(new OSCReceiver());
+	    if (!receiver->connect(port))
+	    {
+		handleConnectError(port);
+		oscReceivePort_ = oldPort;
+		return;
+	    }
+	    oldOscReceiver_ = oscReceiver_.release();
+	    oscReceiver_ = receiver.release();
+	    startOscReceiver(*oscReceiver_);
+	}
+	currentReceivePort_ = port;
+
+	for (auto* engine : engines_)
+	{
+	    if (!engine->sender_.isConnected() || !engine->packets_.hasReturnUrl())
+	    {
+		continue;
+	    }
+	    engine->packets_.setReturnUrl(getReturnUrl(*engine, port), engine->pathPrefix_);
+	    if (engine->connected_ && engine->loopCount_ > 0)
+	    {
+		registerLoops(*engine, 0, engine->loops_.size(), true);
+	    }
+	    engine->packets_.setReturnUrl(getReturnUrl(*engine, oldPort), engine->pathPrefix_);
+	    {
+		// held with the registrations, so it still goes after them
+		const OscPacketSender::QueryScope query(engine->sender_);
+		OscBundleSender bundle(engine->sender_);
+		addUnregistrations(*engine, bundle);
+	    }
+	    engine->packets_.setReturnUrl(getReturnUrl(*engine, port), engine->pathPrefix_);
+	}
+	wheel_.scheduleIn(receivePortDrainTimer_, receivePortDrainMs, time_.getMillisecondCounter());
+	std::cerr << "Moved the OSC receive port from " << oldPort << " to " << port << std::endl;
+    }
+
+    void closeOldOscInput()
+    {
+	if (oldOscSocket_ != nullptr)
+	{
+	    reactor_.unwatch(oldOscSocket_->getRawSocketHandle());
+	    oldOscSocket_ = nullptr;
+	}
+	if (oldOscReceiver_ != nullptr)
+	{
+	    removeOscListener(*oldOscReceiver_);
+	    oldOscReceiver_->disconnect();
+	    oldOscReceiver_ = nullptr;
+	}
+    }
+
     void disconnect()
     {
-	if (oscReceiver.disconnect())
+	if (oscSocket_ != nullptr)
+	{
+	    reactor_.unwatch(oscSocket_->getRawSocketHandle());
+	    oscSocket_ = nullptr;
+	    currentReceivePort_ = -1;
+	}
+	else if (oscReceiver_->disconnect())
 	{
 	    currentReceivePort_ = -1;
-	    oscReceiver.removeListener (this);
+	    removeOscListener(*oscReceiver_);
 	    //connectButton.setButtonText ("Connect");
 	}
 	else
@@ -1738,7 +9941,7 @@ private:
     {
 	printVersion();
 	std::cerr << std::endl;
-	std::cerr << "Usage: " << ProjectInfo::projectName << " [ commands ] [ programfile ] [ -- ]" << std::endl << std::endl
+	std::cerr << "Usage: " << ProjectInfo::projectName << " [ commands ] [ programfile ] [ -- | --framed ]" << std::endl << std::endl
 	<< "Commands:" << std::endl;
 	for (auto&& cmd : commands_)
 	{
@@ -1757,6 +9960,11 @@ private:
 	std::cerr << "  -h  or  --help       Print Help (this message) and exit" << std::endl;
 	std::cerr << "  --version            Print version information and exit" << std::endl;
 	std::cerr << "  --                   Read commands from standard input until it's closed" << std::endl;
+	std::cerr << "  --framed             Read length prefixed binary command frames from standard input" << std::endl;
+	std::cerr << "  --startup-profile    Print how long each step of the startup took, once the LEDs are right" << std::endl;
+	std::cerr << std::endl;
+	std::cerr << "Commands from standard input, and those sent as /loop4r/cmd \"line\" or /loop4r/cmd" << std::endl
+	<< "word word... to the OSC receive port, are run between events while we're running." << std::endl;
 	std::cerr << std::endl;
 	std::cerr << "Alternatively, you can use the following long versions of the commands:" << std::endl;
 	String line = " ";
@@ -1784,53 +9992,379 @@ private:
 	std::cerr << std::endl;
     }
 
-    OSCReceiver oscReceiver;
-    OSCSender oscSender;
+    struct RealtimeOscListener : public OSCReceiver::Listener<OSCReceiver::RealtimeCallback>
+    {
+	RealtimeOscListener(loop4r_readApplication& owner) : owner_(owner) {}
+
+	void oscMessageReceived(const OSCMessage& message) override
+	{
+	    owner_.queueOscMessage(message);
+	}
+
+	void oscBundleReceived(const OSCBundle& bundle) override
+	{
+	    owner_.queueOscBundle(bundle);
+	}
+
+	loop4r_readApplication& owner_;
+    };
+
+    struct ControlThread : public Thread
+    {
+	ControlThread(loop4r_readApplication& owner) : Thread("loop4r control"), owner_(owner) {}
+	~ControlThread() { stopThread(1000); }
+
+	void run() override
+	{
+	    owner_.runControlLoop();
+	}
+
+	loop4r_readApplication& owner_;
+    };
+
+    // first, so everything recording into it has stopped before it goes
+    TraceCapture trace_;
+    TraceArchive archive_;      // of trace_
+    Metrics metrics_;                   // the same, counted into from every thread
+    SpanTrace spans_;                   // and recorded into
+    AllocationAccounting allocations_;  // and charged with what they allocated
+    EventJournal journal_;              // and journalled into
+    LogRateLimiter queueFullLog_ { 1, 5, 1 };  // a flood is reported about once a second
+    File spansFile_;
+
+    // declared before oscReceiver_ so its thread is stopped before these go away
+    RealtimeOscListener realtimeOscListener_;
+    SpscQueue<PedalEvent> pedalEvents_;     // MIDI input thread -> control thread
+    SpscQueue<OSCMessage> oscEvents_;       // OSC listener -> control thread
+    WaitableEvent controlWakeUp_;
+    TimingWheel wheel_;                 // control thread only, see createTimers()
+    int receivePortTimer_ = -1;
+    int expiryTimer_ = -1;
+    int periodicTimer_ = -1;
+    bool realtimeOsc_;
+    OscDispatcher<loop4r_readApplication> oscDispatcher_;
+    ScopedPointer<OSCReceiver> oscReceiver_ { new OSCReceiver() };
+    ScopedPointer<DatagramSocket> oscSocket_;   // instead of oscReceiver_ with "epoll"
+    ScopedPointer<OSCReceiver> oldOscReceiver_; // the port we've just moved from, see rebindOscInput()
+    ScopedPointer<DatagramSocket> oldOscSocket_;
+    CacheLinePadded<SpinLock> oscQueueLock_;    // both of them queue while the old port drains
+    int receivePortDrainTimer_ = -1;
+    int oscReceiveBufferBytes_ = 0;     // SO_RCVBUF and SO_SNDBUF for our OSC sockets, 0 leaves the kernel's
+    int oscSendBufferBytes_ = 0;
+    uint32 oscDrops_ = 0;               // what the kernel said it dropped on oscSocket_, and on oldOscSocket_
+    uint32 oldOscDrops_ = 0;
+    std::atomic<int64> numOscDropped_ { 0 };
+    int oscResyncTimer_ = -1;
+    int presenceTimer_ = -1;
+    int ledReplayTimer_ = -1;
+    int ledReplayBaud_ = 31250;         // "ledreplay", -1 for off
+    int ledReplayNext_ = -1;            // the next LED (then the two digits) it sends, -1 while idle
+    int64 numLedReplays_ = 0;
+    std::atomic<bool> ledReplayRequested_ { false };
+    SpinLock failoverLock_;             // "standby"
+    int64 numFailovers_ = 0;
+    bool presenceEnabled_ = false;      // "presence"
+    int presenceSilenceMs_ = 0;         // and how long an input without active sensing may be quiet, 0 for ever
+    bool useOscSendThread_ = false;
+    OscSendThread oscSendThread_;       // the engines' senders push to it with "osend"
+    int numHeldPasses_ = 0;             // the queries and LEDs have waited for pedals, see runControlPass()
+    OwnedArray<Engine> engines_;
+    int activeEngine_;
+    Engine* oscEngine_ = nullptr;   // engine the OSC message being handled came from
     OSCSender oscLedSender;
-    bool oscLedSenderInitialized_ = false;
+    OscCoalescer ctrlUpdates_;          // control thread only
+    ReplySenderPool replySenders_;      // answers to /loop4r queries, control thread only
 
     int currentReceivePort_ = -1;
-    int currentSendPort_ = -1;
     int currentLedSendPort_ = -1;
     int channel_;
     int baseNote_;
+    SlbBindings slbBindings_;
+    SlSession session_;
+    ScopedPointer<DatagramSocket> discoverySocket_;     // "discover"'s pings, whoever connects an engine
+    int discoverFirstPort_ = 0;
+    int discoverLastPort_ = 0;
+    int discoverWindowMs_ = 50;
+    PedalNotes pedalNotes_;             // from baseNote_ and slbBindings_, control thread once it runs
+    PedalCommands pedalCommands_;       // "slcmd", the same
+    bool ledFrames_ = false;            // "ledframes"
+    LedFrameWriter ledFramePush_;
+    int64 numLedFramesPushed_ = 0;
+    bool slCommands_ = false;
+    int64 numPedalCommandsSent_ = 0;
     int selected_;
-    int oscSendPort_;
     int oscReceivePort_;
     int oscLedSendPort_;
-    String oscRemoteHost_;
-    int oscRemotePort_;
-    int engineId_;
+    LedSubscribers ledSubscribers_;
+    LedStreamServer ledStream_;         // its thread serves the TCP clients
+    LocalOscSocket localSocket_;
+    LedMulticast ledMulticast_;
+    const LocalPeer* localPeer_ = nullptr;  // who sent what's being dispatched, if it came from localSocket_
     int mode_;
 
-    Array<Loop> loops_;
-    Array<LED> leds_;
+    LedFrameBuffer ledFrame_;           // handlers draw, commitLeds() shows
+    LedPatternSet ledPatterns_;         // blink_ has a copy of the patterns
+    AlsaLedPort ledPort_;       // outlives ledOutput_, which may be writing to it
+    bool useLedPort_ = false;
+    String ledPortDestination_;
+    LedPluginSink ledPlugin_;   // the same
+    GpioLedPort gpioLeds_;      // and again
+    Array<int> gpioPins_;
+    SpiLedPort spiLeds_;
+    String spiDevice_;
+    int spiBytes_ = 2;
+    DinLedPort dinLeds_;        // and again
+    String dinDevice_;
+    int dinBurst_ = 3;
+    String ledPluginPath_;
+    String ledPluginArgs_;
+    LedCommandOutput ledOutput_;
+    LedChangeFilter ledChanges_;
+    LedSharedState sharedLeds_;         // control thread only, once it runs
+    BlinkEngine blink_ { ledOutput_ };
+    bool blinkSync_ = false;
+    bool changeUpdates_ = false;
+    int adaptiveMs_ = 10;               // "adaptive"
+    int adaptiveHoldMs_ = 0;            // and how long a command keeps a loop fast, 0 for off
+    int reconcileMinMs_ = 0;            // "reconcile", 0 for off
+    int deliveryAttempts_ = 0;          // "deliver", 0 for off
+    int reconcileMaxMs_ = 0;
+    int64 numDivergences_ = 0;          // loops it found wrong, all engines
+    bool bankUpdates_ = false;
+    PedalBanks pedalBanks_;
+    int numPedalBanks_ = 1;
+    int loopsPerBank_ = 0;              // 0 for one per loop pedal
+    uint64 mirrorLoopControls_ = 0;     // asked for with "mirror", as ids
+    uint64 mirrorGlobalControls_ = 0;
+    int mirrorIntervalMs_ = 100;
+    enum ProgressMode { ProgressOff, ProgressDisplay, ProgressRing };
+    ProgressMode progressMode_ = ProgressOff;
+    int progressMs_ = 50;
+    Array<int> progressLeds_;
+    LoopProgress progress_;             // control thread
+    int progressStep_ = -1;             // what's drawn, -1 for nothing
+    int progressTimer_ = -1;
+    ControlSubscribers controlSubscribers_;
+    int hiddenPollMs_ = 10000;
+    bool predictLoops_ = false;
+    StateSnapshot snapshot_;            // published from the control thread
+    RcuSnapshot<PublishedState> publishedState_;    // by commitLeds(), read from any thread
+    int pollMs_ = 2000;
+    int selectedPollMs_ = 200;
+    EventLog eventLog_;
     Array<ApplicationCommand> commands_;
-    Array<ApplicationCommand> filterCommands_;
+    HashMap<String, int> commandLookup_;
+
+    struct CompiledFile
+    {
+	File file_;
+	Time modified_;
+	CommandScript script_;
+    };
+    OwnedArray<CompiledFile> compiledFiles_;
+    int benchmarkEvents_ = 0;
+    String benchmarkCtrlFile_;
+    String replayFile_;
+    bool replayRealtime_ = false;
+    String analyseFile_;
+    TraceAnalyser::Options analysis_;
+    double replayFrom_ = 0;     // seconds into an archive, and for how long (0 for the rest)
+    double replayFor_ = 0;
+    double soakMinutes_ = 0;
+    int soakRate_ = 20000;
+    double soakLimitKB_ = 1024;
+    double heartbeatLossMinutes_ = 0;   // "hbloss"
+    int heartbeatLossAliveMs_ = 60000;
+    SelfTest selfTest_;                 // "selftest"
+    double scaleSeconds_ = 0;           // "scale"
+    String scaleFile_;
+    bool selfTesting_ = false;
+    ControlClock time_;                 // the control thread's timing goes by this
+    bool simulating_ = false;
+    int loopbackEvents_ = 0;
+    bool journalOff_ = false;
+    File journalShowFile_;
+    int loopbackRate_ = 20;
+    SooperLooperSimulator::Options simulatorOptions_;
+    bool replaying_ = false;      // MIDI goes to midiStage_ (and the trace) without an output
+    MidiInputFilter midiFilter_;        // read by whichever thread takes the MIDI input
+    OverloadGuard overload_;            // "shed"
+    MidiFeedbackGuard feedback_;
+    int64 numFeedbackCutsReported_ = 0;
+    CacheLinePadded<std::atomic<int64>> numMidiFiltered_ {};   // by the MIDI threads
 
     bool noteNumbersOutput_;
     int octaveMiddleC_;
     bool useHexadecimalsByDefault_;
 
-    String midiInName_;
-    ScopedPointer<MidiInput> midiIn_;
-    String fullMidiInName_;
-
-    String midiOutName_;
-    ScopedPointer<MidiOutput> midiOut_;
-    String fullMidiOutName_;
-
-    String virtMidiOutName_;
-
-    int loopCount_;
-    int selectedLoop_;
-    bool pinged_;
-    String hostUrl_;
-    String version_;
-    int heartbeat_;
-
-    ApplicationCommand currentCommand_;
-    Time lastTime_;
+    MidiInputSource midiInputs_[AlsaMidiInput::maxSources];     // "din" is the first
+    int numMidiInputs_ = 0;
+
+    MidiOutputPort midiOutputs_[numMidiOutputRoles];
+    MidiOutputStage midiStage_;
+    BeatScheduler beatScheduler_ { midiStage_ };    // "quant", sends on its own timer
+    int quantiseBeats_ = 0;             // 1 for the beat, beats per bar for the bar, 0 off
+    int quantiseAheadMs_ = 0;
+    bool quantiseAutoAhead_ = false;
+    JackMidi jackMidi_;                 // with "jack", its process callback wakes the control thread
+    String jackClientName_;
+    String jackFrom_;
+    String jackTo_;
+    JackMeter jackMeter_;               // with "meter", read by renderMeter() every meterMs_
+    String meterFrom_;
+    Array<int> meterLeds_;
+    int meterMs_ = 30;
+    static constexpr float meterFloorDb = -48.0f;       // the bottom of the first LED
+    static const uint32 meterClipHoldMs = 1000;
+    int meterTimer_ = -1;
+    int meterRmsStep_ = -1;             // what's drawn, -1 for nothing
+    int meterPeakStep_ = -1;
+    bool meterClipped_ = false;
+    bool meterDrawn_ = false;
+    uint32 meterClipUntil_ = 0;
+    int64 numMeterClips_ = 0;
+    bool meterEnabled_ = false;
+    OnsetDetector onsetDetector_;       // with "onset", fed by jackMeter_, wakes the control thread
+    bool onsetEnabled_ = false;
+    float onsetThreshold_ = 0.05f;
+    float onsetSensitivity_ = 1.5f;
+    static const uint32 onsetHoldMs = 1000;      // for the loop's state to catch up
+    uint32 onsetHoldUntil_ = 0;
+    int64 numOnsetRecords_ = 0;
+    int64 numOnsetsIgnored_ = 0;
+    MidiMonitor midiMonitor_;           // with "monitor", its own thread prints the MIDI coming in
+    SysexCapture sysexCapture_;         // with "sysex", its own thread writes the dumps
+    int partialSysex_[AlsaMidiInput::maxSources] = {};      // what JUCE's inputs have passed on of a dump so far
+    SysexUploader sysexUploader_;       // with "upload", paced from its own thread
+    MidiRecorder midiRecorder_;         // with "mrec", its own thread writes the file
+    MidiFilePlayer midiPlayer_;         // with "play", its own thread wakes the control thread or flushes the stage
+    PitchTracker tuner_;                // with "tuner on" or its gesture, fed by jackMeter_
+    bool tuning_ = false;
+    bool startTuning_ = false;          // "tuner on" at startup, once the meter is open
+    Array<int> tunerLeds_ { 0, 1, 2, 3, 4 };
+    int tunerSharpLed_ = -1;
+    int tunerMs_ = 100;
+    static constexpr float tunerInTuneCents = 5.0f;
+    int tunerTimer_ = -1;
+    int tunerNote_ = -2;                // what's drawn, -1 for no note yet, -2 for nothing
+    int tunerNeedle_ = -2;
+    bool tunerOwns_[LedChangeFilter::maxLeds] = {};
+    bool tunerSaved_[LedChangeFilter::maxLeds] = {};
+    ExpressionMap expression_;
+    MidiClockFollower clock_;           // fed by whichever thread reads the MIDI
+    bool clockFollow_ = false;
+    double clockMinChange_ = 0.5;
+    int64 numClockTempoSent_ = 0;
+    NetworkClock netClock_;             // "netclock", control thread
+    String netClockHost_;               // empty while not following one
+    JackTransport jackTransport_;       // with "jtransport", polled every control pass
+    bool jackTransportEnabled_ = false;
+    int netClockPort_ = 0;
+    int netClockMs_ = 250;
+    int netClockTimer_ = -1;
+    int64 numNetClockRequests_ = 0;
+    int64 numNetClockAnswers_ = 0;      // as the leader
+    int hostClockPort_ = 0;             // "hostclock", 0 trusts the hosts' clocks to agree
+    PedalMacros macros_;
+    int macroLeadMs_ = 0;               // "osct", 0 sends steps when they're due
+    int64 numTimedBundles_ = 0;
+    int macroForKey_[PedalGestures::maxPedals];     // "mpedal", -1 for none
+    int numMacroPedals_ = 0;
+    LoopGroups loopGroups_;
+    int64 numGroupHits_ = 0;
+    int64 numTimedGroupHits_ = 0;
+    CycleTracker cycles_;               // "cycles", the active engine's loops
+    LoopStateStats loopStates_;         // time in and changes between the states drawn
+    int cycleSampleMs_ = 0;             // 0 gets loop_pos every 100ms instead
+    int cycleTimer_ = -1;
+    PedalScripts pedalScripts_ { *this };
+    int scriptForKey_[PedalGestures::maxPedals];    // "jpedal", -1 for none
+    int numScriptPedals_ = 0;
+    TapTempo tapTempo_;
+    int tapKey_ = -1;                   // "tap", keyed like the gestures
+    PedalDebounce debounce_;            // control thread, ahead of the gestures
+    PedalGestures gestures_;            // control thread, like the rest of the pedal handling
+    PedalChords chords_;                // "chord", and which pedals are held
+    GestureAction chordActions_[PedalChords::maxChords];
+    GestureAction gestureActions_[PedalGestures::maxPedals][3];     // long, double, repeat
+
+
+    // the command line command still taking options, nullptr before the first
+    const ApplicationCommand* currentCommand_ = nullptr;
+    StringArray currentOpts_;
+    int currentRemaining_ = 0;
+
+    LatencyStats latency_;
+    StartupTimes startup_;
+    bool startupReported_ = false;      // control thread, then shutdown
+    bool startupProfile_ = false;       // "--startup-profile"
+    bool startupProfiled_ = false;      // control thread, then shutdown
+    bool deferMidiPorts_ = false;       // while parsing the command line
+    bool dumpLatencyStats_;
+    // pedal-down times still waiting for their /ctrl and LED, control thread only
+    int64 pendingCtrlTicks_[LedChangeFilter::maxLeds];
+    int64 pendingSendTicks_[LedChangeFilter::maxLeds];     // when a loop's last note-on left (or will)
+    LatencyEstimate commandLatency_;    // from those to the loop's /ctrl
+    int64 numUncompensated_ = 0;
+    int64 pendingLedTicks_[LedChangeFilter::maxLeds];
+
+    // last, so their threads are gone before anything they poke
+    std::atomic<bool> midiDevicesChanged_ { false };
+    bool hotplugWakesControl_ = false;  // "idle": the control thread rescans, not the message thread
+    WorkerPool workers_;
+    int numWorkers_ = 0;                // "workers", 0 for one per free CPU, -1 for none
+    int midiPollTicks_ = 0;
+    ThreadTuning threadTuning_;
+    int threadTuningTicks_ = 0;
+    bool memoryLocked_ = false;
+    GigMode gig_;                       // "gig"
+    bool gigMode_ = false;
+    bool gigGovernor_ = false;
+    BigInteger gigCpus_;
+    String gigCpuList_;
+    LogLevel logCeiling_ = LogVerbose;  // the most the log goes to when nothing's shed
+
+    enum ReactorTag
+    {
+	ReactorMidi,
+	ReactorOsc,
+	ReactorOscDraining,
+	ReactorLocalOsc,
+	ReactorStdin,
+	ReactorByteMidi      // plus the input's index
+    };
+    bool useReactor_ = false;
+    bool idlePower_ = false;            // "idle"
+    int idlePingMs_ = 10000;
+    int64 controlStartTicks_ = 0;       // when the epoll loop started, for the wakeup rates
+    int64 controlEndTicks_ = 0;
+    ThreadAccounting::WakeupCounts controlStartWakeups_;
+    int64 idleWakeups_ = 0;             // all threads' while the epoll loop ran
+    EventReactor::Backend reactorBackend_ = EventReactor::Epoll;
+    bool readStdinCommands_ = false;
+    bool quitRequested_ = false;
+    EventReactor reactor_;
+    AlsaMidiInput sequencerInput_;      // instead of the JUCE inputs, on Linux
+    AlsaMidiThru midiThru_;             // "thru", under midiPortsLock_
+    bool midiThruEnabled_ = false;
+    int sequencerInputs_[AlsaMidiInput::maxSources] = {};  // its sources' indexes into midiInputs_
+    UdpBatchReader oscBatches_;
+    int64 oscArrivalTicks_ = 0;         // when the kernel had the datagram being handled, 0 if it didn't say
+    OscGate oscGate_ { oscGatePacketsPerSecond, oscGateBlockMs };     // "ogate", for what oscBatches_ reads
+    std::string stdinPending_;
+    bool readStdinInBackground_ = false;
+    bool stdinFramed_ = false;
+    RuntimeCommands runtimeCommands_;   // stdin reader and /loop4r/cmd -> control thread
+    StdinCommandReader stdinReader_ { runtimeCommands_ };
+    ProgramFileWatcher programWatcher_ { runtimeCommands_ };
+    bool reloadPrograms_ = true;
+    CriticalSection midiPortsLock_;     // keeps the device scan and runtime commands apart
+    MidiDeviceCatalogue midiDevices_;   // before midiHotplug_, whose thread invalidates it
+    MidiHotplugMonitor midiHotplug_;
+    MetricsServer metricsServer_ { metrics_ };     // its thread reads the gauges, see registerMetrics()
+    ThreadAccounting threadAccounting_ { allocations_ };
+    LoopbackLatency loopback_;
+    ControlThread controlThread_;
 };
 
 //==============================================================================
@@ -0,0 +1,497 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include <atomic>
+#include <cstring>
+#include <functional>
+
+#if JUCE_LINUX
+ #include <cerrno>
+ #include <poll.h>
+ #include <sys/socket.h>
+ #include <sys/un.h>
+ #include <unistd.h>
+#endif
+
+//==============================================================================
+// Counters for seeing inside a running rig. Every thread that counts gets a
+// shard of its own, so a count is a relaxed add to memory no other thread
+// writes and reading them (adding the shards up) never stops a writer. Past
+// numShards threads they start sharing, which only costs some contention.
+//
+// OSC is counted per address with the path segments that are just a number
+// folded to N, so /sl/0/hit and /sl/3/hit are one address. The first maxAddresses distinct
+// ones get a slot, the rest are counted as "other".
+//
+// Gauges are read by calling a function, on whichever thread reads the
+// metrics, so what they look at has to be safe to read from anywhere. They're
+// all added before anything reads, as are the families of samples.
+class Metrics
+{
+public:
+    enum Counter
+    {
+	MidiNoteOn,
+	MidiNoteOff,
+	MidiController,
+	MidiProgramChange,
+	MidiPitchBend,
+	MidiPressure,           // poly and channel aftertouch
+	MidiClock,
+	MidiOther,              // sysex, transport, sensing and the like
+	NotesOut,
+	Reconnects,             // engines given up on after losing their heartbeat
+	HeartbeatMisses,        // pings that went unanswered past their timeout
+	ControlWakeups,         // times the control thread came back from waiting
+	numCounters
+    };
+
+    enum Direction
+    {
+	OscIn,
+	OscOut,
+	numDirections
+    };
+
+    static const int numShards = 16;
+    static const int maxAddresses = 64;
+    static const int maxAddressLength = 48;
+
+    Metrics() {}
+
+    void add(Counter counter, int64 amount = 1)
+    {
+	getShard().counters_[counter].fetch_add((uint64) amount, std::memory_order_relaxed);
+    }
+
+    void countMidiIn(const uint8* data, int size)
+    {
+	if (size > 0)
+	{
+	    add(getCounter(data, size));
+	}
+    }
+
+    // an encoded message or bundle, each message in a bundle counted on its own
+    void countOscPacket(Direction direction, const void* data, int size)
+    {
+	const char* bytes = static_cast<const char*>(data);
+	if (size >= 16 && std::memcmp(bytes, "#bundle", 8) == 0)
+	{
+	    for (int pos = 16; pos + 4 <= size;)
+	    {
+		const int elementSize = (int) (((uint32) (uint8) bytes[pos] << 24) | ((uint32) (uint8) bytes[pos + 1] << 16)
+					       | ((uint32) (uint8) bytes[pos + 2] << 8) | (uint32) (uint8) bytes[pos + 3]);
+		if (elementSize <= 0 || elementSize > size - pos - 4)
+		{
+		    break;
+		}
+		countOscPacket(direction, bytes + pos + 4, elementSize);
+		pos += 4 + elementSize;
+	    }
+	}
+	else if (size > 0)
+	{
+	    countOscAddress(direction, bytes, size);
+	}
+    }
+
+    // address doesn't need to be terminated within maxLength
+    void countOscAddress(Direction direction, const char* address, int maxLength = maxAddressLength)
+    {
+	getShard().osc_[direction][findAddress(address, maxLength)].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // isCounter says it only goes up (a total kept elsewhere), labels are
+    // Prometheus ones like queue="pedal"
+    void addGauge(const String& name, const String& labels, const String& help, std::function<int64()> read, bool isCounter = false)
+    {
+	gauges_.add({name, labels, help, isCounter, read});
+    }
+
+    // Samples that come and go with what they count, like one per loop and
+    // state: read(emit) calls emit(labels, value) for each there is now
+    typedef std::function<void(const String& labels, int64 value)> Emit;
+    void addSamples(const String& name, const String& help, std::function<void(const Emit&)> read, bool isCounter = false)
+    {
+	families_.add({name, help, isCounter, read});
+    }
+
+    int64 get(Counter counter) const
+    {
+	uint64 sum = 0;
+	for (auto&& shard : shards_)
+	{
+	    sum += shard.counters_[counter].load(std::memory_order_relaxed);
+	}
+	return (int64) sum;
+    }
+
+    // Calls fn(name, labels, help, isCounter, value) for every sample, those
+    // sharing a name one after the other
+    template <typename Function>
+    void forEachSample(Function fn) const
+    {
+	for (int i = 0; i < numCounters; ++i)
+	{
+	    const Description& description = getDescription((Counter) i);
+	    fn(String(description.name_), String(description.labels_), String(description.help_), true, get((Counter) i));
+	}
+
+	for (int direction = 0; direction < numDirections; ++direction)
+	{
+	    const String labels = direction == OscIn ? "direction=\"in\",address=\"" : "direction=\"out\",address=\"";
+	    // the slots are shared by both directions, so skip the unused side
+	    for (int slot = 0; slot <= maxAddresses; ++slot)
+	    {
+		const bool other = slot == maxAddresses;
+		if (!other && !addresses_[slot].ready_.load(std::memory_order_acquire))
+		{
+		    continue;
+		}
+		uint64 sum = 0;
+		for (auto&& shard : shards_)
+		{
+		    sum += shard.osc_[direction][slot].load(std::memory_order_relaxed);
+		}
+		if (sum > 0)
+		{
+		    fn(String("loop4r_osc_messages_total"), labels + (other ? "other" : addresses_[slot].name_) + "\"",
+		       String("OSC messages by direction and address"), true, (int64) sum);
+		}
+	    }
+	}
+
+	for (auto&& gauge : gauges_)
+	{
+	    fn(gauge.name_, gauge.labels_, gauge.help_, gauge.isCounter_, gauge.read_());
+	}
+
+	for (auto&& family : families_)
+	{
+	    family.read_([&] (const String& labels, int64 value) { fn(family.name_, labels, family.help_, family.isCounter_, value); });
+	}
+    }
+
+    // the Prometheus text exposition format
+    String getText() const
+    {
+	MemoryOutputStream out;
+	String lastName;
+	forEachSample([&] (const String& name, const String& labels, const String& help, bool isCounter, int64 value)
+		      {
+			  if (name != lastName)
+			  {
+			      out << "# HELP " << name << " " << help << "\n"
+				  << "# TYPE " << name << (isCounter ? " counter\n" : " gauge\n");
+			      lastName = name;
+			  }
+			  out << name << (labels.isEmpty() ? String() : "{" + labels + "}") << " " << String(value) << "\n";
+		      });
+	return out.toString();
+    }
+
+private:
+    struct Description
+    {
+	const char* name_;
+	const char* labels_;
+	const char* help_;
+    };
+
+    static const Description& getDescription(Counter counter)
+    {
+	static const Description descriptions[numCounters] =
+	{
+	    { "loop4r_midi_in_total",           "type=\"note_on\"",     "MIDI messages in by type" },
+	    { "loop4r_midi_in_total",           "type=\"note_off\"",    "MIDI messages in by type" },
+	    { "loop4r_midi_in_total",           "type=\"cc\"",          "MIDI messages in by type" },
+	    { "loop4r_midi_in_total",           "type=\"pc\"",          "MIDI messages in by type" },
+	    { "loop4r_midi_in_total",           "type=\"bend\"",        "MIDI messages in by type" },
+	    { "loop4r_midi_in_total",           "type=\"pressure\"",    "MIDI messages in by type" },
+	    { "loop4r_midi_in_total",           "type=\"clock\"",       "MIDI messages in by type" },
+	    { "loop4r_midi_in_total",           "type=\"other\"",       "MIDI messages in by type" },
+	    { "loop4r_notes_out_total",         "",                     "Note ons sent" },
+	    { "loop4r_reconnects_total",        "",                     "Engines given up on after losing their heartbeat" },
+	    { "loop4r_heartbeat_misses_total",  "",                     "Pings unanswered past their timeout" },
+	    { "loop4r_control_wakeups_total",   "",                     "Times the control thread came back from waiting" }
+	};
+	return descriptions[counter];
+    }
+
+    static Counter getCounter(const uint8* data, int size)
+    {
+	switch (data[0] & 0xf0)
+	{
+	    case 0x80:  return MidiNoteOff;
+	    case 0x90:  return size >= 3 && data[2] == 0 ? MidiNoteOff : MidiNoteOn;
+	    case 0xa0:  return MidiPressure;
+	    case 0xb0:  return MidiController;
+	    case 0xc0:  return MidiProgramChange;
+	    case 0xd0:  return MidiPressure;
+	    case 0xe0:  return MidiPitchBend;
+	    default:    return data[0] == 0xf8 ? MidiClock : MidiOther;
+	}
+    }
+
+    static bool isDigit(char c)     { return c >= '0' && c <= '9'; }
+
+    // The slot for address, claiming a free one the first time it's seen:
+    // whoever wins the hash's slot writes the name, readers skip it until then
+    int findAddress(const char* address, int maxLength)
+    {
+	char name[maxAddressLength];
+	uint32 hash = 2166136261u;
+	int length = 0;
+	for (int i = 0; i < maxLength && address[i] != 0 && length < maxAddressLength - 1; ++i)
+	{
+	    char c = address[i];
+	    if (isDigit(c) && i > 0 && (address[i - 1] == '/' || (address[i - 1] == '-' && i > 1 && address[i - 2] == '/')))
+	    {
+		int end = i;
+		while (end < maxLength && isDigit(address[end]))
+		{
+		    ++end;
+		}
+		if (end == maxLength || address[end] == 0 || address[end] == '/')
+		{
+		    // a segment that's just a number, a loop index
+		    c = 'N';
+		    i = end - 1;
+		}
+	    }
+	    else if (c < 0x20 || c >= 0x7f || c == '"' || c == '\\')
+	    {
+		c = '_';
+	    }
+	    name[length++] = c;
+	    hash = (hash ^ (uint8) c) * 16777619u;
+	}
+	name[length] = 0;
+	hash = jmax(hash, 1u);     // 0 marks a free slot
+
+	for (int probe = 0; probe < maxAddresses; ++probe)
+	{
+	    Address& slot = addresses_[(hash + (uint32) probe) % maxAddresses];
+	    uint32 seen = slot.hash_.load(std::memory_order_acquire);
+	    if (seen == 0)
+	    {
+		if (slot.hash_.compare_exchange_strong(seen, hash, std::memory_order_acq_rel))
+		{
+		    std::memcpy(slot.name_, name, (size_t) length + 1);
+		    slot.ready_.store(true, std::memory_order_release);
+		    return (int) (&slot - addresses_);
+		}
+	    }
+	    if (seen == hash)
+	    {
+		return (int) (&slot - addresses_);
+	    }
+	}
+	return maxAddresses;
+    }
+
+    // a cache line of padding after each, so no two threads' counters share
+    // one whatever the alignment the allocator gave us
+    struct Shard
+    {
+	std::atomic<uint64> counters_[numCounters] = {};
+	std::atomic<uint64> osc_[numDirections][maxAddresses + 1] = {};
+	char padding_[64];
+    };
+
+    struct Address
+    {
+	std::atomic<uint32> hash_ { 0 };
+	std::atomic<bool> ready_ { false };
+	char name_[maxAddressLength];
+    };
+
+    struct Gauge
+    {
+	String name_;
+	String labels_;
+	String help_;
+	bool isCounter_;
+	std::function<int64()> read_;
+    };
+
+    struct Family
+    {
+	String name_;
+	String help_;
+	bool isCounter_;
+	std::function<void(const Emit&)> read_;
+    };
+
+    // this thread's, handed out in turn the first time a thread counts
+    Shard& getShard()
+    {
+	static std::atomic<int> nextShard { 0 };
+	thread_local const int shard = nextShard.fetch_add(1, std::memory_order_relaxed) % numShards;
+	return shards_[shard];
+    }
+
+    Shard shards_[numShards];
+    Address addresses_[maxAddresses];
+    Array<Gauge> gauges_;
+    Array<Family> families_;
+
+    JUCE_DECLARE_NON_COPYABLE(Metrics)
+};
+
+//==============================================================================
+// Serves the metrics in the Prometheus text format on a Unix domain socket,
+// one snapshot per connection, from a thread of its own so reading them costs
+// the rest nothing. A client that sends an HTTP request first
+// (curl --unix-socket path http://localhost/metrics) gets an HTTP answer, one
+// that just connects (socat - UNIX-CONNECT:path) gets the bare text.
+class MetricsServer : private Thread
+{
+public:
+    static const int requestWaitMs = 100;
+
+    explicit MetricsServer(const Metrics& metrics) : Thread("loop4r metrics"), metrics_(metrics) {}
+
+    ~MetricsServer()
+    {
+	stop();
+    }
+
+#if JUCE_LINUX
+    // replaces whatever socket is left at path from an earlier run
+    bool start(const String& path)
+    {
+	stop();
+	sockaddr_un address = {};
+	address.sun_family = AF_UNIX;
+	if (path.getNumBytesAsUTF8() >= sizeof(address.sun_path))
+	{
+	    return false;
+	}
+	std::strcpy(address.sun_path, path.toRawUTF8());
+
+	fd_ = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	::unlink(address.sun_path);
+	if (fd_ < 0 || ::bind(fd_, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 || ::listen(fd_, 4) != 0)
+	{
+	    stop();
+	    return false;
+	}
+	path_ = path;
+	startThread();
+	return true;
+    }
+
+    void stop()
+    {
+	if (fd_ >= 0)
+	{
+	    signalThreadShouldExit();
+	    ::shutdown(fd_, SHUT_RDWR);        // wakes the accept()
+	    stopThread(1000);
+	    ::close(fd_);
+	    fd_ = -1;
+	}
+	if (path_.isNotEmpty())
+	{
+	    ::unlink(path_.toRawUTF8());
+	    path_ = String();
+	}
+    }
+#else
+    bool start(const String&)   { return false; }
+    void stop()                 {}
+#endif
+
+    bool isRunning() const              { return isThreadRunning(); }
+    const String& getPath() const       { return path_; }
+    int64 getNumServed() const          { return numServed_.load(); }
+
+private:
+#if JUCE_LINUX
+    void run() override
+    {
+	while (!threadShouldExit())
+	{
+	    const int client = ::accept4(fd_, nullptr, nullptr, SOCK_CLOEXEC);
+	    if (client < 0)
+	    {
+		if (errno != EINTR && !threadShouldExit())
+		{
+		    wait(requestWaitMs);
+		}
+		continue;
+	    }
+	    serve(client);
+	    ::close(client);
+	}
+    }
+
+    void serve(int client)
+    {
+	pollfd request = { client, POLLIN, 0 };
+	char buffer[1024];
+	bool http = false;
+	if (::poll(&request, 1, requestWaitMs) > 0)
+	{
+	    const ssize_t size = ::recv(client, buffer, sizeof(buffer), MSG_DONTWAIT);
+	    http = size >= 4 && std::memcmp(buffer, "GET ", 4) == 0;
+	}
+
+	const String text = metrics_.getText();
+	const String header = http ? "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: "
+	    + String(text.getNumBytesAsUTF8()) + "\r\n\r\n" : String();
+	if (writeAll(client, header.toRawUTF8(), header.getNumBytesAsUTF8()) && writeAll(client, text.toRawUTF8(), text.getNumBytesAsUTF8()))
+	{
+	    ++numServed_;
+	}
+    }
+
+    static bool writeAll(int fd, const char* data, size_t size)
+    {
+	while (size > 0)
+	{
+	    const ssize_t written = ::send(fd, data, size, MSG_NOSIGNAL);
+	    if (written < 0 && errno == EINTR)
+	    {
+		continue;
+	    }
+	    if (written <= 0)
+	    {
+		return false;
+	    }
+	    data += written;
+	    size -= (size_t) written;
+	}
+	return true;
+    }
+#else
+    void run() override {}
+#endif
+
+    const Metrics& metrics_;
+    int fd_ = -1;
+    String path_;
+    std::atomic<int64> numServed_ { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE(MetricsServer)
+};
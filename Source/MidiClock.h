@@ -0,0 +1,190 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include <cmath>
+
+//==============================================================================
+// Follows an external MIDI clock (24 clocks a beat) with a second order phase
+// locked loop: each clock is compared with when the loop expected it, and a
+// small share of the error corrects the phase and a smaller one the period.
+// The gains are the alpha-beta tracker's, with beta = alpha^2 / (2 - alpha)
+// for a critically damped response, so a steady clock is followed with the
+// jitter of single intervals averaged out, while a clock that jumps by more
+// than half a period, or stops for a while, is simply locked onto afresh.
+//
+// Start makes the next clock the downbeat, a song position pointer moves the
+// count. Times are Time::getHighResolutionTicks() values. The MIDI reader
+// feeds it and the control thread reads it, hence the lock.
+class MidiClockFollower
+{
+public:
+    static const int clocksPerBeat = 24;
+    static constexpr double alpha = 0.1;
+    static constexpr double beta = alpha * alpha / (2.0 - alpha);
+    static constexpr double maxGapSeconds = 0.25;   // a clock slower than 10bpm isn't one
+    static const int clocksToLock = clocksPerBeat;  // a beat's worth before we trust it
+
+    MidiClockFollower() {}
+
+    void clock(int64 ticks)
+    {
+	const SpinLock::ScopedLockType lock(lock_);
+	++numClocks_;
+	++clockCount_;
+
+	const double t = (double) ticks;
+	const double ticksPerSecond = (double) Time::getHighResolutionTicksPerSecond();
+	if (lastTicks_ == 0 || (t - lastTicks_) > maxGapSeconds * ticksPerSecond)
+	{
+	    relock(t, 0);
+	}
+	else if (period_ <= 0)
+	{
+	    relock(t, t - lastTicks_);
+	}
+	else
+	{
+	    const double expected = predicted_ + period_;
+	    const double error = t - expected;
+	    if (std::abs(error) > period_ / 2)
+	    {
+		++numRelocks_;
+		relock(t, t - lastTicks_);
+	    }
+	    else
+	    {
+		predicted_ = expected + alpha * error;
+		period_ += beta * error;
+		const double errorMicros = error / ticksPerSecond * 1.0e6;
+		jitterSquared_ += 0.05 * (errorMicros * errorMicros - jitterSquared_);
+		++numLocked_;
+	    }
+	}
+	lastTicks_ = t;
+    }
+
+    // 0xfa: the next clock is beat one
+    void start()
+    {
+	const SpinLock::ScopedLockType lock(lock_);
+	clockCount_ = -1;
+	running_ = true;
+    }
+
+    // 0xfb
+    void resume()
+    {
+	const SpinLock::ScopedLockType lock(lock_);
+	running_ = true;
+    }
+
+    // 0xfc
+    void stop()
+    {
+	const SpinLock::ScopedLockType lock(lock_);
+	running_ = false;
+    }
+
+    // 0xf2 counts in sixteenths, six clocks each; the next clock is that one
+    void songPosition(int sixteenths)
+    {
+	const SpinLock::ScopedLockType lock(lock_);
+	clockCount_ = (int64) sixteenths * 6 - 1;
+    }
+
+    // locked and still hearing clocks
+    bool isLocked(int64 now) const
+    {
+	const SpinLock::ScopedLockType lock(lock_);
+	return numLocked_ >= clocksToLock && (double) now - lastTicks_ <= maxGapSeconds * (double) Time::getHighResolutionTicksPerSecond();
+    }
+
+    bool isRunning() const
+    {
+	const SpinLock::ScopedLockType lock(lock_);
+	return running_;
+    }
+
+    double getBpm() const
+    {
+	const SpinLock::ScopedLockType lock(lock_);
+	return period_ > 0 ? 60.0 * (double) Time::getHighResolutionTicksPerSecond() / (period_ * clocksPerBeat) : 0;
+    }
+
+    // beats since Start (or the song position) at now, between clocks from
+    // the locked period
+    double getBeats(int64 now) const
+    {
+	const SpinLock::ScopedLockType lock(lock_);
+	if (period_ <= 0)
+	{
+	    return 0;
+	}
+	const double sinceClock = jlimit(0.0, 1.0, ((double) now - predicted_) / period_);
+	return (clockCount_ + sinceClock) / clocksPerBeat;
+    }
+
+    // where in the beat now is, 0..1
+    double getPhase(int64 now) const
+    {
+	const double beats = getBeats(now);
+	return beats - std::floor(beats);
+    }
+
+    double getTicksPerBeat() const
+    {
+	const SpinLock::ScopedLockType lock(lock_);
+	return period_ * clocksPerBeat;
+    }
+
+    // rms of the clocks' deviation from the loop's prediction
+    double getJitterMicros() const
+    {
+	const SpinLock::ScopedLockType lock(lock_);
+	return std::sqrt(jitterSquared_);
+    }
+
+    int64 getNumClocks() const          { const SpinLock::ScopedLockType lock(lock_); return numClocks_; }
+    int64 getNumRelocks() const         { const SpinLock::ScopedLockType lock(lock_); return numRelocks_; }
+
+private:
+    void relock(double t, double period)
+    {
+	predicted_ = t;
+	period_ = period;
+	numLocked_ = 0;
+	jitterSquared_ = 0;
+    }
+
+    mutable SpinLock lock_;
+    double lastTicks_ = 0;
+    double predicted_ = 0;      // when the loop puts the last clock
+    double period_ = 0;         // ticks per clock
+    double jitterSquared_ = 0;
+    int64 clockCount_ = -1;     // the last clock's, counted from Start
+    bool running_ = false;
+    int64 numLocked_ = 0;
+    int64 numClocks_ = 0;
+    int64 numRelocks_ = 0;
+
+    JUCE_DECLARE_NON_COPYABLE(MidiClockFollower)
+};
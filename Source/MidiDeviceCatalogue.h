@@ -0,0 +1,124 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include <atomic>
+
+//==============================================================================
+// The MIDI input and output device lists, kept until something says they're
+// out of date. Listing the devices opens a throwaway ALSA sequencer client and
+// walks every port, and matching a port by name used to do that two or three
+// times over. invalidate() bumps a generation counter (from any thread, e.g.
+// the hotplug monitor's); the next lookup lists the devices again, every other
+// one is answered from the cache.
+class MidiDeviceCatalogue
+{
+public:
+    MidiDeviceCatalogue() {}
+
+    void invalidate()
+    {
+	generation_.fetch_add(1, std::memory_order_release);
+    }
+
+    StringArray getInputs()             { return get(inputs_); }
+    StringArray getOutputs()            { return get(outputs_); }
+
+    // index of the device called name or else the first one with name in it,
+    // -1 if there's neither; fullName is the device's own name
+    int findInput(const String& name, String& fullName)     { return find(inputs_, name, fullName); }
+    int findOutput(const String& name, String& fullName)    { return find(outputs_, name, fullName); }
+
+    bool hasInput(const String& fullName)
+    {
+	const ScopedLock lock(lock_);
+	return refresh(inputs_).contains(fullName);
+    }
+
+    int64 getNumLookups() const         { return numLookups_; }
+    int64 getNumHits() const            { return numHits_; }
+
+    double getHitRate() const
+    {
+	return numLookups_ > 0 ? (double) numHits_ / (double) numLookups_ : 0.0;
+    }
+
+private:
+    struct DeviceList
+    {
+	DeviceList(bool inputs) : inputs_(inputs) {}
+
+	const bool inputs_;
+	uint32 generation_ = 0;
+	StringArray names_;
+    };
+
+    StringArray get(DeviceList& list)
+    {
+	const ScopedLock lock(lock_);
+	return refresh(list);
+    }
+
+    int find(DeviceList& list, const String& name, String& fullName)
+    {
+	const ScopedLock lock(lock_);
+	const StringArray& names = refresh(list);
+	int index = names.indexOf(name);
+	if (index < 0)
+	{
+	    for (int i = 0; i < names.size() && index < 0; ++i)
+	    {
+		if (names[i].containsIgnoreCase(name))
+		{
+		    index = i;
+		}
+	    }
+	}
+	fullName = index >= 0 ? names[index] : String();
+	return index;
+    }
+
+    // call with lock_ held
+    const StringArray& refresh(DeviceList& list)
+    {
+	++numLookups_;
+	const uint32 generation = generation_.load(std::memory_order_acquire);
+	if (list.generation_ == generation)
+	{
+	    ++numHits_;
+	}
+	else
+	{
+	    list.names_ = list.inputs_ ? MidiInput::getDevices() : MidiOutput::getDevices();
+	    list.generation_ = generation;
+	}
+	return list.names_;
+    }
+
+    CriticalSection lock_;
+    std::atomic<uint32> generation_ { 1 };
+    DeviceList inputs_ { true };
+    DeviceList outputs_ { false };
+    std::atomic<int64> numLookups_ { 0 };
+    std::atomic<int64> numHits_ { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE(MidiDeviceCatalogue)
+};
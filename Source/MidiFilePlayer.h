@@ -0,0 +1,241 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "LockFreeQueue.h"
+#include "MidiOutputStage.h"
+#include <atomic>
+#include <cstring>
+#include <functional>
+#if JUCE_LINUX
+ #include <time.h>
+#endif
+
+//==============================================================================
+// Plays a Standard MIDI File's short messages on a thread of its own, each
+// at its time: onto a queue for the control thread to take as input (onInput
+// is called to wake it), for automation and repeatable load, or straight to
+// the output stage. The file is flattened to one array up front (all tracks,
+// tempo changes applied), so playing it allocates nothing.
+//
+// Every event is due at its offset from when the pass started, and a repeat
+// starts where the last one ended, so however long the session timing never
+// drifts. The thread sleeps to each deadline with clock_nanosleep on
+// CLOCK_MONOTONIC, the clock high resolution ticks are read from, which is
+// tens of microseconds off where a 1ms timer would be a millisecond. What's
+// due together goes together, one wake or flush for the lot.
+class MidiFilePlayer : private Thread
+{
+public:
+    static const int queueSize = 1024;
+
+    struct Event
+    {
+	int64 ticks_;       // from the start of a pass in the file, when it was due on the queue
+	uint8 data_[3];
+	uint8 size_;
+    };
+
+    MidiFilePlayer()
+	: Thread("loop4r midi player"), input_(queueSize)
+    {
+    }
+
+    ~MidiFilePlayer()
+    {
+	stop();
+    }
+
+    // replaces what was loaded, false with why in error if there's nothing to play
+    bool load(const File& file, String& error)
+    {
+	stop();
+	events_.clearQuick();
+	FileInputStream in(file);
+	MidiFile midi;
+	if (in.failedToOpen() || !midi.readFrom(in))
+	{
+	    error = "isn't a MIDI file";
+	    return false;
+	}
+	midi.convertTimestampTicksToSeconds();
+
+	MidiMessageSequence all;
+	for (int track = 0; track < midi.getNumTracks(); ++track)
+	{
+	    all.addSequence(*midi.getTrack(track), 0.0, 0.0, 1.0e9);
+	}
+	all.sort();
+
+	const double ticksPerSecond = (double) Time::getHighResolutionTicksPerSecond();
+	for (int i = 0; i < all.getNumEvents(); ++i)
+	{
+	    const MidiMessage& message = all.getEventPointer(i)->message;
+	    const int size = message.getRawDataSize();
+	    if (size < 1 || size > 3 || message.isMetaEvent() || message.isSysEx())
+	    {
+		continue;
+	    }
+	    Event event = { (int64) (message.getTimeStamp() * ticksPerSecond), { 0, 0, 0 }, (uint8) size };
+	    std::memcpy(event.data_, message.getRawData(), (size_t) size);
+	    events_.add(event);
+	}
+	if (events_.isEmpty())
+	{
+	    error = "has no events to play";
+	    return false;
+	}
+	// a pass lasts until the end of the file's longest track, however quiet that is
+	length_ = jmax(events_.getLast().ticks_ + 1, (int64) (midi.getLastTimestamp() * ticksPerSecond));
+	file_ = file;
+	return true;
+    }
+
+    // times 0 to repeat until stopped; without onInput it goes to stage
+    void start(int times, MidiOutputStage& stage, std::function<void()> onInput)
+    {
+	stop();
+	times_ = times;
+	stage_ = &stage;
+	onInput_ = onInput;
+	numPlayed_.store(0);
+	numDropped_.store(0);
+	maxLateTicks_.store(0);
+	totalLateTicks_.store(0);
+	startThread(9);
+    }
+
+    void stop()
+    {
+	stopThread(1000);
+    }
+
+    bool isPlaying() const          { return isThreadRunning(); }
+    bool isPlayingToInput() const   { return isThreadRunning() && onInput_ != nullptr; }
+
+    // control thread, while playing to the input
+    bool popInput(Event& event)
+    {
+	return input_.pop(event);
+    }
+
+    const File& getFile() const     { return file_; }
+    int getNumEvents() const        { return events_.size(); }
+    double getLengthSeconds() const { return Time::highResolutionTicksToSeconds(length_); }
+
+    int64 getNumPlayed() const      { return numPlayed_.load(); }
+    int64 getNumDropped() const     { return numDropped_.load(); }
+    double getMaxLateMs() const     { return Time::highResolutionTicksToSeconds(maxLateTicks_.load()) * 1000.0; }
+    double getAverageLateMs() const
+    {
+	const int64 played = numPlayed_.load();
+	return played > 0 ? Time::highResolutionTicksToSeconds(totalLateTicks_.load()) * 1000.0 / played : 0.0;
+    }
+
+private:
+    void run() override
+    {
+	int64 passStart = Time::getHighResolutionTicks();
+	for (int pass = 0; (times_ == 0 || pass < times_) && !threadShouldExit(); ++pass)
+	{
+	    int i = 0;
+	    while (i < events_.size() && !threadShouldExit())
+	    {
+		const int64 due = passStart + events_.getReference(i).ticks_;
+		if (!sleepUntil(due))
+		{
+		    continue;       // woken to look at threadShouldExit()
+		}
+		const int64 now = Time::getHighResolutionTicks();
+		int numDue = 0;
+		while (i < events_.size() && passStart + events_.getReference(i).ticks_ <= now)
+		{
+		    Event event = events_.getReference(i++);
+		    event.ticks_ += passStart;
+		    deliver(event);
+		    maxLateTicks_.store(jmax(maxLateTicks_.load(std::memory_order_relaxed), now - event.ticks_), std::memory_order_relaxed);
+		    totalLateTicks_.fetch_add(now - event.ticks_, std::memory_order_relaxed);
+		    ++numDue;
+		}
+		if (onInput_ != nullptr)
+		{
+		    onInput_();
+		}
+		else
+		{
+		    stage_->flush();
+		}
+		numPlayed_.fetch_add(numDue, std::memory_order_relaxed);
+	    }
+	    passStart += length_;
+	}
+    }
+
+    void deliver(const Event& event)
+    {
+	if (onInput_ == nullptr)
+	{
+	    stage_->add(MidiMessage(event.data_, event.size_));
+	}
+	else if (!input_.push(event))
+	{
+	    numDropped_.fetch_add(1, std::memory_order_relaxed);
+	}
+    }
+
+    // false if it gave up early to let the caller look at threadShouldExit()
+    bool sleepUntil(int64 due)
+    {
+	const int64 now = Time::getHighResolutionTicks();
+	if (due <= now)
+	{
+	    return true;
+	}
+	const int64 ticksPerSecond = Time::getHighResolutionTicksPerSecond();
+	const int64 target = jmin(due, now + ticksPerSecond / 10);
+#if JUCE_LINUX
+	// high resolution ticks are CLOCK_MONOTONIC in microseconds here
+	timespec deadline;
+	deadline.tv_sec = (time_t) (target / ticksPerSecond);
+	deadline.tv_nsec = (long) ((target % ticksPerSecond) * (1000000000 / ticksPerSecond));
+	while (::clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, nullptr) == EINTR)
+	{
+	}
+#else
+	wait((int) jmax((int64) 1, (target - now) * 1000 / ticksPerSecond));
+#endif
+	return target == due;
+    }
+
+    Array<Event> events_;
+    int64 length_ = 0;
+    File file_;
+    int times_ = 1;
+    MidiOutputStage* stage_ = nullptr;
+    std::function<void()> onInput_;
+    SpscQueue<Event> input_;        // our thread -> control thread
+    std::atomic<int64> numPlayed_ { 0 };
+    std::atomic<int64> numDropped_ { 0 };
+    std::atomic<int64> maxLateTicks_ { 0 };
+    std::atomic<int64> totalLateTicks_ { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE(MidiFilePlayer)
+};
@@ -0,0 +1,184 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include <functional>
+
+#if JUCE_LINUX && JUCE_ALSA
+ #include <alsa/asoundlib.h>
+ #include <cerrno>
+ #include <fcntl.h>
+ #include <poll.h>
+ #include <unistd.h>
+#endif
+
+//==============================================================================
+// Watches the ALSA sequencer's System:Announce port and calls onChange (on the
+// monitor thread) whenever a port appears, goes away or changes. The thread
+// sleeps in poll() until the kernel has something for us, so an idle box pays
+// nothing for it. Client start/exit events are ignored on purpose: JUCE opens
+// and closes a throwaway client every time it lists the devices, and reacting
+// to those would have us rescanning forever.
+//
+// start() returns false when there's no sequencer, callers keep polling then.
+class MidiHotplugMonitor : private Thread
+{
+public:
+    MidiHotplugMonitor() : Thread("loop4r MIDI hotplug") {}
+
+    ~MidiHotplugMonitor()
+    {
+	stop();
+    }
+
+#if JUCE_LINUX && JUCE_ALSA
+    bool start(std::function<void()> onChange)
+    {
+	if (isThreadRunning())
+	{
+	    return true;
+	}
+
+	if (snd_seq_open(&seq_, "default", SND_SEQ_OPEN_INPUT, SND_SEQ_NONBLOCK) < 0)
+	{
+	    seq_ = nullptr;
+	    return false;
+	}
+
+	snd_seq_set_client_name(seq_, "loop4r hotplug");
+	const int port = snd_seq_create_simple_port(seq_, "announce",
+						    SND_SEQ_PORT_CAP_WRITE | SND_SEQ_PORT_CAP_NO_EXPORT,
+						    SND_SEQ_PORT_TYPE_APPLICATION);
+	if (port < 0 || snd_seq_connect_from(seq_, port, SND_SEQ_CLIENT_SYSTEM, SND_SEQ_PORT_SYSTEM_ANNOUNCE) < 0
+	    || ::pipe(wakePipe_) < 0)
+	{
+	    close();
+	    return false;
+	}
+	::fcntl(wakePipe_[0], F_SETFL, O_NONBLOCK);
+
+	ownClient_ = snd_seq_client_id(seq_);
+	onChange_ = onChange;
+	startThread();
+	return true;
+    }
+
+    void stop()
+    {
+	if (isThreadRunning())
+	{
+	    signalThreadShouldExit();
+	    const char wake = 0;
+	    (void) ::write(wakePipe_[1], &wake, 1);
+	    stopThread(1000);
+	}
+	close();
+    }
+#else
+    bool start(std::function<void()>)   { return false; }
+    void stop()                         {}
+#endif
+
+    bool isRunning() const              { return isThreadRunning(); }
+
+private:
+#if JUCE_LINUX && JUCE_ALSA
+    void close()
+    {
+	if (seq_ != nullptr)
+	{
+	    snd_seq_close(seq_);
+	    seq_ = nullptr;
+	}
+	for (auto&& fd : wakePipe_)
+	{
+	    if (fd >= 0)
+	    {
+		::close(fd);
+		fd = -1;
+	    }
+	}
+    }
+
+    // true if the event means the set of usable MIDI ports may have changed
+    bool isPortChange(const snd_seq_event_t& event) const
+    {
+	switch (event.type)
+	{
+	    case SND_SEQ_EVENT_PORT_START:
+	    case SND_SEQ_EVENT_PORT_EXIT:
+	    case SND_SEQ_EVENT_PORT_CHANGE:
+		return event.data.addr.client != ownClient_;
+	    default:
+		return false;
+	}
+    }
+
+    void run() override
+    {
+	const int numSeqFds = snd_seq_poll_descriptors_count(seq_, POLLIN);
+	HeapBlock<pollfd> fds((size_t) numSeqFds + 1);
+	snd_seq_poll_descriptors(seq_, fds, (unsigned int) numSeqFds, POLLIN);
+	fds[numSeqFds].fd = wakePipe_[0];
+	fds[numSeqFds].events = POLLIN;
+
+	while (!threadShouldExit())
+	{
+	    if (::poll(fds, (nfds_t) numSeqFds + 1, -1) <= 0)
+	    {
+		continue;
+	    }
+
+	    // one hotplug usually announces a client and several ports, report them as one change
+	    bool changed = false;
+	    snd_seq_event_t* event = nullptr;
+	    for (;;)
+	    {
+		const int result = snd_seq_event_input(seq_, &event);
+		if (result == -ENOSPC)
+		{
+		    changed = true; // input overran, we may have missed something
+		    continue;
+		}
+		if (result < 0 || event == nullptr)
+		{
+		    break;
+		}
+		changed = changed || isPortChange(*event);
+		event = nullptr;
+	    }
+
+	    if (changed && !threadShouldExit())
+	    {
+		onChange_();
+	    }
+	}
+    }
+
+    snd_seq_t* seq_ = nullptr;
+    int ownClient_ = -1;
+    int wakePipe_[2] = { -1, -1 };
+    std::function<void()> onChange_;
+#else
+    void run() override {}
+#endif
+
+    JUCE_DECLARE_NON_COPYABLE(MidiHotplugMonitor)
+};
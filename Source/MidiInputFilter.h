@@ -0,0 +1,237 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include <atomic>
+
+//==============================================================================
+// Which MIDI input we act on, by channel, message type and controller number.
+// The rules are compiled when they're set into one 128 bit mask per status
+// byte, indexed by the first data byte, so checking an event is a load, a
+// shift and a mask before anything else looks at it. For controllers the mask
+// is the allowed controller numbers, for the other channel messages all or
+// nothing; system messages go by their type and can also be dropped one
+// kind at a time (clock, active sensing and so on), see setDropped().
+//
+// The input thread reads the table through an atomic pointer. Tables that get
+// replaced are kept until the filter goes away, so a reader is never left
+// holding a freed one; the rules only change when they're configured.
+class MidiInputFilter
+{
+public:
+    MidiInputFilter()
+    {
+	table_ = nullptr;
+    }
+
+    // system messages dropped whatever else is allowed, bit n for status 0xf0 + n
+    static const uint32 clockStatuses = 1u << 0x8;
+    static const uint32 tickStatuses = 1u << 0x9;
+    static const uint32 transportStatuses = (1u << 0xa) | (1u << 0xb) | (1u << 0xc);
+    static const uint32 sensingStatuses = 1u << 0xe;
+    static const uint32 realtimeStatuses = 0xdf00;     // 0xf8-0xfe, not reset
+    static const uint32 sysexStatuses = (1u << 0x0) | (1u << 0x7);
+    static const uint32 timecodeStatuses = 1u << 0x1;
+    static const uint32 songStatuses = (1u << 0x2) | (1u << 0x3);
+
+    // channels 1-16, types note polyat cc pc chanat bend sys and controllers
+    // 0-127; lists are comma separated with ranges like 1-4, "all" or "*" for
+    // no restriction and a missing list means the same. Returns false without
+    // changing anything if a rule doesn't parse.
+    bool set(const String& channels, const String& types, const String& controllers)
+    {
+	uint32 channelMask = 0;
+	uint32 typeMask = 0;
+	uint64 controllerMask[2] = { 0, 0 };
+	if (!parseNumbers(channels, 1, 16, [&] (int channel) { channelMask |= 1u << (channel - 1); })
+	    || !parseTypes(types, typeMask)
+	    || !parseNumbers(controllers, 0, 127, [&] (int cc) { controllerMask[cc >> 6] |= (uint64) 1 << (cc & 63); }))
+	{
+	    return false;
+	}
+
+	channelMask_ = channelMask;
+	typeMask_ = typeMask;
+	controllerMask_[0] = controllerMask[0];
+	controllerMask_[1] = controllerMask[1];
+	hasRules_ = true;
+	compile();
+	return true;
+    }
+
+    // every channel, type and controller passes again, dropped kinds stay dropped
+    void clear()
+    {
+	hasRules_ = false;
+	compile();
+    }
+
+    // comma separated clock, tick, transport, sensing, realtime (all of those),
+    // sysex, timecode and song, or none; false if a kind isn't known
+    bool setDropped(const String& kinds)
+    {
+	uint32 mask = 0;
+	for (auto&& item : StringArray::fromTokens(kinds, ",", ""))
+	{
+	    const String name = item.trim().toLowerCase();
+	    if (name == "clock")            mask |= clockStatuses;
+	    else if (name == "tick")        mask |= tickStatuses;
+	    else if (name == "transport")   mask |= transportStatuses;
+	    else if (name == "sensing")     mask |= sensingStatuses;
+	    else if (name == "realtime")    mask |= realtimeStatuses;
+	    else if (name == "sysex")       mask |= sysexStatuses;
+	    else if (name == "timecode")    mask |= timecodeStatuses;
+	    else if (name == "song")        mask |= songStatuses;
+	    else if (name != "none")        return false;
+	}
+	droppedStatuses_ = mask;
+	compile();
+	return true;
+    }
+
+    uint32 getDroppedStatuses() const   { return droppedStatuses_; }
+
+    bool isActive() const               { return table_.load(std::memory_order_relaxed) != nullptr; }
+
+    bool passes(const uint8* data, int size) const
+    {
+	const Table* table = table_.load(std::memory_order_acquire);
+	if (table == nullptr || size < 1 || data[0] < 0x80)
+	{
+	    return true;
+	}
+	const int data1 = size > 1 ? data[1] & 0x7f : 0;
+	return (table->bits_[data[0] - 0x80][data1 >> 6] >> (data1 & 63)) & 1;
+    }
+
+private:
+    struct Table
+    {
+	uint64 bits_[128][2];
+    };
+
+    void compile()
+    {
+	if (!hasRules_ && droppedStatuses_ == 0)
+	{
+	    table_.store(nullptr, std::memory_order_release);
+	    return;
+	}
+
+	const uint32 channelMask = hasRules_ ? channelMask_ : 0xffff;
+	const uint32 typeMask = hasRules_ ? typeMask_ : 0xff00;
+	const uint64 allControllers = ~(uint64) 0;
+	Table* table = tables_.add(new Table());
+	for (int status = 0x80; status <= 0xff; ++status)
+	{
+	    const int type = status >> 4;
+	    // the low nibble is the channel, or which system message it is
+	    const bool typeAllowed = ((typeMask >> type) & 1) != 0;
+	    const bool nibbleAllowed = type == 0xf ? ((droppedStatuses_ >> (status & 0xf)) & 1) == 0
+		: ((channelMask >> (status & 0xf)) & 1) != 0;
+	    uint64* bits = table->bits_[status - 0x80];
+	    for (int word = 0; word < 2; ++word)
+	    {
+		bits[word] = !(typeAllowed && nibbleAllowed) ? 0
+		    : type == 0xb ? (hasRules_ ? controllerMask_[word] : allControllers)
+		    : allControllers;
+	    }
+	}
+	table_.store(table, std::memory_order_release);
+    }
+
+public:
+    static bool isAll(const String& list)
+    {
+	return list.isEmpty() || list == "*" || list.equalsIgnoreCase("all");
+    }
+
+    // a list as set() takes them, add(n) for each of the numbers from low to
+    // high in it; false if it doesn't parse
+    template <typename Function>
+    static bool parseNumbers(const String& list, int low, int high, Function add)
+    {
+	if (isAll(list))
+	{
+	    for (int i = low; i <= high; ++i)
+	    {
+		add(i);
+	    }
+	    return true;
+	}
+
+	for (auto&& item : StringArray::fromTokens(list, ",", ""))
+	{
+	    const String first = item.upToFirstOccurrenceOf("-", false, false).trim();
+	    const String last = item.containsChar('-') ? item.fromFirstOccurrenceOf("-", false, false).trim() : first;
+	    if (!first.containsOnly("0123456789") || !last.containsOnly("0123456789") || first.isEmpty() || last.isEmpty())
+	    {
+		return false;
+	    }
+	    const int from = first.getIntValue();
+	    const int to = last.getIntValue();
+	    if (from < low || to > high || from > to)
+	    {
+		return false;
+	    }
+	    for (int i = from; i <= to; ++i)
+	    {
+		add(i);
+	    }
+	}
+	return true;
+    }
+
+private:
+    static bool parseTypes(const String& list, uint32& mask)
+    {
+	if (isAll(list))
+	{
+	    mask = 0xff00;
+	    return true;
+	}
+
+	for (auto&& item : StringArray::fromTokens(list, ",", ""))
+	{
+	    const String name = item.trim().toLowerCase();
+	    if (name == "note")             mask |= (1u << 0x8) | (1u << 0x9);
+	    else if (name == "polyat")      mask |= 1u << 0xa;
+	    else if (name == "cc")          mask |= 1u << 0xb;
+	    else if (name == "pc")          mask |= 1u << 0xc;
+	    else if (name == "chanat")      mask |= 1u << 0xd;
+	    else if (name == "bend")        mask |= 1u << 0xe;
+	    else if (name == "sys")         mask |= 1u << 0xf;
+	    else                            return false;
+	}
+	return true;
+    }
+
+    bool hasRules_ = false;
+    uint32 channelMask_ = 0;
+    uint32 typeMask_ = 0;
+    uint64 controllerMask_[2] = { 0, 0 };
+    uint32 droppedStatuses_ = 0;
+
+    std::atomic<Table*> table_;
+    OwnedArray<Table> tables_;
+
+    JUCE_DECLARE_NON_COPYABLE(MidiInputFilter)
+};
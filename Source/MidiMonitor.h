@@ -0,0 +1,506 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "HexEncoder.h"
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#if ! JUCE_WINDOWS
+ #include <cerrno>
+ #include <unistd.h>
+#endif
+
+//==============================================================================
+// Turns raw MIDI into the same lines as the event log, ReceiveMIDI's, without
+// Strings or streams: numbers and note names come out of tables built once
+// and every line is appended to a caller's buffer. append() wants room for
+// maxLineSize(size) bytes.
+class MidiLineFormatter
+{
+public:
+    MidiLineFormatter(bool useHex = false, bool noteNumbers = false, int octaveMiddleC = 3)
+    {
+	setFormat(useHex, noteNumbers, octaveMiddleC);
+    }
+
+    void setFormat(bool useHex, bool noteNumbers, int octaveMiddleC)
+    {
+	useHex_ = useHex;
+	noteNumbers_ = noteNumbers;
+	for (int i = 0; i < 1000; ++i)
+	{
+	    decimal_[i][0] = i >= 100 ? (char) ('0' + i / 100) : ' ';
+	    decimal_[i][1] = i >= 10 ? (char) ('0' + i / 10 % 10) : ' ';
+	    decimal_[i][2] = (char) ('0' + i % 10);
+	    decimalLength_[i] = (uint8) (i >= 100 ? 3 : i >= 10 ? 2 : 1);
+	}
+	for (int i = 0; i < 128; ++i)
+	{
+	    const String name = MidiMessage::getMidiNoteName(i, true, true, octaveMiddleC).paddedLeft(' ', 4);
+	    name.copyToUTF8(noteNames_[i], sizeof(noteNames_[i]));
+	}
+    }
+
+    static int maxLineSize(int size)
+    {
+	return 64 + 3 * size;
+    }
+
+    // the line for one message and its newline, or nothing for what the log
+    // doesn't show either; returns where it ended
+    char* append(char* out, const uint8* data, int size, bool truncated = false) const
+    {
+	if (size < 1)
+	{
+	    return out;
+	}
+	const int status = data[0];
+	if (status < 0xf0)
+	{
+	    if (size < ((status & 0xe0) == 0xc0 ? 2 : 3))
+	    {
+		return out;
+	    }
+	    out = literal(out, "channel ");
+	    out = number7(out, (status & 0x0f) + 1, 2);
+	    out = literal(out, "   ");
+	    switch (status & 0xf0)
+	    {
+		case 0x90:
+		    out = data[2] > 0 ? literal(out, "note-on         ") : literal(out, "note-off        ");
+		    out = note(out, data[1]);
+		    *out++ = ' ';
+		    out = number7(out, data[2], 3);
+		    break;
+		case 0x80:
+		    out = literal(out, "note-off        ");
+		    out = note(out, data[1]);
+		    *out++ = ' ';
+		    out = number7(out, data[2], 3);
+		    break;
+		case 0xa0:
+		    out = literal(out, "poly-pressure   ");
+		    out = note(out, data[1]);
+		    *out++ = ' ';
+		    out = number7(out, data[2], 3);
+		    break;
+		case 0xb0:
+		    out = literal(out, "control-change   ");
+		    out = number7(out, data[1], 3);
+		    *out++ = ' ';
+		    out = number7(out, data[2], 3);
+		    break;
+		case 0xc0:
+		    out = literal(out, "program-change   ");
+		    out = number7(out, data[1], 7);
+		    break;
+		case 0xd0:
+		    out = literal(out, "channel-pressure ");
+		    out = number7(out, data[1], 7);
+		    break;
+		default:
+		    out = literal(out, "pitch-bend       ");
+		    out = number14(out, data[1] | (data[2] << 7), 7);
+		    break;
+	    }
+	    return newline(out);
+	}
+
+	switch (status)
+	{
+	    case 0xf8: return newline(literal(out, "midi-clock"));
+	    case 0xfa: return newline(literal(out, "start"));
+	    case 0xfc: return newline(literal(out, "stop"));
+	    case 0xfb: return newline(literal(out, "continue"));
+	    case 0xfe: return newline(literal(out, "active-sensing"));
+	    case 0xff: return size == 1 ? newline(literal(out, "reset")) : out;
+	    case 0xf6: return newline(literal(out, "tune-request"));
+	    case 0xf0:
+		{
+		    out = literal(out, "system-exclusive");
+		    if (!useHex_)
+		    {
+			out = literal(out, " hex");
+		    }
+		    const int numBytes = size - 1 - (!truncated && data[size - 1] == 0xf7 ? 1 : 0);
+		    out = HexEncoder::appendSpaced(out, data + 1, (size_t) jmax(0, numBytes));
+		    if (truncated)
+		    {
+			out = literal(out, " ...");
+		    }
+		    if (!useHex_)
+		    {
+			out = literal(out, " dec");
+		    }
+		    return newline(out);
+		}
+	    case 0xf1:
+		if (size < 2)
+		{
+		    return out;
+		}
+		out = literal(out, "time-code ");
+		out = number7(out, data[1] >> 4, 2);
+		*out++ = ' ';
+		return newline(number7(out, data[1] & 0x0f, 0));
+	    case 0xf2:
+		if (size < 3)
+		{
+		    return out;
+		}
+		out = literal(out, "song-position ");
+		return newline(number14(out, data[1] | (data[2] << 7), 5));
+	    case 0xf3:
+		if (size < 2)
+		{
+		    return out;
+		}
+		out = literal(out, "song-select ");
+		return newline(number7(out, data[1], 3));
+	    default:
+		return out;
+	}
+    }
+
+private:
+    template <size_t N>
+    static char* literal(char* out, const char (&text)[N])
+    {
+	std::memcpy(out, text, N - 1);
+	return out + N - 1;
+    }
+
+    static char* newline(char* out)
+    {
+	*out++ = '\n';
+	return out;
+    }
+
+    static char* pad(char* out, int length, int width)
+    {
+	while (length++ < width)
+	{
+	    *out++ = ' ';
+	}
+	return out;
+    }
+
+    // two hex digits or up to three decimal ones, right aligned in width
+    char* number7(char* out, int v, int width) const
+    {
+	if (useHex_)
+	{
+	    out = pad(out, 2, width);
+	    std::memcpy(out, HexEncoder::digits((uint8) v), 2);
+	    return out + 2;
+	}
+	const int length = decimalLength_[v];
+	out = pad(out, length, width);
+	std::memcpy(out, decimal_[v] + 3 - length, (size_t) length);
+	return out + length;
+    }
+
+    char* number14(char* out, int v, int width) const
+    {
+	if (useHex_)
+	{
+	    const uint8 bytes[2] = { (uint8) (v >> 8), (uint8) (v & 0xff) };
+	    return HexEncoder::append(pad(out, 4, width), bytes, 2);
+	}
+	if (v < 1000)
+	{
+	    return number7(out, v, width);
+	}
+	const int length = v >= 10000 ? 5 : 4;
+	out = pad(out, length, width);
+	const int high = v / 1000;
+	if (high >= 10)
+	{
+	    *out++ = (char) ('0' + high / 10);
+	}
+	*out++ = (char) ('0' + high % 10);
+	const int low = v % 1000;
+	*out++ = (char) ('0' + low / 100);
+	*out++ = (char) ('0' + low / 10 % 10);
+	*out++ = (char) ('0' + low % 10);
+	return out;
+    }
+
+    char* note(char* out, int noteNumber) const
+    {
+	if (noteNumbers_)
+	{
+	    return number7(out, noteNumber, 4);
+	}
+	std::memcpy(out, noteNames_[noteNumber], 4);
+	return out + 4;
+    }
+
+    bool useHex_ = false;
+    bool noteNumbers_ = false;
+    char decimal_[1000][3];          // right aligned in three, spaces in front
+    uint8 decimalLength_[1000];
+    char noteNames_[128][5];         // right aligned in four
+};
+
+//==============================================================================
+// "monitor": every MIDI message coming in printed to stdout, however dense
+// the stream. Producers copy the raw bytes and their time into a byte ring,
+// sysex of any length included up to maxStoredBytes; a background thread
+// formats whatever has queued every batchIntervalMs, or sooner once the ring
+// is a quarter full, into one buffer and hands that to a single write().
+// Unlike the event log there's no rate limit; if the terminal or a pipe can't
+// keep up, messages are dropped and counted rather than blocking the input.
+class MidiMonitor : private Thread
+{
+public:
+    static const int ringSize = 1 << 20;
+    static const int maxStoredBytes = 8192;
+    static const int batchIntervalMs = 10;
+    static const int bufferSize = 1 << 18;
+
+    MidiMonitor()
+	: Thread("loop4r midi monitor"), fifo_(ringSize), ring_((size_t) ringSize),
+	  message_((size_t) maxStoredBytes), buffer_((size_t) bufferSize)
+    {
+    }
+
+    ~MidiMonitor()
+    {
+	stop();
+    }
+
+    // timestamps puts the seconds since starting in front of every line
+    void start(bool useHex, bool noteNumbers, int octaveMiddleC, bool timestamps)
+    {
+	stop();
+	formatter_.setFormat(useHex, noteNumbers, octaveMiddleC);
+	timestamps_ = timestamps;
+	startTicks_ = Time::getHighResolutionTicks();
+	monitoring_.store(true);
+	startThread();
+    }
+
+    // prints what's still queued first
+    void stop()
+    {
+	monitoring_.store(false);
+	if (isThreadRunning())
+	{
+	    signalThreadShouldExit();
+	    wakeUp_.signal();
+	    stopThread(2000);
+	}
+    }
+
+    bool isMonitoring() const       { return monitoring_.load(std::memory_order_relaxed); }
+
+    // any thread, a spin lock keeping them apart; no allocation or I/O
+    void add(const uint8* data, int size, int64 ticks)
+    {
+	if (size < 1 || !isMonitoring())
+	{
+	    return;
+	}
+	Header header;
+	header.ticks_ = ticks;
+	header.size_ = (uint32) size;
+	header.stored_ = (uint32) jmin(size, (int) maxStoredBytes);
+	const int total = (int) sizeof(header) + (int) header.stored_;
+
+	const SpinLock::ScopedLockType lock(pushLock_);
+	int start1, size1, start2, size2;
+	fifo_.prepareToWrite(total, start1, size1, start2, size2);
+	if (size1 + size2 < total)
+	{
+	    numDropped_.fetch_add(1, std::memory_order_relaxed);
+	    return;
+	}
+	int position = start1;
+	copyIn(&header, (int) sizeof(header), position);
+	copyIn(data, (int) header.stored_, position);
+	fifo_.finishedWrite(total);
+	if (fifo_.getNumReady() >= ringSize / 4 && !wokenEarly_.exchange(true))
+	{
+	    wakeUp_.signal();
+	}
+    }
+
+    int64 getNumPrinted() const     { return numPrinted_.load(); }
+    int64 getNumDropped() const     { return numDropped_.load(); }
+    int64 getNumWrites() const      { return numWrites_.load(); }
+
+private:
+    struct Header
+    {
+	int64 ticks_;
+	uint32 size_;       // as it came in
+	uint32 stored_;     // what of it follows in the ring
+    };
+
+    void run() override
+    {
+	while (!threadShouldExit())
+	{
+	    wakeUp_.wait(batchIntervalMs);
+	    wokenEarly_.store(false);
+	    printQueued();
+	}
+	printQueued();
+    }
+
+    void printQueued()
+    {
+	const int numReady = fifo_.getNumReady();
+	int start1, size1, start2, size2;
+	fifo_.prepareToRead(numReady, start1, size1, start2, size2);
+	int position = start1;
+	int taken = 0;
+	char* out = buffer_;
+	int64 numLines = 0;
+	while (taken + (int) sizeof(Header) <= numReady)
+	{
+	    Header header;
+	    copyOut(&header, (int) sizeof(header), position);
+	    copyOut(message_, (int) header.stored_, position);
+	    taken += (int) sizeof(header) + (int) header.stored_;
+
+	    if (out + MidiLineFormatter::maxLineSize((int) header.stored_) + timestampSize > buffer_ + bufferSize)
+	    {
+		writeOut(out - buffer_);
+		out = buffer_;
+	    }
+	    char* lineStart = out;
+	    if (timestamps_)
+	    {
+		out = appendTimestamp(out, header.ticks_);
+	    }
+	    char* lineEnd = formatter_.append(out, message_, (int) header.stored_, header.stored_ < header.size_);
+	    if (lineEnd == out)
+	    {
+		out = lineStart;
+		continue;
+	    }
+	    out = lineEnd;
+	    ++numLines;
+	}
+	// the ring is freed before the write, which may block on a slow reader
+	fifo_.finishedRead(taken);
+	writeOut(out - buffer_);
+	numPrinted_.fetch_add(numLines, std::memory_order_relaxed);
+    }
+
+    static const int timestampSize = 16;
+
+    // "  12.345   ", seconds since start()
+    char* appendTimestamp(char* out, int64 ticks) const
+    {
+	const int64 ms = jmax((int64) 0, (int64) (Time::highResolutionTicksToSeconds(ticks - startTicks_) * 1000.0));
+	char digits[20];
+	int numDigits = 0;
+	for (int64 seconds = ms / 1000; numDigits == 0 || seconds > 0; seconds /= 10)
+	{
+	    digits[numDigits++] = (char) ('0' + seconds % 10);
+	}
+	for (int i = numDigits; i < 4; ++i)
+	{
+	    *out++ = ' ';
+	}
+	while (numDigits > 0)
+	{
+	    *out++ = digits[--numDigits];
+	}
+	const int millis = (int) (ms % 1000);
+	*out++ = '.';
+	*out++ = (char) ('0' + millis / 100);
+	*out++ = (char) ('0' + millis / 10 % 10);
+	*out++ = (char) ('0' + millis % 10);
+	*out++ = ' ';
+	*out++ = ' ';
+	*out++ = ' ';
+	return out;
+    }
+
+    void writeOut(ptrdiff_t size)
+    {
+	if (size <= 0)
+	{
+	    return;
+	}
+	numWrites_.fetch_add(1, std::memory_order_relaxed);
+       #if JUCE_WINDOWS
+	std::fwrite(buffer_.getData(), 1, (size_t) size, stdout);
+	std::fflush(stdout);
+       #else
+	const char* data = buffer_;
+	while (size > 0)
+	{
+	    const ssize_t written = ::write(STDOUT_FILENO, data, (size_t) size);
+	    if (written < 0)
+	    {
+		if (errno == EINTR)
+		{
+		    continue;
+		}
+		return;     // a closed pipe, nothing more to do with this batch
+	    }
+	    data += written;
+	    size -= written;
+	}
+       #endif
+    }
+
+    void copyIn(const void* source, int size, int& position)
+    {
+	const int first = jmin(size, ringSize - position);
+	std::memcpy(ring_ + position, source, (size_t) first);
+	std::memcpy(ring_.getData(), static_cast<const uint8*>(source) + first, (size_t) (size - first));
+	position = (position + size) % ringSize;
+    }
+
+    void copyOut(void* destination, int size, int& position) const
+    {
+	const int first = jmin(size, ringSize - position);
+	std::memcpy(destination, ring_ + position, (size_t) first);
+	std::memcpy(static_cast<uint8*>(destination) + first, ring_.getData(), (size_t) (size - first));
+	position = (position + size) % ringSize;
+    }
+
+    AbstractFifo fifo_;
+    HeapBlock<uint8> ring_;
+    SpinLock pushLock_;
+    WaitableEvent wakeUp_;
+    std::atomic<bool> wokenEarly_ { false };
+    std::atomic<bool> monitoring_ { false };
+
+    // the writer's
+    MidiLineFormatter formatter_;
+    HeapBlock<uint8> message_;
+    HeapBlock<char> buffer_;
+    bool timestamps_ = false;
+    int64 startTicks_ = 0;
+
+    std::atomic<int64> numPrinted_ { 0 };
+    std::atomic<int64> numDropped_ { 0 };
+    std::atomic<int64> numWrites_ { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE(MidiMonitor)
+};
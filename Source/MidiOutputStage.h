@@ -0,0 +1,357 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "TraceCapture.h"
+#include "Metrics.h"
+#include "SpanTrace.h"
+#include "EventJournal.h"
+#include <atomic>
+
+//==============================================================================
+// Somewhere other than a MidiOutput for the stage to send to (a JACK port).
+// Called from flush() with the stage's lock held.
+class MidiBlockSink
+{
+public:
+    virtual ~MidiBlockSink() {}
+    virtual void sendBlock(const MidiBuffer& block) = 0;
+};
+
+//==============================================================================
+// Collects outgoing MIDI in a MidiBuffer and hands it to each output in one
+// sendBlockOfMessagesNow per flush(). Every output takes some kinds of
+// message (notes, controllers, the rest): one that takes them all gets the
+// buffer as it is, the others a copy with just their kinds, made in a buffer
+// of their own that's kept from flush to flush. With thinning on, controller streams
+// (expression pedal sweeps) keep only the latest value per channel and
+// controller within a millisecond; values held back that way are sent by a
+// 1ms HighResolutionTimer, so the last value of a sweep always goes out.
+//
+// Any thread may add and flush. setOutput(s) and setSink must be called
+// before an old output or sink is deleted.
+class MidiOutputStage : private HighResolutionTimer
+{
+public:
+    static const int maxOutputs = 4;
+
+    enum Route
+    {
+	RouteNotes = 1,             // note on and off
+	RouteControllers = 2,
+	RouteOther = 4,             // everything else
+	RouteAll = RouteNotes | RouteControllers | RouteOther
+    };
+
+    MidiOutputStage()
+    {
+	for (auto&& sent : lastSentMs_)
+	{
+	    sent = 0;
+	}
+	for (auto&& held : held_)
+	{
+	    held = -1;
+	}
+    }
+
+    ~MidiOutputStage()
+    {
+	stopTimer();
+    }
+
+    // the only output, taking everything
+    void setOutput(MidiOutput* output)
+    {
+	const int routes = RouteAll;
+	setOutputs(&output, &routes, output != nullptr ? 1 : 0);
+    }
+
+    // the first maxOutputs of them, a null output is skipped
+    void setOutputs(MidiOutput* const* outputs, const int* routes, int numOutputs)
+    {
+	const SpinLock::ScopedLockType lock(lock_);
+	numOutputs_ = 0;
+	for (int i = 0; i < numOutputs && numOutputs_ < maxOutputs; ++i)
+	{
+	    if (outputs[i] != nullptr && (routes[i] & RouteAll) != 0)
+	    {
+		outputs_[numOutputs_].output_ = outputs[i];
+		outputs_[numOutputs_].routes_ = routes[i] & RouteAll;
+		++numOutputs_;
+	    }
+	}
+	pending_.clear();
+	numPending_ = 0;
+	dropHeld();
+    }
+
+    // sent to as well as the outputs, nullptr for none
+    void setSink(MidiBlockSink* sink, int routes)
+    {
+	const SpinLock::ScopedLockType lock(lock_);
+	sink_.sink_ = sink;
+	sink_.routes_ = routes & RouteAll;
+    }
+
+    static int getRoute(const uint8* data)
+    {
+	const int type = data[0] & 0xf0;
+	return type == 0x80 || type == 0x90 ? RouteNotes
+	    : type == 0xb0 ? RouteControllers
+	    : RouteOther;
+    }
+
+    // what goes out is recorded there as MidiOut (whether or not there's an
+    // output to send it to); set before anything is added
+    void setTrace(TraceCapture* trace)
+    {
+	trace_ = trace;
+    }
+
+    // note ons added are counted there as NotesOut, set before anything is added
+    void setMetrics(Metrics* metrics)
+    {
+	metrics_ = metrics;
+    }
+
+    // each flush that sends anything a "midi send" span there
+    void setSpans(SpanTrace* spans)
+    {
+	spans_ = spans;
+    }
+
+    // note ons and offs added are recorded there, set before anything is added
+    void setJournal(EventJournal* journal)
+    {
+	journal_ = journal;
+    }
+
+    bool hasOutput() const
+    {
+	const SpinLock::ScopedLockType lock(lock_);
+	return numOutputs_ > 0 || sink_.sink_ != nullptr;
+    }
+
+    void setThinning(bool thin)
+    {
+	thin_ = thin;
+	if (thin)
+	{
+	    startTimer(1);
+	}
+	else
+	{
+	    stopTimer();
+	    flush();
+	}
+    }
+
+    void add(const MidiMessage& message)
+    {
+	if (metrics_ != nullptr && message.isNoteOn())
+	{
+	    metrics_->add(Metrics::NotesOut);
+	}
+	if (journal_ != nullptr && message.isNoteOnOrOff())
+	{
+	    journal_->record(message.isNoteOn() ? EventJournal::NoteOn : EventJournal::NoteOff, 0,
+			     message.getChannel(), message.getNoteNumber(), message.getVelocity());
+	}
+
+	const SpinLock::ScopedLockType lock(lock_);
+	if (thin_ && message.isController())
+	{
+	    const int slot = ((message.getChannel() - 1) & 0xf) * 128 + message.getControllerNumber();
+	    const uint32 now = Time::getMillisecondCounter();
+	    if (held_[slot] >= 0 || lastSentMs_[slot] == now)
+	    {
+		// already sent one this millisecond, keep the newest for the timer
+		if (held_[slot] >= 0)
+		{
+		    ++numThinned_;
+		}
+		else
+		{
+		    heldSlots_[numHeld_++] = (int16) slot;
+		}
+		held_[slot] = (int8) message.getControllerValue();
+		return;
+	    }
+	    lastSentMs_[slot] = now;
+	}
+	pending_.addEvent(message, numPending_++);
+    }
+
+    void flush()
+    {
+	const SpinLock::ScopedLockType lock(lock_);
+	flushLocked();
+    }
+
+    int64 getNumBlocks() const          { return numBlocks_.load(); }
+    int64 getNumMessages() const        { return numMessages_.load(); }
+    int64 getNumThinned() const         { return numThinned_.load(); }
+
+private:
+    static const int numSlots = 16 * 128;
+
+    void flushLocked()
+    {
+	if (numPending_ == 0)
+	{
+	    return;
+	}
+	const SpanTrace::Scope span(spans_, "midi send");
+
+	if (trace_ != nullptr && trace_->isOpen())
+	{
+	    MidiBuffer::Iterator it(pending_);
+	    const uint8* data;
+	    int size, position;
+	    while (it.getNextEvent(data, size, position))
+	    {
+		trace_->record(TraceCapture::MidiOut, data, size);
+	    }
+	}
+
+	for (int i = 0; i < numOutputs_; ++i)
+	{
+	    sendPending(outputs_[i]);
+	}
+	if (sink_.sink_ != nullptr)
+	{
+	    sendPending(sink_);
+	}
+	pending_.clear();
+	numPending_ = 0;
+    }
+
+    struct Destination;
+
+    void sendPending(Destination& destination)
+    {
+	if (destination.routes_ == RouteAll)
+	{
+	    destination.send(pending_);
+	    ++numBlocks_;
+	    numMessages_ += numPending_;
+	    return;
+	}
+
+	destination.routed_.clear();
+	int numRouted = 0;
+	MidiBuffer::Iterator it(pending_);
+	const uint8* data;
+	int size, position;
+	while (it.getNextEvent(data, size, position))
+	{
+	    if ((getRoute(data) & destination.routes_) != 0)
+	    {
+		destination.routed_.addEvent(data, size, position);
+		++numRouted;
+	    }
+	}
+	if (numRouted > 0)
+	{
+	    destination.send(destination.routed_);
+	    ++numBlocks_;
+	    numMessages_ += numRouted;
+	}
+    }
+
+    void dropHeld()
+    {
+	for (int i = 0; i < numHeld_; ++i)
+	{
+	    held_[heldSlots_[i]] = -1;
+	}
+	numHeld_ = 0;
+    }
+
+    void hiResTimerCallback() override
+    {
+	const SpinLock::ScopedLockType lock(lock_);
+	if (numHeld_ == 0)
+	{
+	    return;
+	}
+
+	const uint32 now = Time::getMillisecondCounter();
+	int kept = 0;
+	for (int i = 0; i < numHeld_; ++i)
+	{
+	    const int slot = heldSlots_[i];
+	    if (lastSentMs_[slot] == now)
+	    {
+		heldSlots_[kept++] = (int16) slot;
+		continue;
+	    }
+	    pending_.addEvent(MidiMessage::controllerEvent(slot / 128 + 1, slot % 128, held_[slot]), numPending_++);
+	    lastSentMs_[slot] = now;
+	    held_[slot] = -1;
+	}
+	numHeld_ = kept;
+	flushLocked();
+    }
+
+    struct Destination
+    {
+	void send(const MidiBuffer& block)
+	{
+	    if (output_ != nullptr)
+	    {
+		output_->sendBlockOfMessagesNow(block);
+	    }
+	    else
+	    {
+		sink_->sendBlock(block);
+	    }
+	}
+
+	MidiOutput* output_ = nullptr;
+	MidiBlockSink* sink_ = nullptr;     // when there's no output_
+	int routes_ = RouteAll;
+	MidiBuffer routed_;
+    };
+
+    mutable SpinLock lock_;
+    Destination outputs_[maxOutputs];
+    Destination sink_;
+    int numOutputs_ = 0;
+    TraceCapture* trace_ = nullptr;
+    Metrics* metrics_ = nullptr;
+    SpanTrace* spans_ = nullptr;
+    EventJournal* journal_ = nullptr;
+    MidiBuffer pending_;
+    int numPending_ = 0;
+
+    std::atomic<bool> thin_ { false };
+    uint32 lastSentMs_[numSlots];
+    int8 held_[numSlots];
+    int16 heldSlots_[numSlots];
+    int numHeld_ = 0;
+
+    std::atomic<int64> numBlocks_ { 0 };
+    std::atomic<int64> numMessages_ { 0 };
+    std::atomic<int64> numThinned_ { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE(MidiOutputStage)
+};
@@ -0,0 +1,231 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include <atomic>
+#include <cstring>
+
+//==============================================================================
+// Records the pedals coming in and the notes going out to a Standard MIDI
+// File as they happen, for listening back to a rehearsal. Producers only put
+// the raw bytes and their time in a fixed ring of events; a background thread
+// takes them off every flushIntervalMs, or sooner once it's half full, encodes them as track events and
+// appends them to the file. Nothing is kept once it's written, so memory use
+// is the ring whatever the length of the session, which MidiFile, holding the
+// whole sequence until it's written, can't do.
+//
+// The file is format 0 with SMPTE timing of 25 frames of 40 ticks, so a tick
+// is a millisecond. After every flush it ends with End of Track and has the
+// track's length right, so it can be played while it's still growing and
+// whatever a crash leaves is a complete file up to the last flush.
+class MidiRecorder : private Thread
+{
+public:
+    static const int queueSize = 4096;
+    static const int flushIntervalMs = 1000;
+
+    struct Event
+    {
+	uint8 data_[3];
+	uint8 size_;
+	int64 ticks_;       // Time::getHighResolutionTicks()
+    };
+
+    MidiRecorder()
+	: Thread("loop4r midi recorder"), fifo_(queueSize), events_((size_t) queueSize)
+    {
+    }
+
+    ~MidiRecorder()
+    {
+	stop();
+    }
+
+    // starts a new file there, replacing what it had
+    bool start(const File& file)
+    {
+	stop();
+	file.deleteFile();
+	out_ = new FileOutputStream(file);
+	if (out_->failedToOpen())
+	{
+	    out_ = nullptr;
+	    return false;
+	}
+
+	// MThd: format 0, one track, -25 fps of 40 ticks; then MTrk, its length patched as it grows
+	static const uint8 header[] = { 'M', 'T', 'h', 'd', 0, 0, 0, 6, 0, 0, 0, 1, 0xe7, 40, 'M', 'T', 'r', 'k', 0, 0, 0, 0 };
+	out_->write(header, sizeof(header));
+	endOfEvents_ = sizeof(header);
+	startTicks_ = Time::getHighResolutionTicks();
+	lastTick_ = 0;
+	file_ = file;
+	numRecorded_.store(0);
+	numDropped_.store(0);
+	writeEnd();
+	recording_.store(true);
+	startThread();
+	return true;
+    }
+
+    // writes what's queued and closes the file
+    void stop()
+    {
+	recording_.store(false);
+	if (isThreadRunning())
+	{
+	    signalThreadShouldExit();
+	    wakeUp_.signal();
+	    stopThread(2000);
+	}
+	out_ = nullptr;
+    }
+
+    bool isRecording() const        { return recording_.load(); }
+    const File& getFile() const     { return file_; }
+
+    // any thread, a spin lock keeping them apart; no allocation or I/O.
+    // Sysex and the like are left out.
+    void record(const uint8* data, int size, int64 ticks)
+    {
+	if (size < 1 || size > 3 || !recording_.load(std::memory_order_relaxed))
+	{
+	    return;
+	}
+	const SpinLock::ScopedLockType lock(pushLock_);
+	int start1, size1, start2, size2;
+	fifo_.prepareToWrite(1, start1, size1, start2, size2);
+	if (size1 + size2 < 1)
+	{
+	    numDropped_.fetch_add(1, std::memory_order_relaxed);
+	    return;
+	}
+	Event& event = events_[size1 > 0 ? start1 : start2];
+	std::memcpy(event.data_, data, (size_t) size);
+	event.size_ = (uint8) size;
+	event.ticks_ = ticks;
+	fifo_.finishedWrite(1);
+	// a burst gets the writer going before the next flush is due
+	if (fifo_.getNumReady() == queueSize / 2)
+	{
+	    wakeUp_.signal();
+	}
+    }
+
+    void record(const MidiMessage& message, int64 ticks)
+    {
+	record(message.getRawData(), message.getRawDataSize(), ticks);
+    }
+
+    int64 getNumRecorded() const    { return numRecorded_.load(); }
+    int64 getNumDropped() const     { return numDropped_.load(); }
+    int64 getNumFlushes() const     { return numFlushes_.load(); }
+
+private:
+    void run() override
+    {
+	while (!threadShouldExit())
+	{
+	    wakeUp_.wait(flushIntervalMs);
+	    writeQueued();
+	}
+	writeQueued();
+    }
+
+    // the events since the last flush go where the End of Track was
+    void writeQueued()
+    {
+	block_.reset();
+	int numEvents = 0;
+	int start1, size1, start2, size2;
+	fifo_.prepareToRead(fifo_.getNumReady(), start1, size1, start2, size2);
+	for (int i = 0; i < size1 + size2; ++i)
+	{
+	    const Event& event = events_[i < size1 ? start1 + i : start2 + i - size1];
+	    // a millisecond a tick, never going back
+	    const int64 tick = jmax(lastTick_, (int64) (Time::highResolutionTicksToSeconds(event.ticks_ - startTicks_) * 1000.0));
+	    writeVariableLength(block_, (uint32) jmin((int64) 0x0fffffff, tick - lastTick_));
+	    block_.write(event.data_, event.size_);
+	    lastTick_ = tick;
+	    ++numEvents;
+	}
+	fifo_.finishedRead(size1 + size2);
+	if (numEvents == 0)
+	{
+	    return;
+	}
+
+	out_->setPosition(endOfEvents_);
+	out_->write(block_.getData(), block_.getDataSize());
+	endOfEvents_ += (int64) block_.getDataSize();
+	writeEnd();
+	numRecorded_.fetch_add(numEvents, std::memory_order_relaxed);
+	numFlushes_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // End of Track after the last event, and the track's length to match
+    void writeEnd()
+    {
+	static const uint8 endOfTrack[] = { 0, 0xff, 0x2f, 0 };
+	out_->setPosition(endOfEvents_);
+	out_->write(endOfTrack, sizeof(endOfTrack));
+	const int64 trackLength = endOfEvents_ + (int64) sizeof(endOfTrack) - trackStart;
+	out_->setPosition(trackStart - 4);
+	out_->writeIntBigEndian((int) trackLength);
+	out_->flush();
+    }
+
+    static void writeVariableLength(MemoryOutputStream& out, uint32 value)
+    {
+	uint8 bytes[4];
+	int num = 0;
+	do
+	{
+	    bytes[num++] = (uint8) (value & 0x7f);
+	    value >>= 7;
+	}
+	while (value != 0 && num < 4);
+	while (num > 1)
+	{
+	    out.writeByte((char) (bytes[--num] | 0x80));
+	}
+	out.writeByte((char) bytes[0]);
+    }
+
+    static const int64 trackStart = 22;
+
+    AbstractFifo fifo_;
+    HeapBlock<Event> events_;
+    SpinLock pushLock_;
+    ScopedPointer<FileOutputStream> out_;
+    File file_;
+    MemoryOutputStream block_;          // our thread, reused every flush
+    WaitableEvent wakeUp_;
+    int64 endOfEvents_ = 0;
+    int64 startTicks_ = 0;
+    int64 lastTick_ = 0;
+    std::atomic<bool> recording_ { false };
+    std::atomic<int64> numRecorded_ { 0 };
+    std::atomic<int64> numDropped_ { 0 };
+    std::atomic<int64> numFlushes_ { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE(MidiRecorder)
+};
@@ -0,0 +1,234 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include <chrono>
+#include <cmath>
+
+//==============================================================================
+// How far another host's clock is ahead of ours, from NTP style exchanges: we
+// send at t0, the other host gets it at t1 and answers at t2, both on its
+// clock, and the answer arrives at t3. Taking the round trip to be even, the
+// offset is ((t1 - t0) + (t2 - t3)) / 2, good to within half of the time
+// spent on the wire, (t3 - t0) - (t2 - t1).
+//
+// Only exchanges about as quick as the quickest of the last few are listened
+// to, the slow ones having sat in a queue somewhere on one of the ways. Those
+// feed an alpha-beta tracker of the offset and its drift (the two crystals
+// never quite agree), with the gains of MidiClockFollower, so between
+// exchanges the offset is carried on at the drift.
+//
+// Times are microseconds, ours and theirs each from any one clock; they go
+// over the wire as two int32s. Used from one thread.
+class ClockOffset
+{
+public:
+    static constexpr double alpha = 0.2;
+    static constexpr double beta = alpha * alpha / (2.0 - alpha);
+    static const int window = 16;               // exchanges the quickest is the quickest of
+    static const int exchangesToLock = 4;
+    static constexpr double slackMicros = 250;  // slower than the quickest by this still counts
+
+    ClockOffset() {}
+
+    static int64 toMicros(int64 ticks)
+    {
+	return (int64) ((double) ticks * 1.0e6 / (double) Time::getHighResolutionTicksPerSecond());
+    }
+
+    // the wall clock, for time tags
+    static int64 getWallMicros()
+    {
+	return (int64) std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    static int32 getHigh(int64 micros)          { return (int32) (micros >> 32); }
+    static int32 getLow(int64 micros)           { return (int32) (uint32) (micros & 0xffffffff); }
+    static int64 join(int32 high, int32 low)    { return ((int64) high << 32) | (int64) (uint32) low; }
+
+    void reset()
+    {
+	numExchanges_ = numInWindow_ = 0;
+	numUsed_ = 0;
+	lastUsed_ = 0;
+	offset_ = drift_ = 0;
+	jitterSquared_ = 0;
+	minDelayMicros_ = 0;
+    }
+
+    // false if it was too slow to go by
+    bool exchanged(int64 t0, int64 t1, int64 t2, int64 t3)
+    {
+	const double delay = (double) ((t3 - t0) - (t2 - t1));
+	if (delay < 0)
+	{
+	    ++numRejected_;
+	    return false;
+	}
+	++numExchanges_;
+	delays_[numInWindow_++ % window] = delay;
+	double quickest = delay;
+	for (int i = 0; i < jmin(numInWindow_, window); ++i)
+	{
+	    quickest = jmin(quickest, delays_[i]);
+	}
+	minDelayMicros_ = quickest;
+	if (delay > quickest + jmax(slackMicros, quickest / 2))
+	{
+	    ++numRejected_;
+	    return false;
+	}
+
+	const double t = ((double) t0 + (double) t3) / 2;
+	const double offset = ((double) (t1 - t0) + (double) (t2 - t3)) / 2;
+	if (numUsed_ == 0)
+	{
+	    offset_ = offset;
+	    drift_ = 0;
+	}
+	else
+	{
+	    const double elapsed = t - lastUsed_;
+	    const double predicted = offset_ + drift_ * elapsed;
+	    const double error = offset - predicted;
+	    offset_ = predicted + alpha * error;
+	    if (elapsed > 0)
+	    {
+		drift_ += beta * error / elapsed;
+	    }
+	    jitterSquared_ += 0.05 * (error * error - jitterSquared_);
+	}
+	lastUsed_ = t;
+	++numUsed_;
+	return true;
+    }
+
+    // enough exchanges to go by, the last used within maxAgeMicros of now
+    bool isLocked(int64 now, double maxAgeMicros) const
+    {
+	return numUsed_ >= exchangesToLock && (double) now - lastUsed_ <= maxAgeMicros;
+    }
+
+    // theirs less ours at now, our micros
+    double getOffsetMicros(int64 now) const     { return offset_ + drift_ * ((double) now - lastUsed_); }
+
+    // how far that could be out: half the quickest round trip and the jitter
+    double getErrorBoundMicros() const          { return minDelayMicros_ / 2 + getJitterMicros(); }
+
+    int64 getNumExchanges() const       { return numExchanges_; }
+    int64 getNumRejected() const        { return numRejected_; }
+    double getDriftPpm() const          { return drift_ * 1.0e6; }
+    double getMinDelayMicros() const    { return minDelayMicros_; }
+
+    // rms of the exchanges' offsets from the tracker's prediction
+    double getJitterMicros() const      { return std::sqrt(jitterSquared_); }
+
+private:
+    double delays_[window];
+    int numInWindow_ = 0;
+    int64 numExchanges_ = 0;
+    int64 numRejected_ = 0;
+    int64 numUsed_ = 0;
+    double lastUsed_ = 0;       // our time halfway through the last exchange used
+    double offset_ = 0;         // their clock less ours then
+    double drift_ = 0;          // how fast that grows, micros a micro
+    double jitterSquared_ = 0;
+    double minDelayMicros_ = 0;
+
+    JUCE_DECLARE_NON_COPYABLE(ClockOffset)
+};
+
+//==============================================================================
+// Another loop4r_read's beat, followed over the network. We ask the leader
+// for its clock every so often with our time t0 in the request; it answers
+// with t0, its own time t1 and where it is in the beat at t1, and we note t3
+// when the answer comes in. The answer being written as the request came
+// in, t2 is t1 for the ClockOffset. The leader's beat then follows from its
+// tempo at t1, on its clock as ClockOffset has it.
+//
+// Times are microseconds of each host's Time::getHighResolutionTicks().
+// Control thread only.
+class NetworkClock
+{
+public:
+    static constexpr double maxSilenceSeconds = 2.0;
+
+    NetworkClock() {}
+
+    static int64 toMicros(int64 ticks)          { return ClockOffset::toMicros(ticks); }
+    static int32 getHigh(int64 micros)          { return ClockOffset::getHigh(micros); }
+    static int32 getLow(int64 micros)           { return ClockOffset::getLow(micros); }
+    static int64 join(int32 high, int32 low)    { return ClockOffset::join(high, low); }
+
+    // a new leader, or it went away
+    void reset()
+    {
+	offset_.reset();
+	bpm_ = 0;
+    }
+
+    // the answer to the request sent at t0, written by the leader at t1 (its
+    // clock) when it was beats into its count at bpm, received at t3
+    void answered(int64 t0, int64 t1, int64 t3, double beats, double bpm)
+    {
+	if (offset_.exchanged(t0, t1, t1, t3))
+	{
+	    leaderTime_ = (double) t1;
+	    beats_ = beats;
+	    bpm_ = bpm;
+	}
+    }
+
+    // enough answers to go by, the last recent, and a beat to follow
+    bool isLocked(int64 now) const
+    {
+	return bpm_ > 0 && offset_.isLocked(toMicros(now), maxSilenceSeconds * 1.0e6);
+    }
+
+    // the leader's beat count at now, our ticks
+    double getBeats(int64 now) const
+    {
+	const int64 t = toMicros(now);
+	return beats_ + ((double) t + offset_.getOffsetMicros(t) - leaderTime_) * bpm_ / 60.0e6;
+    }
+
+    double getPhase(int64 now) const
+    {
+	const double beats = getBeats(now);
+	return beats - std::floor(beats);
+    }
+
+    double getBpm() const               { return bpm_; }
+
+    double getTicksPerBeat() const
+    {
+	return bpm_ > 0 ? 60.0 * (double) Time::getHighResolutionTicksPerSecond() / bpm_ : 0;
+    }
+
+    const ClockOffset& getOffset() const        { return offset_; }
+
+private:
+    ClockOffset offset_;
+    double leaderTime_ = 0;     // t1 of the last answer used
+    double beats_ = 0;          // the leader's beats at leaderTime_
+    double bpm_ = 0;
+
+    JUCE_DECLARE_NON_COPYABLE(NetworkClock)
+};
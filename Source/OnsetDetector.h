@@ -0,0 +1,294 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "JackMeter.h"
+#include "LockFreeQueue.h"
+#include <atomic>
+#include <cmath>
+#include <functional>
+
+//==============================================================================
+// An in-place radix-2 FFT on separate real and imaginary arrays. JUCE's own
+// FFT lives in juce_dsp, which we don't build with, and at one 1024 point
+// transform per hop this is nowhere near mattering.
+class SplitFft
+{
+public:
+    explicit SplitFft(int order)
+	: size_(1 << order), reversed_((size_t) size_), cos_((size_t) size_ / 2), sin_((size_t) size_ / 2)
+    {
+	for (int i = 0; i < size_; ++i)
+	{
+	    int reversed = 0;
+	    for (int bit = 0; bit < order; ++bit)
+	    {
+		if ((i & (1 << bit)) != 0)
+		{
+		    reversed |= 1 << (order - 1 - bit);
+		}
+	    }
+	    reversed_[i] = reversed;
+	}
+	for (int i = 0; i < size_ / 2; ++i)
+	{
+	    const double angle = -2.0 * double_Pi * i / size_;
+	    cos_[i] = (float) std::cos(angle);
+	    sin_[i] = (float) std::sin(angle);
+	}
+    }
+
+    int getSize() const             { return size_; }
+
+    // forward, unscaled
+    void perform(float* re, float* im) const
+    {
+	for (int i = 0; i < size_; ++i)
+	{
+	    const int j = reversed_[i];
+	    if (j > i)
+	    {
+		std::swap(re[i], re[j]);
+		std::swap(im[i], im[j]);
+	    }
+	}
+	for (int half = 1; half < size_; half *= 2)
+	{
+	    const int step = size_ / (2 * half);
+	    for (int start = 0; start < size_; start += 2 * half)
+	    {
+		for (int k = 0; k < half; ++k)
+		{
+		    const float wr = cos_[k * step];
+		    const float wi = sin_[k * step];
+		    const int a = start + k;
+		    const int b = a + half;
+		    const float tr = re[b] * wr - im[b] * wi;
+		    const float ti = re[b] * wi + im[b] * wr;
+		    re[b] = re[a] - tr;
+		    im[b] = im[a] - ti;
+		    re[a] += tr;
+		    im[a] += ti;
+		}
+	    }
+	}
+    }
+
+private:
+    int size_;
+    HeapBlock<int> reversed_;
+    HeapBlock<float> cos_;
+    HeapBlock<float> sin_;
+
+    JUCE_DECLARE_NON_COPYABLE(SplitFft)
+};
+
+//==============================================================================
+// Spectral flux: how much the magnitude spectrum grew since the last frame,
+// summed over the bins that grew. A note or hit starting shows as a jump in
+// it that a held sound doesn't. Everything past the transform is
+// FloatVectorOperations: the window, the squared magnitudes, the rise and
+// the sum. The result is scaled by the frame size, so a full scale sine
+// starting out of silence comes to about 0.8 and one at -24dB to 0.05.
+class SpectralFlux
+{
+public:
+    static const int order = 10;
+    static const int frameSize = 1 << order;
+    static const int numBins = frameSize / 2 + 1;
+
+    SpectralFlux()
+	: fft_(order), window_(frameSize), re_(frameSize), im_(frameSize),
+	  magnitudes_(numBins), previous_(numBins, true), rise_(numBins)
+    {
+	for (int i = 0; i < frameSize; ++i)
+	{
+	    window_[i] = (float) (0.5 - 0.5 * std::cos(2.0 * double_Pi * i / (frameSize - 1)));
+	}
+    }
+
+    void reset()
+    {
+	FloatVectorOperations::clear(previous_, numBins);
+    }
+
+    // frame is frameSize samples, the newest last
+    float process(const float* frame)
+    {
+	FloatVectorOperations::multiply(re_, frame, window_, frameSize);
+	FloatVectorOperations::clear(im_, frameSize);
+	fft_.perform(re_, im_);
+
+	FloatVectorOperations::multiply(magnitudes_, re_, re_, numBins);
+	FloatVectorOperations::addWithMultiply(magnitudes_, im_, im_, numBins);
+	for (int i = 0; i < numBins; ++i)
+	{
+	    magnitudes_[i] = std::sqrt(magnitudes_[i]);
+	}
+
+	FloatVectorOperations::subtract(rise_, magnitudes_, previous_, numBins);
+	FloatVectorOperations::max(rise_, rise_, 0.0f, numBins);
+	FloatVectorOperations::copy(previous_, magnitudes_, numBins);
+	return JackMeter::foldSum(rise_, numBins) / frameSize;
+    }
+
+private:
+    SplitFft fft_;
+    HeapBlock<float> window_;
+    HeapBlock<float> re_;
+    HeapBlock<float> im_;
+    HeapBlock<float> magnitudes_;
+    HeapBlock<float> previous_;
+    HeapBlock<float> rise_;
+
+    JUCE_DECLARE_NON_COPYABLE(SpectralFlux)
+};
+
+//==============================================================================
+// Finds attacks in the audio a JackMeter feeds it, on a thread of its own:
+// every hop (half a frame) it takes the flux of the latest frame and calls
+// it an onset when it's over threshold and sensitivity times the average of
+// the last few, and the last onset was at least minGapMs ago. Onsets are
+// queued for the control thread, with how far behind the audio they were
+// found, so whatever acts on one can make up for the time it took.
+class OnsetDetector : private Thread
+{
+public:
+    static const int hopSize = SpectralFlux::frameSize / 2;
+    static const int historySize = 8;
+    static const int minGapMs = 100;
+
+    struct Onset
+    {
+	int64 ticks_;       // Time::getHighResolutionTicks() when it was found
+	int framesAgo_;     // the frames fed since the hop it's in began, by then
+	float flux_;
+    };
+
+    OnsetDetector()
+	: Thread("loop4r onset"), onsets_(16), frame_(SpectralFlux::frameSize, true)
+    {
+    }
+
+    ~OnsetDetector()
+    {
+	stop();
+    }
+
+    // meter must stay open until stop(); onOnset is called from our thread
+    void start(JackMeter& meter, float threshold, float sensitivity, std::function<void()> onOnset)
+    {
+	stop();
+	meter_ = &meter;
+	threshold_ = threshold;
+	sensitivity_ = sensitivity;
+	onOnset_ = onOnset;
+	meter.setFeeding(true);
+	startThread();
+    }
+
+    void stop()
+    {
+	stopThread(1000);
+	if (meter_ != nullptr)
+	{
+	    meter_->setFeeding(false);
+	    meter_ = nullptr;
+	}
+    }
+
+    bool isRunning() const          { return isThreadRunning(); }
+
+    // control thread
+    bool popOnset(Onset& onset)
+    {
+	return onsets_.pop(onset);
+    }
+
+    int64 getNumHops() const        { return numHops_.load(); }
+    int64 getNumOnsets() const      { return numOnsets_.load(); }
+
+private:
+    void run() override
+    {
+	meter_->skipReady();
+	flux_.reset();
+	FloatVectorOperations::clear(frame_, SpectralFlux::frameSize);
+	float history[historySize] = {};
+	int next = 0;
+	int filled = 0;
+	int64 framesRead = meter_->getFramesFed();
+	int64 lastOnset = -1;
+	const int sampleRate = jmax(1, meter_->getSampleRate());
+	const int64 minGap = (int64) sampleRate * minGapMs / 1000;
+
+	while (!threadShouldExit())
+	{
+	    // the newest hop goes after the older half of the frame
+	    const int read = meter_->readSamples(frame_ + hopSize + filled, hopSize - filled);
+	    filled += read;
+	    framesRead += read;
+	    if (filled < hopSize)
+	    {
+		wait(2);
+		continue;
+	    }
+
+	    const float flux = flux_.process(frame_);
+	    FloatVectorOperations::copy(frame_, frame_ + hopSize, hopSize);
+	    filled = 0;
+	    numHops_.fetch_add(1, std::memory_order_relaxed);
+
+	    float average = 0;
+	    for (float past : history)
+	    {
+		average += past;
+	    }
+	    average /= historySize;
+	    history[next] = flux;
+	    next = (next + 1) % historySize;
+
+	    const int64 hopStart = framesRead - hopSize;
+	    if (flux > threshold_ && flux > sensitivity_ * average && (lastOnset < 0 || hopStart - lastOnset >= minGap))
+	    {
+		lastOnset = hopStart;
+		const Onset onset = { Time::getHighResolutionTicks(), (int) (meter_->getFramesFed() - hopStart), flux };
+		if (onsets_.push(onset))
+		{
+		    numOnsets_.fetch_add(1, std::memory_order_relaxed);
+		    onOnset_();
+		}
+	    }
+	}
+    }
+
+    JackMeter* meter_ = nullptr;
+    SpectralFlux flux_;
+    float threshold_ = 0;
+    float sensitivity_ = 0;
+    std::function<void()> onOnset_;
+    SpscQueue<Onset> onsets_;               // our thread -> control thread
+    HeapBlock<float> frame_;
+    std::atomic<int64> numHops_ { 0 };
+    std::atomic<int64> numOnsets_ { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE(OnsetDetector)
+};
@@ -0,0 +1,104 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "OscMessageView.h"
+#include <cstring>
+
+//==============================================================================
+// Holds back messages that end in a 4-byte value and keeps only the latest
+// per everything before it, i.e. per address and leading arguments: a burst
+// of "/ctrl loop state value" updates becomes one per loop and control. flush()
+// hands them over in the order they first arrived, each with the arrival time
+// of its latest value. Copies are kept in a fixed table, nothing is allocated.
+class OscCoalescer
+{
+public:
+    static const int maxEntries = 64;
+    static const int maxMessageSize = 64;
+
+    OscCoalescer() {}
+
+    // false if it doesn't fit (too long or the table's full), handle it now then
+    bool add(const OscMessageView& message, int64 arrivalTicks = 0)
+    {
+	const int size = message.getSize();
+	if (size < 4 || size > maxMessageSize)
+	{
+	    return false;
+	}
+
+	const int keySize = size - 4;
+	for (int i = 0; i < numEntries_; ++i)
+	{
+	    Entry& entry = entries_[i];
+	    if (entry.size_ == size && std::memcmp(entry.data_, message.getData(), (size_t) keySize) == 0)
+	    {
+		std::memcpy(entry.data_ + keySize, message.getData() + keySize, 4);
+		entry.arrivalTicks_ = arrivalTicks;
+		++numCoalesced_;
+		return true;
+	    }
+	}
+
+	if (numEntries_ == maxEntries)
+	{
+	    return false;
+	}
+	Entry& entry = entries_[numEntries_++];
+	entry.size_ = size;
+	entry.arrivalTicks_ = arrivalTicks;
+	std::memcpy(entry.data_, message.getData(), (size_t) size);
+	return true;
+    }
+
+    // calls onMessage(const OscMessageView&, int64 arrivalTicks) for each held
+    // message, then forgets them
+    template <typename Function>
+    void flush(Function onMessage)
+    {
+	const int numEntries = numEntries_;
+	numEntries_ = 0;
+	for (int i = 0; i < numEntries; ++i)
+	{
+	    onMessage(OscMessageView(entries_[i].data_, entries_[i].size_), entries_[i].arrivalTicks_);
+	}
+    }
+
+    bool isEmpty() const                { return numEntries_ == 0; }
+
+    // messages replaced by a later one
+    int64 getNumCoalesced() const       { return numCoalesced_; }
+
+private:
+    struct Entry
+    {
+	int size_;
+	int64 arrivalTicks_;
+	char data_[maxMessageSize];
+    };
+
+    Entry entries_[maxEntries];
+    int numEntries_ = 0;
+    int64 numCoalesced_ = 0;
+
+    JUCE_DECLARE_NON_COPYABLE(OscCoalescer)
+};
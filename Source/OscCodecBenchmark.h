@@ -0,0 +1,307 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "OscMessageView.h"
+#include "OscPacket.h"
+#include <cstring>
+
+//==============================================================================
+// The OSC encoding and decoding on their own, for "bench": the shapes that
+// are on the wire all the time, each through the JUCE objects the way
+// OSCSender and OSCReceiver deal in them and through our own paths, the
+// zero-copy view and schemas, the writer, the typed messages and the
+// packets built once. JUCE's OSCOutputStream and OSCInputStream are private
+// to juce_osc, so its side is an OSCMessage built and written out with
+// OscMessageWriter::write(), or read back into one with toMessage(): the
+// OSCMessage, its OSCArguments and Strings are where the allocations are.
+class OscCodecBenchmark
+{
+public:
+    enum Shape
+    {
+	Ctrl,               // "/ctrl ,isf", every SooperLooper update
+	Heartbeat,          // "/heartbeat ,ssii"
+	Led,                // "/led ,iiiii", every LED change pushed
+	Register,           // "/sl/N/register_auto_update ,siss"
+	numShapes
+    };
+
+    enum Path
+    {
+	JuceEncode,         // an OSCMessage built and written out
+	WriterEncode,       // OscMessageWriter, tags up front
+	TypedEncode,        // OscTypedMessage, only fixed size arguments
+	CachedEncode,       // the packet built once, copied out as a send queues it
+	JuceDecode,         // back into an OSCMessage
+	ViewDecode,         // OscMessageView, the tags checked one by one
+	SchemaDecode,       // OscMessageView and an OscSchema
+	numPaths
+    };
+
+    OscCodecBenchmark()
+    {
+	for (int shape = 0; shape < numShapes; ++shape)
+	{
+	    OscPacket& packet = packets_[shape];
+	    packet.size_ = writeWithWriter((Shape) shape, packet.data_, 0);
+#if JUCE_DEBUG
+	    // every encoder has to come up with the same bytes
+	    OscPacket check;
+	    check.size_ = writeWithJuce((Shape) shape, check.data_, 0);
+	    jassert(check.size_ == packet.size_ && std::memcmp(check.data_, packet.data_, (size_t) packet.size_) == 0);
+	    if (shape == Led)
+	    {
+		check.size_ = writeTyped(check.data_, 0);
+		jassert(check.size_ == packet.size_ && std::memcmp(check.data_, packet.data_, (size_t) packet.size_) == 0);
+	    }
+#endif
+	}
+    }
+
+    static const char* getShapeName(Shape shape)
+    {
+	switch (shape)
+	{
+	    case Ctrl:          return "ctrl";
+	    case Heartbeat:     return "heartbeat";
+	    case Led:           return "led";
+	    case Register:      return "register";
+	    default:            return "?";
+	}
+    }
+
+    static const char* getPathName(Path path)
+    {
+	switch (path)
+	{
+	    case JuceEncode:    return "juce enc";
+	    case WriterEncode:  return "writer";
+	    case TypedEncode:   return "typed";
+	    case CachedEncode:  return "cached";
+	    case JuceDecode:    return "juce dec";
+	    case ViewDecode:    return "view";
+	    case SchemaDecode:  return "schema";
+	    default:            return "?";
+	}
+    }
+
+    // typed messages only take ints and floats, so of these only /led
+    static bool applies(Shape shape, Path path)
+    {
+	return path != TypedEncode || shape == Led;
+    }
+
+    // one message of shape through path, i varies the values encoded
+    void run(Shape shape, Path path, int64 i)
+    {
+	const int value = (int) (i & 7);
+	const OscPacket& packet = packets_[shape];
+	switch (path)
+	{
+	    case JuceEncode:    consume(writeWithJuce(shape, out_.data_, value)); break;
+	    case WriterEncode:  consume(writeWithWriter(shape, out_.data_, value)); break;
+	    case TypedEncode:   consume(writeTyped(out_.data_, value)); break;
+	    case CachedEncode:
+		std::memcpy(out_.data_, packet.data_, (size_t) packet.size_);
+		consume(packet.size_);
+		break;
+	    case JuceDecode:    consume(readWithJuce(packet)); break;
+	    case ViewDecode:    consume(readWithView(shape, packet)); break;
+	    case SchemaDecode:  consume(readWithSchema(shape, packet)); break;
+	    default:            break;
+	}
+    }
+
+private:
+    static const char* getUrl()         { return "osc.udp://localhost:9951/"; }
+
+    void consume(int value)             { checksum_ = checksum_ + value; }
+
+    static int writeWithJuce(Shape shape, char* buffer, int value)
+    {
+	OscMessageWriter writer(buffer, OscPacket::maxSize);
+	switch (shape)
+	{
+	    case Ctrl:
+	    {
+		OSCMessage message("/ctrl");
+		message.addInt32(value);
+		message.addString("state");
+		message.addFloat32((float) value);
+		writer.write(message);
+		break;
+	    }
+	    case Heartbeat:
+	    {
+		OSCMessage message("/heartbeat");
+		message.addString(getUrl());
+		message.addString("1.7.3");
+		message.addInt32(8);
+		message.addInt32(value);
+		writer.write(message);
+		break;
+	    }
+	    case Led:
+	    {
+		OSCMessage message("/led");
+		message.addInt32(value);
+		message.addInt32(1);
+		message.addInt32(0);
+		message.addInt32(2);
+		message.addInt32(value);
+		writer.write(message);
+		break;
+	    }
+	    case Register:
+	    {
+		OSCMessage message("/sl/0/register_auto_update");
+		message.addString("state");
+		message.addInt32(100 + value);
+		message.addString(getUrl());
+		message.addString("/ctrl");
+		writer.write(message);
+		break;
+	    }
+	    default:
+		break;
+	}
+	return writer.size();
+    }
+
+    static int writeWithWriter(Shape shape, char* buffer, int value)
+    {
+	OscMessageWriter writer(buffer, OscPacket::maxSize);
+	switch (shape)
+	{
+	    case Ctrl:
+		writer.begin("/ctrl", "isf").addInt32(value).addString("state").addFloat32((float) value);
+		break;
+	    case Heartbeat:
+		writer.begin("/heartbeat", "ssii").addString(getUrl()).addString("1.7.3").addInt32(8).addInt32(value);
+		break;
+	    case Led:
+		writer.begin("/led", "iiiii").addInt32(value).addInt32(1).addInt32(0).addInt32(2).addInt32(value);
+		break;
+	    case Register:
+		writer.begin("/sl/0/register_auto_update", "siss").addString("state").addInt32(100 + value).addString(getUrl()).addString("/ctrl");
+		break;
+	    default:
+		break;
+	}
+	return writer.size();
+    }
+
+    static int writeTyped(char* buffer, int value)
+    {
+	static constexpr auto ledMessage = makeOscMessage<OscInt32, OscInt32, OscInt32, OscInt32, OscInt32>("/led");
+	return ledMessage.write(buffer, value, 1, 0, 2, value);
+    }
+
+    // the arguments as a handler would take them, a String for a string
+    static int readWithJuce(const OscPacket& packet)
+    {
+	OSCMessage message("/");
+	if (!OscMessageReader::read(packet.data_, packet.size_, message))
+	{
+	    return 0;
+	}
+	int sum = 0;
+	for (auto& arg : message)
+	{
+	    sum += arg.isInt32() ? arg.getInt32() : arg.isFloat32() ? (int) arg.getFloat32() : arg.getString().length();
+	}
+	return sum;
+    }
+
+    static int readWithView(Shape shape, const OscPacket& packet)
+    {
+	const OscMessageView message(packet.data_, packet.size_);
+	if (!message.isValid())
+	{
+	    return 0;
+	}
+	switch (shape)
+	{
+	    case Ctrl:
+		return message.size() == 3 && message.isInt32(0) && message.isString(1) && message.isFloat32(2)
+		    ? message.getInt32(0) + (int) std::strlen(message.getString(1)) + (int) message.getFloat32(2) : 0;
+	    case Heartbeat:
+		return message.size() == 4 && message.isString(0) && message.isString(1) && message.isInt32(2) && message.isInt32(3)
+		    ? (int) std::strlen(message.getString(0)) + (int) std::strlen(message.getString(1)) + message.getInt32(2) + message.getInt32(3) : 0;
+	    case Led:
+	    {
+		int sum = 0;
+		for (int i = 0; i < message.size() && message.isInt32(i); ++i)
+		{
+		    sum += message.getInt32(i);
+		}
+		return sum;
+	    }
+	    case Register:
+		return message.size() == 4 && message.isString(0) && message.isInt32(1) && message.isString(2) && message.isString(3)
+		    ? (int) std::strlen(message.getString(0)) + message.getInt32(1) + (int) std::strlen(message.getString(2)) + (int) std::strlen(message.getString(3)) : 0;
+	    default:
+		return 0;
+	}
+    }
+
+    static int readWithSchema(Shape shape, const OscPacket& packet)
+    {
+	const OscMessageView message(packet.data_, packet.size_);
+	switch (shape)
+	{
+	    case Ctrl:
+	    {
+		SooperLooperCtrl ctrl;
+		return ctrl.read(message) ? ctrl.loop_ + (int) std::strlen(ctrl.control_) + (int) ctrl.value_ : 0;
+	    }
+	    case Heartbeat:
+	    {
+		SooperLooperHeartbeat heartbeat;
+		return heartbeat.read(message)
+		    ? (int) std::strlen(heartbeat.hostUrl_) + (int) std::strlen(heartbeat.version_) + heartbeat.numLoops_ + heartbeat.engineId_ : 0;
+	    }
+	    case Led:
+	    {
+		int32 index, on, timer, state, version;
+		return OscSchema<OscInt32, OscInt32, OscInt32, OscInt32, OscInt32>::read(message, index, on, timer, state, version)
+		    ? index + on + timer + state + version : 0;
+	    }
+	    case Register:
+	    {
+		const char* control;
+		int32 intervalMs;
+		const char* returnUrl;
+		const char* path;
+		return OscSchema<OscString, OscInt32, OscString, OscString>::read(message, control, intervalMs, returnUrl, path)
+		    ? (int) std::strlen(control) + intervalMs + (int) std::strlen(returnUrl) + (int) std::strlen(path) : 0;
+	    }
+	    default:
+		return 0;
+	}
+    }
+
+    OscPacket packets_[numShapes];
+    OscPacket out_;
+    volatile int64 checksum_ = 0;       // so none of it is optimised away
+
+    JUCE_DECLARE_NON_COPYABLE(OscCodecBenchmark)
+};
@@ -0,0 +1,181 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "OscMessageView.h"
+
+//==============================================================================
+// Routes an OSC address to a member function of Owner. Addresses are
+// registered once up front, into one trie of their characters, so an address
+// coming in is routed by a single walk along it, however many there are.
+// One that has no handler of its own goes to the first registered address it
+// starts with, so "/ctrl/foo" style addresses keep working; the walk passes
+// them on its way.
+//
+// The few hot addresses can also get a handler taking an OscMessageView.
+// They're in the same trie, found from the raw address, so a message read in
+// place reaches its handler without anything being allocated.
+template <typename Owner>
+class OscDispatcher
+{
+public:
+    typedef void (Owner::*Handler)(const OSCMessage&);
+    typedef void (Owner::*ViewHandler)(const OscMessageView&);
+
+    struct ViewEntry
+    {
+	String address_;
+	ViewHandler handler_;
+	bool verbose_;
+    };
+
+    struct Entry
+    {
+	String address_;
+	Handler handler_;
+	bool verbose_;          // dump the message to stderr before handling
+    };
+
+    OscDispatcher()
+    {
+	nodes_.add(Node());
+    }
+
+    void add(const String& address, Handler handler, bool verbose = true)
+    {
+	entries_.add({address, handler, verbose});
+	nodes_.getReference(insert(address)).entry_ = entries_.size() - 1;
+    }
+
+    void addView(const String& address, ViewHandler handler, bool verbose = true)
+    {
+	viewEntries_.add({address, handler, verbose});
+	nodes_.getReference(insert(address)).view_ = viewEntries_.size() - 1;
+    }
+
+    // exact matches only, nullptr means use the OSCMessage path
+    const ViewEntry* findView(const char* address) const
+    {
+	const int node = walk(address, [] (const Node&) {});
+	return node >= 0 && nodes_.getReference(node).view_ >= 0 ? &viewEntries_.getReference(nodes_.getReference(node).view_) : nullptr;
+    }
+
+    const Entry* find(const String& address) const
+    {
+	int prefix = -1;
+	const int node = walk(address.toRawUTF8(), [&prefix] (const Node& passed)
+	{
+	    if (passed.entry_ >= 0 && (prefix < 0 || passed.entry_ < prefix))
+	    {
+		prefix = passed.entry_;
+	    }
+	});
+	const int entry = node >= 0 && nodes_.getReference(node).entry_ >= 0 ? nodes_.getReference(node).entry_ : prefix;
+	return entry >= 0 ? &entries_.getReference(entry) : nullptr;
+    }
+
+    // whether anything handles address, by itself or as the start of a longer
+    // one; a walk of the trie, so unknown traffic can be turned away unparsed
+    bool knows(const char* address) const
+    {
+	bool prefix = false;
+	const int node = walk(address, [&prefix] (const Node& passed) { prefix = prefix || passed.entry_ >= 0; });
+	return prefix || (node >= 0 && (nodes_.getReference(node).entry_ >= 0 || nodes_.getReference(node).view_ >= 0));
+    }
+
+    bool dispatch(Owner& owner, const Entry* entry, const OSCMessage& message) const
+    {
+	if (entry == nullptr)
+	{
+	    return false;
+	}
+
+	(owner.*(entry->handler_))(message);
+	return true;
+    }
+
+    int size() const    { return entries_.size(); }
+
+private:
+    // a character of an address, the first of those that can follow it and
+    // the next that can take its place; nodes_[0] is where every address starts
+    struct Node
+    {
+	char char_ = 0;
+	int child_ = -1;
+	int sibling_ = -1;
+	int entry_ = -1;        // the address up to here has a handler
+	int view_ = -1;
+    };
+
+    int findChild(int node, char c) const
+    {
+	int child = nodes_.getReference(node).child_;
+	while (child >= 0 && nodes_.getReference(child).char_ != c)
+	{
+	    child = nodes_.getReference(child).sibling_;
+	}
+	return child;
+    }
+
+    int insert(const String& address)
+    {
+	int node = 0;
+	for (const char* c = address.toRawUTF8(); *c != 0; ++c)
+	{
+	    int child = findChild(node, *c);
+	    if (child < 0)
+	    {
+		Node added;
+		added.char_ = *c;
+		added.sibling_ = nodes_.getReference(node).child_;
+		nodes_.add(added);
+		child = nodes_.size() - 1;
+		nodes_.getReference(node).child_ = child;
+	    }
+	    node = child;
+	}
+	return node;
+    }
+
+    // the node address ends at, -1 if it leaves the trie; passed(node) for
+    // every node on the way but that last one
+    template <typename Passed>
+    int walk(const char* address, Passed&& passed) const
+    {
+	int node = 0;
+	for (const char* c = address; *c != 0; ++c)
+	{
+	    passed(nodes_.getReference(node));
+	    node = findChild(node, *c);
+	    if (node < 0)
+	    {
+		return -1;
+	    }
+	}
+	return node;
+    }
+
+    Array<Entry> entries_;
+    Array<ViewEntry> viewEntries_;
+    Array<Node> nodes_;
+
+    JUCE_DECLARE_NON_COPYABLE(OscDispatcher)
+};
@@ -0,0 +1,186 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include <atomic>
+
+//==============================================================================
+// What an OSC datagram goes through before it's parsed. Each source (address
+// and port) has a budget of packets a second, kept as a token bucket topped
+// up as time passes; one that runs through it is blocked for a while and its
+// datagrams are dropped unread. The few sources seen last are remembered, an
+// idle one giving way to a new one. What's turned away here, or later as
+// malformed or for an address nobody handles, is only counted, so a program
+// sending us the wrong traffic costs a compare and an increment a datagram.
+//
+// admit() is for the thread reading the socket; the counts can be bumped and
+// read from any.
+class OscGate
+{
+public:
+    enum Rejection
+    {
+	Malformed,
+	UnknownAddress,
+	RateLimited,        // the datagram its source went over the budget with
+	Blocked,            // dropped while its source was blocked
+	numRejections
+    };
+
+    static const int maxSources = 16;
+
+    OscGate(int packetsPerSecond, int blockMs)
+    {
+	setLimit(packetsPerSecond, blockMs);
+    }
+
+    // packets a second a source may send, 0 for no limit, and for how long
+    // one that sends more is blocked
+    void setLimit(int packetsPerSecond, int blockMs)
+    {
+	packetsPerSecond_ = jmax(0, packetsPerSecond);
+	blockMs_ = jmax(0, blockMs);
+	for (auto& source : sources_)
+	{
+	    source = Source();
+	}
+    }
+
+    int getPacketsPerSecond() const     { return packetsPerSecond_; }
+    int getBlockMs() const              { return blockMs_; }
+
+    // false if the datagram from source is to be dropped, and counted as such
+    bool admit(uint64 source, uint32 now)
+    {
+	if (packetsPerSecond_ == 0)
+	{
+	    return true;
+	}
+
+	Source& entry = find(source, now);
+	if (entry.blocked_ && (int32) (now - entry.blockedUntil_) < 0)
+	{
+	    reject(Blocked);
+	    return false;
+	}
+	if (entry.blocked_)
+	{
+	    // out of the penalty box with a full budget
+	    entry.blocked_ = false;
+	    entry.credit_ = fullCredit();
+	}
+
+	entry.credit_ = jmin(fullCredit(), entry.credit_ + (int64) (uint32) (now - entry.lastSeen_) * packetsPerSecond_);
+	entry.lastSeen_ = now;
+	if (entry.credit_ < packetCost)
+	{
+	    entry.blocked_ = true;
+	    entry.blockedUntil_ = now + (uint32) blockMs_;
+	    ++numBlocks_;
+	    reject(RateLimited);
+	    return false;
+	}
+	entry.credit_ -= packetCost;
+	return true;
+    }
+
+    void reject(Rejection why)
+    {
+	rejected_[why].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    int64 getNumRejected(Rejection why) const   { return rejected_[why].load(std::memory_order_relaxed); }
+
+    int64 getNumRejected() const
+    {
+	int64 total = 0;
+	for (int i = 0; i < numRejections; ++i)
+	{
+	    total += getNumRejected((Rejection) i);
+	}
+	return total;
+    }
+
+    // times a source has been blocked
+    int64 getNumBlocks() const      { return numBlocks_.load(std::memory_order_relaxed); }
+
+private:
+    // credit is in thousandths of a packet, so a millisecond tops it up by
+    // packetsPerSecond_
+    static const int64 packetCost = 1000;
+
+    struct Source
+    {
+	uint64 key_ = 0;
+	bool used_ = false;
+	bool blocked_ = false;
+	uint32 lastSeen_ = 0;
+	uint32 blockedUntil_ = 0;
+	int64 credit_ = 0;
+    };
+
+    int64 fullCredit() const    { return (int64) packetsPerSecond_ * packetCost; }
+
+    // the source's entry, for a new one taking over a free entry, else the
+    // longest idle that isn't blocked, else the longest idle
+    Source& find(uint64 key, uint32 now)
+    {
+	Source* victim = nullptr;
+	for (auto& source : sources_)
+	{
+	    if (source.used_ && source.key_ == key)
+	    {
+		return source;
+	    }
+	    if (victim == nullptr || isBetterVictim(source, *victim))
+	    {
+		victim = &source;
+	    }
+	}
+	*victim = Source();
+	victim->key_ = key;
+	victim->used_ = true;
+	victim->lastSeen_ = now;
+	victim->credit_ = fullCredit();
+	return *victim;
+    }
+
+    static bool isBetterVictim(const Source& source, const Source& than)
+    {
+	if (source.used_ != than.used_)
+	{
+	    return !source.used_;
+	}
+	if (source.blocked_ != than.blocked_)
+	{
+	    return !source.blocked_;
+	}
+	return (int32) (source.lastSeen_ - than.lastSeen_) < 0;
+    }
+
+    int packetsPerSecond_ = 0;
+    int blockMs_ = 0;
+    Source sources_[maxSources];
+    std::atomic<int64> rejected_[numRejections] {};
+    std::atomic<int64> numBlocks_ { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE(OscGate)
+};
@@ -0,0 +1,206 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include <cstring>
+
+//==============================================================================
+// An OSC message read in place: the address, the type tags and the argument
+// offsets point into the caller's buffer, which has to outlive the view.
+// Parsing and reading allocate nothing, so the hot handlers (SooperLooper's
+// fixed "/ctrl ,isf" and friends) can run straight off the receive buffer.
+// toMessage() makes a full OSCMessage for everything else. Only int, float,
+// string and blob arguments are understood, like OSCMessage itself.
+class OscMessageView
+{
+public:
+    static const int maxArgs = 16;
+
+    OscMessageView() {}
+
+    OscMessageView(const void* data, int size)
+    {
+	parse(data, size);
+    }
+
+    // false for a malformed message or one we can't represent
+    bool parse(const void* data, int size)
+    {
+	data_ = static_cast<const char*>(data);
+	size_ = size;
+	numArgs_ = 0;
+	valid_ = false;
+
+	int pos = 0;
+	address_ = readString(pos);
+	typeTags_ = readString(pos);
+	if (address_ == nullptr || typeTags_ == nullptr || *address_ != '/' || *typeTags_ != ',')
+	{
+	    return false;
+	}
+
+	for (const char* tag = typeTags_ + 1; *tag != 0; ++tag, ++numArgs_)
+	{
+	    if (numArgs_ == maxArgs)
+	    {
+		return false;
+	    }
+	    offsets_[numArgs_] = pos;
+	    switch (*tag)
+	    {
+		case 'i':
+		case 'f':
+		    pos += 4;
+		    if (pos > size_)
+		    {
+			return false;
+		    }
+		    break;
+		case 's':
+		    if (readString(pos) == nullptr)
+		    {
+			return false;
+		    }
+		    break;
+		case 'b':
+		    {
+			const int blobSize = pos + 4 <= size_ ? (int) readInt(pos) : -1;
+			if (blobSize < 0 || blobSize > size_ - pos - 4)
+			{
+			    return false;
+			}
+			pos = jmin(size_, padded(pos + 4 + blobSize));
+		    }
+		    break;
+		default:
+		    return false;
+	    }
+	}
+	valid_ = true;
+	return true;
+    }
+
+    bool isValid() const                { return valid_; }
+
+    // the message as it was received
+    const char* getData() const         { return data_; }
+    int getSize() const                 { return size_; }
+
+    const char* getAddress() const      { return address_; }
+    int size() const                    { return numArgs_; }
+    bool isEmpty() const                { return numArgs_ == 0; }
+
+    // the type tag, 0 past the last argument
+    char getType(int index) const       { return isPositiveAndBelow(index, numArgs_) ? typeTags_[index + 1] : 0; }
+    bool isInt32(int index) const       { return getType(index) == 'i'; }
+    bool isFloat32(int index) const     { return getType(index) == 'f'; }
+    bool isString(int index) const      { return getType(index) == 's'; }
+    bool isBlob(int index) const        { return getType(index) == 'b'; }
+
+    // true if the type tags are exactly tags, "," included, for numArgs
+    // arguments: one memcmp, whatever the message holds
+    bool hasTypeTags(const char* tags, int numArgs) const
+    {
+	return valid_ && numArgs_ == numArgs && std::memcmp(typeTags_, tags, (size_t) numArgs + 2) == 0;
+    }
+
+    // the getters expect an argument of that type
+    int32 getInt32(int index) const     { return (int32) readInt(offsets_[index]); }
+
+    float getFloat32(int index) const
+    {
+	const uint32 bits = readInt(offsets_[index]);
+	float value;
+	std::memcpy(&value, &bits, sizeof(value));
+	return value;
+    }
+
+    // not a copy, points into the buffer
+    const char* getString(int index) const  { return data_ + offsets_[index]; }
+
+    bool isString(int index, const char* text) const
+    {
+	return isString(index) && std::strcmp(getString(index), text) == 0;
+    }
+
+    const void* getBlobData(int index) const    { return data_ + offsets_[index] + 4; }
+    int getBlobSize(int index) const            { return (int) readInt(offsets_[index]); }
+
+    // copies the message, false if OSCMessage won't take its address
+    bool toMessage(OSCMessage& message) const
+    {
+	if (!valid_)
+	{
+	    return false;
+	}
+	try
+	{
+	    message = OSCMessage(address_);
+	}
+	catch (const OSCFormatError&)
+	{
+	    return false;
+	}
+
+	for (int i = 0; i < numArgs_; ++i)
+	{
+	    switch (getType(i))
+	    {
+		case 'i':   message.addInt32(getInt32(i)); break;
+		case 'f':   message.addFloat32(getFloat32(i)); break;
+		case 's':   message.addString(getString(i)); break;
+		case 'b':   message.addBlob(MemoryBlock(getBlobData(i), (size_t) getBlobSize(i))); break;
+		default:    break;
+	    }
+	}
+	return true;
+    }
+
+private:
+    static int padded(int size)     { return (size + 3) & ~3; }
+
+    uint32 readInt(int pos) const
+    {
+	return ((uint32) (uint8) data_[pos] << 24) | ((uint32) (uint8) data_[pos + 1] << 16)
+	    | ((uint32) (uint8) data_[pos + 2] << 8) | (uint32) (uint8) data_[pos + 3];
+    }
+
+    // the padded string at pos, nullptr if it runs past the end
+    const char* readString(int& pos) const
+    {
+	const char* start = data_ + pos;
+	const void* end = pos < size_ ? std::memchr(start, 0, (size_t) (size_ - pos)) : nullptr;
+	if (end == nullptr)
+	{
+	    return nullptr;
+	}
+	pos = jmin(size_, padded((int) (static_cast<const char*>(end) - data_) + 1));
+	return start;
+    }
+
+    const char* data_ = nullptr;
+    int size_ = 0;
+    const char* address_ = nullptr;
+    const char* typeTags_ = nullptr;
+    int offsets_[maxArgs];
+    int numArgs_ = 0;
+    bool valid_ = false;
+};
@@ -0,0 +1,1151 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "TraceCapture.h"
+#include "Metrics.h"
+#include "SpanTrace.h"
+#include "OscMessageView.h"
+#include "OscSendThread.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#if JUCE_LINUX || JUCE_MAC
+ #include <arpa/inet.h>
+ #include <netdb.h>
+ #include <sys/socket.h>
+ #include <unistd.h>
+#endif
+
+//==============================================================================
+// A complete OSC datagram, encoded once and resent as is.
+struct OscPacket
+{
+    static const int maxSize = 256;
+
+    char data_[maxSize];
+    int size_ = 0;
+
+    bool isValid() const    { return size_ > 0; }
+    void clear()            { size_ = 0; }
+};
+
+//==============================================================================
+// Writes an OSC message straight into a caller supplied buffer. The type tags
+// are given up front (without the leading ','), the arguments then have to be
+// added in that order. Never allocates; if the buffer is too small the writer
+// goes invalid and size() returns 0.
+class OscMessageWriter
+{
+public:
+    OscMessageWriter(char* buffer, int capacity) : buffer_(buffer), capacity_(capacity), pos_(0), ok_(true) {}
+
+    OscMessageWriter(OscPacket& packet) : OscMessageWriter(packet.data_, OscPacket::maxSize) {}
+
+    OscMessageWriter& begin(const char* address, const char* typeTags)
+    {
+	pos_ = 0;
+	ok_ = true;
+	writePaddedString(address);
+
+	const int numTags = (int) std::strlen(typeTags);
+	if (reserve(padded(numTags + 2)))
+	{
+	    buffer_[pos_] = ',';
+	    std::memcpy(buffer_ + pos_ + 1, typeTags, (size_t) numTags);
+	    pad(pos_ + 1 + numTags);
+	}
+	return *this;
+    }
+
+    OscMessageWriter& addInt32(int32 value)
+    {
+	writeBigEndian((uint32) value);
+	return *this;
+    }
+
+    OscMessageWriter& addFloat32(float value)
+    {
+	uint32 bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+	writeBigEndian(bits);
+	return *this;
+    }
+
+    OscMessageWriter& addString(const char* value)
+    {
+	writePaddedString(value);
+	return *this;
+    }
+
+    OscMessageWriter& addBlob(const void* data, int size)
+    {
+	writeBigEndian((uint32) size);
+	if (reserve(padded(size)))
+	{
+	    std::memcpy(buffer_ + pos_, data, (size_t) size);
+	    std::memset(buffer_ + pos_ + size, 0, (size_t) (padded(size) - size));
+	    pos_ += padded(size);
+	}
+	return *this;
+    }
+
+    // the whole of message, as long as its arguments are all int, float or
+    // string; returns false (leaving the rest out) when they aren't
+    bool write(const OSCMessage& message)
+    {
+	char typeTags[32];
+	int numTags = 0;
+	for (auto& arg : message)
+	{
+	    if (!(arg.isInt32() || arg.isFloat32() || arg.isString()) || numTags == (int) sizeof(typeTags) - 1)
+	    {
+		break;
+	    }
+	    typeTags[numTags++] = arg.getType();
+	}
+	typeTags[numTags] = 0;
+
+	begin(message.getAddressPattern().toString().toRawUTF8(), typeTags);
+	for (int i = 0; i < numTags; ++i)
+	{
+	    const OSCArgument& arg = message[i];
+	    if (arg.isInt32())
+	    {
+		addInt32(arg.getInt32());
+	    }
+	    else if (arg.isFloat32())
+	    {
+		addFloat32(arg.getFloat32());
+	    }
+	    else
+	    {
+		addString(arg.getString().toRawUTF8());
+	    }
+	}
+	return numTags == message.size();
+    }
+
+    const char* getData() const     { return buffer_; }
+    int size() const                { return ok_ ? pos_ : 0; }
+    bool ok() const                 { return ok_; }
+
+    static int padded(int size)     { return (size + 3) & ~3; }
+
+private:
+    bool reserve(int numBytes)
+    {
+	if (!ok_ || pos_ + numBytes > capacity_)
+	{
+	    ok_ = false;
+	}
+	return ok_;
+    }
+
+    // zero fill from end up to the next 4 byte boundary (OSC strings always get at least one 0)
+    void pad(int end)
+    {
+	const int paddedEnd = padded(end + 1);
+	std::memset(buffer_ + end, 0, (size_t) (paddedEnd - end));
+	pos_ = paddedEnd;
+    }
+
+    void writePaddedString(const char* value)
+    {
+	const int length = (int) std::strlen(value);
+	if (reserve(padded(length + 1)))
+	{
+	    std::memcpy(buffer_ + pos_, value, (size_t) length);
+	    pad(pos_ + length);
+	}
+    }
+
+    void writeBigEndian(uint32 value)
+    {
+	if (reserve(4))
+	{
+	    buffer_[pos_++] = (char) ((value >> 24) & 0xff);
+	    buffer_[pos_++] = (char) ((value >> 16) & 0xff);
+	    buffer_[pos_++] = (char) ((value >> 8) & 0xff);
+	    buffer_[pos_++] = (char) (value & 0xff);
+	}
+    }
+
+    char* buffer_;
+    int capacity_;
+    int pos_;
+    bool ok_;
+};
+
+//==============================================================================
+// A message whose address and argument types are fixed at compile time, for
+// the ones sent on every LED change. The constexpr constructor lays out the
+// address, the type tags and their padding once; write() copies that header
+// and puts the values after it in network order. Only fixed size arguments
+// (OscInt32, OscFloat32), so the size is known statically too:
+//
+//     static constexpr auto led = makeOscMessage<OscInt32, OscInt32>("/led");
+//     packet.size_ = led.write(packet.data_, index, on);
+struct OscInt32
+{
+    typedef int32 Value;
+    static constexpr char tag = 'i';
+};
+
+struct OscFloat32
+{
+    typedef float Value;
+    static constexpr char tag = 'f';
+};
+
+constexpr int oscPadded(int size)   { return (size + 3) & ~3; }
+
+template <int AddressLength, typename... Args>
+class OscTypedMessage
+{
+public:
+    static constexpr int numArgs = (int) sizeof...(Args);
+    static constexpr int tagsOffset = oscPadded(AddressLength + 1);
+    static constexpr int headerSize = tagsOffset + oscPadded(numArgs + 2);
+    static constexpr int size = headerSize + 4 * numArgs;
+
+    static_assert(size <= OscPacket::maxSize, "doesn't fit an OscPacket");
+
+    constexpr OscTypedMessage(const char* address)
+	: header_()
+    {
+	const char tags[] = { Args::tag..., 0 };
+	for (int i = 0; i < AddressLength; ++i)
+	{
+	    header_[i] = address[i];
+	}
+	header_[tagsOffset] = ',';
+	for (int i = 0; i < numArgs; ++i)
+	{
+	    header_[tagsOffset + 1 + i] = tags[i];
+	}
+    }
+
+    // buffer has to hold size bytes
+    int write(char* buffer, typename Args::Value... values) const
+    {
+	std::memcpy(buffer, header_, (size_t) headerSize);
+	char* out = buffer + headerSize;
+	const int written[] = { 0, (out = writeValue(out, values), 0)... };
+	(void) written;
+	return size;
+    }
+
+private:
+    static char* writeValue(char* out, int32 value)
+    {
+	return writeBigEndian(out, (uint32) value);
+    }
+
+    static char* writeValue(char* out, float value)
+    {
+	uint32 bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+	return writeBigEndian(out, bits);
+    }
+
+    static char* writeBigEndian(char* out, uint32 value)
+    {
+	out[0] = (char) ((value >> 24) & 0xff);
+	out[1] = (char) ((value >> 16) & 0xff);
+	out[2] = (char) ((value >> 8) & 0xff);
+	out[3] = (char) (value & 0xff);
+	return out + 4;
+    }
+
+    char header_[headerSize];
+};
+
+template <typename... Args, size_t N>
+constexpr OscTypedMessage<(int) N - 1, Args...> makeOscMessage(const char (&address)[N])
+{
+    return OscTypedMessage<(int) N - 1, Args...>(address);
+}
+
+//==============================================================================
+// The shape of a message we expect, as the same argument types plus OscString:
+// a message matches if its type tags are exactly those, checked with a single
+// memcmp, and read() then takes the arguments by position without looking at
+// a tag again. Anything else is turned down before a field is read.
+//
+//     typedef OscSchema<OscInt32, OscString, OscFloat32> Schema;
+//     if (Schema::read(view, loop, control, value)) ...
+struct OscString
+{
+    typedef const char* Value;     // points into the message
+    static constexpr char tag = 's';
+};
+
+template <typename... Args>
+struct OscSchema
+{
+    static constexpr int numArgs = (int) sizeof...(Args);
+
+    static bool matches(const OscMessageView& message)
+    {
+	constexpr char tags[] = { ',', Args::tag..., 0 };
+	return message.hasTypeTags(tags, numArgs);
+    }
+
+    static bool read(const OscMessageView& message, typename Args::Value&... values)
+    {
+	if (!matches(message))
+	{
+	    return false;
+	}
+	int index = 0;
+	const int read[] = { 0, (readValue(message, index++, values), 0)... };
+	(void) read;
+	return true;
+    }
+
+private:
+    static void readValue(const OscMessageView& message, int index, int32& value)          { value = message.getInt32(index); }
+    static void readValue(const OscMessageView& message, int index, float& value)          { value = message.getFloat32(index); }
+    static void readValue(const OscMessageView& message, int index, const char*& value)    { value = message.getString(index); }
+};
+
+// SooperLooper's "/ctrl loop control value", what every registered update
+// is, and the "/pos" and "/reconcile" answers have the same shape
+struct SooperLooperCtrl
+{
+    typedef OscSchema<OscInt32, OscString, OscFloat32> Schema;
+
+    bool read(const OscMessageView& message)    { return Schema::read(message, loop_, control_, value_); }
+
+    int32 loop_ = 0;
+    const char* control_ = nullptr;
+    float value_ = 0.0f;
+};
+
+// "/heartbeat url version loops id"
+struct SooperLooperHeartbeat
+{
+    typedef OscSchema<OscString, OscString, OscInt32, OscInt32> Schema;
+
+    bool read(const OscMessageView& message)    { return Schema::read(message, hostUrl_, version_, numLoops_, engineId_); }
+
+    const char* hostUrl_ = nullptr;
+    const char* version_ = nullptr;
+    int32 numLoops_ = 0;
+    int32 engineId_ = 0;
+};
+
+//==============================================================================
+// The reverse of OscMessageWriter, e.g. for messages read back from a trace or
+// straight off a socket.
+class OscMessageReader
+{
+public:
+    // A whole datagram: calls onMessage(const OscMessageView&) for the message,
+    // or for every message in the bundle and its nested bundles, in order.
+    // Timetags are ignored. Returns false if anything in it was malformed.
+    template <typename Function>
+    static bool readPacket(const void* data, int size, Function onMessage)
+    {
+	const char* buffer = static_cast<const char*>(data);
+	if (size < 16 || std::memcmp(buffer, "#bundle", 8) != 0)
+	{
+	    const OscMessageView view(data, size);
+	    if (!view.isValid())
+	    {
+		return false;
+	    }
+	    onMessage(view);
+	    return true;
+	}
+
+	bool ok = true;
+	for (int pos = 16; pos < size;)
+	{
+	    const int elementSize = pos + 4 <= size ? (int) readInt(buffer + pos) : -1;
+	    if (elementSize <= 0 || elementSize > size - pos - 4)
+	    {
+		return false;
+	    }
+	    ok = readPacket(buffer + pos + 4, elementSize, onMessage) && ok;
+	    pos += 4 + elementSize;
+	}
+	return ok;
+    }
+
+    // a single message, false for a malformed one
+    static bool read(const void* data, int size, OSCMessage& message)
+    {
+	const OscMessageView view(data, size);
+	return view.toMessage(message);
+    }
+
+private:
+    static uint32 readInt(const char* data)
+    {
+	return ((uint32) (uint8) data[0] << 24) | ((uint32) (uint8) data[1] << 16)
+	    | ((uint32) (uint8) data[2] << 8) | (uint32) (uint8) data[3];
+    }
+};
+
+//==============================================================================
+// Sends pre-encoded packets to one target. The DatagramSocket caches the
+// resolved address, so a resend is a single sendto().
+//
+// Coalescing, for a target across WiFi, holds the messages sent until
+// flush() and sends them as one "#bundle" (timetag "immediately"), or as is
+// if there's just one; the control thread flushes at the end of each pass.
+// Bundles, timed ones included, still go straight out after what's held.
+//
+// What's sent inside a QueryScope (registrations, state queries) is held
+// whatever the target until flushQueries(), so a burst of them after a bank
+// switch can't go out ahead of the next loop command. They keep their order
+// among themselves.
+//
+// Given an OscSendThread, what would be written is pushed there instead, as
+// a command or a query.
+class OscPacketSender
+{
+public:
+    static const int maxCoalescedSize = 1432;  // as OscBundleSender's
+    static const int maxHeldSize = 8192;
+
+    class QueryScope
+    {
+    public:
+	explicit QueryScope(OscPacketSender& sender) : sender_(sender), previous_(sender.holding_)
+	{
+	    sender.holding_ = true;
+	}
+
+	~QueryScope()
+	{
+	    sender_.holding_ = previous_;
+	}
+
+    private:
+	OscPacketSender& sender_;
+	const bool previous_;
+
+	JUCE_DECLARE_NON_COPYABLE(QueryScope)
+    };
+
+    OscPacketSender() : port_(-1) {}
+
+    bool connect(const String& host, int port)
+    {
+	socket_ = new DatagramSocket(true);
+	if (!socket_->bindToPort(0))
+	{
+	    socket_ = nullptr;
+	    return false;
+	}
+	host_ = host;
+	port_ = port;
+	coalescedSize_ = numCoalesced_ = heldSize_ = 0;
+	resolve();
+	return true;
+    }
+
+    // nullptr sends from our own socket again
+    void setSendThread(OscSendThread* thread)
+    {
+	sendThread_ = thread;
+	resolve();
+    }
+
+    void disconnect()
+    {
+	coalescedSize_ = numCoalesced_ = heldSize_ = 0;
+	socket_ = nullptr;
+	port_ = -1;
+    }
+
+    bool isConnected() const    { return socket_ != nullptr; }
+    int getSocketHandle() const { return socket_ != nullptr ? socket_->getRawSocketHandle() : -1; }
+
+    // the target's on this host
+    bool isLoopback() const
+    {
+	return host_ == "localhost" || host_.startsWith("127.") || host_ == "::1";
+    }
+
+    // the address of ours the target is reached from, what it should send
+    // back to; empty if there's no route to it
+    String getLocalAddress() const
+    {
+#if JUCE_LINUX || JUCE_MAC
+	struct addrinfo hints = {};
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_DGRAM;
+	struct addrinfo* info = nullptr;
+	if (::getaddrinfo(host_.toRawUTF8(), String(port_).toRawUTF8(), &hints, &info) != 0 || info == nullptr)
+	{
+	    return String();
+	}
+
+	// connecting a UDP socket sends nothing, it only picks the route
+	String address;
+	const int fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+	struct sockaddr_in local = {};
+	socklen_t size = sizeof(local);
+	char text[INET_ADDRSTRLEN];
+	if (fd >= 0 && ::connect(fd, info->ai_addr, info->ai_addrlen) == 0
+	    && ::getsockname(fd, reinterpret_cast<struct sockaddr*>(&local), &size) == 0
+	    && ::inet_ntop(AF_INET, &local.sin_addr, text, sizeof(text)) != nullptr)
+	{
+	    address = text;
+	}
+	if (fd >= 0)
+	{
+	    ::close(fd);
+	}
+	::freeaddrinfo(info);
+	return address;
+#else
+	return String();
+#endif
+    }
+
+    void setCoalescing(bool coalescing)
+    {
+	if (!coalescing)
+	{
+	    flush();
+	}
+	coalescing_ = coalescing;
+    }
+
+    bool isCoalescing() const           { return coalescing_; }
+
+    // sends everything held back, the commands before the queries
+    void flush()
+    {
+	flushCommands();
+	flushQueries();
+    }
+
+    // sends what coalescing has held back
+    void flushCommands()
+    {
+	if (numCoalesced_ == 1)
+	{
+	    write(coalesced_ + bundleHeaderSize + 4, coalescedSize_ - bundleHeaderSize - 4);
+	}
+	else if (numCoalesced_ > 1)
+	{
+	    write(coalesced_, coalescedSize_);
+	}
+	coalescedSize_ = numCoalesced_ = 0;
+    }
+
+    // sends the queries, coalesced with each other for a target that coalesces
+    void flushQueries()
+    {
+	const int size = heldSize_;
+	heldSize_ = 0;
+	writing_ = OscSendThread::Query;
+	for (int offset = 0; offset + 4 <= size;)
+	{
+	    int length = 0;
+	    std::memcpy(&length, held_ + offset, 4);
+	    post(held_ + offset + 4, length);
+	    offset += 4 + length;
+	}
+	if (coalescing_)
+	{
+	    flushCommands();
+	}
+	writing_ = OscSendThread::Command;
+    }
+
+    bool hasHeldQueries() const         { return heldSize_ > 0; }
+
+    // what's sent (or would be, while not connected) is recorded there as OscOut
+    void setTrace(TraceCapture* trace)  { trace_ = trace; }
+
+    // and counted there per address as OscOut
+    void setMetrics(Metrics* metrics)   { metrics_ = metrics; }
+
+    // each send an "osc send" span there
+    void setSpans(SpanTrace* spans)     { spans_ = spans; }
+
+    bool send(const OscPacket& packet)
+    {
+	return send(packet.data_, packet.size_);
+    }
+
+    bool send(const void* data, int size)
+    {
+	if (size <= 0)
+	{
+	    return false;
+	}
+	const SpanTrace::Scope span(spans_, "osc send");
+	if (trace_ != nullptr)
+	{
+	    trace_->record(TraceCapture::OscOut, data, size);
+	}
+	if (metrics_ != nullptr)
+	{
+	    metrics_->countOscPacket(Metrics::OscOut, data, size);
+	}
+	if (socket_ == nullptr)
+	{
+	    return false;
+	}
+	if (holding_ && size + 4 <= maxHeldSize)
+	{
+	    if (heldSize_ + 4 + size > maxHeldSize)
+	    {
+		flushQueries();
+	    }
+	    std::memcpy(held_ + heldSize_, &size, 4);
+	    std::memcpy(held_ + heldSize_ + 4, data, (size_t) size);
+	    heldSize_ += 4 + size;
+	    return true;
+	}
+	return post(data, size);
+    }
+
+private:
+    static const int bundleHeaderSize = 16;    // "#bundle\0" and the timetag
+
+    // out now, or into the bundle being coalesced
+    bool post(const void* data, int size)
+    {
+	if (!coalescing_)
+	{
+	    return write(data, size);
+	}
+
+	if (size >= 8 && std::memcmp(data, "#bundle", 8) == 0)
+	{
+	    flush();
+	    return write(data, size);
+	}
+	if (coalescedSize_ + 4 + size > maxCoalescedSize)
+	{
+	    flush();
+	    if (bundleHeaderSize + 4 + size > maxCoalescedSize)
+	    {
+		return write(data, size);
+	    }
+	}
+	if (coalescedSize_ == 0)
+	{
+	    std::memcpy(coalesced_, "#bundle", 8);
+	    std::memset(coalesced_ + 8, 0, 8);
+	    coalesced_[15] = 1;
+	    coalescedSize_ = bundleHeaderSize;
+	}
+	for (int i = 0; i < 4; ++i)
+	{
+	    coalesced_[coalescedSize_++] = (char) (((uint32) size >> (24 - 8 * i)) & 0xff);
+	}
+	std::memcpy(coalesced_ + coalescedSize_, data, (size_t) size);
+	coalescedSize_ += size;
+	++numCoalesced_;
+	return true;
+    }
+
+    bool write(const void* data, int size)
+    {
+	if (sendThread_ != nullptr && toSize_ > 0 && sendThread_->isRunning())
+	{
+	    if (sendThread_->push(writing_, to_, toSize_, data, size))
+	    {
+		return true;
+	    }
+	    // a query there's no room for is dropped, a command goes from here now
+	    if (writing_ == OscSendThread::Query && size <= OscSendThread::maxDatagramSize)
+	    {
+		return false;
+	    }
+	}
+	return socket_ != nullptr && socket_->write(host_, port_, data, size) == size;
+    }
+
+    // where the send thread sends to
+    void resolve()
+    {
+	toSize_ = 0;
+#if JUCE_LINUX || JUCE_MAC
+	if (sendThread_ == nullptr || port_ < 0)
+	{
+	    return;
+	}
+	struct addrinfo hints = {};
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_DGRAM;
+	struct addrinfo* info = nullptr;
+	if (::getaddrinfo(host_.toRawUTF8(), String(port_).toRawUTF8(), &hints, &info) == 0 && info != nullptr)
+	{
+	    std::memcpy(&to_, info->ai_addr, info->ai_addrlen);
+	    toSize_ = (socklen_t) info->ai_addrlen;
+	    ::freeaddrinfo(info);
+	}
+#endif
+    }
+
+    ScopedPointer<DatagramSocket> socket_;
+    String host_;
+    int port_;
+    bool coalescing_ = false;
+    char coalesced_[maxCoalescedSize];
+    int coalescedSize_ = 0;
+    int numCoalesced_ = 0;
+    bool holding_ = false;              // inside a QueryScope
+    OscSendThread::Class writing_ = OscSendThread::Command;
+    OscSendThread* sendThread_ = nullptr;
+    sockaddr_storage to_;
+    socklen_t toSize_ = 0;
+    char held_[maxHeldSize];            // the queries, each after its int length
+    int heldSize_ = 0;
+    TraceCapture* trace_ = nullptr;
+    Metrics* metrics_ = nullptr;
+    SpanTrace* spans_ = nullptr;
+
+    JUCE_DECLARE_NON_COPYABLE(OscPacketSender)
+};
+
+//==============================================================================
+// Collects already encoded messages into "#bundle" datagrams (timetag
+// "immediately") and sends one whenever the next message wouldn't fit, so a
+// burst of messages costs a few datagrams rather than one each. A lone message
+// is sent as is. Whatever is left is sent by flush() or the destructor.
+class OscBundleSender
+{
+public:
+    // a 1500 byte ethernet MTU less IP and UDP headers, with some room for tunnels
+    static const int defaultMaxSize = 1432;
+
+    OscBundleSender(OscPacketSender& sender, int maxSize = defaultMaxSize)
+	: sender_(sender), maxSize_(jmin(maxSize, (int) sizeof(buffer_))), size_(0), numMessages_(0), numDatagrams_(0)
+    {
+    }
+
+    // an NTP timetag (see OscTimedBundle) for the bundles from here on, for
+    // a receiver to run them then; a lone message is sent in its bundle too
+    void setTimeTag(uint64 timeTag)
+    {
+	flush();
+	timeTag_ = timeTag;
+    }
+
+    ~OscBundleSender()
+    {
+	flush();
+    }
+
+    void add(const OscPacket& packet)
+    {
+	if (!packet.isValid())
+	{
+	    return;
+	}
+	if (size_ + 4 + packet.size_ > maxSize_)
+	{
+	    flush();
+	}
+	if (size_ == 0)
+	{
+	    std::memcpy(buffer_, "#bundle", 8);
+	    for (int i = 0; i < 8; ++i)
+	    {
+		buffer_[8 + i] = (char) ((timeTag_ >> (56 - 8 * i)) & 0xff);
+	    }
+	    size_ = headerSize;
+	}
+
+	const uint32 length = (uint32) packet.size_;
+	buffer_[size_++] = (char) ((length >> 24) & 0xff);
+	buffer_[size_++] = (char) ((length >> 16) & 0xff);
+	buffer_[size_++] = (char) ((length >> 8) & 0xff);
+	buffer_[size_++] = (char) (length & 0xff);
+	std::memcpy(buffer_ + size_, packet.data_, (size_t) packet.size_);
+	size_ += packet.size_;
+	++numMessages_;
+    }
+
+    void flush()
+    {
+	if (numMessages_ == 1 && timeTag_ == immediately)
+	{
+	    sender_.send(buffer_ + headerSize + 4, size_ - headerSize - 4);
+	    ++numDatagrams_;
+	}
+	else if (numMessages_ > 1)
+	{
+	    sender_.send(buffer_, size_);
+	    ++numDatagrams_;
+	}
+	size_ = 0;
+	numMessages_ = 0;
+    }
+
+    int getNumDatagrams() const     { return numDatagrams_; }
+
+private:
+    static const int headerSize = 16;  // "#bundle\0" and the timetag
+    static const uint64 immediately = 1;
+
+    OscPacketSender& sender_;
+    char buffer_[2048];
+    uint64 timeTag_ = immediately;
+    int maxSize_;
+    int size_;
+    int numMessages_;
+    int numDatagrams_;
+
+    JUCE_DECLARE_NON_COPYABLE(OscBundleSender)
+};
+
+//==============================================================================
+// A message wrapped in a "#bundle" of its own with a timetag in the future,
+// for a receiver that schedules bundles (liblo, so SooperLooper, does) to run
+// it then rather than when it arrives.
+struct OscTimedBundle
+{
+    // NTP time, seconds since 1900 in 32.32 fixed point, of a
+    // Time::getHighResolutionTicks() value: the wall clock now plus however
+    // far off ticks is, on a clock offsetMicros ahead of ours
+    static uint64 getTimeTag(int64 ticks, double offsetMicros = 0)
+    {
+	const double nowSeconds = std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count();
+	const double seconds = nowSeconds + offsetMicros / 1.0e6 + Time::highResolutionTicksToSeconds(ticks - Time::getHighResolutionTicks()) + 2208988800.0;
+	return ((uint64) seconds << 32) | (uint64) ((seconds - std::floor(seconds)) * 4294967296.0);
+    }
+
+    // false if it won't fit
+    static bool wrap(const OscPacket& message, uint64 timeTag, OscPacket& bundle)
+    {
+	if (!message.isValid() || 16 + 4 + message.size_ > OscPacket::maxSize)
+	{
+	    bundle.clear();
+	    return false;
+	}
+
+	std::memcpy(bundle.data_, "#bundle", 8);
+	for (int i = 0; i < 8; ++i)
+	{
+	    bundle.data_[8 + i] = (char) ((timeTag >> (56 - 8 * i)) & 0xff);
+	}
+	const uint32 length = (uint32) message.size_;
+	for (int i = 0; i < 4; ++i)
+	{
+	    bundle.data_[16 + i] = (char) ((length >> (24 - 8 * i)) & 0xff);
+	}
+	std::memcpy(bundle.data_ + 20, message.data_, (size_t) message.size_);
+	bundle.size_ = 20 + message.size_;
+	return true;
+    }
+};
+
+//==============================================================================
+// The fixed messages we keep sending to SooperLooper, encoded once per return
+// url. Per loop packets are built the first time a loop is seen, the ones for
+// loop -1 (all of them) along with the fixed ones. The replies
+// come back on "<prefix>/ctrl", "<prefix>/cycle", "<prefix>/delivery",
+// "<prefix>/heartbeat", "<prefix>/pingack", "<prefix>/pos",
+// "<prefix>/reconcile" and "<prefix>/state", which lets
+// several engines share one receive port.
+class SooperLooperPackets
+{
+public:
+    SooperLooperPackets()
+    {
+	returnUrl_[0] = 0;
+	setPrefix("");
+    }
+
+    // returns true if the url or prefix changed and the packets were rebuilt
+    bool setReturnUrl(const String& url, const String& pathPrefix = String())
+    {
+	char newUrl[maxUrlSize];
+	url.copyToUTF8(newUrl, maxUrlSize);
+	char newPrefix[maxPrefixSize];
+	pathPrefix.copyToUTF8(newPrefix, maxPrefixSize);
+	if (std::strcmp(newUrl, returnUrl_) == 0 && std::strcmp(newPrefix, prefix_) == 0)
+	{
+	    return false;
+	}
+
+	std::strcpy(returnUrl_, newUrl);
+	setPrefix(newPrefix);
+	buildPing(heartbeatPing_, heartbeatPath_);
+	buildPing(pingAckPing_, pingAckPath_);
+	buildGlobal(globalRegister_, "/register_update", "selected_loop_num");
+	buildGlobal(globalUnregister_, "/unregister_update", "selected_loop_num");
+	buildGlobal(tempoRegister_, "/register_update", "tempo");
+	buildGlobal(tempoUnregister_, "/unregister_update", "tempo");
+	buildGlobal(tempoGet_, "/get", "tempo");
+	buildPosition(positionRegister_, "/sl/-3/register_auto_update");
+	buildPosition(positionUnregister_, "/sl/-3/unregister_auto_update");
+	buildLoop(allLoops_, -1);
+	reconcileGet_.size_ = OscMessageWriter(reconcileGet_).begin("/sl/-1/get", "sss")
+	    .addString("state").addString(returnUrl_).addString(reconcilePath_).size();
+	for (auto&& loop : loops_)
+	{
+	    loop.built_ = false;
+	}
+	for (int i = 0; i < numPrepared_; ++i)
+	{
+	    getLoop(i);
+	}
+	return true;
+    }
+
+    // loops 0 to numLoops - 1 are built now and again whenever the url
+    // changes, rather than the first time each is sent
+    void prepareLoops(int numLoops)
+    {
+	numPrepared_ = jmax(numPrepared_, numLoops);
+	loops_.ensureStorageAllocated(numPrepared_);
+	for (int i = 0; hasReturnUrl() && i < numPrepared_; ++i)
+	{
+	    getLoop(i);
+	}
+    }
+
+    bool hasReturnUrl() const   { return returnUrl_[0] != 0; }
+
+    const OscPacket& heartbeatPing() const                  { return heartbeatPing_; }
+    const OscPacket& pingAckPing() const                    { return pingAckPing_; }
+    const OscPacket& globalUpdates(bool unreg) const        { return unreg ? globalUnregister_ : globalRegister_; }
+    const OscPacket& tempoUpdates(bool unreg) const         { return unreg ? tempoUnregister_ : tempoRegister_; }
+    const OscPacket& tempoState() const                     { return tempoGet_; }
+
+    // the selected loop's position, answered on "<prefix>/pos"
+    const OscPacket& positionUpdates(bool unreg) const      { return unreg ? positionUnregister_ : positionRegister_; }
+
+    const OscPacket& loopState(int index)                   { return getLoop(index).getState_; }
+
+    // the same answered on "<prefix>/state", for the connection handshake
+    const OscPacket& loopInitialState(int index)            { return getLoop(index).getInitialState_; }
+
+    // and on "<prefix>/delivery", to see whether a pedal's command took
+    const OscPacket& loopDeliveryState(int index)           { return getLoop(index).getDeliveryState_; }
+    const OscPacket& loopAutoUpdates(int index, bool unreg) { return unreg ? getLoop(index).unregister_ : getLoop(index).register_; }
+
+    // state reported only when it changes rather than every 100ms
+    const OscPacket& loopChangeUpdates(int index, bool unreg) { return unreg ? getLoop(index).unregisterChange_ : getLoop(index).registerChange_; }
+
+    // state every fastIntervalMs, for "adaptive"
+    const OscPacket& loopFastUpdates(int index, bool unreg) { return unreg ? getLoop(index).unregisterFast_ : getLoop(index).registerFast_; }
+
+    void setFastInterval(int intervalMs)
+    {
+	if (intervalMs != fastIntervalMs_)
+	{
+	    fastIntervalMs_ = intervalMs;
+	    for (auto&& loop : loops_)
+	    {
+		loop.built_ = false;
+	    }
+	}
+    }
+
+    // the same for every loop at once (SooperLooper's loop -1), each loop answers for itself
+    const OscPacket& allLoopsState() const                          { return allLoops_.getState_; }
+    const OscPacket& allLoopsInitialState() const                   { return allLoops_.getInitialState_; }
+    const OscPacket& allLoopsAutoUpdates(bool unreg) const          { return unreg ? allLoops_.unregister_ : allLoops_.register_; }
+    const OscPacket& allLoopsChangeUpdates(bool unreg) const        { return unreg ? allLoops_.unregisterChange_ : allLoops_.registerChange_; }
+
+    // every loop's state again, answered on "<prefix>/reconcile" so the
+    // answers can be told from updates
+    const OscPacket& allLoopsReconcile() const                      { return reconcileGet_; }
+
+    // a mirrored control: auto updates every intervalMs for every loop, or
+    // updates on change for a global one (index -2). Built when asked, as
+    // they're only sent when registering
+    void buildControlUpdates(OscPacket& packet, int index, const char* control, int intervalMs, bool unreg) const
+    {
+	char address[64];
+	if (index == -2)
+	{
+	    buildGlobal(packet, unreg ? "/unregister_update" : "/register_update", control);
+	    return;
+	}
+	std::snprintf(address, sizeof(address), "/sl/%d/%s", index, unreg ? "unregister_auto_update" : "register_auto_update");
+	packet.size_ = OscMessageWriter(packet).begin(address, "siss")
+	    .addString(control).addInt32(intervalMs).addString(returnUrl_).addString(ctrlPath_).size();
+    }
+
+    // its current value, the same way (index -1 for every loop)
+    void buildControlGet(OscPacket& packet, int index, const char* control) const
+    {
+	char address[64];
+	if (index == -2)
+	{
+	    buildGlobal(packet, "/get", control);
+	    return;
+	}
+	std::snprintf(address, sizeof(address), "/sl/%d/get", index);
+	packet.size_ = OscMessageWriter(packet).begin(address, "sss")
+	    .addString(control).addString(returnUrl_).addString(ctrlPath_).size();
+    }
+
+    // loop_pos or cycle_len of every loop for the cycle tracker, every
+    // intervalMs or now, answered on "<prefix>/cycle"
+    void buildCycleUpdates(OscPacket& packet, const char* control, int intervalMs, bool unreg) const
+    {
+	packet.size_ = OscMessageWriter(packet).begin(unreg ? "/sl/-1/unregister_auto_update" : "/sl/-1/register_auto_update", "siss")
+	    .addString(control).addInt32(intervalMs).addString(returnUrl_).addString(cyclePath_).size();
+    }
+
+    void buildCycleGet(OscPacket& packet, const char* control) const
+    {
+	packet.size_ = OscMessageWriter(packet).begin("/sl/-1/get", "sss")
+	    .addString(control).addString(returnUrl_).addString(cyclePath_).size();
+    }
+
+private:
+    static const int maxUrlSize = 128;
+    static const int maxPrefixSize = 32;
+
+    struct LoopPackets
+    {
+	bool built_;
+	OscPacket getState_;
+	OscPacket getInitialState_;
+	OscPacket getDeliveryState_;
+	OscPacket register_;
+	OscPacket unregister_;
+	OscPacket registerChange_;
+	OscPacket unregisterChange_;
+	OscPacket registerFast_;
+	OscPacket unregisterFast_;
+    };
+
+    LoopPackets& getLoop(int index)
+    {
+	jassert(index >= 0);
+	while (loops_.size() <= index)
+	{
+	    loops_.add(LoopPackets());
+	    loops_.getReference(loops_.size() - 1).built_ = false;
+	}
+
+	LoopPackets& loop = loops_.getReference(index);
+	if (!loop.built_)
+	{
+	    buildLoop(loop, index);
+	}
+	return loop;
+    }
+
+    void buildLoop(LoopPackets& loop, int index)
+    {
+	char address[64];
+	std::snprintf(address, sizeof(address), "/sl/%d/get", index);
+	loop.getState_.size_ = OscMessageWriter(loop.getState_).begin(address, "sss")
+	    .addString("state").addString(returnUrl_).addString(ctrlPath_).size();
+	loop.getInitialState_.size_ = OscMessageWriter(loop.getInitialState_).begin(address, "sss")
+	    .addString("state").addString(returnUrl_).addString(statePath_).size();
+	loop.getDeliveryState_.size_ = OscMessageWriter(loop.getDeliveryState_).begin(address, "sss")
+	    .addString("state").addString(returnUrl_).addString(deliveryPath_).size();
+
+	std::snprintf(address, sizeof(address), "/sl/%d/register_auto_update", index);
+	loop.register_.size_ = OscMessageWriter(loop.register_).begin(address, "siss")
+	    .addString("state").addInt32(100).addString(returnUrl_).addString(ctrlPath_).size();
+
+	std::snprintf(address, sizeof(address), "/sl/%d/unregister_auto_update", index);
+	loop.unregister_.size_ = OscMessageWriter(loop.unregister_).begin(address, "siss")
+	    .addString("state").addInt32(100).addString(returnUrl_).addString(ctrlPath_).size();
+
+	std::snprintf(address, sizeof(address), "/sl/%d/register_auto_update", index);
+	loop.registerFast_.size_ = OscMessageWriter(loop.registerFast_).begin(address, "siss")
+	    .addString("state").addInt32(fastIntervalMs_).addString(returnUrl_).addString(ctrlPath_).size();
+
+	std::snprintf(address, sizeof(address), "/sl/%d/unregister_auto_update", index);
+	loop.unregisterFast_.size_ = OscMessageWriter(loop.unregisterFast_).begin(address, "siss")
+	    .addString("state").addInt32(fastIntervalMs_).addString(returnUrl_).addString(ctrlPath_).size();
+
+	std::snprintf(address, sizeof(address), "/sl/%d/register_update", index);
+	loop.registerChange_.size_ = OscMessageWriter(loop.registerChange_).begin(address, "sss")
+	    .addString("state").addString(returnUrl_).addString(ctrlPath_).size();
+
+	std::snprintf(address, sizeof(address), "/sl/%d/unregister_update", index);
+	loop.unregisterChange_.size_ = OscMessageWriter(loop.unregisterChange_).begin(address, "sss")
+	    .addString("state").addString(returnUrl_).addString(ctrlPath_).size();
+
+	loop.built_ = true;
+    }
+
+    void buildPing(OscPacket& packet, const char* replyPath)
+    {
+	packet.size_ = OscMessageWriter(packet).begin("/ping", "ss")
+	    .addString(returnUrl_).addString(replyPath).size();
+    }
+
+    void buildGlobal(OscPacket& packet, const char* address, const char* control) const
+    {
+	packet.size_ = OscMessageWriter(packet).begin(address, "sss")
+	    .addString(control).addString(returnUrl_).addString(ctrlPath_).size();
+    }
+
+    void buildPosition(OscPacket& packet, const char* address)
+    {
+	packet.size_ = OscMessageWriter(packet).begin(address, "siss")
+	    .addString("loop_pos").addInt32(100).addString(returnUrl_).addString(posPath_).size();
+    }
+
+    void setPrefix(const char* prefix)
+    {
+	std::strcpy(prefix_, prefix);
+	std::snprintf(ctrlPath_, sizeof(ctrlPath_), "%s/ctrl", prefix);
+	std::snprintf(cyclePath_, sizeof(cyclePath_), "%s/cycle", prefix);
+	std::snprintf(deliveryPath_, sizeof(deliveryPath_), "%s/delivery", prefix);
+	std::snprintf(heartbeatPath_, sizeof(heartbeatPath_), "%s/heartbeat", prefix);
+	std::snprintf(pingAckPath_, sizeof(pingAckPath_), "%s/pingack", prefix);
+	std::snprintf(posPath_, sizeof(posPath_), "%s/pos", prefix);
+	std::snprintf(reconcilePath_, sizeof(reconcilePath_), "%s/reconcile", prefix);
+	std::snprintf(statePath_, sizeof(statePath_), "%s/state", prefix);
+    }
+
+    char returnUrl_[maxUrlSize];
+    char prefix_[maxPrefixSize];
+    char ctrlPath_[maxPrefixSize + 16];
+    char cyclePath_[maxPrefixSize + 16];
+    char deliveryPath_[maxPrefixSize + 16];
+    char heartbeatPath_[maxPrefixSize + 16];
+    char pingAckPath_[maxPrefixSize + 16];
+    char posPath_[maxPrefixSize + 16];
+    char reconcilePath_[maxPrefixSize + 16];
+    char statePath_[maxPrefixSize + 16];
+    OscPacket heartbeatPing_;
+    OscPacket pingAckPing_;
+    OscPacket globalRegister_;
+    OscPacket globalUnregister_;
+    OscPacket tempoRegister_;
+    OscPacket tempoUnregister_;
+    OscPacket tempoGet_;
+    OscPacket positionRegister_;
+    OscPacket positionUnregister_;
+    OscPacket reconcileGet_;
+    LoopPackets allLoops_;
+    Array<LoopPackets> loops_;
+    int numPrepared_ = 0;
+    int fastIntervalMs_ = 10;
+};
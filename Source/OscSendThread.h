@@ -0,0 +1,255 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "LockFreeQueue.h"
+#include <atomic>
+#include <cstring>
+
+#if JUCE_LINUX
+ #include <cerrno>
+ #include <fcntl.h>
+ #include <netinet/in.h>
+ #include <poll.h>
+ #include <sys/socket.h>
+ #include <unistd.h>
+#endif
+
+//==============================================================================
+// Sends the engines' datagrams from a thread of its own, so a full socket
+// buffer holds up this thread rather than the control thread and the pedals
+// behind it. Senders push already encoded datagrams with where they go; the
+// thread takes them in batches and hands each batch to one sendmmsg() on a
+// socket of its own, commands before queries.
+//
+// When the kernel won't take more the thread waits for room and the rings
+// fill. A command that then doesn't fit is left to its sender to send at
+// once, later commands still queued if need be rather than lost; a query that
+// doesn't fit is dropped and counted, the polls and leases ask again. The
+// control thread is the only producer, so each ring is single producer.
+class OscSendThread : private Thread
+{
+public:
+    enum Class
+    {
+	Command,
+	Query,
+	numClasses
+    };
+
+    static const int maxDatagramSize = 1472;    // an ethernet MTU less the IP and UDP headers
+    static const int queueSize = 256;
+    static const int maxBatch = 32;
+    static const int maxExitWaits = 50;         // 10ms each for room to send what's left
+
+    OscSendThread() : Thread("loop4r osc send"), commands_(queueSize), queries_(queueSize) {}
+
+    ~OscSendThread()
+    {
+	stop();
+    }
+
+#if JUCE_LINUX
+    bool start()
+    {
+	stop();
+	fd_ = ::socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd_ < 0 || ::pipe2(wakePipe_, O_NONBLOCK | O_CLOEXEC) != 0)
+	{
+	    stop();
+	    return false;
+	}
+	startThread();
+	return true;
+    }
+
+    // sends what's still queued first, for as long as a second
+    void stop()
+    {
+	if (isThreadRunning())
+	{
+	    signalThreadShouldExit();
+	    wake();
+	    stopThread(1000);
+	}
+	for (auto* fd : { &fd_, &wakePipe_[0], &wakePipe_[1] })
+	{
+	    if (*fd >= 0)
+	    {
+		::close(*fd);
+		*fd = -1;
+	    }
+	}
+    }
+#else
+    bool start()                        { return false; }
+    void stop()                         {}
+#endif
+
+    bool isRunning() const              { return fd_ >= 0; }
+    int getSocketHandle() const         { return fd_; }
+
+    // false if it doesn't fit, the thread is woken once for a run of pushes
+    bool push(Class type, const sockaddr_storage& to, socklen_t toSize, const void* data, int size)
+    {
+	if (fd_ < 0 || size <= 0 || size > maxDatagramSize)
+	{
+	    return false;
+	}
+	datagram_.to_ = to;
+	datagram_.toSize_ = toSize;
+	datagram_.size_ = size;
+	std::memcpy(datagram_.data_, data, (size_t) size);
+	if (!(type == Command ? commands_ : queries_).push(datagram_))
+	{
+	    ++(type == Command ? numOverflowed_ : numDropped_);
+	    return false;
+	}
+	if (!wakePending_.exchange(true))
+	{
+	    wake();
+	}
+	return true;
+    }
+
+    int64 getNumSent() const            { return numSent_.load(); }
+    int64 getNumBatches() const         { return numBatches_.load(); }
+    int64 getNumOverflowed() const      { return numOverflowed_.load(); }
+    int64 getNumDropped() const         { return numDropped_.load(); }
+    int getNumQueued() const            { return commands_.size() + queries_.size(); }
+
+private:
+    struct Datagram
+    {
+	sockaddr_storage to_;
+	socklen_t toSize_ = 0;
+	int size_ = 0;
+	char data_[maxDatagramSize];
+    };
+
+    void wake()
+    {
+#if JUCE_LINUX
+	const char byte = 0;
+	(void) ::write(wakePipe_[1], &byte, 1);
+#endif
+    }
+
+#if JUCE_LINUX
+    // tops the batch up from the rings, commands first
+    void fill()
+    {
+	while (batchSize_ < maxBatch && (commands_.pop(batch_[batchSize_]) || queries_.pop(batch_[batchSize_])))
+	{
+	    Datagram& datagram = batch_[batchSize_];
+	    iovecs_[batchSize_] = { datagram.data_, (size_t) datagram.size_ };
+	    headers_[batchSize_] = {};
+	    headers_[batchSize_].msg_hdr.msg_name = &datagram.to_;
+	    headers_[batchSize_].msg_hdr.msg_namelen = datagram.toSize_;
+	    headers_[batchSize_].msg_hdr.msg_iov = &iovecs_[batchSize_];
+	    headers_[batchSize_].msg_hdr.msg_iovlen = 1;
+	    ++batchSize_;
+	}
+    }
+
+    // false when the kernel's full and we have to wait for room
+    bool sendBatch()
+    {
+	while (batchSize_ > 0)
+	{
+	    const int sent = ::sendmmsg(fd_, headers_ + batchStart_, (unsigned int) (batchSize_ - batchStart_), MSG_DONTWAIT);
+	    if (sent < 0)
+	    {
+		if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS)
+		{
+		    return false;
+		}
+		if (errno != EINTR)
+		{
+		    // unreachable or the like, that datagram's lost as it would have been anyway
+		    ++batchStart_;
+		}
+	    }
+	    else
+	    {
+		batchStart_ += sent;
+		numSent_ += sent;
+	    }
+	    if (batchStart_ >= batchSize_)
+	    {
+		++numBatches_;
+		batchStart_ = batchSize_ = 0;
+		fill();
+	    }
+	}
+	return true;
+    }
+
+    void run() override
+    {
+	bool blocked = false;
+	int exitWaits = 0;
+	for (;;)
+	{
+	    pollfd fds[2] = { { wakePipe_[0], POLLIN, 0 }, { blocked ? fd_ : -1, POLLOUT, 0 } };
+	    if (::poll(fds, 2, threadShouldExit() ? 10 : -1) < 0 && errno != EINTR)
+	    {
+		break;
+	    }
+	    if (fds[0].revents != 0)
+	    {
+		char bytes[64];
+		while (::read(wakePipe_[0], bytes, sizeof(bytes)) > 0)
+		{
+		}
+		// cleared before looking, so a push made while we do wakes us again
+		wakePending_ = false;
+	    }
+
+	    fill();
+	    blocked = !sendBatch();
+	    if (threadShouldExit() && (!blocked || ++exitWaits > maxExitWaits))
+	    {
+		break;
+	    }
+	}
+    }
+
+    int wakePipe_[2] = { -1, -1 };
+    Datagram batch_[maxBatch];
+    iovec iovecs_[maxBatch];
+    mmsghdr headers_[maxBatch];
+    int batchStart_ = 0;                // our thread's: sent so far of the batch's batchSize_
+    int batchSize_ = 0;
+#endif
+
+    int fd_ = -1;
+    SpscQueue<Datagram> commands_;
+    SpscQueue<Datagram> queries_;
+    Datagram datagram_;                 // the producer's
+    std::atomic<bool> wakePending_ { false };
+    std::atomic<int64> numSent_ { 0 };
+    std::atomic<int64> numBatches_ { 0 };
+    std::atomic<int64> numOverflowed_ { 0 };
+    std::atomic<int64> numDropped_ { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE(OscSendThread)
+};
@@ -0,0 +1,247 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include <atomic>
+
+//==============================================================================
+// Watches how far behind the control thread is, by its queues' depths and by
+// how long events take from coming in to being handled, and sheds load in
+// steps when it falls behind: first the verbose log, then the OSC display
+// pushes to subscribers, then controllers passed through to the outputs.
+// The pedals and the notes they send SooperLooper are never shed. A level is
+// taken as soon as it's called for and given up one step at a time, once
+// nothing has called for it for calmMs.
+//
+// update() and noteLag() are the control thread's, sheds() is for anyone.
+class OverloadGuard
+{
+public:
+    enum Level
+    {
+	Normal,
+	ShedLogging,
+	ShedDisplays,
+	ShedPassthrough,
+	numLevels
+    };
+
+    static const int defaultQueueDepth = 32;    // entries waiting, per level
+    static const int defaultLagMs = 5;          // in to handled, for the first level
+    static const int calmMs = 500;
+
+    OverloadGuard()
+    {
+	for (auto&& shed : numShed_)
+	{
+	    shed = 0;
+	}
+    }
+
+    // queueDepth 0 turns it off; each level needs another queueDepth entries
+    // waiting, or a lag of lagMs, 4 * lagMs and 10 * lagMs
+    void configure(int queueDepth, int lagMs)
+    {
+	queueDepth_ = jmax(0, queueDepth);
+	lagTicks_ = Time::getHighResolutionTicksPerSecond() * jmax(1, lagMs) / 1000;
+	if (queueDepth_ == 0)
+	{
+	    level_ = Normal;
+	}
+    }
+
+    bool isEnabled() const              { return queueDepth_ > 0; }
+    int getQueueDepth() const           { return queueDepth_; }
+    int getLagMs() const                { return (int) (lagTicks_ * 1000 / Time::getHighResolutionTicksPerSecond()); }
+
+    // the longest an event took since the last update
+    void noteLag(int64 ticks)
+    {
+	worstLag_ = jmax(worstLag_, ticks);
+    }
+
+    // once a control pass with the deepest of its queues, true when the level changed
+    bool update(int queueDepth, int64 now)
+    {
+	if (queueDepth_ == 0)
+	{
+	    return false;
+	}
+
+	const int64 lag = worstLag_;
+	worstLag_ = 0;
+	const int byLag = lag >= 10 * lagTicks_ ? ShedPassthrough
+	    : lag >= 4 * lagTicks_ ? ShedDisplays
+	    : lag >= lagTicks_ ? ShedLogging
+	    : Normal;
+	const int wanted = jmax(byLag, jmin((int) ShedPassthrough, queueDepth / queueDepth_));
+
+	const int level = level_.load(std::memory_order_relaxed);
+	if (wanted >= level)
+	{
+	    if (wanted > level)
+	    {
+		if (level == Normal)
+		{
+		    shedSince_ = now;
+		}
+		++numRaised_;
+		level_ = wanted;
+	    }
+	    if (wanted != Normal)
+	    {
+		calledForAt_ = now;
+	    }
+	    return wanted != level;
+	}
+
+	if (now - calledForAt_ < Time::getHighResolutionTicksPerSecond() * calmMs / 1000)
+	{
+	    return false;
+	}
+	calledForAt_ = now;
+	level_ = level - 1;
+	if (level_ == Normal)
+	{
+	    ticksShed_ += now - shedSince_;
+	}
+	return true;
+    }
+
+    Level getLevel() const              { return (Level) level_.load(std::memory_order_relaxed); }
+    bool sheds(Level level) const       { return level_.load(std::memory_order_relaxed) >= level; }
+
+    // somewhere to count what was left out at a level
+    void countShed(Level level)         { numShed_[level].fetch_add(1, std::memory_order_relaxed); }
+    int64 getNumShed(Level level) const { return numShed_[level].load(std::memory_order_relaxed); }
+
+    int64 getNumRaised() const          { return numRaised_; }
+    // time spent above Normal, up to now for a level that's still held
+    double getSecondsShed(int64 now) const
+    {
+	return Time::highResolutionTicksToSeconds(ticksShed_ + (getLevel() != Normal ? now - shedSince_ : 0));
+    }
+
+    static const char* getLevelName(Level level)
+    {
+	static const char* const names[] = { "normal", "no verbose log", "no displays", "no passthrough" };
+	return names[level];
+    }
+
+private:
+    int queueDepth_ = defaultQueueDepth;
+    int64 lagTicks_ = Time::getHighResolutionTicksPerSecond() * defaultLagMs / 1000;
+    int64 worstLag_ = 0;
+    std::atomic<int> level_ { Normal };
+    int64 calledForAt_ = 0;
+    int64 shedSince_ = 0;
+    int64 ticksShed_ = 0;
+    int64 numRaised_ = 0;
+    std::atomic<int64> numShed_[numLevels];
+
+    JUCE_DECLARE_NON_COPYABLE(OverloadGuard)
+};
+
+//==============================================================================
+// A MIDI feedback loop, vout wired back into an input or a device that
+// echoes what it's sent: each controller we pass through comes straight
+// back, the same three bytes within echoMs, and is passed through again.
+// Controllers about to be passed through are checked against the last few
+// that were; after cutAfter echoes in a row passthrough is cut for cutMs,
+// which starves the loop. Any thread that passes controllers through.
+class MidiFeedbackGuard
+{
+public:
+    static const int echoMs = 1;
+    static const int cutAfter = 16;
+    static const int cutMs = 2000;
+
+    void setEnabled(bool enabled)       { enabled_ = enabled; }
+
+    // false to drop the controller
+    bool pass(const uint8* data, int64 ticks)
+    {
+	if (!enabled_.load(std::memory_order_relaxed))
+	{
+	    return true;
+	}
+	const uint32 message = ((uint32) data[0] << 16) | ((uint32) data[1] << 8) | data[2];
+	const SpinLock::ScopedLockType lock(lock_);
+	if (cutUntil_ != 0)
+	{
+	    if (ticks < cutUntil_)
+	    {
+		numDropped_.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	    }
+	    cutUntil_ = 0;
+	}
+
+	const int64 echoTicks = Time::getHighResolutionTicksPerSecond() * echoMs / 1000;
+	bool echo = false;
+	for (auto&& sent : recent_)
+	{
+	    if (sent.message_ == message && ticks >= sent.ticks_ && ticks - sent.ticks_ <= echoTicks)
+	    {
+		echo = true;
+		break;
+	    }
+	}
+	echoes_ = echo ? echoes_ + 1 : 0;
+	if (echoes_ >= cutAfter)
+	{
+	    echoes_ = 0;
+	    cutUntil_ = ticks + Time::getHighResolutionTicksPerSecond() * cutMs / 1000;
+	    for (auto&& sent : recent_)
+	    {
+		sent = Sent();
+	    }
+	    numCuts_.fetch_add(1, std::memory_order_relaxed);
+	    numDropped_.fetch_add(1, std::memory_order_relaxed);
+	    return false;
+	}
+
+	recent_[next_] = { message, ticks };
+	next_ = (next_ + 1) % numRecent;
+	return true;
+    }
+
+    int64 getNumCuts() const            { return numCuts_.load(std::memory_order_relaxed); }
+    int64 getNumDropped() const         { return numDropped_.load(std::memory_order_relaxed); }
+
+private:
+    static const int numRecent = 8;
+
+    struct Sent
+    {
+	uint32 message_ = 0xffffffff;
+	int64 ticks_ = 0;
+    };
+
+    std::atomic<bool> enabled_ { true };
+    SpinLock lock_;
+    Sent recent_[numRecent];
+    int next_ = 0;
+    int echoes_ = 0;
+    int64 cutUntil_ = 0;
+    std::atomic<int64> numCuts_ { 0 };
+    std::atomic<int64> numDropped_ { 0 };
+};
@@ -0,0 +1,141 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "LoopStore.h"
+#include "SlbBindings.h"
+
+//==============================================================================
+// Banks of loops for the loop pedals to play. Bank b moves every input's loop
+// pedals b * loopsPerBank loops on from its first loop, and UP and DOWN page
+// through the banks. Each bank is worked out in full when the banks are
+// built: the loop and the play and record notes for every input's loop
+// pedals, which board loop pedal shows each loop's LED, and the loops the
+// pedals are over for "bank" updates. A switch only moves the bank being
+// pointed at, and a press is the same one indexed load it always was. Built
+// and read on the control thread.
+class PedalBanks
+{
+public:
+    static const int maxBanks = 32;
+    static const int maxInputs = 8;         // AlsaMidiInput::maxSources
+    static const int maxLoopPedals = 16;
+    static const int noPedal = -1;
+
+    struct Bank
+    {
+	int offset_ = 0;                                    // loops on from the inputs' first loops
+	int16 loops_[maxInputs][maxLoopPedals];             // by input and loop pedal
+	uint8 notes_[2][maxInputs][maxLoopPedals];          // the same, play then record notes
+	int8 pedals_[LoopStore::maxLoops];                  // the board's loop pedal showing a loop, or noPedal
+	BigInteger visible_;                                // under some input's loop pedals
+
+	int getLoop(int input, int pedal) const             { return loops_[input & (maxInputs - 1)][pedal & (maxLoopPedals - 1)]; }
+	int getNote(bool record, int input, int pedal) const
+	{
+	    return notes_[record ? 1 : 0][input & (maxInputs - 1)][pedal & (maxLoopPedals - 1)];
+	}
+	int getPedal(int loop) const                        { return isPositiveAndBelow(loop, LoopStore::maxLoops) ? pedals_[loop] : noPedal; }
+    };
+
+    PedalBanks()
+    {
+	const int firstLoop = 0;
+	build(1, 0, 0, &firstLoop, 1, PedalNotes());
+    }
+
+    // firstLoops has an entry for each of numInputs, the board being the
+    // first; loopsPerBank 0 is a bank's worth of loop pedals. When there are
+    // fewer banks than before, the bank shown is the last one left.
+    void build(int numBanks, int loopsPerBank, int numLoopPedals, const int* firstLoops, int numInputs,
+	       const PedalNotes& notes)
+    {
+	numBanks_ = jlimit(1, maxBanks, numBanks);
+	numLoopPedals = jlimit(0, maxLoopPedals, numLoopPedals);
+	loopsPerBank_ = loopsPerBank > 0 ? loopsPerBank : numLoopPedals;
+	numInputs = jlimit(1, maxInputs, numInputs);
+	for (int b = 0; b < numBanks_; ++b)
+	{
+	    Bank& bank = banks_[b];
+	    bank.offset_ = b * loopsPerBank_;
+	    bank.visible_.clear();
+	    for (int i = 0; i < maxInputs; ++i)
+	    {
+		const int first = i < numInputs ? firstLoops[i] : firstLoops[0];
+		for (int pedal = 0; pedal < maxLoopPedals; ++pedal)
+		{
+		    const int loop = jlimit(0, LoopStore::maxLoops - 1, first + bank.offset_ + pedal);
+		    bank.loops_[i][pedal] = (int16) loop;
+		    bank.notes_[0][i][pedal] = (uint8) notes.getLoopNote(false, loop);
+		    bank.notes_[1][i][pedal] = (uint8) notes.getLoopNote(true, loop);
+		}
+		if (i < numInputs && first + bank.offset_ < LoopStore::maxLoops)
+		{
+		    bank.visible_.setRange(first + bank.offset_, jmin(numLoopPedals, LoopStore::maxLoops - first - bank.offset_), true);
+		}
+	    }
+
+	    for (auto&& pedal : bank.pedals_)
+	    {
+		pedal = (int8) noPedal;
+	    }
+	    for (int pedal = 0; pedal < numLoopPedals; ++pedal)
+	    {
+		if (firstLoops[0] + bank.offset_ + pedal < LoopStore::maxLoops)
+		{
+		    bank.pedals_[firstLoops[0] + bank.offset_ + pedal] = (int8) pedal;
+		}
+	    }
+	}
+	current_ = jmin(current_, numBanks_ - 1);
+	bank_ = &banks_[current_];
+    }
+
+    // a bank on or back, false at either end
+    bool page(int step)
+    {
+	const int next = current_ + step;
+	if (!isPositiveAndBelow(next, numBanks_))
+	{
+	    return false;
+	}
+	current_ = next;
+	bank_ = &banks_[current_];
+	++numSwitches_;
+	return true;
+    }
+
+    const Bank& getCurrent() const      { return *bank_; }
+    const Bank& get(int index) const    { return banks_[index]; }
+    int getIndex() const                { return current_; }
+    int getNumBanks() const             { return numBanks_; }
+    int getLoopsPerBank() const         { return loopsPerBank_; }
+    int64 getNumSwitches() const        { return numSwitches_; }
+
+private:
+    Bank banks_[maxBanks];
+    const Bank* bank_ = banks_;
+    int numBanks_ = 1;
+    int loopsPerBank_ = 0;
+    int current_ = 0;
+    int64 numSwitches_ = 0;
+
+    JUCE_DECLARE_NON_COPYABLE(PedalBanks)
+};
@@ -0,0 +1,274 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "PedalGestures.h"
+#include <cmath>
+
+//==============================================================================
+// Which pedals are held, as a bitmask per input, and chords of two pedals
+// pressed within a window of each other ("chord"). A pedal that's in no chord
+// is only marked held and goes straight on. One that is in a chord waits: if
+// its partner comes down within the window the chord fires and both presses
+// and releases are swallowed, otherwise the press is handed on once the window
+// runs out or the pedal comes up, whichever is first. Pedals are keyed the way
+// PedalGestures keys them, the chords are a small fixed table resolved with
+// bit tests. Only the control thread uses this.
+class PedalChords
+{
+public:
+    static const int maxChords = 16;
+    static const int maxInputs = PedalGestures::maxPedals / PedalGestures::pedalsPerInput;
+
+    static constexpr uint16 maskOf(int pedalA, int pedalB)
+    {
+	return (uint16) ((1u << pedalA) | (1u << pedalB));
+    }
+
+    static constexpr int inputOf(int key)       { return key / PedalGestures::pedalsPerInput; }
+    static constexpr uint16 bitOf(int key)      { return (uint16) (1u << (key % PedalGestures::pedalsPerInput)); }
+
+    PedalChords()
+    {
+	for (auto&& chord : chords_)
+	{
+	    chord = { -1, 0 };
+	}
+	setWindowMs(40);
+    }
+
+    void setWindowMs(int ms)
+    {
+	windowMs_ = jmax(1, ms);
+	windowTicks_ = (int64) (windowMs_ * (double) Time::getHighResolutionTicksPerSecond() / 1000.0);
+    }
+
+    int getWindowMs() const                 { return windowMs_; }
+
+    // the chord's index for its action, -1 if the table is full or the
+    // pedals don't make one; the same two pedals again give the same index
+    int add(int input, int pedalA, int pedalB)
+    {
+	if (!isPositiveAndBelow(input, maxInputs) || !isPositiveAndBelow(pedalA, PedalGestures::pedalsPerInput)
+	    || !isPositiveAndBelow(pedalB, PedalGestures::pedalsPerInput) || pedalA == pedalB)
+	{
+	    return -1;
+	}
+	const uint16 mask = maskOf(pedalA, pedalB);
+	int index = find(input, mask);
+	if (index < 0)
+	{
+	    index = find(-1, 0);
+	}
+	if (index >= 0)
+	{
+	    chords_[index] = { input, mask };
+	    numChords_ = jmax(numChords_, index + 1);
+	    updateMembers();
+	}
+	return index;
+    }
+
+    // the index it had, -1 if there was none
+    int remove(int input, int pedalA, int pedalB)
+    {
+	const int index = isPositiveAndBelow(pedalA, PedalGestures::pedalsPerInput) && isPositiveAndBelow(pedalB, PedalGestures::pedalsPerInput)
+	    ? find(input, maskOf(pedalA, pedalB)) : -1;
+	if (index >= 0)
+	{
+	    chords_[index] = { -1, 0 };
+	    updateMembers();
+	}
+	return index;
+    }
+
+    bool isEmpty() const                    { return numMembers_ == 0; }
+    bool isInChord(int key) const           { return (members_[inputOf(key)] & bitOf(key)) != 0; }
+    uint16 getHeld(int input) const         { return held_[input]; }
+    bool hasPending() const                 { return numPending_ != 0; }
+
+    // every press and release of a pedal on the board; true if it's taken
+    // here, either held back for a chord or part of one. onPress(key, value,
+    // ticks) is the press of a pedal held back and handed on after all,
+    // before its release goes on. fire(chord, value, ticks) is a chord made,
+    // with the controller value of its lower pedal.
+    template <typename Press, typename Fire>
+    bool edge(int key, bool down, int value, int64 ticks, Press&& onPress, Fire&& fire)
+    {
+	const int input = inputOf(key);
+	const uint16 bit = bitOf(key);
+	held_[input] = down ? (uint16) (held_[input] | bit) : (uint16) (held_[input] & ~bit);
+	if ((members_[input] & bit) == 0)
+	{
+	    return false;
+	}
+
+	if (!down)
+	{
+	    if ((consumed_[input] & bit) != 0)
+	    {
+		consumed_[input] = (uint16) (consumed_[input] & ~bit);
+		return true;
+	    }
+	    if ((pending_[input] & bit) != 0)
+	    {
+		release(key, onPress);
+	    }
+	    return false;
+	}
+
+	for (int i = 0; i < numChords_; ++i)
+	{
+	    const Chord& chord = chords_[i];
+	    const uint16 partner = (uint16) (chord.mask_ & ~bit);
+	    if (chord.input_ == input && (chord.mask_ & bit) != 0 && (pending_[input] & partner) != 0)
+	    {
+		pending_[input] = (uint16) (pending_[input] & ~partner);
+		--numPending_;
+		consumed_[input] = (uint16) (consumed_[input] | chord.mask_);
+		++numFired_;
+		const int firstKey = input * PedalGestures::pedalsPerInput + lowestBit(chord.mask_);
+		fire(i, firstKey == key ? value : states_[firstKey].value_, ticks);
+		return true;
+	    }
+	}
+
+	pending_[input] = (uint16) (pending_[input] | bit);
+	++numPending_;
+	states_[key].value_ = value;
+	states_[key].ticks_ = ticks;
+	return true;
+    }
+
+    // hands on the presses whose window ran out by ticks
+    template <typename Press>
+    void advance(int64 ticks, Press&& onPress)
+    {
+	for (int input = 0; input < maxInputs && numPending_ > 0; ++input)
+	{
+	    for (uint16 waiting = pending_[input]; waiting != 0; waiting = (uint16) (waiting & (waiting - 1)))
+	    {
+		const int key = input * PedalGestures::pedalsPerInput + lowestBit(waiting);
+		if (ticks - states_[key].ticks_ >= windowTicks_)
+		{
+		    release(key, onPress);
+		}
+	    }
+	}
+    }
+
+    // ms until advance() has a press to hand on, -1 for none waiting
+    int getMsUntilNext(int64 ticks) const
+    {
+	int64 soonest = -1;
+	for (int input = 0; input < maxInputs && numPending_ > 0; ++input)
+	{
+	    for (uint16 waiting = pending_[input]; waiting != 0; waiting = (uint16) (waiting & (waiting - 1)))
+	    {
+		const int key = input * PedalGestures::pedalsPerInput + lowestBit(waiting);
+		const int64 left = jmax((int64) 0, states_[key].ticks_ + windowTicks_ - ticks);
+		soonest = soonest < 0 ? left : jmin(soonest, left);
+	    }
+	}
+	return soonest < 0 ? -1 : (int) std::ceil(Time::highResolutionTicksToSeconds(soonest) * 1000.0);
+    }
+
+    int64 getNumFired() const               { return numFired_; }
+    int64 getNumLate() const                { return numLate_; }
+
+private:
+    struct Chord
+    {
+	int input_;
+	uint16 mask_;
+    };
+
+    struct State
+    {
+	int value_ = 0;
+	int64 ticks_ = 0;
+    };
+
+    static int lowestBit(uint16 mask)
+    {
+	int bit = 0;
+	while (bit < 16 && ((mask >> bit) & 1) == 0)
+	{
+	    ++bit;
+	}
+	return bit;
+    }
+
+    int find(int input, uint16 mask) const
+    {
+	for (int i = 0; i < maxChords; ++i)
+	{
+	    if (chords_[i].input_ == input && chords_[i].mask_ == mask)
+	    {
+		return i;
+	    }
+	}
+	return -1;
+    }
+
+    void updateMembers()
+    {
+	numMembers_ = 0;
+	for (auto&& members : members_)
+	{
+	    members = 0;
+	}
+	for (int i = 0; i < numChords_; ++i)
+	{
+	    if (chords_[i].input_ >= 0)
+	    {
+		members_[chords_[i].input_] = (uint16) (members_[chords_[i].input_] | chords_[i].mask_);
+		++numMembers_;
+	    }
+	}
+    }
+
+    template <typename Press>
+    void release(int key, Press&& onPress)
+    {
+	const int input = inputOf(key);
+	pending_[input] = (uint16) (pending_[input] & ~bitOf(key));
+	--numPending_;
+	++numLate_;
+	onPress(key, states_[key].value_, states_[key].ticks_);
+    }
+
+    Chord chords_[maxChords];
+    int numChords_ = 0;
+    int numMembers_ = 0;
+    uint16 members_[maxInputs] = {};    // pedals in any chord
+    uint16 held_[maxInputs] = {};
+    uint16 pending_[maxInputs] = {};    // held back for their partner
+    uint16 consumed_[maxInputs] = {};   // in a chord made, their releases go nowhere
+    int numPending_ = 0;
+    State states_[PedalGestures::maxPedals];
+    int windowMs_ = 0;
+    int64 windowTicks_ = 0;
+    int64 numFired_ = 0;
+    int64 numLate_ = 0;
+
+    JUCE_DECLARE_NON_COPYABLE(PedalChords)
+};
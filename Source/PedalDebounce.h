@@ -0,0 +1,155 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "PedalGestures.h"
+#include <cmath>
+
+//==============================================================================
+// Turns a chattering switch back into one press and one release. The first
+// edge of a physical action goes straight through, and anything else on that
+// pedal within the window after it is a bounce and swallowed. If the switch
+// settled the other way by the end of the window (a real, very quick
+// release), advance() hands that edge on late so nothing is lost. Times are
+// the events' own high resolution ticks; pedals are keyed the way
+// PedalGestures keys them. Only the control thread uses this.
+class PedalDebounce
+{
+public:
+    PedalDebounce() {}
+
+    // 0 switches it off
+    void setWindowMs(int ms)
+    {
+	windowMs_ = jmax(0, ms);
+	windowTicks_ = (int64) (windowMs_ * (double) Time::getHighResolutionTicksPerSecond() / 1000.0);
+    }
+
+    int getWindowMs() const                 { return windowMs_; }
+    bool isEnabled() const                  { return windowMs_ > 0; }
+
+    // onEdge(bool down, int value, int64 ticks) only for the edges that count
+    template <typename Function>
+    void edge(int key, bool down, int value, int64 ticks, Function&& onEdge)
+    {
+	State& state = states_[key];
+	state.rawDown_ = down;
+	state.rawValue_ = value;
+	state.rawTicks_ = ticks;
+	if (!state.seen_ || ticks - state.edgeTicks_ >= windowTicks_)
+	{
+	    state.seen_ = true;
+	    acceptRaw(key);
+	    onEdge(down, value, ticks);
+	    return;
+	}
+
+	++numSuppressed_;
+	setPending(key, state.rawDown_ != state.down_);
+    }
+
+    // hands on the edges whose windows ended with the switch the other way
+    template <typename Function>
+    void advance(int64 ticks, Function&& onEdge)
+    {
+	for (int i = numPending_; --i >= 0;)
+	{
+	    const int key = pending_[i];
+	    const State& state = states_[key];
+	    if (ticks - state.edgeTicks_ >= windowTicks_)
+	    {
+		// its own window runs from when it arrived, catching its bounces too
+		acceptRaw(key);
+		onEdge(key, state.down_, state.rawValue_, state.rawTicks_);
+	    }
+	}
+    }
+
+    // how long until advance() has something to do, -1 for nothing pending
+    int getMsUntilNext(int64 ticks) const
+    {
+	int64 soonest = -1;
+	for (int i = 0; i < numPending_; ++i)
+	{
+	    const int64 left = jmax((int64) 0, states_[pending_[i]].edgeTicks_ + windowTicks_ - ticks);
+	    soonest = soonest < 0 ? left : jmin(soonest, left);
+	}
+	return soonest < 0 ? -1 : (int) std::ceil(Time::highResolutionTicksToSeconds(soonest) * 1000.0);
+    }
+
+    bool hasPending() const                 { return numPending_ != 0; }
+    int64 getNumSuppressed() const          { return numSuppressed_; }
+    int64 getNumLate() const                { return numLate_; }
+
+private:
+    struct State
+    {
+	bool seen_ = false;
+	bool down_ = false;         // what we've passed on
+	bool rawDown_ = false;      // what the switch last said
+	bool pending_ = false;
+	int rawValue_ = 0;
+	int64 rawTicks_ = 0;
+	int64 edgeTicks_ = 0;       // when the edge we passed on arrived
+    };
+
+    void acceptRaw(int key)
+    {
+	State& state = states_[key];
+	numLate_ += state.pending_;
+	state.down_ = state.rawDown_;
+	state.edgeTicks_ = state.rawTicks_;
+	setPending(key, false);
+    }
+
+    void setPending(int key, bool pending)
+    {
+	State& state = states_[key];
+	if (pending == state.pending_)
+	{
+	    return;
+	}
+	state.pending_ = pending;
+	if (pending)
+	{
+	    pending_[numPending_++] = key;
+	    return;
+	}
+	for (int i = 0; i < numPending_; ++i)
+	{
+	    if (pending_[i] == key)
+	    {
+		pending_[i] = pending_[--numPending_];
+		break;
+	    }
+	}
+    }
+
+    State states_[PedalGestures::maxPedals];
+    int pending_[PedalGestures::maxPedals];
+    int numPending_ = 0;
+    int windowMs_ = 0;
+    int64 windowTicks_ = 0;
+    int64 numSuppressed_ = 0;
+    int64 numLate_ = 0;
+
+    JUCE_DECLARE_NON_COPYABLE(PedalDebounce)
+};
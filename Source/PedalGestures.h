@@ -0,0 +1,335 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include <limits>
+
+//==============================================================================
+// Recognises long presses, double taps and held repeats on the pedals that
+// have any of them switched on; the rest never come here. Times are the
+// pedal events' own high resolution ticks, so a press is measured from when it
+// arrived rather than when it was handled. A pedal with a long press or a
+// double tap can't act on the press itself, so its ordinary press and release
+// are handed back once they're known not to be a gesture: a long press waits
+// for the release or the threshold, a double tap for the second press or the
+// window running out. A held repeat lets the press through at once.
+//
+// Every pedal has at most one deadline, all of them on one timing wheel of
+// 1ms slots that advance() walks up to now. Only the control thread uses this.
+class PedalGestures
+{
+public:
+    static const int maxPedals = 128;       // input * pedalsPerInput + pedal
+    static const int pedalsPerInput = 16;
+    static const int numSlots = 1024;       // ms, later deadlines go round again
+
+    enum Gesture
+    {
+	LongPress = 1,
+	DoubleTap = 2,
+	HoldRepeat = 4
+    };
+
+    // what comes back out of handlers
+    enum Outcome
+    {
+	Press,                  // the pedal's own down and up, maybe late
+	Release,
+	LongPressed,
+	DoubleTapped,
+	Repeated
+    };
+
+    PedalGestures()
+    {
+	for (auto&& head : slots_)
+	{
+	    head = -1;
+	}
+    }
+
+    static int getKey(int input, int pedal)
+    {
+	return pedal >= 0 && pedal < pedalsPerInput ? input * pedalsPerInput + pedal : -1;
+    }
+
+    // gestures is a mask of Gesture values; a long press rules out a repeat,
+    // and a repeat, which lets the press through, a double tap
+    void setGestures(int key, int gestures)
+    {
+	State& state = states_[key];
+	unschedule(key);
+	state.gestures_ = (uint8) gestures;
+	state.phase_ = Idle;
+	numActive_ += (gestures != 0) - state.wasActive_;
+	state.wasActive_ = gestures != 0;
+    }
+
+    int getGestures(int key) const      { return key >= 0 ? states_[key].gestures_ : 0; }
+    bool isEmpty() const                { return numActive_ == 0; }
+
+    // thresholds in ms
+    void setTimes(int longPressMs, int doubleTapMs, int repeatDelayMs, int repeatMs)
+    {
+	longPressMs_ = jmax(1, longPressMs);
+	doubleTapMs_ = jmax(1, doubleTapMs);
+	repeatDelayMs_ = jmax(1, repeatDelayMs);
+	repeatMs_ = jmax(1, repeatMs);
+    }
+
+    int getLongPressMs() const          { return longPressMs_; }
+    int getDoubleTapMs() const          { return doubleTapMs_; }
+    int getRepeatDelayMs() const        { return repeatDelayMs_; }
+    int getRepeatMs() const             { return repeatMs_; }
+
+    // onOutcome(int key, Outcome outcome, int value, int64 ticks) with the
+    // controller value and ticks of the press it's about
+    template <typename Function>
+    void pressed(int key, int value, int64 ticks, Function&& onOutcome)
+    {
+	State& state = states_[key];
+	const int64 now = toMs(ticks);
+	if (state.phase_ == WaitingForSecond)
+	{
+	    unschedule(key);
+	    state.phase_ = Swallowing;
+	    ++numRecognised_;
+	    onOutcome(key, DoubleTapped, state.value_, state.ticks_);
+	    return;
+	}
+
+	state.value_ = value;
+	state.ticks_ = ticks;
+	if ((state.gestures_ & LongPress) != 0)
+	{
+	    state.phase_ = Held;
+	    schedule(key, now + longPressMs_);
+	}
+	else if ((state.gestures_ & HoldRepeat) != 0)
+	{
+	    state.phase_ = Held;
+	    schedule(key, now + repeatDelayMs_);
+	    onOutcome(key, Press, value, ticks);
+	}
+	else
+	{
+	    // only the release tells whether there's a second tap to wait for
+	    state.phase_ = Held;
+	}
+    }
+
+    template <typename Function>
+    void released(int key, int64 ticks, Function&& onOutcome)
+    {
+	State& state = states_[key];
+	const Phase phase = state.phase_;
+	unschedule(key);
+	state.phase_ = Idle;
+	if (phase == Held && (state.gestures_ & LongPress) == 0 && (state.gestures_ & HoldRepeat) != 0)
+	{
+	    onOutcome(key, Release, state.value_, state.ticks_);
+	}
+	else if (phase == Repeating)
+	{
+	    onOutcome(key, Release, state.value_, state.ticks_);
+	}
+	else if (phase == Held && (state.gestures_ & DoubleTap) != 0)
+	{
+	    state.phase_ = WaitingForSecond;
+	    schedule(key, toMs(ticks) + doubleTapMs_);
+	}
+	else if (phase == Held)
+	{
+	    onOutcome(key, Press, state.value_, state.ticks_);
+	    onOutcome(key, Release, state.value_, state.ticks_);
+	}
+    }
+
+    // everything that's come due by ticks
+    template <typename Function>
+    void advance(int64 ticks, Function&& onOutcome)
+    {
+	const int64 now = toMs(ticks);
+	if (nextDue_ > now)
+	{
+	    return;
+	}
+	const int64 end = jmin(now, lastMs_ + numSlots);
+	for (int64 ms = lastMs_ + 1; ms <= end; ++ms)
+	{
+	    int key = slots_[ms % numSlots];
+	    while (key >= 0)
+	    {
+		const int next = states_[key].next_;
+		if (states_[key].deadline_ <= now)
+		{
+		    unschedule(key);
+		    fire(key, now, onOutcome);
+		}
+		key = next;
+	    }
+	}
+	lastMs_ = now;
+	nextDue_ = findNextDue();
+    }
+
+    // how long until advance() has something to do, -1 for nothing pending
+    int getMsUntilNext(int64 ticks) const
+    {
+	if (nextDue_ == noDeadline)
+	{
+	    return -1;
+	}
+	return (int) jlimit((int64) 0, (int64) numSlots, nextDue_ - toMs(ticks));
+    }
+
+    int64 getNumRecognised() const      { return numRecognised_; }
+
+private:
+    enum Phase : uint8
+    {
+	Idle,
+	Held,                   // down, nothing decided yet
+	LongDone,               // the long press went, its release is ours
+	Repeating,
+	WaitingForSecond,       // a tap that may be the first of two
+	Swallowing              // the second tap's release
+    };
+
+    struct State
+    {
+	uint8 gestures_ = 0;
+	bool wasActive_ = false;
+	Phase phase_ = Idle;
+	int value_ = 0;
+	int64 ticks_ = 0;
+	int64 deadline_ = 0;
+	int next_ = -1;         // the slot's list
+	int prev_ = -1;
+	bool scheduled_ = false;
+    };
+
+    static constexpr int64 noDeadline = std::numeric_limits<int64>::max();
+
+    static int64 toMs(int64 ticks)
+    {
+	return ticks * 1000 / Time::getHighResolutionTicksPerSecond();
+    }
+
+    template <typename Function>
+    void fire(int key, int64 now, Function&& onOutcome)
+    {
+	State& state = states_[key];
+	switch (state.phase_)
+	{
+	    case Held:
+		if ((state.gestures_ & LongPress) != 0)
+		{
+		    state.phase_ = LongDone;
+		    ++numRecognised_;
+		    onOutcome(key, LongPressed, state.value_, state.ticks_);
+		    break;
+		}
+		state.phase_ = Repeating;
+		// fall through
+	    case Repeating:
+		schedule(key, now + repeatMs_);
+		++numRecognised_;
+		onOutcome(key, Repeated, state.value_, state.ticks_);
+		break;
+	    case WaitingForSecond:
+		state.phase_ = Idle;
+		onOutcome(key, Press, state.value_, state.ticks_);
+		onOutcome(key, Release, state.value_, state.ticks_);
+		break;
+	    default:
+		break;
+	}
+    }
+
+    void schedule(int key, int64 deadline)
+    {
+	State& state = states_[key];
+	const int slot = (int) (deadline % numSlots);
+	state.deadline_ = deadline;
+	state.prev_ = -1;
+	state.next_ = slots_[slot];
+	if (state.next_ >= 0)
+	{
+	    states_[state.next_].prev_ = key;
+	}
+	slots_[slot] = key;
+	state.scheduled_ = true;
+	nextDue_ = jmin(nextDue_, deadline);
+	lastMs_ = jmin(lastMs_, deadline - 1);
+    }
+
+    void unschedule(int key)
+    {
+	State& state = states_[key];
+	if (!state.scheduled_)
+	{
+	    return;
+	}
+	if (state.prev_ >= 0)
+	{
+	    states_[state.prev_].next_ = state.next_;
+	}
+	else
+	{
+	    slots_[state.deadline_ % numSlots] = state.next_;
+	}
+	if (state.next_ >= 0)
+	{
+	    states_[state.next_].prev_ = state.prev_;
+	}
+	state.next_ = state.prev_ = -1;
+	state.scheduled_ = false;
+    }
+
+    int64 findNextDue() const
+    {
+	int64 next = noDeadline;
+	for (auto&& state : states_)
+	{
+	    if (state.scheduled_)
+	    {
+		next = jmin(next, state.deadline_);
+	    }
+	}
+	return next;
+    }
+
+    State states_[maxPedals];
+    int slots_[numSlots];
+    int64 lastMs_ = 0;                  // advance() has been through here
+    int64 nextDue_ = noDeadline;
+    int numActive_ = 0;
+
+    int longPressMs_ = 600;
+    int doubleTapMs_ = 300;
+    int repeatDelayMs_ = 500;
+    int repeatMs_ = 150;
+
+    int64 numRecognised_ = 0;
+
+    JUCE_DECLARE_NON_COPYABLE(PedalGestures)
+};
@@ -0,0 +1,115 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+//==============================================================================
+// What a pedal does when it goes down (CC 104) and up (CC 105).
+enum PedalAction
+{
+    PedalLoop,          // note base + mode + pedal, down/up map to note on/off
+    PedalModeToggle,    // flips between play and record mode on press, lights while in record mode
+    PedalMomentary,     // note base + pedal, LED lit while held and loops refreshed on release
+    PedalNote           // note base + pedal
+};
+
+struct PedalInfo
+{
+    int pedal_;         // index into the LED/loop arrays
+    int ledNumber_;     // number sent to loop4r_leds for this pedal
+    int noteOffset_;    // added to the base note (mode is added on top for PedalLoop)
+    PedalAction action_;
+};
+
+//==============================================================================
+// Pedal layouts. Each one says, for a controller value sent by the board, which
+// pedal it is, which LED goes with that pedal and how the pedal behaves. Only
+// these constexpr functions are layout specific, PedalTable turns them into a
+// flat table at compile time so the event path is a single indexed load.
+enum PedalLayoutId
+{
+    EurekaPromIoLayout  // FCB1010 with the EurekaProm in I/O mode
+};
+
+template <PedalLayoutId Layout>
+struct PedalLayout;
+
+template <>
+struct PedalLayout<EurekaPromIoLayout>
+{
+    // pedals 1-9 send 1-9 and pedal 10 sends 0, the up/down pedals send 10 and 11
+    static constexpr int pedalForValue(int value)
+    {
+	return (value >= 1 && value <= 9) ? value - 1 : (value == 0 ? 9 : value);
+    }
+
+    static constexpr int ledForPedal(int pedal)
+    {
+	return (pedal >= 0 && pedal <= 8) ? pedal + 1 : (pedal == 9 ? 0 : pedal);
+    }
+
+    static constexpr PedalAction actionForPedal(int pedal)
+    {
+	return (pedal >= 0 && pedal <= 3) ? PedalLoop
+	    : pedal == 4 ? PedalModeToggle
+	    : pedal == 9 ? PedalMomentary
+	    : PedalNote;
+    }
+};
+
+//==============================================================================
+template <PedalLayoutId Layout>
+struct PedalTable
+{
+    static const int size = 128;
+
+    constexpr PedalTable() : byValue_(), ledByPedal_(), numLoopPedals_(0)
+    {
+	for (int i = 0; i < size; ++i)
+	{
+	    const int pedal = PedalLayout<Layout>::pedalForValue(i);
+	    byValue_[i] = { pedal, PedalLayout<Layout>::ledForPedal(pedal), pedal, PedalLayout<Layout>::actionForPedal(pedal) };
+	    ledByPedal_[i] = PedalLayout<Layout>::ledForPedal(i);
+	    if (PedalLayout<Layout>::actionForPedal(i) == PedalLoop)
+	    {
+		numLoopPedals_ = i + 1;
+	    }
+	}
+    }
+
+    constexpr const PedalInfo& forValue(int controllerValue) const    { return byValue_[controllerValue & 0x7f]; }
+    constexpr int ledNumber(int pedal) const                          { return ledByPedal_[pedal & 0x7f]; }
+
+    // an input's loop pedals play its first loop and the ones after it
+    constexpr int getNumLoopPedals() const                            { return numLoopPedals_; }
+
+    PedalInfo byValue_[size];
+    int ledByPedal_[size];
+    int numLoopPedals_;
+};
+
+template <PedalLayoutId Layout>
+struct Pedals
+{
+    static constexpr PedalTable<Layout> table {};
+};
+
+template <PedalLayoutId Layout>
+constexpr PedalTable<Layout> Pedals<Layout>::table;
@@ -0,0 +1,299 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include <cmath>
+#include <limits>
+
+//==============================================================================
+// Named sequences of SooperLooper actions with waits between them, defined by
+// "macro" in a program file and started by a pedal. A definition is compiled
+// once into steps:
+//
+//     mute L, unmute L        /sl/L/hit mute_on or mute_off
+//     hit L command           /sl/L/hit command
+//     select L                /set selected_loop_num L
+//     note N                  note on and off
+//     wait ms, wait N beats   the next step that much later
+//
+// Running macros share one small schedule that the control pass advances;
+// each wait counts from when the one before was due rather than from when it
+// was handled, so steps keep their spacing however late the pass wakes, and
+// a step can be handed over ahead of time to be sent time tagged.
+// Pressing the pedal of a running macro cancels it. Only the control thread
+// uses this.
+class PedalMacros
+{
+public:
+    static const int maxMacros = 32;
+    static const int maxSteps = 32;
+    static const int maxRunning = 8;
+
+    struct Step
+    {
+	enum Kind
+	{
+	    Hit,
+	    Select,
+	    Note,
+	    WaitMs,
+	    WaitBeats
+	};
+
+	Kind kind_ = Hit;
+	int loop_ = 0;
+	int value_ = 0;         // the note
+	double amount_ = 0;     // ms or beats to wait
+	String command_;
+    };
+
+    PedalMacros() {}
+
+    // replaces a macro of the same name; error says what's wrong otherwise
+    bool define(const String& name, const StringArray& words, String& error)
+    {
+	Macro macro;
+	macro.name_ = name;
+	for (int i = 0; i < words.size();)
+	{
+	    const String word = words[i++].toLowerCase();
+	    Step step;
+	    if (word == "mute" || word == "unmute")
+	    {
+		step.loop_ = words[i++].getIntValue();
+		step.command_ = word == "mute" ? "mute_on" : "mute_off";
+	    }
+	    else if (word == "hit" && i + 1 < words.size())
+	    {
+		step.loop_ = words[i++].getIntValue();
+		step.command_ = words[i++];
+	    }
+	    else if (word == "select")
+	    {
+		step.kind_ = Step::Select;
+		step.loop_ = words[i++].getIntValue();
+	    }
+	    else if (word == "note")
+	    {
+		step.kind_ = Step::Note;
+		step.value_ = jlimit(0, 127, words[i++].getIntValue());
+	    }
+	    else if (word == "wait" && words[i].getDoubleValue() > 0)
+	    {
+		step.amount_ = words[i++].getDoubleValue();
+		step.kind_ = Step::WaitMs;
+		if (words[i].equalsIgnoreCase("beats") || words[i].equalsIgnoreCase("beat"))
+		{
+		    step.kind_ = Step::WaitBeats;
+		    ++i;
+		}
+	    }
+	    else
+	    {
+		error = "didn't expect \"" + words[i - 1] + "\"";
+		return false;
+	    }
+	    if (i > words.size())
+	    {
+		error = "\"" + word + "\" needs a number";
+		return false;
+	    }
+	    if (macro.steps_.size() == maxSteps)
+	    {
+		error = "more than " + String(maxSteps) + " steps";
+		return false;
+	    }
+	    macro.steps_.add(step);
+	}
+
+	const int existing = find(name);
+	if (existing < 0 && macros_.size() == maxMacros)
+	{
+	    error = "more than " + String(maxMacros) + " macros";
+	    return false;
+	}
+	// a redefinition mustn't pull steps from under a macro that's running
+	for (auto&& running : running_)
+	{
+	    running.active_ = running.active_ && running.macro_ != existing;
+	}
+	if (existing >= 0)
+	{
+	    macros_.getReference(existing) = macro;
+	}
+	else
+	{
+	    macros_.add(macro);
+	}
+	return true;
+    }
+
+    int find(const String& name) const
+    {
+	for (int i = 0; i < macros_.size(); ++i)
+	{
+	    if (macros_.getReference(i).name_.equalsIgnoreCase(name))
+	    {
+		return i;
+	    }
+	}
+	return -1;
+    }
+
+    bool isRunning(int key) const
+    {
+	for (auto&& running : running_)
+	{
+	    if (running.active_ && running.key_ == key)
+	    {
+		return true;
+	    }
+	}
+	return false;
+    }
+
+    bool isBusy() const                 { return numActive() > 0; }
+
+    // starts macro for the pedal key at ticks, the first steps right away;
+    // false if too many are running already
+    template <typename StepFunction, typename DoneFunction>
+    bool start(int macro, int key, int64 ticks, int64 now, double ticksPerBeat, StepFunction&& onStep, DoneFunction&& onDone)
+    {
+	for (auto&& running : running_)
+	{
+	    if (!running.active_)
+	    {
+		running = { true, macro, key, 0, ticks };
+		++numStarted_;
+		run(running, now, ticksPerBeat, onStep, onDone);
+		return true;
+	    }
+	}
+	return false;
+    }
+
+    bool cancel(int key)
+    {
+	for (auto&& running : running_)
+	{
+	    if (running.active_ && running.key_ == key)
+	    {
+		running.active_ = false;
+		++numCancelled_;
+		return true;
+	    }
+	}
+	return false;
+    }
+
+    // onStep(const Step& step, int key, int64 due) for each step due by now,
+    // onDone(int key) when a macro has run its last; a now ahead of the clock
+    // hands steps over early with the ticks they're due at
+    template <typename StepFunction, typename DoneFunction>
+    void advance(int64 now, double ticksPerBeat, StepFunction&& onStep, DoneFunction&& onDone)
+    {
+	for (auto&& running : running_)
+	{
+	    if (running.active_ && running.due_ <= now)
+	    {
+		run(running, now, ticksPerBeat, onStep, onDone);
+	    }
+	}
+    }
+
+    // how long until advance() has something to do, -1 for nothing running
+    int getMsUntilNext(int64 now) const
+    {
+	int64 soonest = std::numeric_limits<int64>::max();
+	for (auto&& running : running_)
+	{
+	    soonest = running.active_ ? jmin(soonest, running.due_) : soonest;
+	}
+	if (soonest == std::numeric_limits<int64>::max())
+	{
+	    return -1;
+	}
+	return (int) std::ceil(Time::highResolutionTicksToSeconds(jmax((int64) 0, soonest - now)) * 1000.0);
+    }
+
+    int getNumMacros() const            { return macros_.size(); }
+    int64 getNumStarted() const         { return numStarted_; }
+    int64 getNumCancelled() const       { return numCancelled_; }
+
+private:
+    struct Macro
+    {
+	String name_;
+	Array<Step> steps_;
+    };
+
+    struct Running
+    {
+	bool active_;
+	int macro_;
+	int key_;
+	int next_;              // the step to run at due_
+	int64 due_;
+    };
+
+    int numActive() const
+    {
+	int count = 0;
+	for (auto&& running : running_)
+	{
+	    count += running.active_;
+	}
+	return count;
+    }
+
+    template <typename StepFunction, typename DoneFunction>
+    void run(Running& running, int64 now, double ticksPerBeat, StepFunction&& onStep, DoneFunction&& onDone)
+    {
+	const Array<Step>& steps = macros_.getReference(running.macro_).steps_;
+	const double ticksPerMs = (double) Time::getHighResolutionTicksPerSecond() / 1000.0;
+	while (running.next_ < steps.size())
+	{
+	    const Step& step = steps.getReference(running.next_++);
+	    if (step.kind_ == Step::WaitMs || step.kind_ == Step::WaitBeats)
+	    {
+		running.due_ += (int64) (step.kind_ == Step::WaitMs ? step.amount_ * ticksPerMs : step.amount_ * ticksPerBeat);
+		if (running.due_ > now)
+		{
+		    return;
+		}
+		continue;
+	    }
+	    onStep(step, running.key_, running.due_);
+	    if (!running.active_)
+	    {
+		// the step cancelled it
+		return;
+	    }
+	}
+	running.active_ = false;
+	onDone(running.key_);
+    }
+
+    Array<Macro> macros_;
+    Running running_[maxRunning] {};
+    int64 numStarted_ = 0;
+    int64 numCancelled_ = 0;
+};
@@ -0,0 +1,237 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include <iostream>
+
+//==============================================================================
+// What a pedal script can do, on the control thread
+class PedalScriptHost
+{
+public:
+    virtual ~PedalScriptHost() {}
+
+    // a line of loop4r commands, as a program file has them
+    virtual void runScriptCommand(const String& line) = 0;
+    virtual void setScriptLed(int led, bool on) = 0;
+    virtual void sendScriptMidi(const MidiMessage& message) = 0;
+    virtual int getScriptMode() const = 0;
+    virtual void setScriptMode(int mode) = 0;
+};
+
+//==============================================================================
+// "jpedal": pedals handled by JavaScript through JUCE's JavascriptEngine. A
+// script file is run once when it's loaded, which parses it and defines its
+// functions, and each engine is kept for as long as the file doesn't change,
+// so a pedal event is one callFunction of the already parsed
+//
+//     function onPedal(event)     // event.pedal (1-10), .down, .value, .input, .ms
+//
+// with an event object made once and filled in each time. It runs on the
+// control thread with maximumExecutionTime as its budget, a few milliseconds,
+// so a runaway loop costs one late pass rather than the pedalboard. Returning
+// true means the script has dealt with the pedal; anything else, or an error,
+// leaves it to the usual mapping, which stays the fast path for every pedal
+// without a script. The script sees a loop4r object:
+//
+//     loop4r.command("hit record 0")      run loop4r commands
+//     loop4r.led(led, on)                 an LED (0-9) on or off
+//     loop4r.send(status, data1, data2)   a MIDI message out
+//     loop4r.mode                         0 for play, 20 for record; set it to switch
+class PedalScripts
+{
+public:
+    static const int maxScripts = 8;
+    static const int defaultBudgetMs = 5;
+
+    PedalScripts(PedalScriptHost& host)
+	: host_(host)
+    {
+    }
+
+    // the script's index, the one already loaded from file unless it has
+    // changed since; -1 with why in error if it can't be used
+    int load(const File& file, int budgetMs, String& error)
+    {
+	int index = -1;
+	for (int i = 0; i < scripts_.size(); ++i)
+	{
+	    if (scripts_[i]->file_ == file)
+	    {
+		index = i;
+	    }
+	}
+	if (running_)
+	{
+	    error = "scripts can't be loaded from a script";
+	    return -1;
+	}
+	if (index >= 0 && scripts_[index]->modified_ == file.getLastModificationTime())
+	{
+	    scripts_[index]->engine_->maximumExecutionTime = RelativeTime::milliseconds(jmax(1, budgetMs));
+	    return index;
+	}
+	if (index < 0 && scripts_.size() >= maxScripts)
+	{
+	    error = "there are " + String(maxScripts) + " scripts already";
+	    return -1;
+	}
+
+	String code;
+	if (!file.existsAsFile() || (code = file.loadFileAsString()).isEmpty())
+	{
+	    error = "there's no script in " + file.getFullPathName();
+	    return -1;
+	}
+
+	ScopedPointer<Script> script(new Script());
+	script->file_ = file;
+	script->modified_ = file.getLastModificationTime();
+	script->engine_ = new JavascriptEngine();
+	script->engine_->maximumExecutionTime = RelativeTime::milliseconds(jmax(1, budgetMs));
+	script->api_ = createApi();
+	script->engine_->registerNativeObject("loop4r", script->api_.get());
+	script->event_ = new DynamicObject();
+	script->args_[0] = var(script->event_.get());
+
+	const Result result = script->engine_->execute(code);
+	if (result.failed())
+	{
+	    error = result.getErrorMessage();
+	    return -1;
+	}
+	if (!script->engine_->getRootObjectProperties().contains(onPedal()))
+	{
+	    error = "it has no onPedal(event) function";
+	    return -1;
+	}
+
+	if (index >= 0)
+	{
+	    scripts_.set(index, script.release());
+	    return index;
+	}
+	scripts_.add(script.release());
+	return scripts_.size() - 1;
+    }
+
+    // false to leave the pedal to the usual mapping; pedal counts from 0
+    bool run(int index, int pedal, bool down, int value, int input, int64 ticks)
+    {
+	Script& script = *scripts_[index];
+	DynamicObject& event = *script.event_;
+	event.setProperty(pedalId(), pedal + 1);
+	event.setProperty(downId(), down);
+	event.setProperty(valueId(), value);
+	event.setProperty(inputId(), input);
+	event.setProperty(msId(), Time::highResolutionTicksToSeconds(ticks) * 1000.0);
+	const int mode = host_.getScriptMode();
+	script.api_->setProperty(modeId(), mode);
+
+	const int64 started = Time::getHighResolutionTicks();
+	Result result = Result::ok();
+	running_ = true;
+	const var handled = script.engine_->callFunction(onPedal(), var::NativeFunctionArgs(var(), script.args_, 1), &result);
+	running_ = false;
+	const int64 micros = (int64) (Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - started) * 1.0e6);
+	++numRuns_;
+	maxMicros_ = jmax(maxMicros_, micros);
+
+	const int newMode = (int) script.api_->getProperty(modeId());
+	if (newMode != mode)
+	{
+	    host_.setScriptMode(newMode);
+	}
+	if (result.failed())
+	{
+	    ++numErrors_;
+	    std::cerr << script.file_.getFileName() << ": " << result.getErrorMessage() << std::endl;
+	    return false;
+	}
+	return handled.isBool() && (bool) handled;
+    }
+
+    int64 getNumRuns() const        { return numRuns_; }
+    int64 getNumErrors() const      { return numErrors_; }
+    int64 getMaxMicros() const      { return maxMicros_; }
+
+private:
+    struct Script
+    {
+	File file_;
+	Time modified_;
+	ScopedPointer<JavascriptEngine> engine_;
+	DynamicObject::Ptr api_;
+	DynamicObject::Ptr event_;
+	var args_[1];
+    };
+
+    DynamicObject::Ptr createApi()
+    {
+	DynamicObject::Ptr api(new DynamicObject());
+	api->setMethod("command", [this] (const var::NativeFunctionArgs& args)
+	{
+	    if (args.numArguments > 0)
+	    {
+		host_.runScriptCommand(args.arguments[0].toString());
+	    }
+	    return var();
+	});
+	api->setMethod("led", [this] (const var::NativeFunctionArgs& args)
+	{
+	    if (args.numArguments > 1)
+	    {
+		host_.setScriptLed((int) args.arguments[0], (bool) args.arguments[1]);
+	    }
+	    return var();
+	});
+	api->setMethod("send", [this] (const var::NativeFunctionArgs& args)
+	{
+	    const int status = args.numArguments > 0 ? (int) args.arguments[0] : 0;
+	    if (status >= 0x80 && status <= 0xef)
+	    {
+		const int data1 = args.numArguments > 1 ? (int) args.arguments[1] & 0x7f : 0;
+		const int data2 = args.numArguments > 2 ? (int) args.arguments[2] & 0x7f : 0;
+		const bool twoBytes = (status & 0xe0) == 0xc0;
+		host_.sendScriptMidi(twoBytes ? MidiMessage(status, data1) : MidiMessage(status, data1, data2));
+	    }
+	    return var();
+	});
+	return api;
+    }
+
+    // made once, Identifiers being pooled strings
+    static const Identifier& onPedal()      { static const Identifier id("onPedal"); return id; }
+    static const Identifier& pedalId()      { static const Identifier id("pedal"); return id; }
+    static const Identifier& downId()       { static const Identifier id("down"); return id; }
+    static const Identifier& valueId()      { static const Identifier id("value"); return id; }
+    static const Identifier& inputId()      { static const Identifier id("input"); return id; }
+    static const Identifier& msId()         { static const Identifier id("ms"); return id; }
+    static const Identifier& modeId()       { static const Identifier id("mode"); return id; }
+
+    PedalScriptHost& host_;
+    OwnedArray<Script> scripts_;
+    bool running_ = false;
+    int64 numRuns_ = 0;
+    int64 numErrors_ = 0;
+    int64 maxMicros_ = 0;
+
+    JUCE_DECLARE_NON_COPYABLE(PedalScripts)
+};
@@ -0,0 +1,271 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "JackMeter.h"
+#include "OnsetDetector.h"
+#include <atomic>
+#include <cmath>
+#include <cstring>
+
+//==============================================================================
+// YIN pitch detection on a 2048 sample frame. The difference function over
+// lags up to 1024 is worked out from the frame's first half correlated with
+// all of it, which takes one forward FFT of the frame's size (the two real
+// inputs as one complex one, told apart by symmetry) and an inverse one; the
+// lags never reach past the end, so the circular correlation is the plain
+// one. Splitting the spectra, the cross spectrum and the scaling are
+// FloatVectorOperations, leaving the cumulative mean normalisation and the
+// search for the first dip under threshold as the only scalar loops. At
+// 48kHz it finds 47Hz up.
+class YinPitch
+{
+public:
+    static const int order = 11;
+    static const int frameSize = 1 << order;
+    static const int maxLag = frameSize / 2;
+
+    struct Result
+    {
+	float frequency_;   // Hz, 0 for none found
+	float clarity_;     // 1 less the normalised difference at the lag found
+    };
+
+    YinPitch()
+	: fft_(order), firstRe_(frameSize), firstIm_(frameSize), secondRe_(frameSize), secondIm_(frameSize),
+	  re_(frameSize), im_(frameSize), cross_(frameSize), energy_(frameSize + 1), difference_(maxLag)
+    {
+    }
+
+    Result process(const float* frame, int sampleRate, float minFrequency, float maxFrequency)
+    {
+	const int half = frameSize / 2;
+
+	// z = the first half zero padded + i * the whole frame
+	FloatVectorOperations::copy(re_, frame, half);
+	FloatVectorOperations::clear(re_ + half, half);
+	FloatVectorOperations::copy(im_, frame, frameSize);
+	fft_.perform(re_, im_);
+
+	// with w = conj(Z[N - k]), the first half's spectrum is (Z + w) / 2 and
+	// the frame's is (Z - w) / 2i; only their product matters, so the
+	// halves are left for the scaling after the inverse
+	secondRe_[0] = re_[0];
+	secondIm_[0] = -im_[0];
+	for (int k = 1; k < frameSize; ++k)
+	{
+	    secondRe_[k] = re_[frameSize - k];
+	    secondIm_[k] = -im_[frameSize - k];
+	}
+	FloatVectorOperations::add(firstRe_, re_, secondRe_, frameSize);
+	FloatVectorOperations::add(firstIm_, im_, secondIm_, frameSize);
+	// (Z - w) / i = (Zi - wi) - i (Zr - wr)
+	FloatVectorOperations::subtract(cross_, im_, secondIm_, frameSize);
+	FloatVectorOperations::subtract(im_, secondRe_, re_, frameSize);
+	FloatVectorOperations::copy(re_, cross_, frameSize);
+
+	// conj(first) * whole, into re_ and im_
+	FloatVectorOperations::multiply(cross_, firstIm_, re_, frameSize);
+	FloatVectorOperations::multiply(re_, firstRe_, frameSize);
+	FloatVectorOperations::addWithMultiply(re_, firstIm_, im_, frameSize);
+	FloatVectorOperations::multiply(im_, firstRe_, frameSize);
+	FloatVectorOperations::subtract(im_, cross_, frameSize);
+
+	// the inverse is the forward one with the parts swapped, its real part
+	// ending up in re_
+	fft_.perform(im_, re_);
+	FloatVectorOperations::multiply(re_, 0.25f / frameSize, frameSize);
+
+	// energy_[i] is the sum of squares of the first i samples
+	energy_[0] = 0;
+	for (int i = 0; i < frameSize; ++i)
+	{
+	    energy_[i + 1] = energy_[i] + frame[i] * frame[i];
+	}
+
+	// d(lag) = sum over the first half of (x[j] - x[j + lag])^2,
+	// normalised by its mean over lags 1..lag
+	const int minLag = jmax(2, (int) (sampleRate / maxFrequency));
+	const int lastLag = jmin(maxLag - 1, (int) (sampleRate / minFrequency) + 1);
+	difference_[0] = 1;
+	double runningSum = 0;
+	for (int lag = 1; lag <= lastLag; ++lag)
+	{
+	    const double d = energy_[half] + (energy_[lag + half] - energy_[lag]) - 2.0 * re_[lag];
+	    runningSum += jmax(0.0, d);
+	    difference_[lag] = runningSum > 0 ? (float) (jmax(0.0, d) * lag / runningSum) : 1.0f;
+	}
+
+	for (int lag = minLag; lag < lastLag; ++lag)
+	{
+	    if (difference_[lag] < threshold)
+	    {
+		while (lag + 1 < lastLag && difference_[lag + 1] < difference_[lag])
+		{
+		    ++lag;
+		}
+		// the dip's bottom between lags, from a parabola through its neighbours
+		const float before = difference_[lag - 1];
+		const float at = difference_[lag];
+		const float after = difference_[lag + 1];
+		const float curve = before + after - 2 * at;
+		const float offset = curve > 0 ? 0.5f * (before - after) / curve : 0.0f;
+		return { sampleRate / (lag + jlimit(-0.5f, 0.5f, offset)), 1.0f - at };
+	    }
+	}
+	return { 0.0f, 0.0f };
+    }
+
+    // nearest MIDI note, cents off it in the second
+    static int toNote(float frequency, float& cents)
+    {
+	const double note = 69.0 + 12.0 * std::log2(frequency / 440.0);
+	const int nearest = roundToInt(note);
+	cents = (float) ((note - nearest) * 100.0);
+	return nearest;
+    }
+
+private:
+    static constexpr float threshold = 0.15f;
+
+    SplitFft fft_;
+    HeapBlock<float> firstRe_;
+    HeapBlock<float> firstIm_;
+    HeapBlock<float> secondRe_;
+    HeapBlock<float> secondIm_;
+    HeapBlock<float> re_;
+    HeapBlock<float> im_;
+    HeapBlock<float> cross_;
+    HeapBlock<double> energy_;
+    HeapBlock<float> difference_;
+
+    JUCE_DECLARE_NON_COPYABLE(YinPitch)
+};
+
+//==============================================================================
+// Runs YinPitch on a thread of its own over the audio a JackMeter feeds it,
+// a frame every hop (half a frame), leaving the latest pitch for the control
+// thread to take whenever it draws. Quiet or unclear frames leave no pitch.
+// How long each hop took is kept, for the budget.
+class PitchTracker : private Thread
+{
+public:
+    static const int hopSize = YinPitch::frameSize / 2;
+    static constexpr float minFrequency = 40.0f;
+    static constexpr float maxFrequency = 1500.0f;
+    static constexpr float minClarity = 0.8f;
+    static constexpr float minPeak = 0.01f;     // -40dBFS
+
+    PitchTracker()
+	: Thread("loop4r tuner"), frame_(YinPitch::frameSize, true)
+    {
+    }
+
+    ~PitchTracker()
+    {
+	stop();
+    }
+
+    // meter must stay open until stop()
+    void start(JackMeter& meter)
+    {
+	stop();
+	meter_ = &meter;
+	pitch_.store(0);
+	meter.setFeeding(true);
+	startThread();
+    }
+
+    void stop()
+    {
+	stopThread(1000);
+	if (meter_ != nullptr)
+	{
+	    meter_->setFeeding(false);
+	    meter_ = nullptr;
+	}
+    }
+
+    bool isRunning() const          { return isThreadRunning(); }
+
+    // control thread: Hz, 0 while there's no clear note
+    float getFrequency() const
+    {
+	const uint32 bits = pitch_.load(std::memory_order_acquire);
+	float frequency;
+	std::memcpy(&frequency, &bits, sizeof(frequency));
+	return frequency;
+    }
+
+    int64 getNumHops() const        { return numHops_.load(); }
+    int getMaxMicros() const        { return maxMicros_.load(); }
+    double getAverageMicros() const { return numHops_.load() > 0 ? (double) totalMicros_.load() / numHops_.load() : 0.0; }
+
+private:
+    void run() override
+    {
+	meter_->skipReady();
+	FloatVectorOperations::clear(frame_, YinPitch::frameSize);
+	const int sampleRate = jmax(1, meter_->getSampleRate());
+	int filled = 0;
+
+	while (!threadShouldExit())
+	{
+	    const int read = meter_->readSamples(frame_ + hopSize + filled, hopSize - filled);
+	    filled += read;
+	    if (filled < hopSize)
+	    {
+		wait(5);
+		continue;
+	    }
+
+	    const int64 start = Time::getHighResolutionTicks();
+	    const Range<float> range = FloatVectorOperations::findMinAndMax(frame_.getData(), YinPitch::frameSize);
+	    float frequency = 0;
+	    if (jmax(-range.getStart(), range.getEnd()) >= minPeak)
+	    {
+		const YinPitch::Result result = yin_.process(frame_, sampleRate, minFrequency, maxFrequency);
+		frequency = result.clarity_ >= minClarity ? result.frequency_ : 0.0f;
+	    }
+	    FloatVectorOperations::copy(frame_, frame_ + hopSize, hopSize);
+	    filled = 0;
+
+	    uint32 bits;
+	    std::memcpy(&bits, &frequency, sizeof(bits));
+	    pitch_.store(bits, std::memory_order_release);
+
+	    const int micros = (int) (Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - start) * 1.0e6);
+	    maxMicros_.store(jmax(maxMicros_.load(std::memory_order_relaxed), micros), std::memory_order_relaxed);
+	    totalMicros_.fetch_add(micros, std::memory_order_relaxed);
+	    numHops_.fetch_add(1, std::memory_order_relaxed);
+	}
+    }
+
+    JackMeter* meter_ = nullptr;
+    YinPitch yin_;
+    HeapBlock<float> frame_;
+    std::atomic<uint32> pitch_ { 0 };
+    std::atomic<int64> numHops_ { 0 };
+    std::atomic<int64> totalMicros_ { 0 };
+    std::atomic<int> maxMicros_ { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE(PitchTracker)
+};
@@ -0,0 +1,226 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "CommandScript.h"
+#include "RuntimeCommands.h"
+#include <functional>
+
+#if JUCE_LINUX
+ #include <cerrno>
+ #include <fcntl.h>
+ #include <poll.h>
+ #include <sys/inotify.h>
+ #include <unistd.h>
+#endif
+
+//==============================================================================
+// Watches the program files named on the command line with inotify. When one
+// is written, or replaced the way editors save, its thread compiles it again
+// and hands the commands that are new or changed since the last version to
+// RuntimeCommands in one go, so the control thread runs them between events
+// and everything else stays as it was: the loops stay registered and the
+// LEDs lit. A line that went away isn't undone, and the files a program file
+// includes aren't watched themselves.
+class ProgramFileWatcher : private Thread
+{
+public:
+    typedef std::function<void(const File&, CommandScript&)> Compiler;
+
+    ProgramFileWatcher(RuntimeCommands& commands) : Thread("loop4r config"), commands_(commands) {}
+
+    ~ProgramFileWatcher()
+    {
+	stop();
+    }
+
+    // before start(), which takes the file as it is then as the first version
+    void watch(const File& file)
+    {
+	for (auto* watched : files_)
+	{
+	    if (watched->file_ == file)
+	    {
+		return;
+	    }
+	}
+	files_.add(new Watched())->file_ = file;
+    }
+
+    bool isEmpty() const                { return files_.isEmpty(); }
+
+#if JUCE_LINUX
+    // compile is called on our thread, onReload(file, commands) after each
+    // version that changed any commands
+    bool start(const Compiler& compile, std::function<void(const File&, int)> onReload)
+    {
+	if (isThreadRunning() || files_.isEmpty())
+	{
+	    return isThreadRunning();
+	}
+	inotify_ = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (inotify_ < 0 || ::pipe(wakePipe_) < 0)
+	{
+	    close();
+	    return false;
+	}
+
+	compile_ = compile;
+	onReload_ = onReload;
+	for (auto* watched : files_)
+	{
+	    // the directory, since saving often renames a new file over the old one
+	    watched->dir_ = ::inotify_add_watch(inotify_, watched->file_.getParentDirectory().getFullPathName().toRawUTF8(),
+						IN_CLOSE_WRITE | IN_MOVED_TO);
+	    CommandScript script;
+	    compile_(watched->file_, script);
+	    watched->commands_ = describe(script);
+	}
+	startThread();
+	return true;
+    }
+
+    void stop()
+    {
+	if (isThreadRunning())
+	{
+	    signalThreadShouldExit();
+	    const char wake = 0;
+	    (void) ::write(wakePipe_[1], &wake, 1);
+	    stopThread(1000);
+	}
+	close();
+    }
+#else
+    bool start(const Compiler&, std::function<void(const File&, int)>)  { return false; }
+    void stop()                         {}
+#endif
+
+private:
+    struct Watched
+    {
+	File file_;
+	int dir_ = -1;
+	StringArray commands_;          // the last version's, one string per command
+	bool changed_ = false;
+    };
+
+    static StringArray describe(const CommandScript& script)
+    {
+	StringArray commands;
+	script.forEach([&commands] (int command, const StringArray& opts) { commands.add(String(command) + ":" + opts.joinIntoString("\x01")); });
+	return commands;
+    }
+
+    // compiles the file again and queues what's new since the last version
+    void reload(Watched& watched)
+    {
+	CommandScript script;
+	compile_(watched.file_, script);
+	StringArray previous = watched.commands_;
+	CommandScript changes;
+	script.forEach([&previous, &changes] (int command, const StringArray& opts)
+		       {
+			   const int index = previous.indexOf(String(command) + ":" + opts.joinIntoString("\x01"));
+			   if (index >= 0)
+			   {
+			       previous.remove(index);
+			   }
+			   else
+			   {
+			       changes.add(command, opts);
+			   }
+		       });
+	watched.commands_ = describe(script);
+	if (changes.getNumCommands() > 0)
+	{
+	    commands_.add(changes);
+	    onReload_(watched.file_, changes.getNumCommands());
+	}
+    }
+
+#if JUCE_LINUX
+    void close()
+    {
+	for (auto* fd : { &inotify_, &wakePipe_[0], &wakePipe_[1] })
+	{
+	    if (*fd >= 0)
+	    {
+		::close(*fd);
+		*fd = -1;
+	    }
+	}
+    }
+
+    void run() override
+    {
+	struct pollfd fds[2] = { { inotify_, POLLIN, 0 }, { wakePipe_[0], POLLIN, 0 } };
+	alignas(struct inotify_event) char buffer[4096];
+	while (!threadShouldExit())
+	{
+	    if (::poll(fds, 2, -1) < 0 && errno != EINTR)
+	    {
+		break;
+	    }
+	    if (fds[1].revents != 0)
+	    {
+		break;
+	    }
+
+	    // a save is often several events, the file's reloaded once for them
+	    ssize_t size;
+	    while ((size = ::read(inotify_, buffer, sizeof(buffer))) > 0)
+	    {
+		for (char* at = buffer; at < buffer + size; )
+		{
+		    const struct inotify_event* event = reinterpret_cast<const struct inotify_event*>(at);
+		    for (auto* watched : files_)
+		    {
+			if (event->wd == watched->dir_ && event->len > 0 && watched->file_.getFileName() == String::fromUTF8(event->name))
+			{
+			    watched->changed_ = true;
+			}
+		    }
+		    at += sizeof(struct inotify_event) + event->len;
+		}
+	    }
+	    for (auto* watched : files_)
+	    {
+		if (watched->changed_)
+		{
+		    watched->changed_ = false;
+		    reload(*watched);
+		}
+	    }
+	}
+    }
+
+    int inotify_ = -1;
+    int wakePipe_[2] = { -1, -1 };
+#endif
+
+    RuntimeCommands& commands_;
+    OwnedArray<Watched> files_;
+    Compiler compile_;
+    std::function<void(const File&, int)> onReload_;
+
+    JUCE_DECLARE_NON_COPYABLE(ProgramFileWatcher)
+};
@@ -0,0 +1,169 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include <atomic>
+
+//==============================================================================
+// A value one thread keeps changing and any thread may read, published the
+// RCU way. The writer fills in a fresh block, a copy of the current one,
+// and makes it current with a single atomic pointer store. A reader takes
+// whatever pointer is current and reads that block, which stays as it is
+// for as long as the reader holds it. Neither side locks or waits on the
+// other.
+//
+// Blocks are reused once no reader can still be looking at them, which is
+// decided by epochs. Each publish advances the epoch, and the block it
+// replaced is retired at the new one. A reader announces the epoch it saw in
+// a slot of its own before it loads the pointer. A retired block is free once
+// every announced epoch is at least its own, because a reader that saw that
+// epoch can only have loaded a newer pointer. The blocks are allocated up
+// front. If readers are holding all the others, the writer skips the publish
+// and the next one carries the change.
+//
+// One writer thread; any number of readers, up to maxReaders at once.
+template <typename State, int numBlocks = 8>
+class RcuSnapshot
+{
+public:
+    static const int maxReaders = 16;
+
+    RcuSnapshot()
+    {
+	for (auto& slot : readers_)
+	{
+	    slot.store(0, std::memory_order_relaxed);
+	}
+	for (int i = 0; i < numBlocks; ++i)
+	{
+	    retiredAt_[i] = 0;
+	}
+	current_.store(&blocks_[0], std::memory_order_relaxed);
+    }
+
+    // A pinned view of the current block, good until the scope ends. Only
+    // fails, with isValid() false, if maxReaders are reading already.
+    class ReadScope
+    {
+    public:
+	explicit ReadScope(const RcuSnapshot& owner)
+	    : owner_(owner)
+	{
+	    for (int i = 0; i < maxReaders && state_ == nullptr; ++i)
+	    {
+		uint64 idle = 0;
+		const uint64 epoch = owner.epoch_.load(std::memory_order_seq_cst);
+		if (owner.readers_[i].compare_exchange_strong(idle, epoch + 1, std::memory_order_seq_cst))
+		{
+		    slot_ = i;
+		    state_ = owner.current_.load(std::memory_order_seq_cst);
+		}
+	    }
+	}
+
+	~ReadScope()
+	{
+	    if (slot_ >= 0)
+	    {
+		owner_.readers_[slot_].store(0, std::memory_order_release);
+	    }
+	}
+
+	bool isValid() const                    { return state_ != nullptr; }
+	const State& operator*() const          { return *state_; }
+	const State* operator->() const         { return state_; }
+
+    private:
+	const RcuSnapshot& owner_;
+	const State* state_ = nullptr;
+	int slot_ = -1;
+
+	JUCE_DECLARE_NON_COPYABLE(ReadScope)
+    };
+
+    // writer: the block being filled in, nullptr if none is free; a copy of
+    // the current state, so only what changed needs to be set
+    State* edit()
+    {
+	const State* current = current_.load(std::memory_order_relaxed);
+	const uint64 oldest = getOldestReader();
+	for (int i = 0; i < numBlocks; ++i)
+	{
+	    if (&blocks_[i] != current && retiredAt_[i] <= oldest)
+	    {
+		editing_ = i;
+		blocks_[i] = *current;
+		return &blocks_[i];
+	    }
+	}
+	++numSkipped_;
+	return nullptr;
+    }
+
+    // writer: the block from edit() is current from now on
+    void publish()
+    {
+	jassert(editing_ >= 0);
+	State* old = current_.load(std::memory_order_relaxed);
+	current_.store(&blocks_[editing_], std::memory_order_seq_cst);
+	const uint64 epoch = epoch_.fetch_add(1, std::memory_order_seq_cst) + 1;
+	retiredAt_[old - blocks_] = epoch;
+	editing_ = -1;
+	++numPublished_;
+    }
+
+    // writer: the block from edit() wasn't needed after all
+    void abandon()                  { editing_ = -1; }
+
+    // writer's reads of the current state, needing no pin
+    const State& getCurrent() const     { return *current_.load(std::memory_order_relaxed); }
+
+    int64 getNumPublished() const   { return numPublished_; }
+    int64 getNumSkipped() const     { return numSkipped_; }
+
+private:
+    // the lowest epoch a reader has announced; one that's at least every
+    // retired block's if nobody is reading
+    uint64 getOldestReader() const
+    {
+	uint64 oldest = ~(uint64) 0;
+	for (const auto& slot : readers_)
+	{
+	    const uint64 announced = slot.load(std::memory_order_seq_cst);
+	    if (announced != 0)
+	    {
+		oldest = jmin(oldest, announced - 1);
+	    }
+	}
+	return oldest;
+    }
+
+    State blocks_[numBlocks];
+    uint64 retiredAt_[numBlocks];           // the epoch each was replaced at
+    std::atomic<State*> current_;
+    std::atomic<uint64> epoch_ { 0 };
+    mutable std::atomic<uint64> readers_[maxReaders];   // announced epoch + 1, 0 for a free slot
+    int editing_ = -1;
+    int64 numPublished_ = 0;
+    int64 numSkipped_ = 0;
+
+    JUCE_DECLARE_NON_COPYABLE(RcuSnapshot)
+};
@@ -0,0 +1,110 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "OscPacket.h"
+
+//==============================================================================
+// Connected senders for answering /loop4r queries, one per host and port,
+// so a client polling several times a second reuses one socket instead of
+// having one made and torn down per request. When the pool is full the least
+// recently used sender is dropped, and expire() drops any that have been idle
+// for idleMs. Replies are encoded by the caller (into scratch space) and sent
+// as they are. Only the control thread uses this.
+class ReplySenderPool
+{
+public:
+    static const int maxSenders = 8;
+    static const int idleMs = 30000;
+
+    ReplySenderPool() {}
+
+    // nullptr if we can't connect; finding one already connected takes
+    // nothing from the heap
+    OscPacketSender* get(const char* host, int port)
+    {
+	const uint32 now = Time::getMillisecondCounter();
+	for (auto* entry : entries_)
+	{
+	    if (entry->port_ == port && entry->host_ == host)
+	    {
+		entry->lastUsed_ = now;
+		return &entry->sender_;
+	    }
+	}
+
+	ScopedPointer<Entry> entry(new Entry());
+	if (!entry->sender_.connect(String::fromUTF8(host), port))
+	{
+	    return nullptr;
+	}
+	entry->host_ = String::fromUTF8(host);
+	entry->port_ = port;
+	entry->lastUsed_ = now;
+
+	if (entries_.size() >= maxSenders)
+	{
+	    int oldest = 0;
+	    for (int i = 1; i < entries_.size(); ++i)
+	    {
+		if ((int) (entries_[oldest]->lastUsed_ - entries_[i]->lastUsed_) > 0)
+		{
+		    oldest = i;
+		}
+	    }
+	    entries_.remove(oldest);
+	    ++numEvicted_;
+	}
+	++numConnects_;
+	return &entries_.add(entry.release())->sender_;
+    }
+
+    void expire()
+    {
+	const uint32 now = Time::getMillisecondCounter();
+	for (int i = entries_.size(); --i >= 0;)
+	{
+	    if ((int) (now - entries_[i]->lastUsed_) > idleMs)
+	    {
+		entries_.remove(i);
+	    }
+	}
+    }
+
+    void clear()                        { entries_.clear(); }
+    int size() const                    { return entries_.size(); }
+    int64 getNumConnects() const        { return numConnects_; }
+    int64 getNumEvicted() const         { return numEvicted_; }
+
+private:
+    struct Entry
+    {
+	String host_;
+	int port_ = 0;
+	uint32 lastUsed_ = 0;
+	OscPacketSender sender_;
+    };
+
+    OwnedArray<Entry> entries_;
+    int64 numConnects_ = 0;
+    int64 numEvicted_ = 0;
+
+    JUCE_DECLARE_NON_COPYABLE(ReplySenderPool)
+};
@@ -0,0 +1,822 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "AlsaRawMidi.h"
+#include <atomic>
+#include <cstring>
+
+#if JUCE_LINUX
+ #include <cerrno>
+ #include <fcntl.h>
+ #include <unistd.h>
+ #include <arpa/inet.h>
+ #include <netinet/in.h>
+ #include <sys/socket.h>
+ #include <sys/timerfd.h>
+#endif
+
+//==============================================================================
+// The receiving end of RTP-MIDI (RFC 6295), as the AppleMIDI sessions of
+// macOS, iOS and rtpMIDI send it, without the sockets: packets in, MIDI
+// messages out in order, each when its turn comes.
+//
+// Packets wait in a jitter buffer to be played out at their sender's
+// timestamp plus the quickest transit of the last few plus a delay. The
+// delay follows the interarrival jitter (RFC 3550's estimate, three times
+// over, and at least 2ms), up to the most latency we were given to spend.
+// The buffer goes by sequence number, so packets that come in out of order
+// go out in order. A packet still missing when the one after it is due is
+// given up for lost, and the one after's recovery journal puts back what it
+// carried: the controllers' values (chapter C) and the notes' on or off
+// (chapter N) that don't match what we passed on. The journal has the state,
+// not the history, so a pedal pressed and let go in a lost packet only comes
+// back if its value changed.
+//
+// Times are the session clock's 10kHz units on our clock. One thread only.
+class RtpMidiReceiver
+{
+public:
+    static const int maxPackets = 32;
+    static const int maxCommands = 16;      // of a packet, the rest are dropped
+    static const int maxRecoveries = 32;
+    static const int transitWindow = 64;
+    static const int unitsPerSecond = 10000;
+    static const int minDelay = 20;         // 2ms, for two packets sent back to back to swap places
+
+    struct Message
+    {
+	uint8 data_[3];
+	uint8 size_;
+	int64 time_;        // when it was sent, on our clock
+	bool recovered_;    // from a journal
+    };
+
+    RtpMidiReceiver()
+    {
+	reset();
+    }
+
+    // a new session
+    void reset()
+    {
+	for (auto& packet : packets_)
+	{
+	    packet.used_ = false;
+	}
+	numOut_ = nextOut_ = 0;
+	expected_ = -1;
+	lastSeq_ = lastTimestamp_ = -1;
+	numTransits_ = 0;
+	jitter_ = 0;
+	lastTransit_ = 0;
+	runningStatus_ = 0;
+	std::memset(controllers_, 0xff, sizeof(controllers_));
+	std::memset(notes_, 0, sizeof(notes_));
+    }
+
+    // the most latency the jitter buffer may add
+    void setMaxDelayMs(int ms)          { maxDelay_ = (int64) jmax(0, ms) * unitsPerSecond / 1000; }
+
+    // an RTP packet's bytes, come in at now
+    void receive(const uint8* data, int size, int64 now)
+    {
+	if (size < 13 || (data[0] & 0xc0) != 0x80)
+	{
+	    ++numMalformed_;
+	    return;
+	}
+	++numPackets_;
+	const int64 seq = extend(lastSeq_, (uint32) ((data[2] << 8) | data[3]), 16);
+	const int64 timestamp = extend(lastTimestamp_, readUint32(data + 4), 32);
+	lastSeq_ = jmax(lastSeq_, seq);
+	lastTimestamp_ = jmax(lastTimestamp_, timestamp);
+
+	// the delay goes by every packet's transit, late or not
+	const int64 transit = now - timestamp;
+	if (numTransits_ > 0)
+	{
+	    jitter_ += ((double) std::abs(transit - lastTransit_) - jitter_) / 16.0;
+	}
+	lastTransit_ = transit;
+	transits_[numTransits_++ % transitWindow] = transit;
+	int64 quickest = transit;
+	for (int i = 0; i < jmin(numTransits_, (int64) transitWindow); ++i)
+	{
+	    quickest = jmin(quickest, transits_[i]);
+	}
+
+	if (expected_ >= 0 && seq < expected_)
+	{
+	    ++numLate_;
+	    return;
+	}
+	Packet* free = nullptr;
+	for (auto& packet : packets_)
+	{
+	    if (packet.used_ && packet.seq_ == seq)
+	    {
+		++numDuplicates_;
+		return;
+	    }
+	    if (!packet.used_ && free == nullptr)
+	    {
+		free = &packet;
+	    }
+	}
+	if (free == nullptr)
+	{
+	    ++numOverflowed_;
+	    return;
+	}
+	if (seq < lastSeq_)
+	{
+	    ++numReordered_;
+	}
+
+	Packet& packet = *free;
+	packet.seq_ = seq;
+	packet.sent_ = timestamp + quickest;
+	packet.release_ = packet.sent_ + getDelay();
+	if (!parse(packet, data, size))
+	{
+	    ++numMalformed_;
+	    return;
+	}
+	packet.used_ = true;
+    }
+
+    // the next message due by now, false if there isn't one
+    bool next(int64 now, Message& message)
+    {
+	if (nextOut_ == numOut_)
+	{
+	    Packet* head = getHead();
+	    if (head == nullptr || now < head->release_)
+	    {
+		return false;
+	    }
+	    release(*head);
+	    if (nextOut_ == numOut_)
+	    {
+		return next(now, message);
+	    }
+	}
+	message = out_[nextOut_++];
+	return true;
+    }
+
+    // when next() has something again, 0 for not before another packet
+    int64 getNextDue() const
+    {
+	int64 due = 0;
+	for (auto& packet : packets_)
+	{
+	    if (packet.used_ && (due == 0 || packet.release_ < due))
+	    {
+		due = packet.release_;
+	    }
+	}
+	return due;
+    }
+
+    // what the buffer holds packets back by now
+    int64 getDelay() const              { return jmin(maxDelay_, jmax((int64) minDelay, (int64) (3.0 * jitter_))); }
+    double getJitterMs() const          { return jitter_ * 1000.0 / unitsPerSecond; }
+
+    // the highest sequence number passed on, for the receiver feedback
+    int64 getLastReleased() const       { return expected_ - 1; }
+
+    int64 getNumPackets() const         { return numPackets_; }
+    int64 getNumLost() const            { return numLost_; }
+    int64 getNumRecovered() const       { return numRecovered_; }
+    int64 getNumLate() const            { return numLate_; }
+    int64 getNumReordered() const       { return numReordered_; }
+    int64 getNumDuplicates() const      { return numDuplicates_; }
+    int64 getNumOverflowed() const      { return numOverflowed_; }
+    int64 getNumMalformed() const       { return numMalformed_; }
+
+private:
+    struct Command
+    {
+	uint8 data_[3];
+	uint8 size_;
+	int64 delta_;       // from the packet's timestamp
+    };
+
+    struct Packet
+    {
+	bool used_ = false;
+	int64 seq_ = 0;
+	int64 sent_ = 0;
+	int64 release_ = 0;
+	int numCommands_ = 0;
+	Command commands_[maxCommands];
+	int numJournal_ = 0;
+	Command journal_[maxRecoveries];    // the state it says the stream is in
+    };
+
+    static uint32 readUint32(const uint8* data)
+    {
+	return ((uint32) data[0] << 24) | ((uint32) data[1] << 16) | ((uint32) data[2] << 8) | (uint32) data[3];
+    }
+
+    // a wrapping counter taken on from the highest so far
+    static int64 extend(int64 last, uint32 value, int bits)
+    {
+	if (last < 0)
+	{
+	    return (int64) value;
+	}
+	const int64 range = (int64) 1 << bits;
+	int64 diff = ((int64) value - last) % range;
+	if (diff < 0)
+	{
+	    diff += range;
+	}
+	if (diff >= range / 2)
+	{
+	    diff -= range;
+	}
+	return last + diff;
+    }
+
+    // the MIDI command section and, if there is one, the recovery journal
+    bool parse(Packet& packet, const uint8* data, int size)
+    {
+	packet.numCommands_ = packet.numJournal_ = 0;
+	int pos = 12;
+	const uint8 flags = data[pos++];
+	int length = flags & 0x0f;
+	if ((flags & 0x80) != 0)
+	{
+	    if (pos >= size)
+	    {
+		return false;
+	    }
+	    length = (length << 8) | data[pos++];
+	}
+	const int end = pos + length;
+	if (end > size)
+	{
+	    return false;
+	}
+
+	int64 delta = 0;
+	bool first = true;
+	while (pos < end)
+	{
+	    if (!first || (flags & 0x20) != 0)
+	    {
+		int64 value = 0;
+		for (int i = 0; i < 4 && pos < end; ++i)
+		{
+		    const uint8 byte = data[pos++];
+		    value = (value << 7) | (byte & 0x7f);
+		    if ((byte & 0x80) == 0)
+		    {
+			break;
+		    }
+		}
+		delta += value;
+	    }
+	    first = false;
+	    if (pos >= end)
+	    {
+		break;
+	    }
+
+	    uint8 status = runningStatus_;
+	    if ((data[pos] & 0x80) != 0)
+	    {
+		status = data[pos++];
+		if (status == 0xf0 || status == 0xf7)
+		{
+		    // sysex, or a segment of one: skipped to its end
+		    while (pos < end && data[pos] != 0xf7 && data[pos] != 0xf0 && data[pos] != 0xf4)
+		    {
+			++pos;
+		    }
+		    ++pos;
+		    continue;
+		}
+		if (status < 0xf0)
+		{
+		    runningStatus_ = status;
+		}
+		else if (status < 0xf8)
+		{
+		    runningStatus_ = 0;
+		}
+	    }
+	    if (status == 0)
+	    {
+		return false;
+	    }
+	    const int numData = status >= 0xf8 ? 0 : RunningStatusDecoder::getNumDataBytes(status);
+	    if (pos + numData > end)
+	    {
+		return false;
+	    }
+	    if (packet.numCommands_ < maxCommands)
+	    {
+		Command& command = packet.commands_[packet.numCommands_++];
+		command.data_[0] = status;
+		command.data_[1] = numData > 0 ? data[pos] : 0;
+		command.data_[2] = numData > 1 ? data[pos + 1] : 0;
+		command.size_ = (uint8) (numData + 1);
+		command.delta_ = delta;
+	    }
+	    pos += numData;
+	}
+	if ((flags & 0x40) != 0)
+	{
+	    parseJournal(packet, data + end, size - end);
+	}
+	return true;
+    }
+
+    void addJournal(Packet& packet, uint8 status, uint8 number, uint8 value)
+    {
+	if (packet.numJournal_ < maxRecoveries)
+	{
+	    Command& entry = packet.journal_[packet.numJournal_++];
+	    entry.data_[0] = status;
+	    entry.data_[1] = number;
+	    entry.data_[2] = value;
+	    entry.size_ = 3;
+	    entry.delta_ = 0;
+	}
+    }
+
+    // chapters C and N of each channel journal, the rest are skipped over
+    void parseJournal(Packet& packet, const uint8* data, int size)
+    {
+	if (size < 3)
+	{
+	    return;
+	}
+	const uint8 header = data[0];
+	int pos = 3;
+	if ((header & 0x40) != 0 && pos + 2 <= size)
+	{
+	    pos += ((data[pos] & 0x03) << 8) | data[pos + 1];
+	}
+	if ((header & 0x20) == 0)
+	{
+	    return;
+	}
+	const int numChannels = (header & 0x0f) + 1;
+	for (int c = 0; c < numChannels && pos + 3 <= size; ++c)
+	{
+	    const int channel = (data[pos] >> 3) & 0x0f;
+	    const int length = ((data[pos] & 0x03) << 8) | data[pos + 1];
+	    const uint8 chapters = data[pos + 2];
+	    const int end = jmin(size, pos + length);
+	    if (length < 3)
+	    {
+		return;
+	    }
+	    int q = pos + 3;
+	    if ((chapters & 0x80) != 0)
+	    {
+		q += 3;
+	    }
+	    if ((chapters & 0x40) != 0 && q < end)
+	    {
+		const int numControllers = (data[q++] & 0x7f) + 1;
+		for (int i = 0; i < numControllers && q + 2 <= end; ++i, q += 2)
+		{
+		    // with A set the value is a toggle count, not one to send
+		    if ((data[q + 1] & 0x80) == 0)
+		    {
+			addJournal(packet, (uint8) (0xb0 | channel), data[q] & 0x7f, data[q + 1] & 0x7f);
+		    }
+		}
+	    }
+	    if ((chapters & 0x20) != 0 && q + 2 <= end)
+	    {
+		q += jmax(2, ((data[q] & 0x03) << 8) | data[q + 1]);
+	    }
+	    if ((chapters & 0x10) != 0)
+	    {
+		q += 2;
+	    }
+	    if ((chapters & 0x08) != 0 && q + 2 <= end)
+	    {
+		const int logs = data[q] & 0x7f;
+		const int low = data[q + 1] >> 4;
+		const int high = data[q + 1] & 0x0f;
+		const bool allLogs = logs == 127 && low == 15 && high == 0;
+		q += 2;
+		for (int i = 0; i < (allLogs ? 128 : logs) && q + 2 <= end; ++i, q += 2)
+		{
+		    if ((data[q + 1] & 0x7f) != 0)
+		    {
+			addJournal(packet, (uint8) (0x90 | channel), data[q] & 0x7f, data[q + 1] & 0x7f);
+		    }
+		}
+		for (int octet = low; !allLogs && octet <= high && q < end; ++octet, ++q)
+		{
+		    for (int bit = 0; bit < 8; ++bit)
+		    {
+			if ((data[q] & (0x80 >> bit)) != 0)
+			{
+			    addJournal(packet, (uint8) (0x80 | channel), (uint8) (octet * 8 + bit), 0);
+			}
+		    }
+		}
+	    }
+	    pos += length;
+	}
+    }
+
+    Packet* getHead()
+    {
+	Packet* head = nullptr;
+	for (auto& packet : packets_)
+	{
+	    if (packet.used_ && (head == nullptr || packet.seq_ < head->seq_))
+	    {
+		head = &packet;
+	    }
+	}
+	return head;
+    }
+
+    // its messages to out_, after what its journal puts back if packets
+    // before it went missing
+    void release(Packet& packet)
+    {
+	numOut_ = nextOut_ = 0;
+	if (expected_ >= 0 && packet.seq_ > expected_)
+	{
+	    numLost_ += packet.seq_ - expected_;
+	    for (int i = 0; i < packet.numJournal_; ++i)
+	    {
+		const Command& entry = packet.journal_[i];
+		const int channel = entry.data_[0] & 0x0f;
+		const int number = entry.data_[1];
+		const bool differs = (entry.data_[0] & 0xf0) == 0xb0 ? controllers_[channel][number] != (int8) entry.data_[2]
+		    : ((entry.data_[0] & 0xf0) == 0x90) != notes_[channel][number];
+		if (differs)
+		{
+		    addOut(entry, packet.sent_, true);
+		    ++numRecovered_;
+		}
+	    }
+	}
+	for (int i = 0; i < packet.numCommands_; ++i)
+	{
+	    addOut(packet.commands_[i], packet.sent_ + packet.commands_[i].delta_, false);
+	}
+	expected_ = packet.seq_ + 1;
+	packet.used_ = false;
+    }
+
+    void addOut(const Command& command, int64 time, bool recovered)
+    {
+	Message& message = out_[numOut_++];
+	std::memcpy(message.data_, command.data_, sizeof(message.data_));
+	message.size_ = command.size_;
+	message.time_ = time;
+	message.recovered_ = recovered;
+
+	const uint8 status = command.data_[0] & 0xf0;
+	const int channel = command.data_[0] & 0x0f;
+	if (command.size_ == 3 && status == 0xb0)
+	{
+	    controllers_[channel][command.data_[1]] = (int8) command.data_[2];
+	}
+	else if (command.size_ == 3 && (status == 0x90 || status == 0x80))
+	{
+	    notes_[channel][command.data_[1]] = status == 0x90 && command.data_[2] != 0;
+	}
+    }
+
+    Packet packets_[maxPackets];
+    Message out_[maxCommands + maxRecoveries];
+    int numOut_ = 0;
+    int nextOut_ = 0;
+    int64 expected_ = -1;       // the sequence number to release next, -1 before the first
+    int64 lastSeq_ = -1;
+    int64 lastTimestamp_ = -1;
+    int64 transits_[transitWindow];
+    int64 numTransits_ = 0;
+    int64 lastTransit_ = 0;
+    double jitter_ = 0;
+    int64 maxDelay_ = 100;      // 10ms
+    uint8 runningStatus_ = 0;   // carried over for a packet's phantom first status
+    int8 controllers_[16][128]; // the values passed on, -1 for none yet
+    bool notes_[16][128];
+
+    int64 numPackets_ = 0;
+    int64 numLost_ = 0;
+    int64 numRecovered_ = 0;
+    int64 numLate_ = 0;
+    int64 numReordered_ = 0;
+    int64 numDuplicates_ = 0;
+    int64 numOverflowed_ = 0;
+    int64 numMalformed_ = 0;
+
+    JUCE_DECLARE_NON_COPYABLE(RtpMidiReceiver)
+};
+
+//==============================================================================
+// An AppleMIDI session we take part in as the one invited: a pedalboard or
+// an iPad on the network connects to the control port and the data port
+// after it, and what it plays comes through an RtpMidiReceiver and out as
+// this input's messages, stamped with when they were sent. We answer
+// invitations and clock syncs and send receiver feedback every second, so
+// the sender can trim its journal. A timerfd among the file descriptors
+// wakes the reader when the jitter buffer has something due.
+class RtpMidiInput : public ByteStreamMidiInput
+{
+public:
+    static const int feedbackIntervalMs = 1000;
+
+    RtpMidiInput()
+	: ByteStreamMidiInput("loop4r rtp midi")
+    {
+    }
+
+    ~RtpMidiInput()
+    {
+	close();
+    }
+
+    // before open()
+    void setMaxDelayMs(int ms)          { maxDelayMs_ = ms; }
+    int getMaxDelayMs() const           { return maxDelayMs_; }
+
+#if JUCE_LINUX
+    // device is the control port's number, e.g. "5004"
+    bool open(const String& device) override
+    {
+	close();
+	const int port = device.getIntValue();
+	if (port <= 0 || port >= 65535)
+	{
+	    return false;
+	}
+	control_ = bindSocket(port);
+	data_ = bindSocket(port + 1);
+	timer_ = ::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (control_ < 0 || data_ < 0 || timer_ < 0)
+	{
+	    closeDevice();
+	    return false;
+	}
+	receiver_.reset();
+	receiver_.setMaxDelayMs(maxDelayMs_);
+	ssrc_ = (uint32) Random::getSystemRandom().nextInt();
+	hasControlPeer_ = false;
+	opened();
+	return true;
+    }
+
+    Array<int> getFileDescriptors() const override
+    {
+	Array<int> fds;
+	if (isOpen())
+	{
+	    fds.add(control_);
+	    fds.add(data_);
+	    fds.add(timer_);
+	}
+	return fds;
+    }
+#else
+    bool open(const String&) override   { return false; }
+    Array<int> getFileDescriptors() const override  { return {}; }
+#endif
+
+    bool isOpen() const override        { return control_ >= 0; }
+
+    // copied from the reading thread after each read
+    int64 getNumPackets() const         { return numPackets_.load(); }
+    int64 getNumLost() const            { return numLost_.load(); }
+    int64 getNumRecovered() const       { return numRecovered_.load(); }
+    int64 getNumLate() const            { return numLate_.load(); }
+    int64 getNumReordered() const       { return numReordered_.load(); }
+    double getJitterMs() const          { return jitterMs_.load(); }
+    int64 getNumSessions() const        { return numSessions_.load(); }
+
+private:
+    static int64 toUnits(int64 ticks)
+    {
+	return (int64) ((double) ticks * RtpMidiReceiver::unitsPerSecond / (double) Time::getHighResolutionTicksPerSecond());
+    }
+
+    static int64 toTicks(int64 units)
+    {
+	return (int64) ((double) units * (double) Time::getHighResolutionTicksPerSecond() / RtpMidiReceiver::unitsPerSecond);
+    }
+
+#if JUCE_LINUX
+    static int bindSocket(int port)
+    {
+	const int fd = ::socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+	{
+	    return -1;
+	}
+	struct sockaddr_in address = {};
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_ANY);
+	address.sin_port = htons((uint16) port);
+	if (::bind(fd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) < 0)
+	{
+	    ::close(fd);
+	    return -1;
+	}
+	return fd;
+    }
+
+    int readBytes(uint8* buffer, int size) override
+    {
+	const int64 now = Time::getHighResolutionTicks();
+	RtpMidiReceiver::Message message;
+	if (!receiver_.next(toUnits(now), message))
+	{
+	    service(now);
+	    if (!receiver_.next(toUnits(now), message))
+	    {
+		armTimer(now);
+		streamTicks_ = 0;
+		return 0;
+	    }
+	}
+	const int count = jmin(size, (int) message.size_);
+	std::memcpy(buffer, message.data_, (size_t) count);
+	streamTicks_ = jmin(now, toTicks(message.time_));
+	return count;
+    }
+
+    // everything on the sockets, and the timer's expiry out of the way
+    void service(int64 now)
+    {
+	uint64 expirations;
+	if (::read(timer_, &expirations, sizeof(expirations)) < 0)
+	{
+	    // not expired, nothing to clear
+	}
+	for (const int fd : { control_, data_ })
+	{
+	    for (;;)
+	    {
+		struct sockaddr_in from = {};
+		socklen_t fromSize = sizeof(from);
+		const ssize_t count = ::recvfrom(fd, packet_, sizeof(packet_), 0, reinterpret_cast<struct sockaddr*>(&from), &fromSize);
+		if (count <= 0)
+		{
+		    break;
+		}
+		handlePacket(fd, packet_, (int) count, from, now);
+	    }
+	}
+
+	const uint32 ms = Time::getMillisecondCounter();
+	if (hasControlPeer_ && receiver_.getLastReleased() >= 0 && (int) (ms - feedbackAt_) >= feedbackIntervalMs)
+	{
+	    feedbackAt_ = ms;
+	    uint8 feedback[12] = { 0xff, 0xff, 'R', 'S' };
+	    writeUint32(feedback + 4, ssrc_);
+	    writeUint32(feedback + 8, (uint32) (receiver_.getLastReleased() & 0xffff) << 16);
+	    ::sendto(control_, feedback, sizeof(feedback), 0, reinterpret_cast<const struct sockaddr*>(&controlPeer_), sizeof(controlPeer_));
+	}
+
+	numPackets_ = receiver_.getNumPackets();
+	numLost_ = receiver_.getNumLost();
+	numRecovered_ = receiver_.getNumRecovered();
+	numLate_ = receiver_.getNumLate();
+	numReordered_ = receiver_.getNumReordered();
+	jitterMs_ = receiver_.getJitterMs();
+    }
+
+    void handlePacket(int fd, const uint8* data, int size, const struct sockaddr_in& from, int64 now)
+    {
+	if (size >= 4 && data[0] == 0xff && data[1] == 0xff)
+	{
+	    handleSessionPacket(fd, data, size, from, now);
+	}
+	else if (fd == data_)
+	{
+	    receiver_.receive(data, size, toUnits(now));
+	}
+    }
+
+    // AppleMIDI's own: invitations, clock syncs and goodbyes
+    void handleSessionPacket(int fd, const uint8* data, int size, const struct sockaddr_in& from, int64 now)
+    {
+	if (data[2] == 'I' && data[3] == 'N' && size >= 16)
+	{
+	    if (fd == control_)
+	    {
+		// a new session, or the same one again
+		receiver_.reset();
+		controlPeer_ = from;
+		hasControlPeer_ = true;
+		++numSessions_;
+	    }
+	    static const char name[] = "loop4r_read";
+	    uint8 reply[16 + sizeof(name)] = { 0xff, 0xff, 'O', 'K', 0, 0, 0, 2 };
+	    std::memcpy(reply + 8, data + 8, 4);
+	    writeUint32(reply + 12, ssrc_);
+	    std::memcpy(reply + 16, name, sizeof(name));
+	    ::sendto(fd, reply, sizeof(reply), 0, reinterpret_cast<const struct sockaddr*>(&from), sizeof(from));
+	}
+	else if (data[2] == 'B' && data[3] == 'Y')
+	{
+	    receiver_.reset();
+	    hasControlPeer_ = false;
+	}
+	else if (data[2] == 'C' && data[3] == 'K' && size >= 36 && data[8] == 0)
+	{
+	    uint8 reply[36];
+	    std::memcpy(reply, data, sizeof(reply));
+	    writeUint32(reply + 4, ssrc_);
+	    reply[8] = 1;
+	    const int64 units = toUnits(now);
+	    writeUint32(reply + 20, (uint32) (units >> 32));
+	    writeUint32(reply + 24, (uint32) units);
+	    ::sendto(fd, reply, sizeof(reply), 0, reinterpret_cast<const struct sockaddr*>(&from), sizeof(from));
+	}
+    }
+
+    static void writeUint32(uint8* data, uint32 value)
+    {
+	data[0] = (uint8) (value >> 24);
+	data[1] = (uint8) (value >> 16);
+	data[2] = (uint8) (value >> 8);
+	data[3] = (uint8) value;
+    }
+
+    // to go off when the jitter buffer next has something due
+    void armTimer(int64 now)
+    {
+	struct itimerspec spec = {};
+	const int64 due = receiver_.getNextDue();
+	if (due != 0)
+	{
+	    const int64 nanos = jmax((int64) 1, (int64) (Time::highResolutionTicksToSeconds(toTicks(due) - now) * 1.0e9));
+	    spec.it_value.tv_sec = (time_t) (nanos / 1000000000);
+	    spec.it_value.tv_nsec = (long) (nanos % 1000000000);
+	}
+	::timerfd_settime(timer_, 0, &spec, nullptr);
+    }
+
+    void closeDevice() override
+    {
+	for (int* fd : { &control_, &data_, &timer_ })
+	{
+	    if (*fd >= 0)
+	    {
+		::close(*fd);
+		*fd = -1;
+	    }
+	}
+    }
+
+    uint8 packet_[1500];
+    struct sockaddr_in controlPeer_ = {};
+#else
+    int readBytes(uint8*, int) override { return 0; }
+    void closeDevice() override         {}
+#endif
+
+    RtpMidiReceiver receiver_;
+    int control_ = -1;
+    int data_ = -1;
+    int timer_ = -1;
+    int maxDelayMs_ = 10;
+    uint32 ssrc_ = 0;
+    bool hasControlPeer_ = false;
+    uint32 feedbackAt_ = 0;
+    std::atomic<int64> numPackets_ { 0 };
+    std::atomic<int64> numLost_ { 0 };
+    std::atomic<int64> numRecovered_ { 0 };
+    std::atomic<int64> numLate_ { 0 };
+    std::atomic<int64> numReordered_ { 0 };
+    std::atomic<double> jitterMs_ { 0 };
+    std::atomic<int64> numSessions_ { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE(RtpMidiInput)
+};
@@ -0,0 +1,246 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "CommandScript.h"
+#include <atomic>
+#include <functional>
+#include <string>
+
+#if JUCE_LINUX
+ #include <cerrno>
+ #include <poll.h>
+ #include <sys/stat.h>
+ #include <unistd.h>
+#endif
+
+//==============================================================================
+// Commands given while we're running, from standard input or /loop4r/cmd.
+// They wait here for the control thread, which runs them at the start of a
+// pass, so a change is either all there or not yet there for the pedal and
+// OSC handling around it.
+class RuntimeCommands
+{
+public:
+    static const int line = -1;         // the one option is a line to parse
+    static const int parameters = -2;   // the options are the parameters, already split
+
+    RuntimeCommands() {}
+
+    void add(int command, const StringArray& opts)
+    {
+	const SpinLock::ScopedLockType lock(lock_);
+	pending_.add({ command, opts });
+	hasPending_.store(true, std::memory_order_release);
+    }
+
+    void addLine(const String& text)
+    {
+	add(line, StringArray(text));
+    }
+
+    // every command in the script, which the control thread then sees all at once
+    void add(const CommandScript& script)
+    {
+	const SpinLock::ScopedLockType lock(lock_);
+	script.forEach([this] (int command, const StringArray& opts) { pending_.add({ command, opts }); });
+	hasPending_.store(true, std::memory_order_release);
+    }
+
+    bool hasPending() const             { return hasPending_.load(std::memory_order_acquire); }
+
+    // calls run(command, opts) for each command in the order they came
+    template <typename Function>
+    void run(Function&& run)
+    {
+	Array<Command> commands;
+	{
+	    const SpinLock::ScopedLockType lock(lock_);
+	    commands.swapWith(pending_);
+	    hasPending_.store(false, std::memory_order_relaxed);
+	}
+	for (auto&& command : commands)
+	{
+	    run(command.command_, command.opts_);
+	}
+    }
+
+private:
+    struct Command
+    {
+	int command_;
+	StringArray opts_;
+    };
+
+    SpinLock lock_;
+    Array<Command> pending_;
+    std::atomic<bool> hasPending_ { false };
+
+    JUCE_DECLARE_NON_COPYABLE(RuntimeCommands)
+};
+
+//==============================================================================
+// Reads "--" lines or "--framed" frames from standard input on its own
+// thread, so a terminal or a pipe that stays open doesn't hold up starting,
+// and hands them to RuntimeCommands, calling onCommand after each lot.
+class StdinCommandReader : private Thread
+{
+public:
+    StdinCommandReader(RuntimeCommands& commands) : Thread("loop4r stdin"), commands_(commands) {}
+
+    ~StdinCommandReader()
+    {
+	stop();
+    }
+
+#if JUCE_LINUX
+    bool start(bool framed, std::function<void()> onCommand)
+    {
+	if (isThreadRunning() || ::pipe(wakePipe_) < 0)
+	{
+	    return false;
+	}
+	framed_ = framed;
+	onCommand_ = onCommand;
+	startThread();
+	return true;
+    }
+
+    void stop()
+    {
+	if (isThreadRunning())
+	{
+	    signalThreadShouldExit();
+	    const char wake = 0;
+	    (void) ::write(wakePipe_[1], &wake, 1);
+	    stopThread(1000);
+	}
+	for (auto&& fd : wakePipe_)
+	{
+	    if (fd >= 0)
+	    {
+		::close(fd);
+		fd = -1;
+	    }
+	}
+    }
+#else
+    bool start(bool, std::function<void()>)     { return false; }
+    void stop()                         {}
+#endif
+
+    // whether standard input is a regular file, which can be read to the end
+    // straight away instead
+    static bool isFile()
+    {
+#if JUCE_LINUX
+	struct stat info;
+	return ::fstat(STDIN_FILENO, &info) == 0 && S_ISREG(info.st_mode);
+#else
+	return true;
+#endif
+    }
+
+private:
+#if JUCE_LINUX
+    void run() override
+    {
+	struct pollfd fds[2] = { { STDIN_FILENO, POLLIN, 0 }, { wakePipe_[0], POLLIN, 0 } };
+	std::string pending;
+	while (!threadShouldExit())
+	{
+	    if (::poll(fds, 2, -1) < 0)
+	    {
+		if (errno == EINTR)
+		{
+		    continue;
+		}
+		break;
+	    }
+	    if (fds[1].revents != 0)
+	    {
+		break;
+	    }
+
+	    char buffer[1024];
+	    const ssize_t size = ::read(STDIN_FILENO, buffer, sizeof(buffer));
+	    if (size < 0 && errno == EINTR)
+	    {
+		continue;
+	    }
+	    if (size > 0)
+	    {
+		pending.append(buffer, (size_t) size);
+	    }
+	    else if (!framed_)
+	    {
+		// the last line needn't have its newline
+		pending += '\n';
+	    }
+
+	    const bool garbage = framed_ ? !takeFrames(pending) : (takeLines(pending), false);
+	    onCommand_();
+	    if (size <= 0 || garbage)
+	    {
+		break;
+	    }
+	}
+    }
+
+    void takeLines(std::string& pending)
+    {
+	size_t end;
+	while ((end = pending.find('\n')) != std::string::npos)
+	{
+	    commands_.addLine(String(pending.c_str(), end));
+	    pending.erase(0, end + 1);
+	}
+    }
+
+    // false on a frame that doesn't decode, which is where "--framed" stops
+    bool takeFrames(std::string& pending)
+    {
+	int command;
+	StringArray opts;
+	for (;;)
+	{
+	    switch (CommandScript::takeFrame(pending, command, opts))
+	    {
+		case CommandScript::FrameRead:
+		    commands_.add(command, opts);
+		    break;
+		case CommandScript::FrameIncomplete:
+		    return true;
+		case CommandScript::FrameGarbage:
+		    return false;
+	    }
+	}
+    }
+
+    int wakePipe_[2] = { -1, -1 };
+#endif
+
+    RuntimeCommands& commands_;
+    bool framed_ = false;
+    std::function<void()> onCommand_;
+
+    JUCE_DECLARE_NON_COPYABLE(StdinCommandReader)
+};
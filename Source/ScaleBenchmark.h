@@ -0,0 +1,416 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "OscPacket.h"
+#include <atomic>
+#include <initializer_list>
+#include <ostream>
+
+#if JUCE_LINUX
+ #include <cerrno>
+ #include <csignal>
+ #include <cstdlib>
+ #include <cstring>
+ #include <fcntl.h>
+ #include <poll.h>
+ #include <spawn.h>
+ #include <sys/socket.h>
+ #include <sys/un.h>
+ #include <sys/wait.h>
+ #include <unistd.h>
+
+extern char** environ;
+#endif
+
+//==============================================================================
+// How the design scales ("scale"): for every point of loops x LED
+// subscribers x SooperLooper update interval, the simulator ("sim") and a
+// copy of us run as processes of their own, the way they would on the rig,
+// with pedals played into our serial input through a pty at a steady rate
+// and the subscribers registered on our OSC port from sockets here. The
+// pedals go to the simulator as OSC commands ("slcmd"), it has no MIDI.
+// After the copy says it's ready (its LEDs are right) the point is measured
+// for the given time: our CPU from /proc, and from our metrics socket the
+// pedal to LED percentiles, the OSC messages in and out and the time spent
+// in handleCtrlMessage, updateLoopLedState and the MIDI, LED and OSC sends,
+// by their spans. Each point is a CSV line, written as soon as it's done.
+//
+// SooperLooper loops past LoopStore::maxLoops still send their updates, so
+// the largest point measures what those cost us too.
+class ScaleBenchmark
+{
+public:
+    struct Options
+    {
+	File executable_;
+	double seconds_ = 3;
+	int simPort_ = 29951;
+	int oscPort_ = 29000;
+	int pressesPerSecond_ = 20;
+    };
+
+    static const char* getHeader()
+    {
+	return "loops,subscribers,update_ms,ready,cpu_percent,pedal_led_p50_ms,pedal_led_p99_ms,presses,"
+	       "osc_in_per_s,osc_out_per_s,subscriber_packets_per_s,ctrl_us_per_s,led_state_us_per_s,send_us_per_s";
+    }
+
+#if JUCE_LINUX
+    // every point, progress on progress and the CSV on out; false if the
+    // processes couldn't be started at all
+    bool run(const Options& options, std::ostream& out, std::ostream& progress)
+    {
+	static const int loopCounts[] = { 4, 16, 64, 256 };
+	static const int subscriberCounts[] = { 0, 1, 8, 32 };
+	static const int updateIntervals[] = { 100, 10, 1 };
+
+	out << getHeader() << std::endl;
+	for (int loops : loopCounts)
+	{
+	    for (int subscribers : subscriberCounts)
+	    {
+		for (int updateMs : updateIntervals)
+		{
+		    progress << "scale: " << loops << " loops, " << subscribers << " subscribers, updates every " << updateMs << "ms" << std::endl;
+		    String line;
+		    if (!runPoint(options, loops, subscribers, updateMs, line))
+		    {
+			return false;
+		    }
+		    out << line << std::endl;
+		}
+	    }
+	}
+	return true;
+    }
+#else
+    bool run(const Options&, std::ostream&, std::ostream& progress)
+    {
+	progress << "The scaling benchmark is only on Linux" << std::endl;
+	return false;
+    }
+#endif
+
+private:
+#if JUCE_LINUX
+    // the LED subscribers, drained on a thread of their own so their
+    // sockets never back up into our sends
+    class Subscribers : public Thread
+    {
+    public:
+	Subscribers() : Thread("loop4r scale subscribers") {}
+
+	~Subscribers()
+	{
+	    stopThread(1000);
+	    for (int fd : fds_)
+	    {
+		::close(fd);
+	    }
+	}
+
+	// count sockets, each registered with us on port as a subscriber
+	bool open(int count, int port)
+	{
+	    sockaddr_in to = {};
+	    to.sin_family = AF_INET;
+	    to.sin_port = htons((uint16) port);
+	    to.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	    for (int i = 0; i < count; ++i)
+	    {
+		const int fd = ::socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		if (fd < 0)
+		{
+		    return false;
+		}
+		fds_.add(fd);
+		sockaddr_in local = {};
+		local.sin_family = AF_INET;
+		local.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		socklen_t length = sizeof(local);
+		if (::bind(fd, (const sockaddr*) &local, sizeof(local)) != 0 || ::getsockname(fd, (sockaddr*) &local, &length) != 0)
+		{
+		    return false;
+		}
+		OscPacket registration;
+		registration.size_ = OscMessageWriter(registration).begin("/loop4r/register_auto_update", "si")
+		    .addString("127.0.0.1").addInt32(ntohs(local.sin_port)).size();
+		if (::sendto(fd, registration.data_, (size_t) registration.size_, 0, (const sockaddr*) &to, sizeof(to)) < 0)
+		{
+		    return false;
+		}
+	    }
+	    startThread();
+	    return true;
+	}
+
+	int64 getNumPackets() const             { return numPackets_.load(); }
+
+	void run() override
+	{
+	    Array<pollfd> polled;
+	    for (int fd : fds_)
+	    {
+		polled.add({fd, POLLIN, 0});
+	    }
+	    char buffer[2048];
+	    while (!threadShouldExit())
+	    {
+		if (polled.isEmpty())
+		{
+		    wait(50);
+		    continue;
+		}
+		if (::poll(polled.getRawDataPointer(), (nfds_t) polled.size(), 50) <= 0)
+		{
+		    continue;
+		}
+		for (auto&& p : polled)
+		{
+		    while ((p.revents & POLLIN) != 0 && ::recv(p.fd, buffer, sizeof(buffer), 0) >= 0)
+		    {
+			++numPackets_;
+		    }
+		}
+	    }
+	}
+
+    private:
+	Array<int> fds_;
+	std::atomic<int64> numPackets_ { 0 };
+    };
+
+    struct Sample
+    {
+	double seconds_;
+	double cpuSeconds_;
+	String metrics_;
+	int64 subscriberPackets_;
+    };
+
+    bool runPoint(const Options& options, int loops, int subscribers, int updateMs, String& line)
+    {
+	const String exe = options.executable_.getFullPathName();
+	const File metrics(File::getSpecialLocation(File::tempDirectory).getChildFile("loop4r_scale_" + String(::getpid()) + ".metrics"));
+	const File spans(metrics.withFileExtension("json"));
+
+	int master = ::posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+	if (master < 0 || ::grantpt(master) != 0 || ::unlockpt(master) != 0)
+	{
+	    std::cerr << "Couldn't open a pty for the pedals: " << std::strerror(errno) << std::endl;
+	    if (master >= 0)
+	    {
+		::close(master);
+	    }
+	    return false;
+	}
+	const String slave(::ptsname(master));
+
+	const pid_t sim = spawn({ exe, "sim", String(options.simPort_), String(loops), String(updateMs) });
+	Thread::sleep(200);
+	const pid_t us = spawn({ exe, "oin", String(options.oscPort_), "oout", String(options.simPort_), "serial", slave,
+				 "metrics", metrics.getFullPathName(), "spans", spans.getFullPathName(), "16",
+				 "slcmd", "on", "jrnl", "off", "log", "quiet", "multi" });
+	if (sim <= 0 || us <= 0)
+	{
+	    stop(sim);
+	    stop(us);
+	    ::close(master);
+	    return false;
+	}
+
+	// ready once the LEDs are right, or given up on
+	String text;
+	bool ready = false;
+	for (int i = 0; i < 100 && !ready; ++i)
+	{
+	    Thread::sleep(100);
+	    text = readMetrics(metrics);
+	    ready = sumSamples(text, "loop4r_startup_ready_milliseconds", "") > 0;
+	}
+
+	Subscribers listeners;
+	listeners.open(subscribers, options.oscPort_);
+	Thread::sleep(300);
+
+	const Sample before = sample(us, metrics, listeners);
+	const int numPresses = roundToInt(options.seconds_ * options.pressesPerSecond_);
+	const double interval = 1000.0 / options.pressesPerSecond_;
+	const double start = Time::getMillisecondCounterHiRes();
+	for (int i = 0; i < numPresses; ++i)
+	{
+	    // the loop pedals 1-4 in turn, down then up
+	    const uint8 pedal = (uint8) (1 + i % 4);
+	    const uint8 press[6] = { 0xb0, 104, pedal, 0xb0, 105, pedal };
+	    if (::write(master, press, sizeof(press)) < 0)
+	    {
+		break;
+	    }
+	    const double due = start + (i + 1) * interval;
+	    const double now = Time::getMillisecondCounterHiRes();
+	    if (due > now)
+	    {
+		Thread::sleep(roundToInt(due - now));
+	    }
+	}
+	Thread::sleep(100);    // the last press's round trip
+	const Sample after = sample(us, metrics, listeners);
+
+	// the simulator first: on a single core its updates can starve our
+	// threads for long enough that we don't get to exit
+	stop(sim);
+	stop(us);
+	::close(master);
+	metrics.deleteFile();
+	spans.deleteFile();
+
+	const double seconds = jmax(0.001, after.seconds_ - before.seconds_);
+	auto rate = [&] (const char* name, const char* labels)
+	{
+	    return (sumSamples(after.metrics_, name, labels) - sumSamples(before.metrics_, name, labels)) / seconds;
+	};
+	line << loops << "," << subscribers << "," << updateMs << "," << (ready ? 1 : 0) << ","
+	     << String((after.cpuSeconds_ - before.cpuSeconds_) / seconds * 100.0, 1) << ","
+	     << String(sumSamples(after.metrics_, "loop4r_latency_microseconds", "stage=\"pedal-led\",quantile=\"0.5\"") / 1000.0, 1) << ","
+	     << String(sumSamples(after.metrics_, "loop4r_latency_microseconds", "stage=\"pedal-led\",quantile=\"0.99\"") / 1000.0, 1) << ","
+	     << numPresses << ","
+	     << roundToInt(rate("loop4r_osc_messages_total", "direction=\"in\"")) << ","
+	     << roundToInt(rate("loop4r_osc_messages_total", "direction=\"out\"")) << ","
+	     << roundToInt((after.subscriberPackets_ - before.subscriberPackets_) / seconds) << ","
+	     << roundToInt(rate("loop4r_span_microseconds_total", "span=\"handleCtrlMessage\"")) << ","
+	     << roundToInt(rate("loop4r_span_microseconds_total", "span=\"updateLoopLedState\"")) << ","
+	     << roundToInt(rate("loop4r_span_microseconds_total", "span=\"osc send\"") + rate("loop4r_span_microseconds_total", "span=\"midi send\"")
+			  + rate("loop4r_span_microseconds_total", "span=\"led write\""));
+	return true;
+    }
+
+    Sample sample(pid_t pid, const File& metrics, const Subscribers& listeners)
+    {
+	Sample result;
+	result.seconds_ = Time::getMillisecondCounterHiRes() / 1000.0;
+	result.cpuSeconds_ = getCpuSeconds(pid);
+	result.metrics_ = readMetrics(metrics);
+	result.subscriberPackets_ = listeners.getNumPackets();
+	return result;
+    }
+
+    // stdin, stdout and stderr all on /dev/null
+    static pid_t spawn(std::initializer_list<String> args)
+    {
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init(&actions);
+	for (int fd = 0; fd <= 2; ++fd)
+	{
+	    posix_spawn_file_actions_addopen(&actions, fd, "/dev/null", fd == 0 ? O_RDONLY : O_WRONLY, 0);
+	}
+	Array<char*> argv;
+	for (auto&& arg : args)
+	{
+	    argv.add(const_cast<char*>(arg.toRawUTF8()));
+	}
+	argv.add(nullptr);
+	pid_t pid = 0;
+	const int error = ::posix_spawn(&pid, argv[0], &actions, nullptr, argv.getRawDataPointer(), environ);
+	posix_spawn_file_actions_destroy(&actions);
+	if (error != 0)
+	{
+	    std::cerr << "Couldn't start " << *args.begin() << ": " << std::strerror(error) << std::endl;
+	    return 0;
+	}
+	return pid;
+    }
+
+    // SIGINT for a clean exit, SIGKILL if that takes more than 3s
+    static void stop(pid_t pid)
+    {
+	if (pid <= 0)
+	{
+	    return;
+	}
+	::kill(pid, SIGINT);
+	for (int i = 0; i < 300; ++i)
+	{
+	    if (::waitpid(pid, nullptr, WNOHANG) == pid)
+	    {
+		return;
+	    }
+	    Thread::sleep(10);
+	}
+	::kill(pid, SIGKILL);
+	::waitpid(pid, nullptr, 0);
+    }
+
+    // utime and stime, the 14th and 15th fields of /proc/pid/stat
+    static double getCpuSeconds(pid_t pid)
+    {
+	const StringArray fields(StringArray::fromTokens(File("/proc/" + String(pid) + "/stat").loadFileAsString()
+							 .fromLastOccurrenceOf(")", false, false).trim(), " ", ""));
+	const long ticksPerSecond = ::sysconf(_SC_CLK_TCK);
+	if (fields.size() < 13 || ticksPerSecond <= 0)
+	{
+	    return 0;
+	}
+	return (double) (fields[11].getLargeIntValue() + fields[12].getLargeIntValue()) / ticksPerSecond;
+    }
+
+    // the bare text, as a client that sends nothing gets it
+    static String readMetrics(const File& path)
+    {
+	const int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+	{
+	    return String();
+	}
+	sockaddr_un address = {};
+	address.sun_family = AF_UNIX;
+	path.getFullPathName().copyToUTF8(address.sun_path, sizeof(address.sun_path));
+	MemoryOutputStream text;
+	if (::connect(fd, (const sockaddr*) &address, sizeof(address)) == 0)
+	{
+	    char buffer[4096];
+	    for (ssize_t size; (size = ::read(fd, buffer, sizeof(buffer))) > 0;)
+	    {
+		text.write(buffer, (size_t) size);
+	    }
+	}
+	::close(fd);
+	return text.toString();
+    }
+
+    // of the samples of name whose labels contain labels
+    static double sumSamples(const String& text, const String& name, const String& labels)
+    {
+	double sum = 0;
+	StringArray lines;
+	lines.addLines(text);
+	for (auto&& sampleLine : lines)
+	{
+	    if (sampleLine.startsWith(name) && (sampleLine.length() == name.length() || sampleLine[name.length()] == '{'
+						|| sampleLine[name.length()] == ' ')
+		&& sampleLine.upToLastOccurrenceOf(" ", false, false).contains(labels))
+	    {
+		sum += sampleLine.fromLastOccurrenceOf(" ", false, false).getDoubleValue();
+	    }
+	}
+	return sum;
+    }
+#endif
+};
@@ -0,0 +1,96 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include <cstddef>
+
+//==============================================================================
+// Per-thread bump allocation for the work of one event: OSC replies encoded
+// before they're sent, a frame's blob. Each thread's block is allocated the
+// first time it's used and never again; a Scope around handling an event
+// gives back everything taken inside it, so steady state handling needs
+// nothing from the global heap. Allocations that don't fit get nullptr and
+// the caller does without.
+class ScratchArena
+{
+public:
+    static const size_t blockSize = 64 * 1024;
+
+    static ScratchArena& get()
+    {
+	thread_local ScratchArena arena;
+	return arena;
+    }
+
+    void* allocate(size_t numBytes, size_t alignment = alignof(std::max_align_t))
+    {
+	if (block_ == nullptr)
+	{
+	    block_.malloc(blockSize);
+	}
+	const size_t start = (used_ + alignment - 1) & ~(alignment - 1);
+	if (start + numBytes > blockSize)
+	{
+	    ++numExhausted_;
+	    return nullptr;
+	}
+	used_ = start + numBytes;
+	highWater_ = jmax(highWater_, used_);
+	return block_ + start;
+    }
+
+    char* allocateChars(int numBytes)
+    {
+	return static_cast<char*>(allocate((size_t) jmax(0, numBytes), 4));
+    }
+
+    size_t getUsed() const              { return used_; }
+    size_t getHighWater() const         { return highWater_; }
+    int64 getNumExhausted() const       { return numExhausted_; }
+
+    // what's allocated inside is given back when it ends; scopes nest
+    class Scope
+    {
+    public:
+	explicit Scope(ScratchArena& arena = get()) : arena_(arena), mark_(arena.used_) {}
+
+	~Scope()
+	{
+	    arena_.used_ = mark_;
+	}
+
+    private:
+	ScratchArena& arena_;
+	const size_t mark_;
+
+	JUCE_DECLARE_NON_COPYABLE(Scope)
+    };
+
+private:
+    ScratchArena() {}
+
+    HeapBlock<char> block_;
+    size_t used_ = 0;
+    size_t highWater_ = 0;
+    int64 numExhausted_ = 0;
+
+    JUCE_DECLARE_NON_COPYABLE(ScratchArena)
+};
@@ -0,0 +1,398 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "OscPacket.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <ostream>
+
+#if JUCE_LINUX
+ #include <cerrno>
+ #include <time.h>
+#endif
+
+#if JUCE_LINUX && JUCE_ALSA
+ #include <alsa/asoundlib.h>
+ #include <poll.h>
+#endif
+
+//==============================================================================
+// What this box can do, measured in a couple of seconds before a show
+// ("selftest"). Each probe is timed against the high resolution clock:
+//
+// - sequencer: an ALSA sequencer client of its own sends a controller from
+//   one of its ports to another through a subscription, one at a time, the
+//   path a USB pedal board's events take to our input
+// - udp: a datagram to the OSC receive port, bound by a thread echoing it
+//   back, and the echo, the loopback hop and a wakeup each way
+// - timer: how late 1ms sleeps wake up, on a thread scheduled as the control
+//   thread would be
+// - ping: /ping to SooperLooper until its /pingack
+//
+// A probe passes if its 99th percentile is under its limit and nothing was
+// lost. Each sample is kept, so the percentiles are exact.
+class SelfTest
+{
+public:
+    enum Probe
+    {
+	Sequencer,
+	Udp,
+	Timer,
+	Ping,
+	numProbes
+    };
+
+    static const char* getProbeName(Probe probe)
+    {
+	switch (probe)
+	{
+	    case Sequencer:     return "sequencer";
+	    case Udp:           return "udp";
+	    case Timer:         return "timer";
+	    case Ping:          return "ping";
+	    default:            return "unknown";
+	}
+    }
+
+    static double getDefaultLimitMs(Probe probe)
+    {
+	switch (probe)
+	{
+	    case Sequencer:     return 1.0;
+	    case Udp:           return 0.5;
+	    case Timer:         return 0.5;
+	    case Ping:          return 5.0;
+	    default:            return 0;
+	}
+    }
+
+    SelfTest()
+    {
+	for (int i = 0; i < numProbes; ++i)
+	{
+	    results_[i].limitMs_ = getDefaultLimitMs((Probe) i);
+	}
+    }
+
+    void setLimitMs(Probe probe, double ms)     { results_[probe].limitMs_ = ms; }
+
+#if JUCE_LINUX && JUCE_ALSA
+    void probeSequencer(int events, int timeoutMs)
+    {
+	Result& result = start(Sequencer);
+	snd_seq_t* seq = nullptr;
+	if (snd_seq_open(&seq, "default", SND_SEQ_OPEN_DUPLEX, SND_SEQ_NONBLOCK) < 0)
+	{
+	    result.note_ = "no ALSA sequencer";
+	    return;
+	}
+	snd_seq_set_client_name(seq, "loop4r selftest");
+	const int from = snd_seq_create_simple_port(seq, "selftest out", SND_SEQ_PORT_CAP_READ | SND_SEQ_PORT_CAP_SUBS_READ,
+						    SND_SEQ_PORT_TYPE_MIDI_GENERIC | SND_SEQ_PORT_TYPE_APPLICATION);
+	const int to = snd_seq_create_simple_port(seq, "selftest in", SND_SEQ_PORT_CAP_WRITE | SND_SEQ_PORT_CAP_SUBS_WRITE,
+						  SND_SEQ_PORT_TYPE_MIDI_GENERIC | SND_SEQ_PORT_TYPE_APPLICATION);
+	if (from < 0 || to < 0 || snd_seq_connect_to(seq, from, snd_seq_client_id(seq), to) < 0)
+	{
+	    result.note_ = "couldn't connect its ports";
+	    snd_seq_close(seq);
+	    return;
+	}
+
+	struct pollfd fds[8];
+	const int numFds = jmin(8, snd_seq_poll_descriptors_count(seq, POLLIN));
+	snd_seq_poll_descriptors(seq, fds, (unsigned int) numFds, POLLIN);
+	for (int i = 0; i < events; ++i)
+	{
+	    snd_seq_event_t event;
+	    snd_seq_ev_clear(&event);
+	    snd_seq_ev_set_source(&event, from);
+	    snd_seq_ev_set_subs(&event);
+	    snd_seq_ev_set_direct(&event);
+	    snd_seq_ev_set_controller(&event, 0, 104, i & 0x7f);
+	    const int64 sent = Time::getHighResolutionTicks();
+	    snd_seq_event_output_direct(seq, &event);
+
+	    bool seen = false;
+	    while (!seen && ::poll(fds, (nfds_t) numFds, timeoutMs) > 0)
+	    {
+		snd_seq_event_t* in = nullptr;
+		while (snd_seq_event_input(seq, &in) >= 0 && in != nullptr)
+		{
+		    seen = seen || (in->type == SND_SEQ_EVENT_CONTROLLER && in->data.control.value == (i & 0x7f));
+		}
+	    }
+	    record(result, sent, seen);
+	    Thread::sleep(1);
+	}
+	snd_seq_close(seq);
+    }
+#else
+    void probeSequencer(int, int)
+    {
+	Result& result = start(Sequencer);
+	result.skipped_ = true;
+	result.note_ = "built without ALSA";
+    }
+#endif
+
+    void probeUdp(int oscPort, int events, int timeoutMs)
+    {
+	Result& result = start(Udp);
+	DatagramSocket echoSocket(false);
+	DatagramSocket socket(false);
+	if (!echoSocket.bindToPort(oscPort))
+	{
+	    result.note_ = "port " + String(oscPort) + " is taken";
+	    return;
+	}
+	if (!socket.bindToPort(0))
+	{
+	    result.note_ = "no socket";
+	    return;
+	}
+
+	Echo echo(echoSocket);
+	echo.startThread();
+	for (int i = 0; i < events; ++i)
+	{
+	    uint32 sequence = (uint32) i;
+	    const int64 sent = Time::getHighResolutionTicks();
+	    socket.write("127.0.0.1", oscPort, &sequence, (int) sizeof(sequence));
+	    bool seen = false;
+	    while (!seen && socket.waitUntilReady(true, timeoutMs) == 1)
+	    {
+		uint32 answer = 0;
+		seen = socket.read(&answer, (int) sizeof(answer), false) == (int) sizeof(answer) && answer == sequence;
+	    }
+	    record(result, sent, seen);
+	    Thread::sleep(1);
+	}
+	echo.stopThread(4 * Echo::waitMs);
+    }
+
+    // schedule is called on the sleeping thread first, and returns what it set
+    void probeTimer(int sleeps, std::function<String()> schedule)
+    {
+	Result& result = start(Timer);
+	Sleeper sleeper(result, sleeps, schedule);
+	sleeper.startThread();
+	sleeper.waitForThreadToExit(-1);
+    }
+
+    void probePing(const String& host, int port, int pings, int timeoutMs)
+    {
+	Result& result = start(Ping);
+	DatagramSocket socket(false);
+	if (port <= 0 || !socket.bindToPort(0))
+	{
+	    result.note_ = port <= 0 ? "no SooperLooper" : "no socket";
+	    return;
+	}
+	OscPacket ping;
+	ping.size_ = OscMessageWriter(ping).begin("/ping", "ss")
+	    .addString(("osc.udp://localhost:" + String(socket.getBoundPort()) + "/").toRawUTF8()).addString("/pingack").size();
+	for (int i = 0; i < pings; ++i)
+	{
+	    const int64 sent = Time::getHighResolutionTicks();
+	    socket.write(host, port, ping.data_, ping.size_);
+	    bool seen = false;
+	    while (!seen && socket.waitUntilReady(true, timeoutMs) == 1)
+	    {
+		char answer[OscPacket::maxSize];
+		const int size = socket.read(answer, (int) sizeof(answer), false);
+		seen = size >= 8 && std::memcmp(answer, "/pingack", 8) == 0;
+	    }
+	    record(result, sent, seen);
+	    Thread::sleep(10);
+	}
+	if (result.micros_.isEmpty())
+	{
+	    result.note_ = "SooperLooper on " + host + ":" + String(port) + " didn't answer";
+	}
+    }
+
+    // returns whether every probe that ran passed
+    bool dump(std::ostream& out)
+    {
+	bool passed = true;
+	out << "Self-test:" << std::endl;
+	for (int i = 0; i < numProbes; ++i)
+	{
+	    Result& result = results_[i];
+	    if (!result.ran_)
+	    {
+		continue;
+	    }
+	    out << "  " << String(getProbeName((Probe) i)).paddedRight(' ', 10);
+	    if (result.skipped_)
+	    {
+		out << "  skipped, " << result.note_ << std::endl;
+		continue;
+	    }
+	    if (result.micros_.isEmpty())
+	    {
+		out << "  fail, " << result.note_ << std::endl;
+		passed = false;
+		continue;
+	    }
+	    std::sort(result.micros_.begin(), result.micros_.end());
+	    const double p99 = getPercentile(result, 99) / 1000.0;
+	    const bool ok = p99 <= result.limitMs_ && result.missed_ == 0;
+	    passed = passed && ok;
+	    out << "  count " << result.micros_.size()
+		<< "  p50 " << String(getPercentile(result, 50) / 1000.0, 3) << "ms"
+		<< "  p99 " << String(p99, 3) << "ms"
+		<< "  max " << String(result.micros_.getLast() / 1000.0, 3) << "ms"
+		<< "  missed " << result.missed_
+		<< "  limit " << String(result.limitMs_, 3) << "ms  " << (ok ? "pass" : "fail")
+		<< (result.note_.isEmpty() ? String() : ", " + result.note_) << std::endl;
+	}
+	out << "Self-test " << (passed ? "passed" : "failed") << std::endl;
+	return passed;
+    }
+
+private:
+    struct Result
+    {
+	bool ran_ = false;
+	bool skipped_ = false;
+	Array<double> micros_;
+	int missed_ = 0;
+	double limitMs_ = 0;
+	String note_;
+    };
+
+    // echoes whatever comes in on the OSC port back to where it came from
+    class Echo : public Thread
+    {
+    public:
+	static const int waitMs = 50;
+
+	Echo(DatagramSocket& socket) : Thread("loop4r selftest echo"), socket_(socket) {}
+
+	void run() override
+	{
+	    while (!threadShouldExit())
+	    {
+		if (socket_.waitUntilReady(true, waitMs) != 1)
+		{
+		    continue;
+		}
+		char data[64];
+		String host;
+		int port = 0;
+		const int size = socket_.read(data, (int) sizeof(data), false, host, port);
+		if (size > 0)
+		{
+		    socket_.write(host, port, data, size);
+		}
+	    }
+	}
+
+    private:
+	DatagramSocket& socket_;
+    };
+
+    class Sleeper : public Thread
+    {
+    public:
+	Sleeper(Result& result, int sleeps, std::function<String()> schedule)
+	    : Thread("loop4r selftest timer"), result_(result), sleeps_(sleeps), schedule_(schedule) {}
+
+	void run() override
+	{
+	    const String scheduled = schedule_ ? schedule_() : String();
+	    result_.note_ = scheduled.isEmpty() ? String("default scheduling") : scheduled;
+#if JUCE_LINUX
+	    const int64 periodNs = 1000000;
+	    struct timespec next;
+	    clock_gettime(CLOCK_MONOTONIC, &next);
+	    for (int i = 0; i < sleeps_; ++i)
+	    {
+		next.tv_nsec += periodNs;
+		if (next.tv_nsec >= 1000000000)
+		{
+		    next.tv_nsec -= 1000000000;
+		    ++next.tv_sec;
+		}
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, nullptr) == EINTR)
+		{
+		}
+		struct timespec now;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		const int64 lateNs = (int64) (now.tv_sec - next.tv_sec) * 1000000000 + (now.tv_nsec - next.tv_nsec);
+		result_.micros_.add(jmax((int64) 0, lateNs) / 1000.0);
+	    }
+#else
+	    for (int i = 0; i < sleeps_; ++i)
+	    {
+		const double wanted = Time::getMillisecondCounterHiRes() + 1.0;
+		Thread::sleep(1);
+		result_.micros_.add(jmax(0.0, Time::getMillisecondCounterHiRes() - wanted) * 1000.0);
+	    }
+#endif
+	}
+
+    private:
+	Result& result_;
+	const int sleeps_;
+	std::function<String()> schedule_;
+    };
+
+    Result& start(Probe probe)
+    {
+	Result& result = results_[probe];
+	result.ran_ = true;
+	result.skipped_ = false;
+	result.micros_.clearQuick();
+	result.micros_.ensureStorageAllocated(1024);
+	result.missed_ = 0;
+	result.note_ = String();
+	return result;
+    }
+
+    static void record(Result& result, int64 sentTicks, bool seen)
+    {
+	if (seen)
+	{
+	    result.micros_.add(Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - sentTicks) * 1.0e6);
+	}
+	else
+	{
+	    ++result.missed_;
+	}
+    }
+
+    // of the sorted samples, nearest rank
+    static double getPercentile(const Result& result, double percentile)
+    {
+	const int size = result.micros_.size();
+	const int rank = jlimit(0, size - 1, (int) std::ceil(percentile / 100.0 * size) - 1);
+	return result.micros_[rank];
+    }
+
+    Result results_[numProbes];
+
+    JUCE_DECLARE_NON_COPYABLE(SelfTest)
+};
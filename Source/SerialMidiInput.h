@@ -0,0 +1,153 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "AlsaRawMidi.h"
+
+#if JUCE_LINUX
+ #include <fcntl.h>
+ #include <termios.h>
+ #include <sys/ioctl.h>
+ #include <linux/serial.h>
+#endif
+
+//==============================================================================
+// MIDI straight off a UART (a Pi's ttyAMA0 wired to the board's DIN socket)
+// at 31250 baud, 8N1, raw. Reads return as soon as there's a byte (VMIN 1,
+// VTIME 0) and the driver is asked for low latency. termios has no 31250, so
+// the port is set to 38400 with a custom divisor where the driver allows it;
+// on a Pi that doesn't, init_uart_clock in config.txt does the same.
+class SerialMidiInput : public ByteStreamMidiInput
+{
+public:
+    static const int midiBaudRate = 31250;
+
+    SerialMidiInput()
+	: ByteStreamMidiInput("loop4r serial midi")
+    {
+    }
+
+    ~SerialMidiInput()
+    {
+	close();
+    }
+
+#if JUCE_LINUX
+    // device is the tty's path, e.g. "/dev/ttyAMA0"
+    bool open(const String& device) override
+    {
+	close();
+	fd_ = ::open(device.toRawUTF8(), O_RDONLY | O_NOCTTY | O_NONBLOCK);
+	if (fd_ < 0)
+	{
+	    return false;
+	}
+	if (!setMidiLine(fd_))
+	{
+	    closeDevice();
+	    return false;
+	}
+	tcflush(fd_, TCIFLUSH);
+	opened();
+	return true;
+    }
+
+    // a tty as a raw 31250 baud MIDI line, for the DIN output as well
+    static bool setMidiLine(int fd)
+    {
+	struct termios settings;
+	if (tcgetattr(fd, &settings) < 0)
+	{
+	    return false;
+	}
+	cfmakeraw(&settings);
+	settings.c_cflag |= CLOCAL | CREAD;
+	settings.c_cflag &= ~(CSTOPB | PARENB | CRTSCTS);
+	settings.c_cc[VMIN] = 1;
+	settings.c_cc[VTIME] = 0;
+	cfsetispeed(&settings, B38400);
+	cfsetospeed(&settings, B38400);
+	if (tcsetattr(fd, TCSANOW, &settings) < 0)
+	{
+	    return false;
+	}
+
+	// not every driver has these, and it works without them
+	struct serial_struct serial;
+	if (ioctl(fd, TIOCGSERIAL, &serial) == 0)
+	{
+	    serial.flags |= ASYNC_LOW_LATENCY;
+	    if (serial.baud_base > 0 && serial.baud_base != midiBaudRate)
+	    {
+		serial.flags = (serial.flags & ~ASYNC_SPD_MASK) | ASYNC_SPD_CUST;
+		serial.custom_divisor = jmax(1, roundToInt(serial.baud_base / (double) midiBaudRate));
+	    }
+	    ioctl(fd, TIOCSSERIAL, &serial);
+	}
+	return true;
+    }
+
+    Array<int> getFileDescriptors() const override
+    {
+	Array<int> fds;
+	if (fd_ >= 0)
+	{
+	    fds.add(fd_);
+	}
+	return fds;
+    }
+#else
+    bool open(const String&) override   { return false; }
+    Array<int> getFileDescriptors() const override  { return {}; }
+#endif
+
+    bool isOpen() const override        { return fd_ >= 0; }
+
+private:
+#if JUCE_LINUX
+    int readBytes(uint8* buffer, int size) override
+    {
+	const ssize_t count = ::read(fd_, buffer, (size_t) size);
+	if (count < 0)
+	{
+	    return errno == EAGAIN || errno == EINTR ? 0 : -1;
+	}
+	// a tty that hung up reads as end of file
+	return count == 0 ? -1 : (int) count;
+    }
+
+    void closeDevice() override
+    {
+	if (fd_ >= 0)
+	{
+	    ::close(fd_);
+	    fd_ = -1;
+	}
+    }
+#else
+    int readBytes(uint8*, int) override { return 0; }
+    void closeDevice() override         {}
+#endif
+
+    int fd_ = -1;
+
+    JUCE_DECLARE_NON_COPYABLE(SerialMidiInput)
+};
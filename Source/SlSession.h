@@ -0,0 +1,159 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include <cstring>
+
+//==============================================================================
+// What a SooperLooper session file (.slsess) says that's of use before the
+// engine first answers: its loops, their channels and length, and the tempo.
+// It's read in one forward pass over the start tags, picking the attributes
+// out of <Globals> and <Looper>, with no document built and the rest (the
+// panners, the controls) skipped over.
+class SlSession
+{
+public:
+    static const int maxLoopers = 128;
+
+    struct Looper
+    {
+	int channels_ = 0;
+	float loopSecs_ = 0;
+    };
+
+    SlSession() {}
+
+    // false if it can't be read or has no loopers
+    bool load(const File& file)
+    {
+	clear();
+	MemoryBlock data;
+	if (!file.loadFileAsData(data))
+	{
+	    return false;
+	}
+	forEachStartTag(static_cast<const char*>(data.getData()), data.getSize(),
+			[this] (const char* name, size_t nameLength, const char* attributes, const char* end)
+	{
+	    if (nameLength == 7 && std::memcmp(name, "Globals", 7) == 0)
+	    {
+		tempo_ = getAttribute(attributes, end, "tempo").getDoubleValue();
+	    }
+	    else if (nameLength == 6 && std::memcmp(name, "Looper", 6) == 0)
+	    {
+		const String index = getAttribute(attributes, end, "index");
+		const int i = index.isEmpty() ? numLoopers_ : index.getIntValue();
+		if (isPositiveAndBelow(i, maxLoopers))
+		{
+		    loopers_[i].channels_ = getAttribute(attributes, end, "channels").getIntValue();
+		    loopers_[i].loopSecs_ = getAttribute(attributes, end, "loop_secs").getFloatValue();
+		    numLoopers_ = jmax(numLoopers_, i + 1);
+		}
+	    }
+	});
+	if (numLoopers_ == 0)
+	{
+	    return false;
+	}
+	file_ = file;
+	return true;
+    }
+
+    void clear()
+    {
+	numLoopers_ = 0;
+	tempo_ = 0;
+	file_ = File();
+    }
+
+    bool isLoaded() const                   { return numLoopers_ > 0; }
+    const File& getFile() const             { return file_; }
+    int getNumLoopers() const               { return numLoopers_; }
+    const Looper& getLooper(int i) const    { return loopers_[jlimit(0, maxLoopers - 1, i)]; }
+    double getTempo() const                 { return tempo_; }     // 0 for none
+
+private:
+    // onTag(name, nameLength, attributes, end) for every start (or empty)
+    // element tag, the attributes being the text up to its closing '>'
+    template <typename Function>
+    static void forEachStartTag(const char* text, size_t size, Function onTag)
+    {
+	const char* const end = text + size;
+	for (const char* p = text; p < end; ++p)
+	{
+	    if (*p != '<' || p + 1 >= end || p[1] == '/' || p[1] == '?' || p[1] == '!')
+	    {
+		continue;
+	    }
+	    const char* name = p + 1;
+	    const char* nameEnd = name;
+	    while (nameEnd < end && !CharacterFunctions::isWhitespace(*nameEnd) && *nameEnd != '>' && *nameEnd != '/')
+	    {
+		++nameEnd;
+	    }
+
+	    // the '>' that isn't inside a quoted value
+	    char quote = 0;
+	    const char* close = nameEnd;
+	    for (; close < end && (quote != 0 || *close != '>'); ++close)
+	    {
+		if (quote == 0 && (*close == '"' || *close == '\''))
+		{
+		    quote = *close;
+		}
+		else if (*close == quote)
+		{
+		    quote = 0;
+		}
+	    }
+	    onTag(name, (size_t) (nameEnd - name), nameEnd, close);
+	    p = close;
+	}
+    }
+
+    static String getAttribute(const char* attributes, const char* end, const char* name)
+    {
+	const size_t nameLength = std::strlen(name);
+	for (const char* p = attributes; p + nameLength + 2 < end; ++p)
+	{
+	    if ((p == attributes || CharacterFunctions::isWhitespace(p[-1])) && std::memcmp(p, name, nameLength) == 0
+		&& p[nameLength] == '=' && (p[nameLength + 1] == '"' || p[nameLength + 1] == '\''))
+	    {
+		const char quote = p[nameLength + 1];
+		const char* value = p + nameLength + 2;
+		const char* valueEnd = value;
+		while (valueEnd < end && *valueEnd != quote)
+		{
+		    ++valueEnd;
+		}
+		return String::fromUTF8(value, (int) (valueEnd - value));
+	    }
+	}
+	return String();
+    }
+
+    Looper loopers_[maxLoopers];
+    int numLoopers_ = 0;
+    double tempo_ = 0;
+    File file_;
+
+    JUCE_DECLARE_NON_COPYABLE(SlSession)
+};
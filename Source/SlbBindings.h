@@ -0,0 +1,325 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "OscPacket.h"
+#include <cstdio>
+
+//==============================================================================
+// A SooperLooper MIDI binding file (.slb), as much of it as says which note
+// or controller runs which command on which loop. Each line is
+//
+//     channel type number  action command loop  ...
+//
+// e.g. "0 n 64  note mute_trigger 0  0 1  norm 0 127 0", the channel counting
+// from 0 and the loop -1 for all, -2 for global and -3 for the selected one.
+// Lines it can't read are skipped. The result is one table per kind indexed
+// by number.
+class SlbBindings
+{
+public:
+    static const int size = 128;
+
+    struct Binding
+    {
+	int8 command_ = -1;     // into getCommandName(), -1 for none
+	int8 channel_ = 0;
+	int16 loop_ = 0;
+    };
+
+    SlbBindings() {}
+
+    // false if it can't be read; a file that's the same as last time is kept
+    // as it was parsed then
+    bool load(const File& file)
+    {
+	if (!file.existsAsFile())
+	{
+	    return false;
+	}
+	const String text = file.loadFileAsString();
+	const int64 hash = text.hashCode64();
+	if (isLoaded() && hash == hash_ && file == file_)
+	{
+	    return true;
+	}
+
+	clear();
+	file_ = file;
+	hash_ = hash;
+	StringArray lines;
+	lines.addLines(text);
+	for (const String& line : lines)
+	{
+	    parseLine(line);
+	}
+	return true;
+    }
+
+    void clear()
+    {
+	for (int i = 0; i < size; ++i)
+	{
+	    notes_[i] = Binding();
+	    controllers_[i] = Binding();
+	}
+	commandNames_.clearQuick();
+	file_ = File();
+	hash_ = 0;
+	numBindings_ = 0;
+    }
+
+    bool isLoaded() const                       { return file_ != File(); }
+    const File& getFile() const                 { return file_; }
+    int getNumBindings() const                  { return numBindings_; }
+
+    const Binding& getNote(int note) const      { return notes_[note & 0x7f]; }
+    const Binding& getController(int cc) const  { return controllers_[cc & 0x7f]; }
+    String getCommandName(const Binding& binding) const { return commandNames_[binding.command_]; }
+
+    // the note bound to command on loop, -1 if there isn't one
+    int findNote(const char* command, int loop) const
+    {
+	const int index = commandNames_.indexOf(command);
+	for (int i = 0; index >= 0 && i < size; ++i)
+	{
+	    if (notes_[i].command_ == index && notes_[i].loop_ == loop)
+	    {
+		return i;
+	    }
+	}
+	return -1;
+    }
+
+private:
+    void parseLine(const String& line)
+    {
+	StringArray tokens;
+	tokens.addTokens(line.upToFirstOccurrenceOf("#", false, false), " \t", "");
+	tokens.removeEmptyStrings();
+	if (tokens.size() < 6 || !tokens[0].containsOnly("0123456789") || !tokens[2].containsOnly("0123456789"))
+	{
+	    return;
+	}
+
+	const int number = tokens[2].getIntValue();
+	Binding* table = tokens[1] == "n" || tokens[1] == "on" || tokens[1] == "off" ? notes_
+	    : tokens[1] == "cc" ? controllers_ : nullptr;
+	if (table == nullptr || !isPositiveAndBelow(number, size))
+	{
+	    return;
+	}
+
+	int command = commandNames_.indexOf(tokens[4]);
+	if (command < 0)
+	{
+	    if (commandNames_.size() >= 127)
+	    {
+		return;
+	    }
+	    command = commandNames_.size();
+	    commandNames_.add(tokens[4]);
+	}
+	Binding& binding = table[number];
+	binding.command_ = (int8) command;
+	binding.channel_ = (int8) jlimit(0, 15, tokens[0].getIntValue());
+	binding.loop_ = (int16) tokens[5].getIntValue();
+	++numBindings_;
+    }
+
+    Binding notes_[size];
+    Binding controllers_[size];
+    StringArray commandNames_;
+    File file_;
+    int64 hash_ = 0;
+    int numBindings_ = 0;
+
+    JUCE_DECLARE_NON_COPYABLE(SlbBindings)
+};
+
+//==============================================================================
+// The note each pedal sends, worked out once so a pedal event is one indexed
+// load: a loop pedal's by loop and mode, the other pedals' by their offset.
+// Starts out as the base note plus the offset (plus 20 in record mode for the
+// loops) and takes the loop notes from the bindings when there are some.
+class PedalNotes
+{
+public:
+    static const int size = 128;
+    static const int recordOffset = 20;
+
+    PedalNotes()
+    {
+	setBase(0);
+    }
+
+    void setBase(int baseNote)
+    {
+	for (int i = 0; i < size; ++i)
+	{
+	    play_[i] = (uint8) jlimit(0, 127, baseNote + i);
+	    record_[i] = (uint8) jlimit(0, 127, baseNote + recordOffset + i);
+	    other_[i] = (uint8) jlimit(0, 127, baseNote + i);
+	}
+    }
+
+    // Loops 0 to numLoops - 1 play mute_trigger and record with
+    // record_or_overdub_excl where the bindings say which note does that,
+    // and the other pedals' notes have to be bound to something. What doesn't
+    // match the base note layout is added to problems.
+    void applyBindings(const SlbBindings& bindings, int numLoops, const Array<int>& otherOffsets, int channel,
+		       StringArray& problems)
+    {
+	for (int loop = 0; loop < jmin(numLoops, size); ++loop)
+	{
+	    applyLoop(bindings, "mute_trigger", loop, channel, play_[loop], problems);
+	    applyLoop(bindings, "record_or_overdub_excl", loop, channel, record_[loop], problems);
+	}
+	for (int offset : otherOffsets)
+	{
+	    const int note = other_[offset & 0x7f];
+	    if (bindings.getNote(note).command_ < 0)
+	    {
+		problems.add("nothing is bound to note " + String(note) + ", which pedal " + String(offset + 1) + " sends");
+	    }
+	}
+    }
+
+    int getLoopNote(bool record, int loop) const    { return (record ? record_ : play_)[loop & 0x7f]; }
+    int getNote(int offset) const                   { return other_[offset & 0x7f]; }
+
+private:
+    static void applyLoop(const SlbBindings& bindings, const char* command, int loop, int channel, uint8& note,
+			  StringArray& problems)
+    {
+	const int bound = bindings.findNote(command, loop);
+	if (bound < 0)
+	{
+	    problems.add(String("no ") + command + " for loop " + String(loop) + ", note " + String(note)
+			 + " is sent for it and may do something else");
+	    return;
+	}
+	if (bound != note)
+	{
+	    problems.add(String(command) + " for loop " + String(loop) + " is note " + String(bound) + ", not "
+			 + String(note) + ", sending " + String(bound));
+	    note = (uint8) bound;
+	}
+	if (channel > 0 && bindings.getNote(bound).channel_ != channel - 1)
+	{
+	    problems.add(String(command) + " for loop " + String(loop) + " is bound on channel "
+			 + String(bindings.getNote(bound).channel_ + 1) + ", we send on " + String(channel));
+	}
+    }
+
+    uint8 play_[size];
+    uint8 record_[size];
+    uint8 other_[size];
+
+    JUCE_DECLARE_NON_COPYABLE(PedalNotes)
+};
+
+//==============================================================================
+// What "slcmd" sends SooperLooper in place of a pedal's note: the command the
+// bindings have on that note, as /sl/N/down for the note on and /sl/N/up for
+// the note off, the way SooperLooper's own MIDI binding runs it. Encoded once
+// per note, so a pedal is a copy out of the table and one datagram, without
+// the ALSA hop and the binding lookup on SooperLooper's side. Notes bound to
+// nothing or to a global command have no packets and stay notes.
+class PedalCommands
+{
+public:
+    static const int size = 128;
+
+    PedalCommands() {}
+
+    void clear()
+    {
+	for (int i = 0; i < size; ++i)
+	{
+	    down_[i].clear();
+	    up_[i].clear();
+	}
+	numCommands_ = 0;
+    }
+
+    // every note the bindings give a loop (or all or the selected loop) a command on
+    void build(const SlbBindings& bindings)
+    {
+	clear();
+	for (int note = 0; note < size; ++note)
+	{
+	    const SlbBindings::Binding& binding = bindings.getNote(note);
+	    if (binding.command_ >= 0 && binding.loop_ != -2)
+	    {
+		set(note, binding.loop_, bindings.getCommandName(binding).toRawUTF8());
+	    }
+	}
+    }
+
+    // without bindings, the base note layout: every loop's play note is its
+    // mute_trigger and its record note its record_or_overdub_excl
+    void build(const PedalNotes& notes, int numLoops)
+    {
+	clear();
+	for (int loop = 0; loop < jmin(numLoops, size); ++loop)
+	{
+	    set(notes.getLoopNote(false, loop), loop, "mute_trigger");
+	    set(notes.getLoopNote(true, loop), loop, "record_or_overdub_excl");
+	}
+    }
+
+    // nullptr for a note that stays a note
+    const OscPacket* get(int note, bool down) const
+    {
+	const OscPacket& packet = (down ? down_ : up_)[note & 0x7f];
+	return packet.isValid() ? &packet : nullptr;
+    }
+
+    int getNumCommands() const          { return numCommands_; }
+
+private:
+    void set(int note, int loop, const char* command)
+    {
+	char address[32];
+	std::snprintf(address, sizeof(address), "/sl/%d/down", loop);
+	OscPacket& down = down_[note & 0x7f];
+	down.size_ = OscMessageWriter(down).begin(address, "s").addString(command).size();
+	std::snprintf(address, sizeof(address), "/sl/%d/up", loop);
+	OscPacket& up = up_[note & 0x7f];
+	up.size_ = OscMessageWriter(up).begin(address, "s").addString(command).size();
+	if (down.isValid() && up.isValid())
+	{
+	    ++numCommands_;
+	}
+	else
+	{
+	    down.clear();
+	    up.clear();
+	}
+    }
+
+    OscPacket down_[size];
+    OscPacket up_[size];
+    int numCommands_ = 0;
+
+    JUCE_DECLARE_NON_COPYABLE(PedalCommands)
+};
@@ -0,0 +1,122 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include <ostream>
+
+#if JUCE_LINUX
+ #include <malloc.h>
+ #include <unistd.h>
+#endif
+
+//==============================================================================
+// The process's memory at one moment: resident set from /proc/self/statm and
+// the malloc heap's bytes in use and free (glibc's mallinfo), the free part
+// being what fragmentation keeps from going back to the system.
+struct MemorySample
+{
+    double seconds_ = 0;        // since the soak started
+    int64 rss_ = 0;
+    int64 heapInUse_ = 0;
+    int64 heapFree_ = 0;
+
+    static MemorySample take(double seconds)
+    {
+	MemorySample sample;
+	sample.seconds_ = seconds;
+#if JUCE_LINUX
+	StringArray statm;
+	statm.addTokens(File("/proc/self/statm").loadFileAsString(), " ", "");
+	sample.rss_ = statm[1].getLargeIntValue() * (int64) ::sysconf(_SC_PAGESIZE);
+ #if defined (__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+	const struct mallinfo2 info = ::mallinfo2();
+ #elif defined (__GLIBC__)
+	const struct mallinfo info = ::mallinfo();
+ #endif
+ #if defined (__GLIBC__)
+	sample.heapInUse_ = (int64) info.uordblks + (int64) info.hblkhd;
+	sample.heapFree_ = (int64) info.fordblks;
+ #endif
+#endif
+	return sample;
+    }
+
+    // free heap as a share of the heap, 0-1
+    double getFragmentation() const
+    {
+	const int64 heap = heapInUse_ + heapFree_;
+	return heap > 0 ? (double) heapFree_ / (double) heap : 0.0;
+    }
+
+    void print(std::ostream& out) const
+    {
+	out << String(seconds_, 1).paddedLeft(' ', 8) << "s  rss " << rss_ / 1024 << "KB  heap "
+	    << heapInUse_ / 1024 << "KB in use, " << heapFree_ / 1024 << "KB free ("
+	    << roundToInt(getFragmentation() * 100.0) << "% fragmented)" << std::endl;
+    }
+};
+
+//==============================================================================
+// Memory samples over a soak and how fast they grew: the least squares slope
+// of the RSS and the heap in use against time, leaving out the first tenth
+// while caches and pools fill up.
+class MemoryGrowth
+{
+public:
+    void add(const MemorySample& sample)    { samples_.add(sample); }
+    int size() const                        { return samples_.size(); }
+    const MemorySample& getLast() const     { return samples_.getReference(samples_.size() - 1); }
+
+    double getRssSlopeKBPerHour() const         { return getSlope([] (const MemorySample& s) { return (double) s.rss_; }); }
+    double getHeapSlopeKBPerHour() const        { return getSlope([] (const MemorySample& s) { return (double) s.heapInUse_; }); }
+
+private:
+    template <typename Field>
+    double getSlope(Field field) const
+    {
+	const int first = samples_.size() / 10;
+	const int count = samples_.size() - first;
+	if (count < 2)
+	{
+	    return 0;
+	}
+
+	double meanT = 0, meanY = 0;
+	for (int i = first; i < samples_.size(); ++i)
+	{
+	    meanT += samples_.getReference(i).seconds_;
+	    meanY += field(samples_.getReference(i));
+	}
+	meanT /= count;
+	meanY /= count;
+
+	double covariance = 0, variance = 0;
+	for (int i = first; i < samples_.size(); ++i)
+	{
+	    const double dt = samples_.getReference(i).seconds_ - meanT;
+	    covariance += dt * (field(samples_.getReference(i)) - meanY);
+	    variance += dt * dt;
+	}
+	// bytes per second to KB per hour
+	return variance > 0 ? covariance / variance * 3600.0 / 1024.0 : 0;
+    }
+
+    Array<MemorySample> samples_;
+};
@@ -0,0 +1,461 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "LoopStore.h"
+#include "OscPacket.h"
+#include <atomic>
+#include <cmath>
+#include <ostream>
+#include <queue>
+#include <vector>
+
+//==============================================================================
+// Enough of SooperLooper's OSC server to load test against: /ping answered
+// on the path it names, /get, /register_auto_update and /register_update
+// (with their unregisters) for any loop or -1 for all of them, the global
+// selected_loop_num and tempo, /set and /sl/N/hit (/sl/N/down too, /up does
+// nothing). Loops also change state
+// on their own every so often, so change updates have something to report.
+// Auto updates go out every updateIntervalMs whatever interval was asked
+// for. Every reply can be dropped (lossPercent) or held back by delayMs plus
+// up to jitterMs, which can reorder them the way a network would.
+class SooperLooperSimulator : private Thread
+{
+public:
+    struct Options
+    {
+	int port_ = 9951;
+	int loops_ = 8;
+	int updateIntervalMs_ = 100;
+	int changeIntervalMs_ = 1000;       // between spontaneous state changes, 0 for none
+	double lossPercent_ = 0;
+	int delayMs_ = 0;
+	int jitterMs_ = 0;
+    };
+
+    SooperLooperSimulator() : Thread("loop4r sim") {}
+
+    ~SooperLooperSimulator()
+    {
+	stop();
+    }
+
+    bool start(const Options& options)
+    {
+	stop();
+	options_ = options;
+	options_.loops_ = jmax(1, options_.loops_);
+	options_.updateIntervalMs_ = jmax(1, options_.updateIntervalMs_);
+	socket_ = new DatagramSocket(false);
+	if (!socket_->bindToPort(options_.port_))
+	{
+	    socket_ = nullptr;
+	    return false;
+	}
+	states_.assign((size_t) options_.loops_, (int) Playing);
+	subscribers_.clear();
+	startThread();
+	return true;
+    }
+
+    void stop()
+    {
+	if (socket_ != nullptr)
+	{
+	    signalThreadShouldExit();
+	    socket_->shutdown();
+	    stopThread(1000);
+	    socket_ = nullptr;
+	}
+    }
+
+    int getNumSubscribers() const       { return numSubscribers_.load(); }
+
+    // what came in and went out since the last call
+    void printStats(std::ostream& out, double seconds)
+    {
+	const int64 received = received_.exchange(0);
+	const int64 sent = sent_.exchange(0);
+	const int64 dropped = dropped_.exchange(0);
+	out << "sim: " << received << " received, " << sent << " sent (" << roundToInt(sent / jmax(0.001, seconds))
+	    << "/s), " << dropped << " dropped, " << numSubscribers_.load() << " subscriptions, "
+	    << numDelayed_.load() << " delayed" << std::endl;
+    }
+
+private:
+    struct Subscriber
+    {
+	String host_;
+	int port_;
+	String path_;
+	String control_;
+	int loop_;          // -1 every loop, -2 global, -3 the selected loop
+	bool changes_;      // only when it changes, rather than every update interval
+    };
+
+    struct Delayed
+    {
+	double due_;
+	int64 order_;       // keeps equal due times in sending order
+	String host_;
+	int port_;
+	OscPacket packet_;
+
+	bool operator> (const Delayed& other) const
+	{
+	    return due_ != other.due_ ? due_ > other.due_ : order_ > other.order_;
+	}
+    };
+
+    void run() override
+    {
+	char buffer[2048];
+	double nextUpdate = Time::getMillisecondCounterHiRes();
+	double nextChange = nextUpdate + options_.changeIntervalMs_;
+	while (!threadShouldExit())
+	{
+	    const double now = Time::getMillisecondCounterHiRes();
+	    double wake = nextUpdate;
+	    if (!delayed_.empty())
+	    {
+		wake = jmin(wake, delayed_.top().due_);
+	    }
+	    if (options_.changeIntervalMs_ > 0)
+	    {
+		wake = jmin(wake, nextChange);
+	    }
+	    // rounded up, a wait of less than a millisecond would spin until it's due
+	    if (socket_->waitUntilReady(true, jmax(0, (int) std::ceil(wake - now))) == 1)
+	    {
+		String senderHost;
+		int senderPort = 0;
+		const int size = socket_->read(buffer, sizeof(buffer), false, senderHost, senderPort);
+		if (size > 0)
+		{
+		    ++received_;
+		    OscMessageReader::readPacket(buffer, size, [this] (const OscMessageView& message) { handle(message); });
+		}
+	    }
+
+	    const double after = Time::getMillisecondCounterHiRes();
+	    if (after >= nextUpdate)
+	    {
+		sendAutoUpdates();
+		// a slow pass skips the missed updates rather than bursting them
+		nextUpdate = jmax(nextUpdate + options_.updateIntervalMs_, after);
+	    }
+	    if (options_.changeIntervalMs_ > 0 && after >= nextChange)
+	    {
+		const LoopStates changes[] = { Recording, Playing, Overdubbing, Multiplying, Muted, Paused };
+		setState(random_.nextInt(options_.loops_), changes[random_.nextInt(numElementsInArray(changes))]);
+		nextChange += options_.changeIntervalMs_;
+	    }
+	    while (!delayed_.empty() && delayed_.top().due_ <= after)
+	    {
+		const Delayed& next = delayed_.top();
+		socket_->write(next.host_, next.port_, next.packet_.data_, next.packet_.size_);
+		delayed_.pop();
+	    }
+	    numDelayed_ = (int) delayed_.size();
+	}
+    }
+
+    void handle(const OscMessageView& message)
+    {
+	const char* address = message.getAddress();
+	if (std::strcmp(address, "/ping") == 0 && message.isString(0) && message.isString(1))
+	{
+	    OscPacket reply;
+	    char url[64];
+	    std::snprintf(url, sizeof(url), "osc.udp://localhost:%d/", options_.port_);
+	    reply.size_ = OscMessageWriter(reply).begin(message.getString(1), "ssii")
+		.addString(url).addString("1.7.3").addInt32(options_.loops_).addInt32(options_.port_).size();
+	    sendTo(message.getString(0), reply);
+	}
+	else if (std::strcmp(address, "/set") == 0 && message.isString(0) && message.isFloat32(1))
+	{
+	    if (message.isString(0, "selected_loop_num"))
+	    {
+		selectedLoop_ = jlimit(0, options_.loops_ - 1, (int) message.getFloat32(1));
+		notifyGlobal("selected_loop_num");
+	    }
+	    else if (message.isString(0, "tempo"))
+	    {
+		tempo_ = message.getFloat32(1);
+		notifyGlobal("tempo");
+	    }
+	}
+	else if (std::strcmp(address, "/get") == 0 && message.size() >= 3 && message.isString(0) && message.isString(1) && message.isString(2))
+	{
+	    reply(message.getString(1), message.getString(2), -2, message.getString(0));
+	}
+	else if (std::strcmp(address, "/register_update") == 0 || std::strcmp(address, "/unregister_update") == 0)
+	{
+	    if (message.size() >= 3 && message.isString(0) && message.isString(1) && message.isString(2))
+	    {
+		subscribe(address[1] == 'r', message.getString(1), message.getString(2), message.getString(0), -2, true);
+	    }
+	}
+	else if (std::strncmp(address, "/sl/", 4) == 0)
+	{
+	    char* end = nullptr;
+	    const int loop = (int) std::strtol(address + 4, &end, 10);
+	    if (end == address + 4 || *end != '/')
+	    {
+		return;
+	    }
+	    const char* method = end + 1;
+	    if (std::strcmp(method, "get") == 0 && message.size() >= 3 && message.isString(0) && message.isString(1) && message.isString(2))
+	    {
+		forEachLoop(loop, [&] (int index) { reply(message.getString(1), message.getString(2), index, message.getString(0)); });
+	    }
+	    else if ((std::strcmp(method, "register_auto_update") == 0 || std::strcmp(method, "unregister_auto_update") == 0)
+		     && message.size() >= 4 && message.isString(0) && message.isString(2) && message.isString(3))
+	    {
+		subscribe(method[0] == 'r', message.getString(2), message.getString(3), message.getString(0), loop, false);
+	    }
+	    else if ((std::strcmp(method, "register_update") == 0 || std::strcmp(method, "unregister_update") == 0)
+		     && message.size() >= 3 && message.isString(0) && message.isString(1) && message.isString(2))
+	    {
+		subscribe(method[0] == 'r', message.getString(1), message.getString(2), message.getString(0), loop, true);
+	    }
+	    else if (std::strcmp(method, "hit") == 0 && message.isString(0))
+	    {
+		forEachLoop(loop, [&] (int index) { hit(index, message.getString(0)); });
+	    }
+	    else if (std::strcmp(method, "down") == 0 && message.isString(0))
+	    {
+		forEachLoop(loop, [&] (int index) { press(index, message.getString(0)); });
+	    }
+	}
+    }
+
+    // a binding's command pressed: the momentary commands the pedals are
+    // bound to as the hit they come down to
+    void press(int loop, const char* command)
+    {
+	if (std::strncmp(command, "record_or_overdub", 17) == 0)
+	{
+	    hit(loop, states_[(size_t) loop] == Off || states_[(size_t) loop] == Recording ? "record" : "overdub");
+	    return;
+	}
+	const char* trigger = std::strstr(command, "_trigger");
+	if (trigger != nullptr)
+	{
+	    hit(loop, String(command, (size_t) (trigger - command)).toRawUTF8());
+	    return;
+	}
+	hit(loop, command);
+    }
+
+    // what a hit does, roughly: the same command again goes back to playing
+    void hit(int loop, const char* command)
+    {
+	const struct { const char* command_; LoopStates state_; } commands[] =
+	{
+	    { "record", Recording }, { "overdub", Overdubbing }, { "multiply", Multiplying }, { "insert", Inserting },
+	    { "replace", Replacing }, { "mute", Muted }, { "pause", Paused }, { "substitute", Substitute }
+	};
+	for (auto& entry : commands)
+	{
+	    if (std::strcmp(entry.command_, command) == 0)
+	    {
+		setState(loop, states_[(size_t) loop] == entry.state_ ? Playing : entry.state_);
+		return;
+	    }
+	}
+	if (std::strcmp(command, "trigger") == 0 || std::strcmp(command, "oneshot") == 0)
+	{
+	    setState(loop, Playing);
+	}
+    }
+
+    template <typename Function>
+    void forEachLoop(int loop, Function&& function)
+    {
+	if (loop == -1)
+	{
+	    for (int i = 0; i < options_.loops_; ++i)
+	    {
+		function(i);
+	    }
+	}
+	else if (loop == -3)
+	{
+	    function(selectedLoop_);
+	}
+	else if (isPositiveAndBelow(loop, options_.loops_))
+	{
+	    function(loop);
+	}
+    }
+
+    void subscribe(bool add, const String& url, const String& path, const String& control, int loop, bool changes)
+    {
+	String host;
+	int port = 0;
+	if (!parseUrl(url, host, port))
+	{
+	    return;
+	}
+	for (int i = subscribers_.size(); --i >= 0;)
+	{
+	    const Subscriber& s = subscribers_.getReference(i);
+	    if (s.port_ == port && s.loop_ == loop && s.changes_ == changes && s.host_ == host && s.path_ == path && s.control_ == control)
+	    {
+		subscribers_.remove(i);
+	    }
+	}
+	if (add)
+	{
+	    subscribers_.add({ host, port, path, control, loop, changes });
+	}
+	numSubscribers_ = subscribers_.size();
+    }
+
+    void setState(int loop, LoopStates state)
+    {
+	if (states_[(size_t) loop] == (int) state)
+	{
+	    return;
+	}
+	states_[(size_t) loop] = (int) state;
+	for (auto& s : subscribers_)
+	{
+	    if (s.changes_ && s.control_ == "state" && (s.loop_ == -1 || s.loop_ == loop || (s.loop_ == -3 && loop == selectedLoop_)))
+	    {
+		send(s.host_, s.port_, makeReply(s.path_, loop, "state"));
+	    }
+	}
+    }
+
+    void notifyGlobal(const char* control)
+    {
+	for (auto& s : subscribers_)
+	{
+	    if (s.changes_ && s.loop_ == -2 && s.control_ == control)
+	    {
+		send(s.host_, s.port_, makeReply(s.path_, -2, control));
+	    }
+	}
+    }
+
+    void sendAutoUpdates()
+    {
+	for (auto& s : subscribers_)
+	{
+	    if (!s.changes_)
+	    {
+		forEachLoop(s.loop_, [&] (int index) { send(s.host_, s.port_, makeReply(s.path_, index, s.control_.toRawUTF8())); });
+	    }
+	}
+    }
+
+    void reply(const String& url, const String& path, int loop, const String& control)
+    {
+	sendTo(url, makeReply(path, loop, control.toRawUTF8()));
+    }
+
+    // "isf" loop control value, loop_pos always being the selected loop's,
+    // counting up through an eight second loop of one cycle
+    OscPacket makeReply(const String& path, int loop, const char* control)
+    {
+	float value = 0;
+	if (loop == -2)
+	{
+	    value = std::strcmp(control, "tempo") == 0 ? tempo_ : (float) selectedLoop_;
+	}
+	else if (std::strcmp(control, "loop_pos") == 0)
+	{
+	    loop = selectedLoop_;
+	    value = (float) std::fmod(Time::getMillisecondCounterHiRes() / 1000.0, 8.0);
+	}
+	else if (isPositiveAndBelow(loop, options_.loops_) && (std::strcmp(control, "loop_len") == 0 || std::strcmp(control, "cycle_len") == 0))
+	{
+	    value = 8.0f;
+	}
+	else if (isPositiveAndBelow(loop, options_.loops_))
+	{
+	    value = std::strcmp(control, "state") == 0 ? (float) states_[(size_t) loop] : 0.0f;
+	}
+	OscPacket packet;
+	packet.size_ = OscMessageWriter(packet).begin(path.toRawUTF8(), "isf").addInt32(loop).addString(control).addFloat32(value).size();
+	return packet;
+    }
+
+    void sendTo(const String& url, const OscPacket& packet)
+    {
+	String host;
+	int port = 0;
+	if (parseUrl(url, host, port))
+	{
+	    send(host, port, packet);
+	}
+    }
+
+    void send(const String& host, int port, const OscPacket& packet)
+    {
+	if (!packet.isValid())
+	{
+	    return;
+	}
+	++sent_;
+	if (options_.lossPercent_ > 0 && random_.nextDouble() * 100.0 < options_.lossPercent_)
+	{
+	    ++dropped_;
+	}
+	else if (options_.delayMs_ > 0 || options_.jitterMs_ > 0)
+	{
+	    const double jitter = options_.jitterMs_ > 0 ? random_.nextDouble() * options_.jitterMs_ : 0.0;
+	    delayed_.push({ Time::getMillisecondCounterHiRes() + options_.delayMs_ + jitter, order_++, host, port, packet });
+	}
+	else
+	{
+	    socket_->write(host, port, packet.data_, packet.size_);
+	}
+    }
+
+    // "osc.udp://host:port/"
+    static bool parseUrl(const String& url, String& host, int& port)
+    {
+	const String rest = url.fromFirstOccurrenceOf("://", false, false);
+	host = rest.upToLastOccurrenceOf(":", false, false);
+	port = rest.fromLastOccurrenceOf(":", false, false).getIntValue();
+	return host.isNotEmpty() && port > 0;
+    }
+
+    Options options_;
+    ScopedPointer<DatagramSocket> socket_;
+    std::vector<int> states_;
+    int selectedLoop_ = 0;
+    float tempo_ = 120.0f;
+    Array<Subscriber> subscribers_;
+    std::priority_queue<Delayed, std::vector<Delayed>, std::greater<Delayed>> delayed_;
+    int64 order_ = 0;
+    Random random_;
+    std::atomic<int64> received_ { 0 };
+    std::atomic<int64> sent_ { 0 };
+    std::atomic<int64> dropped_ { 0 };
+    std::atomic<int> numSubscribers_ { 0 };
+    std::atomic<int> numDelayed_ { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE(SooperLooperSimulator)
+};
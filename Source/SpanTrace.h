@@ -0,0 +1,265 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+//==============================================================================
+// What each thread was doing, as begin/end spans written out as Chrome
+// trace-event JSON for chrome://tracing or ui.perfetto.dev. Every thread
+// records into a ring of its own, claimed the first time it records, so a
+// span is two tick reads and a store nobody else writes to; while recording
+// is off a span costs the one branch on isEnabled(). Past maxThreads threads
+// the rest go unrecorded.
+//
+// write() copies the rings while they're still being written and drops
+// whatever was overwritten during the copy, so it may run on any thread at
+// any time. Span names are kept as pointers and must be string literals.
+//
+// Each name also has a running count and total time, kept while recording
+// is on, which is what's left of a span once the ring has moved past it:
+// the first maxNames names get a slot, claimed like the metrics' OSC
+// addresses, and two relaxed adds per span.
+class SpanTrace
+{
+public:
+    static const int maxThreads = 16;
+    static const int defaultNumSpans = 16384;      // per thread
+    static const int maxThreadName = 32;
+    static const int maxNames = 32;
+
+    SpanTrace() {}
+
+    // Makes every thread's ring numSpans long. Only before anything has
+    // recorded, later calls keep the rings they have
+    void allocate(int numSpans = defaultNumSpans)
+    {
+	if (numSpans_ == 0)
+	{
+	    numSpans_ = jmax(16, numSpans);
+	    for (auto&& ring : rings_)
+	    {
+		ring.spans_.calloc((size_t) numSpans_);
+	    }
+	    startTicks_ = Time::getHighResolutionTicks();
+	}
+    }
+
+    void setEnabled(bool enabled)       { enabled_.store(enabled && numSpans_ > 0, std::memory_order_relaxed); }
+    bool isEnabled() const              { return enabled_.load(std::memory_order_relaxed); }
+    int getNumSpans() const             { return numSpans_; }
+
+    // ticks are Time::getHighResolutionTicks() values
+    void record(const char* name, int64 startTicks, int64 endTicks)
+    {
+	Ring* ring = getRing();
+	if (ring != nullptr)
+	{
+	    const uint64 next = ring->next_.load(std::memory_order_relaxed);
+	    Span& span = ring->spans_[(size_t) (next % (uint64) numSpans_)];
+	    span.name_ = name;
+	    span.start_ = startTicks;
+	    span.end_ = endTicks;
+	    ring->next_.store(next + 1, std::memory_order_release);
+	}
+	Total* total = findTotal(name);
+	if (total != nullptr)
+	{
+	    total->count_.fetch_add(1, std::memory_order_relaxed);
+	    total->ticks_.fetch_add(endTicks - startTicks, std::memory_order_relaxed);
+	}
+    }
+
+    // fn(name, count, seconds) for every name recorded so far
+    template <typename Function>
+    void forEachTotal(Function fn) const
+    {
+	for (auto&& total : totals_)
+	{
+	    const char* name = total.name_.load(std::memory_order_acquire);
+	    if (name != nullptr)
+	    {
+		fn(name, (int64) total.count_.load(std::memory_order_relaxed),
+		   Time::highResolutionTicksToSeconds(total.ticks_.load(std::memory_order_relaxed)));
+	    }
+	}
+    }
+
+    // one span for as long as it's in scope, from when recording was on
+    class Scope
+    {
+    public:
+	Scope(SpanTrace* trace, const char* name)
+	    : trace_(trace != nullptr && trace->isEnabled() ? trace : nullptr), name_(name),
+	      start_(trace_ != nullptr ? Time::getHighResolutionTicks() : 0)
+	{
+	}
+
+	~Scope()
+	{
+	    if (trace_ != nullptr)
+	    {
+		trace_->record(name_, start_, Time::getHighResolutionTicks());
+	    }
+	}
+
+    private:
+	SpanTrace* trace_;
+	const char* name_;
+	int64 start_;
+
+	JUCE_DECLARE_NON_COPYABLE(Scope)
+    };
+
+    // The spans recorded so far (what the rings still hold) as Chrome JSON,
+    // returns how many went in or -1 if the file couldn't be written
+    int write(const File& file) const
+    {
+	file.deleteFile();
+	FileOutputStream out(file);
+	if (out.failedToOpen())
+	{
+	    return -1;
+	}
+
+	HeapBlock<Span> copy((size_t) jmax(1, numSpans_));
+	const double microsPerTick = 1.0e6 / (double) Time::getHighResolutionTicksPerSecond();
+	int numWritten = 0;
+	bool first = true;
+	out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	for (int i = 0; i < maxThreads; ++i)
+	{
+	    const Ring& ring = rings_[i];
+	    if (!ring.claimed_.load(std::memory_order_acquire))
+	    {
+		continue;
+	    }
+	    out << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << (i + 1)
+		<< ",\"args\":{\"name\":\"" << ring.threadName_ << "\"}}";
+	    first = false;
+
+	    // anything the writer may have got to again while we copied is dropped
+	    const uint64 end = ring.next_.load(std::memory_order_acquire);
+	    const uint64 begin = end > (uint64) numSpans_ ? end - (uint64) numSpans_ : 0;
+	    for (uint64 n = begin; n < end; ++n)
+	    {
+		copy[(size_t) (n - begin)] = ring.spans_[(size_t) (n % (uint64) numSpans_)];
+	    }
+	    const uint64 overwritten = ring.next_.load(std::memory_order_acquire);
+	    const uint64 valid = jmax(begin, overwritten >= (uint64) numSpans_ ? overwritten - (uint64) numSpans_ + 1 : 0);
+	    for (uint64 n = valid; n < end; ++n)
+	    {
+		const Span& span = copy[(size_t) (n - begin)];
+		out << ",\n{\"name\":\"" << span.name_ << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << (i + 1)
+		    << ",\"ts\":" << String((double) (span.start_ - startTicks_) * microsPerTick, 3)
+		    << ",\"dur\":" << String((double) (span.end_ - span.start_) * microsPerTick, 3) << "}";
+		++numWritten;
+	    }
+	}
+	out << "\n]}\n";
+	out.flush();
+	return out.getStatus().wasOk() ? numWritten : -1;
+    }
+
+private:
+    struct Span
+    {
+	const char* name_;
+	int64 start_;
+	int64 end_;
+    };
+
+    struct Ring
+    {
+	HeapBlock<Span> spans_;
+	std::atomic<uint64> next_ { 0 };        // spans written so far, the next goes at next_ % numSpans_
+	std::atomic<bool> claimed_ { false };
+	char threadName_[maxThreadName] = {};
+	char padding_[64];                      // keeps next_ off the neighbour's cache line
+    };
+
+    struct Total
+    {
+	std::atomic<const char*> name_ { nullptr };
+	std::atomic<uint64> count_ { 0 };
+	std::atomic<int64> ticks_ { 0 };
+    };
+
+    // name's slot, claiming a free one the first time, nullptr once they're
+    // all taken; a literal has the one address, so the pointer is the key
+    Total* findTotal(const char* name)
+    {
+	const uint32 hash = (uint32) (((pointer_sized_uint) name >> 3) * 2654435761u);
+	for (int probe = 0; probe < maxNames; ++probe)
+	{
+	    Total& total = totals_[(hash + (uint32) probe) % maxNames];
+	    const char* seen = total.name_.load(std::memory_order_acquire);
+	    if (seen == nullptr && total.name_.compare_exchange_strong(seen, name, std::memory_order_acq_rel))
+	    {
+		return &total;
+	    }
+	    if (seen == name)
+	    {
+		return &total;
+	    }
+	}
+	return nullptr;
+    }
+
+    // this thread's, nullptr once they're all taken
+    Ring* getRing()
+    {
+	thread_local int index = -1;
+	if (index == -1)
+	{
+	    index = claimRing();
+	}
+	return index >= 0 ? &rings_[index] : nullptr;
+    }
+
+    int claimRing()
+    {
+	const int index = nextRing_.fetch_add(1, std::memory_order_relaxed);
+	if (index >= maxThreads)
+	{
+	    return -2;
+	}
+
+	Ring& ring = rings_[index];
+	const Thread* thread = Thread::getCurrentThread();
+	const String name = thread != nullptr ? thread->getThreadName()
+	    : MessageManager::getInstanceWithoutCreating() != nullptr && MessageManager::getInstance()->isThisTheMessageThread() ? String("message thread")
+	    : "thread " + String(index + 1);
+	name.removeCharacters("\"\\").copyToUTF8(ring.threadName_, maxThreadName);
+	ring.claimed_.store(true, std::memory_order_release);
+	return index;
+    }
+
+    int numSpans_ = 0;
+    int64 startTicks_ = 0;
+    std::atomic<bool> enabled_ { false };
+    std::atomic<int> nextRing_ { 0 };
+    Ring rings_[maxThreads];
+    Total totals_[maxNames];
+
+    JUCE_DECLARE_NON_COPYABLE(SpanTrace)
+};
@@ -0,0 +1,101 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+//==============================================================================
+// A chain of event handling stages fixed at compile time. A stage is anything
+// callable with the event that returns true to hand it on, false when it's
+// done with it; the chain stops at the first false. The stages are members of
+// the chain by value, lambdas mostly, so
+//
+//     makeStagePipeline(decode, filter, route, log)(event)
+//
+// comes out as decode(event) && filter(event) && ... with nothing virtual in
+// the way, and inlines to straight-line code the way one long function
+// would. A stage wrapped in whenEnabled() costs a test and a branch while
+// it's off.
+template <typename... Stages>
+class StagePipeline;
+
+template <>
+class StagePipeline<>
+{
+public:
+    template <typename Event>
+    bool operator()(Event&)
+    {
+	return true;
+    }
+};
+
+template <typename First, typename... Rest>
+class StagePipeline<First, Rest...>
+{
+public:
+    StagePipeline(First first, Rest... rest)
+	: first_(first), rest_(rest...)
+    {
+    }
+
+    // false if a stage kept the event
+    template <typename Event>
+    bool operator()(Event& event)
+    {
+	return first_(event) && rest_(event);
+    }
+
+private:
+    First first_;
+    StagePipeline<Rest...> rest_;
+};
+
+template <typename... Stages>
+StagePipeline<Stages...> makeStagePipeline(Stages... stages)
+{
+    return StagePipeline<Stages...>(stages...);
+}
+
+// a stage that's passed over unless enabled
+template <typename Stage>
+class OptionalStage
+{
+public:
+    OptionalStage(bool enabled, Stage stage)
+	: enabled_(enabled), stage_(stage)
+    {
+    }
+
+    template <typename Event>
+    bool operator()(Event& event)
+    {
+	return !enabled_ || stage_(event);
+    }
+
+private:
+    bool enabled_;
+    Stage stage_;
+};
+
+template <typename Stage>
+OptionalStage<Stage> whenEnabled(bool enabled, Stage stage)
+{
+    return OptionalStage<Stage>(enabled, stage);
+}
@@ -0,0 +1,263 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include <atomic>
+#include <cstring>
+
+//==============================================================================
+// Little-endian ints and bytes into a fixed buffer. Anything past the end is
+// dropped and remembered, so the caller only has to check once at the end.
+class SnapshotWriter
+{
+public:
+    static const int capacity = 8192;
+
+    void reset()                        { size_ = 0; overflowed_ = false; }
+
+    void addByte(int value)
+    {
+	if (size_ >= capacity)
+	{
+	    overflowed_ = true;
+	    return;
+	}
+	data_[size_++] = (uint8) value;
+    }
+
+    void addInt(int value)
+    {
+	for (int i = 0; i < 4; ++i)
+	{
+	    addByte((int) (((uint32) value >> (8 * i)) & 0xff));
+	}
+    }
+
+    const uint8* getData() const        { return data_; }
+    int getSize() const                 { return size_; }
+    bool hasOverflowed() const          { return overflowed_; }
+
+private:
+    uint8 data_[capacity];
+    int size_ = 0;
+    bool overflowed_ = false;
+};
+
+// The other way round; reads past the end give 0.
+class SnapshotReader
+{
+public:
+    SnapshotReader(const void* data, size_t size)
+	: data_(static_cast<const uint8*>(data)), size_(size)
+    {
+    }
+
+    int readByte()
+    {
+	return pos_ < size_ ? data_[pos_++] : 0;
+    }
+
+    int readInt()
+    {
+	uint32 value = 0;
+	for (int i = 0; i < 4; ++i)
+	{
+	    value |= (uint32) readByte() << (8 * i);
+	}
+	return (int) value;
+    }
+
+    bool isExhausted() const            { return pos_ >= size_; }
+
+private:
+    const uint8* data_;
+    size_t size_;
+    size_t pos_ = 0;
+};
+
+//==============================================================================
+// Keeps the last state we showed in a small binary file, so a restart mid-set
+// can light the board straight away instead of waiting for SooperLooper. The
+// control thread encodes the state into getWriter() on its tick and publishes
+// it; when it changed, a background thread writes it out through a temporary
+// file and a rename, so a crash never leaves half a snapshot behind, and at
+// most once every minIntervalMs. What's in it is up to the caller, the file
+// only adds a magic number, a version and the payload size.
+class StateSnapshot : private Thread
+{
+public:
+    static const int magic = 0x5352344c;        // "L4RS"
+    static const int version = 1;
+    static const int minIntervalMs = 1000;
+
+    StateSnapshot()
+	: Thread("loop4r snapshot")
+    {
+    }
+
+    ~StateSnapshot()
+    {
+	stop();
+    }
+
+    void setFile(const File& file)      { file_ = file; }
+    const File& getFile() const         { return file_; }
+    bool isEnabled() const              { return file_ != File(); }
+
+    // the payload of the last snapshot written, false if there's none we can use
+    bool load(MemoryBlock& payload) const
+    {
+	MemoryBlock data;
+	if (!isEnabled() || !file_.loadFileAsData(data))
+	{
+	    return false;
+	}
+	SnapshotReader in(data.getData(), data.getSize());
+	if (in.readInt() != magic || in.readInt() != version)
+	{
+	    return false;
+	}
+	const int size = in.readInt();
+	if (size < 0 || (size_t) size != data.getSize() - headerSize)
+	{
+	    return false;
+	}
+	payload.replaceWith(static_cast<const char*>(data.getData()) + headerSize, (size_t) size);
+	return true;
+    }
+
+    void start()
+    {
+	if (isEnabled())
+	{
+	    startThread();
+	}
+    }
+
+    // writes out anything still pending, then stops the writer
+    void stop()
+    {
+	if (isThreadRunning())
+	{
+	    signalThreadShouldExit();
+	    wakeUp_.signal();
+	    stopThread(2000);
+	}
+    }
+
+    // control thread: reset, fill, publish
+    SnapshotWriter& getWriter()         { return writer_; }
+
+    void publish()
+    {
+	if (writer_.hasOverflowed()
+	    || (writer_.getSize() == lastSize_ && std::memcmp(writer_.getData(), last_, (size_t) lastSize_) == 0))
+	{
+	    return;
+	}
+	std::memcpy(last_, writer_.getData(), (size_t) writer_.getSize());
+	lastSize_ = writer_.getSize();
+	{
+	    const SpinLock::ScopedLockType lock(pendingLock_);
+	    std::memcpy(pending_, last_, (size_t) lastSize_);
+	    pendingSize_ = lastSize_;
+	}
+	wakeUp_.signal();
+    }
+
+    int64 getNumWritten() const         { return numWritten_; }
+    int64 getNumFailed() const          { return numFailed_; }
+
+private:
+    static const int headerSize = 12;
+
+    void run() override
+    {
+	HeapBlock<uint8> payload((size_t) SnapshotWriter::capacity);
+	for (;;)
+	{
+	    wakeUp_.wait(-1);
+	    int size;
+	    {
+		const SpinLock::ScopedLockType lock(pendingLock_);
+		size = pendingSize_;
+		std::memcpy(payload, pending_, (size_t) jmax(0, size));
+		pendingSize_ = -1;
+	    }
+	    if (size >= 0)
+	    {
+		write(payload, size);
+	    }
+	    if (threadShouldExit())
+	    {
+		return;
+	    }
+	    // anything published meanwhile is picked up after the pause
+	    wait(minIntervalMs);
+	    if (threadShouldExit())
+	    {
+		wakeUp_.signal();
+	    }
+	}
+    }
+
+    void write(const uint8* payload, int size)
+    {
+	SnapshotWriter header;
+	header.addInt(magic);
+	header.addInt(version);
+	header.addInt(size);
+
+	TemporaryFile temp(file_);
+	bool written = false;
+	{
+	    FileOutputStream out(temp.getFile());
+	    written = out.openedOk()
+		&& out.write(header.getData(), (size_t) header.getSize())
+		&& out.write(payload, (size_t) size);
+	    out.flush();
+	    written = written && out.getStatus().wasOk();
+	}
+	if (written && temp.overwriteTargetFileWithTemporary())
+	{
+	    ++numWritten_;
+	}
+	else
+	{
+	    ++numFailed_;
+	}
+    }
+
+    File file_;
+    SnapshotWriter writer_;
+    uint8 last_[SnapshotWriter::capacity];
+    int lastSize_ = -1;
+
+    SpinLock pendingLock_;
+    uint8 pending_[SnapshotWriter::capacity];
+    int pendingSize_ = -1;
+    WaitableEvent wakeUp_;
+
+    std::atomic<int64> numWritten_ { 0 };
+    std::atomic<int64> numFailed_ { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE(StateSnapshot)
+};
@@ -0,0 +1,367 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include <atomic>
+#include <cstring>
+#include <iostream>
+
+//==============================================================================
+// CRC-32 as zlib and the crc32 tool have it, a table lookup a byte, so a
+// dump's checksum can be kept up as it streams by and compared with the
+// file's.
+class Crc32
+{
+public:
+    static uint32 update(uint32 crc, const uint8* data, size_t size)
+    {
+	const uint32* table = getTable();
+	crc = ~crc;
+	for (size_t i = 0; i < size; ++i)
+	{
+	    crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+	}
+	return ~crc;
+    }
+
+private:
+    struct Table
+    {
+	Table()
+	{
+	    for (uint32 i = 0; i < 256; ++i)
+	    {
+		uint32 c = i;
+		for (int bit = 0; bit < 8; ++bit)
+		{
+		    c = (c & 1) != 0 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+		}
+		entries_[i] = c;
+	    }
+	}
+
+	uint32 entries_[256];
+    };
+
+    static const uint32* getTable()
+    {
+	static const Table table;
+	return table.entries_;
+    }
+};
+
+//==============================================================================
+// "sysex": bulk dumps written to disk as they come in, a file each, without
+// ever holding a whole dump. Inputs hand over their sysex bytes as they are
+// on the wire, in whatever pieces they arrive: F0 opens a dump, F7 closes it
+// and any other status byte cuts it short. The pieces go into a fixed byte
+// ring tagged with their input; a background thread takes them off every
+// flushIntervalMs, or sooner once the ring is a quarter full, and appends
+// them to the dump's file, keeping up its CRC-32 along the way. A finished
+// dump is reported with its size and checksum, compared with the expected
+// one if there is one, and whether it ended properly. If the ring overflows
+// the bytes are dropped and the dump they belonged to is reported damaged;
+// memory use stays the ring's whatever the size of the dumps.
+class SysexCapture : private Thread
+{
+public:
+    static const int maxSources = 8;
+    static const int ringSize = 1 << 20;
+    static const int maxChunkSize = 4096;
+    static const int flushIntervalMs = 50;
+
+    SysexCapture()
+	: Thread("loop4r sysex capture"), fifo_(ringSize), ring_((size_t) ringSize), chunk_((size_t) maxChunkSize)
+    {
+    }
+
+    ~SysexCapture()
+    {
+	stop();
+    }
+
+    // dumps go to directory as dump-0001.syx and on; expectedCrc is checked
+    // against every dump when hasExpectedCrc
+    bool start(const File& directory, bool hasExpectedCrc, uint32 expectedCrc)
+    {
+	stop();
+	if (!directory.createDirectory())
+	{
+	    return false;
+	}
+	directory_ = directory;
+	hasExpectedCrc_ = hasExpectedCrc;
+	expectedCrc_ = expectedCrc;
+	for (auto&& lost : lost_)
+	{
+	    lost.store(false);
+	}
+	capturing_.store(true);
+	startThread();
+	return true;
+    }
+
+    // writes what's queued, and what's left of an unfinished dump
+    void stop()
+    {
+	capturing_.store(false);
+	if (isThreadRunning())
+	{
+	    signalThreadShouldExit();
+	    wakeUp_.signal();
+	    stopThread(2000);
+	}
+    }
+
+    bool isCapturing() const        { return capturing_.load(std::memory_order_relaxed); }
+    const File& getDirectory() const        { return directory_; }
+
+    // any thread, a spin lock keeping them apart; no allocation or I/O
+    void feed(int source, const uint8* data, int size)
+    {
+	if (size < 1 || !isCapturing())
+	{
+	    return;
+	}
+	source = jlimit(0, maxSources - 1, source);
+	const SpinLock::ScopedLockType lock(pushLock_);
+	for (int done = 0; done < size; done += maxChunkSize)
+	{
+	    push(source, data + done, jmin(size - done, (int) maxChunkSize));
+	}
+	if (fifo_.getNumReady() >= ringSize / 4 && !wokenEarly_.exchange(true))
+	{
+	    wakeUp_.signal();
+	}
+    }
+
+    int64 getNumDumps() const       { return numDumps_.load(); }
+    int64 getNumBad() const         { return numBad_.load(); }
+    int64 getNumBytes() const       { return numBytes_.load(); }
+    int64 getNumDropped() const     { return numDropped_.load(); }
+
+private:
+    struct Header
+    {
+	uint8 source_;
+	uint8 lost_;        // bytes before these were dropped
+	uint16 size_;
+    };
+
+    struct Dump
+    {
+	ScopedPointer<FileOutputStream> out_;
+	File file_;
+	uint32 crc_ = 0;
+	int64 size_ = 0;
+	bool lost_ = false;
+    };
+
+    void push(int source, const uint8* data, int size)
+    {
+	Header header = { (uint8) source, (uint8) (lost_[source].load(std::memory_order_relaxed) ? 1 : 0), (uint16) size };
+	const int total = (int) sizeof(header) + size;
+	int start1, size1, start2, size2;
+	fifo_.prepareToWrite(total, start1, size1, start2, size2);
+	if (size1 + size2 < total)
+	{
+	    lost_[source].store(true, std::memory_order_relaxed);
+	    numDropped_.fetch_add(size, std::memory_order_relaxed);
+	    return;
+	}
+	lost_[source].store(false, std::memory_order_relaxed);
+	int position = start1;
+	copyIn(&header, (int) sizeof(header), position);
+	copyIn(data, size, position);
+	fifo_.finishedWrite(total);
+    }
+
+    void run() override
+    {
+	while (!threadShouldExit())
+	{
+	    wakeUp_.wait(flushIntervalMs);
+	    wokenEarly_.store(false);
+	    writeQueued();
+	}
+	writeQueued();
+	for (int i = 0; i < maxSources; ++i)
+	{
+	    finish(i, "unfinished");
+	}
+    }
+
+    void writeQueued()
+    {
+	const int numReady = fifo_.getNumReady();
+	int start1, size1, start2, size2;
+	fifo_.prepareToRead(numReady, start1, size1, start2, size2);
+	int position = start1;
+	int taken = 0;
+	while (taken + (int) sizeof(Header) <= numReady)
+	{
+	    Header header;
+	    copyOut(&header, (int) sizeof(header), position);
+	    copyOut(chunk_, header.size_, position);
+	    taken += (int) sizeof(header) + header.size_;
+	    write(header.source_, header.lost_ != 0, chunk_, header.size_);
+	}
+	fifo_.finishedRead(taken);
+	for (auto&& dump : dumps_)
+	{
+	    if (dump.out_ != nullptr)
+	    {
+		dump.out_->flush();
+	    }
+	}
+    }
+
+    // a piece as it came from the wire, split at the status bytes
+    void write(int source, bool lost, const uint8* data, int size)
+    {
+	Dump& dump = dumps_[source];
+	dump.lost_ = dump.lost_ || lost;
+	for (int i = 0; i < size;)
+	{
+	    const uint8 byte = data[i];
+	    if (byte == 0xf0)
+	    {
+		finish(source, "cut short by the next dump");
+		open(source);
+		append(dump, data + i++, 1);
+	    }
+	    else if (byte == 0xf7)
+	    {
+		append(dump, data + i++, 1);
+		finish(source, nullptr);
+	    }
+	    else if (byte >= 0x80)
+	    {
+		finish(source, "cut short");
+		++i;
+	    }
+	    else
+	    {
+		int end = i;
+		while (end < size && data[end] < 0x80)
+		{
+		    ++end;
+		}
+		append(dump, data + i, end - i);
+		i = end;
+	    }
+	}
+    }
+
+    void open(int source)
+    {
+	Dump& dump = dumps_[source];
+	const int64 number = numDumps_.fetch_add(1) + 1;
+	dump.file_ = directory_.getChildFile("dump-" + String(number).paddedLeft('0', 4) + ".syx");
+	dump.file_.deleteFile();
+	dump.out_ = new FileOutputStream(dump.file_);
+	if (dump.out_->failedToOpen())
+	{
+	    std::cerr << "Couldn't write sysex dump to " << dump.file_.getFullPathName() << std::endl;
+	    dump.out_ = nullptr;
+	}
+	dump.crc_ = 0;
+	dump.size_ = 0;
+	dump.lost_ = false;
+	inDump_[source] = true;
+    }
+
+    void append(Dump& dump, const uint8* data, int size)
+    {
+	if (!inDump_[&dump - dumps_])
+	{
+	    return;         // no F0 to go with it
+	}
+	if (dump.out_ != nullptr)
+	{
+	    dump.out_->write(data, (size_t) size);
+	}
+	dump.crc_ = Crc32::update(dump.crc_, data, (size_t) size);
+	dump.size_ += size;
+	numBytes_.fetch_add(size, std::memory_order_relaxed);
+    }
+
+    // problem is why the dump didn't end with F7, nullptr if it did
+    void finish(int source, const char* problem)
+    {
+	Dump& dump = dumps_[source];
+	if (!inDump_[source])
+	{
+	    return;
+	}
+	inDump_[source] = false;
+	dump.out_ = nullptr;
+
+	const bool matches = !hasExpectedCrc_ || dump.crc_ == expectedCrc_;
+	if (problem != nullptr || dump.lost_ || !matches)
+	{
+	    numBad_.fetch_add(1, std::memory_order_relaxed);
+	}
+	std::cerr << "Sysex dump from input " << source + 1 << ": " << dump.size_ << " bytes in " << dump.file_.getFileName()
+		  << ", CRC-32 " << String::toHexString((int) dump.crc_).paddedLeft('0', 8)
+		  << (hasExpectedCrc_ ? (matches ? " as expected" : " NOT as expected") : "")
+		  << (problem != nullptr ? String(", ") + problem : String())
+		  << (dump.lost_ ? ", bytes were dropped" : "") << std::endl;
+    }
+
+    void copyIn(const void* source, int size, int& position)
+    {
+	const int first = jmin(size, ringSize - position);
+	std::memcpy(ring_ + position, source, (size_t) first);
+	std::memcpy(ring_.getData(), static_cast<const uint8*>(source) + first, (size_t) (size - first));
+	position = (position + size) % ringSize;
+    }
+
+    void copyOut(void* destination, int size, int& position) const
+    {
+	const int first = jmin(size, ringSize - position);
+	std::memcpy(destination, ring_ + position, (size_t) first);
+	std::memcpy(static_cast<uint8*>(destination) + first, ring_.getData(), (size_t) (size - first));
+	position = (position + size) % ringSize;
+    }
+
+    AbstractFifo fifo_;
+    HeapBlock<uint8> ring_;
+    SpinLock pushLock_;
+    WaitableEvent wakeUp_;
+    std::atomic<bool> wokenEarly_ { false };
+    std::atomic<bool> capturing_ { false };
+    std::atomic<bool> lost_[maxSources];       // producers', under pushLock_
+
+    // the writer's
+    HeapBlock<uint8> chunk_;
+    Dump dumps_[maxSources];
+    bool inDump_[maxSources] = {};
+    File directory_;
+    bool hasExpectedCrc_ = false;
+    uint32 expectedCrc_ = 0;
+
+    std::atomic<int64> numDumps_ { 0 };
+    std::atomic<int64> numBad_ { 0 };
+    std::atomic<int64> numBytes_ { 0 };
+    std::atomic<int64> numDropped_ { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE(SysexCapture)
+};
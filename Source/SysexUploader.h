@@ -0,0 +1,150 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "MidiOutputStage.h"
+#include <atomic>
+#include <iostream>
+
+//==============================================================================
+// "upload": a .syx file's messages sent to the output stage one at a time
+// from a low priority thread of its own, each one followed by the time it
+// takes on the wire at 31250 baud and gapMs more for the device to deal with
+// it, the FCB1010 writing its EEPROM being the slow case. Whatever the
+// control thread sends, notes and LEDs, goes out in between as usual, so a
+// long upload doesn't hold the pedalboard up.
+//
+// A message isn't split itself: any status byte in
+// the middle of one ends it on the wire, so there's no interleaving
+// anything with it, and the sequencer output sends a message whole anyway.
+// Files for the FCB1010 and EurekaProm come as many messages of a page or
+// so each, which is what gets paced.
+class SysexUploader : private Thread
+{
+public:
+    static const int defaultGapMs = 100;
+    static const int wireBytesPerSecond = 3125;
+
+    SysexUploader()
+	: Thread("loop4r sysex upload")
+    {
+    }
+
+    ~SysexUploader()
+    {
+	stop();
+    }
+
+    // replaces what was loaded; bytes outside F0 to F7 are left out, false
+    // with why in error if there's no message
+    bool load(const File& file, String& error)
+    {
+	stop();
+	data_.reset();
+	messages_.clearQuick();
+	if (!file.loadFileAsData(data_))
+	{
+	    error = "can't be read";
+	    return false;
+	}
+
+	const uint8* bytes = static_cast<const uint8*>(data_.getData());
+	const int size = (int) data_.getSize();
+	int start = -1;
+	for (int i = 0; i < size; ++i)
+	{
+	    if (bytes[i] == 0xf0)
+	    {
+		start = i;
+	    }
+	    else if (bytes[i] == 0xf7 && start >= 0)
+	    {
+		messages_.add({ start, i + 1 - start });
+		start = -1;
+	    }
+	    else if (bytes[i] >= 0x80)
+	    {
+		start = -1;
+	    }
+	}
+	if (messages_.isEmpty())
+	{
+	    error = "has no complete sysex messages";
+	    return false;
+	}
+	file_ = file;
+	return true;
+    }
+
+    void start(MidiOutputStage& stage, int gapMs)
+    {
+	stop();
+	stage_ = &stage;
+	gapMs_ = jmax(0, gapMs);
+	numSent_.store(0);
+	startThread(2);
+    }
+
+    void stop()
+    {
+	stopThread(1000);
+    }
+
+    bool isUploading() const        { return isThreadRunning(); }
+    int getNumMessages() const      { return messages_.size(); }
+    int64 getNumBytes() const       { return (int64) data_.getSize(); }
+    int getNumSent() const          { return numSent_.load(); }
+
+private:
+    struct Message
+    {
+	int offset_;
+	int size_;
+    };
+
+    void run() override
+    {
+	const uint32 startMs = Time::getMillisecondCounter();
+	int64 numBytes = 0;
+	for (auto&& message : messages_)
+	{
+	    if (threadShouldExit())
+	    {
+		break;
+	    }
+	    stage_->add(MidiMessage(static_cast<const uint8*>(data_.getData()) + message.offset_, message.size_));
+	    stage_->flush();
+	    numBytes += message.size_;
+	    numSent_.fetch_add(1, std::memory_order_relaxed);
+	    wait(message.size_ * 1000 / wireBytesPerSecond + gapMs_);
+	}
+	std::cerr << (threadShouldExit() ? "Stopped uploading " : "Uploaded ") << numSent_.load() << " of " << messages_.size() << " sysex messages ("
+		  << numBytes << " bytes) from " << file_.getFileName() << " in " << String((Time::getMillisecondCounter() - startMs) / 1000.0, 1) << "s" << std::endl;
+    }
+
+    MemoryBlock data_;
+    Array<Message> messages_;
+    File file_;
+    MidiOutputStage* stage_ = nullptr;
+    int gapMs_ = defaultGapMs;
+    std::atomic<int> numSent_ { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE(SysexUploader)
+};
@@ -0,0 +1,142 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include <algorithm>
+
+//==============================================================================
+// Tempo from a tapped pedal. The last few intervals between taps are kept in
+// a ring and the tempo is the mean of the ones within 15% of their
+// median, so one fluffed or doubled tap doesn't throw it. Two intervals in a
+// row that disagree with the rest in the same direction are a new tempo and
+// start the ring again, and so does a pause longer than the slowest tap.
+// Times are the pedal events' high resolution ticks, so the result is as
+// precise as the input's timestamps. No allocation, a handful of compares.
+class TapTempo
+{
+public:
+    static const int maxIntervals = 8;
+    static constexpr double minBpm = 30.0;
+    static constexpr double maxBpm = 300.0;
+
+    TapTempo() {}
+
+    // true when there's a tempo to go by, from three taps on
+    bool tap(int64 ticks)
+    {
+	++numTaps_;
+	const double ticksPerSecond = (double) Time::getHighResolutionTicksPerSecond();
+	const double interval = (double) (ticks - lastTap_);
+	const bool fresh = lastTap_ == 0 || interval > 60.0 / minBpm * ticksPerSecond;
+	lastTap_ = ticks;
+	if (fresh)
+	{
+	    numIntervals_ = 0;
+	    next_ = 0;
+	    strikes_ = 0;
+	    return false;
+	}
+	if (interval < 60.0 / maxBpm * ticksPerSecond)
+	{
+	    // a bounce or a double tap, not a beat
+	    ++numRejected_;
+	    return hasTempo();
+	}
+
+	if (numIntervals_ >= 2)
+	{
+	    const double median = getMedian();
+	    const double deviation = (interval - median) / median;
+	    if (std::abs(deviation) > tolerance)
+	    {
+		++numRejected_;
+		// the same way twice running: the player has changed tempo
+		if (strikes_ != 0 && (strikes_ > 0) == (deviation > 0))
+		{
+		    intervals_[0] = lastOutlier_;
+		    intervals_[1] = interval;
+		    numIntervals_ = 2;
+		    next_ = 2;
+		    strikes_ = 0;
+		    update();
+		    return true;
+		}
+		strikes_ = deviation > 0 ? 1 : -1;
+		lastOutlier_ = interval;
+		return hasTempo();
+	    }
+	}
+
+	strikes_ = 0;
+	intervals_[next_] = interval;
+	next_ = (next_ + 1) % maxIntervals;
+	numIntervals_ = jmin(numIntervals_ + 1, (int) maxIntervals);
+	update();
+	return hasTempo();
+    }
+
+    bool hasTempo() const               { return numIntervals_ >= 2; }
+    double getBpm() const               { return bpm_; }
+    double getTicksPerBeat() const      { return ticksPerBeat_; }
+    int64 getLastTap() const            { return lastTap_; }
+    int64 getNumTaps() const            { return numTaps_; }
+    int64 getNumRejected() const        { return numRejected_; }
+
+private:
+    static constexpr double tolerance = 0.15;
+
+    double getMedian() const
+    {
+	double sorted[maxIntervals];
+	std::copy(intervals_, intervals_ + numIntervals_, sorted);
+	std::sort(sorted, sorted + numIntervals_);
+	return numIntervals_ % 2 != 0 ? sorted[numIntervals_ / 2]
+	    : (sorted[numIntervals_ / 2 - 1] + sorted[numIntervals_ / 2]) / 2;
+    }
+
+    void update()
+    {
+	const double median = getMedian();
+	double sum = 0;
+	int count = 0;
+	for (int i = 0; i < numIntervals_; ++i)
+	{
+	    if (std::abs(intervals_[i] - median) <= tolerance * median)
+	    {
+		sum += intervals_[i];
+		++count;
+	    }
+	}
+	ticksPerBeat_ = count > 0 ? sum / count : median;
+	bpm_ = 60.0 * (double) Time::getHighResolutionTicksPerSecond() / ticksPerBeat_;
+    }
+
+    double intervals_[maxIntervals];
+    int numIntervals_ = 0;
+    int next_ = 0;
+    int strikes_ = 0;           // the last tap was an outlier, long (1) or short (-1)
+    double lastOutlier_ = 0;
+    int64 lastTap_ = 0;
+    double bpm_ = 0;
+    double ticksPerBeat_ = 0;
+    int64 numTaps_ = 0;
+    int64 numRejected_ = 0;
+};
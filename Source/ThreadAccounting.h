@@ -0,0 +1,350 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include <atomic>
+
+#if JUCE_LINUX
+ #include <unistd.h>
+#endif
+
+//==============================================================================
+// Heap allocations made by the calling thread so far, counted by our
+// operator new so a stretch of work can be charged with what it allocated.
+struct ThreadAllocations
+{
+    static int64& get()
+    {
+	thread_local int64 count = 0;
+	return count;
+    }
+};
+
+//==============================================================================
+// Allocations per MIDI event and per OSC message: a Scope around handling
+// one counts it and charges it with whatever the thread allocated meanwhile.
+// A scope nested in another of its kind isn't counted again. While disabled a
+// scope costs a branch.
+class AllocationAccounting
+{
+public:
+    enum Kind
+    {
+	MidiEvent,
+	OscMessage,
+	numKinds
+    };
+
+    void setEnabled(bool enabled)       { enabled_.store(enabled, std::memory_order_relaxed); }
+    bool isEnabled() const              { return enabled_.load(std::memory_order_relaxed); }
+
+    int64 getNumEvents(Kind kind) const         { return events_[kind].load(std::memory_order_relaxed); }
+    int64 getNumAllocations(Kind kind) const    { return allocations_[kind].load(std::memory_order_relaxed); }
+
+    double getAllocationsPerEvent(Kind kind) const
+    {
+	const int64 events = getNumEvents(kind);
+	return events > 0 ? (double) getNumAllocations(kind) / (double) events : 0.0;
+    }
+
+    // countsEvent false charges the allocations without counting another
+    // event, for the part of a message's handling done on another thread
+    class Scope
+    {
+    public:
+	Scope(AllocationAccounting& accounting, Kind kind, bool countsEvent = true)
+	    : accounting_(accounting.isEnabled() && !isInside(kind) ? &accounting : nullptr), kind_(kind), countsEvent_(countsEvent),
+	      start_(accounting_ != nullptr ? ThreadAllocations::get() : 0)
+	{
+	    if (accounting_ != nullptr)
+	    {
+		isInside(kind) = true;
+	    }
+	}
+
+	~Scope()
+	{
+	    if (accounting_ != nullptr)
+	    {
+		isInside(kind_) = false;
+		accounting_->allocations_[kind_].fetch_add(ThreadAllocations::get() - start_, std::memory_order_relaxed);
+		if (countsEvent_)
+		{
+		    accounting_->events_[kind_].fetch_add(1, std::memory_order_relaxed);
+		}
+	    }
+	}
+
+    private:
+	static bool& isInside(Kind kind)
+	{
+	    thread_local bool inside[numKinds] = {};
+	    return inside[kind];
+	}
+
+	AllocationAccounting* accounting_;
+	Kind kind_;
+	bool countsEvent_;
+	int64 start_;
+
+	JUCE_DECLARE_NON_COPYABLE(Scope)
+    };
+
+    void dump(std::ostream& out) const
+    {
+	out << "Allocations: " << String(getAllocationsPerEvent(MidiEvent), 2) << " per MIDI event (" << getNumEvents(MidiEvent) << "), "
+	    << String(getAllocationsPerEvent(OscMessage), 2) << " per OSC message (" << getNumEvents(OscMessage) << ")" << std::endl;
+    }
+
+private:
+    std::atomic<bool> enabled_ { false };
+    std::atomic<int64> events_[numKinds] = {};
+    std::atomic<int64> allocations_[numKinds] = {};
+};
+
+//==============================================================================
+// CPU time per thread, sampled every so often from /proc/self/task: the
+// nanoseconds on a CPU from schedstat (or utime and stime from stat, to the
+// clock tick, where the kernel doesn't keep schedstats) and the number of
+// times each thread was scheduled. That covers the threads JUCE starts for us
+// as well as ours, by the name each gives itself. Each sample prints every
+// thread's share of a CPU since the last one, with the allocations, and
+// dump() gives the totals since start(). Runs on a thread of its own,
+// which shows up in its own report.
+class ThreadAccounting : private Thread
+{
+public:
+    ThreadAccounting(const AllocationAccounting& allocations)
+	: Thread("loop4r acct"), allocations_(allocations)
+    {
+    }
+
+    ~ThreadAccounting()
+    {
+	stop();
+    }
+
+    void start(int intervalMs)
+    {
+	stop();
+	intervalMs_ = jmax(100, intervalMs);
+	startTicks_ = Time::getHighResolutionTicks();
+	lastTicks_ = startTicks_;
+	sample(first_);
+	last_ = first_;
+	startThread();
+    }
+
+    void stop()
+    {
+	if (isThreadRunning())
+	{
+	    signalThreadShouldExit();
+	    notify();
+	    stopThread(1000);
+	}
+    }
+
+    bool isRunning() const      { return isThreadRunning(); }
+
+    // each thread's count of the times it has gone to sleep and been woken,
+    // the voluntary context switches from /proc, by thread id
+    typedef Array<std::pair<int, int64>> WakeupCounts;
+
+    static WakeupCounts sampleWakeups()
+    {
+	WakeupCounts counts;
+#if JUCE_LINUX
+	for (DirectoryIterator it(File("/proc/self/task"), false, "*", File::findDirectories); it.next();)
+	{
+	    StringArray lines;
+	    lines.addLines(it.getFile().getChildFile("status").loadFileAsString());
+	    for (auto&& line : lines)
+	    {
+		if (line.startsWith("voluntary_ctxt_switches:"))
+		{
+		    counts.add({ it.getFile().getFileName().getIntValue(), line.fromFirstOccurrenceOf(":", false, false).trim().getLargeIntValue() });
+		    break;
+		}
+	    }
+	}
+#endif
+	return counts;
+    }
+
+    // the wakeups in now, less those of the same threads in since
+    static int64 countWakeups(const WakeupCounts& now, const WakeupCounts& since = WakeupCounts())
+    {
+	int64 total = 0;
+	for (auto&& thread : now)
+	{
+	    total += thread.second;
+	    for (auto&& was : since)
+	    {
+		if (was.first == thread.first)
+		{
+		    total -= was.second;
+		    break;
+		}
+	    }
+	}
+	return total;
+    }
+
+    // each thread's CPU time since start(), threads gone by now included
+    void dump(std::ostream& out)
+    {
+	const ScopedLock lock(lock_);
+	Array<Task> now;
+	sample(now);
+	keepFinished(now);
+	report(out, "since start", first_, now, Time::getHighResolutionTicks() - startTicks_);
+    }
+
+private:
+    struct Task
+    {
+	int tid_;
+	String name_;
+	int64 cpuNanos_;
+	int64 slices_;
+    };
+
+    void run() override
+    {
+	while (!threadShouldExit())
+	{
+	    wait(intervalMs_);
+	    if (threadShouldExit())
+	    {
+		break;
+	    }
+
+	    const ScopedLock lock(lock_);
+	    Array<Task> now;
+	    sample(now);
+	    const int64 ticks = Time::getHighResolutionTicks();
+	    report(std::cerr, "last " + String(intervalMs_ / 1000.0, 1) + "s", last_, now, ticks - lastTicks_);
+	    allocations_.dump(std::cerr);
+	    keepFinished(now);
+	    last_ = now;
+	    lastTicks_ = ticks;
+	}
+    }
+
+    // threads that have finished since the last sample stay in the totals
+    void keepFinished(Array<Task>& now) const
+    {
+	for (auto&& task : last_)
+	{
+	    if (findTask(now, task.tid_) == nullptr)
+	    {
+		now.add(task);
+	    }
+	}
+    }
+
+    static const Task* findTask(const Array<Task>& tasks, int tid)
+    {
+	for (auto&& task : tasks)
+	{
+	    if (task.tid_ == tid)
+	    {
+		return &task;
+	    }
+	}
+	return nullptr;
+    }
+
+    static void report(std::ostream& out, const String& period, const Array<Task>& before, const Array<Task>& after, int64 elapsedTicks)
+    {
+	const double elapsedNanos = Time::highResolutionTicksToSeconds(elapsedTicks) * 1.0e9;
+	int64 totalNanos = 0;
+	out << "CPU per thread, " << period << ":" << std::endl;
+	for (auto&& task : after)
+	{
+	    const Task* was = findTask(before, task.tid_);
+	    const int64 nanos = task.cpuNanos_ - (was != nullptr ? was->cpuNanos_ : 0);
+	    const int64 slices = task.slices_ - (was != nullptr ? was->slices_ : 0);
+	    if (nanos == 0 && slices == 0)
+	    {
+		continue;
+	    }
+	    totalNanos += nanos;
+	    out << "  " << task.name_.paddedRight(' ', 20) << " " << String(task.tid_).paddedLeft(' ', 7)
+		<< "  " << String(nanos / 1.0e6, 1).paddedLeft(' ', 9) << "ms " << String(100.0 * nanos / jmax(1.0, elapsedNanos), 2).paddedLeft(' ', 6) << "%"
+		<< "  " << slices << " times scheduled" << std::endl;
+	}
+	out << "  " << String("all").paddedRight(' ', 28) << "  " << String(totalNanos / 1.0e6, 1).paddedLeft(' ', 9) << "ms "
+	    << String(100.0 * totalNanos / jmax(1.0, elapsedNanos), 2).paddedLeft(' ', 6) << "%" << std::endl;
+    }
+
+#if JUCE_LINUX
+    static void sample(Array<Task>& tasks)
+    {
+	tasks.clearQuick();
+	const File dir("/proc/self/task");
+	const double nanosPerClockTick = 1.0e9 / (double) ::sysconf(_SC_CLK_TCK);
+	for (DirectoryIterator it(dir, false, "*", File::findDirectories); it.next();)
+	{
+	    const File task(it.getFile());
+	    Task entry;
+	    entry.tid_ = task.getFileName().getIntValue();
+	    // the main thread goes by the program's name, and runs the message loop
+	    entry.name_ = entry.tid_ == (int) ::getpid() ? String("message thread") : task.getChildFile("comm").loadFileAsString().trimEnd();
+
+	    StringArray schedstat;
+	    schedstat.addTokens(task.getChildFile("schedstat").loadFileAsString(), " \n", "");
+	    schedstat.removeEmptyStrings();
+	    if (schedstat.size() >= 3)
+	    {
+		entry.cpuNanos_ = schedstat[0].getLargeIntValue();
+		entry.slices_ = schedstat[2].getLargeIntValue();
+	    }
+	    else
+	    {
+		// the fields after the name in brackets, utime and stime are the 12th and 13th of those
+		const String stat = task.getChildFile("stat").loadFileAsString();
+		StringArray fields;
+		fields.addTokens(stat.fromLastOccurrenceOf(")", false, false), " ", "");
+		fields.removeEmptyStrings();
+		entry.cpuNanos_ = (int64) ((fields[11].getLargeIntValue() + fields[12].getLargeIntValue()) * nanosPerClockTick);
+		entry.slices_ = 0;
+	    }
+	    if (entry.tid_ > 0)
+	    {
+		tasks.add(entry);
+	    }
+	}
+    }
+#else
+    static void sample(Array<Task>& tasks)      { tasks.clearQuick(); }
+#endif
+
+    const AllocationAccounting& allocations_;
+    int intervalMs_ = 10000;
+    int64 startTicks_ = 0;
+    int64 lastTicks_ = 0;
+    Array<Task> first_;
+    Array<Task> last_;
+    CriticalSection lock_;
+
+    JUCE_DECLARE_NON_COPYABLE(ThreadAccounting)
+};
@@ -0,0 +1,258 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "AlsaMidiInput.h"
+
+#if JUCE_LINUX
+ #include <cerrno>
+ #include <cstring>
+ #include <sched.h>
+ #include <sys/mman.h>
+#endif
+
+//==============================================================================
+// Realtime scheduling and CPU affinity for threads picked by name, our own
+// and the ones JUCE starts for us ("Juce OSC server", "Juce MIDI Input" where
+// we don't read the sequencer ourselves),
+// which we have no handle for. apply() looks the names up in
+// /proc/self/task/<tid>/comm and so finds those threads again when a device
+// reopens and they're replaced; each thread is only set up once, and a
+// setting that can't be applied (usually for lack of CAP_SYS_NICE or an
+// rtprio limit) is reported the first time.
+//
+// lockMemory() is mlockall(MCL_CURRENT | MCL_FUTURE), so the stacks of threads
+// started afterwards are faulted in when they're mapped as well;
+// prefaultStack() does the same for the calling thread's stack below it.
+class ThreadTuning
+{
+public:
+    enum Policy
+    {
+	PolicyOther,
+	PolicyFifo,
+	PolicyRoundRobin
+    };
+
+    ThreadTuning() {}
+
+    bool isEmpty() const            { return rules_.isEmpty(); }
+
+    // whether thread (as for add()) has a rule already
+    bool has(const String& thread) const
+    {
+	const String name = threadName(thread).substring(0, 15);
+	for (auto&& rule : rules_)
+	{
+	    if (rule.name_ == name)
+	    {
+		return true;
+	    }
+	}
+	return false;
+    }
+
+    // the CPUs the realtime threads were pinned to, for others to stay off
+    BigInteger getRealtimeCpus() const
+    {
+	BigInteger cpus;
+	for (auto&& rule : rules_)
+	{
+	    if (rule.policy_ != PolicyOther)
+	    {
+		cpus |= rule.cpus_;
+	    }
+	}
+	return cpus;
+    }
+
+    // thread is a short name (midi, osc, control, leds) or a thread's own name.
+    // cpus is a list like "2" or "0,2-3", empty leaves the affinity alone.
+    bool add(const String& thread, Policy policy, int priority, const String& cpus)
+    {
+	Rule rule;
+	rule.name_ = threadName(thread).substring(0, 15);
+	rule.policy_ = policy;
+	rule.priority_ = priority;
+	rule.cpuList_ = cpus;
+	if (!parseCpus(cpus, rule.cpus_))
+	{
+	    return false;
+	}
+	rules_.add(rule);
+	return true;
+    }
+
+    // a list like "2" or "0,2-3" into mask, false if it isn't one
+    static bool parseCpus(const String& cpus, BigInteger& mask)
+    {
+	StringArray ranges;
+	ranges.addTokens(cpus, ",", "");
+	ranges.removeEmptyStrings();
+	for (const String& range : ranges)
+	{
+	    const String first = range.upToFirstOccurrenceOf("-", false, false);
+	    const String last = range.contains("-") ? range.fromFirstOccurrenceOf("-", false, false) : first;
+	    if (!first.containsOnly("0123456789") || !last.containsOnly("0123456789") || first.isEmpty() || last.isEmpty()
+		|| last.getIntValue() < first.getIntValue() || last.getIntValue() >= maxCpus)
+	    {
+		return false;
+	    }
+	    mask.setRange(first.getIntValue(), last.getIntValue() - first.getIntValue() + 1, true);
+	}
+	return true;
+    }
+
+#if JUCE_LINUX
+    void apply()
+    {
+	const File tasks("/proc/self/task");
+	for (DirectoryIterator it(tasks, false, "*", File::findDirectories); it.next();)
+	{
+	    const File task(it.getFile());
+	    const int tid = task.getFileName().getIntValue();
+	    if (tid <= 0 || applied_.contains(tid))
+	    {
+		continue;
+	    }
+
+	    const String name = task.getChildFile("comm").loadFileAsString().trimEnd();
+	    for (auto&& rule : rules_)
+	    {
+		if (rule.name_ == name)
+		{
+		    applied_.add(tid);
+		    applyRule(rule, tid);
+		    break;
+		}
+	    }
+	}
+    }
+
+    // the calling thread scheduled as thread's rule says, for something
+    // standing in for it; what it got, empty if there's no rule or it failed
+    String applyToCurrentThread(const String& thread) const
+    {
+	const String name = threadName(thread).substring(0, 15);
+	for (auto&& rule : rules_)
+	{
+	    if (rule.name_ == name)
+	    {
+		return applyRule(rule, 0) ? describe(rule) : String();
+	    }
+	}
+	return String();
+    }
+
+    static bool lockMemory()
+    {
+	if (::mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+	{
+	    std::cerr << "Couldn't lock memory: " << std::strerror(errno) << std::endl;
+	    return false;
+	}
+	return true;
+    }
+#else
+    void apply()                    {}
+    String applyToCurrentThread(const String&) const    { return String(); }
+    static bool lockMemory()
+    {
+	std::cerr << "Memory locking is only supported on Linux" << std::endl;
+	return false;
+    }
+#endif
+
+    // touches the next 64k of the calling thread's stack
+    static void prefaultStack()
+    {
+	volatile char stack[64 * 1024];
+	for (size_t i = 0; i < sizeof(stack); i += 4096)
+	{
+	    stack[i] = 0;
+	}
+    }
+
+private:
+    struct Rule
+    {
+	String name_;
+	Policy policy_;
+	int priority_;
+	String cpuList_;
+	BigInteger cpus_;
+    };
+
+    static const int maxCpus = 1024;
+
+    static String describe(const Rule& rule)
+    {
+	return String(rule.policy_ == PolicyFifo ? "SCHED_FIFO " : rule.policy_ == PolicyRoundRobin ? "SCHED_RR " : "SCHED_OTHER ")
+	    + String(rule.priority_) + (rule.cpuList_.isEmpty() ? String() : " on CPUs " + rule.cpuList_);
+    }
+
+    static String threadName(const String& thread)
+    {
+	if (thread.equalsIgnoreCase("midi"))       return AlsaMidiInput::isAvailable ? "loop4r midi in" : "Juce MIDI Input";
+	if (thread.equalsIgnoreCase("osc"))        return "Juce OSC server";
+	if (thread.equalsIgnoreCase("control"))    return "loop4r control";
+	if (thread.equalsIgnoreCase("leds"))       return "loop4r LED output";
+	if (thread.equalsIgnoreCase("workers"))    return "loop4r worker";
+	return thread;
+    }
+
+#if JUCE_LINUX
+    // tid 0 for the calling thread
+    static bool applyRule(const Rule& rule, int tid)
+    {
+	bool applied = true;
+	const int policy = rule.policy_ == PolicyFifo ? SCHED_FIFO : rule.policy_ == PolicyRoundRobin ? SCHED_RR : SCHED_OTHER;
+	sched_param param;
+	param.sched_priority = policy == SCHED_OTHER ? 0 : jlimit(sched_get_priority_min(policy), sched_get_priority_max(policy), rule.priority_);
+	if (::sched_setscheduler(tid, policy, &param) != 0)
+	{
+	    std::cerr << "Couldn't set the scheduling of thread \"" << rule.name_ << "\" (" << tid << "): " << std::strerror(errno) << std::endl;
+	    applied = false;
+	}
+
+	if (!rule.cpus_.isZero())
+	{
+	    cpu_set_t set;
+	    CPU_ZERO(&set);
+	    for (int cpu = rule.cpus_.findNextSetBit(0); cpu >= 0; cpu = rule.cpus_.findNextSetBit(cpu + 1))
+	    {
+		CPU_SET(cpu, &set);
+	    }
+	    if (::sched_setaffinity(tid, sizeof(set), &set) != 0)
+	    {
+		std::cerr << "Couldn't pin thread \"" << rule.name_ << "\" (" << tid << ") to CPUs " << rule.cpuList_ << ": " << std::strerror(errno) << std::endl;
+		applied = false;
+	    }
+	}
+	return applied;
+    }
+#endif
+
+    Array<Rule> rules_;
+    SortedSet<int> applied_;
+
+    JUCE_DECLARE_NON_COPYABLE(ThreadTuning)
+};
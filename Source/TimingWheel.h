@@ -0,0 +1,217 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include <functional>
+#include <vector>
+
+//==============================================================================
+// The control thread's deferred work on one hashed timing wheel of 1ms slots.
+// A timer is created once with what it runs and then scheduled, moved and
+// cancelled as often as needed, each of those O(1): it's linked into the slot
+// its due time hashes to, and a slot's timers are only run once they're
+// actually due, so deadlines further off than the wheel goes round simply wait
+// for a later turn. The earliest deadline is kept so the caller can sleep
+// exactly until then, and not at all while nothing is scheduled; it's only
+// looked for again when that timer goes.
+//
+// Times are Time::getMillisecondCounter() values. A timer may schedule itself
+// again (or any other) from its own callback. Only the control thread uses
+// this.
+class TimingWheel
+{
+public:
+    typedef std::function<void(uint32 now)> Callback;
+
+    static const int numSlots = 256;
+
+    TimingWheel() : position_(Time::getMillisecondCounter())
+    {
+	for (auto&& head : slots_)
+	{
+	    head = -1;
+	}
+    }
+
+    // at setup, the only call that allocates
+    int create(Callback callback)
+    {
+	Timer timer;
+	timer.callback_ = std::move(callback);
+	timers_.push_back(std::move(timer));
+	return (int) timers_.size() - 1;
+    }
+
+    void schedule(int id, uint32 due)
+    {
+	cancel(id);
+	Timer& timer = timers_[(size_t) id];
+	timer.due_ = due;
+	timer.scheduled_ = true;
+	link(id);
+	++numScheduled_;
+	if (!hasEarliest_ || (int) (due - earliest_) < 0)
+	{
+	    earliest_ = due;
+	    hasEarliest_ = true;
+	}
+    }
+
+    void scheduleIn(int id, int ms, uint32 now)
+    {
+	schedule(id, now + (uint32) jmax(0, ms));
+    }
+
+    // moves the timer earlier if it's later than due (or not scheduled), never later
+    void scheduleBy(int id, uint32 due)
+    {
+	const Timer& timer = timers_[(size_t) id];
+	if (!timer.scheduled_ || (int) (due - timer.due_) < 0)
+	{
+	    schedule(id, due);
+	}
+    }
+
+    void cancel(int id)
+    {
+	Timer& timer = timers_[(size_t) id];
+	if (!timer.scheduled_)
+	{
+	    return;
+	}
+	unlink(id);
+	timer.scheduled_ = false;
+	--numScheduled_;
+	if (hasEarliest_ && timer.due_ == earliest_)
+	{
+	    findEarliest();
+	}
+    }
+
+    bool isScheduled(int id) const      { return timers_[(size_t) id].scheduled_; }
+
+    // runs every timer due by now, earliest first within a slot's turn
+    void advance(uint32 now)
+    {
+	if (numScheduled_ == 0)
+	{
+	    position_ = now;
+	    return;
+	}
+
+	// a gap of a whole turn or more visits each slot once
+	const int steps = jmin((int) (now - position_), (int) numSlots - 1);
+	const uint32 from = now - (uint32) jmax(0, steps);
+	for (uint32 t = from; (int) (t - now) <= 0; ++t)
+	{
+	    int id = slots_[t % numSlots];
+	    while (id >= 0)
+	    {
+		Timer& timer = timers_[(size_t) id];
+		const int next = timer.next_;
+		if ((int) (timer.due_ - now) <= 0)
+		{
+		    cancel(id);
+		    ++numFired_;
+		    timer.callback_(now);
+		}
+		id = next;
+	    }
+	}
+	position_ = now + 1;
+    }
+
+    // ms until the next timer is due, -1 with nothing scheduled
+    int getMsUntilNext(uint32 now) const
+    {
+	return hasEarliest_ ? jmax(0, (int) (earliest_ - now)) : -1;
+    }
+
+    int getNumScheduled() const         { return numScheduled_; }
+    int64 getNumFired() const           { return numFired_; }
+
+private:
+    struct Timer
+    {
+	Callback callback_;
+	uint32 due_ = 0;
+	bool scheduled_ = false;
+	int slot_ = 0;
+	int prev_ = -1;
+	int next_ = -1;
+    };
+
+    void link(int id)
+    {
+	Timer& timer = timers_[(size_t) id];
+	// one already due goes where advance() looks next
+	timer.slot_ = (int) (((int) (timer.due_ - position_) < 0 ? position_ : timer.due_) % numSlots);
+	int& head = slots_[timer.slot_];
+	timer.prev_ = -1;
+	timer.next_ = head;
+	if (head >= 0)
+	{
+	    timers_[(size_t) head].prev_ = id;
+	}
+	head = id;
+    }
+
+    void unlink(int id)
+    {
+	Timer& timer = timers_[(size_t) id];
+	if (timer.prev_ >= 0)
+	{
+	    timers_[(size_t) timer.prev_].next_ = timer.next_;
+	}
+	else
+	{
+	    slots_[timer.slot_] = timer.next_;
+	}
+	if (timer.next_ >= 0)
+	{
+	    timers_[(size_t) timer.next_].prev_ = timer.prev_;
+	}
+	timer.prev_ = timer.next_ = -1;
+    }
+
+    void findEarliest()
+    {
+	hasEarliest_ = false;
+	for (auto&& timer : timers_)
+	{
+	    if (timer.scheduled_ && (!hasEarliest_ || (int) (timer.due_ - earliest_) < 0))
+	    {
+		earliest_ = timer.due_;
+		hasEarliest_ = true;
+	    }
+	}
+    }
+
+    std::vector<Timer> timers_;
+    int slots_[numSlots];
+    int numScheduled_ = 0;
+    uint32 position_;           // the first slot advance() hasn't been through
+    uint32 earliest_ = 0;
+    bool hasEarliest_ = false;
+    int64 numFired_ = 0;
+
+    JUCE_DECLARE_NON_COPYABLE(TimingWheel)
+};
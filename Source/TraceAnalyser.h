@@ -0,0 +1,735 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "TraceCapture.h"
+#include "TraceArchive.h"
+#include "OscMessageView.h"
+#include "LedPatterns.h"
+#include <atomic>
+#include <functional>
+#include <ostream>
+#include <vector>
+
+//==============================================================================
+// Queries over a trace or a trace archive, offline, on every core: how
+// records of each source are spread ("count"), pedal presses whose LED echo
+// took longer than a threshold ("echo"), stretches without any OSC coming in
+// while we kept sending ("reconnects") and the time each loop spent in each
+// state ("states"), optionally within a window of the capture.
+//
+// A trace is mapped rather than read, its ring taken from the oldest slot
+// on; an archive has only the segments the window overlaps decompressed, in
+// parallel, into one block. The records are then cut into chunks, scanned a
+// block of 64 at a time by a branch free pass over their source and time
+// that gives a mask of the ones the query wants, and only those are looked
+// at properly. Each chunk is summed up on its own, what crosses chunks (a
+// gap, a loop's state) carried at its edges, and the chunks are put together
+// in order at the end.
+class TraceAnalyser
+{
+public:
+    enum Query
+    {
+	CountQuery,
+	EchoQuery,
+	ReconnectQuery,
+	StateQuery
+    };
+
+    struct Options
+    {
+	Query query_ = CountQuery;
+	double threshold_ = -1;     // echo ms (20), reconnect seconds (2)
+	double fromSeconds_ = 0;    // after the first record
+	double seconds_ = 0;        // 0 for the rest
+	int numThreads_ = 0;        // 0 for one per core
+    };
+
+    static const int blockSize = 64;
+    static const int minChunkRecords = 4096;
+    static const int numLoops = 32;             // the loops "states" keeps apart, the rest are left out
+    static const int numStates = Paused - Unknown + 1;
+    static const int maxListed = 1000;          // slow presses and episodes printed
+    static const int echoWindowMs = 1000;
+
+    // "count", "echo", "reconnects" or "states"
+    static bool parseQuery(const String& text, Query& query)
+    {
+	static const char* const names[] = { "count", "echo", "reconnects", "states" };
+	for (int i = 0; i < 4; ++i)
+	{
+	    if (text.equalsIgnoreCase(names[i]))
+	    {
+		query = (Query) i;
+		return true;
+	    }
+	}
+	return false;
+    }
+
+    TraceAnalyser() {}
+
+    bool open(const File& file, const Options& options)
+    {
+	options_ = options;
+	numThreads_ = options.numThreads_ > 0 ? options.numThreads_ : jmax(1, SystemStats::getNumCpus());
+	spans_.clear();
+	archived_ = TraceArchive::isArchive(file);
+	return archived_ ? openArchive(file) : openTrace(file);
+    }
+
+    // the query, written to out; the time it took to stats
+    void run(std::ostream& out, std::ostream& stats)
+    {
+	const int64 start = Time::getHighResolutionTicks();
+	makeChunks();
+	results_.clear();
+	results_.resize(chunks_.size());
+	parallelFor((int) chunks_.size(), [this] (int i) { scan(chunks_[(size_t) i], results_[(size_t) i]); });
+	const double scanMs = Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - start) * 1000.0;
+
+	switch (options_.query_)
+	{
+	    case CountQuery:        printCounts(out); break;
+	    case EchoQuery:         printEchoes(out); break;
+	    case ReconnectQuery:    printReconnects(out); break;
+	    case StateQuery:        printStates(out); break;
+	}
+	stats << "Analysed " << getNumRecords() << " records" << (archived_ ? " from " + String(numSegmentsRead_) + " archive segments" : String())
+	      << " in " << String(loadMs_ + scanMs, 1) << "ms (" << String(loadMs_, 1) << "ms loading), "
+	      << chunks_.size() << " chunks on " << numThreads_ << " threads" << std::endl;
+    }
+
+    int64 getNumRecords() const
+    {
+	int64 total = 0;
+	for (auto& span : spans_)
+	{
+	    total += span.size_;
+	}
+	return total;
+    }
+
+private:
+    typedef TraceCapture::Record Record;
+
+    struct Span
+    {
+	const Record* records_;
+	int64 size_;
+    };
+
+    struct Chunk
+    {
+	int64 begin_;       // in the spans, one after the other
+	int64 end_;
+    };
+
+    struct Listed
+    {
+	int64 ticks_;
+	int64 endTicks_;
+	uint8 data_[3];
+	int size_;
+	int64 count_;
+    };
+
+    // what one chunk comes to
+    struct Result
+    {
+	int64 lastTicks_ = 0;       // of the records it looked at
+
+	// count
+	int64 numRecords_[8] = {};
+	int64 numBytes_[8] = {};
+	int64 firstTicks_ = 0;
+
+	// echo
+	int64 numPresses_ = 0;
+	int64 numEchoed_ = 0;
+	int64 histogram_[8] = {};
+	double sumMs_ = 0;
+	double maxMs_ = 0;
+	std::vector<Listed> listed_;
+
+	// reconnects: the gaps inside, and what's at the edges
+	int64 firstIn_ = 0;
+	int64 lastIn_ = 0;
+	int64 outsBeforeFirst_ = 0;
+	int64 outsAfterLast_ = 0;
+
+	// states, per loop
+	struct Loop
+	{
+	    int64 firstTicks_ = 0;
+	    int firstState_ = 0;
+	    int64 lastTicks_ = 0;
+	    int lastState_ = 0;
+	    int64 numChanges_[numStates] = {};
+	    int64 ticksIn_[numStates] = {};
+	};
+	std::vector<Loop> loops_;
+    };
+
+    // where the echo histogram's buckets end, the last one has no end
+    static double getBucketEndMs(int bucket)
+    {
+	static const double ends[] = { 1, 2, 5, 10, 20, 50, 100 };
+	return ends[bucket];
+    }
+
+    const Record& at(int64 i) const
+    {
+	return i < spans_[0].size_ ? spans_[0].records_[i] : spans_[1].records_[i - spans_[0].size_];
+    }
+
+    bool openTrace(const File& file)
+    {
+	const int64 start = Time::getHighResolutionTicks();
+	map_ = new MemoryMappedFile(file, MemoryMappedFile::readOnly);
+	int numSlots = 0;
+	const Record* slots = TraceCapture::getSlots(map_->getData(), map_->getSize(), numSlots, ticksPerSecond_);
+	if (slots == nullptr)
+	{
+	    return false;
+	}
+
+	// the slots go round once from the oldest, the one with the lowest sequence
+	int oldest = 0;
+	uint32 lowest = 0;
+	for (int i = 0; i < numSlots; ++i)
+	{
+	    const uint32 sequence = slots[i].sequence_.load(std::memory_order_relaxed);
+	    if (sequence != 0 && (lowest == 0 || sequence < lowest))
+	    {
+		lowest = sequence;
+		oldest = i;
+	    }
+	}
+	spans_.push_back({ slots + oldest, numSlots - oldest });
+	spans_.push_back({ slots, oldest });
+	firstTicks_ = lowest != 0 ? slots[oldest].ticks_ : 0;
+	setWindow();
+	loadMs_ = Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - start) * 1000.0;
+	return true;
+    }
+
+    bool openArchive(const File& file)
+    {
+	const int64 start = Time::getHighResolutionTicks();
+	Array<TraceArchive::Segment> segments;
+	if (!TraceArchive::readIndex(file, segments, ticksPerSecond_))
+	{
+	    return false;
+	}
+	int64 from, to;
+	TraceArchive::getWindow(segments, ticksPerSecond_, options_.fromSeconds_, options_.seconds_, from, to);
+
+	Array<TraceArchive::Segment> wanted;
+	Array<int64> offsets;
+	int64 total = 0;
+	for (auto& segment : segments)
+	{
+	    if (segment.lastTicks_ >= from && segment.firstTicks_ <= to)
+	    {
+		wanted.add(segment);
+		offsets.add(total);
+		total += segment.numRecords_;
+	    }
+	}
+	archive_.calloc((size_t) jmax((int64) 1, total));
+	std::vector<int64> numRead((size_t) wanted.size(), 0);
+	parallelFor(wanted.size(), [&] (int i)
+	{
+	    FileInputStream in(file);
+	    if (!in.failedToOpen())
+	    {
+		numRead[(size_t) i] = TraceArchive::readSegment(in, wanted.getReference(i), archive_ + offsets[i]);
+	    }
+	});
+
+	// a segment that came up short leaves a hole, closed up here
+	int64 size = 0;
+	for (int i = 0; i < wanted.size(); ++i)
+	{
+	    if (offsets[i] != size)
+	    {
+		std::memmove(static_cast<void*>(archive_ + size), archive_ + offsets[i], (size_t) numRead[(size_t) i] * sizeof(Record));
+	    }
+	    size += numRead[(size_t) i];
+	}
+	numSegmentsRead_ = wanted.size();
+	spans_.push_back({ archive_.getData(), size });
+	spans_.push_back({ archive_.getData(), 0 });
+	firstTicks_ = segments.isEmpty() ? 0 : segments.getReference(0).firstTicks_;
+	setWindow();
+	loadMs_ = Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - start) * 1000.0;
+	return true;
+    }
+
+    void setWindow()
+    {
+	from_ = firstTicks_ + (int64) (jmax(0.0, options_.fromSeconds_) * (double) ticksPerSecond_);
+	to_ = options_.seconds_ > 0 ? from_ + (int64) (options_.seconds_ * (double) ticksPerSecond_) : std::numeric_limits<int64>::max();
+	// a ring's empty slots have no time, so they never match
+	from_ = jmax((int64) 1, from_);
+    }
+
+    // enough chunks for every thread to have a few, none across the two spans
+    void makeChunks()
+    {
+	chunks_.clear();
+	const int64 chunkSize = jmax((int64) minChunkRecords, getNumRecords() / (numThreads_ * 8) + 1);
+	int64 begin = 0;
+	for (auto& span : spans_)
+	{
+	    for (int64 i = 0; i < span.size_; i += chunkSize)
+	    {
+		chunks_.push_back({ begin + i, begin + jmin(span.size_, i + chunkSize) });
+	    }
+	    begin += span.size_;
+	}
+    }
+
+    template <typename Function>
+    void parallelFor(int numTasks, Function&& task)
+    {
+	std::atomic<int> next { 0 };
+	auto work = [&next, &task, numTasks] ()
+	{
+	    for (int i = next++; i < numTasks; i = next++)
+	    {
+		task(i);
+	    }
+	};
+
+	struct Worker : public Thread
+	{
+	    Worker(std::function<void()> work) : Thread("loop4r analyser"), work_(work) {}
+	    void run() override     { work_(); }
+	    std::function<void()> work_;
+	};
+	OwnedArray<Worker> workers;
+	for (int i = 1; i < jmin(numThreads_, numTasks); ++i)
+	{
+	    workers.add(new Worker(work))->startThread();
+	}
+	work();
+	for (auto* worker : workers)
+	{
+	    worker->waitForThreadToExit(-1);
+	}
+    }
+
+    static uint32 sourceBit(TraceCapture::Source source)     { return 1u << (int) source; }
+
+    uint32 getSources() const
+    {
+	switch (options_.query_)
+	{
+	    case EchoQuery:         return sourceBit(TraceCapture::MidiIn);
+	    case ReconnectQuery:    return sourceBit(TraceCapture::OscIn) | sourceBit(TraceCapture::OscOut);
+	    case StateQuery:        return sourceBit(TraceCapture::OscIn);
+	    default:                return 0xff;
+	}
+    }
+
+    // which of count (up to 64) records are from one of sources and in the
+    // window, bit n for the n'th; no branches, for the compiler to vectorise
+    uint64 filter(const Record* records, int count, uint32 sources) const
+    {
+	uint64 matches = 0;
+	for (int j = 0; j < count; ++j)
+	{
+	    const uint32 wanted = ((sources >> (records[j].source_ & 31)) & 1u)
+		& (uint32) (records[j].ticks_ >= from_) & (uint32) (records[j].ticks_ <= to_);
+	    matches |= (uint64) wanted << j;
+	}
+	return matches;
+    }
+
+    void scan(const Chunk& chunk, Result& result) const
+    {
+	const uint32 sources = getSources();
+	if (options_.query_ == StateQuery)
+	{
+	    result.loops_.resize(numLoops);
+	}
+	for (int64 block = chunk.begin_; block < chunk.end_; block += blockSize)
+	{
+	    const int count = (int) jmin((int64) blockSize, chunk.end_ - block);
+	    const Record* records = &at(block);
+	    for (uint64 matches = filter(records, count, sources); matches != 0; matches &= matches - 1)
+	    {
+		const int j = countTrailingZeros(matches);
+		visit(block + j, records[j], result);
+	    }
+	}
+    }
+
+    static int countTrailingZeros(uint64 bits)
+    {
+#if JUCE_GCC || JUCE_CLANG
+	return __builtin_ctzll(bits);
+#else
+	int n = 0;
+	while ((bits & 1) == 0)
+	{
+	    bits >>= 1;
+	    ++n;
+	}
+	return n;
+#endif
+    }
+
+    void visit(int64 index, const Record& record, Result& result) const
+    {
+	result.lastTicks_ = jmax(result.lastTicks_, record.ticks_);
+	switch (options_.query_)
+	{
+	    case CountQuery:
+		{
+		    const int source = jmin(7, (int) record.source_);
+		    ++result.numRecords_[source];
+		    result.numBytes_[source] += record.size_;
+		    result.firstTicks_ = result.firstTicks_ == 0 ? record.ticks_ : jmin(result.firstTicks_, record.ticks_);
+		}
+		break;
+	    case EchoQuery:
+		visitPress(index, record, result);
+		break;
+	    case ReconnectQuery:
+		visitOsc(record, result);
+		break;
+	    case StateQuery:
+		visitState(record, result);
+		break;
+	}
+    }
+
+    // a controller, note on or program change with something in it
+    static bool isPress(const Record& record)
+    {
+	const int type = record.source_ == TraceCapture::MidiIn && record.size_ > 0 ? record.data_[0] & 0xf0 : 0;
+	return ((type == 0xb0 || type == 0x90) && record.size_ >= 3 && record.data_[2] != 0) || type == 0xc0;
+    }
+
+    // the press's echo is the first LED command after it, if that comes
+    // before the next press
+    void visitPress(int64 index, const Record& record, Result& result) const
+    {
+	if (!isPress(record))
+	{
+	    return;
+	}
+	++result.numPresses_;
+	const int64 window = (int64) echoWindowMs * ticksPerSecond_ / 1000;
+	const int64 total = getNumRecords();
+	for (int64 i = index + 1; i < total; ++i)
+	{
+	    const Record& next = at(i);
+	    if (next.ticks_ - record.ticks_ > window || (isPress(next) && next.ticks_ > record.ticks_))
+	    {
+		break;
+	    }
+	    if (next.source_ == TraceCapture::LedOut && next.ticks_ >= record.ticks_)
+	    {
+		const double ms = (double) (next.ticks_ - record.ticks_) * 1000.0 / (double) ticksPerSecond_;
+		++result.numEchoed_;
+		result.sumMs_ += ms;
+		result.maxMs_ = jmax(result.maxMs_, ms);
+		int bucket = 0;
+		while (bucket < 7 && ms >= getBucketEndMs(bucket))
+		{
+		    ++bucket;
+		}
+		++result.histogram_[bucket];
+		if (ms > getThreshold() && result.listed_.size() < (size_t) maxListed)
+		{
+		    Listed listed = { record.ticks_, next.ticks_, { record.data_[0], record.data_[1], record.data_[2] }, jmin(3, (int) record.size_), 0 };
+		    result.listed_.push_back(listed);
+		}
+		break;
+	    }
+	}
+    }
+
+    void visitOsc(const Record& record, Result& result) const
+    {
+	if (record.source_ == TraceCapture::OscOut)
+	{
+	    ++(result.firstIn_ == 0 ? result.outsBeforeFirst_ : result.outsAfterLast_);
+	    return;
+	}
+	if (result.firstIn_ == 0)
+	{
+	    result.firstIn_ = record.ticks_;
+	}
+	else
+	{
+	    addGap(result.lastIn_, record.ticks_, result.outsAfterLast_, result.listed_);
+	}
+	result.lastIn_ = record.ticks_;
+	result.outsAfterLast_ = 0;
+    }
+
+    void addGap(int64 from, int64 to, int64 numOut, std::vector<Listed>& listed) const
+    {
+	if (numOut > 0 && (double) (to - from) >= getThreshold() * (double) ticksPerSecond_ && listed.size() < (size_t) maxListed)
+	{
+	    Listed gap = { from, to, { 0, 0, 0 }, 0, numOut };
+	    listed.push_back(gap);
+	}
+    }
+
+    // SooperLooper's "/state loop state value", with or without an engine's prefix
+    void visitState(const Record& record, Result& result) const
+    {
+	OscMessageView message;
+	if (!message.parse(record.data_, record.size_) || !message.isInt32(0) || !message.isFloat32(2)
+	    || !String(message.getAddress()).endsWith("/state"))
+	{
+	    return;
+	}
+	const int loop = message.getInt32(0);
+	const int state = (int) message.getFloat32(2) - Unknown;
+	if (!isPositiveAndBelow(loop, (int) numLoops) || !isPositiveAndBelow(state, (int) numStates))
+	{
+	    return;
+	}
+	Result::Loop& info = result.loops_[(size_t) loop];
+	if (info.firstTicks_ == 0)
+	{
+	    // counted as a change, unless the chunk before ended in it
+	    info.firstTicks_ = record.ticks_;
+	    info.firstState_ = state;
+	    ++info.numChanges_[state];
+	}
+	else
+	{
+	    info.ticksIn_[info.lastState_] += record.ticks_ - info.lastTicks_;
+	    if (state != info.lastState_)
+	    {
+		++info.numChanges_[state];
+	    }
+	}
+	info.lastTicks_ = record.ticks_;
+	info.lastState_ = state;
+    }
+
+    double getThreshold() const
+    {
+	return options_.threshold_ >= 0 ? options_.threshold_ : options_.query_ == EchoQuery ? 20.0 : 2.0;
+    }
+
+    double secondsOf(int64 ticks) const
+    {
+	return (double) (ticks - firstTicks_) / (double) ticksPerSecond_;
+    }
+
+    void printCounts(std::ostream& out) const
+    {
+	static const char* const names[] = { "?", "midi in", "osc in", "midi out", "led out", "osc out", "?", "?" };
+	int64 records[8] = {}, bytes[8] = {}, first = 0, last = 0;
+	for (auto& result : results_)
+	{
+	    for (int i = 0; i < 8; ++i)
+	    {
+		records[i] += result.numRecords_[i];
+		bytes[i] += result.numBytes_[i];
+	    }
+	    if (result.firstTicks_ != 0)
+	    {
+		first = first == 0 ? result.firstTicks_ : jmin(first, result.firstTicks_);
+	    }
+	    last = jmax(last, result.lastTicks_);
+	}
+	out << "From " << String(secondsOf(first), 3) << "s to " << String(secondsOf(last), 3) << "s:" << std::endl;
+	for (int i = 1; i < 8; ++i)
+	{
+	    if (records[i] > 0)
+	    {
+		out << "  " << String(names[i]).paddedRight(' ', 9) << " " << records[i] << " records, " << bytes[i] << " bytes" << std::endl;
+	    }
+	}
+    }
+
+    void printEchoes(std::ostream& out) const
+    {
+	int64 presses = 0, echoed = 0, histogram[8] = {};
+	double sum = 0, worst = 0;
+	for (auto& result : results_)
+	{
+	    presses += result.numPresses_;
+	    echoed += result.numEchoed_;
+	    sum += result.sumMs_;
+	    worst = jmax(worst, result.maxMs_);
+	    for (int i = 0; i < 8; ++i)
+	    {
+		histogram[i] += result.histogram_[i];
+	    }
+	}
+	out << presses << " pedal presses, " << echoed << " with an LED echo before the next one and within " << echoWindowMs << "ms, mean "
+	    << String(echoed > 0 ? sum / (double) echoed : 0.0, 2) << "ms, worst " << String(worst, 2) << "ms" << std::endl;
+	for (int i = 0; i < 8; ++i)
+	{
+	    const String range = i == 0 ? "<" + String(getBucketEndMs(0), 0) : i == 7 ? ">=" + String(getBucketEndMs(6), 0)
+		: String(getBucketEndMs(i - 1), 0) + "-" + String(getBucketEndMs(i), 0);
+	    out << "  " << (range + "ms").paddedLeft(' ', 9) << " " << histogram[i] << std::endl;
+	}
+	int listed = 0;
+	for (auto& result : results_)
+	{
+	    for (auto& press : result.listed_)
+	    {
+		if (listed++ == 0)
+		{
+		    out << "Over " << String(getThreshold(), 1) << "ms:" << std::endl;
+		}
+		if (listed <= maxListed)
+		{
+		    out << "  " << String(secondsOf(press.ticks_), 3).paddedLeft(' ', 10) << "s  "
+			<< String::toHexString(press.data_, press.size_) << "  "
+			<< String((double) (press.endTicks_ - press.ticks_) * 1000.0 / (double) ticksPerSecond_, 2) << "ms" << std::endl;
+		}
+	    }
+	}
+    }
+
+    void printReconnects(std::ostream& out) const
+    {
+	// the gaps across chunks: from one's last input to the next one's first
+	std::vector<Listed> gaps;
+	int64 lastIn = 0, outs = 0, numIn = 0;
+	for (auto& result : results_)
+	{
+	    if (result.firstIn_ == 0)
+	    {
+		outs += result.outsBeforeFirst_;
+		continue;
+	    }
+	    ++numIn;
+	    if (lastIn != 0)
+	    {
+		addGap(lastIn, result.firstIn_, outs + result.outsBeforeFirst_, gaps);
+	    }
+	    gaps.insert(gaps.end(), result.listed_.begin(), result.listed_.end());
+	    lastIn = result.lastIn_;
+	    outs = result.outsAfterLast_;
+	}
+	std::sort(gaps.begin(), gaps.end(), [] (const Listed& a, const Listed& b) { return a.ticks_ < b.ticks_; });
+
+	out << gaps.size() << " stretches of " << String(getThreshold(), 1) << "s or more with nothing coming in while we sent" << std::endl;
+	double total = 0;
+	for (auto& gap : gaps)
+	{
+	    const double seconds = (double) (gap.endTicks_ - gap.ticks_) / (double) ticksPerSecond_;
+	    total += seconds;
+	    out << "  " << String(secondsOf(gap.ticks_), 3).paddedLeft(' ', 10) << "s for " << String(seconds, 3) << "s, "
+		<< gap.count_ << " messages sent meanwhile" << std::endl;
+	}
+	if (!gaps.empty())
+	{
+	    out << "  " << String(total, 3) << "s in all" << std::endl;
+	}
+	if (outs > 0)
+	{
+	    out << "  and " << outs << " messages sent after the last that came in" << (numIn == 0 ? " (nothing did)" : "") << std::endl;
+	}
+    }
+
+    // each loop's last state lasts until the last report of any
+    void printStates(std::ostream& out) const
+    {
+	int64 end = 0;
+	for (auto& result : results_)
+	{
+	    end = jmax(end, result.lastTicks_);
+	}
+	for (int loop = 0; loop < numLoops; ++loop)
+	{
+	    Result::Loop total;
+	    for (auto& result : results_)
+	    {
+		const Result::Loop& info = result.loops_[(size_t) loop];
+		if (info.firstTicks_ == 0)
+		{
+		    continue;
+		}
+		if (total.firstTicks_ == 0)
+		{
+		    total.firstTicks_ = info.firstTicks_;
+		}
+		else
+		{
+		    // the last state of the one before lasts until this one's first report
+		    total.ticksIn_[total.lastState_] += info.firstTicks_ - total.lastTicks_;
+		    if (info.firstState_ == total.lastState_)
+		    {
+			--total.numChanges_[info.firstState_];
+		    }
+		}
+		for (int s = 0; s < numStates; ++s)
+		{
+		    total.numChanges_[s] += info.numChanges_[s];
+		    total.ticksIn_[s] += info.ticksIn_[s];
+		}
+		total.lastTicks_ = info.lastTicks_;
+		total.lastState_ = info.lastState_;
+	    }
+	    if (total.firstTicks_ == 0)
+	    {
+		continue;
+	    }
+
+	    total.ticksIn_[total.lastState_] += end - total.lastTicks_;
+	    const int64 span = jmax((int64) 1, end - total.firstTicks_);
+	    out << "loop " << loop << ", " << String((double) span / (double) ticksPerSecond_, 1) << "s reported, last "
+		<< LedPatternSet::getStateName((LoopStates) (total.lastState_ + Unknown)) << ":";
+	    for (int s = 0; s < numStates; ++s)
+	    {
+		if (total.numChanges_[s] > 0 || total.ticksIn_[s] > 0)
+		{
+		    out << " " << LedPatternSet::getStateName((LoopStates) (s + Unknown)) << " "
+			<< String(100.0 * (double) total.ticksIn_[s] / (double) span, 1) << "% (" << total.numChanges_[s] << "x)";
+		}
+	    }
+	    out << std::endl;
+	}
+    }
+
+    Options options_;
+    int numThreads_ = 1;
+    bool archived_ = false;
+    int numSegmentsRead_ = 0;
+    ScopedPointer<MemoryMappedFile> map_;
+    HeapBlock<Record> archive_;
+    std::vector<Span> spans_;
+    std::vector<Chunk> chunks_;
+    std::vector<Result> results_;
+    int64 ticksPerSecond_ = 1;
+    int64 firstTicks_ = 0;
+    int64 from_ = 0;
+    int64 to_ = 0;
+    double loadMs_ = 0;
+
+    JUCE_DECLARE_NON_COPYABLE(TraceAnalyser)
+};
@@ -0,0 +1,370 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "TraceCapture.h"
+#include <atomic>
+#include <cstring>
+
+//==============================================================================
+// Keeps a whole gig of a TraceCapture: a thread at low priority follows the
+// ring, behind its writers, and appends what they recorded to an archive in
+// compressed segments, before the ring goes round. A segment is up to
+// segmentSeconds (30) or maxSegmentRecords of records, each a gzip member of
+// its own, so "zcat" on the archive gives the records back as they lay in the
+// ring. Alongside it, file.idx has one entry per segment, so read() can start
+// anywhere in a four hour capture and only decompress the segments it needs.
+// Records the ring lost before we got to them are counted, not waited for.
+//
+//   file.idx: "L4RINDEX" u32 version u32 recordSize i64 ticksPerSecond u64 0
+//             then per segment: i64 firstTicks i64 lastTicks u64 firstSequence
+//             u32 numRecords u32 compressedSize i64 offset
+//
+// in native byte order, like the trace itself. Both files are only appended
+// to and flushed a segment at a time, so after a crash they hold everything
+// up to the last whole segment.
+class TraceArchive : private Thread
+{
+public:
+    static const int defaultSegmentSeconds = 30;
+    static const int maxSegmentRecords = 8192;      // 1MB of them
+    static const int pollMs = 250;
+    static const uint32 version = 1;
+
+    TraceArchive()
+	: Thread("loop4r trace archive")
+    {
+    }
+
+    ~TraceArchive()
+    {
+	stop();
+    }
+
+    // from what the open capture's ring still holds on, to file (recreated)
+    bool start(TraceCapture& capture, const File& file, int segmentSeconds = defaultSegmentSeconds)
+    {
+	stop();
+	if (!capture.isOpen())
+	{
+	    return false;
+	}
+	file.deleteFile();
+	getIndexFile(file).deleteFile();
+	data_ = new FileOutputStream(file);
+	index_ = new FileOutputStream(getIndexFile(file));
+	if (data_->failedToOpen() || index_->failedToOpen())
+	{
+	    data_ = nullptr;
+	    index_ = nullptr;
+	    return false;
+	}
+
+	IndexHeader header;
+	std::memcpy(header.magic_, "L4RINDEX", 8);
+	header.version_ = version;
+	header.recordSize_ = TraceCapture::recordSize;
+	header.ticksPerSecond_ = capture.getTicksPerSecond();
+	header.reserved_ = 0;
+	index_->write(&header, sizeof(header));
+	index_->flush();
+
+	capture_ = &capture;
+	file_ = file;
+	const uint64 recorded = capture.getNumRecorded();
+	next_ = recorded > (uint64) capture.getNumSlots() ? recorded - (uint64) capture.getNumSlots() : 0;
+	segmentTicks_ = (int64) jmax(1, segmentSeconds) * header.ticksPerSecond_;
+	numPending_ = 0;
+	if (records_ == nullptr)
+	{
+	    records_.calloc(maxSegmentRecords);
+	}
+	startThread(1);
+	return true;
+    }
+
+    // with what's recorded until now archived
+    void stop()
+    {
+	if (isThreadRunning())
+	{
+	    signalThreadShouldExit();
+	    notify();
+	    stopThread(10000);
+	}
+	data_ = nullptr;
+	index_ = nullptr;
+	capture_ = nullptr;
+    }
+
+    bool isRunning() const              { return isThreadRunning(); }
+    const File& getFile() const         { return file_; }
+
+    int64 getNumSegments() const        { return numSegments_.load(); }
+    int64 getNumArchived() const        { return numArchived_.load(); }
+    int64 getNumLost() const            { return numLost_.load(); }
+    int64 getNumCompressedBytes() const { return numCompressedBytes_.load(); }
+
+    static File getIndexFile(const File& file)
+    {
+	return file.getSiblingFile(file.getFileName() + ".idx");
+    }
+
+    // whether file is an archive rather than a trace, going by its index
+    static bool isArchive(const File& file)
+    {
+	FileInputStream in(getIndexFile(file));
+	IndexHeader header;
+	return !in.failedToOpen() && in.read(&header, sizeof(header)) == (int) sizeof(header)
+	    && std::memcmp(header.magic_, "L4RINDEX", 8) == 0;
+    }
+
+    // an index entry
+    struct Segment
+    {
+	int64 firstTicks_;
+	int64 lastTicks_;
+	uint64 firstSequence_;
+	uint32 numRecords_;
+	uint32 compressedSize_;
+	int64 offset_;
+    };
+
+    // file's segments as its index lists them
+    static bool readIndex(const File& file, Array<Segment>& segments, int64& ticksPerSecond)
+    {
+	MemoryBlock index;
+	if (!getIndexFile(file).loadFileAsData(index) || index.getSize() < sizeof(IndexHeader))
+	{
+	    return false;
+	}
+	const IndexHeader* header = static_cast<const IndexHeader*>(index.getData());
+	if (std::memcmp(header->magic_, "L4RINDEX", 8) != 0 || header->version_ != version
+	    || header->recordSize_ != (uint32) TraceCapture::recordSize)
+	{
+	    return false;
+	}
+	ticksPerSecond = header->ticksPerSecond_;
+	const int numSegments = (int) ((index.getSize() - sizeof(IndexHeader)) / sizeof(Segment));
+	segments.clearQuick();
+	segments.addArray(reinterpret_cast<const Segment*>(header + 1), numSegments);
+	return true;
+    }
+
+    // one segment's records into out, which has room for its numRecords_;
+    // the number there, 0 if it couldn't be read
+    static int readSegment(InputStream& in, const Segment& segment, TraceCapture::Record* out)
+    {
+	MemoryBlock compressed(segment.compressedSize_);
+	if (!in.setPosition(segment.offset_) || in.read(compressed.getData(), (int) segment.compressedSize_) != (int) segment.compressedSize_)
+	{
+	    return 0;
+	}
+	MemoryInputStream source(compressed, false);
+	GZIPDecompressorInputStream gzip(&source, false, GZIPDecompressorInputStream::gzipFormat);
+	const int size = (int) (segment.numRecords_ * sizeof(TraceCapture::Record));
+	int done = 0;
+	while (done < size)
+	{
+	    const int count = gzip.read(reinterpret_cast<char*>(out) + done, size - done);
+	    if (count <= 0)
+	    {
+		break;
+	    }
+	    done += count;
+	}
+	return done / (int) sizeof(TraceCapture::Record);
+    }
+
+    // where a window fromSeconds after the archive's first record, for
+    // seconds (to the end with 0), starts and ends in ticks
+    static void getWindow(const Array<Segment>& segments, int64 ticksPerSecond, double fromSeconds, double seconds,
+			  int64& from, int64& to)
+    {
+	from = (segments.isEmpty() ? 0 : segments.getReference(0).firstTicks_) + (int64) (jmax(0.0, fromSeconds) * (double) ticksPerSecond);
+	to = seconds > 0 ? from + (int64) (seconds * (double) ticksPerSecond) : std::numeric_limits<int64>::max();
+    }
+
+    // the records in that window, oldest first. Segments wholly before or
+    // after it are skipped without reading them; numSegmentsRead says how
+    // many weren't.
+    static bool read(const File& file, double fromSeconds, double seconds, Array<TraceCapture::Entry>& entries,
+		     int64& ticksPerSecond, int* numSegmentsRead = nullptr)
+    {
+	Array<Segment> segments;
+	FileInputStream in(file);
+	if (!readIndex(file, segments, ticksPerSecond) || in.failedToOpen())
+	{
+	    return false;
+	}
+	int64 from, to;
+	getWindow(segments, ticksPerSecond, fromSeconds, seconds, from, to);
+
+	entries.clearQuick();
+	if (numSegmentsRead != nullptr)
+	{
+	    *numSegmentsRead = 0;
+	}
+	HeapBlock<TraceCapture::Record> records;
+	for (auto& segment : segments)
+	{
+	    if (segment.lastTicks_ < from)
+	    {
+		continue;
+	    }
+	    if (segment.firstTicks_ > to)
+	    {
+		break;
+	    }
+	    records.realloc(segment.numRecords_);
+	    const int numRecords = readSegment(in, segment, records);
+	    if (numRecords == 0)
+	    {
+		break;
+	    }
+	    if (numSegmentsRead != nullptr)
+	    {
+		++*numSegmentsRead;
+	    }
+	    for (int r = 0; r < numRecords; ++r)
+	    {
+		if (records[r].ticks_ >= from && records[r].ticks_ <= to)
+		{
+		    entries.add(TraceCapture::toEntry(records[r]));
+		}
+	    }
+	}
+	return true;
+    }
+
+private:
+    struct IndexHeader
+    {
+	char magic_[8];
+	uint32 version_;
+	uint32 recordSize_;
+	int64 ticksPerSecond_;
+	uint64 reserved_;
+    };
+
+    static_assert(sizeof(IndexHeader) == 32, "archive index header layout");
+    static_assert(sizeof(Segment) == 40, "archive index entry layout");
+
+    void run() override
+    {
+	while (!threadShouldExit())
+	{
+	    wait(pollMs);
+	    collect();
+	    if (numPending_ > 0 && records_[numPending_ - 1].ticks_ - records_[0].ticks_ >= segmentTicks_)
+	    {
+		writeSegment();
+	    }
+	}
+	collect();
+	writeSegment();
+    }
+
+    // whatever the ring has for us, a segment written whenever it's full
+    void collect()
+    {
+	const uint64 recorded = capture_->getNumRecorded();
+	for (; next_ < recorded; ++next_)
+	{
+	    const TraceCapture::CopyResult result = capture_->copyRecord(next_, records_[numPending_]);
+	    if (result == TraceCapture::NotYet)
+	    {
+		// a writer that stopped half way (a crashed thread) isn't waited for forever
+		if (recorded - next_ < (uint64) capture_->getNumSlots() / 2)
+		{
+		    return;
+		}
+		++numLost_;
+		continue;
+	    }
+	    if (result == TraceCapture::Overwritten)
+	    {
+		++numLost_;
+		continue;
+	    }
+	    if (numPending_ == 0)
+	    {
+		firstSequence_ = next_ + 1;
+	    }
+	    if (++numPending_ == maxSegmentRecords)
+	    {
+		writeSegment();
+	    }
+	}
+    }
+
+    void writeSegment()
+    {
+	if (numPending_ == 0)
+	{
+	    return;
+	}
+	MemoryOutputStream compressed;
+	{
+	    GZIPCompressorOutputStream gzip(&compressed, 6, false, GZIPCompressorOutputStream::windowBitsGZIP);
+	    gzip.write(records_.getData(), (size_t) numPending_ * sizeof(TraceCapture::Record));
+	}
+
+	Segment segment;
+	segment.firstTicks_ = records_[0].ticks_;
+	segment.lastTicks_ = records_[numPending_ - 1].ticks_;
+	for (int i = 0; i < numPending_; ++i)
+	{
+	    // the writers' clocks are read before they take a slot, so not quite in order
+	    segment.firstTicks_ = jmin(segment.firstTicks_, records_[i].ticks_);
+	    segment.lastTicks_ = jmax(segment.lastTicks_, records_[i].ticks_);
+	}
+	segment.firstSequence_ = firstSequence_;
+	segment.numRecords_ = (uint32) numPending_;
+	segment.compressedSize_ = (uint32) compressed.getDataSize();
+	segment.offset_ = data_->getPosition();
+	data_->write(compressed.getData(), compressed.getDataSize());
+	data_->flush();
+	index_->write(&segment, sizeof(segment));
+	index_->flush();
+
+	numSegments_ += 1;
+	numArchived_ += numPending_;
+	numCompressedBytes_ += (int64) compressed.getDataSize();
+	numPending_ = 0;
+    }
+
+    TraceCapture* capture_ = nullptr;
+    File file_;
+    ScopedPointer<FileOutputStream> data_;
+    ScopedPointer<FileOutputStream> index_;
+    HeapBlock<TraceCapture::Record> records_;
+    int numPending_ = 0;
+    uint64 next_ = 0;               // the capture's record to archive next
+    uint64 firstSequence_ = 0;
+    int64 segmentTicks_ = 0;
+
+    std::atomic<int64> numSegments_ { 0 };
+    std::atomic<int64> numArchived_ { 0 };
+    std::atomic<int64> numLost_ { 0 };
+    std::atomic<int64> numCompressedBytes_ { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE(TraceArchive)
+};
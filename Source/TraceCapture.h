@@ -0,0 +1,292 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+//==============================================================================
+// Records MIDI and OSC traffic in and out as fixed size binary records in a
+// memory mapped ring file, normally on tmpfs (/dev/shm). Recording is an
+// atomic increment and a memcpy, so any thread may do it, and since the
+// mapping is shared the file holds everything up to the moment of a crash.
+//
+// The file is a 64 byte header followed by numRecords records of 128 bytes:
+//
+//   header: "L4RTRACE" u32 version u32 recordSize u32 numRecords u32 0
+//           i64 ticksPerSecond u64 next (records written so far)
+//   record: i64 highResolutionTicks u32 sequence u8 source u8 flags u16 size
+//           u8 data[112]
+//
+// in native byte order. Record n goes in slot n % numRecords and its sequence
+// is n + 1, stored last; a sequence of 0 is a slot that's empty or was being
+// written. Source says where the bytes came from or went; flags bit 0 means
+// the data was cut short. MIDI is stored as the raw message, LED commands as
+// cc and value and OSC as the datagram, or for incoming messages (which JUCE
+// hands us parsed) encoded again from their int, float and string arguments.
+class TraceCapture
+{
+public:
+    enum Source
+    {
+	MidiIn = 1,
+	OscIn,
+	MidiOut,
+	LedOut,
+	OscOut
+    };
+
+    static const int recordSize = 128;
+    static const int maxData = recordSize - 16;
+    static const int defaultNumRecords = 65536;
+    static const uint32 version = 1;
+    static const uint8 truncated = 1;
+
+    TraceCapture() {}
+
+    ~TraceCapture()
+    {
+	close();
+    }
+
+    // (re)creates the file at its full size and maps it
+    bool open(const File& file, int numRecords = defaultNumRecords)
+    {
+	close();
+	numRecords = jmax(16, numRecords);
+	const int64 fileSize = (int64) sizeof(Header) + (int64) numRecords * recordSize;
+	{
+	    file.deleteFile();
+	    FileOutputStream out(file);
+	    if (out.failedToOpen() || !out.setPosition(fileSize - 1) || !out.writeByte(0))
+	    {
+		return false;
+	    }
+	}
+
+	map_ = new MemoryMappedFile(file, MemoryMappedFile::readWrite);
+	if (map_->getData() == nullptr || (int64) map_->getSize() != fileSize)
+	{
+	    map_ = nullptr;
+	    return false;
+	}
+
+	Header* header = static_cast<Header*>(map_->getData());
+	std::memcpy(header->magic_, "L4RTRACE", 8);
+	header->version_ = version;
+	header->recordSize_ = recordSize;
+	header->numRecords_ = (uint32) numRecords;
+	header->reserved_ = 0;
+	header->ticksPerSecond_ = Time::getHighResolutionTicksPerSecond();
+	header->next_.store(0);
+	numRecords_ = (uint32) numRecords;
+	file_ = file;
+	records_.store(reinterpret_cast<Record*>(header + 1));
+	return true;
+    }
+
+    void close()
+    {
+	records_.store(nullptr);
+	map_ = nullptr;
+    }
+
+    bool isOpen() const                 { return records_.load(std::memory_order_relaxed) != nullptr; }
+    const File& getFile() const         { return file_; }
+
+    // data beyond maxData is dropped; cutShort flags a record the caller already had to shorten
+    void record(Source source, const void* data, int size, bool cutShort = false)
+    {
+	Record* records = records_.load(std::memory_order_acquire);
+	if (records == nullptr)
+	{
+	    return;
+	}
+
+	const uint64 n = header()->next_.fetch_add(1, std::memory_order_relaxed);
+	Record& record = records[n % numRecords_];
+	record.sequence_.store(0, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	record.ticks_ = Time::getHighResolutionTicks();
+	record.source_ = (uint8) source;
+	record.flags_ = (cutShort || size > maxData) ? truncated : 0;
+	record.size_ = (uint16) jmin(size, (int) maxData);
+	std::memcpy(record.data_, data, (size_t) record.size_);
+	record.sequence_.store((uint32) (n + 1), std::memory_order_release);
+    }
+
+    // one record as read back from a file
+    struct Entry
+    {
+	int64 ticks_;
+	Source source_;
+	bool cutShort_;
+	int size_;
+	uint8 data_[maxData];
+    };
+
+    // a record as it lies in the ring, the file and a TraceArchive's segments
+    struct Record
+    {
+	int64 ticks_;
+	std::atomic<uint32> sequence_;
+	uint8 source_;
+	uint8 flags_;
+	uint16 size_;
+	uint8 data_[maxData];
+    };
+
+    enum CopyResult
+    {
+	Copied,
+	NotYet,         // not written yet, or still being written
+	Overwritten     // the ring has gone round since
+    };
+
+    // record n (the first is 0) as it is in the ring now, for a reader behind
+    // the writers like TraceArchive
+    CopyResult copyRecord(uint64 n, Record& out) const
+    {
+	const Record* records = records_.load(std::memory_order_acquire);
+	if (records == nullptr)
+	{
+	    return NotYet;
+	}
+	const Record& record = records[n % numRecords_];
+	const uint32 sequence = record.sequence_.load(std::memory_order_acquire);
+	if (sequence != (uint32) (n + 1))
+	{
+	    return sequence > (uint32) (n + 1) ? Overwritten : NotYet;
+	}
+	out.ticks_ = record.ticks_;
+	out.source_ = record.source_;
+	out.flags_ = record.flags_;
+	out.size_ = record.size_;
+	std::memcpy(out.data_, record.data_, (size_t) jmin((int) record.size_, (int) maxData));
+	std::atomic_thread_fence(std::memory_order_acquire);
+
+	// a writer that got to the slot meanwhile has zeroed its sequence first
+	if (record.sequence_.load(std::memory_order_relaxed) != sequence)
+	{
+	    return Overwritten;
+	}
+	out.sequence_.store(sequence, std::memory_order_relaxed);
+	return Copied;
+    }
+
+    static Entry toEntry(const Record& record)
+    {
+	Entry entry;
+	entry.ticks_ = record.ticks_;
+	entry.source_ = (Source) record.source_;
+	entry.cutShort_ = (record.flags_ & truncated) != 0;
+	entry.size_ = jmin((int) record.size_, (int) maxData);
+	std::memcpy(entry.data_, record.data_, (size_t) entry.size_);
+	return entry;
+    }
+
+    // the slots of a trace file's contents (loaded or mapped), nullptr if it
+    // isn't a trace
+    static const Record* getSlots(const void* data, size_t size, int& numSlots, int64& ticksPerSecond)
+    {
+	const Header* header = static_cast<const Header*>(data);
+	if (data == nullptr || size < sizeof(Header) || std::memcmp(header->magic_, "L4RTRACE", 8) != 0
+	    || header->version_ != version || header->recordSize_ != (uint32) recordSize
+	    || size < sizeof(Header) + (size_t) header->numRecords_ * recordSize)
+	{
+	    return nullptr;
+	}
+	numSlots = (int) header->numRecords_;
+	ticksPerSecond = header->ticksPerSecond_;
+	return reinterpret_cast<const Record*>(header + 1);
+    }
+
+    // the complete records in the file, oldest first; false if it isn't a trace
+    static bool read(const File& file, Array<Entry>& entries, int64& ticksPerSecond)
+    {
+	MemoryBlock block;
+	int numSlots = 0;
+	const Record* records = file.loadFileAsData(block) ? getSlots(block.getData(), block.getSize(), numSlots, ticksPerSecond) : nullptr;
+	if (records == nullptr)
+	{
+	    return false;
+	}
+
+	struct Slot
+	{
+	    uint32 sequence_;
+	    const Record* record_;
+	};
+	Array<Slot> slots;
+	for (int i = 0; i < numSlots; ++i)
+	{
+	    const uint32 sequence = records[i].sequence_.load();
+	    if (sequence != 0)
+	    {
+		slots.add({ sequence, records + i });
+	    }
+	}
+	std::sort(slots.begin(), slots.end(), [] (const Slot& a, const Slot& b) { return a.sequence_ < b.sequence_; });
+
+	entries.clearQuick();
+	entries.ensureStorageAllocated(slots.size());
+	for (auto& slot : slots)
+	{
+	    entries.add(toEntry(*slot.record_));
+	}
+	return true;
+    }
+
+    uint64 getNumRecorded() const
+    {
+	return isOpen() ? header()->next_.load(std::memory_order_relaxed) : 0;
+    }
+
+    int getNumSlots() const             { return (int) numRecords_; }
+    int64 getTicksPerSecond() const     { return isOpen() ? header()->ticksPerSecond_ : Time::getHighResolutionTicksPerSecond(); }
+
+private:
+    struct Header
+    {
+	char magic_[8];
+	uint32 version_;
+	uint32 recordSize_;
+	uint32 numRecords_;
+	uint32 reserved_;
+	int64 ticksPerSecond_;
+	std::atomic<uint64> next_;
+	char padding_[24];
+    };
+
+    static_assert(sizeof(Header) == 64, "trace header layout");
+    static_assert(sizeof(Record) == recordSize, "trace record layout");
+
+    Header* header() const              { return static_cast<Header*>(map_->getData()); }
+
+    ScopedPointer<MemoryMappedFile> map_;
+    std::atomic<Record*> records_ { nullptr };
+    uint32 numRecords_ = 0;
+    File file_;
+
+    JUCE_DECLARE_NON_COPYABLE(TraceCapture)
+};
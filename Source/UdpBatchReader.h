@@ -0,0 +1,245 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+#if JUCE_LINUX
+ #include <cstring>
+ #include <ctime>
+ #include <sys/socket.h>
+ #include <netinet/in.h>
+#endif
+
+//==============================================================================
+// Reads every datagram waiting on a non-blocking UDP socket with as few
+// recvmmsg() calls as possible, into slots allocated up front. A burst of
+// SooperLooper updates is then one syscall instead of a wakeup and a read
+// each. Datagrams longer than a slot are dropped and counted.
+//
+// A socket set up with configure() also has the kernel tell us, with each
+// datagram, how many it has dropped for want of buffer space (SO_RXQ_OVFL)
+// and when the datagram came in (SO_TIMESTAMPNS). Who sent the one being
+// handled is getSource() meanwhile, and getArrivalTicks() when it arrived.
+class UdpBatchReader
+{
+public:
+    static const int numSlots = 32;
+    static const int slotSize = 8192;
+
+    UdpBatchReader() : buffers_((size_t) numSlots * slotSize)
+    {
+#if JUCE_LINUX
+	for (int i = 0; i < numSlots; ++i)
+	{
+	    iovecs_[i].iov_base = buffers_ + i * slotSize;
+	    iovecs_[i].iov_len = slotSize;
+	}
+#endif
+    }
+
+    // Kernel buffer sizes in bytes for fd (0 leaves one as it is), and the
+    // drop counts and receive times turned on; false if any of it was
+    // refused. The kernel doubles what it's given and caps it at
+    // net.core.rmem_max/wmem_max.
+    static bool configure(int fd, int receiveBytes, int sendBytes)
+    {
+#if JUCE_LINUX
+	const int on = 1;
+	return (receiveBytes <= 0 || ::setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &receiveBytes, sizeof(receiveBytes)) == 0)
+	    && (sendBytes <= 0 || ::setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &sendBytes, sizeof(sendBytes)) == 0)
+	    && ::setsockopt(fd, SOL_SOCKET, SO_RXQ_OVFL, &on, sizeof(on)) == 0
+	    && ::setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) == 0;
+#else
+	ignoreUnused(fd, receiveBytes, sendBytes);
+	return false;
+#endif
+    }
+
+    // what the kernel gives fd for its receive buffer, -1 if it won't say
+    static int getReceiveBufferSize(int fd)
+    {
+#if JUCE_LINUX
+	int size = 0;
+	socklen_t length = sizeof(size);
+	return ::getsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, &length) == 0 ? size : -1;
+#else
+	ignoreUnused(fd);
+	return -1;
+#endif
+    }
+
+    // calls onDatagram(const char* data, int size) for each, in arrival order.
+    // With drops given it's kept at the socket's drop count, the one the
+    // kernel has reported since it was made, and the receive times are read.
+    template <typename Function>
+    void read(int fd, Function onDatagram, uint32* drops = nullptr)
+    {
+#if JUCE_LINUX
+	for (;;)
+	{
+	    for (int i = 0; i < numSlots; ++i)
+	    {
+		headers_[i] = {};
+		headers_[i].msg_hdr.msg_iov = &iovecs_[i];
+		headers_[i].msg_hdr.msg_iovlen = 1;
+		headers_[i].msg_hdr.msg_name = &names_[i];
+		headers_[i].msg_hdr.msg_namelen = sizeof(names_[i]);
+		if (drops != nullptr)
+		{
+		    headers_[i].msg_hdr.msg_control = controls_[i];
+		    headers_[i].msg_hdr.msg_controllen = controlSize;
+		}
+	    }
+
+	    const int received = ::recvmmsg(fd, headers_, numSlots, MSG_DONTWAIT, nullptr);
+	    if (received <= 0)
+	    {
+		return;
+	    }
+
+	    // the kernel stamps with the wall clock, taken back to our ticks
+	    // from both clocks read once for the batch
+	    timespec wallNow = {};
+	    ::clock_gettime(CLOCK_REALTIME, &wallNow);
+	    const int64 ticksNow = Time::getHighResolutionTicks();
+	    ++numBatches_;
+	    numDatagrams_ += received;
+	    maxBatch_ = jmax(maxBatch_, received);
+	    if (drops != nullptr)
+	    {
+		readDrops(headers_[received - 1].msg_hdr, *drops);
+	    }
+	    for (int i = 0; i < received; ++i)
+	    {
+		if ((headers_[i].msg_hdr.msg_flags & MSG_TRUNC) != 0)
+		{
+		    ++numTruncated_;
+		    continue;
+		}
+		source_ = sourceKey(names_[i], headers_[i].msg_hdr.msg_namelen);
+		arrivalTicks_ = drops != nullptr ? readArrival(headers_[i].msg_hdr, wallNow, ticksNow) : 0;
+		onDatagram(buffers_ + i * slotSize, (int) headers_[i].msg_len);
+	    }
+
+	    // a full batch may have left more behind
+	    if (received < numSlots)
+	    {
+		return;
+	    }
+	}
+#endif
+    }
+
+    int64 getNumBatches() const     { return numBatches_; }
+    int64 getNumDatagrams() const   { return numDatagrams_; }
+    int64 getNumTruncated() const   { return numTruncated_; }
+    int64 getNumDropped() const     { return numDropped_; }
+    int getMaxBatch() const         { return maxBatch_; }
+
+    // the sender of the datagram onDatagram has, as a number unique to its
+    // address and port: an IPv4 address above the port, an IPv6 one hashed
+    uint64 getSource() const        { return source_; }
+
+    // when the kernel had it, a Time::getHighResolutionTicks() value, 0 if
+    // it didn't say
+    int64 getArrivalTicks() const   { return arrivalTicks_; }
+    int64 getNumStamped() const     { return numStamped_; }
+
+    double getMeanBatch() const
+    {
+	return numBatches_ > 0 ? (double) numDatagrams_ / (double) numBatches_ : 0.0;
+    }
+
+private:
+#if JUCE_LINUX
+    static const size_t controlSize = CMSG_SPACE(sizeof(uint32)) + CMSG_SPACE(sizeof(timespec));
+
+    static uint64 sourceKey(const sockaddr_storage& name, socklen_t length)
+    {
+	if (name.ss_family == AF_INET && length >= sizeof(sockaddr_in))
+	{
+	    const sockaddr_in& address = reinterpret_cast<const sockaddr_in&>(name);
+	    return ((uint64) ntohl(address.sin_addr.s_addr) << 16) | ntohs(address.sin_port);
+	}
+	if (name.ss_family == AF_INET6 && length >= sizeof(sockaddr_in6))
+	{
+	    const sockaddr_in6& address = reinterpret_cast<const sockaddr_in6&>(name);
+	    uint64 hash = 14695981039346656037ull;
+	    for (const uint8 byte : address.sin6_addr.s6_addr)
+	    {
+		hash = (hash ^ byte) * 1099511628211ull;
+	    }
+	    return (hash << 16) ^ ntohs(address.sin6_port);
+	}
+	return 0;
+    }
+
+    int64 readArrival(msghdr& header, const timespec& wallNow, int64 ticksNow)
+    {
+	for (cmsghdr* message = CMSG_FIRSTHDR(&header); message != nullptr; message = CMSG_NXTHDR(&header, message))
+	{
+	    if (message->cmsg_level == SOL_SOCKET && message->cmsg_type == SCM_TIMESTAMPNS)
+	    {
+		timespec stamp;
+		std::memcpy(&stamp, CMSG_DATA(message), sizeof(stamp));
+		const double ago = (double) (wallNow.tv_sec - stamp.tv_sec) + (double) (wallNow.tv_nsec - stamp.tv_nsec) * 1.0e-9;
+		++numStamped_;
+		return ticksNow - (int64) (jmax(0.0, ago) * (double) Time::getHighResolutionTicksPerSecond());
+	    }
+	}
+	return 0;
+    }
+
+    // the count only ever grows, so the latest datagram's is all we need
+    void readDrops(msghdr& header, uint32& drops)
+    {
+	for (cmsghdr* message = CMSG_FIRSTHDR(&header); message != nullptr; message = CMSG_NXTHDR(&header, message))
+	{
+	    if (message->cmsg_level == SOL_SOCKET && message->cmsg_type == SO_RXQ_OVFL)
+	    {
+		uint32 count;
+		std::memcpy(&count, CMSG_DATA(message), sizeof(count));
+		numDropped_ += (int64) (uint32) (count - drops);
+		drops = count;
+	    }
+	}
+    }
+#endif
+
+    HeapBlock<char> buffers_;
+#if JUCE_LINUX
+    iovec iovecs_[numSlots];
+    mmsghdr headers_[numSlots];
+    sockaddr_storage names_[numSlots];
+    alignas(cmsghdr) char controls_[numSlots][controlSize];
+#endif
+
+    int64 numBatches_ = 0;
+    int64 numDatagrams_ = 0;
+    int64 numTruncated_ = 0;
+    int64 numDropped_ = 0;
+    int maxBatch_ = 0;
+    uint64 source_ = 0;
+    int64 arrivalTicks_ = 0;
+    int64 numStamped_ = 0;
+
+    JUCE_DECLARE_NON_COPYABLE(UdpBatchReader)
+};
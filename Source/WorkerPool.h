@@ -0,0 +1,347 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include <atomic>
+
+#if JUCE_LINUX
+ #include <cerrno>
+ #include <cstring>
+ #include <poll.h>
+ #include <sched.h>
+ #include <sys/eventfd.h>
+ #include <unistd.h>
+#endif
+
+//==============================================================================
+// A few threads for the jobs nothing should wait on: writing files, listing
+// devices again and the like. Each worker has a bounded queue of its own;
+// submit() puts a job on the next one in turn, or the one after when that's
+// full, and a worker with nothing of its own left steals from the others, so
+// a long job holds up only the worker running it.
+//
+// The queues are lock-free for any number of threads on either end (Vyukov's
+// bounded MPMC ring, a sequence number per slot), and a job is a function
+// pointer and its context, so submitting never locks, allocates or blocks:
+// any thread may do it, the MIDI and control threads included. A worker out
+// of jobs sleeps in poll() on an eventfd, written to only while one sleeps.
+//
+// The workers are all called "loop4r worker" for "sched", and start pinned
+// to the CPUs they're given, if any, so they keep off the ones reserved for
+// the realtime threads.
+class WorkerPool
+{
+public:
+    typedef void (*JobFunction)(void* context);
+
+    static const int maxWorkers = 4;
+    static const int queueSize = 64;        // per worker, a power of two
+
+    WorkerPool() {}
+
+    ~WorkerPool()
+    {
+	stop();
+    }
+
+    // numWorkers of them, on cpus unless it's empty
+    bool start(int numWorkers, const BigInteger& cpus)
+    {
+	stop();
+#if JUCE_LINUX
+	wakeFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC | EFD_SEMAPHORE);
+	if (wakeFd_ < 0)
+	{
+	    return false;
+	}
+#endif
+	cpus_ = cpus;
+	numWorkers_ = jlimit(1, (int) maxWorkers, numWorkers);
+	for (int i = 0; i < numWorkers_; ++i)
+	{
+	    Worker& worker = workers_[i];
+	    for (int slot = 0; slot < queueSize; ++slot)
+	    {
+		worker.slots_[slot].sequence_ = (uint32) slot;
+	    }
+	    worker.enqueue_ = 0;
+	    worker.dequeue_ = 0;
+	    worker.thread_ = new WorkerThread(*this, i);
+	    worker.thread_->startThread(3);
+	}
+	running_ = true;
+	return true;
+    }
+
+    // waits for the jobs already running, drops the ones still queued
+    void stop()
+    {
+	if (!running_.exchange(false))
+	{
+	    return;
+	}
+	for (int i = 0; i < numWorkers_; ++i)
+	{
+	    workers_[i].thread_->signalThreadShouldExit();
+	}
+	wake(numWorkers_);
+	for (int i = 0; i < numWorkers_; ++i)
+	{
+	    workers_[i].thread_->stopThread(5000);
+	    workers_[i].thread_ = nullptr;
+	}
+	// numWorkers_ stays, for a submit() that saw the pool running a moment ago
+#if JUCE_LINUX
+	::close(wakeFd_);
+	wakeFd_ = -1;
+#endif
+    }
+
+    bool isRunning() const              { return running_.load(); }
+    int getNumWorkers() const           { return numWorkers_; }
+
+    // false if the pool isn't running or every queue is full; from any thread
+    bool submit(JobFunction function, void* context)
+    {
+	if (!running_.load(std::memory_order_acquire))
+	{
+	    return false;
+	}
+	const int first = (int) (next_.fetch_add(1, std::memory_order_relaxed) % (uint32) numWorkers_);
+	for (int i = 0; i < numWorkers_; ++i)
+	{
+	    if (push(workers_[(first + i) % numWorkers_], function, context))
+	    {
+		numSubmitted_.fetch_add(1, std::memory_order_relaxed);
+		if (sleeping_.load() > 0)
+		{
+		    wake(1);
+		}
+		return true;
+	    }
+	}
+	numRejected_.fetch_add(1, std::memory_order_relaxed);
+	return false;
+    }
+
+    int64 getNumSubmitted() const       { return numSubmitted_.load(std::memory_order_relaxed); }
+    int64 getNumRejected() const        { return numRejected_.load(std::memory_order_relaxed); }
+    int64 getNumStolen() const          { return numStolen_.load(std::memory_order_relaxed); }
+
+private:
+    struct Slot
+    {
+	std::atomic<uint32> sequence_ { 0 };
+	JobFunction function_ = nullptr;
+	void* context_ = nullptr;
+    };
+
+    class WorkerThread : public Thread
+    {
+    public:
+	WorkerThread(WorkerPool& pool, int index)
+	    : Thread("loop4r worker"), pool_(pool), index_(index)
+	{
+	}
+
+	void run() override
+	{
+	    pool_.runWorker(*this, index_);
+	}
+
+    private:
+	WorkerPool& pool_;
+	const int index_;
+    };
+
+    struct Worker
+    {
+	Slot slots_[queueSize];
+	std::atomic<uint32> enqueue_ { 0 };
+	std::atomic<uint32> dequeue_ { 0 };
+	ScopedPointer<WorkerThread> thread_;
+    };
+
+    static bool push(Worker& worker, JobFunction function, void* context)
+    {
+	uint32 position = worker.enqueue_.load(std::memory_order_relaxed);
+	for (;;)
+	{
+	    Slot& slot = worker.slots_[position & (queueSize - 1)];
+	    const int32 difference = (int32) (slot.sequence_.load(std::memory_order_acquire) - position);
+	    if (difference == 0)
+	    {
+		if (worker.enqueue_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+		{
+		    slot.function_ = function;
+		    slot.context_ = context;
+		    slot.sequence_.store(position + 1, std::memory_order_release);
+		    return true;
+		}
+	    }
+	    else if (difference < 0)
+	    {
+		return false;
+	    }
+	    else
+	    {
+		position = worker.enqueue_.load(std::memory_order_relaxed);
+	    }
+	}
+    }
+
+    static bool pop(Worker& worker, JobFunction& function, void*& context)
+    {
+	uint32 position = worker.dequeue_.load(std::memory_order_relaxed);
+	for (;;)
+	{
+	    Slot& slot = worker.slots_[position & (queueSize - 1)];
+	    const int32 difference = (int32) (slot.sequence_.load(std::memory_order_acquire) - (position + 1));
+	    if (difference == 0)
+	    {
+		if (worker.dequeue_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+		{
+		    function = slot.function_;
+		    context = slot.context_;
+		    slot.sequence_.store(position + queueSize, std::memory_order_release);
+		    return true;
+		}
+	    }
+	    else if (difference < 0)
+	    {
+		return false;
+	    }
+	    else
+	    {
+		position = worker.dequeue_.load(std::memory_order_relaxed);
+	    }
+	}
+    }
+
+    // its own queue first, then everyone else's
+    bool take(int index, JobFunction& function, void*& context)
+    {
+	if (pop(workers_[index], function, context))
+	{
+	    return true;
+	}
+	for (int i = 1; i < numWorkers_; ++i)
+	{
+	    if (pop(workers_[(index + i) % numWorkers_], function, context))
+	    {
+		numStolen_.fetch_add(1, std::memory_order_relaxed);
+		return true;
+	    }
+	}
+	return false;
+    }
+
+    void runWorker(Thread& thread, int index)
+    {
+	pinWorker();
+	JobFunction function;
+	void* context;
+	while (!thread.threadShouldExit())
+	{
+	    if (take(index, function, context))
+	    {
+		function(context);
+		continue;
+	    }
+
+	    // a job submitted after the count went up wakes us, one before it is found now
+	    sleeping_.fetch_add(1);
+	    if (take(index, function, context))
+	    {
+		sleeping_.fetch_sub(1);
+		function(context);
+		continue;
+	    }
+	    sleep(thread);
+	    sleeping_.fetch_sub(1);
+	}
+    }
+
+#if JUCE_LINUX
+    void wake(int numWorkers)
+    {
+	const uint64 count = (uint64) numWorkers;
+	(void) ::write(wakeFd_, &count, sizeof(count));
+    }
+
+    void sleep(Thread& thread)
+    {
+	pollfd pfd = { wakeFd_, POLLIN, 0 };
+	if (!thread.threadShouldExit() && ::poll(&pfd, 1, -1) > 0)
+	{
+	    uint64 count;
+	    (void) ::read(wakeFd_, &count, sizeof(count));
+	}
+    }
+
+    void pinWorker()
+    {
+	if (cpus_.isZero())
+	{
+	    return;
+	}
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for (int cpu = cpus_.findNextSetBit(0); cpu >= 0 && cpu < CPU_SETSIZE; cpu = cpus_.findNextSetBit(cpu + 1))
+	{
+	    CPU_SET(cpu, &set);
+	}
+	if (::sched_setaffinity(0, sizeof(set), &set) != 0)
+	{
+	    std::cerr << "Couldn't pin a worker thread: " << std::strerror(errno) << std::endl;
+	}
+    }
+#else
+    void wake(int)
+    {
+	wakeEvent_.signal();
+    }
+
+    void sleep(Thread&)
+    {
+	wakeEvent_.wait(100);
+    }
+
+    void pinWorker()                    {}
+
+    WaitableEvent wakeEvent_;
+#endif
+
+    Worker workers_[maxWorkers];
+    int numWorkers_ = 0;
+    BigInteger cpus_;
+    std::atomic<bool> running_ { false };
+    std::atomic<uint32> next_ { 0 };
+    std::atomic<int> sleeping_ { 0 };
+    std::atomic<int64> numSubmitted_ { 0 };
+    std::atomic<int64> numRejected_ { 0 };
+    std::atomic<int64> numStolen_ { 0 };
+#if JUCE_LINUX
+    int wakeFd_ = -1;
+#endif
+
+    JUCE_DECLARE_NON_COPYABLE(WorkerPool)
+};